@@ -19,12 +19,18 @@
  * MA 02110-1301 USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
+#include <windows.h>
 #endif
 
 #include "common.h"
@@ -38,6 +44,15 @@
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
+#define NTHREADS 8
+
+typedef struct trace_writer_t {
+	FILE *fp;
+	unsigned int count;
+	unsigned long long threads[NTHREADS];
+	unsigned int nthreads;
+} trace_writer_t;
+
 typedef struct backend_table_t {
 	const char *name;
 	dc_family_t type;
@@ -152,6 +167,9 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 	const dc_event_devinfo_t *devinfo = (const dc_event_devinfo_t *) data;
 	const dc_event_clock_t *clock = (const dc_event_clock_t *) data;
 	const dc_event_vendor_t *vendor = (const dc_event_vendor_t *) data;
+	const dc_event_stats_t *stats = (const dc_event_stats_t *) data;
+	const dc_event_logbook_t *logbook = (const dc_event_logbook_t *) data;
+	const dc_event_throughput_t *throughput = (const dc_event_throughput_t *) data;
 
 	switch (event) {
 	case DC_EVENT_WAITING:
@@ -178,6 +196,47 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 			message ("%02X", vendor->data[i]);
 		message ("\n");
 		break;
+	case DC_EVENT_STATS:
+		message ("Event: in=%llu, out=%llu, reads=%u, writes=%u, timeouts=%u, retries=%u, checksums=%u, rtt=",
+			stats->bytes_in, stats->bytes_out, stats->reads, stats->writes,
+			stats->timeouts, stats->retries, stats->checksums);
+		for (unsigned int i = 0; i < DC_EVENT_STATS_NBUCKETS; ++i)
+			message ("%s%u", i ? "/" : "", stats->rtt[i]);
+		message ("\n");
+		message ("Event: open=%.3f, download=%.3f, logbook=%.3f, profile=%.3f, callback=%.3f\n",
+			stats->phases[DC_PHASE_OPEN] / 1e6,
+			stats->phases[DC_PHASE_DOWNLOAD] / 1e6,
+			stats->phases[DC_PHASE_LOGBOOK] / 1e6,
+			stats->phases[DC_PHASE_PROFILE] / 1e6,
+			stats->phases[DC_PHASE_CALLBACK] / 1e6);
+		if (stats->memory.allocations) {
+			message ("Event: memory=%lu, peak=%lu, allocations=%u, releases=%u\n",
+				(unsigned long) stats->memory.current, (unsigned long) stats->memory.peak,
+				stats->memory.allocations, stats->memory.releases);
+		}
+		break;
+	case DC_EVENT_LOGBOOK:
+		message ("Event: logbook, %u dives\n", logbook->count);
+		for (unsigned int i = 0; i < logbook->count; ++i) {
+			const dc_logbook_entry_t *entry = &logbook->entries[i];
+			message ("Event: dive %u:", i);
+			if (entry->flags & DC_LOGBOOK_DATETIME)
+				message (" datetime=%04i-%02i-%02i %02i:%02i:%02i",
+					entry->datetime.year, entry->datetime.month, entry->datetime.day,
+					entry->datetime.hour, entry->datetime.minute, entry->datetime.second);
+			if (entry->flags & DC_LOGBOOK_MAXDEPTH)
+				message (" maxdepth=%.2f", entry->maxdepth);
+			if (entry->flags & DC_LOGBOOK_DIVETIME)
+				message (" divetime=%u", entry->divetime);
+			message ("\n");
+		}
+		break;
+	case DC_EVENT_THROUGHPUT:
+		message ("Event: throughput %.0f/s, eta=%.1fs, elapsed=%.1fs, idle=%.1fs%s\n",
+			throughput->rate, throughput->eta / 1000.0,
+			throughput->elapsed / 1000.0, throughput->idle / 1000.0,
+			throughput->refined ? ", refined" : "");
+		break;
 	default:
 		break;
 	}
@@ -340,3 +399,56 @@ dctool_file_read (const char *filename)
 
 	return buffer;
 }
+
+static void
+trace_cb (const char *name, unsigned long long thread, unsigned long long begin, unsigned long long end, void *userdata)
+{
+	trace_writer_t *writer = (trace_writer_t *) userdata;
+
+	// Number the threads in order of appearance.
+	unsigned int tid = 0;
+	while (tid < writer->nthreads && writer->threads[tid] != thread)
+		tid++;
+	if (tid == writer->nthreads && writer->nthreads < C_ARRAY_SIZE (writer->threads))
+		writer->threads[writer->nthreads++] = thread;
+
+	fprintf (writer->fp, "%s\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %llu, \"dur\": %llu}",
+		writer->count ? "," : "", name, tid + 1, begin, end - begin);
+	writer->count++;
+}
+
+void
+dctool_trace_write (dc_context_t *context, const char *filename)
+{
+	trace_writer_t writer = {0};
+
+	// Open the file.
+	writer.fp = fopen (filename, "w");
+	if (writer.fp == NULL)
+		return;
+
+	// Write the spans as complete events in the Chrome trace format.
+	fprintf (writer.fp, "{\"traceEvents\": [");
+	dc_context_trace_foreach (context, trace_cb, &writer);
+	fprintf (writer.fp, "\n], \"displayTimeUnit\": \"ms\"}\n");
+
+	// Close the file.
+	fclose (writer.fp);
+}
+
+double
+dctool_now (void)
+{
+#if defined (_WIN32)
+	LARGE_INTEGER frequency, now;
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&now);
+	return (double) now.QuadPart / frequency.QuadPart;
+#elif defined (HAVE_CLOCK_GETTIME)
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+#else
+	return (double) clock () / CLOCKS_PER_SEC;
+#endif
+}
@@ -57,6 +57,19 @@ dctool_file_write (const char *filename, dc_buffer_t *buffer);
 dc_buffer_t *
 dctool_file_read (const char *filename);
 
+/*
+ * Write the trace spans of the context to a file in the Chrome trace
+ * format, for viewing in chrome://tracing or Perfetto.
+ */
+void
+dctool_trace_write (dc_context_t *context, const char *filename);
+
+/*
+ * Monotonic clock, in seconds.
+ */
+double
+dctool_now (void);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
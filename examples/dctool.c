@@ -54,6 +54,9 @@
 #define NOPERMUTATION ""
 #endif
 
+// The number of trace spans per thread.
+#define TRACESIZE 65536
+
 static const dctool_command_t *g_commands[] = {
 	&dctool_help,
 	&dctool_version,
@@ -61,6 +64,9 @@ static const dctool_command_t *g_commands[] = {
 	&dctool_download,
 	&dctool_dump,
 	&dctool_parse,
+	&dctool_bench,
+	&dctool_benchdownload,
+	&dctool_scale,
 	&dctool_read,
 	&dctool_write,
 	&dctool_timesync,
@@ -110,6 +116,7 @@ dctool_command_showhelp (const dctool_command_t *command)
 			"   -f, --family <family>     Device family type\n"
 			"   -m, --model <model>       Device model number\n"
 			"   -l, --logfile <logfile>   Logfile\n"
+			"   -t, --trace <file>        Chrome trace file\n"
 			"   -q, --quiet               Quiet mode\n"
 			"   -v, --verbose             Verbose mode\n"
 #else
@@ -118,6 +125,7 @@ dctool_command_showhelp (const dctool_command_t *command)
 			"   -f <family>    Family type\n"
 			"   -m <model>     Model number\n"
 			"   -l <logfile>   Logfile\n"
+			"   -t <file>      Chrome trace file\n"
 			"   -q             Quiet mode\n"
 			"   -v             Verbose mode\n"
 #endif
@@ -173,6 +181,7 @@ main (int argc, char *argv[])
 	unsigned int help = 0;
 	dc_loglevel_t loglevel = DC_LOGLEVEL_WARNING;
 	const char *logfile = NULL;
+	const char *tracefile = NULL;
 	const char *device = NULL;
 	dc_family_t family = DC_FAMILY_NULL;
 	unsigned int model = 0;
@@ -180,7 +189,7 @@ main (int argc, char *argv[])
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = NOPERMUTATION "hd:f:m:l:qv";
+	const char *optstring = NOPERMUTATION "hd:f:m:l:t:qv";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
@@ -188,6 +197,7 @@ main (int argc, char *argv[])
 		{"family",      required_argument, 0, 'f'},
 		{"model",       required_argument, 0, 'm'},
 		{"logfile",     required_argument, 0, 'l'},
+		{"trace",       required_argument, 0, 't'},
 		{"quiet",       no_argument,       0, 'q'},
 		{"verbose",     no_argument,       0, 'v'},
 		{0,             0,                 0,  0 }
@@ -214,6 +224,9 @@ main (int argc, char *argv[])
 		case 'l':
 			logfile = optarg;
 			break;
+		case 't':
+			tracefile = optarg;
+			break;
 		case 'q':
 			loglevel = DC_LOGLEVEL_NONE;
 			break;
@@ -275,6 +288,11 @@ main (int argc, char *argv[])
 	dc_context_set_loglevel (context, loglevel);
 	dc_context_set_logfunc (context, logfunc, NULL);
 
+	// Setup the tracing.
+	if (tracefile) {
+		dc_context_set_trace (context, TRACESIZE);
+	}
+
 	if (command->config & DCTOOL_CONFIG_DESCRIPTOR) {
 		// Check mandatory arguments.
 		if (device == NULL && family == DC_FAMILY_NULL) {
@@ -307,6 +325,11 @@ main (int argc, char *argv[])
 	// Execute the command.
 	exitcode = command->run (argc, argv, context, descriptor);
 
+	// Export the trace.
+	if (tracefile) {
+		dctool_trace_write (context, tracefile);
+	}
+
 cleanup:
 	dc_descriptor_free (descriptor);
 	dc_context_free (context);
@@ -0,0 +1,534 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2015 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/parser.h>
+#include <libdivecomputer/archive.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+typedef enum bench_format_t {
+	BENCH_FORMAT_TEXT,
+	BENCH_FORMAT_JSON,
+} bench_format_t;
+
+typedef struct bench_t {
+	dc_descriptor_t *descriptor;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	// Dives.
+	dc_parse_job_t *jobs;
+	unsigned int count;
+	unsigned int capacity;
+	// Storage of the dive data.
+	dc_buffer_t **buffers;
+	unsigned int nbuffers;
+	dc_archive_t **archives;
+	unsigned int narchives;
+	// Results.
+	unsigned long long *samples;
+	unsigned int errors;
+	// Memory statistics of the parsers.
+	unsigned int memory;
+	unsigned long long allocations;
+	size_t peak;
+} bench_t;
+
+static int
+bench_grow (void **array, unsigned int count, unsigned int *capacity, size_t size)
+{
+	if (count < *capacity)
+		return 1;
+
+	unsigned int n = *capacity ? 2 * *capacity : 64;
+	void *tmp = realloc (*array, n * size);
+	if (tmp == NULL)
+		return 0;
+
+	*array = tmp;
+	*capacity = n;
+
+	return 1;
+}
+
+static int
+bench_add (bench_t *bench, const unsigned char *data, unsigned int size, unsigned int devtime, dc_ticks_t systime)
+{
+	if (!bench_grow ((void **) &bench->jobs, bench->count, &bench->capacity, sizeof (dc_parse_job_t)))
+		return 0;
+
+	dc_parse_job_t *job = &bench->jobs[bench->count++];
+	job->descriptor = bench->descriptor;
+	job->devtime = devtime;
+	job->systime = systime;
+	job->data = data;
+	job->size = size;
+
+	return 1;
+}
+
+static int
+bench_load_file (bench_t *bench, const char *filename)
+{
+	dc_buffer_t *buffer = dctool_file_read (filename);
+	if (buffer == NULL) {
+		message ("Failed to open the input file '%s'.\n", filename);
+		return 0;
+	}
+
+	dc_buffer_t **buffers = (dc_buffer_t **) realloc (bench->buffers, (bench->nbuffers + 1) * sizeof (dc_buffer_t *));
+	if (buffers == NULL) {
+		dc_buffer_free (buffer);
+		return 0;
+	}
+
+	bench->buffers = buffers;
+	bench->buffers[bench->nbuffers++] = buffer;
+
+	return bench_add (bench, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), bench->devtime, bench->systime);
+}
+
+static int
+bench_load_directory (bench_t *bench, const char *dirname)
+{
+#ifdef HAVE_DIRENT_H
+	DIR *dir = opendir (dirname);
+	if (dir == NULL) {
+		message ("Failed to open the directory '%s'.\n", dirname);
+		return 0;
+	}
+
+	int success = 1;
+	struct dirent *entry = NULL;
+	while (success && (entry = readdir (dir)) != NULL) {
+		char filename[1024];
+		struct stat st;
+
+		snprintf (filename, sizeof (filename), "%s/%s", dirname, entry->d_name);
+		if (stat (filename, &st) != 0 || !S_ISREG (st.st_mode))
+			continue;
+
+		success = bench_load_file (bench, filename);
+	}
+
+	closedir (dir);
+
+	return success;
+#else
+	message ("Reading directories is not supported.\n");
+	return 0;
+#endif
+}
+
+static int
+bench_load_archive (bench_t *bench, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_archive_t *archive = NULL;
+	dc_iterator_t *iterator = NULL;
+	dc_archive_entry_t entry;
+	unsigned int skipped = 0;
+
+	status = dc_archive_open (&archive, context, filename);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("Failed to open the archive '%s'.\n", filename);
+		return 0;
+	}
+
+	dc_archive_t **archives = (dc_archive_t **) realloc (bench->archives, (bench->narchives + 1) * sizeof (dc_archive_t *));
+	if (archives == NULL) {
+		dc_archive_close (archive);
+		return 0;
+	}
+
+	// The archive stays open, because the jobs point into it.
+	bench->archives = archives;
+	bench->archives[bench->narchives++] = archive;
+
+	status = dc_archive_iterator_new (&iterator, archive);
+	if (status != DC_STATUS_SUCCESS)
+		return 0;
+
+	while ((status = dc_iterator_next (iterator, &entry)) == DC_STATUS_SUCCESS) {
+		if (entry.family != dc_descriptor_get_type (bench->descriptor)) {
+			skipped++;
+			continue;
+		}
+
+		if (!bench_add (bench, entry.data, entry.size, entry.devtime, entry.systime)) {
+			status = DC_STATUS_NOMEMORY;
+			break;
+		}
+	}
+
+	dc_iterator_free (iterator);
+
+	if (skipped) {
+		message ("Skipped %u dives of another family in '%s'.\n", skipped, filename);
+	}
+
+	return status == DC_STATUS_DONE;
+}
+
+static void
+bench_free (bench_t *bench)
+{
+	for (unsigned int i = 0; i < bench->nbuffers; ++i) {
+		dc_buffer_free (bench->buffers[i]);
+	}
+
+	for (unsigned int i = 0; i < bench->narchives; ++i) {
+		dc_archive_close (bench->archives[i]);
+	}
+
+	free (bench->buffers);
+	free (bench->archives);
+	free (bench->jobs);
+	free (bench->samples);
+}
+
+static void
+sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	unsigned long long *nsamples = (unsigned long long *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		(*nsamples)++;
+}
+
+static dc_status_t
+parse_cb (dc_parser_t *parser, unsigned int index, void *userdata)
+{
+	bench_t *bench = (bench_t *) userdata;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_datetime_t datetime;
+	unsigned int ngasmixes = 0, ntanks = 0;
+	union {
+		unsigned int u;
+		double d;
+		dc_gasmix_t gasmix;
+		dc_salinity_t salinity;
+		dc_tank_t tank;
+		dc_divemode_t divemode;
+		dc_field_string_t string;
+	} value;
+
+	static const dc_field_type_t fields[] = {
+		DC_FIELD_DIVETIME,
+		DC_FIELD_MAXDEPTH,
+		DC_FIELD_AVGDEPTH,
+		DC_FIELD_SALINITY,
+		DC_FIELD_ATMOSPHERIC,
+		DC_FIELD_TEMPERATURE_SURFACE,
+		DC_FIELD_TEMPERATURE_MINIMUM,
+		DC_FIELD_TEMPERATURE_MAXIMUM,
+		DC_FIELD_DIVEMODE,
+	};
+
+	dc_parser_get_datetime (parser, &datetime);
+
+	// Query the summary fields, the same way as the applications do.
+	for (unsigned int i = 0; i < sizeof (fields) / sizeof (fields[0]); ++i) {
+		dc_parser_get_field (parser, fields[i], 0, &value);
+	}
+
+	if (dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes) != DC_STATUS_SUCCESS)
+		ngasmixes = 0;
+	for (unsigned int i = 0; i < ngasmixes; ++i) {
+		dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &value);
+	}
+
+	if (dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks) != DC_STATUS_SUCCESS)
+		ntanks = 0;
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		dc_parser_get_field (parser, DC_FIELD_TANK, i, &value);
+	}
+
+	for (unsigned int i = 0; dc_parser_get_field (parser, DC_FIELD_STRING, i, &value) == DC_STATUS_SUCCESS; ++i) {
+	}
+
+	// Each job is only processed by a single thread at a time.
+	status = dc_parser_samples_foreach (parser, sample_cb, &bench->samples[index]);
+
+	dc_memory_stats_t memory;
+	if (bench->memory && dc_parser_get_memory_stats (parser, &memory) == DC_STATUS_SUCCESS) {
+		bench->allocations += memory.allocations;
+		if (bench->peak < memory.peak)
+			bench->peak = memory.peak;
+	}
+
+	return status;
+}
+
+static int
+result_cb (unsigned int index, dc_status_t status, void *userdata)
+{
+	bench_t *bench = (bench_t *) userdata;
+
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		bench->errors++;
+
+	return 1;
+}
+
+static int
+dctool_bench_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	bench_t bench;
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int archive = 0;
+	unsigned int iterations = 10;
+	unsigned int nthreads = 1;
+	unsigned int pool = 0;
+	bench_format_t format = BENCH_FORMAT_TEXT;
+
+	memset (&bench, 0, sizeof (bench));
+	bench.descriptor = descriptor;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "han:t:p:f:d:s:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"archive",     no_argument,       0, 'a'},
+		{"iterations",  required_argument, 0, 'n'},
+		{"threads",     required_argument, 0, 't'},
+		{"pool",        required_argument, 0, 'p'},
+		{"format",      required_argument, 0, 'f'},
+		{"devtime",     required_argument, 0, 'd'},
+		{"systime",     required_argument, 0, 's'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'a':
+			archive = 1;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		case 't':
+			nthreads = strtoul (optarg, NULL, 0);
+			break;
+		case 'p':
+			pool = strtoul (optarg, NULL, 0);
+			break;
+		case 'f':
+			if (strcmp (optarg, "text") == 0)
+				format = BENCH_FORMAT_TEXT;
+			if (strcmp (optarg, "json") == 0)
+				format = BENCH_FORMAT_JSON;
+			break;
+		case 'd':
+			bench.devtime = strtoul (optarg, NULL, 0);
+			break;
+		case 's':
+			bench.systime = strtoll (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_bench);
+		return EXIT_SUCCESS;
+	}
+
+	if (iterations == 0)
+		iterations = 1;
+
+	// The memory statistics are not attributed correctly to the parsers
+	// of concurrent threads, so they are only collected without worker
+	// threads. They are enabled before any object of the context
+	// exists, and remain enabled for the pooled parsers.
+	if (nthreads <= 1) {
+		dc_context_set_memory_stats (context, 1);
+		bench.memory = 1;
+	}
+
+	// Load the dives.
+	for (int i = 0; i < argc; ++i) {
+		struct stat st;
+		int success = 0;
+
+		if (archive)
+			success = bench_load_archive (&bench, context, argv[i]);
+		else if (stat (argv[i], &st) == 0 && S_ISDIR (st.st_mode))
+			success = bench_load_directory (&bench, argv[i]);
+		else
+			success = bench_load_file (&bench, argv[i]);
+
+		if (!success) {
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	if (bench.count == 0) {
+		message ("No dives to parse.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	bench.samples = (unsigned long long *) calloc (bench.count, sizeof (unsigned long long));
+	if (bench.samples == NULL) {
+		message ("Failed to allocate memory.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	if (pool) {
+		dc_context_set_parser_pool (context, pool);
+	}
+
+	// Run the benchmark.
+	double start = dctool_now ();
+	for (unsigned int i = 0; i < iterations; ++i) {
+		status = dc_parse_many (context, bench.jobs, bench.count, nthreads, parse_cb, result_cb, &bench);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+			break;
+		}
+	}
+	double elapsed = dctool_now () - start;
+
+	if (exitcode != EXIT_SUCCESS)
+		goto cleanup;
+
+	// Compute the statistics. The sample counters are accumulated over
+	// all iterations.
+	unsigned long long ndives = (unsigned long long) bench.count * iterations;
+	unsigned long long nsamples = 0;
+	for (unsigned int i = 0; i < bench.count; ++i) {
+		nsamples += bench.samples[i];
+	}
+
+	if (elapsed <= 0)
+		elapsed = 1e-9;
+
+	double dives_per_sec = ndives / elapsed;
+	double samples_per_sec = nsamples / elapsed;
+	double ns_per_sample = nsamples ? elapsed * 1e9 / nsamples : 0;
+	double allocs_per_dive = (double) bench.allocations / ndives;
+
+	if (format == BENCH_FORMAT_JSON) {
+		printf ("{\"vendor\": \"%s\", \"product\": \"%s\", \"dives\": %u, \"iterations\": %u, \"threads\": %u, "
+			"\"errors\": %u, \"samples\": %llu, \"seconds\": %.6f, \"dives_per_sec\": %.1f, "
+			"\"samples_per_sec\": %.1f, \"ns_per_sample\": %.2f, ",
+			dc_descriptor_get_vendor (descriptor), dc_descriptor_get_product (descriptor),
+			bench.count, iterations, nthreads, bench.errors, nsamples, elapsed,
+			dives_per_sec, samples_per_sec, ns_per_sample);
+		if (bench.memory)
+			printf ("\"allocs_per_dive\": %.2f, \"peak_bytes\": %lu}\n", allocs_per_dive, (unsigned long) bench.peak);
+		else
+			printf ("\"allocs_per_dive\": null, \"peak_bytes\": null}\n");
+	} else {
+		printf ("Device:      %s %s\n", dc_descriptor_get_vendor (descriptor), dc_descriptor_get_product (descriptor));
+		printf ("Dives:       %u x %u iterations (%u threads)\n", bench.count, iterations, nthreads);
+		printf ("Errors:      %u\n", bench.errors);
+		printf ("Samples:     %llu\n", nsamples);
+		printf ("Time:        %.6f s\n", elapsed);
+		printf ("Dives/s:     %.1f\n", dives_per_sec);
+		printf ("Samples/s:   %.1f\n", samples_per_sec);
+		printf ("ns/sample:   %.2f\n", ns_per_sample);
+		if (bench.memory) {
+			printf ("Allocs/dive: %.2f\n", allocs_per_dive);
+			printf ("Peak memory: %lu bytes\n", (unsigned long) bench.peak);
+		}
+	}
+
+cleanup:
+	bench_free (&bench);
+	return exitcode;
+}
+
+const dctool_command_t dctool_bench = {
+	dctool_bench_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"bench",
+	"Measure the parser throughput",
+	"Usage:\n"
+	"   dctool bench [options] <filename|directory>...\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -a, --archive              Read the dives from dive archives\n"
+	"   -n, --iterations <count>   Number of iterations\n"
+	"   -t, --threads <count>      Number of worker threads\n"
+	"   -p, --pool <size>          Size of the parser pool\n"
+	"   -f, --format <format>      Output format (text or json)\n"
+	"   -d, --devtime <timestamp>  Device time\n"
+	"   -s, --systime <timestamp>  System time\n"
+#else
+	"   -h              Show help message\n"
+	"   -a              Read the dives from dive archives\n"
+	"   -n <count>      Number of iterations\n"
+	"   -t <count>      Number of worker threads\n"
+	"   -p <size>       Size of the parser pool\n"
+	"   -f <format>     Output format (text or json)\n"
+	"   -d <devtime>    Device time\n"
+	"   -s <systime>    System time\n"
+#endif
+	"\n"
+	"The allocations are the memory blocks requested through the\n"
+	"allocator of the context by the parsers, and the peak memory is\n"
+	"the largest amount held by a single dive. Both are only measured\n"
+	"with a single thread.\n"
+};
@@ -0,0 +1,234 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/emulator.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+static int
+dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	unsigned int *ndives = (unsigned int *) userdata;
+
+	(*ndives)++;
+
+	return 1;
+}
+
+static dc_status_t
+benchdownload (dc_context_t *context, dc_descriptor_t *descriptor, dc_buffer_t *image, dc_replay_pacing_t pacing, unsigned int baudrate, unsigned int latency, unsigned int loss, unsigned int *ndives, unsigned long long *usecs)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_iostream_t *iostream = NULL;
+	dc_device_t *device = NULL;
+	dc_custom_io_t io;
+
+	rc = dc_emulator_open (&iostream, context, descriptor,
+		dc_buffer_get_data (image), dc_buffer_get_size (image),
+		pacing, baudrate, latency, loss);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the emulator.");
+		return rc;
+	}
+
+	// Connect the backend to the emulator.
+	dc_replay_custom_io (&io, iostream);
+	dc_context_set_custom_io (context, &io, NULL);
+
+	rc = dc_device_open (&device, context, descriptor, "emulator");
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error opening the device.");
+		goto cleanup;
+	}
+
+	rc = dc_device_set_cancel (device, dctool_cancel_cb, NULL);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error registering the cancellation handler.");
+		goto cleanup;
+	}
+
+	rc = dc_device_foreach (device, dive_cb, ndives);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error downloading the dives.");
+		goto cleanup;
+	}
+
+cleanup:
+	dc_device_close (device);
+	dc_emulator_get_elapsed (iostream, usecs);
+	dc_context_set_custom_io (context, NULL, NULL);
+	dc_iostream_close (iostream);
+	return rc;
+}
+
+static int
+dctool_benchdownload_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_buffer_t *image = NULL;
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int iterations = 1;
+	unsigned int baudrate = 0;
+	unsigned int latency = 0;
+	unsigned int loss = 0;
+	dc_replay_pacing_t pacing = DC_REPLAY_PACING_NONE;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hmn:b:l:L:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"model",       no_argument,       0, 'm'},
+		{"iterations",  required_argument, 0, 'n'},
+		{"baudrate",    required_argument, 0, 'b'},
+		{"latency",     required_argument, 0, 'l'},
+		{"loss",        required_argument, 0, 'L'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'm':
+			pacing = DC_REPLAY_PACING_MODEL;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		case 'b':
+			baudrate = strtoul (optarg, NULL, 0);
+			break;
+		case 'l':
+			latency = strtoul (optarg, NULL, 0);
+			break;
+		case 'L':
+			loss = strtoul (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_benchdownload);
+		return EXIT_SUCCESS;
+	}
+
+	if (argc < 1) {
+		message ("No memory image specified.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (iterations == 0)
+		iterations = 1;
+
+	image = dctool_file_read (argv[0]);
+	if (image == NULL) {
+		message ("Failed to open the input file '%s'.\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Run the benchmark.
+	unsigned int ndives = 0;
+	unsigned long long modelled = 0;
+	double start = dctool_now ();
+	for (unsigned int i = 0; i < iterations; ++i) {
+		unsigned long long usecs = 0;
+		ndives = 0;
+		status = benchdownload (context, descriptor, image, pacing, baudrate, latency, loss, &ndives, &usecs);
+		modelled += usecs;
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s\n", dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+	double elapsed = dctool_now () - start;
+
+	printf ("Device:      %s %s\n", dc_descriptor_get_vendor (descriptor), dc_descriptor_get_product (descriptor));
+	printf ("Dives:       %u x %u iterations\n", ndives, iterations);
+	printf ("Wall time:   %.6f s\n", elapsed / iterations);
+	printf ("Link time:   %.6f s\n", modelled / 1e6 / iterations);
+
+cleanup:
+	dc_buffer_free (image);
+	return exitcode;
+}
+
+const dctool_command_t dctool_benchdownload = {
+	dctool_benchdownload_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"bench-download",
+	"Measure the download time with an emulated device",
+	"Usage:\n"
+	"   dctool bench-download [options] <image>\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -m, --model                Wait for the modelled link time\n"
+	"   -n, --iterations <count>   Number of iterations\n"
+	"   -b, --baudrate <rate>      Baudrate of the link\n"
+	"   -l, --latency <ms>         Latency of every transfer\n"
+	"   -L, --loss <permille>      Fraction of lost answers\n"
+#else
+	"   -h              Show help message\n"
+	"   -m              Wait for the modelled link time\n"
+	"   -n <count>      Number of iterations\n"
+	"   -b <rate>       Baudrate of the link\n"
+	"   -l <ms>         Latency of every transfer\n"
+	"   -L <permille>   Fraction of lost answers\n"
+#endif
+	"\n"
+	"The image is a memory dump of the device, preceded by the version\n"
+	"info for the families that need one. The times are averages per\n"
+	"download. The link time is the modelled transfer time, and is also\n"
+	"computed without waiting for it.\n"
+};
@@ -30,6 +30,9 @@
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
@@ -41,9 +44,47 @@
 #include "output.h"
 #include "utils.h"
 
+typedef struct download_pool_t download_pool_t;
+
+typedef struct download_job_t {
+	download_pool_t *pool;
+	const char *devname;
+	dc_status_t status;
+	// Output fragment, or NULL to write to the shared output.
+	dctool_output_t *output;
+	dc_buffer_t *buffer;
+	// Statistics.
+	unsigned int ndives;
+	unsigned long long nbytes;
+	unsigned long long transferred;
+	unsigned int current;
+	unsigned int maximum;
+	unsigned int done;
+	double elapsed;
+#ifdef HAVE_PTHREAD_H
+	pthread_t thread;
+	int started;
+#endif
+} download_job_t;
+
+struct download_pool_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	const char *cachedir;
+	dc_buffer_t *fingerprint;
+	dctool_output_t *output;
+	download_job_t *jobs;
+	unsigned int count;
+	unsigned int reported;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t mutex;
+#endif
+};
+
 typedef struct event_data_t {
 	const char *cachedir;
 	dc_event_devinfo_t devinfo;
+	download_job_t *job;
 } event_data_t;
 
 typedef struct dive_data_t {
@@ -51,8 +92,58 @@ typedef struct dive_data_t {
 	dc_buffer_t **fingerprint;
 	unsigned int number;
 	dctool_output_t *output;
+	download_job_t *job;
 } dive_data_t;
 
+static void
+download_lock (download_pool_t *pool)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock (&pool->mutex);
+#endif
+}
+
+static void
+download_unlock (download_pool_t *pool)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock (&pool->mutex);
+#endif
+}
+
+/*
+ * Report the combined progress of all devices. Every device counts for
+ * the same share, and the progress is only shown in steps of 0.1%, to
+ * keep the output readable with many devices.
+ */
+static void
+download_progress (download_pool_t *pool)
+{
+	double total = 0.0;
+	unsigned int ndone = 0;
+
+	download_lock (pool);
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		const download_job_t *job = pool->jobs + i;
+		if (job->done) {
+			total += 1.0;
+			ndone++;
+		} else if (job->maximum) {
+			total += (double) job->current / (double) job->maximum;
+		}
+	}
+
+	unsigned int permille = (unsigned int) (1000.0 * total / pool->count);
+	if (permille != pool->reported) {
+		message ("Progress: %3.1f%% (%u/%u devices done)\n",
+			permille / 10.0, ndone, pool->count);
+		pool->reported = permille;
+	}
+
+	download_unlock (pool);
+}
+
 static int
 dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
 {
@@ -62,6 +153,11 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 
 	divedata->number++;
 
+	if (divedata->job) {
+		divedata->job->ndives++;
+		divedata->job->nbytes += size;
+	}
+
 	message ("Dive: number=%u, size=%u, fingerprint=", divedata->number, size);
 	for (unsigned int i = 0; i < fsize; ++i)
 		message ("%02X", fingerprint[i]);
@@ -94,7 +190,14 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 
 	// Parse the dive data.
 	message ("Parsing the dive data.\n");
-	rc = dctool_output_write (divedata->output, parser, data, size, fingerprint, fsize);
+	if (divedata->job && divedata->job->output == NULL) {
+		// The shared output is written by all devices.
+		download_lock (divedata->job->pool);
+		rc = dctool_output_write (divedata->output, parser, data, size, fingerprint, fsize);
+		download_unlock (divedata->job->pool);
+	} else {
+		rc = dctool_output_write (divedata->output, parser, data, size, fingerprint, fsize);
+	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error parsing the dive data.");
 		goto cleanup;
@@ -108,15 +211,40 @@ cleanup:
 static void
 event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
 {
+	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
 	const dc_event_devinfo_t *devinfo = (const dc_event_devinfo_t *) data;
+	const dc_event_stats_t *stats = (const dc_event_stats_t *) data;
 
 	event_data_t *eventdata = (event_data_t *) userdata;
+	download_job_t *job = eventdata->job;
 
-	// Forward to the default event handler.
-	dctool_event_cb (device, event, data, userdata);
+	// Forward to the default event handler. With multiple devices, only
+	// the combined progress is reported.
+	if (job == NULL) {
+		dctool_event_cb (device, event, data, userdata);
+	}
 
 	switch (event) {
+	case DC_EVENT_PROGRESS:
+		if (job) {
+			download_lock (job->pool);
+			job->current = progress->current;
+			job->maximum = progress->maximum;
+			download_unlock (job->pool);
+			download_progress (job->pool);
+		}
+		break;
+	case DC_EVENT_STATS:
+		if (job) {
+			job->transferred = stats->bytes_in;
+		}
+		break;
 	case DC_EVENT_DEVINFO:
+		if (job) {
+			message ("Device %s: model=%u, firmware=%u, serial=%u\n",
+				job->devname, devinfo->model, devinfo->firmware, devinfo->serial);
+		}
+
 		// Load the fingerprint from the cache. If there is no
 		// fingerprint present in the cache, a NULL buffer is returned,
 		// and the registered fingerprint will be cleared.
@@ -152,7 +280,7 @@ event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *us
 }
 
 static dc_status_t
-download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output)
+download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output, download_job_t *job)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
@@ -176,10 +304,11 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 	} else {
 		eventdata.cachedir = cachedir;
 	}
+	eventdata.job = job;
 
 	// Register the event handler.
 	message ("Registering the event handler.\n");
-	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR;
+	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR | DC_EVENT_STATS | DC_EVENT_LOGBOOK | DC_EVENT_THROUGHPUT;
 	rc = dc_device_set_events (device, events, event_cb, &eventdata);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the event handler.");
@@ -209,7 +338,8 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 	divedata.device = device;
 	divedata.fingerprint = &ofingerprint;
 	divedata.number = 0;
-	divedata.output = output;
+	divedata.output = job && job->output ? job->output : output;
+	divedata.job = job;
 
 	// Download the dives.
 	message ("Downloading the dives.\n");
@@ -239,6 +369,127 @@ cleanup:
 	return rc;
 }
 
+static void *
+download_worker (void *userdata)
+{
+	download_job_t *job = (download_job_t *) userdata;
+	download_pool_t *pool = job->pool;
+
+	double start = dctool_now ();
+	job->status = download (pool->context, pool->descriptor, job->devname, pool->cachedir, pool->fingerprint, pool->output, job);
+	job->elapsed = dctool_now () - start;
+
+	download_lock (pool);
+	job->done = 1;
+	download_unlock (pool);
+
+	download_progress (pool);
+
+	return NULL;
+}
+
+static dc_status_t
+download_many (dc_context_t *context, dc_descriptor_t *descriptor, char *devnames[], unsigned int count, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	download_pool_t pool;
+
+	pool.context = context;
+	pool.descriptor = descriptor;
+	pool.cachedir = cachedir;
+	pool.fingerprint = fingerprint;
+	pool.output = output;
+	pool.count = count;
+	pool.reported = 0;
+	pool.jobs = (download_job_t *) calloc (count, sizeof (download_job_t));
+	if (pool.jobs == NULL) {
+		ERROR ("Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init (&pool.mutex, NULL);
+#endif
+
+	// Every device collects its dives in an output fragment, to keep the
+	// dives of each device together in the output. Formats without
+	// fragment support are written directly.
+	for (unsigned int i = 0; i < count; ++i) {
+		download_job_t *job = pool.jobs + i;
+		job->pool = &pool;
+		job->devname = devnames[i];
+		job->status = DC_STATUS_SUCCESS;
+		job->buffer = dc_buffer_new (0);
+		job->output = dctool_output_fragment (output, job->buffer, 0);
+	}
+
+	// Download all devices concurrently.
+	double start = dctool_now ();
+	for (unsigned int i = 0; i < count; ++i) {
+		download_job_t *job = pool.jobs + i;
+#ifdef HAVE_PTHREAD_H
+		job->started = pthread_create (&job->thread, NULL, download_worker, job) == 0;
+		if (!job->started) {
+			WARNING ("Failed to start a thread, downloading sequentially.");
+			download_worker (job);
+		}
+#else
+		download_worker (job);
+#endif
+	}
+
+#ifdef HAVE_PTHREAD_H
+	for (unsigned int i = 0; i < count; ++i) {
+		if (pool.jobs[i].started)
+			pthread_join (pool.jobs[i].thread, NULL);
+	}
+#endif
+	double elapsed = dctool_now () - start;
+
+	// Write the dives in the order of the devices, and report the
+	// statistics of each device.
+	unsigned int nfailed = 0, ndives = 0;
+	unsigned long long nbytes = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		download_job_t *job = pool.jobs + i;
+
+		if (job->output) {
+			dctool_output_free (job->output);
+			dctool_output_append (output, job->buffer, job->ndives);
+		}
+
+		// Prefer the number of bytes on the wire, if the backend
+		// reports it.
+		unsigned long long bytes = job->transferred ? job->transferred : job->nbytes;
+
+		message ("Device %s: %s, %u dives, %llu bytes in %.2f s (%.0f bytes/s)\n",
+			job->devname,
+			job->status == DC_STATUS_SUCCESS ? "done" : dctool_errmsg (job->status),
+			job->ndives, bytes, job->elapsed,
+			job->elapsed > 0.0 ? bytes / job->elapsed : 0.0);
+
+		if (job->status != DC_STATUS_SUCCESS) {
+			nfailed++;
+			rc = job->status;
+		}
+		ndives += job->ndives;
+		nbytes += bytes;
+
+		dc_buffer_free (job->buffer);
+	}
+
+	message ("Total: %u of %u devices done, %u dives, %llu bytes in %.2f s (%.0f bytes/s)\n",
+		count - nfailed, count, ndives, nbytes, elapsed,
+		elapsed > 0.0 ? nbytes / elapsed : 0.0);
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy (&pool.mutex);
+#endif
+	free (pool.jobs);
+
+	return rc;
+}
+
 static int
 dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
 {
@@ -316,6 +567,8 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		output = dctool_raw_output_new (filename);
 	} else if (strcasecmp(format, "xml") == 0) {
 		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "columnar") == 0) {
+		output = dctool_columnar_output_new (filename);
 	} else {
 		message ("Unknown output format: %s\n", format);
 		exitcode = EXIT_FAILURE;
@@ -328,7 +581,11 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	}
 
 	// Download the dives.
-	status = download (context, descriptor, argv[0], cachedir, fingerprint, output);
+	if (argc > 1) {
+		status = download_many (context, descriptor, argv, argc, cachedir, fingerprint, output);
+	} else {
+		status = download (context, descriptor, argv[0], cachedir, fingerprint, output, NULL);
+	}
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -347,7 +604,7 @@ const dctool_command_t dctool_download = {
 	"download",
 	"Download the dives",
 	"Usage:\n"
-	"   dctool download [options] <devname>\n"
+	"   dctool download [options] <devname>...\n"
 	"\n"
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
@@ -365,6 +622,12 @@ const dctool_command_t dctool_download = {
 	"   -f <format>        Output format\n"
 	"   -u <units>         Set units (metric or imperial)\n"
 #endif
+	"\n"
+	"With multiple device names, all devices are downloaded concurrently,\n"
+	"each with its own fingerprint in the cache directory. The dives are\n"
+	"written to the output grouped per device, in the order of the device\n"
+	"names, and numbered per device. Only the combined progress is shown,\n"
+	"followed by the statistics of every device.\n"
 	"\n"
 	"Supported output formats:\n"
 	"\n"
@@ -378,6 +641,11 @@ const dctool_command_t dctool_download = {
 	"      files, the filename is interpreted as a template and should\n"
 	"      contain one or more placeholders.\n"
 	"\n"
+	"   COLUMNAR\n"
+	"\n"
+	"      All dives are exported to a single binary file, with the samples\n"
+	"      stored as delta encoded columns in metric units.\n"
+	"\n"
 	"Supported template placeholders:\n"
 	"\n"
 	"   %f   Fingerprint (hexadecimal format)\n"
@@ -39,11 +39,46 @@
 #include "common.h"
 #include "utils.h"
 
+typedef struct checkpoint_t {
+	const char *filename;
+	FILE *fp;
+	unsigned int size;
+} checkpoint_t;
+
+static void
+event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	checkpoint_t *checkpoint = (checkpoint_t *) userdata;
+	const dc_event_checkpoint_t *completed = (const dc_event_checkpoint_t *) data;
+
+	if (event != DC_EVENT_CHECKPOINT) {
+		dctool_event_cb (device, event, data, NULL);
+		return;
+	}
+
+	// Append the new blocks to the checkpoint file, or rewrite the
+	// file if the dump started over.
+	if (checkpoint->fp == NULL || completed->size < checkpoint->size) {
+		if (checkpoint->fp)
+			fclose (checkpoint->fp);
+		checkpoint->fp = fopen (checkpoint->filename, "wb");
+		checkpoint->size = 0;
+		if (checkpoint->fp == NULL)
+			return;
+	}
+
+	fwrite (completed->data + checkpoint->size, 1, completed->size - checkpoint->size, checkpoint->fp);
+	fflush (checkpoint->fp);
+	checkpoint->size = completed->size;
+}
+
 static dc_status_t
-dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, dc_buffer_t *fingerprint, dc_buffer_t *buffer)
+dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, dc_buffer_t *fingerprint, const char *cpfilename, dc_buffer_t *buffer)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
+	dc_buffer_t *cpdata = NULL;
+	checkpoint_t checkpoint = {cpfilename, NULL, 0};
 
 	// Open the device.
 	message ("Opening the device (%s %s, %s).\n",
@@ -58,8 +93,10 @@ dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, d
 
 	// Register the event handler.
 	message ("Registering the event handler.\n");
-	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR;
-	rc = dc_device_set_events (device, events, dctool_event_cb, NULL);
+	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR | DC_EVENT_STATS;
+	if (cpfilename)
+		events |= DC_EVENT_CHECKPOINT;
+	rc = dc_device_set_events (device, events, event_cb, &checkpoint);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the event handler.");
 		goto cleanup;
@@ -83,6 +120,16 @@ dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, d
 		}
 	}
 
+	// Register the checkpoint data of a previous attempt.
+	if (cpfilename && (cpdata = dctool_file_read (cpfilename)) != NULL) {
+		message ("Registering the checkpoint data (%u bytes).\n", (unsigned int) dc_buffer_get_size (cpdata));
+		rc = dc_device_set_checkpoint (device, dc_buffer_get_data (cpdata), dc_buffer_get_size (cpdata));
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error registering the checkpoint data.");
+			goto cleanup;
+		}
+	}
+
 	// Download the memory dump.
 	message ("Downloading the memory dump.\n");
 	rc = dc_device_dump (device, buffer);
@@ -91,7 +138,18 @@ dump (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, d
 		goto cleanup;
 	}
 
+	// The checkpoint is no longer needed.
+	if (checkpoint.fp) {
+		fclose (checkpoint.fp);
+		checkpoint.fp = NULL;
+	}
+	if (cpfilename)
+		remove (cpfilename);
+
 cleanup:
+	if (checkpoint.fp)
+		fclose (checkpoint.fp);
+	dc_buffer_free (cpdata);
 	dc_device_close (device);
 	return rc;
 }
@@ -108,15 +166,17 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	unsigned int help = 0;
 	const char *fphex = NULL;
 	const char *filename = NULL;
+	const char *checkpoint = NULL;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:p:";
+	const char *optstring = "ho:p:c:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"output",      required_argument, 0, 'o'},
 		{"fingerprint", required_argument, 0, 'p'},
+		{"checkpoint",  required_argument, 0, 'c'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -133,6 +193,9 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 'p':
 			fphex = optarg;
 			break;
+		case 'c':
+			checkpoint = optarg;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -154,7 +217,7 @@ dctool_dump_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	buffer = dc_buffer_new (0);
 
 	// Download the memory dump.
-	status = dump (context, descriptor, argv[0], fingerprint, buffer);
+	status = dump (context, descriptor, argv[0], fingerprint, checkpoint, buffer);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -183,9 +246,14 @@ const dctool_command_t dctool_dump = {
 	"   -h, --help                 Show help message\n"
 	"   -o, --output <filename>    Output filename\n"
 	"   -p, --fingerprint <data>   Fingerprint data (hexadecimal)\n"
+	"   -c, --checkpoint <file>    Checkpoint filename\n"
 #else
 	"   -h                 Show help message\n"
 	"   -o <filename>      Output filename\n"
 	"   -p <fingerprint>   Fingerprint data (hexadecimal)\n"
+	"   -c <filename>      Checkpoint filename\n"
 #endif
+	"\n"
+	"With a checkpoint file, the completed part of the dump is saved while\n"
+	"downloading, and a failed dump resumes from there on the next run.\n"
 };
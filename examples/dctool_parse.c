@@ -27,9 +27,14 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
@@ -42,41 +47,186 @@
 
 #define REACTPROWHITE 0x4354
 
+typedef struct parse_t {
+	dc_descriptor_t *descriptor;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	dctool_output_t *output;
+	unsigned int nthreads;
+	// Input files.
+	dc_parse_job_t *jobs;
+	dc_buffer_t **buffers;
+	const char **filenames;
+	unsigned int count;
+	unsigned int capacity;
+	// Rendered dives, waiting to be written in order.
+	dc_buffer_t **fragments;
+} parse_t;
+
+static int
+parse_load_file (parse_t *parse, const char *filename)
+{
+	if (parse->count >= parse->capacity) {
+		unsigned int capacity = parse->capacity ? 2 * parse->capacity : 64;
+
+		dc_parse_job_t *jobs = (dc_parse_job_t *) realloc (parse->jobs, capacity * sizeof (dc_parse_job_t));
+		if (jobs == NULL)
+			return 0;
+		parse->jobs = jobs;
+
+		dc_buffer_t **buffers = (dc_buffer_t **) realloc (parse->buffers, capacity * sizeof (dc_buffer_t *));
+		if (buffers == NULL)
+			return 0;
+		parse->buffers = buffers;
+
+		const char **filenames = (const char **) realloc (parse->filenames, capacity * sizeof (const char *));
+		if (filenames == NULL)
+			return 0;
+		parse->filenames = filenames;
+
+		parse->capacity = capacity;
+	}
+
+	dc_buffer_t *buffer = dctool_file_read (filename);
+	if (buffer == NULL) {
+		message ("Failed to open the input file '%s'.\n", filename);
+		return 0;
+	}
+
+	dc_parse_job_t *job = &parse->jobs[parse->count];
+	job->descriptor = parse->descriptor;
+	job->devtime = parse->devtime;
+	job->systime = parse->systime;
+	job->data = dc_buffer_get_data (buffer);
+	job->size = dc_buffer_get_size (buffer);
+
+	parse->buffers[parse->count] = buffer;
+	parse->filenames[parse->count] = filename;
+	parse->count++;
+
+	return 1;
+}
+
+#ifdef HAVE_DIRENT_H
+static int
+parse_compare (const void *a, const void *b)
+{
+	return strcmp (*(char * const *) a, *(char * const *) b);
+}
+#endif
+
+static int
+parse_load_directory (parse_t *parse, const char *dirname, char ***names, unsigned int *nnames)
+{
+#ifdef HAVE_DIRENT_H
+	DIR *dir = opendir (dirname);
+	if (dir == NULL) {
+		message ("Failed to open the directory '%s'.\n", dirname);
+		return 0;
+	}
+
+	// Collect the filenames first, to parse them in a deterministic order.
+	unsigned int first = *nnames;
+	int success = 1;
+	struct dirent *entry = NULL;
+	while (success && (entry = readdir (dir)) != NULL) {
+		char filename[1024];
+		struct stat st;
+
+		snprintf (filename, sizeof (filename), "%s/%s", dirname, entry->d_name);
+		if (stat (filename, &st) != 0 || !S_ISREG (st.st_mode))
+			continue;
+
+		char **tmp = (char **) realloc (*names, (*nnames + 1) * sizeof (char *));
+		char *name = strdup (filename);
+		if (tmp)
+			*names = tmp;
+		if (tmp == NULL || name == NULL) {
+			free (name);
+			success = 0;
+			break;
+		}
+
+		(*names)[(*nnames)++] = name;
+	}
+
+	closedir (dir);
+
+	if (!success)
+		return 0;
+
+	qsort (*names + first, *nnames - first, sizeof (char *), parse_compare);
+
+	for (unsigned int i = first; i < *nnames; ++i) {
+		if (!parse_load_file (parse, (*names)[i]))
+			return 0;
+	}
+
+	return 1;
+#else
+	message ("Reading directories is not supported.\n");
+	return 0;
+#endif
+}
+
 static dc_status_t
-parse (dc_buffer_t *buffer, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, dctool_output_t *output)
+parse_cb (dc_parser_t *parser, unsigned int index, void *userdata)
 {
+	parse_t *parse = (parse_t *) userdata;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_parser_t *parser = NULL;
-	unsigned char *data = dc_buffer_get_data (buffer);
-	unsigned int size = dc_buffer_get_size (buffer);
+	const dc_parse_job_t *job = &parse->jobs[index];
 
-	// Create the parser.
-	message ("Creating the parser.\n");
-	rc = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error creating the parser.");
-		goto cleanup;
+	// Without worker threads, the dives are parsed in order, and can
+	// be written to the output directly.
+	if (parse->nthreads <= 1) {
+		message ("Parsing the dive data.\n");
+		return dctool_output_write (parse->output, parser, job->data, job->size, NULL, 0);
 	}
 
-	// Register the data.
-	message ("Registering the data.\n");
-	rc = dc_parser_set_data (parser, data, size);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error registering the data.");
-		goto cleanup;
+	// Render the dive into a fragment, to be written by the result
+	// function in the right order.
+	dc_buffer_t *buffer = dc_buffer_new (0);
+	dctool_output_t *fragment = dctool_output_fragment (parse->output, buffer, index);
+	if (buffer == NULL || fragment == NULL) {
+		dctool_output_free (fragment);
+		dc_buffer_free (buffer);
+		return DC_STATUS_NOMEMORY;
 	}
 
-	// Parse the dive data.
 	message ("Parsing the dive data.\n");
-	rc = dctool_output_write (output, parser, data, size, NULL, 0);
+	rc = dctool_output_write (fragment, parser, job->data, job->size, NULL, 0);
+
+	dc_status_t status = dctool_output_free (fragment);
+	if (rc == DC_STATUS_SUCCESS)
+		rc = status;
+
 	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error parsing the dive data.");
-		goto cleanup;
+		dc_buffer_free (buffer);
+		return rc;
 	}
 
-cleanup:
-	dc_parser_destroy (parser);
-	return rc;
+	parse->fragments[index] = buffer;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+parse_result_cb (unsigned int index, dc_status_t status, void *userdata)
+{
+	parse_t *parse = (parse_t *) userdata;
+
+	if (status == DC_STATUS_SUCCESS && parse->fragments) {
+		status = dctool_output_append (parse->output, parse->fragments[index], 1);
+		dc_buffer_free (parse->fragments[index]);
+		parse->fragments[index] = NULL;
+	}
+
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s (%s)\n", dctool_errmsg (status), parse->filenames[index]);
+		return 0;
+	}
+
+	return 1;
 }
 
 static int
@@ -85,26 +235,34 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	// Default values.
 	int exitcode = EXIT_SUCCESS;
 	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_buffer_t *buffer = NULL;
 	dctool_output_t *output = NULL;
 	dctool_units_t units = DCTOOL_UNITS_METRIC;
+	parse_t parse;
+	char **names = NULL;
+	unsigned int nnames = 0;
 
 	// Default option values.
 	unsigned int help = 0;
 	const char *filename = NULL;
 	unsigned int devtime = 0;
 	dc_ticks_t systime = 0;
+	const char *format = "xml";
+	unsigned int nthreads = 1;
+
+	memset (&parse, 0, sizeof (parse));
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:d:s:u:";
+	const char *optstring = "ho:d:s:f:u:t:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"output",      required_argument, 0, 'o'},
 		{"devtime",     required_argument, 0, 'd'},
 		{"systime",     required_argument, 0, 's'},
+		{"format",      required_argument, 0, 'f'},
 		{"units",       required_argument, 0, 'u'},
+		{"threads",     required_argument, 0, 't'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -124,12 +282,18 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 's':
 			systime = strtoll (optarg, NULL, 0);
 			break;
+		case 'f':
+			format = optarg;
+			break;
 		case 'u':
 			if (strcmp (optarg, "metric") == 0)
 				units = DCTOOL_UNITS_METRIC;
 			if (strcmp (optarg, "imperial") == 0)
 				units = DCTOOL_UNITS_IMPERIAL;
 			break;
+		case 't':
+			nthreads = strtoul (optarg, NULL, 0);
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -145,37 +309,75 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Create the output.
-	output = dctool_xml_output_new (filename, units);
+	if (strcasecmp(format, "xml") == 0) {
+		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "columnar") == 0) {
+		output = dctool_columnar_output_new (filename);
+	} else {
+		message ("Unknown output format: %s\n", format);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
 	if (output == NULL) {
 		message ("Failed to create the output.\n");
 		exitcode = EXIT_FAILURE;
 		goto cleanup;
 	}
 
-	for (unsigned int i = 0; i < argc; ++i) {
-		// Read the input file.
-		buffer = dctool_file_read (argv[i]);
-		if (buffer == NULL) {
-			message ("Failed to open the input file.\n");
+	parse.descriptor = descriptor;
+	parse.devtime = devtime;
+	parse.systime = systime;
+	parse.output = output;
+	parse.nthreads = nthreads;
+
+	// Load the input files.
+	for (int i = 0; i < argc; ++i) {
+		struct stat st;
+		int success = 0;
+
+		if (stat (argv[i], &st) == 0 && S_ISDIR (st.st_mode))
+			success = parse_load_directory (&parse, argv[i], &names, &nnames);
+		else
+			success = parse_load_file (&parse, argv[i]);
+
+		if (!success) {
 			exitcode = EXIT_FAILURE;
 			goto cleanup;
 		}
+	}
 
-		// Parse the dive.
-		status = parse (buffer, context, descriptor, devtime, systime, output);
-		if (status != DC_STATUS_SUCCESS) {
-			message ("ERROR: %s\n", dctool_errmsg (status));
+	if (parse.nthreads > 1 && parse.count > 1) {
+		parse.fragments = (dc_buffer_t **) calloc (parse.count, sizeof (dc_buffer_t *));
+		if (parse.fragments == NULL) {
+			message ("Failed to allocate memory.\n");
 			exitcode = EXIT_FAILURE;
 			goto cleanup;
 		}
+	} else {
+		parse.nthreads = 1;
+	}
 
-		// Cleanup.
-		dc_buffer_free (buffer);
-		buffer = NULL;
+	// Parse the dives.
+	status = dc_parse_many (context, parse.jobs, parse.count, parse.nthreads, parse_cb, parse_result_cb, &parse);
+	if (status != DC_STATUS_SUCCESS) {
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
 	}
 
 cleanup:
-	dc_buffer_free (buffer);
+	for (unsigned int i = 0; i < parse.count; ++i) {
+		dc_buffer_free (parse.buffers[i]);
+		if (parse.fragments)
+			dc_buffer_free (parse.fragments[i]);
+	}
+	for (unsigned int i = 0; i < nnames; ++i) {
+		free (names[i]);
+	}
+	free (names);
+	free (parse.fragments);
+	free (parse.filenames);
+	free (parse.buffers);
+	free (parse.jobs);
 	dctool_output_free (output);
 	return exitcode;
 }
@@ -186,7 +388,7 @@ const dctool_command_t dctool_parse = {
 	"parse",
 	"Parse previously downloaded dives",
 	"Usage:\n"
-	"   dctool parse [options] <filename>\n"
+	"   dctool parse [options] <filename|directory>...\n"
 	"\n"
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
@@ -194,12 +396,20 @@ const dctool_command_t dctool_parse = {
 	"   -o, --output <filename>    Output filename\n"
 	"   -d, --devtime <timestamp>  Device time\n"
 	"   -s, --systime <timestamp>  System time\n"
+	"   -f, --format <format>      Output format (xml or columnar)\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
+	"   -t, --threads <count>      Number of worker threads\n"
 #else
 	"   -h              Show help message\n"
 	"   -o <filename>   Output filename\n"
 	"   -d <devtime>    Device time\n"
 	"   -s <systime>    System time\n"
+	"   -f <format>     Output format (xml or columnar)\n"
 	"   -u <units>      Set units (metric or imperial)\n"
+	"   -t <count>      Number of worker threads\n"
 #endif
+	"\n"
+	"All input files, and the files in the input directories, are written\n"
+	"to a single output, in the order of the command-line. The files in a\n"
+	"directory are sorted by name.\n"
 };
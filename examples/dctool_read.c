@@ -26,6 +26,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
@@ -38,8 +39,92 @@
 #include "common.h"
 #include "utils.h"
 
+// Block size of the checkpoints.
+#define BLOCKSIZE 4096
+
+/*
+ * Read the data in blocks, and append every block to the checkpoint
+ * file. The data of a previous attempt is reused, except for its last
+ * block, which is read again to verify that the memory didn't change.
+ */
 static dc_status_t
-doread (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, unsigned int address, dc_buffer_t *buffer)
+doread_checkpoint (dc_device_t *device, const char *cpfilename, unsigned int address, dc_buffer_t *buffer)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned char *data = dc_buffer_get_data (buffer);
+	unsigned int size = dc_buffer_get_size (buffer);
+	FILE *fp = NULL;
+
+	// Reuse the data of a previous attempt.
+	unsigned int nbytes = 0;
+	dc_buffer_t *cpdata = dctool_file_read (cpfilename);
+	if (cpdata) {
+		unsigned int length = dc_buffer_get_size (cpdata);
+		if (length > size)
+			length = size;
+		length -= length % BLOCKSIZE;
+		if (length >= 2 * BLOCKSIZE) {
+			nbytes = length - BLOCKSIZE;
+			memcpy (data, dc_buffer_get_data (cpdata), nbytes);
+			message ("Resuming at offset 0x%08x.\n", address + nbytes);
+		}
+	}
+
+	// Rewrite the checkpoint file with the reused data only.
+	fp = fopen (cpfilename, "wb");
+	if (fp == NULL) {
+		ERROR ("Failed to open the checkpoint file.");
+		rc = DC_STATUS_IO;
+		goto cleanup;
+	}
+	fwrite (data, 1, nbytes, fp);
+
+	while (nbytes < size) {
+		unsigned int len = size - nbytes;
+		if (len > BLOCKSIZE)
+			len = BLOCKSIZE;
+
+		rc = dc_device_read (device, address + nbytes, data + nbytes, len);
+		if (rc != DC_STATUS_SUCCESS)
+			goto cleanup;
+
+		// Start over if the memory changed since the checkpoint.
+		if (cpdata && nbytes < dc_buffer_get_size (cpdata) &&
+			memcmp (dc_buffer_get_data (cpdata) + nbytes, data + nbytes, len) != 0) {
+			WARNING ("The memory changed since the checkpoint. Starting over.");
+			dc_buffer_free (cpdata);
+			cpdata = NULL;
+			nbytes = 0;
+			fclose (fp);
+			fp = fopen (cpfilename, "wb");
+			if (fp == NULL) {
+				ERROR ("Failed to open the checkpoint file.");
+				rc = DC_STATUS_IO;
+				goto cleanup;
+			}
+			continue;
+		}
+
+		fwrite (data + nbytes, 1, len, fp);
+		fflush (fp);
+
+		nbytes += len;
+	}
+
+	// The checkpoint is no longer needed.
+	fclose (fp);
+	fp = NULL;
+	remove (cpfilename);
+
+cleanup:
+	if (fp)
+		fclose (fp);
+	dc_buffer_free (cpdata);
+	return rc;
+}
+
+static dc_status_t
+doread (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, unsigned int address, const char *cpfilename, dc_buffer_t *buffer)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
@@ -74,7 +159,10 @@ doread (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname,
 
 	// Read data from the internal memory.
 	message ("Reading data from the internal memory.\n");
-	rc = dc_device_read (device, address, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+	if (cpfilename)
+		rc = doread_checkpoint (device, cpfilename, address, buffer);
+	else
+		rc = dc_device_read (device, address, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error reading from the internal memory.");
 		goto cleanup;
@@ -95,18 +183,20 @@ dctool_read_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	// Default option values.
 	unsigned int help = 0;
 	const char *filename = NULL;
+	const char *checkpoint = NULL;
 	unsigned int address = 0, have_address = 0;
 	unsigned int count = 0, have_count = 0;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ha:c:o:";
+	const char *optstring = "ha:c:o:k:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"address",     required_argument, 0, 'a'},
 		{"count",       required_argument, 0, 'c'},
 		{"output",      required_argument, 0, 'o'},
+		{"checkpoint",  required_argument, 0, 'k'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -128,6 +218,9 @@ dctool_read_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 'o':
 			filename = optarg;
 			break;
+		case 'k':
+			checkpoint = optarg;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -159,7 +252,7 @@ dctool_read_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Read data from the internal memory.
-	status = doread (context, descriptor, argv[0], address, buffer);
+	status = doread (context, descriptor, argv[0], address, checkpoint, buffer);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -188,10 +281,15 @@ const dctool_command_t dctool_read = {
 	"   -a, --address <address>    Memory address\n"
 	"   -c, --count <count>        Number of bytes\n"
 	"   -o, --output <filename>    Output filename\n"
+	"   -k, --checkpoint <file>    Checkpoint filename\n"
 #else
 	"   -h              Show help message\n"
 	"   -a <address>    Memory address\n"
 	"   -c <count>      Number of bytes\n"
 	"   -o <filename>   Output filename\n"
+	"   -k <filename>   Checkpoint filename\n"
 #endif
+	"\n"
+	"With a checkpoint file, the completed part of the data is saved while\n"
+	"reading, and a failed read resumes from there on the next run.\n"
 };
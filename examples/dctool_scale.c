@@ -0,0 +1,535 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+// Growth of the time per item that is reported as non-linear.
+#define NONLINEAR 2.0
+
+typedef struct scale_generator_t {
+	const char *name;
+	const char *description;
+	dc_family_t family;
+	unsigned int model;
+	// Extract the dives from a memory image, instead of parsing a dive.
+	unsigned int extract;
+	int (*generate) (dc_buffer_t *buffer, unsigned int count);
+} scale_generator_t;
+
+typedef struct scale_memory_t {
+	size_t current;
+	size_t peak;
+} scale_memory_t;
+
+/*
+ * A deterministic profile: repeated descents to 30 m and back, with
+ * the temperature dropping with the depth. The depth is in cm.
+ */
+static unsigned int
+scale_depth (unsigned int i)
+{
+	unsigned int phase = i % 2000;
+	return phase < 1000 ? phase * 3 : (2000 - phase) * 3;
+}
+
+static void
+scale_uint16_be (unsigned char *data, unsigned int value)
+{
+	data[0] = (value >> 8) & 0xFF;
+	data[1] = value & 0xFF;
+}
+
+static void
+scale_uint16_le (unsigned char *data, unsigned int value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+}
+
+static void
+scale_uint32_le (unsigned char *data, unsigned int value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+/*
+ * Shearwater dive: a header block, the samples every 10 seconds, a
+ * footer block, and for the Petrel also the final block.
+ */
+static int
+scale_shearwater (dc_buffer_t *buffer, unsigned int count, unsigned int samplesize, unsigned int petrel)
+{
+	const unsigned int blocksize = 0x80;
+	unsigned int size = blocksize + count * samplesize + blocksize * (petrel ? 2 : 1);
+
+	if (!dc_buffer_resize (buffer, size))
+		return 0;
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+	memset (data, 0, size);
+
+	// Header: metric units, the date and the log version.
+	data[0] = data[1] = 0xFF;
+	data[8] = 0;
+	data[12] = 0x60; data[13] = 0x00; data[14] = 0x00; data[15] = 0x00;
+	data[127] = 7;
+
+	unsigned int maxdepth = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned char *sample = data + blocksize + i * samplesize;
+		unsigned int depth = scale_depth (i) / 10;
+		if (maxdepth < depth)
+			maxdepth = depth;
+		scale_uint16_be (sample + 0, depth);
+		sample[7] = 32;
+		sample[8] = 0;
+		sample[11] = 0x10;
+		sample[13] = 20 - depth / 20;
+	}
+
+	// Footer: the maximum depth and the dive time (minutes).
+	unsigned char *footer = data + blocksize + count * samplesize;
+	footer[0] = 0xFF; footer[1] = 0xFE;
+	scale_uint16_be (footer + 4, maxdepth / 10);
+	scale_uint16_be (footer + 6, count / 6);
+	if (petrel) {
+		footer[blocksize + 0] = 0xFF;
+		footer[blocksize + 1] = 0xFD;
+	}
+
+	return 1;
+}
+
+static int
+scale_predator (dc_buffer_t *buffer, unsigned int count)
+{
+	return scale_shearwater (buffer, count, 0x10, 0);
+}
+
+static int
+scale_petrel (dc_buffer_t *buffer, unsigned int count)
+{
+	return scale_shearwater (buffer, count, 0x20, 1);
+}
+
+/*
+ * OSTC3 dive (version 0x23): the 256 byte header, the profile header
+ * with a single extended sample (the temperature, every 6 samples),
+ * one sample per second, and the end marker.
+ */
+static int
+scale_ostc3 (dc_buffer_t *buffer, unsigned int count)
+{
+	const unsigned int header = 256;
+	const unsigned int divisor = 6;
+	unsigned int nextended = count / divisor;
+	unsigned int size = header + 5 + 3 + count * 3 + nextended * 2 + 2;
+
+	if (!dc_buffer_resize (buffer, size))
+		return 0;
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+	memset (data, 0, size);
+
+	// Header: version, date, the first gas mix, and OC mode.
+	data[0] = 0xFA; data[1] = 0xFA;
+	data[8] = 0x23;
+	data[12] = 26; data[13] = 1; data[14] = 1; data[15] = 12; data[16] = 0;
+	data[28] = 21; data[29] = 0; data[31] = 1;
+	data[82] = 0;
+
+	unsigned int maxdepth = 0;
+	unsigned int offset = header;
+	data[offset + 3] = 1;
+	data[offset + 4] = 1;
+	data[offset + 5] = 0;
+	data[offset + 6] = 2;
+	data[offset + 7] = divisor;
+	offset += 5 + 3;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int depth = scale_depth (i);
+		if (maxdepth < depth)
+			maxdepth = depth;
+
+		// The pressure (mbar), which is about a cm of water.
+		scale_uint16_le (data + offset, depth);
+		offset += 2;
+
+		if ((i + 1) % divisor == 0) {
+			data[offset++] = 2;
+			scale_uint16_le (data + offset, 200 - depth / 20);
+			offset += 2;
+		} else {
+			data[offset++] = 0;
+		}
+	}
+
+	data[offset + 0] = 0xFD;
+	data[offset + 1] = 0xFD;
+
+	scale_uint16_le (data + 17, maxdepth);
+	scale_uint16_le (data + 19, count / 60);
+	data[21] = count % 60;
+
+	return 1;
+}
+
+/*
+ * Scubapro Meridian memory image: count dives of 256 bytes, each
+ * starting with the start marker, the length and the timestamp.
+ */
+static int
+scale_meridian (dc_buffer_t *buffer, unsigned int count)
+{
+	const unsigned int length = 256;
+	unsigned int size = count * length;
+
+	if (!dc_buffer_resize (buffer, size))
+		return 0;
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+	memset (data, 0, size);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned char *dive = data + i * length;
+		dive[0] = 0xA5; dive[1] = 0xA5; dive[2] = 0x5A; dive[3] = 0x5A;
+		scale_uint32_le (dive + 4, length);
+		scale_uint32_le (dive + 8, 0x10000000 + i * 3600);
+	}
+
+	return 1;
+}
+
+static const scale_generator_t g_generators[] = {
+	{"predator", "Shearwater Predator dive",       DC_FAMILY_SHEARWATER_PREDATOR, 0x02, 0, scale_predator},
+	{"petrel",   "Shearwater Petrel dive",         DC_FAMILY_SHEARWATER_PETREL,   0x03, 0, scale_petrel},
+	{"ostc3",    "Heinrichs Weikamp OSTC3 dive",   DC_FAMILY_HW_OSTC3,            0x0A, 0, scale_ostc3},
+	{"meridian", "Scubapro Meridian memory image", DC_FAMILY_UWATEC_MERIDIAN,     0x20, 1, scale_meridian},
+};
+
+static void *
+scale_alloc (size_t size, void *userdata)
+{
+	scale_memory_t *memory = (scale_memory_t *) userdata;
+
+	// The size is stored in front of the block, to account for the
+	// release of the block later.
+	size_t *block = (size_t *) malloc (sizeof (size_t) * 2 + size);
+	if (block == NULL)
+		return NULL;
+
+	block[0] = size;
+	memory->current += size;
+	if (memory->peak < memory->current)
+		memory->peak = memory->current;
+
+	return block + 2;
+}
+
+static void
+scale_release (void *ptr, void *userdata)
+{
+	scale_memory_t *memory = (scale_memory_t *) userdata;
+
+	if (ptr == NULL)
+		return;
+
+	size_t *block = (size_t *) ptr - 2;
+	memory->current -= block[0];
+	free (block);
+}
+
+static void
+sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	unsigned int *nsamples = (unsigned int *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		(*nsamples)++;
+}
+
+static int
+dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	unsigned int *ndives = (unsigned int *) userdata;
+
+	(*ndives)++;
+
+	return 1;
+}
+
+static dc_status_t
+scale_parse (dc_context_t *context, dc_descriptor_t *descriptor, dc_buffer_t *buffer, unsigned int *count)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+	dc_datetime_t datetime;
+	unsigned int ngasmixes = 0;
+	double depth = 0.0;
+
+	rc = dc_parser_new2 (&parser, context, descriptor, 0, 0);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	rc = dc_parser_set_data (parser, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+	if (rc != DC_STATUS_SUCCESS)
+		goto cleanup;
+
+	// Query the summary, the same way as the applications do.
+	dc_parser_get_datetime (parser, &datetime);
+	dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &depth);
+	dc_parser_get_field (parser, DC_FIELD_AVGDEPTH, 0, &depth);
+	dc_parser_get_field (parser, DC_FIELD_TEMPERATURE_MINIMUM, 0, &depth);
+	dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes);
+
+	*count = 0;
+	rc = dc_parser_samples_foreach (parser, sample_cb, count);
+
+cleanup:
+	dc_parser_destroy (parser);
+	return rc;
+}
+
+static int
+scale_run (dc_context_t *context, const scale_generator_t *generator, unsigned int minimum, unsigned int maximum, unsigned int iterations)
+{
+	int exitcode = EXIT_SUCCESS;
+	dc_descriptor_t *descriptor = NULL;
+	dc_buffer_t *buffer = NULL;
+	scale_memory_t memory = {0, 0};
+	double first = 0.0, last = 0.0;
+	const char *unit = generator->extract ? "dive" : "sample";
+
+	dc_status_t rc = dctool_descriptor_search (&descriptor, NULL, generator->family, generator->model);
+	if (rc != DC_STATUS_SUCCESS || descriptor == NULL) {
+		message ("No descriptor for the '%s' generator.\n", generator->name);
+		return EXIT_FAILURE;
+	}
+
+	buffer = dc_buffer_new (0);
+	if (buffer == NULL) {
+		message ("Failed to allocate memory.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	printf ("%s (%s %s)\n", generator->description,
+		dc_descriptor_get_vendor (descriptor), dc_descriptor_get_product (descriptor));
+	printf ("%10s %12s %14s %14s\n", generator->extract ? "dives" : "samples", "seconds", "ns/item", "bytes/item");
+
+	for (unsigned int count = minimum; count <= maximum; count *= 2) {
+		if (!generator->generate (buffer, count)) {
+			message ("Failed to generate %u items.\n", count);
+			exitcode = EXIT_FAILURE;
+			break;
+		}
+
+		// The fastest of the iterations, and the peak memory usage of
+		// the library.
+		double elapsed = 0.0;
+		unsigned int n = 0;
+		memory.current = 0;
+		memory.peak = 0;
+		dc_context_set_allocator (context, scale_alloc, scale_release, &memory);
+		for (unsigned int i = 0; i < iterations; ++i) {
+			double start = dctool_now ();
+			n = 0;
+			if (generator->extract)
+				rc = dc_device_extract (context, descriptor, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), dive_cb, &n);
+			else
+				rc = scale_parse (context, descriptor, buffer, &n);
+			double seconds = dctool_now () - start;
+			if (rc != DC_STATUS_SUCCESS)
+				break;
+			if (i == 0 || seconds < elapsed)
+				elapsed = seconds;
+		}
+		dc_context_set_allocator (context, NULL, NULL, NULL);
+
+		if (rc != DC_STATUS_SUCCESS || n != count) {
+			message ("ERROR: %s (%u of %u items)\n", dctool_errmsg (rc), n, count);
+			exitcode = EXIT_FAILURE;
+			break;
+		}
+
+		double ns = elapsed * 1e9 / count;
+		printf ("%10u %12.6f %14.2f %14.2f\n", count, elapsed, ns, (double) memory.peak / count);
+
+		if (count == minimum)
+			first = ns;
+		last = ns;
+
+		// Stop doubling before the count overflows.
+		if (count > maximum / 2)
+			break;
+	}
+
+	if (exitcode == EXIT_SUCCESS && first > 0.0 && last > NONLINEAR * first) {
+		printf ("WARNING: The time per %s grows with the size (%.1fx).\n", unit, last / first);
+	}
+
+	printf ("\n");
+
+cleanup:
+	dc_buffer_free (buffer);
+	dc_descriptor_free (descriptor);
+	return exitcode;
+}
+
+static int
+dctool_scale_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *dummy)
+{
+	int exitcode = EXIT_SUCCESS;
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int minimum = 1000;
+	unsigned int maximum = 1024000;
+	unsigned int iterations = 3;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hm:M:n:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"minimum",     required_argument, 0, 'm'},
+		{"maximum",     required_argument, 0, 'M'},
+		{"iterations",  required_argument, 0, 'n'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'm':
+			minimum = strtoul (optarg, NULL, 0);
+			break;
+		case 'M':
+			maximum = strtoul (optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_scale);
+		return EXIT_SUCCESS;
+	}
+
+	if (minimum == 0)
+		minimum = 1;
+	if (maximum < minimum)
+		maximum = minimum;
+	if (iterations == 0)
+		iterations = 1;
+
+	// Run the selected generators, or all of them.
+	unsigned int found = 0;
+	for (unsigned int i = 0; i < sizeof (g_generators) / sizeof (g_generators[0]); ++i) {
+		int selected = (argc == 0);
+		for (int j = 0; j < argc; ++j) {
+			if (strcmp (argv[j], g_generators[i].name) == 0)
+				selected = 1;
+		}
+		if (!selected)
+			continue;
+
+		found++;
+		if (scale_run (context, &g_generators[i], minimum, maximum, iterations) != EXIT_SUCCESS)
+			exitcode = EXIT_FAILURE;
+	}
+
+	if (found == 0) {
+		message ("No such generator.\n");
+		exitcode = EXIT_FAILURE;
+	}
+
+	return exitcode;
+}
+
+const dctool_command_t dctool_scale = {
+	dctool_scale_run,
+	DCTOOL_CONFIG_NONE,
+	"scale",
+	"Measure the scalability with synthetic data",
+	"Usage:\n"
+	"   dctool scale [options] [generator]...\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -m, --minimum <count>      Smallest number of items\n"
+	"   -M, --maximum <count>      Largest number of items\n"
+	"   -n, --iterations <count>   Number of iterations\n"
+#else
+	"   -h              Show help message\n"
+	"   -m <count>      Smallest number of items\n"
+	"   -M <count>      Largest number of items\n"
+	"   -n <count>      Number of iterations\n"
+#endif
+	"\n"
+	"Generators:\n"
+	"   predator   Shearwater Predator dive (samples)\n"
+	"   petrel     Shearwater Petrel dive (samples)\n"
+	"   ostc3      Heinrichs Weikamp OSTC3 dive (samples)\n"
+	"   meridian   Scubapro Meridian memory image (dives)\n"
+	"\n"
+	"The number of items doubles from the minimum up to the maximum. The\n"
+	"time is the fastest iteration, and the memory is the peak of the\n"
+	"allocations through the context. A time per item which grows with\n"
+	"the size indicates non-linear behaviour.\n"
+};
@@ -77,3 +77,31 @@ dctool_output_free (dctool_output_t *output)
 
 	return status;
 }
+
+dctool_output_t *
+dctool_output_fragment (dctool_output_t *output, dc_buffer_t *buffer, unsigned int number)
+{
+	dctool_output_t *fragment = NULL;
+
+	if (output == NULL || output->vtable->fragment == NULL)
+		return NULL;
+
+	fragment = output->vtable->fragment (output, buffer);
+	if (fragment == NULL)
+		return NULL;
+
+	fragment->number = number;
+
+	return fragment;
+}
+
+dc_status_t
+dctool_output_append (dctool_output_t *output, dc_buffer_t *buffer, unsigned int ndives)
+{
+	if (output == NULL || output->vtable->append == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	output->number += ndives;
+
+	return output->vtable->append (output, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+}
@@ -24,6 +24,7 @@
 
 #include <libdivecomputer/common.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/buffer.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,12 +43,32 @@ dctool_xml_output_new (const char *filename, dctool_units_t units);
 dctool_output_t *
 dctool_raw_output_new (const char *template);
 
+dctool_output_t *
+dctool_columnar_output_new (const char *filename);
+
 dc_status_t
 dctool_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
 
 dc_status_t
 dctool_output_free (dctool_output_t *output);
 
+/*
+ * Output fragments
+ *
+ * A fragment is a temporary output with the same format and settings as
+ * the parent output, which writes the dives to a memory buffer instead,
+ * without the file header or footer. The dives are numbered starting
+ * after the given number. The content of the buffer can be appended to
+ * the parent output afterwards. This allows to render dives on another
+ * thread, and still write them in order. Not every format supports
+ * fragments, in which case NULL is returned.
+ */
+dctool_output_t *
+dctool_output_fragment (dctool_output_t *output, dc_buffer_t *buffer, unsigned int number);
+
+dc_status_t
+dctool_output_append (dctool_output_t *output, dc_buffer_t *buffer, unsigned int ndives);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
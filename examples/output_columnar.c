@@ -0,0 +1,430 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "output-private.h"
+#include "writer.h"
+#include "utils.h"
+
+/*
+ * Columnar output format
+ *
+ * The file starts with a 16 byte header: the magic "DCCOLUMN", the
+ * format version and a reserved field. It is followed by one block per
+ * dive. All integers are stored in little endian, every field is
+ * aligned to its natural size and every block is padded to a multiple
+ * of 8 bytes, so the file can be mapped into memory and accessed
+ * directly. Each block starts with a 48 byte header:
+ *
+ *   0  u32  block size (including this header and the padding)
+ *   4  u32  dive number
+ *   8  u32  size of the raw dive data
+ *  12  u32  number of rows
+ *  16  u32  number of pressure columns (tanks)
+ *  20  u32  number of events
+ *  24  u32  union of the row masks
+ *  28  i32  timezone (seconds, or DC_TIMEZONE_NONE)
+ *  32  u16  year
+ *  34  u8   month, day, hour, minute, second
+ *  39  u8   fingerprint size
+ *  40  u32  divetime (seconds)
+ *  44  u32  maximum depth (millimeters)
+ *
+ * The header is followed by the fingerprint (padded to 8 bytes), the
+ * row mask column (u32, 1 << DC_SAMPLE_xxx), and the time (seconds),
+ * depth (millimeters), pressure (millibar, one column per tank) and
+ * temperature (hundredths of a degree Celsius) columns. The values of
+ * these columns are i32 deltas to the previous row, starting from
+ * zero. A row without a value repeats the previous value, and thus has
+ * a zero delta. The events are stored at the end, as five u32 fields
+ * each: row, type, time, flags and value.
+ */
+
+#define MAGIC      "DCCOLUMN"
+#define VERSION    1
+#define SZ_HEADER  16
+#define SZ_DIVE    48
+#define SZ_EVENT   20
+
+#define ALIGN8(x)  (((x) + 7) & ~7u)
+
+static dc_status_t dctool_columnar_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_columnar_output_free (dctool_output_t *output);
+static dctool_output_t *dctool_columnar_output_fragment (dctool_output_t *output, dc_buffer_t *buffer);
+static dc_status_t dctool_columnar_output_append (dctool_output_t *output, const unsigned char data[], unsigned int size);
+
+typedef struct dctool_columnar_output_t {
+	dctool_output_t base;
+	FILE *ostream;
+	dc_sample_table_t table;
+	unsigned int npressure;
+	dctool_writer_t writer;
+} dctool_columnar_output_t;
+
+static const dctool_output_vtable_t columnar_vtable = {
+	sizeof(dctool_columnar_output_t), /* size */
+	dctool_columnar_output_write, /* write */
+	dctool_columnar_output_free, /* free */
+	dctool_columnar_output_fragment, /* fragment */
+	dctool_columnar_output_append, /* append */
+};
+
+static void
+columnar_put_u16 (unsigned char data[], unsigned int value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+}
+
+static void
+columnar_put_u32 (unsigned char data[], unsigned int value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+	data[2] = (value >> 16) & 0xFF;
+	data[3] = (value >> 24) & 0xFF;
+}
+
+static long
+columnar_round (double value)
+{
+	return (long) (value >= 0.0 ? value + 0.5 : value - 0.5);
+}
+
+static void
+columnar_write_u32 (dctool_writer_t *writer, unsigned int value)
+{
+	unsigned char data[4];
+	columnar_put_u32 (data, value);
+	dctool_writer_write (writer, (const char *) data, sizeof (data));
+}
+
+static void
+columnar_write_padding (dctool_writer_t *writer, unsigned int size)
+{
+	static const char zero[8] = {0};
+	dctool_writer_write (writer, zero, ALIGN8 (size) - size);
+}
+
+/*
+ * Write a column as deltas of the fixed-point values. Rows without the
+ * sample type in their mask repeat the previous value.
+ */
+static void
+columnar_write_column (dctool_writer_t *writer, const dc_sample_table_t *table, const double values[], unsigned int stride, unsigned int type, double scale)
+{
+	long previous = 0, current = 0;
+
+	for (unsigned int i = 0; i < table->count; ++i) {
+		if (table->mask[i] & (1u << type))
+			current = columnar_round (values[i * stride] * scale);
+		columnar_write_u32 (writer, (unsigned int) (current - previous));
+		previous = current;
+	}
+}
+
+static dc_status_t
+columnar_table_resize (dctool_columnar_output_t *output, unsigned int capacity, unsigned int nevents)
+{
+	dc_sample_table_t *table = &output->table;
+
+	if (capacity > table->capacity) {
+		unsigned int *mask = (unsigned int *) realloc (table->mask, capacity * sizeof (unsigned int));
+		if (mask == NULL)
+			return DC_STATUS_NOMEMORY;
+		table->mask = mask;
+
+		unsigned int *time = (unsigned int *) realloc (table->time, capacity * sizeof (unsigned int));
+		if (time == NULL)
+			return DC_STATUS_NOMEMORY;
+		table->time = time;
+
+		double *depth = (double *) realloc (table->depth, capacity * sizeof (double));
+		if (depth == NULL)
+			return DC_STATUS_NOMEMORY;
+		table->depth = depth;
+
+		double *temperature = (double *) realloc (table->temperature, capacity * sizeof (double));
+		if (temperature == NULL)
+			return DC_STATUS_NOMEMORY;
+		table->temperature = temperature;
+
+		table->capacity = capacity;
+	}
+
+	// The pressure column depends on the number of tanks, and is sized
+	// separately.
+	if (table->capacity * table->ntanks > output->npressure) {
+		unsigned int npressure = table->capacity * table->ntanks;
+		double *pressure = (double *) realloc (table->pressure, npressure * sizeof (double));
+		if (pressure == NULL)
+			return DC_STATUS_NOMEMORY;
+		table->pressure = pressure;
+		output->npressure = npressure;
+	}
+
+	if (nevents > table->events_capacity) {
+		dc_sample_table_event_t *events = (dc_sample_table_event_t *) realloc (table->events, nevents * sizeof (dc_sample_table_event_t));
+		if (events == NULL)
+			return DC_STATUS_NOMEMORY;
+		table->events = events;
+		table->events_capacity = nevents;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dctool_output_t *
+dctool_columnar_output_new (const char *filename)
+{
+	dctool_columnar_output_t *output = NULL;
+	unsigned char header[SZ_HEADER] = {0};
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_columnar_output_t *) dctool_output_allocate (&columnar_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	memset (&output->table, 0, sizeof (output->table));
+	output->npressure = 0;
+
+	// Open the output file.
+	output->ostream = fopen (filename, "wb");
+	if (output->ostream == NULL) {
+		goto error_free;
+	}
+
+	setvbuf (output->ostream, NULL, _IONBF, 0);
+	dctool_writer_init (&output->writer, output->ostream);
+
+	memcpy (header, MAGIC, 8);
+	columnar_put_u32 (header + 8, VERSION);
+	dctool_writer_write (&output->writer, (const char *) header, sizeof (header));
+
+	return (dctool_output_t *) output;
+
+error_free:
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dctool_output_t *
+dctool_columnar_output_fragment (dctool_output_t *abstract, dc_buffer_t *buffer)
+{
+	dctool_columnar_output_t *output = NULL;
+
+	// Allocate memory.
+	output = (dctool_columnar_output_t *) dctool_output_allocate (&columnar_vtable);
+	if (output == NULL) {
+		return NULL;
+	}
+
+	memset (&output->table, 0, sizeof (output->table));
+	output->npressure = 0;
+	output->ostream = NULL;
+	dctool_writer_init_buffer (&output->writer, buffer);
+
+	return (dctool_output_t *) output;
+}
+
+static dc_status_t
+dctool_columnar_output_append (dctool_output_t *abstract, const unsigned char data[], unsigned int size)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+
+	dctool_writer_write (&output->writer, (const char *) data, size);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_columnar_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dctool_writer_t *writer = &output->writer;
+	dc_sample_table_t *table = &output->table;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char header[SZ_DIVE] = {0};
+
+	if (fingerprint == NULL || fsize > 255)
+		fsize = 0;
+
+	// Parse the datetime.
+	message ("Parsing the datetime.\n");
+	dc_datetime_t dt = {0};
+	dt.timezone = DC_TIMEZONE_NONE;
+	status = dc_parser_get_datetime (parser, &dt);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the datetime.");
+		return status;
+	}
+
+	// Parse the divetime.
+	message ("Parsing the divetime.\n");
+	unsigned int divetime = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the divetime.");
+		return status;
+	}
+
+	// Parse the maxdepth.
+	message ("Parsing the maxdepth.\n");
+	double maxdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the maxdepth.");
+		return status;
+	}
+
+	// Parse the tank count.
+	message ("Parsing the tank count.\n");
+	unsigned int ntanks = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the tank count.");
+		return status;
+	}
+
+	// Some backends report pressure samples without any tank info.
+	if (ntanks == 0)
+		ntanks = 1;
+
+	// Parse the sample data, and grow the table if it's too small.
+	message ("Parsing the sample data.\n");
+	table->ntanks = ntanks;
+	for (;;) {
+		status = columnar_table_resize (output, table->capacity, table->events_capacity);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR ("Failed to allocate memory.");
+			return status;
+		}
+
+		status = dc_parser_samples_get_batch (parser, table);
+		if (status != DC_STATUS_NOMEMORY)
+			break;
+
+		status = columnar_table_resize (output, table->count, table->nevents);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR ("Failed to allocate memory.");
+			return status;
+		}
+	}
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the sample data.");
+		return status;
+	}
+
+	unsigned int mask = 0;
+	for (unsigned int i = 0; i < table->count; ++i) {
+		mask |= table->mask[i];
+	}
+
+	// Only store the pressure columns if there are pressure samples.
+	unsigned int ncolumns = (mask & (1u << DC_SAMPLE_PRESSURE)) ? ntanks : 0;
+
+	unsigned int blocksize = SZ_DIVE + ALIGN8 (fsize) +
+		table->count * 4 * (4 + ncolumns) +
+		table->nevents * SZ_EVENT;
+
+	columnar_put_u32 (header +  0, ALIGN8 (blocksize));
+	columnar_put_u32 (header +  4, abstract->number);
+	columnar_put_u32 (header +  8, size);
+	columnar_put_u32 (header + 12, table->count);
+	columnar_put_u32 (header + 16, ncolumns);
+	columnar_put_u32 (header + 20, table->nevents);
+	columnar_put_u32 (header + 24, mask);
+	columnar_put_u32 (header + 28, (unsigned int) dt.timezone);
+	columnar_put_u16 (header + 32, dt.year);
+	header[34] = dt.month;
+	header[35] = dt.day;
+	header[36] = dt.hour;
+	header[37] = dt.minute;
+	header[38] = dt.second;
+	header[39] = fsize;
+	columnar_put_u32 (header + 40, divetime);
+	columnar_put_u32 (header + 44, (unsigned int) columnar_round (maxdepth * 1000.0));
+	dctool_writer_write (writer, (const char *) header, sizeof (header));
+
+	if (fsize) {
+		dctool_writer_write (writer, (const char *) fingerprint, fsize);
+		columnar_write_padding (writer, fsize);
+	}
+
+	for (unsigned int i = 0; i < table->count; ++i) {
+		columnar_write_u32 (writer, table->mask[i]);
+	}
+
+	unsigned int time = 0;
+	for (unsigned int i = 0; i < table->count; ++i) {
+		columnar_write_u32 (writer, table->time[i] - time);
+		time = table->time[i];
+	}
+
+	columnar_write_column (writer, table, table->depth, 1, DC_SAMPLE_DEPTH, 1000.0);
+	for (unsigned int n = 0; n < ncolumns; ++n) {
+		columnar_write_column (writer, table, table->pressure + n, ntanks, DC_SAMPLE_PRESSURE, 1000.0);
+	}
+	columnar_write_column (writer, table, table->temperature, 1, DC_SAMPLE_TEMPERATURE, 100.0);
+
+	for (unsigned int i = 0; i < table->nevents; ++i) {
+		const dc_sample_table_event_t *event = table->events + i;
+		columnar_write_u32 (writer, event->row);
+		columnar_write_u32 (writer, event->type);
+		columnar_write_u32 (writer, event->time);
+		columnar_write_u32 (writer, event->flags);
+		columnar_write_u32 (writer, event->value);
+	}
+
+	columnar_write_padding (writer, blocksize);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_columnar_output_free (dctool_output_t *abstract)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (dctool_writer_flush (&output->writer) != 0)
+		status = output->ostream ? DC_STATUS_IO : DC_STATUS_NOMEMORY;
+
+	if (output->ostream)
+		fclose (output->ostream);
+
+	free (output->table.mask);
+	free (output->table.time);
+	free (output->table.depth);
+	free (output->table.pressure);
+	free (output->table.temperature);
+	free (output->table.events);
+
+	return status;
+}
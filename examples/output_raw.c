@@ -24,6 +24,7 @@
 #include <stdio.h>
 
 #include "output-private.h"
+#include "writer.h"
 #include "utils.h"
 
 static dc_status_t dctool_raw_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
@@ -38,27 +39,17 @@ static const dctool_output_vtable_t raw_vtable = {
 	sizeof(dctool_raw_output_t), /* size */
 	dctool_raw_output_write, /* write */
 	dctool_raw_output_free, /* free */
+	NULL, /* fragment */
+	NULL, /* append */
 };
 
 static int
 mktemplate_fingerprint (char *buffer, size_t size, const unsigned char fingerprint[], size_t fsize)
 {
-	const unsigned char ascii[] = {
-		'0', '1', '2', '3', '4', '5', '6', '7',
-		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-
 	if (size < 2 * fsize + 1)
 		return -1;
 
-	for (size_t i = 0; i < fsize; ++i) {
-		// Set the most-significant nibble.
-		unsigned char msn = (fingerprint[i] >> 4) & 0x0F;
-		buffer[i * 2 + 0] = ascii[msn];
-
-		// Set the least-significant nibble.
-		unsigned char lsn = fingerprint[i] & 0x0F;
-		buffer[i * 2 + 1] = ascii[lsn];
-	}
+	dctool_hex_encode (buffer, fingerprint, fsize);
 
 	// Null-terminate the string.
 	buffer[fsize * 2] = 0;
@@ -26,14 +26,18 @@
 #include <libdivecomputer/units.h>
 
 #include "output-private.h"
+#include "writer.h"
 #include "utils.h"
 
 static dc_status_t dctool_xml_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
 static dc_status_t dctool_xml_output_free (dctool_output_t *output);
+static dctool_output_t *dctool_xml_output_fragment (dctool_output_t *output, dc_buffer_t *buffer);
+static dc_status_t dctool_xml_output_append (dctool_output_t *output, const unsigned char data[], unsigned int size);
 
 typedef struct dctool_xml_output_t {
 	dctool_output_t base;
 	FILE *ostream;
+	dctool_writer_t writer;
 	dctool_units_t units;
 } dctool_xml_output_t;
 
@@ -41,10 +45,12 @@ static const dctool_output_vtable_t xml_vtable = {
 	sizeof(dctool_xml_output_t), /* size */
 	dctool_xml_output_write, /* write */
 	dctool_xml_output_free, /* free */
+	dctool_xml_output_fragment, /* fragment */
+	dctool_xml_output_append, /* append */
 };
 
 typedef struct sample_data_t {
-	FILE *ostream;
+	dctool_writer_t *writer;
 	dctool_units_t units;
 	unsigned int nsamples;
 } sample_data_t;
@@ -103,65 +109,93 @@ sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
 		"ndl", "safety", "deco", "deep"};
 
 	sample_data_t *sampledata = (sample_data_t *) userdata;
+	dctool_writer_t *writer = sampledata->writer;
 
 	switch (type) {
 	case DC_SAMPLE_TIME:
 		if (sampledata->nsamples++)
-			fprintf (sampledata->ostream, "</sample>\n");
-		fprintf (sampledata->ostream, "<sample>\n");
-		fprintf (sampledata->ostream, "   <time>%02u:%02u</time>\n", value.time / 60, value.time % 60);
+			dctool_writer_puts (writer, "</sample>\n");
+		dctool_writer_puts (writer, "<sample>\n   <time>");
+		dctool_writer_uint (writer, value.time / 60, 2);
+		dctool_writer_puts (writer, ":");
+		dctool_writer_uint (writer, value.time % 60, 2);
+		dctool_writer_puts (writer, "</time>\n");
 		break;
 	case DC_SAMPLE_DEPTH:
-		fprintf (sampledata->ostream, "   <depth>%.2f</depth>\n",
-			convert_depth(value.depth, sampledata->units));
+		dctool_writer_puts (writer, "   <depth>");
+		dctool_writer_fixed (writer, convert_depth(value.depth, sampledata->units), 2);
+		dctool_writer_puts (writer, "</depth>\n");
 		break;
 	case DC_SAMPLE_PRESSURE:
-		fprintf (sampledata->ostream, "   <pressure tank=\"%u\">%.2f</pressure>\n",
-			value.pressure.tank,
-			convert_pressure(value.pressure.value, sampledata->units));
+		dctool_writer_puts (writer, "   <pressure tank=\"");
+		dctool_writer_uint (writer, value.pressure.tank, 0);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_fixed (writer, convert_pressure(value.pressure.value, sampledata->units), 2);
+		dctool_writer_puts (writer, "</pressure>\n");
 		break;
 	case DC_SAMPLE_TEMPERATURE:
-		fprintf (sampledata->ostream, "   <temperature>%.2f</temperature>\n",
-			convert_temperature(value.temperature, sampledata->units));
+		dctool_writer_puts (writer, "   <temperature>");
+		dctool_writer_fixed (writer, convert_temperature(value.temperature, sampledata->units), 2);
+		dctool_writer_puts (writer, "</temperature>\n");
 		break;
 	case DC_SAMPLE_EVENT:
 		if (value.event.type != SAMPLE_EVENT_GASCHANGE && value.event.type != SAMPLE_EVENT_GASCHANGE2) {
-			fprintf (sampledata->ostream, "   <event type=\"%u\" time=\"%u\" flags=\"%u\" value=\"%u\">%s</event>\n",
+			dctool_writer_printf (writer, "   <event type=\"%u\" time=\"%u\" flags=\"%u\" value=\"%u\">%s</event>\n",
 				value.event.type, value.event.time, value.event.flags, value.event.value, events[value.event.type]);
 		}
 		break;
 	case DC_SAMPLE_RBT:
-		fprintf (sampledata->ostream, "   <rbt>%u</rbt>\n", value.rbt);
+		dctool_writer_puts (writer, "   <rbt>");
+		dctool_writer_uint (writer, value.rbt, 0);
+		dctool_writer_puts (writer, "</rbt>\n");
 		break;
 	case DC_SAMPLE_HEARTBEAT:
-		fprintf (sampledata->ostream, "   <heartbeat>%u</heartbeat>\n", value.heartbeat);
+		dctool_writer_puts (writer, "   <heartbeat>");
+		dctool_writer_uint (writer, value.heartbeat, 0);
+		dctool_writer_puts (writer, "</heartbeat>\n");
 		break;
 	case DC_SAMPLE_BEARING:
-		fprintf (sampledata->ostream, "   <bearing>%u</bearing>\n", value.bearing);
+		dctool_writer_puts (writer, "   <bearing>");
+		dctool_writer_uint (writer, value.bearing, 0);
+		dctool_writer_puts (writer, "</bearing>\n");
 		break;
 	case DC_SAMPLE_VENDOR:
-		fprintf (sampledata->ostream, "   <vendor type=\"%u\" size=\"%u\">", value.vendor.type, value.vendor.size);
-		for (unsigned int i = 0; i < value.vendor.size; ++i)
-			fprintf (sampledata->ostream, "%02X", ((const unsigned char *) value.vendor.data)[i]);
-		fprintf (sampledata->ostream, "</vendor>\n");
+		dctool_writer_puts (writer, "   <vendor type=\"");
+		dctool_writer_uint (writer, value.vendor.type, 0);
+		dctool_writer_puts (writer, "\" size=\"");
+		dctool_writer_uint (writer, value.vendor.size, 0);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_hex (writer, (const unsigned char *) value.vendor.data, value.vendor.size);
+		dctool_writer_puts (writer, "</vendor>\n");
 		break;
 	case DC_SAMPLE_SETPOINT:
-		fprintf (sampledata->ostream, "   <setpoint>%.2f</setpoint>\n", value.setpoint);
+		dctool_writer_puts (writer, "   <setpoint>");
+		dctool_writer_fixed (writer, value.setpoint, 2);
+		dctool_writer_puts (writer, "</setpoint>\n");
 		break;
 	case DC_SAMPLE_PPO2:
-		fprintf (sampledata->ostream, "   <ppo2>%.2f</ppo2>\n", value.ppo2);
+		dctool_writer_puts (writer, "   <ppo2>");
+		dctool_writer_fixed (writer, value.ppo2, 2);
+		dctool_writer_puts (writer, "</ppo2>\n");
 		break;
 	case DC_SAMPLE_CNS:
-		fprintf (sampledata->ostream, "   <cns>%.1f</cns>\n", value.cns * 100.0);
+		dctool_writer_puts (writer, "   <cns>");
+		dctool_writer_fixed (writer, value.cns * 100.0, 1);
+		dctool_writer_puts (writer, "</cns>\n");
 		break;
 	case DC_SAMPLE_DECO:
-		fprintf (sampledata->ostream, "   <deco time=\"%u\" depth=\"%.2f\">%s</deco>\n",
-			value.deco.time,
-			convert_depth(value.deco.depth, sampledata->units),
-			decostop[value.deco.type]);
+		dctool_writer_puts (writer, "   <deco time=\"");
+		dctool_writer_uint (writer, value.deco.time, 0);
+		dctool_writer_puts (writer, "\" depth=\"");
+		dctool_writer_fixed (writer, convert_depth(value.deco.depth, sampledata->units), 2);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_puts (writer, decostop[value.deco.type]);
+		dctool_writer_puts (writer, "</deco>\n");
 		break;
 	case DC_SAMPLE_GASMIX:
-		fprintf (sampledata->ostream, "   <gasmix>%u</gasmix>\n", value.gasmix);
+		dctool_writer_puts (writer, "   <gasmix>");
+		dctool_writer_uint (writer, value.gasmix, 0);
+		dctool_writer_puts (writer, "</gasmix>\n");
 		break;
 	default:
 		break;
@@ -188,9 +222,14 @@ dctool_xml_output_new (const char *filename, dctool_units_t units)
 		goto error_free;
 	}
 
+	// All output goes through the writer, which already writes large
+	// blocks, so the stdio buffering is redundant.
+	setvbuf (output->ostream, NULL, _IONBF, 0);
+	dctool_writer_init (&output->writer, output->ostream);
+
 	output->units = units;
 
-	fprintf (output->ostream, "<device>\n");
+	dctool_writer_puts (&output->writer, "<device>\n");
 
 	return (dctool_output_t *) output;
 
@@ -200,6 +239,35 @@ error_exit:
 	return NULL;
 }
 
+static dctool_output_t *
+dctool_xml_output_fragment (dctool_output_t *abstract, dc_buffer_t *buffer)
+{
+	dctool_xml_output_t *parent = (dctool_xml_output_t *) abstract;
+	dctool_xml_output_t *output = NULL;
+
+	// Allocate memory.
+	output = (dctool_xml_output_t *) dctool_output_allocate (&xml_vtable);
+	if (output == NULL) {
+		return NULL;
+	}
+
+	output->ostream = NULL;
+	dctool_writer_init_buffer (&output->writer, buffer);
+	output->units = parent->units;
+
+	return (dctool_output_t *) output;
+}
+
+static dc_status_t
+dctool_xml_output_append (dctool_output_t *abstract, const unsigned char data[], unsigned int size)
+{
+	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
+
+	dctool_writer_write (&output->writer, (const char *) data, size);
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
 {
@@ -209,16 +277,15 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	// Initialize the sample data.
 	sample_data_t sampledata = {0};
 	sampledata.nsamples = 0;
-	sampledata.ostream = output->ostream;
+	sampledata.writer = &output->writer;
 	sampledata.units = output->units;
 
-	fprintf (output->ostream, "<dive>\n<number>%u</number>\n<size>%u</size>\n", abstract->number, size);
+	dctool_writer_printf (&output->writer, "<dive>\n<number>%u</number>\n<size>%u</size>\n", abstract->number, size);
 
 	if (fingerprint) {
-		fprintf (output->ostream, "<fingerprint>");
-		for (unsigned int i = 0; i < fsize; ++i)
-			fprintf (output->ostream, "%02X", fingerprint[i]);
-		fprintf (output->ostream, "</fingerprint>\n");
+		dctool_writer_puts (&output->writer, "<fingerprint>");
+		dctool_writer_hex (&output->writer, fingerprint, fsize);
+		dctool_writer_puts (&output->writer, "</fingerprint>\n");
 	}
 
 	// Parse the datetime.
@@ -231,11 +298,11 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (dt.timezone == DC_TIMEZONE_NONE) {
-		fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i</datetime>\n",
+		dctool_writer_printf (&output->writer, "<datetime>%04i-%02i-%02i %02i:%02i:%02i</datetime>\n",
 			dt.year, dt.month, dt.day,
 			dt.hour, dt.minute, dt.second);
 	} else {
-		fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i %+03i:%02i</datetime>\n",
+		dctool_writer_printf (&output->writer, "<datetime>%04i-%02i-%02i %02i:%02i:%02i %+03i:%02i</datetime>\n",
 			dt.year, dt.month, dt.day,
 			dt.hour, dt.minute, dt.second,
 			dt.timezone / 3600, (dt.timezone % 3600) / 60);
@@ -250,7 +317,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	fprintf (output->ostream, "<divetime>%02u:%02u</divetime>\n",
+	dctool_writer_printf (&output->writer, "<divetime>%02u:%02u</divetime>\n",
 		divetime / 60, divetime % 60);
 
 	// Parse the maxdepth.
@@ -262,7 +329,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		goto cleanup;
 	}
 
-	fprintf (output->ostream, "<maxdepth>%.2f</maxdepth>\n",
+	dctool_writer_printf (&output->writer, "<maxdepth>%.2f</maxdepth>\n",
 		convert_depth(maxdepth, output->units));
 
 	// Parse the temperature.
@@ -281,7 +348,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		}
 
 		if (status != DC_STATUS_UNSUPPORTED) {
-			fprintf (output->ostream, "<temperature type=\"%s\">%.1f</temperature>\n",
+			dctool_writer_printf (&output->writer, "<temperature type=\"%s\">%.1f</temperature>\n",
 				names[i],
 				convert_temperature(temperature, output->units));
 		}
@@ -304,7 +371,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			goto cleanup;
 		}
 
-		fprintf (output->ostream,
+		dctool_writer_printf (&output->writer,
 			"<gasmix>\n"
 			"   <he>%.1f</he>\n"
 			"   <o2>%.1f</o2>\n"
@@ -334,14 +401,14 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			goto cleanup;
 		}
 
-		fprintf (output->ostream, "<tank>\n");
+		dctool_writer_printf (&output->writer, "<tank>\n");
 		if (tank.gasmix != DC_GASMIX_UNKNOWN) {
-			fprintf (output->ostream,
+			dctool_writer_printf (&output->writer,
 				"   <gasmix>%u</gasmix>\n",
 				tank.gasmix);
 		}
 		if (tank.type != DC_TANKVOLUME_NONE) {
-			fprintf (output->ostream,
+			dctool_writer_printf (&output->writer,
 				"   <type>%s</type>\n"
 				"   <volume>%.1f</volume>\n"
 				"   <workpressure>%.2f</workpressure>\n",
@@ -349,7 +416,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 				convert_volume(tank.volume, output->units),
 				convert_pressure(tank.workpressure, output->units));
 		}
-		fprintf (output->ostream,
+		dctool_writer_printf (&output->writer,
 			"   <beginpressure>%.2f</beginpressure>\n"
 			"   <endpressure>%.2f</endpressure>\n"
 			"</tank>\n",
@@ -368,7 +435,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 
 	if (status != DC_STATUS_UNSUPPORTED) {
 		const char *names[] = {"freedive", "gauge", "oc", "ccr", "scr"};
-		fprintf (output->ostream, "<divemode>%s</divemode>\n",
+		dctool_writer_printf (&output->writer, "<divemode>%s</divemode>\n",
 			names[divemode]);
 	}
 
@@ -382,7 +449,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<salinity type=\"%u\">%.1f</salinity>\n",
+		dctool_writer_printf (&output->writer, "<salinity type=\"%u\">%.1f</salinity>\n",
 			salinity.type, salinity.density);
 	}
 
@@ -396,7 +463,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
-		fprintf (output->ostream, "<atmospheric>%.5f</atmospheric>\n",
+		dctool_writer_printf (&output->writer, "<atmospheric>%.5f</atmospheric>\n",
 			convert_pressure(atmospheric, output->units));
 	}
 
@@ -413,7 +480,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 			break;
 		if (!str.desc || !str.value)
 			break;
-		fprintf (output->ostream, "<extradata key='%s' value='%s' />\n",
+		dctool_writer_printf (&output->writer, "<extradata key='%s' value='%s' />\n",
 			str.desc, str.value);
 
 	}
@@ -429,8 +496,8 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 cleanup:
 
 	if (sampledata.nsamples)
-		fprintf (output->ostream, "</sample>\n");
-	fprintf (output->ostream, "</dive>\n");
+		dctool_writer_puts (&output->writer, "</sample>\n");
+	dctool_writer_puts (&output->writer, "</dive>\n");
 
 	return status;
 }
@@ -439,10 +506,19 @@ static dc_status_t
 dctool_xml_output_free (dctool_output_t *abstract)
 {
 	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
 
-	fprintf (output->ostream, "</device>\n");
+	// A fragment has no footer, and only needs to be flushed.
+	if (output->ostream == NULL) {
+		if (dctool_writer_flush (&output->writer) != 0)
+			status = DC_STATUS_NOMEMORY;
+		return status;
+	}
+
+	dctool_writer_puts (&output->writer, "</device>\n");
+	dctool_writer_flush (&output->writer);
 
 	fclose (output->ostream);
 
-	return DC_STATUS_SUCCESS;
+	return status;
 }
@@ -0,0 +1,235 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#include "writer.h"
+
+#define MAXDECIMALS 6
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+static const double scales[MAXDECIMALS + 1] = {
+	1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0, 1000000.0};
+
+void
+dctool_writer_init (dctool_writer_t *writer, FILE *ostream)
+{
+	writer->ostream = ostream;
+	writer->sink = NULL;
+	writer->size = 0;
+}
+
+void
+dctool_writer_init_buffer (dctool_writer_t *writer, dc_buffer_t *buffer)
+{
+	writer->ostream = NULL;
+	writer->sink = buffer;
+	writer->size = 0;
+}
+
+int
+dctool_writer_flush (dctool_writer_t *writer)
+{
+	int rc = 0;
+
+	if (writer->size) {
+		if (writer->sink) {
+			if (!dc_buffer_append (writer->sink, (const unsigned char *) writer->buffer, writer->size))
+				rc = -1;
+		} else if (fwrite (writer->buffer, 1, writer->size, writer->ostream) != writer->size) {
+			rc = -1;
+		}
+		writer->size = 0;
+	}
+
+	return rc;
+}
+
+static char *
+dctool_writer_reserve (dctool_writer_t *writer, size_t size)
+{
+	if (writer->size + size > sizeof (writer->buffer))
+		dctool_writer_flush (writer);
+
+	return writer->buffer + writer->size;
+}
+
+void
+dctool_writer_write (dctool_writer_t *writer, const char data[], size_t size)
+{
+	if (writer->size + size > sizeof (writer->buffer)) {
+		dctool_writer_flush (writer);
+
+		// Write large blocks directly.
+		if (size >= sizeof (writer->buffer)) {
+			fwrite (data, 1, size, writer->ostream);
+			return;
+		}
+	}
+
+	memcpy (writer->buffer + writer->size, data, size);
+	writer->size += size;
+}
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *text)
+{
+	dctool_writer_write (writer, text, strlen (text));
+}
+
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width)
+{
+	char digits[16];
+	unsigned int n = 0;
+
+	// Generate the digits in reverse order.
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+
+	// Pad with zeros to the minimum width.
+	if (width > sizeof (digits))
+		width = sizeof (digits);
+	while (n < width)
+		digits[n++] = '0';
+
+	char *p = dctool_writer_reserve (writer, n);
+	for (unsigned int i = 0; i < n; ++i)
+		p[i] = digits[n - 1 - i];
+	writer->size += n;
+}
+
+void
+dctool_writer_fixed (dctool_writer_t *writer, double value, unsigned int decimals)
+{
+	// Fallback to the standard formatting for values that can't be
+	// represented exactly as an integer after scaling.
+	if (decimals > MAXDECIMALS || !isfinite (value) ||
+		fabs (value) * scales[decimals] >= 1e15) {
+		dctool_writer_printf (writer, "%.*f", decimals, value);
+		return;
+	}
+
+	// Round to the nearest integer. Values close to halfway are left to
+	// printf, which rounds the exact binary value. The scaling itself
+	// can introduce a rounding error that would round the other way.
+	double exact = fabs (value) * scales[decimals];
+	double rounded = rint (exact);
+	if (fabs (fabs (exact - rounded) - 0.5) < 1e-6) {
+		dctool_writer_printf (writer, "%.*f", decimals, value);
+		return;
+	}
+
+	unsigned long long scale = (unsigned long long) scales[decimals];
+	unsigned long long scaled = (unsigned long long) rounded;
+	unsigned long long integer = scaled / scale;
+	unsigned long long fraction = scaled % scale;
+
+	if (signbit (value))
+		dctool_writer_write (writer, "-", 1);
+
+	char digits[24];
+	unsigned int n = 0;
+
+	// Generate the fraction digits in reverse order.
+	for (unsigned int i = 0; i < decimals; ++i) {
+		digits[n++] = '0' + fraction % 10;
+		fraction /= 10;
+	}
+	if (decimals)
+		digits[n++] = '.';
+
+	// Generate the integer digits in reverse order.
+	do {
+		digits[n++] = '0' + integer % 10;
+		integer /= 10;
+	} while (integer);
+
+	char *p = dctool_writer_reserve (writer, n);
+	for (unsigned int i = 0; i < n; ++i)
+		p[i] = digits[n - 1 - i];
+	writer->size += n;
+}
+
+void
+dctool_hex_encode (char output[], const unsigned char data[], size_t size)
+{
+	for (size_t i = 0; i < size; ++i) {
+		output[i * 2 + 0] = hexdigits[(data[i] >> 4) & 0x0F];
+		output[i * 2 + 1] = hexdigits[data[i] & 0x0F];
+	}
+}
+
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], size_t size)
+{
+	// Encode in chunks that always fit in the buffer.
+	const size_t chunk = sizeof (writer->buffer) / 4;
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		size_t len = size - nbytes;
+		if (len > chunk)
+			len = chunk;
+
+		char *p = dctool_writer_reserve (writer, 2 * len);
+		dctool_hex_encode (p, data + nbytes, len);
+		writer->size += 2 * len;
+
+		nbytes += len;
+	}
+}
+
+void
+dctool_writer_printf (dctool_writer_t *writer, const char *format, ...)
+{
+	va_list ap;
+	int n = 0;
+
+	// Try to format directly into the remaining space.
+	size_t available = sizeof (writer->buffer) - writer->size;
+	va_start (ap, format);
+	n = vsnprintf (writer->buffer + writer->size, available, format, ap);
+	va_end (ap);
+	if (n < 0)
+		return;
+
+	if ((size_t) n < available) {
+		writer->size += n;
+		return;
+	}
+
+	dctool_writer_flush (writer);
+
+	va_start (ap, format);
+	if ((size_t) n < sizeof (writer->buffer)) {
+		n = vsnprintf (writer->buffer, sizeof (writer->buffer), format, ap);
+		if (n > 0)
+			writer->size = n;
+	} else {
+		vfprintf (writer->ostream, format, ap);
+	}
+	va_end (ap);
+}
@@ -0,0 +1,85 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_ARCHIVE_H
+#define DC_ARCHIVE_H
+
+#include "common.h"
+#include "context.h"
+#include "datetime.h"
+#include "iterator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Dive archive
+ *
+ * An append-only file with raw dive data, as an alternative for
+ * storing every dive in a separate file. Each dive is stored with a
+ * small header, containing the parameters needed to create a parser
+ * (family, model, serial and the device/system clock pair) and the
+ * fingerprint of the dive (at most 32 bytes).
+ *
+ * For reading, the archive is mapped into memory, and the iterator
+ * returns the entries in the order they were appended. The data and
+ * fingerprint pointers point directly into the mapping, without any
+ * copying, and can be passed to dc_parser_set_data. They remain valid
+ * until the archive is closed. An incomplete entry at the end of the
+ * file, for example after a crash during an append, is ignored.
+ */
+
+#define DC_ARCHIVE_MAXFINGERPRINT 32
+
+typedef struct dc_archive_t dc_archive_t;
+
+typedef struct dc_archive_entry_t {
+	dc_family_t family;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	const unsigned char *data;
+	unsigned int size;
+} dc_archive_entry_t;
+
+dc_status_t
+dc_archive_open (dc_archive_t **archive, dc_context_t *context, const char *filename);
+
+dc_status_t
+dc_archive_create (dc_archive_t **archive, dc_context_t *context, const char *filename);
+
+dc_status_t
+dc_archive_append (dc_archive_t *archive, const dc_archive_entry_t *entry);
+
+dc_status_t
+dc_archive_iterator_new (dc_iterator_t **iterator, dc_archive_t *archive);
+
+dc_status_t
+dc_archive_close (dc_archive_t *archive);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_ARCHIVE_H */
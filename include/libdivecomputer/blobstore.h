@@ -0,0 +1,104 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BLOBSTORE_H
+#define DC_BLOBSTORE_H
+
+#include "common.h"
+#include "context.h"
+#include "buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Dive blob store
+ *
+ * A content addressed store for the raw dive data, as passed to the
+ * dive callback of dc_device_foreach. Every dive is identified by a
+ * 64 bit hash of its data and fingerprint, so the same dive received
+ * again (after a lost fingerprint, from another application, or from
+ * a repeated download) is stored only once. Checking whether a dive is
+ * already present only needs the hash, which is much cheaper than
+ * parsing the dive.
+ *
+ * Next to the dive data, an entry can hold a summary of any format,
+ * for example the fields the application extracted with the parser
+ * the first time, such that a known dive doesn't need to be parsed
+ * again at all.
+ *
+ * The store lives in memory, and can be saved to and loaded from a
+ * file. The hash function is part of the file format, and therefore
+ * remains stable. The store isn't thread-safe.
+ */
+
+typedef struct dc_blobstore_t dc_blobstore_t;
+
+unsigned long long
+dc_blobstore_hash (const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+
+dc_status_t
+dc_blobstore_new (dc_blobstore_t **store, dc_context_t *context);
+
+dc_status_t
+dc_blobstore_free (dc_blobstore_t *store);
+
+/*
+ * Add the entries of a file to the store. An incomplete entry at the
+ * end of the file, for example after a crash during a save, is ignored.
+ */
+dc_status_t
+dc_blobstore_load (dc_blobstore_t *store, const char *filename);
+
+dc_status_t
+dc_blobstore_save (dc_blobstore_t *store, const char *filename);
+
+int
+dc_blobstore_contains (dc_blobstore_t *store, unsigned long long hash);
+
+/*
+ * Add a dive, unless it is already present, and return its hash.
+ */
+dc_status_t
+dc_blobstore_add (dc_blobstore_t *store, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize, unsigned long long *hash);
+
+/*
+ * Copy the data and the fingerprint of a dive into the buffers. Either
+ * buffer can be NULL. Returns DC_STATUS_DONE if the dive is not present.
+ */
+dc_status_t
+dc_blobstore_get (dc_blobstore_t *store, unsigned long long hash, dc_buffer_t *data, dc_buffer_t *fingerprint);
+
+dc_status_t
+dc_blobstore_set_summary (dc_blobstore_t *store, unsigned long long hash, const unsigned char data[], unsigned int size);
+
+/*
+ * Copy the summary of a dive into the buffer. Returns DC_STATUS_DONE if
+ * the dive is not present, or has no summary.
+ */
+dc_status_t
+dc_blobstore_get_summary (dc_blobstore_t *store, unsigned long long hash, dc_buffer_t *summary);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BLOBSTORE_H */
@@ -0,0 +1,138 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2013 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_BLUETOOTH_H
+#define DC_BLUETOOTH_H
+
+#include "common.h"
+#include "context.h"
+#include "datetime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Bluetooth address (48 bits).
+ */
+#if defined (_WIN32) && !defined (__GNUC__)
+typedef unsigned __int64 dc_bluetooth_address_t;
+#else
+typedef unsigned long long dc_bluetooth_address_t;
+#endif
+
+/**
+ * Bluetooth device cache callback.
+ *
+ * @param[in]  address    The bluetooth device address.
+ * @param[in]  name       The name of the device, or NULL if unknown.
+ * @param[in]  port       The rfcomm port number, or zero if unknown.
+ * @param[in]  timestamp  The time the device was last seen.
+ * @param[in]  userdata   The user data pointer.
+ * @returns Non-zero to continue, or zero to stop.
+ */
+typedef int (*dc_bluetooth_cache_callback_t) (dc_bluetooth_address_t address, const char *name, unsigned int port, dc_ticks_t timestamp, void *userdata);
+
+/**
+ * Set the lifetime of the bluetooth device cache entries.
+ *
+ * Every context remembers the devices that were discovered, and the
+ * rfcomm port that was found by the service discovery. If a device
+ * was seen less than the discovery lifetime ago, the iterator returns
+ * the cached devices instead of performing a new inquiry. Similarly,
+ * the service discovery is skipped when opening a connection to a
+ * device with a port less than the sdp lifetime old. If the connection
+ * to the cached port fails, the service discovery is performed anyway.
+ * By default, the discovery cache is disabled, and ports are cached
+ * for one day.
+ *
+ * @param[in]  context    A valid context object.
+ * @param[in]  discovery  The discovery lifetime (in seconds), or zero to disable.
+ * @param[in]  sdp        The port lifetime (in seconds), or zero to disable.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_cache_set_ttl (dc_context_t *context, unsigned int discovery, unsigned int sdp);
+
+/**
+ * Enable the streaming device discovery.
+ *
+ * By default, the iterator performs the complete inquiry (about ten
+ * seconds) before it returns the first device. With the streaming
+ * discovery, the iterator returns every device as soon as it responds
+ * to the inquiry. A caller looking for a single dive computer can stop
+ * at the first device that matches the descriptor, and freeing the
+ * iterator cancels the remainder of the inquiry. The streaming
+ * discovery is only available with BlueZ, and the blocking inquiry is
+ * used if it can't be started.
+ *
+ * @param[in]  context    A valid context object.
+ * @param[in]  enable     Non-zero to enable the streaming discovery.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_set_streaming (dc_context_t *context, unsigned int enable);
+
+/**
+ * Add a device to the bluetooth device cache.
+ *
+ * This is intended to restore the cache contents that were saved
+ * previously with #dc_bluetooth_cache_foreach.
+ *
+ * @param[in]  context    A valid context object.
+ * @param[in]  address    The bluetooth device address.
+ * @param[in]  name       The name of the device, or NULL if unknown.
+ * @param[in]  port       The rfcomm port number, or zero if unknown.
+ * @param[in]  timestamp  The time the device was last seen.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_cache_add (dc_context_t *context, dc_bluetooth_address_t address, const char *name, unsigned int port, dc_ticks_t timestamp);
+
+/**
+ * Enumerate the devices in the bluetooth device cache.
+ *
+ * @param[in]  context    A valid context object.
+ * @param[in]  callback   The callback function.
+ * @param[in]  userdata   The user data pointer.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_cache_foreach (dc_context_t *context, dc_bluetooth_cache_callback_t callback, void *userdata);
+
+/**
+ * Remove all devices from the bluetooth device cache.
+ *
+ * @param[in]  context    A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_bluetooth_cache_clear (dc_context_t *context);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_BLUETOOTH_H */
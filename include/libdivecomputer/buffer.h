@@ -24,6 +24,8 @@
 
 #include <stddef.h>
 
+#include "context.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -33,12 +35,28 @@ typedef struct dc_buffer_t dc_buffer_t;
 dc_buffer_t *
 dc_buffer_new (size_t capacity);
 
+/*
+ * Create a buffer with its memory obtained from the allocator of the
+ * context (see dc_context_set_allocator). The buffer must be freed
+ * before the context.
+ */
+dc_buffer_t *
+dc_buffer_new2 (dc_context_t *context, size_t capacity);
+
 void
 dc_buffer_free (dc_buffer_t *buffer);
 
 int
 dc_buffer_clear (dc_buffer_t *buffer);
 
+/*
+ * Set the growth factor (in percent of the current capacity) that is
+ * applied when an append or prepend runs out of space. The default is
+ * 100, doubling the capacity every time.
+ */
+int
+dc_buffer_set_growth (dc_buffer_t *buffer, unsigned int percent);
+
 int
 dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity);
 
@@ -43,23 +43,292 @@ typedef enum dc_loglevel_t {
 	DC_LOGLEVEL_ALL
 } dc_loglevel_t;
 
+typedef enum dc_logcategory_t {
+	DC_LOGCATEGORY_TRANSPORT,
+	DC_LOGCATEGORY_PROTOCOL,
+	DC_LOGCATEGORY_PARSER
+} dc_logcategory_t;
+
+typedef enum dc_cpufeature_t {
+	DC_CPUFEATURE_SSE2      = (1 << 0),
+	DC_CPUFEATURE_SSSE3     = (1 << 1),
+	DC_CPUFEATURE_AVX2      = (1 << 2),
+	DC_CPUFEATURE_AESNI     = (1 << 3),
+	DC_CPUFEATURE_NEON      = (1 << 4),
+	DC_CPUFEATURE_ARMCRYPTO = (1 << 5)
+} dc_cpufeature_t;
+
 typedef void (*dc_logfunc_t) (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *message, void *userdata);
 
+typedef void *(*dc_allocfunc_t) (size_t size, void *userdata);
+
+typedef void (*dc_freefunc_t) (void *ptr, void *userdata);
+
+/*
+ * Memory statistics: the bytes currently allocated, the peak of the
+ * allocated bytes, and the number of allocations and releases.
+ */
+typedef struct dc_memory_stats_t {
+	size_t current;
+	size_t peak;
+	unsigned int allocations;
+	unsigned int releases;
+} dc_memory_stats_t;
+
+/*
+ * Parser call counter: the number of calls, and their cumulative time
+ * in nanoseconds.
+ */
+typedef struct dc_parser_counter_t {
+	unsigned long long calls;
+	unsigned long long nsecs;
+} dc_parser_counter_t;
+
+/*
+ * Parser statistics of a family and model: the counters of the
+ * backend calls, the number of samples reported by the profile walks,
+ * and the number of bytes of dive data passed to the backend.
+ */
+typedef struct dc_parser_stats_t {
+	dc_family_t family;
+	unsigned int model;
+	dc_parser_counter_t set_data;
+	dc_parser_counter_t datetime;
+	dc_parser_counter_t field;
+	dc_parser_counter_t samples;
+	unsigned long long nsamples;
+	unsigned long long nbytes;
+} dc_parser_stats_t;
+
+typedef void (*dc_trace_callback_t) (const char *name, unsigned long long thread, unsigned long long begin, unsigned long long end, void *userdata);
+
+typedef void (*dc_mirror_callback_t) (dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size, void *userdata);
+
+typedef void (*dc_syncindex_callback_t) (dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size, void *userdata);
+
 dc_status_t
 dc_context_new (dc_context_t **context);
 
 dc_status_t
 dc_context_free (dc_context_t *context);
 
+/*
+ * A context can be shared by several threads. The caches and the
+ * settings are protected by a lock. The custom I/O is looked up when a
+ * device is opened, and bound to that device, so it can be replaced
+ * for the next download while other downloads are still running.
+ */
 dc_status_t
 dc_context_set_custom_io (dc_context_t *context, dc_custom_io_t *custom_io, dc_user_device_t *);
 
+/*
+ * Register the optional extensions (see dc_custom_io_ext_t) of the
+ * custom I/O that is currently set. The structure is copied. Setting
+ * another custom I/O clears the extensions again, and the connections
+ * that are still bound to the previous one fall back to the basic
+ * functions.
+ */
+dc_status_t
+dc_context_set_custom_io_ext (dc_context_t *context, const dc_custom_io_ext_t *ext);
+
+/*
+ * Keep up to size destroyed parsers alive, and hand them out again
+ * from dc_parser_new and dc_parser_new2 when a parser with the same
+ * family, model, serial number and clock is requested. A size of zero
+ * disables the pool. Settings applied to a parser after its creation
+ * (for example a calibration) are not reset when it is re-used.
+ */
+dc_status_t
+dc_context_set_parser_pool (dc_context_t *context, unsigned int size);
+
+/*
+ * Keep up to size freed buffers of the context alive, together with
+ * their memory, and hand them out again from dc_buffer_new2. The
+ * backends allocate their transient download buffers this way, such
+ * that repeated downloads don't allocate them again. Buffers created
+ * with dc_buffer_new are not affected. A size of zero disables the
+ * pool and releases the pooled buffers. Change the size only while
+ * no other thread is using the context.
+ */
+dc_status_t
+dc_context_set_buffer_pool (dc_context_t *context, unsigned int size);
+
+/*
+ * Deliver the log messages asynchronously. The messages are formatted
+ * by the caller as usual, but queued in a buffer of the given size (in
+ * bytes), and passed to the log function from a background thread. The
+ * log function must therefore be thread-safe. A size of zero flushes
+ * the pending messages and restores the synchronous delivery. Change
+ * the log function only while the asynchronous mode is disabled.
+ */
+dc_status_t
+dc_context_set_logasync (dc_context_t *context, unsigned int size);
+
 dc_status_t
 dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel);
 
+/*
+ * Override the log level for a single category of messages: the I/O
+ * transports, the device protocols or the parsers. Messages below the
+ * level of their category are rejected before any formatting is done.
+ * Setting the global log level resets all categories.
+ */
+dc_status_t
+dc_context_set_loglevel_category (dc_context_t *context, dc_logcategory_t category, dc_loglevel_t loglevel);
+
 dc_status_t
 dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata);
 
+/*
+ * Allocate the memory of the objects created with the context (devices,
+ * parsers, iterators and I/O streams), their working memory, and the
+ * buffers created with dc_buffer_new2 with the given functions instead
+ * of malloc and free. This allows to serve all allocations of a
+ * download session from a single arena, and release them at once
+ * afterwards (with a free function that does nothing). There is no
+ * reallocation function: a block that grows is copied into a new one.
+ * The functions must be thread-safe if the context is shared between
+ * threads. Change them only while no such objects exist, including the
+ * parsers kept in the parser pool. Passing NULL restores the default
+ * functions.
+ */
+dc_status_t
+dc_context_set_allocator (dc_context_t *context, dc_allocfunc_t allocfunc, dc_freefunc_t freefunc, void *userdata);
+
+/*
+ * Remember which dives were already downloaded, identified by the
+ * family, model and serial number of the device together with the
+ * fingerprint of the dive. When the sync index is enabled, every dive
+ * passed to the callback of dc_device_foreach is added to the index,
+ * and dives which are already present are no longer passed to the
+ * callback at all. Backends which download the dives one by one also
+ * skip the transfer of the known dives. Unlike the single fingerprint
+ * of dc_device_set_fingerprint, this keeps working when the most recent
+ * downloaded dive has been deleted from the device.
+ *
+ * The index lives in memory only. To keep it between sessions, store
+ * the entries reported by dc_context_syncindex_foreach, and add them
+ * again with dc_context_syncindex_add. The callback of the foreach
+ * function must not call any of the sync index functions. Disabling
+ * the index discards all entries.
+ */
+dc_status_t
+dc_context_set_syncindex (dc_context_t *context, unsigned int enable);
+
+dc_status_t
+dc_context_syncindex_add (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size);
+
+dc_status_t
+dc_context_syncindex_foreach (dc_context_t *context, dc_syncindex_callback_t callback, void *userdata);
+
+dc_status_t
+dc_context_syncindex_clear (dc_context_t *context);
+
+/*
+ * Keep a mirror of the memory of the devices, identified by the family
+ * and serial number, after every memory dump. When a mirror is present,
+ * the backends which support it read only the parts of the memory that
+ * can have changed since, based on the ring buffer pointers, and merge
+ * them with the mirror. The result of dc_device_dump is the same as
+ * with a full dump. Currently, the Suunto D9 and Vyper2 families use
+ * the mirror.
+ *
+ * The mirrors live in memory only, for up to 4 devices. To keep them
+ * between sessions, store the data reported by
+ * dc_context_mirror_foreach, and add it again with
+ * dc_context_mirror_add. The callback of the foreach function must not
+ * call any of the mirror functions. Disabling the mirror discards all
+ * data.
+ */
+dc_status_t
+dc_context_set_mirror (dc_context_t *context, unsigned int enable);
+
+dc_status_t
+dc_context_mirror_add (dc_context_t *context, dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size);
+
+dc_status_t
+dc_context_mirror_foreach (dc_context_t *context, dc_mirror_callback_t callback, void *userdata);
+
+/*
+ * Limit the memory of a download to a budget of the given size in
+ * bytes. The families that need a buffer larger than the budget, such
+ * as the full memory image (see dc_descriptor_get_memory), fail with
+ * DC_STATUS_NOMEMORY before anything is downloaded, or as soon as the
+ * size is known for the devices that announce it in their answer. The
+ * families that download one dive at a time limit their read-ahead to
+ * the budget. A size of zero (the default) means no limit.
+ */
+dc_status_t
+dc_context_set_memory_budget (dc_context_t *context, unsigned int size);
+
+/*
+ * Count the memory allocated through the context (see
+ * dc_context_set_allocator). The totals of the context are available
+ * with dc_context_get_memory_stats, those of the device sessions in
+ * the stats of dc_device_get_stats, and those of the current dive of a
+ * parser with dc_parser_get_memory_stats. The size of every block is
+ * stored in front of it, so the setting can only be changed while no
+ * objects exist, like the allocator. With several threads sharing the
+ * context, the allocations of the other threads are attributed to the
+ * devices and parsers as well.
+ */
+dc_status_t
+dc_context_set_memory_stats (dc_context_t *context, unsigned int enable);
+
+dc_status_t
+dc_context_get_memory_stats (dc_context_t *context, dc_memory_stats_t *stats);
+
+/*
+ * Record the begin and end time of the I/O reads and writes, the
+ * protocol transfers, the ring buffer reads, the parser calls and the
+ * dive callbacks of the devices and parsers created with the context.
+ * The spans are kept in a ring buffer of the given size (in spans) per
+ * thread, for up to 8 threads, such that only the most recent ones are
+ * retained. A size of zero disables the trace and discards all spans.
+ * Change the setting only while no devices or parsers are in use.
+ *
+ * The foreach function reports the spans thread by thread, oldest
+ * first. The times are in microseconds since the trace was enabled.
+ * The name is a static string, and the thread an opaque identifier.
+ */
+dc_status_t
+dc_context_set_trace (dc_context_t *context, unsigned int size);
+
+dc_status_t
+dc_context_trace_foreach (dc_context_t *context, dc_trace_callback_t callback, void *userdata);
+
+/*
+ * Count the backend calls of the parsers created with the context
+ * (setting the dive data, the date and time, the fields, and the
+ * profile walks), per family and model, for up to 32 of them. When
+ * disabled, the parser calls only check the setting, and disabling
+ * discards the counters. Change the setting only while no parsers are
+ * in use.
+ *
+ * The get function copies up to size entries into the stats array,
+ * and stores the total number of entries in count.
+ */
+dc_status_t
+dc_context_set_parser_stats (dc_context_t *context, unsigned int enable);
+
+dc_status_t
+dc_context_get_parser_stats (dc_context_t *context, dc_parser_stats_t stats[], unsigned int size, unsigned int *count);
+
+/*
+ * Restrict the processor features (see dc_cpufeature_t) which the
+ * optimized kernels may use, for example to test the portable
+ * implementations on a machine with all features. The features are
+ * detected once per process, but the mask applies only to the kernels
+ * running on behalf of this context. The get function returns the
+ * detected features which are allowed by the mask.
+ * A mask with all bits set (the default) allows every detected feature.
+ */
+dc_status_t
+dc_context_set_cpufeatures (dc_context_t *context, unsigned int mask);
+
+unsigned int
+dc_context_get_cpufeatures (dc_context_t *context);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -33,6 +33,22 @@ struct dc_user_device_t;
  * and isn't specific to the IO routines, but to the download
  * as a whole.
  */
+
+/*
+ * Link parameter hints, for the packet_set_params function. A backend
+ * requests the parameters for a high throughput before a bulk transfer,
+ * and relaxes them again (hints zero) afterwards, to save power. The
+ * hints are only a request, the application is free to ignore them.
+ */
+typedef enum dc_link_hints_t {
+	DC_LINK_INTERVAL = (1 << 0),   // Short connection interval
+	DC_LINK_MTU = (1 << 1),        // Large MTU
+	DC_LINK_PHY2M = (1 << 2),      // 2M PHY
+	DC_LINK_NORESPONSE = (1 << 3), // Write without response
+} dc_link_hints_t;
+
+#define DC_LINK_BULK (DC_LINK_INTERVAL | DC_LINK_MTU | DC_LINK_PHY2M | DC_LINK_NORESPONSE)
+
 typedef struct dc_custom_io_t
 {
 	void *userdata;
@@ -63,6 +79,45 @@ typedef struct dc_custom_io_t
 	dc_status_t (*packet_write) (struct dc_custom_io_t *, const void* data, size_t size, size_t *actual);
 } dc_custom_io_t;
 
+/*
+ * Optional extensions of the custom I/O, registered with
+ * dc_context_set_custom_io_ext. They are kept out of dc_custom_io_t,
+ * such that its layout stays compatible with the applications built
+ * against an older version. The size field must be set to
+ * sizeof (dc_custom_io_ext_t), and the library ignores the members
+ * beyond that size. Every member may be left zero or NULL.
+ */
+typedef struct dc_custom_io_ext_t
+{
+	size_t size;
+
+	// Batched packet transfer. The packet_read_many function returns
+	// all packets that are already queued (but at least one, blocking
+	// like packet_read), concatenated in a single buffer. The packet
+	// boundaries are not preserved, so it is only used by stream
+	// oriented protocols. The packet_get_mtu function returns the
+	// payload size that was negotiated with the device (e.g. the BLE
+	// ATT MTU minus the header), which may be larger than the initial
+	// packet_size.
+	dc_status_t (*packet_read_many) (struct dc_custom_io_t *, void* data, size_t size, size_t *actual);
+	dc_status_t (*packet_get_mtu) (struct dc_custom_io_t *, size_t *size);
+
+	// Optional buffering of the custom serial transfers. With a non-zero
+	// size, the library keeps a receive buffer, which is filled with a
+	// single serial_read call for all the data that serial_get_available
+	// reports, and serves small reads from it. Small writes are collected
+	// until the buffer is full, the stream is flushed, or a read or line
+	// change needs them on the wire. This reduces the number of calls
+	// into the application, which matters when they cross a language
+	// boundary. Receive buffering needs serial_get_available.
+	size_t serial_buffer_size;
+
+	// Optional link parameter hints (see dc_link_hints_t). They apply
+	// to the connection, and are therefore also used for the custom
+	// serial transfer, if that is a BLE connection too.
+	dc_status_t (*packet_set_params) (struct dc_custom_io_t *, unsigned int hints);
+} dc_custom_io_ext_t;
+
 
 #ifdef __cplusplus
 }
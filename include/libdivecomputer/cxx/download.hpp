@@ -0,0 +1,173 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CXX_DOWNLOAD_HPP
+#define DC_CXX_DOWNLOAD_HPP
+
+/*
+ * Header-only C++20 coroutine download
+ *
+ * A dive_stream runs dc_device_foreach on a worker thread, and hands
+ * the dives to a coroutine, which waits for them with co_await
+ * stream.next(). The coroutine is never resumed from the worker thread
+ * directly: the post function is called with the coroutine handle, and
+ * must arrange for it to be resumed on the event loop (for example with
+ * asio::post). The event loop thread therefore never blocks.
+ *
+ * The communication protocols of the backends are written as blocking
+ * code, so every active download still occupies one worker thread. Use
+ * the session manager to limit the number of them.
+ *
+ * The device must stay open until the stream is destroyed. Destroying
+ * the stream cancels the download and waits for the worker thread.
+ */
+
+#include <coroutine>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <libdivecomputer/device.h>
+
+namespace dc {
+
+struct dive {
+	std::vector<unsigned char> data;
+	std::vector<unsigned char> fingerprint;
+};
+
+template <typename Post>
+class dive_stream {
+public:
+	dive_stream (dc_device_t *device, Post post)
+		: m_device (device), m_post (std::move (post)),
+		  m_finished (false), m_status (DC_STATUS_SUCCESS)
+	{
+		m_thread = std::thread (&dive_stream::run, this);
+	}
+
+	~dive_stream ()
+	{
+		cancel ();
+		m_thread.join ();
+	}
+
+	dive_stream (const dive_stream &) = delete;
+	dive_stream &operator= (const dive_stream &) = delete;
+
+	class awaiter {
+	public:
+		explicit awaiter (dive_stream &stream) : m_stream (stream) {}
+
+		bool await_ready ()
+		{
+			std::lock_guard<std::mutex> lock (m_stream.m_mutex);
+			return m_stream.ready ();
+		}
+
+		bool await_suspend (std::coroutine_handle<> handle)
+		{
+			std::lock_guard<std::mutex> lock (m_stream.m_mutex);
+			// A dive may have arrived since await_ready.
+			if (m_stream.ready ())
+				return false;
+			m_stream.m_waiting = handle;
+			return true;
+		}
+
+		// Returns the next dive, or nothing at the end of the download.
+		std::optional<dive> await_resume ()
+		{
+			std::lock_guard<std::mutex> lock (m_stream.m_mutex);
+			if (m_stream.m_queue.empty ())
+				return std::nullopt;
+			dive d = std::move (m_stream.m_queue.front ());
+			m_stream.m_queue.pop_front ();
+			return d;
+		}
+
+	private:
+		dive_stream &m_stream;
+	};
+
+	awaiter next () { return awaiter (*this); }
+
+	void cancel () { dc_device_cancel (m_device); }
+
+	// The result of dc_device_foreach, once next() returned nothing.
+	dc_status_t status () const
+	{
+		std::lock_guard<std::mutex> lock (m_mutex);
+		return m_status;
+	}
+
+private:
+	bool ready () const { return !m_queue.empty () || m_finished; }
+
+	void run ()
+	{
+		dc_status_t rc = dc_device_foreach (m_device, &dive_cb, this);
+
+		std::unique_lock<std::mutex> lock (m_mutex);
+		m_finished = true;
+		m_status = rc;
+		wakeup (lock);
+	}
+
+	static int dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+	{
+		dive_stream *stream = static_cast<dive_stream *> (userdata);
+
+		dive d;
+		d.data.assign (data, data + size);
+		d.fingerprint.assign (fingerprint, fingerprint + fsize);
+
+		std::unique_lock<std::mutex> lock (stream->m_mutex);
+		stream->m_queue.push_back (std::move (d));
+		stream->wakeup (lock);
+
+		return 1;
+	}
+
+	void wakeup (std::unique_lock<std::mutex> &lock)
+	{
+		std::coroutine_handle<> handle = std::exchange (m_waiting, nullptr);
+		lock.unlock ();
+		if (handle)
+			m_post (handle);
+	}
+
+	dc_device_t *m_device;
+	Post m_post;
+	std::thread m_thread;
+	mutable std::mutex m_mutex;
+	std::deque<dive> m_queue;
+	std::coroutine_handle<> m_waiting;
+	bool m_finished;
+	dc_status_t m_status;
+};
+
+} // namespace dc
+
+#endif /* DC_CXX_DOWNLOAD_HPP */
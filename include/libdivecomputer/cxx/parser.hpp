@@ -0,0 +1,354 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CXX_PARSER_HPP
+#define DC_CXX_PARSER_HPP
+
+/*
+ * Header-only C++17 wrapper
+ *
+ * Move-only handles for the buffer, device and parser objects, which
+ * release the underlying object when they go out of scope. Errors are
+ * reported with the same dc_status_t codes as the C interface.
+ *
+ * The for_each_sample function collects the profile with a single
+ * dc_parser_samples_get_batch call, and then calls the visitor once
+ * per row from a plain loop over the columns. Because the visitor is a
+ * template argument instead of a function pointer, the compiler can
+ * inline it into that loop.
+ */
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include <libdivecomputer/buffer.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+
+namespace dc {
+
+namespace detail {
+
+template <typename T, typename Deleter>
+class handle {
+public:
+	handle () noexcept : m_ptr (nullptr) {}
+	explicit handle (T *ptr) noexcept : m_ptr (ptr) {}
+	~handle () { reset (); }
+
+	handle (const handle &) = delete;
+	handle &operator= (const handle &) = delete;
+
+	handle (handle &&other) noexcept : m_ptr (other.release ()) {}
+	handle &operator= (handle &&other) noexcept
+	{
+		if (this != &other)
+			reset (other.release ());
+		return *this;
+	}
+
+	T *get () const noexcept { return m_ptr; }
+	explicit operator bool () const noexcept { return m_ptr != nullptr; }
+
+	T *release () noexcept
+	{
+		T *ptr = m_ptr;
+		m_ptr = nullptr;
+		return ptr;
+	}
+
+	void reset (T *ptr = nullptr) noexcept
+	{
+		if (m_ptr)
+			Deleter () (m_ptr);
+		m_ptr = ptr;
+	}
+
+private:
+	T *m_ptr;
+};
+
+struct buffer_deleter {
+	void operator() (dc_buffer_t *ptr) const noexcept { dc_buffer_free (ptr); }
+};
+
+struct device_deleter {
+	void operator() (dc_device_t *ptr) const noexcept { dc_device_close (ptr); }
+};
+
+struct parser_deleter {
+	void operator() (dc_parser_t *ptr) const noexcept { dc_parser_destroy (ptr); }
+};
+
+} // namespace detail
+
+class buffer : public detail::handle<dc_buffer_t, detail::buffer_deleter> {
+public:
+	using handle::handle;
+
+	static buffer create (size_t capacity = 0)
+	{
+		return buffer (dc_buffer_new (capacity));
+	}
+
+	const unsigned char *data () const { return dc_buffer_get_data (get ()); }
+	size_t size () const { return dc_buffer_get_size (get ()); }
+};
+
+class device : public detail::handle<dc_device_t, detail::device_deleter> {
+public:
+	using handle::handle;
+
+	static dc_status_t open (device &out, dc_context_t *context, dc_descriptor_t *descriptor, const char *name)
+	{
+		dc_device_t *ptr = nullptr;
+		dc_status_t status = dc_device_open (&ptr, context, descriptor, name);
+		if (status == DC_STATUS_SUCCESS)
+			out.reset (ptr);
+		return status;
+	}
+
+	dc_family_t type () const { return dc_device_get_type (get ()); }
+
+	dc_status_t set_fingerprint (const unsigned char data[], unsigned int size)
+	{
+		return dc_device_set_fingerprint (get (), data, size);
+	}
+
+	dc_status_t dump (buffer &out)
+	{
+		return dc_device_dump (get (), out.get ());
+	}
+
+	// The visitor is called as f(data, size, fingerprint, fsize), and
+	// returns non-zero to continue with the next dive.
+	template <typename F>
+	dc_status_t for_each_dive (F &&f)
+	{
+		return dc_device_foreach (get (), &dive_cb<F>, &f);
+	}
+
+private:
+	template <typename F>
+	static int dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+	{
+		F &f = *static_cast<F *> (userdata);
+		return f (data, size, fingerprint, fsize) ? 1 : 0;
+	}
+};
+
+/*
+ * One row of the sample table. The values of the sample types without
+ * the corresponding bit in the mask are undefined. The pressure array
+ * holds ntanks values, and the events array the nevents events of the
+ * row.
+ */
+struct sample_row {
+	unsigned int mask;
+	unsigned int time;
+	double depth;
+	double temperature;
+	double ppo2;
+	unsigned int deco_type;
+	unsigned int deco_time;
+	double deco_depth;
+	const double *pressure;
+	unsigned int ntanks;
+	const dc_sample_table_event_t *events;
+	unsigned int nevents;
+
+	bool has (dc_sample_type_t type) const
+	{
+		return (mask & (1u << type)) != 0;
+	}
+};
+
+/*
+ * Storage for the sample table. Keeping one table around for several
+ * dives avoids allocating the columns again for every dive.
+ */
+class sample_table {
+public:
+	sample_table () : m_table () {}
+
+	const dc_sample_table_t &table () const { return m_table; }
+
+	dc_status_t fill (dc_parser_t *parser)
+	{
+		unsigned int ntanks = 0;
+		if (dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks) != DC_STATUS_SUCCESS)
+			ntanks = 0;
+
+		if (ntanks != m_table.ntanks) {
+			m_table.ntanks = ntanks;
+			reserve (m_table.capacity, m_table.events_capacity);
+		}
+
+		dc_status_t status = dc_parser_samples_get_batch (parser, &m_table);
+		if (status == DC_STATUS_NOMEMORY) {
+			// The table reports the required size.
+			reserve (m_table.count, m_table.nevents);
+			status = dc_parser_samples_get_batch (parser, &m_table);
+		}
+
+		return status;
+	}
+
+	template <typename F>
+	void visit (F &&f) const
+	{
+		const dc_sample_table_t &t = m_table;
+		unsigned int e = 0;
+		for (unsigned int i = 0; i < t.count; ++i) {
+			unsigned int first = e;
+			while (e < t.nevents && t.events[e].row == i)
+				++e;
+
+			sample_row row;
+			row.mask = t.mask[i];
+			row.time = t.time[i];
+			row.depth = t.depth[i];
+			row.temperature = t.temperature[i];
+			row.ppo2 = t.ppo2[i];
+			row.deco_type = t.deco_type[i];
+			row.deco_time = t.deco_time[i];
+			row.deco_depth = t.deco_depth[i];
+			row.pressure = t.pressure + static_cast<size_t> (i) * t.ntanks;
+			row.ntanks = t.ntanks;
+			row.events = t.events + first;
+			row.nevents = e - first;
+			f (static_cast<const sample_row &> (row));
+		}
+	}
+
+private:
+	void reserve (unsigned int capacity, unsigned int events_capacity)
+	{
+		m_mask.resize (capacity);
+		m_time.resize (capacity);
+		m_depth.resize (capacity);
+		m_temperature.resize (capacity);
+		m_ppo2.resize (capacity);
+		m_deco_type.resize (capacity);
+		m_deco_time.resize (capacity);
+		m_deco_depth.resize (capacity);
+		// Keep at least one element, such that the column pointers are
+		// valid even without tanks.
+		m_pressure.resize (static_cast<size_t> (capacity) * m_table.ntanks + 1);
+		m_events.resize (events_capacity + 1);
+
+		m_table.capacity = capacity;
+		m_table.events_capacity = events_capacity;
+		m_table.mask = m_mask.data ();
+		m_table.time = m_time.data ();
+		m_table.depth = m_depth.data ();
+		m_table.pressure = m_pressure.data ();
+		m_table.temperature = m_temperature.data ();
+		m_table.ppo2 = m_ppo2.data ();
+		m_table.deco_type = m_deco_type.data ();
+		m_table.deco_time = m_deco_time.data ();
+		m_table.deco_depth = m_deco_depth.data ();
+		m_table.events = m_events.data ();
+	}
+
+	dc_sample_table_t m_table;
+	std::vector<unsigned int> m_mask;
+	std::vector<unsigned int> m_time;
+	std::vector<double> m_depth;
+	std::vector<double> m_pressure;
+	std::vector<double> m_temperature;
+	std::vector<double> m_ppo2;
+	std::vector<unsigned int> m_deco_type;
+	std::vector<unsigned int> m_deco_time;
+	std::vector<double> m_deco_depth;
+	std::vector<dc_sample_table_event_t> m_events;
+};
+
+class parser : public detail::handle<dc_parser_t, detail::parser_deleter> {
+public:
+	using handle::handle;
+
+	static dc_status_t create (parser &out, dc_device_t *device)
+	{
+		dc_parser_t *ptr = nullptr;
+		dc_status_t status = dc_parser_new (&ptr, device);
+		if (status == DC_STATUS_SUCCESS)
+			out.reset (ptr);
+		return status;
+	}
+
+	static dc_status_t create (parser &out, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime)
+	{
+		dc_parser_t *ptr = nullptr;
+		dc_status_t status = dc_parser_new2 (&ptr, context, descriptor, devtime, systime);
+		if (status == DC_STATUS_SUCCESS)
+			out.reset (ptr);
+		return status;
+	}
+
+	dc_family_t type () const { return dc_parser_get_type (get ()); }
+
+	dc_status_t set_data (const unsigned char *data, unsigned int size)
+	{
+		return dc_parser_set_data (get (), data, size);
+	}
+
+	dc_status_t set_sample_mask (unsigned int mask)
+	{
+		return dc_parser_set_sample_mask (get (), mask);
+	}
+
+	dc_status_t get_datetime (dc_datetime_t &datetime)
+	{
+		return dc_parser_get_datetime (get (), &datetime);
+	}
+
+	template <typename T>
+	dc_status_t get_field (dc_field_type_t type, unsigned int flags, T &value)
+	{
+		return dc_parser_get_field (get (), type, flags, &value);
+	}
+
+	// The visitor is called as f(const sample_row &) for every row.
+	template <typename F>
+	dc_status_t for_each_sample (sample_table &table, F &&f)
+	{
+		dc_status_t status = table.fill (get ());
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		table.visit (std::forward<F> (f));
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	template <typename F>
+	dc_status_t for_each_sample (F &&f)
+	{
+		sample_table table;
+		return for_each_sample (table, std::forward<F> (f));
+	}
+};
+
+} // namespace dc
+
+#endif /* DC_CXX_PARSER_HPP */
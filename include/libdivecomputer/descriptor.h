@@ -38,11 +38,47 @@ typedef enum dc_transport_t {
 	DC_TRANSPORT_BLUETOOTH
 } dc_transport_t;
 
+/*
+ * The peak memory class of a download: a single dive, the entire
+ * profile ringbuffer, or the full memory image.
+ */
+typedef enum dc_memory_t {
+	DC_MEMORY_DIVE,
+	DC_MEMORY_PROFILE,
+	DC_MEMORY_IMAGE
+} dc_memory_t;
+
 typedef struct dc_descriptor_t dc_descriptor_t;
 
 dc_status_t
 dc_descriptor_iterator (dc_iterator_t **iterator);
 
+/*
+ * Find the descriptor matching the vendor and product name (case
+ * insensitive), the family and model number, or the USB vendor and
+ * product id. The first matching entry is returned, without allocating
+ * memory, or DC_STATUS_NODEVICE if there is no match. The descriptor
+ * may be passed to dc_descriptor_free, but that is not required.
+ */
+dc_status_t
+dc_descriptor_find_by_name (dc_descriptor_t **descriptor, const char *vendor, const char *product);
+
+dc_status_t
+dc_descriptor_find_by_model (dc_descriptor_t **descriptor, dc_family_t type, unsigned int model);
+
+dc_status_t
+dc_descriptor_find_by_usb (dc_descriptor_t **descriptor, unsigned int vid, unsigned int pid);
+
+/*
+ * Create an iterator over the descriptors accepting the name of a
+ * device, as reported by the irda or bluetooth transport. The name is
+ * looked up once in a sorted table, instead of running the filter of
+ * every descriptor, which keeps a discovery with many advertisements
+ * cheap. Descriptors that don't check the name aren't returned.
+ */
+dc_status_t
+dc_descriptor_match_name (dc_iterator_t **iterator, dc_transport_t transport, const char *name);
+
 void
 dc_descriptor_free (dc_descriptor_t *descriptor);
 
@@ -61,6 +97,15 @@ dc_descriptor_get_model (dc_descriptor_t *descriptor);
 dc_transport_t
 dc_descriptor_get_transport (dc_descriptor_t *descriptor);
 
+/*
+ * Get the peak memory class of dc_device_foreach, and the size in bytes
+ * of the largest buffer of dc_device_foreach and dc_device_dump, for
+ * the largest model of the family. A size of zero means the buffer is
+ * small, or its size is only known once the device answered.
+ */
+dc_memory_t
+dc_descriptor_get_memory (dc_descriptor_t *descriptor, unsigned int *download, unsigned int *dump);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
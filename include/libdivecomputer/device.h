@@ -37,7 +37,12 @@ typedef enum dc_event_type_t {
 	DC_EVENT_PROGRESS = (1 << 1),
 	DC_EVENT_DEVINFO = (1 << 2),
 	DC_EVENT_CLOCK = (1 << 3),
-	DC_EVENT_VENDOR = (1 << 4)
+	DC_EVENT_VENDOR = (1 << 4),
+	DC_EVENT_STATS = (1 << 5),
+	DC_EVENT_DIVEDATA = (1 << 6),
+	DC_EVENT_LOGBOOK = (1 << 7),
+	DC_EVENT_THROUGHPUT = (1 << 8),
+	DC_EVENT_CHECKPOINT = (1 << 9)
 } dc_event_type_t;
 
 typedef struct dc_device_t dc_device_t;
@@ -47,6 +52,30 @@ typedef struct dc_event_progress_t {
 	unsigned int maximum;
 } dc_event_progress_t;
 
+/*
+ * Transfer rate
+ *
+ * Delivered after every progress event (subject to the same throttle),
+ * for the progress of the current dc_device_dump or dc_device_foreach
+ * call. The rate is the progress per second (bytes for most backends),
+ * smoothed over the last few seconds, and the eta the remaining time
+ * in milliseconds at that rate, or zero as long as the rate is not
+ * known. Many backends start with a worst-case maximum, and refine it
+ * once the real size is known, for example from the logbook. The
+ * refined flag is set once the maximum changed. The idle time is the
+ * time in milliseconds since the progress last advanced, such that a
+ * stalled transfer can be told apart from a slow one.
+ */
+typedef struct dc_event_throughput_t {
+	unsigned int current;
+	unsigned int maximum;
+	double rate;
+	unsigned int eta;
+	unsigned int elapsed;
+	unsigned int idle;
+	unsigned int refined;
+} dc_event_throughput_t;
+
 typedef struct dc_event_devinfo_t {
 	unsigned int model;
 	unsigned int firmware;
@@ -63,27 +92,249 @@ typedef struct dc_event_vendor_t {
 	unsigned int size;
 } dc_event_vendor_t;
 
+/*
+ * Memory dump checkpoint
+ *
+ * Reported by dc_device_dump after every completed block, with the
+ * first size bytes of the memory dump, which are final. An application
+ * may store them, and pass them to dc_device_set_checkpoint to resume
+ * a failed dump later.
+ */
+typedef struct dc_event_checkpoint_t {
+	const unsigned char *data;
+	unsigned int size;
+} dc_event_checkpoint_t;
+
+/*
+ * Partial dive data
+ *
+ * Backends that download each dive in several pieces report every
+ * piece as soon as it arrives, such that the application can start
+ * processing the dive (see dc_parser_samples_feed) before it is
+ * complete. The pieces are reported in order, with offset the position
+ * in the dive and total the size of the complete dive, or zero if the
+ * size is only known at the end. Concatenated, they are identical to
+ * the data which is passed to the dive callback later. A dive that fails
+ * to download (for example with a checksum error) is never passed to the
+ * dive callback, and its pieces should be discarded. With a NULL dive
+ * callback, the backend is allowed to skip collecting the complete dive
+ * in memory.
+ */
+typedef struct dc_event_divedata_t {
+	const unsigned char *data;
+	unsigned int size;
+	unsigned int offset;
+	unsigned int total;
+} dc_event_divedata_t;
+
+/*
+ * Logbook summaries
+ *
+ * Backends that read a separate logbook (or dive list) first report
+ * the new dives with a DC_EVENT_LOGBOOK event, before any profile is
+ * downloaded, such that the application can show them right away. The
+ * entries are in the same order as the dives passed to the dive
+ * callback later, and have the same fingerprint. They only contain the
+ * information present in the logbook, and the flags indicate which of
+ * the fields are valid. The parsed dive remains authoritative, for
+ * example the logbook of some devices stores the time at the end of
+ * the dive. The data is only valid during the event callback.
+ */
+typedef enum dc_logbook_flags_t {
+	DC_LOGBOOK_DATETIME = (1 << 0),
+	DC_LOGBOOK_MAXDEPTH = (1 << 1),
+	DC_LOGBOOK_DIVETIME = (1 << 2)
+} dc_logbook_flags_t;
+
+typedef struct dc_logbook_entry_t {
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+	unsigned int flags;
+	dc_datetime_t datetime;
+	double maxdepth;
+	unsigned int divetime;
+} dc_logbook_entry_t;
+
+typedef struct dc_event_logbook_t {
+	const dc_logbook_entry_t *entries;
+	unsigned int count;
+} dc_event_logbook_t;
+
+/*
+ * Transport statistics
+ *
+ * The counters cover the lifetime of the device handle, and are emitted
+ * with a DC_EVENT_STATS event at the end of dc_device_dump and
+ * dc_device_foreach. A round trip is measured from the end of a write
+ * to the end of the first read that returns data. Bucket i of the
+ * histogram counts the round trips shorter than 2^i milliseconds (and
+ * not counted in a smaller bucket). The last bucket also counts the
+ * slower round trips.
+ *
+ * The phases array holds the wall time (in microseconds) spent in each
+ * phase of the session. The open phase covers dc_device_open, including
+ * the handshake with the device. The download phase covers the parts of
+ * dc_device_dump and dc_device_foreach that the backend does not
+ * attribute to the logbook or profile phase, such as a full memory
+ * dump. The callback phase is the time spent in the dive callback. With
+ * pipelined delivery, the callback runs concurrently with the download,
+ * so the phases can add up to more than the total time.
+ */
+
+#define DC_EVENT_STATS_NBUCKETS 16
+
+typedef enum dc_phase_t {
+	DC_PHASE_OPEN,
+	DC_PHASE_DOWNLOAD,
+	DC_PHASE_LOGBOOK,
+	DC_PHASE_PROFILE,
+	DC_PHASE_CALLBACK,
+} dc_phase_t;
+
+#define DC_EVENT_STATS_NPHASES 5
+
+typedef struct dc_event_stats_t {
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	unsigned int reads;
+	unsigned int writes;
+	unsigned int timeouts;
+	unsigned int retries;
+	unsigned int checksums;
+	unsigned int rtt[DC_EVENT_STATS_NBUCKETS];
+	unsigned long long phases[DC_EVENT_STATS_NPHASES];
+	dc_memory_stats_t memory;
+} dc_event_stats_t;
+
 typedef int (*dc_cancel_callback_t) (void *userdata);
 
 typedef void (*dc_event_callback_t) (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata);
 
+/*
+ * The dive data and fingerprint are borrowed: they remain valid only
+ * until the callback returns, and must be copied to be kept. Backends
+ * that download a memory image pass a pointer into the image wherever
+ * the dive is stored contiguously, and copy only the dives that cross
+ * the ringbuffer wrap point or need to be combined with other data.
+ */
 typedef int (*dc_dive_callback_t) (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
 
+/*
+ * The location of a dive in a memory image. The offsets of the dive
+ * and its fingerprint are relative to the start of the image, or if
+ * copied is set, to the start of the buffer with the copied dives.
+ */
+typedef struct dc_dive_span_t {
+	unsigned int offset;
+	unsigned int size;
+	unsigned int fingerprint;
+	unsigned int fsize;
+	unsigned int copied;
+} dc_dive_span_t;
+
 dc_status_t
 dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, const char *name);
 
+/*
+ * Open the device over several transports at once, for example a
+ * serial and a bluetooth rfcomm port, or the names of different custom
+ * I/O transports. A connection attempt is started for every name on a
+ * thread of its own. The first device that opens successfully, which
+ * includes the handshake of the backend, is returned, and the other
+ * attempts are cancelled. The connect time becomes the shortest of the
+ * transports, plus the time the cancelled transports need to give up.
+ * If all attempts fail, the error of the first name is returned. At
+ * most eight names are supported. Without thread support, the names
+ * are tried in order.
+ */
+dc_status_t
+dc_device_open_race (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, const char *names[], unsigned int count);
+
 dc_family_t
 dc_device_get_type (dc_device_t *device);
 
 dc_status_t
 dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *userdata);
 
+/*
+ * Cancel the current operation from another thread. Unlike the polled
+ * cancel callback, this also interrupts a blocking read, write or sleep
+ * on the underlying I/O stream, such that the operation fails with
+ * DC_STATUS_CANCELLED without waiting for the transport timeout. The
+ * cancellation is permanent; the device can only be closed afterwards.
+ */
+dc_status_t
+dc_device_cancel (dc_device_t *device);
+
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata);
 
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
 
+/*
+ * Enable pipelined dive delivery in dc_device_foreach. The downloaded
+ * dives are copied into a queue of up to depth dives, and the dive
+ * callback is invoked from a separate consumer thread, such that the
+ * download of the next dive overlaps with the processing of the
+ * previous one. Because of the queue, up to depth additional dives may
+ * be downloaded after the dive callback returned zero. A depth of zero
+ * (the default) disables the pipeline.
+ */
+dc_status_t
+dc_device_set_pipeline (dc_device_t *device, unsigned int depth);
+
+/*
+ * Resume the next memory dump from a checkpoint, with the beginning of
+ * a previous dump of the same device (see DC_EVENT_CHECKPOINT). The
+ * data is copied. The last block of the checkpoint is downloaded again,
+ * and if it has changed since, the dump starts over from the beginning.
+ * Backends that don't download the memory in blocks ignore the
+ * checkpoint. The checkpoint is removed after a successful dump, or with
+ * a size of zero.
+ */
+dc_status_t
+dc_device_set_checkpoint (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+/*
+ * Throttle the progress events. A progress event is only delivered if
+ * at least interval milliseconds have passed, and the progress has
+ * advanced by at least delta, since the previously delivered event.
+ * The first event, the final event (current equal to maximum), and
+ * events with a different maximum or a lower current value are always
+ * delivered. Suppressed events are dropped, not delayed. Zero for both
+ * values (the default) delivers all progress events.
+ */
+dc_status_t
+dc_device_set_progress_throttle (dc_device_t *device, unsigned int interval, unsigned int delta);
+
+/*
+ * Queue the event notifications, such that a slow event callback no
+ * longer delays the communication with the device. The events are
+ * copied into a queue of up to depth events, and delivered by a
+ * background thread, or with the background flag cleared, by the
+ * application calling dc_device_pump_events. The events are delivered
+ * in order, but only the most recent checkpoint event is kept. When the
+ * queue is full, the download waits for a free slot. With a background
+ * thread, dc_device_dump and dc_device_foreach return after all their
+ * events are delivered; without, the remaining events are dropped when
+ * the device is closed. The event data is only valid during the event
+ * callback, as usual. A depth of zero (the default) disables the queue.
+ * The queue can only be changed while no operation is in progress.
+ */
+dc_status_t
+dc_device_set_event_queue (dc_device_t *device, unsigned int depth, unsigned int background);
+
+/*
+ * Deliver the events in the queue on the current thread, without
+ * waiting for new events. Only one thread at a time may pump the events.
+ */
+dc_status_t
+dc_device_pump_events (dc_device_t *device);
+
+dc_status_t
+dc_device_get_stats (dc_device_t *device, dc_event_stats_t *stats);
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size);
 
@@ -99,6 +350,57 @@ dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userd
 dc_status_t
 dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime);
 
+/*
+ * Keep an idle connection alive, for devices that leave the download
+ * mode after a period of inactivity. Nothing is sent if the link was
+ * used recently. Devices without such a timeout return
+ * DC_STATUS_UNSUPPORTED.
+ */
+dc_status_t
+dc_device_keepalive (dc_device_t *device);
+
+/*
+ * Extract the dives from a memory image, as created with dc_device_dump,
+ * without a connection to the device. The dives are reported in the same
+ * order as with dc_device_foreach, but without a fingerprint check. Where
+ * a dive is stored contiguously, the dive callback receives a pointer
+ * into the image rather than a copy. Only the families that download a
+ * memory image are supported, for all others DC_STATUS_UNSUPPORTED is
+ * returned.
+ */
+dc_status_t
+dc_device_extract (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
+/*
+ * Same as dc_device_extract, but for a memory image stored in a file. The
+ * file is memory mapped read-only, and the data pointers passed to the
+ * dive callback remain valid only until this function returns.
+ */
+dc_status_t
+dc_device_extract_file (dc_context_t *context, dc_descriptor_t *descriptor, const char *filename, dc_dive_callback_t callback, void *userdata);
+
+/*
+ * Scan a memory image for dives, as with dc_device_extract, and append
+ * a dc_dive_span_t for every dive to the spans buffer. The dives that
+ * are not stored contiguously in the image, and their fingerprints,
+ * are appended to the copies buffer instead.
+ */
+dc_status_t
+dc_device_extract_spans (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_buffer_t *spans, dc_buffer_t *copies);
+
+/*
+ * Same as dc_device_extract, but the dive callback is invoked
+ * concurrently from up to nthreads threads, including the calling
+ * thread, and therefore must be thread-safe. The dives are scanned
+ * first, and are then handed out in the same order as with
+ * dc_device_extract, but may finish in any order. After the dive
+ * callback returned zero, no new dives are handed out. Without thread
+ * support, or with nthreads equal to zero or one, the dives are
+ * processed one after the other on the calling thread.
+ */
+dc_status_t
+dc_device_extract_parallel (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, unsigned int nthreads, dc_dive_callback_t callback, void *userdata);
+
 dc_status_t
 dc_device_close (dc_device_t *device);
 
@@ -0,0 +1,75 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_EMULATOR_H
+#define DC_EMULATOR_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+#include "iostream.h"
+#include "replay.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Device emulator
+ *
+ * The emulator is an I/O stream that answers the commands of a dive
+ * computer from a memory image, such that the protocol code of the
+ * backend can be exercised and timed without any hardware. Unlike a
+ * replay, the answers are generated for whatever the backend requests,
+ * so a change in the sequence of commands can be measured directly.
+ *
+ * The following families are supported, with the image layout:
+ *
+ *   DC_FAMILY_SHEARWATER_PREDATOR: the memory dump.
+ *   DC_FAMILY_SUUNTO_D9, DC_FAMILY_SUUNTO_VYPER2: the version info
+ *     (4 bytes), followed by the memory dump.
+ *   DC_FAMILY_OCEANIC_ATOM2: the version info (16 bytes), followed by
+ *     the memory dump.
+ *
+ * The timing follows the model of the replay stream: every read and
+ * write takes the fixed latency plus the time to transfer the bytes at
+ * the baudrate. The baudrate configured by the backend is used, unless
+ * a baudrate is passed explicitly. A read that times out also takes the
+ * timeout of the stream. With DC_REPLAY_PACING_NONE the time is only
+ * accumulated; otherwise the emulator also waits for it.
+ *
+ * The loss (in units of 0.1%) is the probability that the emulator
+ * does not answer a command at all. The losses are pseudo random, but
+ * the same for every run.
+ *
+ * The stream is connected to the backend with dc_replay_custom_io.
+ */
+
+dc_status_t
+dc_emulator_open (dc_iostream_t **iostream, dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], size_t size, dc_replay_pacing_t pacing, unsigned int baudrate, unsigned int latency, unsigned int loss);
+
+dc_status_t
+dc_emulator_get_elapsed (dc_iostream_t *iostream, unsigned long long *usecs);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_EMULATOR_H */
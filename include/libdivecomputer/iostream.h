@@ -34,6 +34,14 @@ extern "C" {
  */
 typedef struct dc_iostream_t dc_iostream_t;
 
+/**
+ * Buffer descriptor for the scatter/gather functions.
+ */
+typedef struct dc_iovec_t {
+	void *data;  /**< Pointer to the buffer. */
+	size_t size; /**< Size of the buffer in bytes. */
+} dc_iovec_t;
+
 /**
  * The parity checking scheme.
  */
@@ -186,6 +194,22 @@ dc_iostream_get_lines (dc_iostream_t *iostream, unsigned int *value);
 dc_status_t
 dc_iostream_get_available (dc_iostream_t *iostream, size_t *value);
 
+/**
+ * Wait until some data is available for reading.
+ *
+ * This allows to wait for incoming data on the I/O stream without
+ * reading it, for example to service several streams from a single
+ * thread.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  timeout   The timeout in milliseconds (0 to return
+ *                       immediately, or -1 to wait forever).
+ * @returns #DC_STATUS_SUCCESS if data is available, #DC_STATUS_TIMEOUT
+ * if the timeout expired, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_iostream_poll (dc_iostream_t *iostream, int timeout);
+
 /**
  * Configure the line settings.
  *
@@ -229,6 +253,41 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 dc_status_t
 dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+/**
+ * Read data from the I/O stream into multiple buffers.
+ *
+ * The buffers are filled in order, exactly as if the data was read
+ * into a single buffer with their concatenated size.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  iov       The buffers to read the data into.
+ * @param[in]  count     The number of buffers.
+ * @param[out] actual    An (optional) location to store the actual
+ *                       number of bytes transferred.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_readv (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+/**
+ * Write data from multiple buffers to the I/O stream.
+ *
+ * The buffers are transmitted in order, exactly as if their
+ * concatenation was written with a single call. Where supported, this
+ * is done without copying the data and with a single system call.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @param[in]  iov       The buffers with the data to write.
+ * @param[in]  count     The number of buffers.
+ * @param[out] actual    An (optional) location to store the actual
+ *                       number of bytes transferred.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
 /**
  * Flush the internal output buffer and wait until the data has been
  * transmitted.
@@ -263,6 +322,23 @@ dc_iostream_purge (dc_iostream_t *iostream, dc_direction_t direction);
 dc_status_t
 dc_iostream_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 
+/**
+ * Cancel the I/O stream.
+ *
+ * This function can be called from another thread. A blocking read,
+ * write, poll or sleep that is in progress is interrupted immediately,
+ * and fails with #DC_STATUS_CANCELLED. All further I/O on the stream
+ * fails with the same error, so the stream can only be closed
+ * afterwards.
+ *
+ * @param[in]  iostream  A valid I/O stream.
+ * @returns #DC_STATUS_SUCCESS on success, or #DC_STATUS_UNSUPPORTED if
+ * the transport can't interrupt a blocking call. In that case the call
+ * in progress still runs until its timeout, but all further I/O fails.
+ */
+dc_status_t
+dc_iostream_cancel (dc_iostream_t *iostream);
+
 /**
  * Close the I/O stream and free all resources.
  *
@@ -35,6 +35,15 @@ oceanic_atom2_device_version (dc_device_t *device, unsigned char data[], unsigne
 dc_status_t
 oceanic_atom2_device_keepalive (dc_device_t *device);
 
+/*
+ * Keep up to npages of the most recently read pages (at most 32) in
+ * memory, such that the logbook and profile stages of a download, which
+ * often touch the same pages, don't need to read them twice. A value of
+ * zero disables the cache. Writing to the device invalidates the cache.
+ */
+dc_status_t
+oceanic_atom2_device_set_cache (dc_device_t *device, unsigned int npages);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
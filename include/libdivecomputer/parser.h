@@ -64,10 +64,12 @@ typedef enum dc_field_type_t {
 	DC_FIELD_TANK,
 	DC_FIELD_DIVEMODE,
 	DC_FIELD_STRING,
+	DC_FIELD_VENDOR,
 } dc_field_type_t;
 
 // Make it easy to test support compile-time with "#ifdef DC_FIELD_STRING"
 #define DC_FIELD_STRING DC_FIELD_STRING
+#define DC_FIELD_VENDOR DC_FIELD_VENDOR
 
 typedef enum parser_sample_event_t {
 	SAMPLE_EVENT_NONE,
@@ -208,6 +210,26 @@ typedef struct dc_field_string_t {
 	const char *value;
 } dc_field_string_t;
 
+/*
+ * Vendor sample block
+ *
+ * The location of the raw sample data in the dive data, as a single
+ * block of count samples of stride bytes each, starting at offset. The
+ * data pointer refers directly into the dive data, and remains valid as
+ * long as that data does. Backends with such a fixed sample layout
+ * support this field, such that the vendor data can be copied at once,
+ * instead of one DC_SAMPLE_VENDOR sample at a time. The block contains
+ * the empty samples too, and some sample types, like the surface
+ * interval samples of the Oceanic devices, span multiple samples.
+ */
+typedef struct dc_field_vendor_t {
+	unsigned int type;    /* Vendor data type (SAMPLE_VENDOR_xxx) */
+	unsigned int offset;  /* Offset in the dive data (bytes) */
+	unsigned int stride;  /* Size of a single sample (bytes) */
+	unsigned int count;   /* Number of samples */
+	const unsigned char *data;
+} dc_field_vendor_t;
+
 typedef union dc_sample_value_t {
 	unsigned int time;
 	double depth;
@@ -246,6 +268,247 @@ typedef struct dc_parser_t dc_parser_t;
 
 typedef void (*dc_sample_callback_t) (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+/*
+ * Sample table
+ *
+ * A caller-provided struct-of-arrays buffer, filled by
+ * dc_parser_samples_get_batch in a single pass over the profile. Each
+ * DC_SAMPLE_TIME sample starts a new row, and the other sample types
+ * are stored in the columns of the current row. Every column pointer
+ * is optional: a NULL column is simply not filled. The pressure column
+ * holds ntanks values per row, and the value for tank n of row i is
+ * stored at pressure[i * ntanks + n]. Tanks without a value are zero.
+ *
+ * The (optional) mask column contains a bitmask with the sample types
+ * present in each row (1 << DC_SAMPLE_xxx). Column values of sample
+ * types without the corresponding mask bit are undefined.
+ *
+ * Events are stored separately, because a row can contain any number
+ * of them. The row field refers to the row the event belongs to.
+ *
+ * On return, count and nevents contain the total number of rows and
+ * events in the profile, even if the table was too small to store all
+ * of them. In that case DC_STATUS_NOMEMORY is returned, and the caller
+ * can grow the table to the required size and try again.
+ */
+
+typedef struct dc_sample_table_event_t {
+	unsigned int row;
+	unsigned int type;
+	unsigned int time;
+	unsigned int flags;
+	unsigned int value;
+	const char *name;
+} dc_sample_table_event_t;
+
+typedef struct dc_sample_table_t {
+	/* Table dimensions (input). */
+	unsigned int capacity;
+	unsigned int ntanks;
+	unsigned int events_capacity;
+	/* Number of rows and events (output). */
+	unsigned int count;
+	unsigned int nevents;
+	/* Columns. */
+	unsigned int *mask;
+	unsigned int *time;
+	double *depth;
+	double *pressure;
+	double *temperature;
+	double *ppo2;
+	unsigned int *deco_type;
+	unsigned int *deco_time;
+	double *deco_depth;
+	unsigned int *gasmix;
+	/* Events. */
+	dc_sample_table_event_t *events;
+} dc_sample_table_t;
+
+/*
+ * Derived metrics
+ *
+ * With a derived metrics buffer attached to the parser (see
+ * dc_parser_set_derived), dc_parser_samples_get_batch also computes
+ * the ascent rate, the gas consumption and the time on each gas mix,
+ * straight from the columns of the sample table. Like the table, the
+ * buffer is provided by the caller, and the library allocates nothing.
+ * Every column pointer is optional, and has room for as many rows as
+ * the table. A metric is only computed if the table has the columns it
+ * needs (besides the mask and time columns): the depth column for the
+ * ascent rate, the depth and pressure columns for the gas consumption,
+ * and the gasmix column for the gas time.
+ *
+ * The ascent rate (m/min, negative while descending) of a row is the
+ * rate since the previous row with a depth. The SAC column holds ntanks
+ * values per row, like the pressure column, with the pressure drop of
+ * each tank converted to the surface (bar/min). The rate is taken over
+ * the interval between two different pressure readings, because of the
+ * coarse resolution of most pressure sensors. The RMV column adds the
+ * SAC of all tanks with a known volume (liter/min). The time before the
+ * first gas switch counts for the first gas mix.
+ *
+ * The decompression columns come from the library's own Buhlmann
+ * ZH-L16C model with gradient factors (in percent, zero for 100), and
+ * don't depend on the decompression samples of the device. They need
+ * the depth column. The gas mixes come from DC_FIELD_GASMIX, with the
+ * gasmix column for the switches, and the first gas mix (or air) at the
+ * start of the dive. On a rebreather, the ppo2 column is the setpoint.
+ * The ceiling is a depth (m), the no decompression limit (capped at 99
+ * minutes, zero in decompression) and the time to surface (an ascent
+ * at 10 m/min with stops every 3 m, on the current gas) are in seconds,
+ * and the CNS oxygen toxicity is a fraction, without the recovery at
+ * the surface.
+ */
+
+typedef struct dc_sample_derived_t {
+	/* Columns. */
+	double *ascent;
+	double *sac;
+	double *rmv;
+	/* Time on each gas mix (seconds). */
+	unsigned int ngasmixes;
+	unsigned int *gastime;
+	/* Decompression columns. */
+	unsigned int gflow;
+	unsigned int gfhigh;
+	double *ceiling;
+	unsigned int *ndl;
+	unsigned int *tts;
+	double *cns;
+	/* Summaries (output). */
+	double maxascent;   /* Fastest ascent rate (m/min) */
+	double maxdescent;  /* Fastest descent rate (m/min) */
+	double rmv_average; /* Average RMV over the dive (liter/min) */
+} dc_sample_derived_t;
+
+/*
+ * Sample table summary
+ *
+ * The summary of a filled sample table (see dc_sample_table_summarize),
+ * which needs the mask and time columns. The dive time is the time of
+ * the last row, and the average depth is weighted by time. The types
+ * field contains a bitmask (1 << DC_SAMPLE_xxx) with the depth,
+ * temperature and pressure values found in the table. The (optional)
+ * pressure arrays receive the first and last non-zero pressure of each
+ * tank, or zero for a tank without pressures.
+ */
+
+typedef struct dc_sample_summary_t {
+	unsigned int types;
+	unsigned int divetime;
+	double maxdepth;
+	double avgdepth;
+	double mintemperature;
+	double maxtemperature;
+	/* Pressures (ntanks values each). */
+	double *pressure_begin;
+	double *pressure_end;
+} dc_sample_summary_t;
+
+/*
+ * Sample type mask
+ *
+ * A bitmask with the sample types the application is interested in
+ * (1 << DC_SAMPLE_xxx). Samples of the other types are not reported,
+ * and backends can skip their (expensive) decoding, such as the vendor
+ * data and the event names. By default, all types are reported.
+ */
+
+#define DC_SAMPLE_MASK_ALL 0xFFFFFFFF
+
+/*
+ * Sample decimation
+ *
+ * With decimation enabled, dc_parser_samples_foreach reports only time
+ * and depth samples, reduced to at most npoints rows, for example for
+ * dive list thumbnails. The envelope mode divides the profile into
+ * npoints / 2 buckets, and reports the minimum and maximum depth of
+ * each bucket. The LTTB mode selects the rows with the largest
+ * triangle three buckets algorithm, which preserves the visual shape
+ * of the profile. The first and last rows are always reported.
+ */
+
+typedef enum dc_decimation_t {
+	DC_DECIMATION_NONE,
+	DC_DECIMATION_ENVELOPE,
+	DC_DECIMATION_LTTB,
+} dc_decimation_t;
+
+/*
+ * Sample resampling
+ *
+ * With a non-zero interval (in seconds), dc_parser_samples_get_batch
+ * fills the sample table with a fixed interval grid instead of the
+ * rows of the device. The grid rows are the multiples of the interval,
+ * from the first to the last time sample. The samples are resampled
+ * while they are parsed, without an intermediate copy.
+ *
+ * The depth, pressure, temperature and ppO2 columns are interpolated
+ * linearly by default, and only between two samples of the same type.
+ * With step interpolation, a row receives the last value at or before
+ * its time, up to the end of the dive. The gas mix and the deco status
+ * always use step interpolation. An event belongs to the first row at
+ * or after its time.
+ */
+
+typedef enum dc_interpolation_t {
+	DC_INTERPOLATION_LINEAR,
+	DC_INTERPOLATION_STEP,
+} dc_interpolation_t;
+
+/*
+ * Event coalescing
+ *
+ * Many dive computers store a warning in every sample while the
+ * condition lasts. With coalescing enabled (dc_parser_set_coalescing),
+ * such a run is reported as a single event with SAMPLE_FLAGS_BEGIN at
+ * the first sample, and the same event with SAMPLE_FLAGS_END at the
+ * first sample without it. A run that lasts until the last sample has
+ * no end event. Events that already carry a begin or end flag, and
+ * the bookmark, gas change and heading events, are reported
+ * unchanged. Coalescing applies to dc_parser_samples_foreach, the
+ * event list of dc_parser_samples_get_batch, and the range and
+ * minmax walks, but not to dc_parser_samples_feed.
+ */
+
+/*
+ * Field requests
+ *
+ * A request for dc_parser_get_fields, with the same type, flags and
+ * value arguments as dc_parser_get_field. The status of the individual
+ * request is stored in the request itself.
+ */
+
+typedef struct dc_field_request_t {
+	dc_field_type_t type;
+	unsigned int flags;
+	void *value;
+	dc_status_t status;
+} dc_field_request_t;
+
+/*
+ * Work limits
+ *
+ * Bound the work of a single call on the parser, such that corrupt or
+ * hostile data can not stall the application: the number of records
+ * (samples, entries or events), the number of bytes scanned, and the
+ * number of type descriptors. A limit of zero means no limit. Once a
+ * limit is exceeded, the call stops early and fails with
+ * DC_STATUS_DATAFORMAT. For the incremental sample feed, the limits
+ * apply to the entire dive, since the last dc_parser_set_data call.
+ *
+ * The limits are enforced by the backends which scan their data in the
+ * most expensive way (Suunto EON Steel, Cochran and Uwatec Smart). The
+ * work is counted in the parser, so a parser with limits must not be
+ * shared between threads, not even after dc_parser_prepare.
+ */
+
+typedef struct dc_parser_limits_t {
+	unsigned int records;
+	unsigned int bytes;
+	unsigned int descriptors;
+} dc_parser_limits_t;
+
 dc_status_t
 dc_parser_new (dc_parser_t **parser, dc_device_t *device);
 
@@ -258,18 +521,173 @@ dc_parser_get_type (dc_parser_t *parser);
 dc_status_t
 dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
 
+dc_status_t
+dc_parser_reset (dc_parser_t *parser);
+
+/*
+ * Build the caches of the parser eagerly, instead of on first use: the
+ * header, the memoized summary fields, and the profile index and
+ * statistics. Afterwards, dc_parser_get_datetime, dc_parser_get_field,
+ * dc_parser_samples_foreach and dc_parser_samples_get_batch only read
+ * the parser state, and may be called concurrently from several
+ * threads, until the data or one of the settings is changed. Apply the
+ * settings before preparing the parser. With derived metrics enabled,
+ * the batch function writes the derived columns, and must not be
+ * called concurrently.
+ */
+dc_status_t
+dc_parser_prepare (dc_parser_t *parser);
+
 dc_status_t
 dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime);
 
 dc_status_t
 dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value);
 
+/*
+ * Fetch several fields in one call. Every request receives its own
+ * status, and a missing field is not an error for the other requests.
+ */
+dc_status_t
+dc_parser_get_fields (dc_parser_t *parser, dc_field_request_t requests[], unsigned int count);
+
+dc_status_t
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask);
+
+dc_status_t
+dc_parser_set_decimation (dc_parser_t *parser, dc_decimation_t mode, unsigned int npoints);
+
+dc_status_t
+dc_parser_set_resampling (dc_parser_t *parser, unsigned int interval);
+
+dc_status_t
+dc_parser_set_interpolation (dc_parser_t *parser, dc_sample_type_t type, dc_interpolation_t mode);
+
+dc_status_t
+dc_parser_set_coalescing (dc_parser_t *parser, unsigned int enable);
+
+dc_status_t
+dc_parser_set_derived (dc_parser_t *parser, dc_sample_derived_t *derived);
+
+dc_status_t
+dc_parser_set_limits (dc_parser_t *parser, const dc_parser_limits_t *limits);
+
+/*
+ * The memory statistics of the current dive, since the last call to
+ * dc_parser_set_data (see dc_context_set_memory_stats). The peak is
+ * relative to the memory in use before the dive.
+ */
+dc_status_t
+dc_parser_get_memory_stats (dc_parser_t *parser, dc_memory_stats_t *stats);
+
 dc_status_t
 dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+dc_status_t
+dc_parser_samples_get_batch (dc_parser_t *parser, dc_sample_table_t *table);
+
+dc_status_t
+dc_sample_table_summarize (const dc_sample_table_t *table, dc_sample_summary_t *summary);
+
+/*
+ * Sample table codec
+ *
+ * A compact encoding of the rows and events in a sample table, for
+ * storing parsed profiles. The double columns are quantized to fixed
+ * point (millimeter, millibar, hundredths of a degree Celsius, and
+ * millibar for the ppO2), and every column is stored as zig-zag varint
+ * deltas, with runs of equal values collapsed, or as a single value if
+ * it is constant. Only the non-NULL columns of the table are stored. A
+ * row without a value for a column decodes to the value of the previous
+ * row, the mask column tells them apart.
+ *
+ * The encoded data is appended to the buffer. Decoding fills the
+ * non-NULL columns of the table, and the event names point into the
+ * encoded data. Like dc_parser_samples_get_batch, decoding returns
+ * DC_STATUS_NOMEMORY with the required count and nevents if the table
+ * is too small.
+ */
+
+dc_status_t
+dc_sample_table_encode (const dc_sample_table_t *table, dc_buffer_t *buffer);
+
+dc_status_t
+dc_sample_table_decode (dc_sample_table_t *table, const unsigned char data[], unsigned int size);
+
+/*
+ * Windowed sample iteration
+ *
+ * Only the rows with a time in the range [begin, end] (in seconds) are
+ * reported, and of those only every step'th row (a step of zero or one
+ * reports all of them). Backends that can seek in their profile data
+ * start decoding close to the begin time, and stop after the end time.
+ * The gas mix in effect at the start of the window, or after skipped
+ * rows, is reported right after the time sample of the next row.
+ *
+ * The min/max variant divides the window into buckets of interval
+ * seconds, and reports only the rows with the minimum and the maximum
+ * depth of each bucket, for overview plots. Rows without a depth are
+ * skipped, and vendor samples are not reported in this mode.
+ */
+
+dc_status_t
+dc_parser_samples_range (dc_parser_t *parser, unsigned int begin, unsigned int end, unsigned int step, dc_sample_callback_t callback, void *userdata);
+
+dc_status_t
+dc_parser_samples_minmax (dc_parser_t *parser, unsigned int begin, unsigned int end, unsigned int interval, dc_sample_callback_t callback, void *userdata);
+
+/*
+ * Incremental sample parsing
+ *
+ * Parse the samples while the dive data is still arriving, for example
+ * from the DC_EVENT_DIVEDATA events of the download. Every call passes
+ * the next size bytes of the dive, and reports the samples that are
+ * complete so far. A call with a size of zero marks the end of the dive
+ * and reports the remaining samples. Call dc_parser_set_data with a NULL
+ * pointer first to start a new dive. Only the backends that implement
+ * this mode support it. The others return DC_STATUS_UNSUPPORTED. The
+ * sample mask applies, but decimation does not.
+ */
+
+dc_status_t
+dc_parser_samples_feed (dc_parser_t *parser, const unsigned char data[], unsigned int size, dc_sample_callback_t callback, void *userdata);
+
 dc_status_t
 dc_parser_destroy (dc_parser_t *parser);
 
+/*
+ * Parse many dives in parallel
+ *
+ * Each job is parsed on one of up to nthreads worker threads: a parser
+ * is created with dc_parser_new2, the dive data is attached, and the
+ * callback function is called to extract whatever the application
+ * needs (fields, samples). The callback runs on a worker thread, and
+ * should only touch the parser and the per-job results. The result
+ * function is called on the calling thread, strictly in job order, as
+ * soon as a job is complete. Returning zero from the result function
+ * stops the processing, and DC_STATUS_CANCELLED is returned.
+ *
+ * The context is shared between the worker threads. The log function
+ * of the context must therefore be thread-safe. Without thread support,
+ * or with nthreads smaller than two, all jobs are processed on the
+ * calling thread.
+ */
+
+typedef struct dc_parse_job_t {
+	dc_descriptor_t *descriptor;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	const unsigned char *data;
+	unsigned int size;
+} dc_parse_job_t;
+
+typedef dc_status_t (*dc_parse_callback_t) (dc_parser_t *parser, unsigned int index, void *userdata);
+
+typedef int (*dc_parse_result_callback_t) (unsigned int index, dc_status_t status, void *userdata);
+
+dc_status_t
+dc_parse_many (dc_context_t *context, const dc_parse_job_t jobs[], unsigned int count, unsigned int nthreads, dc_parse_callback_t callback, dc_parse_result_callback_t result, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
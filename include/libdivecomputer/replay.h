@@ -0,0 +1,96 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_REPLAY_H
+#define DC_REPLAY_H
+
+#include "common.h"
+#include "context.h"
+#include "custom_io.h"
+#include "iostream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Record and replay of I/O streams
+ *
+ * The recorder wraps an open I/O stream, and writes every call with a
+ * timestamp to a capture file. The replay stream serves such a capture
+ * back without any hardware, so a download can be repeated offline.
+ *
+ * The data received from the device is replayed as a byte stream: a
+ * chunk of recorded data only becomes available after the same number
+ * of bytes was written as at the time it was recorded. A read that
+ * would need more data returns a timeout, just like a device that does
+ * not answer. Recorded timeouts and errors are reported again at the
+ * same position in the stream. Because of this, a backend that reads
+ * the same data in smaller or larger pieces still replays correctly.
+ * Written data that differs from the capture is logged as a warning.
+ *
+ * The replay is paced according to the pacing mode: without any delay,
+ * with the recorded timing, or with a model of a serial line at the
+ * configured baudrate plus a fixed latency per transfer. The modelled
+ * transfer time is always accumulated, independent of the pacing, and
+ * can be retrieved with dc_replay_get_elapsed.
+ *
+ * Since the backends open their transport themselves, both streams are
+ * connected through the custom I/O of the context: dc_replay_custom_io
+ * fills a dc_custom_io_t structure with serial callbacks that forward
+ * to the stream. Packet based transports are not supported.
+ */
+
+typedef enum dc_replay_pacing_t {
+	DC_REPLAY_PACING_NONE,
+	DC_REPLAY_PACING_REALTIME,
+	DC_REPLAY_PACING_MODEL,
+} dc_replay_pacing_t;
+
+/*
+ * Create a recording I/O stream. The recorder takes ownership of the
+ * base stream, and closes it when it is closed itself.
+ */
+dc_status_t
+dc_recorder_open (dc_iostream_t **iostream, dc_context_t *context, dc_iostream_t *base, const char *filename);
+
+/*
+ * Create a replay I/O stream. The latency (in milliseconds) is only
+ * used for the model, and is added to every read and write.
+ */
+dc_status_t
+dc_replay_open (dc_iostream_t **iostream, dc_context_t *context, const char *filename, dc_replay_pacing_t pacing, unsigned int latency);
+
+dc_status_t
+dc_replay_get_elapsed (dc_iostream_t *iostream, unsigned long long *usecs);
+
+/*
+ * Fill a custom I/O structure with serial callbacks that forward to the
+ * stream, which is a recorder, replay or emulator stream. The stream is
+ * not closed by the callbacks.
+ */
+dc_status_t
+dc_replay_custom_io (dc_custom_io_t *io, dc_iostream_t *iostream);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_REPLAY_H */
@@ -0,0 +1,129 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SESSION_H
+#define DC_SESSION_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Download from several dive computers concurrently
+ *
+ * Each session is a (descriptor, device name) pair, optionally with the
+ * fingerprint of the most recent dive that was already downloaded. The
+ * sessions are processed on a bounded pool of worker threads: the device
+ * is opened, dc_device_foreach is called, and the device is closed
+ * again. All sessions share the same context, and thus the same logging
+ * and caches. The log function of the context must therefore be
+ * thread-safe.
+ *
+ * The callback functions are passed the index of the session, and are
+ * never called concurrently, so they need no locking of their own.
+ * Progress events are also accumulated over all sessions, and the total
+ * can be retrieved with dc_session_manager_get_progress at any time.
+ * A single dc_session_manager_cancel call aborts all sessions.
+ *
+ * Sessions that share a bus or radio can be slower when they run at
+ * the same time. Every session therefore uses a named resource, and at
+ * most limit sessions of the same resource run concurrently. By
+ * default, all bluetooth sessions share the "bluetooth" resource, and
+ * all irda sessions the "irda" resource (with a limit of one), while
+ * the other sessions don't share anything. A USB hub, for example,
+ * can be modelled by assigning its sessions a resource of their own.
+ * A limit of zero means no limit.
+ *
+ * The pending session with the largest expected size is started first,
+ * as far as the resource limits allow, such that the long downloads
+ * don't end up running last. The expected size is a hint in the units
+ * of the progress events, for example from the logbook of a previous
+ * download, and is updated with the progress maximum of every run.
+ *
+ * In persistent mode, the devices remain open after a successful run,
+ * such that the next run skips the transport setup and the handshake
+ * of the device, and starts downloading right away. The fingerprint of
+ * the newest dive of every run replaces the fingerprint of the session,
+ * so the next run downloads only the new dives. Between the runs,
+ * dc_session_manager_keepalive prevents the devices from leaving the
+ * download mode, and dc_session_manager_close closes all devices. A
+ * device which fails is closed, and opened again by the next run.
+ */
+
+typedef struct dc_session_manager_t dc_session_manager_t;
+
+typedef int (*dc_session_dive_callback_t) (unsigned int index, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+typedef void (*dc_session_event_callback_t) (unsigned int index, dc_event_type_t event, const void *data, void *userdata);
+
+typedef void (*dc_session_result_callback_t) (unsigned int index, dc_status_t status, void *userdata);
+
+dc_status_t
+dc_session_manager_new (dc_session_manager_t **manager, dc_context_t *context, unsigned int nthreads);
+
+dc_status_t
+dc_session_manager_add (dc_session_manager_t *manager, dc_descriptor_t *descriptor, const char *name, const unsigned char data[], unsigned int size, unsigned int *index);
+
+dc_status_t
+dc_session_manager_set_resource (dc_session_manager_t *manager, unsigned int index, const char *resource);
+
+dc_status_t
+dc_session_manager_set_limit (dc_session_manager_t *manager, const char *resource, unsigned int limit);
+
+dc_status_t
+dc_session_manager_set_size (dc_session_manager_t *manager, unsigned int index, unsigned int size);
+
+dc_status_t
+dc_session_manager_set_persistent (dc_session_manager_t *manager, int persistent);
+
+dc_status_t
+dc_session_manager_set_events (dc_session_manager_t *manager, unsigned int events, dc_session_event_callback_t callback, void *userdata);
+
+dc_status_t
+dc_session_manager_run (dc_session_manager_t *manager, dc_session_dive_callback_t callback, dc_session_result_callback_t result, void *userdata);
+
+dc_status_t
+dc_session_manager_keepalive (dc_session_manager_t *manager);
+
+dc_status_t
+dc_session_manager_close (dc_session_manager_t *manager);
+
+dc_status_t
+dc_session_manager_cancel (dc_session_manager_t *manager);
+
+dc_status_t
+dc_session_manager_get_progress (dc_session_manager_t *manager, dc_event_progress_t *progress);
+
+dc_status_t
+dc_session_manager_get_status (dc_session_manager_t *manager, unsigned int index, dc_status_t *status);
+
+dc_status_t
+dc_session_manager_free (dc_session_manager_t *manager);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SESSION_H */
@@ -35,6 +35,7 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 /*****************************************************************************/
 #include <string.h> // CBC mode, for memset
 #include "aes.h"
+#include "cpu-private.h"
 
 
 /*****************************************************************************/
@@ -56,6 +57,21 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
   #define MULTIPLY_AS_A_FUNCTION 0
 #endif
 
+// Use the AES-NI instructions, if supported by the processor at runtime.
+// Requires a compiler with support for the target function attribute.
+#ifndef AESNI
+  #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) || defined(__clang__))
+    #define AESNI 1
+  #else
+    #define AESNI 0
+  #endif
+#endif
+
+#if AESNI
+#include <wmmintrin.h>
+#endif
+
 
 /*****************************************************************************/
 /* Private variables:                                                        */
@@ -72,6 +88,9 @@ typedef struct aes_state_t {
 	// The Key input to the AES Program
 	const uint8_t* Key;
 
+	// The processor features the cipher is allowed to use.
+	unsigned int features;
+
 #if defined(CBC) && CBC
 	// Initial Vector used only for CBC mode
 	uint8_t* Iv;
@@ -234,72 +253,11 @@ static void AddRoundKey(aes_state_t *state, uint8_t round)
   }
 }
 
-// The SubBytes Function Substitutes the values in the
-// state matrix with values in an S-box.
-static void SubBytes(aes_state_t *state)
-{
-  uint8_t i, j;
-  for(i = 0; i < 4; ++i)
-  {
-    for(j = 0; j < 4; ++j)
-    {
-      (*state->state)[j][i] = getSBoxValue((*state->state)[j][i]);
-    }
-  }
-}
-
-// The ShiftRows() function shifts the rows in the state to the left.
-// Each row is shifted with different offset.
-// Offset = Row number. So the first row is not shifted.
-static void ShiftRows(aes_state_t *state)
-{
-  uint8_t temp;
-
-  // Rotate first row 1 columns to left  
-  temp           = (*state->state)[0][1];
-  (*state->state)[0][1] = (*state->state)[1][1];
-  (*state->state)[1][1] = (*state->state)[2][1];
-  (*state->state)[2][1] = (*state->state)[3][1];
-  (*state->state)[3][1] = temp;
-
-  // Rotate second row 2 columns to left  
-  temp           = (*state->state)[0][2];
-  (*state->state)[0][2] = (*state->state)[2][2];
-  (*state->state)[2][2] = temp;
-
-  temp       = (*state->state)[1][2];
-  (*state->state)[1][2] = (*state->state)[3][2];
-  (*state->state)[3][2] = temp;
-
-  // Rotate third row 3 columns to left
-  temp       = (*state->state)[0][3];
-  (*state->state)[0][3] = (*state->state)[3][3];
-  (*state->state)[3][3] = (*state->state)[2][3];
-  (*state->state)[2][3] = (*state->state)[1][3];
-  (*state->state)[1][3] = temp;
-}
-
 static uint8_t xtime(uint8_t x)
 {
   return ((x<<1) ^ (((x>>7) & 1) * 0x1b));
 }
 
-// MixColumns function mixes the columns of the state matrix
-static void MixColumns(aes_state_t *state)
-{
-  uint8_t i;
-  uint8_t Tmp,Tm,t;
-  for(i = 0; i < 4; ++i)
-  {  
-    t   = (*state->state)[i][0];
-    Tmp = (*state->state)[i][0] ^ (*state->state)[i][1] ^ (*state->state)[i][2] ^ (*state->state)[i][3] ;
-    Tm  = (*state->state)[i][0] ^ (*state->state)[i][1] ; Tm = xtime(Tm);  (*state->state)[i][0] ^= Tm ^ Tmp ;
-    Tm  = (*state->state)[i][1] ^ (*state->state)[i][2] ; Tm = xtime(Tm);  (*state->state)[i][1] ^= Tm ^ Tmp ;
-    Tm  = (*state->state)[i][2] ^ (*state->state)[i][3] ; Tm = xtime(Tm);  (*state->state)[i][2] ^= Tm ^ Tmp ;
-    Tm  = (*state->state)[i][3] ^ t ;        Tm = xtime(Tm);  (*state->state)[i][3] ^= Tm ^ Tmp ;
-  }
-}
-
 // Multiply is used to multiply numbers in the field GF(2^8)
 #if MULTIPLY_AS_A_FUNCTION
 static uint8_t Multiply(uint8_t x, uint8_t y)
@@ -385,30 +343,137 @@ static void InvShiftRows(aes_state_t *state)
 }
 
 
-// Cipher is the main function that encrypts the PlainText.
-static void Cipher(aes_state_t *state)
+// Lookup table combining SubBytes and MixColumns for the encryption rounds.
+// Entry x holds the MixColumns column {02}.s, s, s, {03}.s of s = sbox[x],
+// packed with row 0 in the least significant byte. The tables for the other
+// rows are byte rotations of this one, so only a single table is stored.
+static const uint32_t Te0[256] = {
+  0xa56363c6, 0x847c7cf8, 0x997777ee, 0x8d7b7bf6, 0x0df2f2ff, 0xbd6b6bd6, 0xb16f6fde, 0x54c5c591,
+  0x50303060, 0x03010102, 0xa96767ce, 0x7d2b2b56, 0x19fefee7, 0x62d7d7b5, 0xe6abab4d, 0x9a7676ec,
+  0x45caca8f, 0x9d82821f, 0x40c9c989, 0x877d7dfa, 0x15fafaef, 0xeb5959b2, 0xc947478e, 0x0bf0f0fb,
+  0xecadad41, 0x67d4d4b3, 0xfda2a25f, 0xeaafaf45, 0xbf9c9c23, 0xf7a4a453, 0x967272e4, 0x5bc0c09b,
+  0xc2b7b775, 0x1cfdfde1, 0xae93933d, 0x6a26264c, 0x5a36366c, 0x413f3f7e, 0x02f7f7f5, 0x4fcccc83,
+  0x5c343468, 0xf4a5a551, 0x34e5e5d1, 0x08f1f1f9, 0x937171e2, 0x73d8d8ab, 0x53313162, 0x3f15152a,
+  0x0c040408, 0x52c7c795, 0x65232346, 0x5ec3c39d, 0x28181830, 0xa1969637, 0x0f05050a, 0xb59a9a2f,
+  0x0907070e, 0x36121224, 0x9b80801b, 0x3de2e2df, 0x26ebebcd, 0x6927274e, 0xcdb2b27f, 0x9f7575ea,
+  0x1b090912, 0x9e83831d, 0x742c2c58, 0x2e1a1a34, 0x2d1b1b36, 0xb26e6edc, 0xee5a5ab4, 0xfba0a05b,
+  0xf65252a4, 0x4d3b3b76, 0x61d6d6b7, 0xceb3b37d, 0x7b292952, 0x3ee3e3dd, 0x712f2f5e, 0x97848413,
+  0xf55353a6, 0x68d1d1b9, 0x00000000, 0x2cededc1, 0x60202040, 0x1ffcfce3, 0xc8b1b179, 0xed5b5bb6,
+  0xbe6a6ad4, 0x46cbcb8d, 0xd9bebe67, 0x4b393972, 0xde4a4a94, 0xd44c4c98, 0xe85858b0, 0x4acfcf85,
+  0x6bd0d0bb, 0x2aefefc5, 0xe5aaaa4f, 0x16fbfbed, 0xc5434386, 0xd74d4d9a, 0x55333366, 0x94858511,
+  0xcf45458a, 0x10f9f9e9, 0x06020204, 0x817f7ffe, 0xf05050a0, 0x443c3c78, 0xba9f9f25, 0xe3a8a84b,
+  0xf35151a2, 0xfea3a35d, 0xc0404080, 0x8a8f8f05, 0xad92923f, 0xbc9d9d21, 0x48383870, 0x04f5f5f1,
+  0xdfbcbc63, 0xc1b6b677, 0x75dadaaf, 0x63212142, 0x30101020, 0x1affffe5, 0x0ef3f3fd, 0x6dd2d2bf,
+  0x4ccdcd81, 0x140c0c18, 0x35131326, 0x2fececc3, 0xe15f5fbe, 0xa2979735, 0xcc444488, 0x3917172e,
+  0x57c4c493, 0xf2a7a755, 0x827e7efc, 0x473d3d7a, 0xac6464c8, 0xe75d5dba, 0x2b191932, 0x957373e6,
+  0xa06060c0, 0x98818119, 0xd14f4f9e, 0x7fdcdca3, 0x66222244, 0x7e2a2a54, 0xab90903b, 0x8388880b,
+  0xca46468c, 0x29eeeec7, 0xd3b8b86b, 0x3c141428, 0x79dedea7, 0xe25e5ebc, 0x1d0b0b16, 0x76dbdbad,
+  0x3be0e0db, 0x56323264, 0x4e3a3a74, 0x1e0a0a14, 0xdb494992, 0x0a06060c, 0x6c242448, 0xe45c5cb8,
+  0x5dc2c29f, 0x6ed3d3bd, 0xefacac43, 0xa66262c4, 0xa8919139, 0xa4959531, 0x37e4e4d3, 0x8b7979f2,
+  0x32e7e7d5, 0x43c8c88b, 0x5937376e, 0xb76d6dda, 0x8c8d8d01, 0x64d5d5b1, 0xd24e4e9c, 0xe0a9a949,
+  0xb46c6cd8, 0xfa5656ac, 0x07f4f4f3, 0x25eaeacf, 0xaf6565ca, 0x8e7a7af4, 0xe9aeae47, 0x18080810,
+  0xd5baba6f, 0x887878f0, 0x6f25254a, 0x722e2e5c, 0x241c1c38, 0xf1a6a657, 0xc7b4b473, 0x51c6c697,
+  0x23e8e8cb, 0x7cdddda1, 0x9c7474e8, 0x211f1f3e, 0xdd4b4b96, 0xdcbdbd61, 0x868b8b0d, 0x858a8a0f,
+  0x907070e0, 0x423e3e7c, 0xc4b5b571, 0xaa6666cc, 0xd8484890, 0x05030306, 0x01f6f6f7, 0x120e0e1c,
+  0xa36161c2, 0x5f35356a, 0xf95757ae, 0xd0b9b969, 0x91868617, 0x58c1c199, 0x271d1d3a, 0xb99e9e27,
+  0x38e1e1d9, 0x13f8f8eb, 0xb398982b, 0x33111122, 0xbb6969d2, 0x70d9d9a9, 0x898e8e07, 0xa7949433,
+  0xb69b9b2d, 0x221e1e3c, 0x92878715, 0x20e9e9c9, 0x49cece87, 0xff5555aa, 0x78282850, 0x7adfdfa5,
+  0x8f8c8c03, 0xf8a1a159, 0x80898909, 0x170d0d1a, 0xdabfbf65, 0x31e6e6d7, 0xc6424284, 0xb86868d0,
+  0xc3414182, 0xb0999929, 0x772d2d5a, 0x110f0f1e, 0xcbb0b07b, 0xfc5454a8, 0xd6bbbb6d, 0x3a16162c };
+
+#define ROTL8(x)  (((x) << 8) | ((x) >> 24))
+#define ROTL16(x) (((x) << 16) | ((x) >> 16))
+#define ROTL24(x) (((x) << 24) | ((x) >> 8))
+
+static uint32_t LoadWord(const uint8_t* p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void StoreWord(uint8_t* p, uint32_t w)
+{
+  p[0] = (uint8_t)(w);
+  p[1] = (uint8_t)(w >> 8);
+  p[2] = (uint8_t)(w >> 16);
+  p[3] = (uint8_t)(w >> 24);
+}
+
+// Table driven implementation of the cipher. Each state column is processed
+// as a single 32 bit word, with SubBytes, ShiftRows and MixColumns folded
+// into four table lookups per column.
+static void CipherTable(const uint8_t* RoundKey, uint8_t* block)
 {
-  uint8_t round = 0;
+  uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+  uint8_t round;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(state, 0);
-  
-  // There will be Nr rounds.
+  s0 = LoadWord(block +  0) ^ LoadWord(RoundKey +  0);
+  s1 = LoadWord(block +  4) ^ LoadWord(RoundKey +  4);
+  s2 = LoadWord(block +  8) ^ LoadWord(RoundKey +  8);
+  s3 = LoadWord(block + 12) ^ LoadWord(RoundKey + 12);
+
   // The first Nr-1 rounds are identical.
-  // These Nr-1 rounds are executed in the loop below.
   for(round = 1; round < Nr; ++round)
   {
-    SubBytes(state);
-    ShiftRows(state);
-    MixColumns(state);
-    AddRoundKey(state, round);
+    const uint8_t* rk = RoundKey + round * Nb * 4;
+    t0 = Te0[s0 & 0xff] ^ ROTL8(Te0[(s1 >> 8) & 0xff]) ^ ROTL16(Te0[(s2 >> 16) & 0xff]) ^ ROTL24(Te0[s3 >> 24]) ^ LoadWord(rk +  0);
+    t1 = Te0[s1 & 0xff] ^ ROTL8(Te0[(s2 >> 8) & 0xff]) ^ ROTL16(Te0[(s3 >> 16) & 0xff]) ^ ROTL24(Te0[s0 >> 24]) ^ LoadWord(rk +  4);
+    t2 = Te0[s2 & 0xff] ^ ROTL8(Te0[(s3 >> 8) & 0xff]) ^ ROTL16(Te0[(s0 >> 16) & 0xff]) ^ ROTL24(Te0[s1 >> 24]) ^ LoadWord(rk +  8);
+    t3 = Te0[s3 & 0xff] ^ ROTL8(Te0[(s0 >> 8) & 0xff]) ^ ROTL16(Te0[(s1 >> 16) & 0xff]) ^ ROTL24(Te0[s2 >> 24]) ^ LoadWord(rk + 12);
+    s0 = t0;
+    s1 = t1;
+    s2 = t2;
+    s3 = t3;
   }
-  
+
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  SubBytes(state);
-  ShiftRows(state);
-  AddRoundKey(state, Nr);
+  {
+    const uint8_t* rk = RoundKey + Nr * Nb * 4;
+    t0 = (uint32_t)sbox[s0 & 0xff] | ((uint32_t)sbox[(s1 >> 8) & 0xff] << 8) | ((uint32_t)sbox[(s2 >> 16) & 0xff] << 16) | ((uint32_t)sbox[s3 >> 24] << 24);
+    t1 = (uint32_t)sbox[s1 & 0xff] | ((uint32_t)sbox[(s2 >> 8) & 0xff] << 8) | ((uint32_t)sbox[(s3 >> 16) & 0xff] << 16) | ((uint32_t)sbox[s0 >> 24] << 24);
+    t2 = (uint32_t)sbox[s2 & 0xff] | ((uint32_t)sbox[(s3 >> 8) & 0xff] << 8) | ((uint32_t)sbox[(s0 >> 16) & 0xff] << 16) | ((uint32_t)sbox[s1 >> 24] << 24);
+    t3 = (uint32_t)sbox[s3 & 0xff] | ((uint32_t)sbox[(s0 >> 8) & 0xff] << 8) | ((uint32_t)sbox[(s1 >> 16) & 0xff] << 16) | ((uint32_t)sbox[s2 >> 24] << 24);
+    StoreWord(block +  0, t0 ^ LoadWord(rk +  0));
+    StoreWord(block +  4, t1 ^ LoadWord(rk +  4));
+    StoreWord(block +  8, t2 ^ LoadWord(rk +  8));
+    StoreWord(block + 12, t3 ^ LoadWord(rk + 12));
+  }
+}
+
+#if AESNI
+// Implementation of the cipher with the AES-NI instructions. The expanded
+// key has the byte layout expected by the instructions, so the round keys
+// can be loaded directly.
+__attribute__((target("aes,sse2")))
+static void CipherAesni(const uint8_t* RoundKey, uint8_t* block)
+{
+  uint8_t round;
+  __m128i m = _mm_loadu_si128((const __m128i*)block);
+
+  m = _mm_xor_si128(m, _mm_loadu_si128((const __m128i*)RoundKey));
+  for(round = 1; round < Nr; ++round)
+  {
+    m = _mm_aesenc_si128(m, _mm_loadu_si128((const __m128i*)(RoundKey + round * Nb * 4)));
+  }
+  m = _mm_aesenclast_si128(m, _mm_loadu_si128((const __m128i*)(RoundKey + Nr * Nb * 4)));
+
+  _mm_storeu_si128((__m128i*)block, m);
+}
+#endif
+
+// Cipher is the main function that encrypts the PlainText.
+// The hardware implementation is used when the processor supports it.
+static void Cipher(aes_state_t *state)
+{
+#if AESNI
+  if (state->features & DC_CPUFEATURE_AESNI)
+  {
+    CipherAesni(state->RoundKey, (uint8_t*)state->state);
+    return;
+  }
+#endif
+  CipherTable(state->RoundKey, (uint8_t*)state->state);
 }
 
 static void InvCipher(aes_state_t *state)
@@ -453,9 +518,10 @@ static void BlockCopy(uint8_t* output, uint8_t* input)
 #if defined(ECB) && ECB
 
 
-void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t* output)
+void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t* output, unsigned int features)
 {
   aes_state_t state;
+  state.features = features;
   // Copy input to output, and work in-memory on output
   BlockCopy(output, input);
   state.state = (state_t*)output;
@@ -467,9 +533,10 @@ void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t* output)
   Cipher(&state);
 }
 
-void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output)
+void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output, unsigned int features)
 {
   aes_state_t state;
+  state.features = features;
   // Copy input to output, and work in-memory on output
   BlockCopy(output, input);
   state.state = (state_t*)output;
@@ -481,6 +548,42 @@ void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output)
   InvCipher(&state);
 }
 
+void AES128_ECB_encrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, unsigned int features)
+{
+  uint32_t i;
+  aes_state_t state;
+  state.features = features;
+
+  // The key expansion is done only once for the entire buffer.
+  state.Key = key;
+  KeyExpansion(&state);
+
+  for(i = 0; i + KEYLEN <= length; i += KEYLEN)
+  {
+    memmove(output + i, input + i, KEYLEN);
+    state.state = (state_t*)(output + i);
+    Cipher(&state);
+  }
+}
+
+void AES128_ECB_decrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, unsigned int features)
+{
+  uint32_t i;
+  aes_state_t state;
+  state.features = features;
+
+  // The key expansion is done only once for the entire buffer.
+  state.Key = key;
+  KeyExpansion(&state);
+
+  for(i = 0; i + KEYLEN <= length; i += KEYLEN)
+  {
+    memmove(output + i, input + i, KEYLEN);
+    state.state = (state_t*)(output + i);
+    InvCipher(&state);
+  }
+}
+
 
 #endif // #if defined(ECB) && ECB
 
@@ -500,11 +603,12 @@ static void XorWithIv(aes_state_t *state, uint8_t* buf)
   }
 }
 
-void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv)
+void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv, unsigned int features)
 {
   intptr_t i;
   uint8_t remainders = length % KEYLEN; /* Remaining bytes in the last non-full block */
   aes_state_t state;
+  state.features = features;
 
   BlockCopy(output, input);
   state.state = (state_t*)output;
@@ -541,11 +645,12 @@ void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
   }
 }
 
-void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv)
+void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv, unsigned int features)
 {
   intptr_t i;
   uint8_t remainders = length % KEYLEN; /* Remaining bytes in the last non-full block */
   aes_state_t state;
+  state.features = features;
   
   BlockCopy(output, input);
   state.state = (state_t*)output;
@@ -587,3 +692,38 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 #endif // #if defined(CBC) && CBC
 
 
+
+#if defined(CFB) && CFB
+
+
+void AES128_CFB_decrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv, unsigned int features)
+{
+  uint32_t i, j;
+  uint8_t block[KEYLEN];
+  uint8_t feedback[KEYLEN];
+  aes_state_t state;
+  state.features = features;
+
+  state.Key = key;
+  KeyExpansion(&state);
+
+  memcpy(feedback, iv, KEYLEN);
+
+  for(i = 0; i + KEYLEN <= length; i += KEYLEN)
+  {
+    // Encrypt the previous ciphertext block (or the iv).
+    memcpy(block, feedback, KEYLEN);
+    state.state = (state_t*)block;
+    Cipher(&state);
+
+    // Save the ciphertext first, to support in-place decryption.
+    memcpy(feedback, input + i, KEYLEN);
+    for(j = 0; j < KEYLEN; ++j)
+    {
+      output[i + j] = feedback[j] ^ block[j];
+    }
+  }
+}
+
+
+#endif // #if defined(CFB) && CFB
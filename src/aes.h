@@ -13,6 +13,7 @@ typedef unsigned int  uint32_t;
 //
 // CBC enables AES128 encryption in CBC-mode of operation and handles 0-padding.
 // ECB enables the basic ECB 16-byte block algorithm. Both can be enabled simultaneously.
+// CFB enables AES128 decryption in CFB-mode of operation.
 
 // The #ifndef-guard allows it to be configured before #include'ing or at compile time.
 #ifndef CBC
@@ -23,23 +24,44 @@ typedef unsigned int  uint32_t;
   #define ECB 1
 #endif
 
+#ifndef CFB
+  #define CFB 1
+#endif
+
 
 
+// The features are the processor features (see dc_cpufeature_t) which
+// the cipher is allowed to use.
+
 #if defined(ECB) && ECB
 
-void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t *output);
-void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output);
+void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t *output, unsigned int features);
+void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output, unsigned int features);
+
+// Process an entire buffer with a single key expansion. The length must be
+// a multiple of 16 bytes, and the output may be the same as the input.
+void AES128_ECB_encrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, unsigned int features);
+void AES128_ECB_decrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, unsigned int features);
 
 #endif // #if defined(ECB) && ECB
 
 
 #if defined(CBC) && CBC
 
-void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
-void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv);
+void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv, unsigned int features);
+void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv, unsigned int features);
 
 #endif // #if defined(CBC) && CBC
 
 
+#if defined(CFB) && CFB
+
+// The length must be a multiple of 16 bytes, and the output may be the same
+// as the input.
+void AES128_CFB_decrypt_buffer(uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* key, const uint8_t* iv, unsigned int features);
+
+#endif // #if defined(CFB) && CFB
+
+
 
 #endif //_AES_H_
@@ -0,0 +1,317 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/archive.h>
+
+#include "context-private.h"
+#include "iterator-private.h"
+#include "mapping.h"
+#include "array.h"
+
+#define SZ_HEADER 16
+#define SZ_ENTRY  (32 + DC_ARCHIVE_MAXFINGERPRINT)
+
+#define FORMAT_VERSION 1
+
+/*
+ * File layout (all values are little endian):
+ *
+ *   header: magic (8 bytes), version (4 bytes), reserved (4 bytes)
+ *   entry:  family, model, serial, devtime, systime (8 bytes), size,
+ *           fingerprint size, fingerprint (32 bytes), followed by the
+ *           size bytes of dive data.
+ */
+static const unsigned char magic[8] = {'D', 'C', 'A', 'R', 'C', 'H', 'I', 'V'};
+
+struct dc_archive_t {
+	dc_context_t *context;
+	// Writing.
+	FILE *fp;
+	// Reading.
+	dc_mapping_t mapping;
+	size_t end;
+};
+
+typedef struct dc_archive_iterator_t {
+	dc_iterator_t base;
+	dc_archive_t *archive;
+	size_t offset;
+} dc_archive_iterator_t;
+
+static dc_status_t dc_archive_iterator_next (dc_iterator_t *iterator, void *item);
+
+static const dc_iterator_vtable_t dc_archive_iterator_vtable = {
+	sizeof(dc_archive_iterator_t),
+	dc_archive_iterator_next,
+	NULL,
+};
+
+static dc_archive_t *
+dc_archive_allocate (dc_context_t *context)
+{
+	dc_archive_t *archive = (dc_archive_t *) malloc (sizeof (dc_archive_t));
+	if (archive == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	archive->context = context;
+	archive->fp = NULL;
+	dc_mapping_init (&archive->mapping);
+	archive->end = 0;
+
+	return archive;
+}
+
+static int
+dc_archive_check_header (const unsigned char header[SZ_HEADER])
+{
+	return memcmp (header, magic, sizeof (magic)) == 0 &&
+		array_uint32_le (header + 8) == FORMAT_VERSION;
+}
+
+dc_status_t
+dc_archive_open (dc_archive_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_archive_t *archive = NULL;
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	archive = dc_archive_allocate (context);
+	if (archive == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	status = dc_mapping_open (&archive->mapping, context, filename);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (archive->mapping.size < SZ_HEADER || !dc_archive_check_header (archive->mapping.data)) {
+		ERROR (context, "Invalid archive header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_free;
+	}
+
+	// Find the end of the last valid entry.
+	size_t offset = SZ_HEADER;
+	while (offset + SZ_ENTRY <= archive->mapping.size) {
+		const unsigned char *p = archive->mapping.data + offset;
+		unsigned int size = array_uint32_le (p + 24);
+		unsigned int fsize = array_uint32_le (p + 28);
+		if (fsize > DC_ARCHIVE_MAXFINGERPRINT ||
+			size > archive->mapping.size - offset - SZ_ENTRY)
+			break;
+		offset += SZ_ENTRY + size;
+	}
+
+	if (offset != archive->mapping.size) {
+		WARNING (context, "Ignoring an incomplete or invalid entry at the end of the archive.");
+	}
+
+	archive->end = offset;
+
+	*out = archive;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_mapping_close (&archive->mapping);
+	free (archive);
+	return status;
+}
+
+dc_status_t
+dc_archive_create (dc_archive_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_archive_t *archive = NULL;
+	unsigned char header[SZ_HEADER] = {0};
+
+	if (out == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	archive = dc_archive_allocate (context);
+	if (archive == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Open the file for appending, and create it if necessary.
+	archive->fp = fopen (filename, "ab+");
+	if (archive->fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	if (fseek (archive->fp, 0, SEEK_END) != 0) {
+		ERROR (context, "Failed to seek the file.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	if (ftell (archive->fp) == 0) {
+		// Write the header of a new archive.
+		memcpy (header, magic, sizeof (magic));
+		array_uint32_le_set (header + 8, FORMAT_VERSION);
+		if (fwrite (header, sizeof (header), 1, archive->fp) != 1 ||
+			fflush (archive->fp) != 0) {
+			ERROR (context, "Failed to write the header.");
+			status = DC_STATUS_IO;
+			goto error_close;
+		}
+	} else {
+		// Verify the header of an existing archive.
+		if (fseek (archive->fp, 0, SEEK_SET) != 0 ||
+			fread (header, sizeof (header), 1, archive->fp) != 1) {
+			ERROR (context, "Failed to read the header.");
+			status = DC_STATUS_IO;
+			goto error_close;
+		}
+
+		if (!dc_archive_check_header (header)) {
+			ERROR (context, "Invalid archive header.");
+			status = DC_STATUS_DATAFORMAT;
+			goto error_close;
+		}
+	}
+
+	*out = archive;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	fclose (archive->fp);
+error_free:
+	free (archive);
+	return status;
+}
+
+dc_status_t
+dc_archive_append (dc_archive_t *archive, const dc_archive_entry_t *entry)
+{
+	unsigned char header[SZ_ENTRY] = {0};
+
+	if (archive == NULL || archive->fp == NULL || entry == NULL ||
+		(entry->data == NULL && entry->size) ||
+		(entry->fingerprint == NULL && entry->fsize) ||
+		entry->fsize > DC_ARCHIVE_MAXFINGERPRINT)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned long long systime = (unsigned long long) entry->systime;
+
+	array_uint32_le_set (header + 0, entry->family);
+	array_uint32_le_set (header + 4, entry->model);
+	array_uint32_le_set (header + 8, entry->serial);
+	array_uint32_le_set (header + 12, entry->devtime);
+	array_uint32_le_set (header + 16, systime & 0xFFFFFFFF);
+	array_uint32_le_set (header + 20, (systime >> 32) & 0xFFFFFFFF);
+	array_uint32_le_set (header + 24, entry->size);
+	array_uint32_le_set (header + 28, entry->fsize);
+	if (entry->fsize)
+		memcpy (header + 32, entry->fingerprint, entry->fsize);
+
+	if (fwrite (header, sizeof (header), 1, archive->fp) != 1 ||
+		(entry->size && fwrite (entry->data, entry->size, 1, archive->fp) != 1) ||
+		fflush (archive->fp) != 0) {
+		ERROR (archive->context, "Failed to write the entry.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_archive_iterator_new (dc_iterator_t **out, dc_archive_t *archive)
+{
+	dc_archive_iterator_t *iterator = NULL;
+
+	if (out == NULL || archive == NULL || archive->mapping.data == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	iterator = (dc_archive_iterator_t *) dc_iterator_allocate (archive->context, &dc_archive_iterator_vtable);
+	if (iterator == NULL) {
+		ERROR (archive->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	iterator->archive = archive;
+	iterator->offset = SZ_HEADER;
+
+	*out = (dc_iterator_t *) iterator;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_archive_iterator_next (dc_iterator_t *abstract, void *out)
+{
+	dc_archive_iterator_t *iterator = (dc_archive_iterator_t *) abstract;
+	const dc_archive_t *archive = iterator->archive;
+	dc_archive_entry_t *entry = (dc_archive_entry_t *) out;
+
+	if (iterator->offset >= archive->end)
+		return DC_STATUS_DONE;
+
+	// The entries were validated when the archive was opened.
+	const unsigned char *p = archive->mapping.data + iterator->offset;
+	unsigned long long systime =
+		array_uint32_le (p + 16) |
+		((unsigned long long) array_uint32_le (p + 20) << 32);
+
+	entry->family = (dc_family_t) array_uint32_le (p + 0);
+	entry->model = array_uint32_le (p + 4);
+	entry->serial = array_uint32_le (p + 8);
+	entry->devtime = array_uint32_le (p + 12);
+	entry->systime = (dc_ticks_t) systime;
+	entry->size = array_uint32_le (p + 24);
+	entry->fsize = array_uint32_le (p + 28);
+	entry->fingerprint = entry->fsize ? p + 32 : NULL;
+	entry->data = p + SZ_ENTRY;
+
+	iterator->offset += SZ_ENTRY + entry->size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_archive_close (dc_archive_t *archive)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (archive == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (archive->fp && fclose (archive->fp) != 0)
+		status = DC_STATUS_IO;
+
+	dc_mapping_close (&archive->mapping);
+	free (archive);
+
+	return status;
+}
@@ -23,31 +23,120 @@
 
 #include "array.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define USE_NEON
+#include <arm_neon.h>
+#endif
+
 void
 array_reverse_bytes (unsigned char data[], unsigned int size)
 {
-	for (unsigned int i = 0; i < size / 2; ++i) {
+	unsigned int i = 0, j = size;
+
+	// Swap the blocks of 16 bytes at both ends, reversing each block.
+#if defined(USE_SSE2)
+	for (; j - i >= 32; i += 16, j -= 16) {
+		__m128i a = _mm_loadu_si128 ((const __m128i *) (data + i));
+		__m128i b = _mm_loadu_si128 ((const __m128i *) (data + j - 16));
+		a = _mm_shuffle_epi32 (a, _MM_SHUFFLE (0, 1, 2, 3));
+		b = _mm_shuffle_epi32 (b, _MM_SHUFFLE (0, 1, 2, 3));
+		a = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (a, _MM_SHUFFLE (2, 3, 0, 1)), _MM_SHUFFLE (2, 3, 0, 1));
+		b = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (b, _MM_SHUFFLE (2, 3, 0, 1)), _MM_SHUFFLE (2, 3, 0, 1));
+		a = _mm_or_si128 (_mm_slli_epi16 (a, 8), _mm_srli_epi16 (a, 8));
+		b = _mm_or_si128 (_mm_slli_epi16 (b, 8), _mm_srli_epi16 (b, 8));
+		_mm_storeu_si128 ((__m128i *) (data + i), b);
+		_mm_storeu_si128 ((__m128i *) (data + j - 16), a);
+	}
+#elif defined(USE_NEON)
+	for (; j - i >= 32; i += 16, j -= 16) {
+		uint8x16_t a = vrev64q_u8 (vld1q_u8 (data + i));
+		uint8x16_t b = vrev64q_u8 (vld1q_u8 (data + j - 16));
+		vst1q_u8 (data + i, vcombine_u8 (vget_high_u8 (b), vget_low_u8 (b)));
+		vst1q_u8 (data + j - 16, vcombine_u8 (vget_high_u8 (a), vget_low_u8 (a)));
+	}
+#endif
+
+	// Reverse the remaining bytes in the middle.
+	while (j - i >= 2) {
+		j--;
 		unsigned char hlp = data[i];
-		data[i] = data[size - 1 - i];
-		data[size - 1 - i] = hlp;
+		data[i] = data[j];
+		data[j] = hlp;
+		i++;
 	}
 }
 
 
+static const unsigned char reverse_bits_table[256] = {
+	0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
+	0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+	0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8,
+	0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+	0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4,
+	0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+	0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec,
+	0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+	0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2,
+	0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+	0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea,
+	0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+	0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6,
+	0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+	0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee,
+	0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+	0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1,
+	0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+	0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9,
+	0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+	0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5,
+	0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+	0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed,
+	0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+	0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3,
+	0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+	0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb,
+	0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+	0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7,
+	0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+	0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef,
+	0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
+};
+
 void
 array_reverse_bits (unsigned char data[], unsigned int size)
 {
-	for (unsigned int i = 0; i < size; ++i) {
-		unsigned char j = 0;
-		j  = (data[i] & 0x01) << 7;
-		j += (data[i] & 0x02) << 5;
-		j += (data[i] & 0x04) << 3;
-		j += (data[i] & 0x08) << 1;
-		j += (data[i] & 0x10) >> 1;
-		j += (data[i] & 0x20) >> 3;
-		j += (data[i] & 0x40) >> 5;
-		j += (data[i] & 0x80) >> 7;
-		data[i] = j;
+	unsigned int i = 0;
+
+	// Swap the nibbles, the pairs and the single bits of 16 bytes at a
+	// time. The masks prevent any bits from crossing the byte boundaries.
+#if defined(USE_SSE2)
+	const __m128i m1 = _mm_set1_epi8 (0x55);
+	const __m128i m2 = _mm_set1_epi8 (0x33);
+	const __m128i m4 = _mm_set1_epi8 (0x0F);
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128 ((const __m128i *) (data + i));
+		x = _mm_or_si128 (_mm_and_si128 (_mm_srli_epi16 (x, 1), m1), _mm_slli_epi16 (_mm_and_si128 (x, m1), 1));
+		x = _mm_or_si128 (_mm_and_si128 (_mm_srli_epi16 (x, 2), m2), _mm_slli_epi16 (_mm_and_si128 (x, m2), 2));
+		x = _mm_or_si128 (_mm_and_si128 (_mm_srli_epi16 (x, 4), m4), _mm_slli_epi16 (_mm_and_si128 (x, m4), 4));
+		_mm_storeu_si128 ((__m128i *) (data + i), x);
+	}
+#elif defined(USE_NEON)
+	const uint8x16_t m1 = vdupq_n_u8 (0x55);
+	const uint8x16_t m2 = vdupq_n_u8 (0x33);
+	for (; i + 16 <= size; i += 16) {
+		uint8x16_t x = vld1q_u8 (data + i);
+		x = vorrq_u8 (vandq_u8 (vshrq_n_u8 (x, 1), m1), vshlq_n_u8 (vandq_u8 (x, m1), 1));
+		x = vorrq_u8 (vandq_u8 (vshrq_n_u8 (x, 2), m2), vshlq_n_u8 (vandq_u8 (x, m2), 2));
+		x = vorrq_u8 (vshrq_n_u8 (x, 4), vshlq_n_u8 (x, 4));
+		vst1q_u8 (data + i, x);
+	}
+#endif
+
+	for (; i < size; ++i) {
+		data[i] = reverse_bits_table[data[i]];
 	}
 }
 
@@ -55,7 +144,25 @@ array_reverse_bits (unsigned char data[], unsigned int size)
 int
 array_isequal (const unsigned char data[], unsigned int size, unsigned char value)
 {
-	for (unsigned int i = 0; i < size; ++i) {
+	unsigned int i = 0;
+
+#if defined(USE_SSE2)
+	const __m128i v = _mm_set1_epi8 ((char) value);
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_loadu_si128 ((const __m128i *) (data + i));
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (x, v)) != 0xFFFF)
+			return 0;
+	}
+#elif defined(USE_NEON)
+	const uint8x16_t v = vdupq_n_u8 (value);
+	for (; i + 16 <= size; i += 16) {
+		uint64x2_t eq = vreinterpretq_u64_u8 (vceqq_u8 (vld1q_u8 (data + i), v));
+		if ((vgetq_lane_u64 (eq, 0) & vgetq_lane_u64 (eq, 1)) != ~(uint64_t) 0)
+			return 0;
+	}
+#endif
+
+	for (; i < size; ++i) {
 		if (data[i] != value)
 			return 0;
 	}
@@ -64,15 +171,64 @@ array_isequal (const unsigned char data[], unsigned int size, unsigned char valu
 }
 
 
+/*
+ * Find the last occurrence of a byte value, scanning backwards 16 bytes
+ * at a time. The forward search uses memchr, which is already
+ * vectorized by the C library, but memrchr is not portable.
+ */
+static const unsigned char *
+array_search_last (const unsigned char *data, unsigned int size, unsigned char value)
+{
+#if defined(USE_SSE2)
+	const __m128i v = _mm_set1_epi8 ((char) value);
+	while (size >= 16) {
+		__m128i x = _mm_loadu_si128 ((const __m128i *) (data + size - 16));
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (x, v)) != 0)
+			break;
+		size -= 16;
+	}
+#elif defined(USE_NEON)
+	const uint8x16_t v = vdupq_n_u8 (value);
+	while (size >= 16) {
+		uint64x2_t eq = vreinterpretq_u64_u8 (vceqq_u8 (vld1q_u8 (data + size - 16), v));
+		if ((vgetq_lane_u64 (eq, 0) | vgetq_lane_u64 (eq, 1)) != 0)
+			break;
+		size -= 16;
+	}
+#endif
+
+	while (size > 0) {
+		size--;
+		if (data[size] == value)
+			return data + size;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * The marker searches only compare the full marker at the positions
+ * where its first (or last) byte matches, and skip over the rest of the
+ * data with a vectorized single byte search.
+ */
 const unsigned char *
 array_search_forward (const unsigned char *data, unsigned int size,
                       const unsigned char *marker, unsigned int msize)
 {
+	if (msize == 0)
+		return data;
+
 	while (size >= msize) {
-		if (memcmp (data, marker, msize) == 0)
-			return data;
-		size--;
-		data++;
+		const unsigned char *p = (const unsigned char *) memchr (data, marker[0], size - msize + 1);
+		if (p == NULL)
+			return NULL;
+
+		if (memcmp (p + 1, marker + 1, msize - 1) == 0)
+			return p;
+
+		size -= p + 1 - data;
+		data = p + 1;
 	}
 	return NULL;
 }
@@ -82,70 +238,104 @@ const unsigned char *
 array_search_backward (const unsigned char *data, unsigned int size,
                        const unsigned char *marker, unsigned int msize)
 {
-	data += size;
+	if (msize == 0)
+		return data + size;
+
 	while (size >= msize) {
-		if (memcmp (data - msize, marker, msize) == 0)
-			return data;
-		size--;
-		data--;
+		// Find the last possible end of the marker.
+		const unsigned char *p = array_search_last (data + msize - 1, size - msize + 1, marker[msize - 1]);
+		if (p == NULL)
+			return NULL;
+
+		if (memcmp (p - (msize - 1), marker, msize - 1) == 0)
+			return p + 1;
+
+		size = p - data;
 	}
 	return NULL;
 }
 
 
+/*
+ * Lookup table with the two hexadecimal digits of every byte, such that
+ * a byte is converted with a single lookup.
+ */
+#define HEXDIGIT(n) ((n) < 10 ? '0' + (n) : 'A' + (n) - 10)
+#define HEXPAIR(n) {HEXDIGIT ((n) >> 4), HEXDIGIT ((n) & 0x0F)}
+#define HEXROW(n) \
+	HEXPAIR ((n) + 0x0), HEXPAIR ((n) + 0x1), HEXPAIR ((n) + 0x2), HEXPAIR ((n) + 0x3), \
+	HEXPAIR ((n) + 0x4), HEXPAIR ((n) + 0x5), HEXPAIR ((n) + 0x6), HEXPAIR ((n) + 0x7), \
+	HEXPAIR ((n) + 0x8), HEXPAIR ((n) + 0x9), HEXPAIR ((n) + 0xA), HEXPAIR ((n) + 0xB), \
+	HEXPAIR ((n) + 0xC), HEXPAIR ((n) + 0xD), HEXPAIR ((n) + 0xE), HEXPAIR ((n) + 0xF)
+
+static const unsigned char bin2hex[256][2] = {
+	HEXROW (0x00), HEXROW (0x10), HEXROW (0x20), HEXROW (0x30),
+	HEXROW (0x40), HEXROW (0x50), HEXROW (0x60), HEXROW (0x70),
+	HEXROW (0x80), HEXROW (0x90), HEXROW (0xA0), HEXROW (0xB0),
+	HEXROW (0xC0), HEXROW (0xD0), HEXROW (0xE0), HEXROW (0xF0),
+};
+
 int
 array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize)
 {
 	if (osize != 2 * isize)
 		return -1;
 
-	const unsigned char ascii[] = {
-		'0', '1', '2', '3', '4', '5', '6', '7',
-		'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
-
 	for (unsigned int i = 0; i < isize; ++i) {
-		// Set the most-significant nibble.
-		unsigned char msn = (input[i] >> 4) & 0x0F;
-		output[i * 2 + 0] = ascii[msn];
-
-		// Set the least-significant nibble.
-		unsigned char lsn = input[i] & 0x0F;
-		output[i * 2 + 1] = ascii[lsn];
+		const unsigned char *pair = bin2hex[input[i]];
+		output[i * 2 + 0] = pair[0];
+		output[i * 2 + 1] = pair[1];
 	}
 
 	return 0;
 }
 
 
+/*
+ * Lookup table for the hexadecimal digits. Invalid characters have the
+ * most significant bit set, which allows to check the entire input at
+ * once, instead of branching on every single character.
+ */
+static const unsigned char hex2bin[256] = {
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
+};
+
 int
 array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize)
 {
 	if (isize != 2 * osize)
 		return -1;
 
+	unsigned char invalid = 0;
 	for (unsigned int i = 0; i < osize; ++i) {
-		unsigned char value = 0;
-		for (unsigned int j = 0; j < 2; ++j) {
-			unsigned char number = 0;
-			unsigned char ascii = input[i * 2 + j];
-			if (ascii >= '0' && ascii <= '9')
-				number = ascii - '0';
-			else if (ascii >= 'A' && ascii <= 'F')
-				number = 10 + ascii - 'A';
-			else if (ascii >= 'a' && ascii <= 'f')
-				number = 10 + ascii - 'a';
-			else
-				return -1; /* Invalid character */
-
-			value <<= 4;
-			value += number;
-		}
-		output[i] = value;
+		unsigned char msn = hex2bin[input[i * 2 + 0]];
+		unsigned char lsn = hex2bin[input[i * 2 + 1]];
+		invalid |= msn | lsn;
+		output[i] = (msn << 4) | (lsn & 0x0F);
 	}
 
+	if (invalid & 0x80)
+		return -1; /* Invalid character */
+
 	return 0;
 }
 
+
 unsigned int
 array_convert_str2num (const unsigned char data[], unsigned int size)
 {
@@ -160,96 +350,6 @@ array_convert_str2num (const unsigned char data[], unsigned int size)
 	return value;
 }
 
-unsigned int
-array_uint_be (const unsigned char data[], unsigned int n)
-{
-	unsigned int shift = n * 8;
-	unsigned int value = 0;
-	for (unsigned int i = 0; i < n; ++i) {
-		shift -= 8;
-		value |= data[i] << shift;
-	}
-	return value;
-}
-
-unsigned int
-array_uint_le (const unsigned char data[], unsigned int n)
-{
-	unsigned int shift = 0;
-	unsigned int value = 0;
-	for (unsigned int i = 0; i < n; ++i) {
-		value |= data[i] << shift;
-		shift += 8;
-	}
-	return value;
-}
-
-unsigned int
-array_uint32_be (const unsigned char data[])
-{
-	return (data[0] << 24) + (data[1] << 16) + (data[2] << 8) + data[3];
-}
-
-
-unsigned int
-array_uint32_le (const unsigned char data[])
-{
-	return data[0] + (data[1] << 8) + (data[2] << 16) + (data[3] << 24);
-}
-
-
-unsigned int
-array_uint32_word_be (const unsigned char data[])
-{
-	return data[1] + (data[0] << 8) + (data[3] << 16) + (data[2] << 24);
-}
-
-
-void
-array_uint32_le_set (unsigned char data[], const unsigned int input)
-{
-	data[0] = input & 0xFF;
-	data[1] = (input >>  8) & 0xFF;
-	data[2] = (input >> 16) & 0xFF;
-	data[3] = (input >> 24) & 0xFF;
-}
-
-
-unsigned int
-array_uint24_be (const unsigned char data[])
-{
-	return (data[0] << 16) + (data[1] << 8) + data[2];
-}
-
-
-void
-array_uint24_be_set (unsigned char data[], const unsigned int input)
-{
-	data[0] = (input >> 16) & 0xFF;
-	data[1] = (input >>  8) & 0xFF;
-	data[2] = input & 0xFF;
-}
-
-
-unsigned int
-array_uint24_le (const unsigned char data[])
-{
-	return data[0] + (data[1] << 8) + (data[2] << 16);
-}
-
-unsigned short
-array_uint16_be (const unsigned char data[])
-{
-	return (data[0] << 8) + data[1];
-}
-
-
-unsigned short
-array_uint16_le (const unsigned char data[])
-{
-	return data[0] + (data[1] << 8);
-}
-
 unsigned char
 bcd2dec (unsigned char value)
 {
@@ -52,38 +52,112 @@ array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned
 unsigned int
 array_convert_str2num (const unsigned char data[], unsigned int size);
 
-unsigned int
-array_uint_be (const unsigned char data[], unsigned int n);
+/*
+ * The fixed width readers are defined inline, because the parsers call
+ * them from their innermost loops. Compilers recognize the shift and or
+ * pattern, and emit a single unaligned load (plus a byte swap for the
+ * non-native byte order) when the target allows it.
+ */
 
-unsigned int
-array_uint_le (const unsigned char data[], unsigned int n);
+static inline unsigned int
+array_uint32_be (const unsigned char data[])
+{
+	return ((unsigned int) data[0] << 24) | ((unsigned int) data[1] << 16) | ((unsigned int) data[2] << 8) | data[3];
+}
 
-unsigned int
-array_uint32_be (const unsigned char data[]);
+static inline unsigned int
+array_uint32_le (const unsigned char data[])
+{
+	return data[0] | ((unsigned int) data[1] << 8) | ((unsigned int) data[2] << 16) | ((unsigned int) data[3] << 24);
+}
 
-unsigned int
-array_uint32_le (const unsigned char data[]);
+static inline unsigned int
+array_uint32_word_be (const unsigned char data[])
+{
+	return data[1] | ((unsigned int) data[0] << 8) | ((unsigned int) data[3] << 16) | ((unsigned int) data[2] << 24);
+}
 
-unsigned int
-array_uint32_word_be (const unsigned char data[]);
+static inline void
+array_uint32_le_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = input & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+	data[2] = (input >> 16) & 0xFF;
+	data[3] = (input >> 24) & 0xFF;
+}
 
-void
-array_uint32_le_set (unsigned char data[], const unsigned int input);
+static inline unsigned int
+array_uint24_be (const unsigned char data[])
+{
+	return ((unsigned int) data[0] << 16) | ((unsigned int) data[1] << 8) | data[2];
+}
 
-unsigned int
-array_uint24_be (const unsigned char data[]);
+static inline void
+array_uint24_be_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = (input >> 16) & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+	data[2] = input & 0xFF;
+}
 
-void
-array_uint24_be_set (unsigned char data[], const unsigned int input);
+static inline unsigned int
+array_uint24_le (const unsigned char data[])
+{
+	return data[0] | ((unsigned int) data[1] << 8) | ((unsigned int) data[2] << 16);
+}
 
-unsigned int
-array_uint24_le (const unsigned char data[]);
+static inline unsigned short
+array_uint16_be (const unsigned char data[])
+{
+	return (data[0] << 8) | data[1];
+}
 
-unsigned short
-array_uint16_be (const unsigned char data[]);
+static inline unsigned short
+array_uint16_le (const unsigned char data[])
+{
+	return data[0] | (data[1] << 8);
+}
 
-unsigned short
-array_uint16_le (const unsigned char data[]);
+/*
+ * The variable width readers dispatch to the fixed width ones. With a
+ * constant width, or a width that only takes a few values, the switch
+ * is resolved or reduced to a jump table by the compiler. Widths above
+ * four bytes keep the four least significant bytes.
+ */
+
+static inline unsigned int
+array_uint_be (const unsigned char data[], unsigned int n)
+{
+	switch (n) {
+	case 0:
+		return 0;
+	case 1:
+		return data[0];
+	case 2:
+		return array_uint16_be (data);
+	case 3:
+		return array_uint24_be (data);
+	default:
+		return array_uint32_be (data + n - 4);
+	}
+}
+
+static inline unsigned int
+array_uint_le (const unsigned char data[], unsigned int n)
+{
+	switch (n) {
+	case 0:
+		return 0;
+	case 1:
+		return data[0];
+	case 2:
+		return array_uint16_le (data);
+	case 3:
+		return array_uint24_le (data);
+	default:
+		return array_uint32_le (data);
+	}
+}
 
 unsigned char
 bcd2dec (unsigned char value);
@@ -38,6 +38,7 @@
 #include "device-private.h"
 #include "checksum.h"
 #include "array.h"
+#include "timer.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &atomics_cobalt_device_vtable)
 
@@ -51,6 +52,13 @@
 
 #define SZ_MEMORY (29 * 64 * 1024)
 #define SZ_VERSION 14
+#define SZ_PACKET (8 * 1024)
+
+// Maximum size of a dive, including the two checksum bytes, rounded up
+// to a whole number of packets.
+#define SZ_MAXDIVE (SZ_MEMORY + SZ_PACKET)
+
+#define NTRANSFERS 4
 
 typedef struct atomics_cobalt_device_t {
 	dc_device_t base;
@@ -235,6 +243,7 @@ atomics_cobalt_device_version (dc_device_t *abstract, unsigned char data[], unsi
 	unsigned short crc = array_uint16_le (packet + SZ_VERSION);
 	unsigned short ccrc = checksum_add_uint16 (packet, SZ_VERSION, 0x0);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -248,6 +257,23 @@ atomics_cobalt_device_version (dc_device_t *abstract, unsigned char data[], unsi
 }
 
 
+#ifdef HAVE_LIBUSB
+enum {
+	TRANSFER_PENDING = 0,
+	TRANSFER_COMPLETE = 1,
+	TRANSFER_IDLE = 2,
+};
+
+static void LIBUSB_CALL
+atomics_cobalt_transfer_cb (struct libusb_transfer *transfer)
+{
+	int *state = (int *) transfer->user_data;
+
+	*state = TRANSFER_COMPLETE;
+}
+#endif
+
+
 static dc_status_t
 atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init, dc_event_progress_t *progress)
 {
@@ -279,19 +305,110 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 
 	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", &bRequest, 1);
 
-	unsigned int nbytes = 0;
+	// Presize the buffer, so the bulk transfers can store the data in place.
+	if (!dc_buffer_resize (buffer, SZ_MAXDIVE)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+
+	dc_timer_t *timer = NULL;
+	dc_status_t status = dc_timer_new (&timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create a high resolution timer.");
+		return status;
+	}
+
+	struct libusb_transfer *transfers[NTRANSFERS] = {NULL};
+	int state[NTRANSFERS];
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		state[i] = TRANSFER_IDLE;
+		transfers[i] = libusb_alloc_transfer (0);
+		if (transfers[i] == NULL) {
+			ERROR (abstract->context, "Failed to allocate the usb transfers.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+	}
+
+	// Keep several bulk transfers queued, each one receiving the next
+	// packet directly into its own slot of the buffer. The answer ends
+	// with the first packet that is shorter than requested.
+	unsigned int nbytes = 0, nreported = 0;
+	unsigned int nsubmitted = 0, ncompleted = 0;
+	int report = -1;
 	while (1) {
-		// Receive the answer from the dive computer.
-		int length = 0;
-		unsigned char packet[8 * 1024] = {0};
-		rc = libusb_bulk_transfer (device->handle, 0x82,
-			packet, sizeof (packet), &length, TIMEOUT);
-		if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_TIMEOUT) {
+		while (nsubmitted < SZ_MAXDIVE / SZ_PACKET && nsubmitted - ncompleted < NTRANSFERS) {
+			unsigned int idx = nsubmitted % NTRANSFERS;
+			libusb_fill_bulk_transfer (transfers[idx], device->handle, 0x82,
+				data + nsubmitted * SZ_PACKET, SZ_PACKET,
+				atomics_cobalt_transfer_cb, &state[idx], 0);
+			state[idx] = TRANSFER_PENDING;
+			rc = libusb_submit_transfer (transfers[idx]);
+			if (rc != LIBUSB_SUCCESS) {
+				ERROR (abstract->context, "Failed to submit the usb transfer.");
+				state[idx] = TRANSFER_IDLE;
+				status = EXITCODE(rc);
+				goto error_cancel;
+			}
+			nsubmitted++;
+		}
+
+		if (ncompleted == nsubmitted) {
+			ERROR (abstract->context, "Dive exceeds the memory size.");
+			status = DC_STATUS_PROTOCOL;
+			goto error_cancel;
+		}
+
+		// Wait for the oldest transfer to complete. The timeout applies
+		// to this transfer only, because the queued transfers can't
+		// receive any data before it is finished.
+		unsigned int idx = ncompleted % NTRANSFERS;
+		struct libusb_transfer *transfer = transfers[idx];
+		dc_usecs_t now = 0, deadline = 0;
+		dc_timer_now (timer, &now);
+		deadline = now + (dc_usecs_t) TIMEOUT * 1000;
+		int expired = 0;
+		while (state[idx] == TRANSFER_PENDING) {
+			if (!expired) {
+				dc_timer_now (timer, &now);
+				if (now >= deadline) {
+					libusb_cancel_transfer (transfer);
+					expired = 1;
+				}
+			}
+
+			if (expired) {
+				rc = libusb_handle_events_completed (device->context, &state[idx]);
+			} else {
+				struct timeval tv;
+				tv.tv_sec = (deadline - now) / 1000000;
+				tv.tv_usec = (deadline - now) % 1000000;
+				rc = libusb_handle_events_timeout_completed (device->context, &tv, &state[idx]);
+			}
+			if (rc != LIBUSB_SUCCESS) {
+				ERROR (abstract->context, "Failed to handle the usb events.");
+				status = EXITCODE(rc);
+				goto error_cancel;
+			}
+		}
+
+		state[idx] = TRANSFER_IDLE;
+		ncompleted++;
+
+		// A timeout is not an error, but the end of the answer.
+		if (transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+			transfer->status != LIBUSB_TRANSFER_TIMED_OUT &&
+			!(expired && transfer->status == LIBUSB_TRANSFER_CANCELLED)) {
 			ERROR (abstract->context, "Failed to receive the answer.");
-			return EXITCODE(rc);
+			status = DC_STATUS_IO;
+			goto error_cancel;
 		}
 
-		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", packet, length);
+		unsigned int length = transfer->actual_length;
+
+		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", data + nbytes, length);
 
 		// Update and emit a progress event.
 		if (progress) {
@@ -299,20 +416,54 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 		}
 
-		// Append the packet to the output buffer.
-		dc_buffer_append (buffer, packet, length);
 		nbytes += length;
 
+		// Report the new data as soon as the fingerprint shows that the
+		// dive is not known yet. The last two bytes are held back, because
+		// they are the checksum if the answer ends here. The total size is
+		// only known at the end.
+		if (report < 0 && nbytes >= FP_OFFSET + sizeof (device->fingerprint) + 2)
+			report = memcmp (data + FP_OFFSET, device->fingerprint, sizeof (device->fingerprint)) != 0;
+		if (report > 0 && nbytes - 2 > nreported) {
+			dc_event_divedata_t divedata;
+			divedata.data = data + nreported;
+			divedata.size = nbytes - 2 - nreported;
+			divedata.offset = nreported;
+			divedata.total = 0;
+			device_event_emit (abstract, DC_EVENT_DIVEDATA, &divedata);
+			nreported = nbytes - 2;
+		}
+
 		// If we received fewer bytes than requested, the transfer is finished.
-		if (length < sizeof (packet))
+		if (length < SZ_PACKET)
 			break;
 	}
 
-	// Check for a buffer error.
-	if (dc_buffer_get_size (buffer) != nbytes) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		return DC_STATUS_NOMEMORY;
+error_cancel:
+	// Cancel the remaining transfers, and wait for their completion.
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		if (state[i] == TRANSFER_PENDING)
+			libusb_cancel_transfer (transfers[i]);
+	}
+
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		while (state[i] == TRANSFER_PENDING) {
+			if (libusb_handle_events_completed (device->context, &state[i]) != LIBUSB_SUCCESS)
+				break;
+		}
 	}
+error_free:
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		// A transfer that is still owned by libusb can't be freed.
+		if (state[i] != TRANSFER_PENDING)
+			libusb_free_transfer (transfers[i]);
+	}
+	dc_timer_free (timer);
+
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	dc_buffer_slice (buffer, 0, nbytes);
 
 	// Check for the minimum length.
 	if (nbytes < 2) {
@@ -321,7 +472,6 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 	}
 
 	// When only two 0xFF bytes are received, there are no more dives.
-	unsigned char *data = dc_buffer_get_data (buffer);
 	if (nbytes == 2 && data[0] == 0xFF && data[1] == 0xFF) {
 		dc_buffer_clear (buffer);
 		return DC_STATUS_SUCCESS;
@@ -331,6 +481,7 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 	unsigned short crc = array_uint16_le (data + nbytes - 2);
 	unsigned short ccrc = checksum_add_uint16 (data, nbytes - 2, 0x0);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -374,7 +525,7 @@ atomics_cobalt_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Allocate a memory buffer.
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
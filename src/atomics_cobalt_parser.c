@@ -43,17 +43,38 @@
 
 typedef struct atomics_cobalt_parser_t atomics_cobalt_parser_t;
 
+typedef struct atomics_cobalt_state_t {
+	unsigned int interval;
+	unsigned int ngasmixes;
+	unsigned int tank;
+	double atmospheric;
+	unsigned int time;
+	unsigned int in_deco;
+	unsigned int gasmix_previous;
+} atomics_cobalt_state_t;
+
 struct atomics_cobalt_parser_t {
 	dc_parser_t base;
 	// Depth calibration.
 	double atmospheric;
 	double hydrostatic;
+	// Incremental sample parsing.
+	dc_buffer_t *header;
+	unsigned int headersize;
+	unsigned int nsegments;
+	unsigned int nbytes;
+	unsigned char segment[SZ_SEGMENT];
+	unsigned int length;
+	dc_status_t status;
+	atomics_cobalt_state_t state;
 };
 
 static dc_status_t atomics_cobalt_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t atomics_cobalt_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t atomics_cobalt_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t atomics_cobalt_parser_samples_feed (dc_parser_t *abstract, const unsigned char data[], unsigned int size, dc_sample_callback_t callback, void *userdata);
+static dc_status_t atomics_cobalt_parser_destroy (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t atomics_cobalt_parser_vtable = {
 	sizeof(atomics_cobalt_parser_t),
@@ -62,7 +83,10 @@ static const dc_parser_vtable_t atomics_cobalt_parser_vtable = {
 	atomics_cobalt_parser_get_datetime, /* datetime */
 	atomics_cobalt_parser_get_field, /* fields */
 	atomics_cobalt_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	atomics_cobalt_parser_samples_feed, /* samples_feed */
+	atomics_cobalt_parser_destroy /* destroy */
 };
 
 
@@ -84,6 +108,12 @@ atomics_cobalt_parser_create (dc_parser_t **out, dc_context_t *context)
 	// Set the default values.
 	parser->atmospheric = 0.0;
 	parser->hydrostatic = 1025.0 * GRAVITY;
+	parser->header = NULL;
+	parser->headersize = 0;
+	parser->nsegments = 0;
+	parser->nbytes = 0;
+	parser->length = 0;
+	parser->status = DC_STATUS_SUCCESS;
 
 	*out = (dc_parser_t*) parser;
 
@@ -91,9 +121,37 @@ atomics_cobalt_parser_create (dc_parser_t **out, dc_context_t *context)
 }
 
 
+static dc_status_t
+atomics_cobalt_parser_destroy (dc_parser_t *abstract)
+{
+	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
+
+	dc_buffer_free (parser->header);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+atomics_cobalt_parser_reset (atomics_cobalt_parser_t *parser)
+{
+	dc_buffer_clear (parser->header);
+	parser->headersize = 0;
+	parser->nsegments = 0;
+	parser->nbytes = 0;
+	parser->length = 0;
+	parser->status = DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 atomics_cobalt_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
+	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
+
+	// Start a new dive for the incremental sample parsing.
+	atomics_cobalt_parser_reset (parser);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -109,6 +167,8 @@ atomics_cobalt_parser_set_calibration (dc_parser_t *abstract, double atmospheric
 	parser->atmospheric = atmospheric;
 	parser->hydrostatic = hydrostatic;
 
+	dc_parser_invalidate_summary (abstract);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -252,130 +312,238 @@ atomics_cobalt_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 }
 
 
-static dc_status_t
-atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+static unsigned int
+atomics_cobalt_parser_headersize (const unsigned char data[])
 {
-	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
-
-	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
-
-	if (size < SZ_HEADER)
-		return DC_STATUS_DATAFORMAT;
-
-	unsigned int interval = data[0x1a];
 	unsigned int ngasmixes = data[0x2a];
 	unsigned int nswitches = data[0x2b];
-	unsigned int nsegments = array_uint16_le (data + 0x50);
 
-	unsigned int header = SZ_HEADER + SZ_GASMIX * ngasmixes +
-		SZ_GASSWITCH * nswitches;
+	return SZ_HEADER + SZ_GASMIX * ngasmixes + SZ_GASSWITCH * nswitches;
+}
 
-	if (size < header + SZ_SEGMENT * nsegments)
-		return DC_STATUS_DATAFORMAT;
 
-	double atmospheric = 0.0;
+static dc_status_t
+atomics_cobalt_parser_init (atomics_cobalt_parser_t *parser, const unsigned char data[], atomics_cobalt_state_t *state)
+{
+	state->interval = data[0x1a];
+	state->ngasmixes = data[0x2a];
+
 	if (parser->atmospheric)
-		atmospheric = parser->atmospheric;
+		state->atmospheric = parser->atmospheric;
 	else
-		atmospheric = array_uint16_le (data + 0x26) * BAR / 1000.0;
+		state->atmospheric = array_uint16_le (data + 0x26) * BAR / 1000.0;
 
 	// Previous gas mix - initialize with impossible value
-	unsigned int gasmix_previous = 0xFFFFFFFF;
+	state->gasmix_previous = 0xFFFFFFFF;
 
 	// Get the primary tank.
-	unsigned int tank = 0;
-	while (tank < ngasmixes) {
-		unsigned int sensor = array_uint16_le(data + SZ_HEADER + SZ_GASMIX * tank + 12);
+	state->tank = 0;
+	while (state->tank < state->ngasmixes) {
+		unsigned int sensor = array_uint16_le(data + SZ_HEADER + SZ_GASMIX * state->tank + 12);
 		if (sensor == 1)
 			break;
-		tank++;
+		state->tank++;
 	}
-	if (tank >= ngasmixes) {
-		ERROR (abstract->context, "Invalid primary tank index.");
+	if (state->tank >= state->ngasmixes) {
+		ERROR (parser->base.context, "Invalid primary tank index.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	unsigned int time = 0;
-	unsigned int in_deco = 0;
-	unsigned int offset = header;
-	while (offset + SZ_SEGMENT <= size) {
-		dc_sample_value_t sample = {0};
-
-		// Time (seconds).
-		time += interval;
-		sample.time = time;
-		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
-
-		// Depth (1/1000 bar).
-		unsigned int depth = array_uint16_le (data + offset + 0);
-		sample.depth = (depth * BAR / 1000.0 - atmospheric) / parser->hydrostatic;
-		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
-		// Pressure (1 psi).
-		unsigned int pressure = array_uint16_le (data + offset + 2);
-		sample.pressure.tank = tank;
-		sample.pressure.value = pressure * PSI / BAR;
-		if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
-
-		// Current gas mix
-		unsigned int gasmix = data[offset + 4];
-		if (gasmix != gasmix_previous) {
-			unsigned int idx = 0;
-			while (idx < ngasmixes) {
-				if (data[SZ_HEADER + SZ_GASMIX * idx + 0] == gasmix)
-					break;
-				idx++;
-			}
-			if (idx >= ngasmixes) {
-				ERROR (abstract->context, "Invalid gas mix index.");
-				return DC_STATUS_DATAFORMAT;
-			}
-			sample.gasmix = idx;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-			gasmix_previous = gasmix;
-		}
+	state->time = 0;
+	state->in_deco = 0;
 
-		// Temperature (1 °F).
-		unsigned int temperature = data[offset + 8];
-		sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-
-		// violation status
-		sample.event.type = 0;
-		sample.event.time = 0;
-		sample.event.value = 0;
-		sample.event.flags = 0;
-		unsigned int violation = data[offset + 11];
-		if (violation & 0x01) {
-			sample.event.type = SAMPLE_EVENT_ASCENT;
-			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
-		}
-		if (violation & 0x04) {
-			sample.event.type = SAMPLE_EVENT_CEILING;
-			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+atomics_cobalt_parser_segment (atomics_cobalt_parser_t *parser, atomics_cobalt_state_t *state, const unsigned char data[], const unsigned char segment[], dc_sample_callback_t callback, void *userdata)
+{
+	dc_sample_value_t sample = {0};
+
+	// Time (seconds).
+	state->time += state->interval;
+	sample.time = state->time;
+	if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+	// Depth (1/1000 bar).
+	unsigned int depth = array_uint16_le (segment + 0);
+	sample.depth = (depth * BAR / 1000.0 - state->atmospheric) / parser->hydrostatic;
+	if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+	// Pressure (1 psi).
+	unsigned int pressure = array_uint16_le (segment + 2);
+	sample.pressure.tank = state->tank;
+	sample.pressure.value = pressure * PSI / BAR;
+	if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+
+	// Current gas mix
+	unsigned int gasmix = segment[4];
+	if (gasmix != state->gasmix_previous) {
+		unsigned int idx = 0;
+		while (idx < state->ngasmixes) {
+			if (data[SZ_HEADER + SZ_GASMIX * idx + 0] == gasmix)
+				break;
+			idx++;
 		}
-		if (violation & 0x08) {
-			sample.event.type = SAMPLE_EVENT_PO2;
-			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+		if (idx >= state->ngasmixes) {
+			ERROR (parser->base.context, "Invalid gas mix index.");
+			return DC_STATUS_DATAFORMAT;
 		}
+		sample.gasmix = idx;
+		if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+		state->gasmix_previous = gasmix;
+	}
+
+	// Temperature (1 °F).
+	unsigned int temperature = segment[8];
+	sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
+	if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+
+	// violation status
+	sample.event.type = 0;
+	sample.event.time = 0;
+	sample.event.value = 0;
+	sample.event.flags = 0;
+	unsigned int violation = segment[11];
+	if (violation & 0x01) {
+		sample.event.type = SAMPLE_EVENT_ASCENT;
+		if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+	}
+	if (violation & 0x04) {
+		sample.event.type = SAMPLE_EVENT_CEILING;
+		if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+	}
+	if (violation & 0x08) {
+		sample.event.type = SAMPLE_EVENT_PO2;
+		if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+	}
+
+	// NDL & deco
+	unsigned int ndl = segment[5] * 60;
+	if (ndl > 0)
+		state->in_deco = 0;
+	else if (ndl == 0 && (violation & 0x02))
+		state->in_deco = 1;
+	if (state->in_deco)
+		sample.deco.type = DC_DECO_DECOSTOP;
+	else
+		sample.deco.type = DC_DECO_NDL;
+	sample.deco.time = ndl;
+	sample.deco.depth = 0.0;
+	if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
+	atomics_cobalt_state_t state;
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (size < SZ_HEADER)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned int nsegments = array_uint16_le (data + 0x50);
+	unsigned int header = atomics_cobalt_parser_headersize (data);
 
-		// NDL & deco
-		unsigned int ndl = data[offset + 5] * 60;
-		if (ndl > 0)
-			in_deco = 0;
-		else if (ndl == 0 && (violation & 0x02))
-			in_deco = 1;
-		if (in_deco)
-			sample.deco.type = DC_DECO_DECOSTOP;
-		else
-			sample.deco.type = DC_DECO_NDL;
-		sample.deco.time = ndl;
-		sample.deco.depth = 0.0;
-		if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+	if (size < header + SZ_SEGMENT * nsegments)
+		return DC_STATUS_DATAFORMAT;
+
+	dc_status_t status = atomics_cobalt_parser_init (parser, data, &state);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	unsigned int offset = header;
+	while (offset + SZ_SEGMENT <= size) {
+		status = atomics_cobalt_parser_segment (parser, &state, data, data + offset, callback, userdata);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
 
 		offset += SZ_SEGMENT;
 	}
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+/*
+ * The header (with the gas mixes and gas switches) is collected first,
+ * and kept for the gas mix lookups. After the header, each segment is
+ * reported as soon as it is complete, and only the bytes of an
+ * unfinished segment are kept. The size checks of samples_foreach need
+ * the size of the entire dive, and are done at the end.
+ */
+static dc_status_t
+atomics_cobalt_parser_samples_feed (dc_parser_t *abstract, const unsigned char data[], unsigned int size, dc_sample_callback_t callback, void *userdata)
+{
+	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser->header == NULL) {
+		parser->header = dc_buffer_new2 (abstract->context, SZ_HEADER);
+		if (parser->header == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	unsigned int offset = 0;
+	while (parser->status == DC_STATUS_SUCCESS && offset < size) {
+		if (!parser->headersize) {
+			// Collect the fixed part of the header first, and then the
+			// gas mixes and gas switches.
+			unsigned int current = dc_buffer_get_size (parser->header);
+			unsigned int needed = current < SZ_HEADER ? SZ_HEADER :
+				atomics_cobalt_parser_headersize (dc_buffer_get_data (parser->header));
+			unsigned int len = needed - current;
+			if (len > size - offset)
+				len = size - offset;
+			if (!dc_buffer_append (parser->header, data + offset, len)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				return DC_STATUS_NOMEMORY;
+			}
+			offset += len;
+
+			const unsigned char *header = dc_buffer_get_data (parser->header);
+			current = dc_buffer_get_size (parser->header);
+			if (current < SZ_HEADER || current < atomics_cobalt_parser_headersize (header))
+				continue;
+
+			parser->headersize = current;
+			parser->nsegments = array_uint16_le (header + 0x50);
+			parser->status = atomics_cobalt_parser_init (parser, header, &parser->state);
+		} else {
+			unsigned int len = SZ_SEGMENT - parser->length;
+			if (len > size - offset)
+				len = size - offset;
+			memcpy (parser->segment + parser->length, data + offset, len);
+			parser->length += len;
+			offset += len;
+
+			if (parser->length < SZ_SEGMENT)
+				continue;
+
+			parser->status = atomics_cobalt_parser_segment (parser, &parser->state,
+				dc_buffer_get_data (parser->header), parser->segment, callback, userdata);
+			parser->length = 0;
+			parser->nbytes += SZ_SEGMENT;
+		}
+	}
+
+	status = parser->status;
+
+	if (size == 0) {
+		if (status == DC_STATUS_SUCCESS &&
+			(!parser->headersize || parser->nbytes + parser->length < SZ_SEGMENT * parser->nsegments))
+			status = DC_STATUS_DATAFORMAT;
+		atomics_cobalt_parser_reset (parser);
+	}
+
+	return status;
+}
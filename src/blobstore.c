@@ -0,0 +1,474 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/blobstore.h>
+
+#include "context-private.h"
+#include "mapping.h"
+#include "array.h"
+
+#define MINSLOTS 64
+
+#define SZ_HEADER 16
+#define SZ_ENTRY  24
+
+#define FORMAT_VERSION 1
+
+#define FLAG_SUMMARY 0x01
+
+/*
+ * File layout (all values are little endian):
+ *
+ *   header: magic (8 bytes), version (4 bytes), reserved (4 bytes)
+ *   entry:  hash (8 bytes), size, fingerprint size, summary size,
+ *           flags, followed by the fingerprint, the dive data and the
+ *           summary.
+ */
+static const unsigned char magic[8] = {'D', 'C', 'B', 'L', 'O', 'B', 'S', 'T'};
+
+typedef struct dc_blobstore_entry_t {
+	unsigned long long hash;
+	// The fingerprint, followed by the dive data.
+	unsigned char *blob;
+	unsigned int size;
+	unsigned int fsize;
+	unsigned char *summary;
+	unsigned int ssize;
+	unsigned int flags;
+} dc_blobstore_entry_t;
+
+/*
+ * The entries are stored in an open addressing hash table with linear
+ * probing, keyed by the hash of the dive. The number of slots is always
+ * a power of two, and the table is kept at most half full.
+ */
+struct dc_blobstore_t {
+	dc_context_t *context;
+	dc_blobstore_entry_t *entries;
+	unsigned int nslots;
+	unsigned int count;
+};
+
+static unsigned long long
+fnv1a_update (unsigned long long hash, const unsigned char data[], unsigned int size)
+{
+	for (unsigned int i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+unsigned long long
+dc_blobstore_hash (const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	// FNV-1a hash of both sizes, the fingerprint and the data. The sizes
+	// keep the boundary between the fingerprint and the data apart.
+	unsigned char sizes[8];
+	array_uint32_le_set (sizes + 0, size);
+	array_uint32_le_set (sizes + 4, fsize);
+
+	unsigned long long hash = 14695981039346656037ULL;
+	hash = fnv1a_update (hash, sizes, sizeof (sizes));
+	hash = fnv1a_update (hash, fingerprint, fsize);
+	hash = fnv1a_update (hash, data, size);
+
+	return hash;
+}
+
+static dc_blobstore_entry_t *
+dc_blobstore_lookup (dc_blobstore_entry_t *entries, unsigned int nslots, unsigned long long hash)
+{
+	unsigned int mask = nslots - 1;
+	unsigned int i = (unsigned int) (hash ^ (hash >> 32)) & mask;
+
+	// Return either the matching entry, or the empty slot where the
+	// entry should be inserted.
+	while (entries[i].blob) {
+		if (entries[i].hash == hash)
+			break;
+		i = (i + 1) & mask;
+	}
+
+	return &entries[i];
+}
+
+static dc_blobstore_entry_t *
+dc_blobstore_find (dc_blobstore_t *store, unsigned long long hash)
+{
+	if (store->count == 0)
+		return NULL;
+
+	dc_blobstore_entry_t *entry = dc_blobstore_lookup (store->entries, store->nslots, hash);
+	if (entry->blob == NULL)
+		return NULL;
+
+	return entry;
+}
+
+static dc_status_t
+dc_blobstore_resize (dc_blobstore_t *store, unsigned int nslots)
+{
+	dc_blobstore_entry_t *entries = (dc_blobstore_entry_t *) calloc (nslots, sizeof (dc_blobstore_entry_t));
+	if (entries == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Re-insert the existing entries.
+	for (unsigned int i = 0; i < store->nslots; ++i) {
+		const dc_blobstore_entry_t *entry = &store->entries[i];
+		if (entry->blob == NULL)
+			continue;
+
+		*dc_blobstore_lookup (entries, nslots, entry->hash) = *entry;
+	}
+
+	free (store->entries);
+	store->entries = entries;
+	store->nslots = nslots;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_blobstore_insert (dc_blobstore_t *store, unsigned long long hash, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize, dc_blobstore_entry_t **out)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Keep the table at most half full.
+	if (2 * (store->count + 1) > store->nslots) {
+		status = dc_blobstore_resize (store, store->nslots ? 2 * store->nslots : MINSLOTS);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	dc_blobstore_entry_t *entry = dc_blobstore_lookup (store->entries, store->nslots, hash);
+	if (entry->blob) {
+		// Verify the contents, to rule out a hash collision.
+		if (entry->size != size || entry->fsize != fsize ||
+			memcmp (entry->blob, fingerprint, fsize) != 0 ||
+			memcmp (entry->blob + fsize, data, size) != 0) {
+			ERROR (store->context, "Hash collision detected (%016llx).", hash);
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		*out = entry;
+		return DC_STATUS_SUCCESS;
+	}
+
+	unsigned char *blob = (unsigned char *) malloc (fsize + size + 1);
+	if (blob == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (fsize)
+		memcpy (blob, fingerprint, fsize);
+	if (size)
+		memcpy (blob + fsize, data, size);
+
+	entry->hash = hash;
+	entry->blob = blob;
+	entry->size = size;
+	entry->fsize = fsize;
+	entry->summary = NULL;
+	entry->ssize = 0;
+	entry->flags = 0;
+	store->count++;
+
+	*out = entry;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_blobstore_entry_set_summary (dc_blobstore_t *store, dc_blobstore_entry_t *entry, const unsigned char data[], unsigned int size)
+{
+	unsigned char *summary = (unsigned char *) malloc (size + 1);
+	if (summary == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size)
+		memcpy (summary, data, size);
+
+	free (entry->summary);
+	entry->summary = summary;
+	entry->ssize = size;
+	entry->flags |= FLAG_SUMMARY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_blobstore_new (dc_blobstore_t **out, dc_context_t *context)
+{
+	dc_blobstore_t *store = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	store = (dc_blobstore_t *) malloc (sizeof (dc_blobstore_t));
+	if (store == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	store->context = context;
+	store->entries = NULL;
+	store->nslots = 0;
+	store->count = 0;
+
+	*out = store;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_blobstore_free (dc_blobstore_t *store)
+{
+	if (store == NULL)
+		return DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < store->nslots; ++i) {
+		free (store->entries[i].blob);
+		free (store->entries[i].summary);
+	}
+
+	free (store->entries);
+	free (store);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_blobstore_load (dc_blobstore_t *store, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_mapping_t mapping;
+
+	if (store == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mapping_init (&mapping);
+
+	status = dc_mapping_open (&mapping, store->context, filename);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (mapping.size < SZ_HEADER ||
+		memcmp (mapping.data, magic, sizeof (magic)) != 0 ||
+		array_uint32_le (mapping.data + 8) != FORMAT_VERSION) {
+		ERROR (store->context, "Invalid blob store header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_close;
+	}
+
+	size_t offset = SZ_HEADER;
+	while (offset + SZ_ENTRY <= mapping.size) {
+		const unsigned char *p = mapping.data + offset;
+		unsigned long long hash =
+			array_uint32_le (p + 0) |
+			((unsigned long long) array_uint32_le (p + 4) << 32);
+		unsigned int size = array_uint32_le (p + 8);
+		unsigned int fsize = array_uint32_le (p + 12);
+		unsigned int ssize = array_uint32_le (p + 16);
+		unsigned int flags = array_uint32_le (p + 20);
+
+		size_t available = mapping.size - offset - SZ_ENTRY;
+		if (fsize > available || size > available - fsize ||
+			ssize > available - fsize - size)
+			break;
+
+		const unsigned char *fingerprint = p + SZ_ENTRY;
+		const unsigned char *data = fingerprint + fsize;
+		const unsigned char *summary = data + size;
+		if (dc_blobstore_hash (data, size, fingerprint, fsize) != hash)
+			break;
+
+		dc_blobstore_entry_t *entry = NULL;
+		status = dc_blobstore_insert (store, hash, data, size, fingerprint, fsize, &entry);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_close;
+
+		if (flags & FLAG_SUMMARY) {
+			status = dc_blobstore_entry_set_summary (store, entry, summary, ssize);
+			if (status != DC_STATUS_SUCCESS)
+				goto error_close;
+		}
+
+		offset += SZ_ENTRY + fsize + size + ssize;
+	}
+
+	if (offset != mapping.size) {
+		WARNING (store->context, "Ignoring an incomplete or invalid entry at the end of the blob store.");
+	}
+
+error_close:
+	dc_mapping_close (&mapping);
+	return status;
+}
+
+dc_status_t
+dc_blobstore_save (dc_blobstore_t *store, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char header[SZ_HEADER] = {0};
+
+	if (store == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	FILE *fp = fopen (filename, "wb");
+	if (fp == NULL) {
+		ERROR (store->context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	memcpy (header, magic, sizeof (magic));
+	array_uint32_le_set (header + 8, FORMAT_VERSION);
+	if (fwrite (header, sizeof (header), 1, fp) != 1) {
+		ERROR (store->context, "Failed to write the header.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	for (unsigned int i = 0; i < store->nslots; ++i) {
+		const dc_blobstore_entry_t *entry = &store->entries[i];
+		if (entry->blob == NULL)
+			continue;
+
+		unsigned char info[SZ_ENTRY] = {0};
+		array_uint32_le_set (info + 0, entry->hash & 0xFFFFFFFF);
+		array_uint32_le_set (info + 4, (entry->hash >> 32) & 0xFFFFFFFF);
+		array_uint32_le_set (info + 8, entry->size);
+		array_uint32_le_set (info + 12, entry->fsize);
+		array_uint32_le_set (info + 16, entry->ssize);
+		array_uint32_le_set (info + 20, entry->flags);
+
+		unsigned int bsize = entry->fsize + entry->size;
+		if (fwrite (info, sizeof (info), 1, fp) != 1 ||
+			(bsize && fwrite (entry->blob, bsize, 1, fp) != 1) ||
+			(entry->ssize && fwrite (entry->summary, entry->ssize, 1, fp) != 1)) {
+			ERROR (store->context, "Failed to write the entry.");
+			status = DC_STATUS_IO;
+			goto error_close;
+		}
+	}
+
+error_close:
+	if (fclose (fp) != 0 && status == DC_STATUS_SUCCESS) {
+		ERROR (store->context, "Failed to close the file.");
+		status = DC_STATUS_IO;
+	}
+	return status;
+}
+
+int
+dc_blobstore_contains (dc_blobstore_t *store, unsigned long long hash)
+{
+	if (store == NULL)
+		return 0;
+
+	return dc_blobstore_find (store, hash) != NULL;
+}
+
+dc_status_t
+dc_blobstore_add (dc_blobstore_t *store, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize, unsigned long long *hash)
+{
+	if (store == NULL || (data == NULL && size) || (fingerprint == NULL && fsize))
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned long long value = dc_blobstore_hash (data, size, fingerprint, fsize);
+
+	dc_blobstore_entry_t *entry = NULL;
+	dc_status_t status = dc_blobstore_insert (store, value, data, size, fingerprint, fsize, &entry);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (hash)
+		*hash = value;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_blobstore_get (dc_blobstore_t *store, unsigned long long hash, dc_buffer_t *data, dc_buffer_t *fingerprint)
+{
+	if (store == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const dc_blobstore_entry_t *entry = dc_blobstore_find (store, hash);
+	if (entry == NULL)
+		return DC_STATUS_DONE;
+
+	if (data) {
+		if (!dc_buffer_clear (data) ||
+			!dc_buffer_append (data, entry->blob + entry->fsize, entry->size))
+			return DC_STATUS_NOMEMORY;
+	}
+
+	if (fingerprint) {
+		if (!dc_buffer_clear (fingerprint) ||
+			!dc_buffer_append (fingerprint, entry->blob, entry->fsize))
+			return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_blobstore_set_summary (dc_blobstore_t *store, unsigned long long hash, const unsigned char data[], unsigned int size)
+{
+	if (store == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_blobstore_entry_t *entry = dc_blobstore_find (store, hash);
+	if (entry == NULL)
+		return DC_STATUS_DONE;
+
+	return dc_blobstore_entry_set_summary (store, entry, data, size);
+}
+
+dc_status_t
+dc_blobstore_get_summary (dc_blobstore_t *store, unsigned long long hash, dc_buffer_t *summary)
+{
+	if (store == NULL || summary == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const dc_blobstore_entry_t *entry = dc_blobstore_find (store, hash);
+	if (entry == NULL || !(entry->flags & FLAG_SUMMARY))
+		return DC_STATUS_DONE;
+
+	if (!dc_buffer_clear (summary) ||
+		!dc_buffer_append (summary, entry->summary, entry->ssize))
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
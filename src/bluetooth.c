@@ -23,8 +23,12 @@
 #include "config.h"
 #endif
 
+#include <stddef.h> // offsetof
 #include <stdlib.h> // malloc, free
 #include <stdio.h>
+#include <string.h>
+
+#include <libdivecomputer/datetime.h>
 
 #include "socket.h"
 
@@ -53,6 +57,7 @@
 #include "iostream-private.h"
 #include "iterator-private.h"
 #include "descriptor-private.h"
+#include "thread.h"
 
 #ifdef _WIN32
 #define DC_ADDRESS_FORMAT "%012I64X"
@@ -65,6 +70,14 @@
 #define MAX_DEVICES 255
 #define MAX_PERIODS 8
 
+// The inquiry lasts for MAX_PERIODS * 1.28 seconds, plus some margin
+// for the final event.
+#define INQUIRY_TIMEOUT (MAX_PERIODS * 1280 + 2000)
+
+#define NCACHE        16
+#define DISCOVERY_TTL 0
+#define SDP_TTL       (24 * 3600)
+
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_bluetooth_vtable)
 
 struct dc_bluetooth_device_t {
@@ -72,13 +85,40 @@ struct dc_bluetooth_device_t {
 	char name[248];
 };
 
+typedef struct dc_bluetooth_cache_entry_t {
+	dc_bluetooth_address_t address;
+	char name[248];
+	unsigned int port;
+	dc_ticks_t timestamp;
+} dc_bluetooth_cache_entry_t;
+
+struct dc_bluetooth_cache_t {
+	dc_mutex_t *mutex;
+	unsigned int discovery;
+	unsigned int sdp;
+	unsigned int streaming;
+	dc_bluetooth_cache_entry_t entries[NCACHE];
+	unsigned int count;
+};
+
 #ifdef BLUETOOTH
 static dc_status_t dc_bluetooth_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_bluetooth_iterator_free (dc_iterator_t *iterator);
 
+#ifdef HAVE_BLUEZ
+typedef struct dc_bluetooth_result_t {
+	bdaddr_t bdaddr;
+	char name[HCI_MAX_NAME_LENGTH];
+	int done;
+} dc_bluetooth_result_t;
+#endif
+
 typedef struct dc_bluetooth_iterator_t {
 	dc_iterator_t base;
 	dc_filter_t filter;
+	dc_bluetooth_cache_entry_t cache[NCACHE];
+	unsigned int ncache;
+	unsigned int icache;
 #ifdef _WIN32
 	HANDLE hLookup;
 #else
@@ -86,6 +126,15 @@ typedef struct dc_bluetooth_iterator_t {
 	inquiry_info *devices;
 	size_t count;
 	size_t current;
+	// Streaming discovery. The inquiry events arrive on a socket of
+	// their own, because the remote name requests on the other socket
+	// discard all unrelated events.
+	int inquiry;
+	int active;
+	int deferred;
+	dc_bluetooth_result_t *results;
+	size_t nresults;
+	size_t iresult;
 #endif
 } dc_bluetooth_iterator_t;
 
@@ -104,13 +153,17 @@ static const dc_iostream_vtable_t dc_bluetooth_vtable = {
 	dc_socket_set_rts, /* set_rts */
 	dc_socket_get_lines, /* get_lines */
 	dc_socket_get_available, /* get_received */
+	dc_socket_poll, /* poll */
 	dc_socket_configure, /* configure */
 	dc_socket_read, /* read */
 	dc_socket_write, /* write */
+	NULL, /* readv */
+	dc_socket_writev, /* writev */
 	dc_socket_flush, /* flush */
 	dc_socket_purge, /* purge */
 	dc_socket_sleep, /* sleep */
 	dc_socket_close, /* close */
+	dc_socket_cancel, /* cancel */
 };
 
 #ifdef HAVE_BLUEZ
@@ -138,6 +191,256 @@ dc_address_set (bdaddr_t *ba, dc_bluetooth_address_t address)
 	}
 }
 
+static void
+dc_bluetooth_inquiry_add (dc_bluetooth_iterator_t *iterator, const bdaddr_t *ba, const unsigned char eir[], size_t size)
+{
+	for (size_t i = 0; i < iterator->nresults; ++i) {
+		if (bacmp (&iterator->results[i].bdaddr, ba) == 0)
+			return;
+	}
+
+	if (iterator->nresults >= MAX_DEVICES)
+		return;
+
+	dc_bluetooth_result_t *result = &iterator->results[iterator->nresults++];
+	bacpy (&result->bdaddr, ba);
+	result->name[0] = '\0';
+	result->done = 0;
+
+	// Take the name from the extended inquiry response, if present, such
+	// that no remote name request is needed.
+	size_t offset = 0;
+	while (eir && offset + 1 < size) {
+		unsigned int length = eir[offset];
+		if (length == 0 || offset + 1 + length > size)
+			break;
+
+		unsigned int type = eir[offset + 1];
+		if (type == 0x08 || type == 0x09) {
+			// Shortened or complete local name.
+			size_t n = length - 1;
+			if (n > sizeof (result->name) - 1)
+				n = sizeof (result->name) - 1;
+			memcpy (result->name, eir + offset + 2, n);
+			result->name[n] = '\0';
+			if (type == 0x09)
+				break;
+		}
+
+		offset += 1 + length;
+	}
+}
+
+static void
+dc_bluetooth_inquiry_results (dc_bluetooth_iterator_t *iterator, const unsigned char data[], size_t size, size_t itemsize, int eir)
+{
+	if (size < 1)
+		return;
+
+	unsigned int count = data[0];
+	data += 1;
+	size -= 1;
+
+	for (unsigned int i = 0; i < count && size >= itemsize; ++i) {
+		// All inquiry result structures start with the address.
+		if (eir) {
+			dc_bluetooth_inquiry_add (iterator, (const bdaddr_t *) data,
+				data + offsetof (extended_inquiry_info, data), HCI_MAX_EIR_LENGTH);
+		} else {
+			dc_bluetooth_inquiry_add (iterator, (const bdaddr_t *) data, NULL, 0);
+		}
+
+		data += itemsize;
+		size -= itemsize;
+	}
+}
+
+static dc_status_t
+dc_bluetooth_inquiry_start (dc_bluetooth_iterator_t *iterator, int dev)
+{
+	dc_context_t *context = iterator->base.context;
+
+	iterator->results = (dc_bluetooth_result_t *) malloc (MAX_DEVICES * sizeof (dc_bluetooth_result_t));
+	if (iterator->results == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	int fd = hci_open_dev (dev);
+	if (fd < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		goto error_free;
+	}
+
+	// Receive only the inquiry events.
+	struct hci_filter filter;
+	hci_filter_clear (&filter);
+	hci_filter_set_ptype (HCI_EVENT_PKT, &filter);
+	hci_filter_set_event (EVT_CMD_STATUS, &filter);
+	hci_filter_set_event (EVT_INQUIRY_COMPLETE, &filter);
+	hci_filter_set_event (EVT_INQUIRY_RESULT, &filter);
+	hci_filter_set_event (EVT_INQUIRY_RESULT_WITH_RSSI, &filter);
+	hci_filter_set_event (EVT_EXTENDED_INQUIRY_RESULT, &filter);
+	if (setsockopt (fd, SOL_HCI, HCI_FILTER, &filter, sizeof (filter)) < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		goto error_close;
+	}
+
+	// Start the inquiry with the general inquiry access code, without
+	// a limit on the number of responses.
+	inquiry_cp cp;
+	memset (&cp, 0, sizeof (cp));
+	cp.lap[0] = 0x33;
+	cp.lap[1] = 0x8B;
+	cp.lap[2] = 0x9E;
+	cp.length = MAX_PERIODS;
+	cp.num_rsp = 0;
+	if (hci_send_cmd (fd, OGF_LINK_CTL, OCF_INQUIRY, INQUIRY_CP_SIZE, &cp) < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (context, errcode);
+		goto error_close;
+	}
+
+	iterator->inquiry = fd;
+	iterator->active = 1;
+	iterator->deferred = 0;
+	iterator->nresults = 0;
+	iterator->iresult = 0;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	hci_close_dev (fd);
+error_free:
+	free (iterator->results);
+	iterator->results = NULL;
+	return DC_STATUS_IO;
+}
+
+static dc_status_t
+dc_bluetooth_inquiry_wait (dc_bluetooth_iterator_t *iterator)
+{
+	dc_context_t *context = iterator->base.context;
+
+	fd_set fds;
+	FD_ZERO (&fds);
+	FD_SET (iterator->inquiry, &fds);
+
+	struct timeval tv;
+	tv.tv_sec  = (INQUIRY_TIMEOUT / 1000);
+	tv.tv_usec = (INQUIRY_TIMEOUT % 1000) * 1000;
+
+	int rc = select (iterator->inquiry + 1, &fds, NULL, NULL, &tv);
+	if (rc < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		if (errcode == S_EINTR)
+			return DC_STATUS_SUCCESS;
+		SYSERROR (context, errcode);
+		return dc_socket_syserror (errcode);
+	} else if (rc == 0) {
+		WARNING (context, "Inquiry timeout.");
+		iterator->active = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	unsigned char buf[HCI_MAX_EVENT_SIZE];
+	s_ssize_t n = read (iterator->inquiry, buf, sizeof (buf));
+	if (n < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		if (errcode == S_EINTR || errcode == S_EAGAIN)
+			return DC_STATUS_SUCCESS;
+		SYSERROR (context, errcode);
+		return dc_socket_syserror (errcode);
+	}
+
+	if (n < 1 + HCI_EVENT_HDR_SIZE || buf[0] != HCI_EVENT_PKT)
+		return DC_STATUS_SUCCESS;
+
+	const hci_event_hdr *hdr = (const hci_event_hdr *) (buf + 1);
+	const unsigned char *data = buf + 1 + HCI_EVENT_HDR_SIZE;
+	size_t size = n - 1 - HCI_EVENT_HDR_SIZE;
+
+	switch (hdr->evt) {
+	case EVT_CMD_STATUS:
+		if (size >= EVT_CMD_STATUS_SIZE) {
+			const evt_cmd_status *cs = (const evt_cmd_status *) data;
+			if (btohs (cs->opcode) == cmd_opcode_pack (OGF_LINK_CTL, OCF_INQUIRY) && cs->status) {
+				ERROR (context, "Failed to start the inquiry (0x%02x).", cs->status);
+				iterator->active = 0;
+			}
+		}
+		break;
+	case EVT_INQUIRY_COMPLETE:
+		iterator->active = 0;
+		break;
+	case EVT_INQUIRY_RESULT:
+		dc_bluetooth_inquiry_results (iterator, data, size, INQUIRY_INFO_SIZE, 0);
+		break;
+	case EVT_INQUIRY_RESULT_WITH_RSSI:
+		dc_bluetooth_inquiry_results (iterator, data, size, INQUIRY_INFO_WITH_RSSI_SIZE, 0);
+		break;
+	case EVT_EXTENDED_INQUIRY_RESULT:
+		dc_bluetooth_inquiry_results (iterator, data, size, EXTENDED_INQUIRY_INFO_SIZE, 1);
+		break;
+	default:
+		break;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Return the next device of the streaming discovery, as soon as it has
+ * responded. A remote name request that fails while the inquiry is
+ * still running is tried again after the inquiry is complete, because
+ * not every adapter can page a device during an inquiry.
+ */
+static dc_status_t
+dc_bluetooth_inquiry_next (dc_bluetooth_iterator_t *iterator, bdaddr_t *bdaddr, char *name, size_t size, int *hasname)
+{
+	while (1) {
+		while (iterator->iresult < iterator->nresults) {
+			dc_bluetooth_result_t *result = &iterator->results[iterator->iresult++];
+			if (result->done)
+				continue;
+
+			int found = result->name[0] != '\0';
+			if (!found) {
+				found = hci_read_remote_name (iterator->fd, &result->bdaddr, sizeof (result->name), result->name, 0) >= 0;
+				result->name[found ? sizeof (result->name) - 1 : 0] = '\0';
+			}
+
+			if (!found && iterator->active) {
+				iterator->deferred = 1;
+				continue;
+			}
+
+			result->done = 1;
+			bacpy (bdaddr, &result->bdaddr);
+			strncpy (name, result->name, size - 1);
+			name[size - 1] = '\0';
+			*hasname = found;
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (!iterator->active) {
+			if (!iterator->deferred)
+				return DC_STATUS_DONE;
+
+			// Retry the deferred name requests.
+			iterator->deferred = 0;
+			iterator->iresult = 0;
+			continue;
+		}
+
+		dc_status_t status = dc_bluetooth_inquiry_wait (iterator);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+}
+
 static dc_status_t
 dc_bluetooth_sdp (uint8_t *port, dc_context_t *context, const bdaddr_t *ba)
 {
@@ -223,6 +526,232 @@ error:
 #endif
 #endif
 
+dc_status_t
+dc_bluetooth_cache_new (dc_bluetooth_cache_t **out)
+{
+	dc_bluetooth_cache_t *cache = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	cache = (dc_bluetooth_cache_t *) malloc (sizeof (dc_bluetooth_cache_t));
+	if (cache == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Without thread support, the mutex remains NULL.
+	cache->mutex = NULL;
+	dc_mutex_new (&cache->mutex);
+
+	cache->discovery = DISCOVERY_TTL;
+	cache->sdp = SDP_TTL;
+	cache->streaming = 0;
+	cache->count = 0;
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_bluetooth_cache_free (dc_bluetooth_cache_t *cache)
+{
+	if (cache == NULL)
+		return;
+
+	dc_mutex_free (cache->mutex);
+	free (cache);
+}
+
+static dc_bluetooth_cache_entry_t *
+dc_bluetooth_cache_find (dc_bluetooth_cache_t *cache, dc_bluetooth_address_t address)
+{
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (cache->entries[i].address == address)
+			return &cache->entries[i];
+	}
+
+	return NULL;
+}
+
+static void
+dc_bluetooth_cache_update (dc_context_t *context, dc_bluetooth_address_t address, const char *name, unsigned int port, dc_ticks_t timestamp)
+{
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return;
+
+	dc_mutex_lock (cache->mutex);
+
+	dc_bluetooth_cache_entry_t *entry = dc_bluetooth_cache_find (cache, address);
+	if (entry == NULL) {
+		if (cache->count < NCACHE) {
+			entry = &cache->entries[cache->count++];
+		} else {
+			// Replace the least recently seen device.
+			entry = &cache->entries[0];
+			for (unsigned int i = 1; i < cache->count; ++i) {
+				if (cache->entries[i].timestamp < entry->timestamp)
+					entry = &cache->entries[i];
+			}
+		}
+		entry->address = address;
+		entry->name[0] = '\0';
+		entry->port = 0;
+		entry->timestamp = 0;
+	}
+
+	if (name && name[0]) {
+		strncpy (entry->name, name, sizeof (entry->name) - 1);
+		entry->name[sizeof (entry->name) - 1] = '\0';
+	}
+	if (port)
+		entry->port = port;
+	if (entry->timestamp < timestamp)
+		entry->timestamp = timestamp;
+
+	dc_mutex_unlock (cache->mutex);
+}
+
+#ifdef BLUETOOTH
+static int
+dc_bluetooth_cache_fresh (const dc_bluetooth_cache_entry_t *entry, unsigned int ttl, dc_ticks_t now)
+{
+	return ttl && now - entry->timestamp < (dc_ticks_t) ttl;
+}
+
+static unsigned int
+dc_bluetooth_cache_get_port (dc_context_t *context, dc_bluetooth_address_t address)
+{
+	unsigned int port = 0;
+
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return 0;
+
+	dc_mutex_lock (cache->mutex);
+	const dc_bluetooth_cache_entry_t *entry = dc_bluetooth_cache_find (cache, address);
+	if (entry && dc_bluetooth_cache_fresh (entry, cache->sdp, dc_datetime_now ()))
+		port = entry->port;
+	dc_mutex_unlock (cache->mutex);
+
+	return port;
+}
+
+static void
+dc_bluetooth_cache_invalidate (dc_context_t *context, dc_bluetooth_address_t address)
+{
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return;
+
+	dc_mutex_lock (cache->mutex);
+	dc_bluetooth_cache_entry_t *entry = dc_bluetooth_cache_find (cache, address);
+	if (entry)
+		entry->port = 0;
+	dc_mutex_unlock (cache->mutex);
+}
+
+static unsigned int
+dc_bluetooth_cache_snapshot (dc_context_t *context, dc_bluetooth_cache_entry_t entries[])
+{
+	unsigned int count = 0;
+
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return 0;
+
+	dc_ticks_t now = dc_datetime_now ();
+
+	dc_mutex_lock (cache->mutex);
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (dc_bluetooth_cache_fresh (&cache->entries[i], cache->discovery, now))
+			entries[count++] = cache->entries[i];
+	}
+	dc_mutex_unlock (cache->mutex);
+
+	return count;
+}
+#endif
+
+dc_status_t
+dc_bluetooth_cache_set_ttl (dc_context_t *context, unsigned int discovery, unsigned int sdp)
+{
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (cache->mutex);
+	cache->discovery = discovery;
+	cache->sdp = sdp;
+	dc_mutex_unlock (cache->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bluetooth_set_streaming (dc_context_t *context, unsigned int enable)
+{
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (cache->mutex);
+	cache->streaming = enable ? 1 : 0;
+	dc_mutex_unlock (cache->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bluetooth_cache_add (dc_context_t *context, dc_bluetooth_address_t address, const char *name, unsigned int port, dc_ticks_t timestamp)
+{
+	if (dc_context_get_bluetooth_cache (context) == NULL || address == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_bluetooth_cache_update (context, address, name, port, timestamp);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bluetooth_cache_foreach (dc_context_t *context, dc_bluetooth_cache_callback_t callback, void *userdata)
+{
+	dc_bluetooth_cache_entry_t entries[NCACHE];
+	unsigned int count = 0;
+
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Take a copy, to call the callback without holding the lock.
+	dc_mutex_lock (cache->mutex);
+	count = cache->count;
+	memcpy (entries, cache->entries, count * sizeof (dc_bluetooth_cache_entry_t));
+	dc_mutex_unlock (cache->mutex);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const dc_bluetooth_cache_entry_t *entry = &entries[i];
+		if (!callback (entry->address, entry->name[0] ? entry->name : NULL, entry->port, entry->timestamp, userdata))
+			break;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_bluetooth_cache_clear (dc_context_t *context)
+{
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	if (cache == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (cache->mutex);
+	cache->count = 0;
+	dc_mutex_unlock (cache->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
 char *
 dc_bluetooth_addr2str(dc_bluetooth_address_t address, char *str, size_t size)
 {
@@ -311,6 +840,27 @@ dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descri
 		return DC_STATUS_NOMEMORY;
 	}
 
+	iterator->filter = dc_descriptor_get_filter (descriptor);
+
+	// Skip the device discovery if the cached results are recent enough.
+	iterator->ncache = dc_bluetooth_cache_snapshot (context, iterator->cache);
+	iterator->icache = 0;
+	if (iterator->ncache) {
+		INFO (context, "Discover: using %u cached devices", iterator->ncache);
+#ifdef _WIN32
+		iterator->hLookup = NULL;
+#else
+		iterator->fd = -1;
+		iterator->devices = NULL;
+		iterator->count = 0;
+		iterator->current = 0;
+		iterator->inquiry = -1;
+		iterator->results = NULL;
+#endif
+		*out = (dc_iterator_t *) iterator;
+		return DC_STATUS_SUCCESS;
+	}
+
 #ifdef _WIN32
 	WSAQUERYSET wsaq;
 	memset(&wsaq, 0, sizeof (wsaq));
@@ -351,6 +901,26 @@ dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descri
 		goto error_free;
 	}
 
+	iterator->fd = fd;
+	iterator->devices = NULL;
+	iterator->count = 0;
+	iterator->current = 0;
+	iterator->inquiry = -1;
+	iterator->results = NULL;
+
+	// With the streaming discovery, the inquiry is started here, and the
+	// devices are reported by the iterator as they respond. If the
+	// inquiry can't be started, fall back to the blocking inquiry.
+	dc_bluetooth_cache_t *cache = dc_context_get_bluetooth_cache (context);
+	dc_mutex_lock (cache->mutex);
+	unsigned int streaming = cache->streaming;
+	dc_mutex_unlock (cache->mutex);
+	if (streaming && dc_bluetooth_inquiry_start (iterator, dev) == DC_STATUS_SUCCESS) {
+		INFO (context, "Discover: streaming inquiry started");
+		*out = (dc_iterator_t *) iterator;
+		return DC_STATUS_SUCCESS;
+	}
+
 	// Perform the bluetooth device discovery. The inquiry lasts for at
 	// most MAX_PERIODS * 1.28 seconds, and at most MAX_DEVICES devices
 	// will be returned.
@@ -363,12 +933,9 @@ dc_bluetooth_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descri
 		goto error_close;
 	}
 
-	iterator->fd = fd;
 	iterator->devices = devices;
 	iterator->count = ndevices;
-	iterator->current = 0;
 #endif
-	iterator->filter = dc_descriptor_get_filter (descriptor);
 
 	*out = (dc_iterator_t *) iterator;
 
@@ -387,11 +954,48 @@ error_free:
 }
 
 #ifdef BLUETOOTH
+static dc_status_t
+dc_bluetooth_device_new (dc_bluetooth_device_t **out, dc_context_t *context, dc_bluetooth_address_t address, const char *name)
+{
+	dc_bluetooth_device_t *device = NULL;
+
+	device = (dc_bluetooth_device_t *) malloc (sizeof(dc_bluetooth_device_t));
+	if (device == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->address = address;
+	if (name) {
+		strncpy(device->name, name, sizeof(device->name) - 1);
+		device->name[sizeof(device->name) - 1] = '\0';
+	} else {
+		memset(device->name, 0, sizeof(device->name));
+	}
+
+	*out = device;
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_bluetooth_iterator_next (dc_iterator_t *abstract, void *out)
 {
 	dc_bluetooth_iterator_t *iterator = (dc_bluetooth_iterator_t *) abstract;
-	dc_bluetooth_device_t *device = NULL;
+
+	while (iterator->icache < iterator->ncache) {
+		const dc_bluetooth_cache_entry_t *entry = &iterator->cache[iterator->icache++];
+		const char *name = entry->name[0] ? entry->name : NULL;
+
+		INFO (abstract->context, "Discover: address=" DC_ADDRESS_FORMAT ", name=%s (cached)",
+			entry->address, name ? name : "");
+
+		if (iterator->filter && !iterator->filter (DC_TRANSPORT_BLUETOOTH, name)) {
+			continue;
+		}
+
+		return dc_bluetooth_device_new ((dc_bluetooth_device_t **) out, abstract->context, entry->address, name);
+	}
 
 #ifdef _WIN32
 	if (iterator->hLookup == NULL) {
@@ -427,46 +1031,49 @@ dc_bluetooth_iterator_next (dc_iterator_t *abstract, void *out)
 		dc_bluetooth_address_t address = sa->btAddr;
 		const char *name = (char *) pwsaResults->lpszServiceInstanceName;
 #else
-	while (iterator->current < iterator->count) {
-		inquiry_info *dev = &iterator->devices[iterator->current++];
+	while (1) {
+		bdaddr_t bdaddr;
+		char buf[HCI_MAX_NAME_LENGTH], *name = buf;
+
+		if (iterator->inquiry >= 0) {
+			int hasname = 0;
+			dc_status_t status = dc_bluetooth_inquiry_next (iterator, &bdaddr, buf, sizeof(buf), &hasname);
+			if (status == DC_STATUS_DONE)
+				break;
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+			if (!hasname)
+				name = NULL;
+		} else {
+			if (iterator->current >= iterator->count)
+				break;
 
-		dc_bluetooth_address_t address = dc_address_get (&dev->bdaddr);
+			inquiry_info *dev = &iterator->devices[iterator->current++];
+			bacpy (&bdaddr, &dev->bdaddr);
 
-		// Get the user friendly name.
-		char buf[HCI_MAX_NAME_LENGTH], *name = buf;
-		int rc = hci_read_remote_name (iterator->fd, &dev->bdaddr, sizeof(buf), buf, 0);
-		if (rc < 0) {
-			name = NULL;
+			// Get the user friendly name.
+			int rc = hci_read_remote_name (iterator->fd, &bdaddr, sizeof(buf), buf, 0);
+			if (rc < 0) {
+				name = NULL;
+			}
+
+			// Null terminate the string.
+			buf[sizeof(buf) - 1] = '\0';
 		}
 
-		// Null terminate the string.
-		buf[sizeof(buf) - 1] = '\0';
+		dc_bluetooth_address_t address = dc_address_get (&bdaddr);
 #endif
 
 		INFO (abstract->context, "Discover: address=" DC_ADDRESS_FORMAT ", name=%s",
 			address, name ? name : "");
 
+		dc_bluetooth_cache_update (abstract->context, address, name, 0, dc_datetime_now ());
+
 		if (iterator->filter && !iterator->filter (DC_TRANSPORT_BLUETOOTH, name)) {
 			continue;
 		}
 
-		device = (dc_bluetooth_device_t *) malloc (sizeof(dc_bluetooth_device_t));
-		if (device == NULL) {
-			SYSERROR (abstract->context, S_ENOMEM);
-			return DC_STATUS_NOMEMORY;
-		}
-
-		device->address = address;
-		if (name) {
-			strncpy(device->name, name, sizeof(device->name) - 1);
-			device->name[sizeof(device->name) - 1] = '\0';
-		} else {
-			memset(device->name, 0, sizeof(device->name));
-		}
-
-		*(dc_bluetooth_device_t **) out = device;
-
-		return DC_STATUS_SUCCESS;
+		return dc_bluetooth_device_new ((dc_bluetooth_device_t **) out, abstract->context, address, name);
 	}
 
 	return DC_STATUS_DONE;
@@ -482,32 +1089,30 @@ dc_bluetooth_iterator_free (dc_iterator_t *abstract)
 		WSALookupServiceEnd (iterator->hLookup);
 	}
 #else
+	if (iterator->inquiry >= 0) {
+		// Cancel the remainder of the inquiry.
+		if (iterator->active) {
+			hci_send_cmd (iterator->inquiry, OGF_LINK_CTL, OCF_INQUIRY_CANCEL, 0, NULL);
+		}
+		hci_close_dev(iterator->inquiry);
+	}
+	free(iterator->results);
 	bt_free(iterator->devices);
-	hci_close_dev(iterator->fd);
+	if (iterator->fd >= 0) {
+		hci_close_dev(iterator->fd);
+	}
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
 #endif
 
-dc_status_t
-dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_address_t address, unsigned int port)
-{
 #ifdef BLUETOOTH
+static dc_status_t
+dc_bluetooth_connect (dc_socket_t *device, dc_bluetooth_address_t address, unsigned int port, unsigned int *resolved)
+{
 	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_socket_t *device = NULL;
-
-	if (out == NULL)
-		return DC_STATUS_INVALIDARGS;
-
-	INFO (context, "Open: address=" DC_ADDRESS_FORMAT ", port=%u", address, port);
-
-	// Allocate memory.
-	device = (dc_socket_t *) dc_iostream_allocate (context, &dc_bluetooth_vtable);
-	if (device == NULL) {
-		SYSERROR (context, S_ENOMEM);
-		return DC_STATUS_NOMEMORY;
-	}
+	dc_context_t *context = device->base.context;
 
 	// Open the socket.
 #ifdef _WIN32
@@ -516,7 +1121,7 @@ dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_addr
 	status = dc_socket_open (&device->base, AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
 #endif
 	if (status != DC_STATUS_SUCCESS) {
-		goto error_free;
+		return status;
 	}
 
 #ifdef _WIN32
@@ -548,12 +1153,76 @@ dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_addr
 		goto error_close;
 	}
 
-	*out = (dc_iostream_t *) device;
+	// Report the port that was actually used.
+#ifdef _WIN32
+	if (port == 0) {
+		SOCKADDR_BTH peer;
+		int len = sizeof (peer);
+		if (getpeername (device->fd, (struct sockaddr *) &peer, &len) == 0) {
+			port = peer.port;
+		}
+	}
+#else
+	port = sa.rc_channel;
+#endif
+	if (resolved) {
+		*resolved = port;
+	}
 
 	return DC_STATUS_SUCCESS;
 
 error_close:
 	dc_socket_close (&device->base);
+	return status;
+}
+#endif
+
+dc_status_t
+dc_bluetooth_open (dc_iostream_t **out, dc_context_t *context, dc_bluetooth_address_t address, unsigned int port)
+{
+#ifdef BLUETOOTH
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_socket_t *device = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: address=" DC_ADDRESS_FORMAT ", port=%u", address, port);
+
+	// Allocate memory.
+	device = (dc_socket_t *) dc_iostream_allocate (context, &dc_bluetooth_vtable);
+	if (device == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Try the cached port first, to skip the service discovery.
+	unsigned int cached = 0, resolved = 0;
+	if (port == 0) {
+		cached = dc_bluetooth_cache_get_port (context, address);
+	}
+	if (cached) {
+		INFO (context, "Open: cached port=%u", cached);
+		status = dc_bluetooth_connect (device, address, cached, &resolved);
+		if (status != DC_STATUS_SUCCESS) {
+			WARNING (context, "Failed to connect to the cached port.");
+			dc_bluetooth_cache_invalidate (context, address);
+		}
+	}
+	if (cached == 0 || status != DC_STATUS_SUCCESS) {
+		status = dc_bluetooth_connect (device, address, port, &resolved);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_free;
+		}
+	}
+
+	// Remember the port for the next connection.
+	dc_bluetooth_cache_update (context, address, NULL, resolved, dc_datetime_now ());
+
+	*out = (dc_iostream_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
 error_free:
 	dc_iostream_deallocate ((dc_iostream_t *) device);
 	return status;
@@ -19,14 +19,16 @@
  * MA 02110-1301 USA
  */
 
-#ifndef DC_BLUETOOTH_H
-#define DC_BLUETOOTH_H
+#ifndef BLUETOOTH_H
+#define BLUETOOTH_H
 
 #include <libdivecomputer/common.h>
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/iterator.h>
 #include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/datetime.h>
+#include <libdivecomputer/bluetooth.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,15 +40,6 @@ extern "C" {
  */
 #define DC_BLUETOOTH_SIZE 18
 
-/**
- * Bluetooth address (48 bits).
- */
-#if defined (_WIN32) && !defined (__GNUC__)
-typedef unsigned __int64 dc_bluetooth_address_t;
-#else
-typedef unsigned long long dc_bluetooth_address_t;
-#endif
-
 /**
  * Convert a bluetooth address to a string.
  *
@@ -132,4 +125,4 @@ dc_bluetooth_open (dc_iostream_t **iostream, dc_context_t *context, dc_bluetooth
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
-#endif /* DC_BLUETOOTH_H */
+#endif /* BLUETOOTH_H */
@@ -19,36 +19,179 @@
  * MA 02110-1301 USA
  */
 
-#include <stdlib.h> // malloc, realloc, free
+#include <stdlib.h> // malloc, free
 #include <string.h> // memcpy, memmove
 
 #include <libdivecomputer/buffer.h>
 
+#include "context-private.h"
+#include "thread.h"
+
+#define GROWTH 100
+
 struct dc_buffer_t {
+	dc_context_t *context;
 	unsigned char *data;
 	size_t capacity, offset, size;
+	unsigned int growth;
 };
 
 dc_buffer_t *
 dc_buffer_new (size_t capacity)
 {
-	dc_buffer_t *buffer = (dc_buffer_t *) malloc (sizeof (dc_buffer_t));
+	return dc_buffer_new2 (NULL, capacity);
+}
+
+
+struct dc_buffer_pool_t {
+	dc_mutex_t *mutex;
+	unsigned int size;
+	unsigned int count;
+	dc_buffer_t *buffers[];
+};
+
+static dc_buffer_t *
+dc_buffer_pool_get (dc_buffer_pool_t *pool, size_t capacity)
+{
+	dc_buffer_t *buffer = NULL;
+
+	if (pool == NULL)
+		return NULL;
+
+	dc_mutex_lock (pool->mutex);
+
+	// Prefer the smallest buffer that is large enough, and otherwise
+	// the largest one, which needs to grow the least.
+	unsigned int best = pool->count;
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		size_t current = pool->buffers[i]->capacity;
+		if (best == pool->count) {
+			best = i;
+		} else {
+			size_t previous = pool->buffers[best]->capacity;
+			if (previous >= capacity ?
+				(current >= capacity && current < previous) :
+				(current > previous))
+				best = i;
+		}
+	}
+
+	if (best != pool->count) {
+		// Remove the buffer from the pool.
+		buffer = pool->buffers[best];
+		pool->count--;
+		pool->buffers[best] = pool->buffers[pool->count];
+	}
+
+	dc_mutex_unlock (pool->mutex);
+
+	return buffer;
+}
+
+static int
+dc_buffer_pool_put (dc_buffer_pool_t *pool, dc_buffer_t *buffer)
+{
+	int stored = 0;
+
+	if (pool == NULL)
+		return 0;
+
+	dc_mutex_lock (pool->mutex);
+
+	if (pool->count < pool->size) {
+		// Keep the memory, but restore the default state.
+		buffer->offset = 0;
+		buffer->size = 0;
+		buffer->growth = GROWTH;
+
+		pool->buffers[pool->count++] = buffer;
+		stored = 1;
+	}
+
+	dc_mutex_unlock (pool->mutex);
+
+	return stored;
+}
+
+static void
+dc_buffer_deallocate (dc_buffer_t *buffer)
+{
+	dc_context_release (buffer->context, buffer->data);
+	dc_context_release (buffer->context, buffer);
+}
+
+dc_status_t
+dc_buffer_pool_new (dc_buffer_pool_t **out, unsigned int size)
+{
+	dc_buffer_pool_t *pool = NULL;
+
+	if (out == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	pool = (dc_buffer_pool_t *) malloc (sizeof (*pool) + size * sizeof (dc_buffer_t *));
+	if (pool == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Without thread support, the pool is simply not protected.
+	pool->mutex = NULL;
+	dc_mutex_new (&pool->mutex);
+
+	pool->size = size;
+	pool->count = 0;
+
+	*out = pool;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_buffer_pool_free (dc_buffer_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	for (unsigned int i = 0; i < pool->count; ++i)
+		dc_buffer_deallocate (pool->buffers[i]);
+
+	dc_mutex_free (pool->mutex);
+	free (pool);
+}
+
+
+dc_buffer_t *
+dc_buffer_new2 (dc_context_t *context, size_t capacity)
+{
+	// Re-use a pooled buffer, if enabled.
+	dc_buffer_t *buffer = dc_buffer_pool_get (dc_context_get_buffer_pool (context), capacity);
+	if (buffer) {
+		if (!dc_buffer_reserve (buffer, capacity)) {
+			dc_buffer_deallocate (buffer);
+			return NULL;
+		}
+
+		return buffer;
+	}
+
+	buffer = (dc_buffer_t *) dc_context_alloc (context, sizeof (dc_buffer_t));
 	if (buffer == NULL)
 		return NULL;
 
 	if (capacity) {
-		buffer->data = (unsigned char *) malloc (capacity);
+		buffer->data = (unsigned char *) dc_context_alloc (context, capacity);
 		if (buffer->data == NULL) {
-			free (buffer);
+			dc_context_release (context, buffer);
 			return NULL;
 		}
 	} else {
 		buffer->data = NULL;
 	}
 
+	buffer->context = context;
 	buffer->capacity = capacity;
 	buffer->offset = 0;
 	buffer->size = 0;
+	buffer->growth = GROWTH;
 
 	return buffer;
 }
@@ -60,10 +203,23 @@ dc_buffer_free (dc_buffer_t *buffer)
 	if (buffer == NULL)
 		return;
 
-	if (buffer->data)
-		free (buffer->data);
+	// Return the buffer to the pool, if enabled.
+	if (dc_buffer_pool_put (dc_context_get_buffer_pool (buffer->context), buffer))
+		return;
+
+	dc_buffer_deallocate (buffer);
+}
+
 
-	free (buffer);
+int
+dc_buffer_set_growth (dc_buffer_t *buffer, unsigned int percent)
+{
+	if (buffer == NULL || percent == 0)
+		return 0;
+
+	buffer->growth = percent;
+
+	return 1;
 }
 
 
@@ -85,8 +241,10 @@ dc_buffer_expand_calc (dc_buffer_t *buffer, size_t n)
 {
 	size_t oldsize = buffer->capacity;
 	size_t newsize = (oldsize ? oldsize : n);
-	while (newsize < n)
-		newsize *= 2;
+	while (newsize < n) {
+		size_t increment = newsize / 100 * buffer->growth + newsize % 100 * buffer->growth / 100;
+		newsize += (increment ? increment : 1);
+	}
 
 	return newsize;
 }
@@ -96,17 +254,20 @@ static int
 dc_buffer_expand_append (dc_buffer_t *buffer, size_t n)
 {
 	if (n > buffer->capacity - buffer->offset) {
-		if (n > buffer->capacity) {
-			size_t capacity = dc_buffer_expand_calc (buffer, n);
+		// Moving the data to the front is only worth it when that
+		// frees a good amount of space. Otherwise the buffer would be
+		// shifted over and over again by a series of small appends.
+		if (n > buffer->capacity || buffer->offset < buffer->size / 2) {
+			size_t capacity = dc_buffer_expand_calc (buffer, n > buffer->capacity ? n : buffer->capacity + 1);
 
-			unsigned char *data = (unsigned char *) malloc (capacity);
+			unsigned char *data = (unsigned char *) dc_context_alloc (buffer->context, capacity);
 			if (data == NULL)
 				return 0;
 
 			if (buffer->size)
 				memcpy (data, buffer->data + buffer->offset, buffer->size);
 
-			free (buffer->data);
+			dc_context_release (buffer->context, buffer->data);
 
 			buffer->data = data;
 			buffer->capacity = capacity;
@@ -129,17 +290,18 @@ dc_buffer_expand_prepend (dc_buffer_t *buffer, size_t n)
 	size_t available = buffer->capacity - buffer->size;
 
 	if (n > buffer->offset + buffer->size) {
-		if (n > buffer->capacity) {
-			size_t capacity = dc_buffer_expand_calc (buffer, n);
+		// The same applies to moving the data to the back.
+		if (n > buffer->capacity || available - buffer->offset < buffer->size / 2) {
+			size_t capacity = dc_buffer_expand_calc (buffer, n > buffer->capacity ? n : buffer->capacity + 1);
 
-			unsigned char *data = (unsigned char *) malloc (capacity);
+			unsigned char *data = (unsigned char *) dc_context_alloc (buffer->context, capacity);
 			if (data == NULL)
 				return 0;
 
 			if (buffer->size)
 				memcpy (data + capacity - buffer->size, buffer->data + buffer->offset, buffer->size);
 
-			free (buffer->data);
+			dc_context_release (buffer->context, buffer->data);
 
 			buffer->data = data;
 			buffer->capacity = capacity;
@@ -165,10 +327,15 @@ dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity)
 	if (capacity <= buffer->capacity)
 		return 1;
 
-	unsigned char *data = (unsigned char *) realloc (buffer->data, capacity);
+	unsigned char *data = (unsigned char *) dc_context_alloc (buffer->context, capacity);
 	if (data == NULL)
 		return 0;
 
+	if (buffer->size)
+		memcpy (data + buffer->offset, buffer->data + buffer->offset, buffer->size);
+
+	dc_context_release (buffer->context, buffer->data);
+
 	buffer->data = data;
 	buffer->capacity = capacity;
 
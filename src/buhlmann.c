@@ -0,0 +1,399 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include <libdivecomputer/units.h>
+
+#include "parser-private.h"
+
+#define HAS(table,row,type) (((table)->mask[(row)] & (1u << (type))) != 0)
+
+#define NCOMPARTMENTS 16
+
+#define WATERVAPOUR 0.0627 /* bar */
+#define AIR_N2      0.7902
+
+#define ASCENT_RATE 10.0   /* m/min */
+#define STOP_STEP   3.0    /* m */
+#define STOP_TIME   60     /* s */
+#define STEP_TIME   18     /* s, one stop step at the ascent rate */
+#define NDL_MAX     (99 * 60)
+#define TTS_MAX     (24 * 3600)
+#define GF_ITERATIONS 3
+
+#define LN2 0.69314718055994530942
+
+/*
+ * ZH-L16C, with the half-time of compartment 1b. The half-times are in
+ * minutes, and the a coefficients in bar.
+ */
+static const double n2_halftime[NCOMPARTMENTS] = {
+	5.0, 8.0, 12.5, 18.5, 27.0, 38.3, 54.3, 77.0,
+	109.0, 146.0, 187.0, 239.0, 305.0, 390.0, 498.0, 635.0};
+static const double n2_a[NCOMPARTMENTS] = {
+	1.1696, 1.0, 0.8618, 0.7562, 0.62, 0.5043, 0.441, 0.4,
+	0.375, 0.35, 0.3295, 0.3065, 0.2835, 0.261, 0.248, 0.2327};
+static const double n2_b[NCOMPARTMENTS] = {
+	0.5578, 0.6514, 0.7222, 0.7825, 0.8126, 0.8434, 0.8693, 0.891,
+	0.9092, 0.9222, 0.9319, 0.9403, 0.9477, 0.9544, 0.9602, 0.9653};
+static const double he_halftime[NCOMPARTMENTS] = {
+	1.88, 3.02, 4.72, 6.99, 10.21, 14.48, 20.53, 29.11,
+	41.20, 55.19, 70.69, 90.34, 115.29, 147.42, 188.24, 240.03};
+static const double he_a[NCOMPARTMENTS] = {
+	1.6189, 1.383, 1.1919, 1.0458, 0.922, 0.8205, 0.7305, 0.6502,
+	0.595, 0.5545, 0.5333, 0.5189, 0.5181, 0.5176, 0.5172, 0.5119};
+static const double he_b[NCOMPARTMENTS] = {
+	0.4770, 0.5747, 0.6527, 0.7223, 0.7582, 0.7957, 0.8279, 0.8553,
+	0.8757, 0.8903, 0.8997, 0.9073, 0.9122, 0.9171, 0.9217, 0.9267};
+
+/*
+ * NOAA oxygen exposure limits (minutes) for a ppO2 of 0.5 to 1.6 bar,
+ * in steps of 0.1 bar.
+ */
+static const double cns_limit[] = {
+	720.0, 720.0, 570.0, 450.0, 360.0, 300.0,
+	240.0, 210.0, 180.0, 150.0, 120.0, 45.0};
+
+typedef struct deco_tissues_t {
+	double n2[NCOMPARTMENTS];
+	double he[NCOMPARTMENTS];
+} deco_tissues_t;
+
+/*
+ * The fraction of the difference with the inspired pressure that is
+ * taken up during an interval, for every compartment. Most profiles
+ * have a fixed sample interval, so these are computed only once.
+ */
+typedef struct deco_factors_t {
+	unsigned int interval;
+	double n2[NCOMPARTMENTS];
+	double he[NCOMPARTMENTS];
+} deco_factors_t;
+
+typedef struct deco_state_t {
+	double atmospheric;
+	double density;
+	double gflow;
+	double gfhigh;
+	// Ambient pressure of the deepest first stop so far, where the low
+	// gradient factor applies.
+	double anchor;
+	// Inspired inert gas fractions.
+	double fn2;
+	double fhe;
+	deco_factors_t stop;
+	deco_factors_t step;
+} deco_state_t;
+
+static void
+deco_factors (deco_factors_t *factors, unsigned int interval)
+{
+	double minutes = interval / 60.0;
+
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		factors->n2[i] = 1.0 - exp (-LN2 * minutes / n2_halftime[i]);
+		factors->he[i] = 1.0 - exp (-LN2 * minutes / he_halftime[i]);
+	}
+
+	factors->interval = interval;
+}
+
+static void
+deco_load (deco_tissues_t *tissues, const deco_factors_t *factors, double pn2, double phe)
+{
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i)
+		tissues->n2[i] += (pn2 - tissues->n2[i]) * factors->n2[i];
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i)
+		tissues->he[i] += (phe - tissues->he[i]) * factors->he[i];
+}
+
+static double
+deco_pressure (const deco_state_t *state, double depth)
+{
+	return state->atmospheric + depth * state->density * GRAVITY / BAR;
+}
+
+static double
+deco_depth (const deco_state_t *state, double pressure)
+{
+	if (pressure <= state->atmospheric)
+		return 0.0;
+
+	return (pressure - state->atmospheric) * BAR / (state->density * GRAVITY);
+}
+
+/*
+ * Load the tissues with the gas breathed at the ambient pressure. On a
+ * rebreather, the setpoint replaces part of the inert gas.
+ */
+static void
+deco_breathe (const deco_state_t *state, deco_tissues_t *tissues, const deco_factors_t *factors, double pressure, double ppo2)
+{
+	double inert = pressure - WATERVAPOUR;
+	double total = state->fn2 + state->fhe;
+
+	if (ppo2 > 0.0) {
+		inert -= ppo2;
+		if (total > 0.0)
+			inert /= total;
+	}
+
+	if (inert < 0.0)
+		inert = 0.0;
+
+	deco_load (tissues, factors, inert * state->fn2, inert * state->fhe);
+}
+
+/*
+ * The lowest tolerated ambient pressure, for the given gradient factor.
+ */
+static double
+deco_tolerated (const deco_tissues_t *tissues, double gf)
+{
+	double tolerated = 0.0;
+
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		double n2 = tissues->n2[i], he = tissues->he[i];
+		double total = n2 + he;
+		if (total <= 0.0)
+			continue;
+
+		double a = (n2_a[i] * n2 + he_a[i] * he) / total;
+		double b = (n2_b[i] * n2 + he_b[i] * he) / total;
+		double value = (total - a * gf) / (gf / b + 1.0 - gf);
+		if (value > tolerated)
+			tolerated = value;
+	}
+
+	return tolerated;
+}
+
+/*
+ * The gradient factor changes linearly from the low value at the
+ * anchor (the first stop) to the high value at the surface.
+ */
+static double
+deco_gf (const deco_state_t *state, double pressure)
+{
+	if (state->anchor <= state->atmospheric || pressure <= state->atmospheric)
+		return state->gfhigh;
+
+	if (pressure >= state->anchor)
+		return state->gflow;
+
+	return state->gfhigh + (state->gflow - state->gfhigh) *
+		(pressure - state->atmospheric) / (state->anchor - state->atmospheric);
+}
+
+static double
+deco_ceiling (const deco_state_t *state, const deco_tissues_t *tissues)
+{
+	double tolerated = deco_tolerated (tissues, state->gfhigh);
+
+	for (unsigned int i = 0; i < GF_ITERATIONS; ++i)
+		tolerated = deco_tolerated (tissues, deco_gf (state, tolerated));
+
+	return tolerated;
+}
+
+static unsigned int
+deco_ndl (const deco_state_t *state, const deco_tissues_t *tissues, double pressure, double ppo2)
+{
+	deco_tissues_t future = *tissues;
+
+	for (unsigned int ndl = 0; ndl < NDL_MAX; ndl += STOP_TIME) {
+		deco_breathe (state, &future, &state->stop, pressure, ppo2);
+		if (deco_tolerated (&future, state->gfhigh) > state->atmospheric)
+			return ndl;
+	}
+
+	return NDL_MAX;
+}
+
+/*
+ * Time to surface, with an ascent at 10 m/min and stops every 3 m, on
+ * the current gas.
+ */
+static unsigned int
+deco_tts (deco_state_t *state, const deco_tissues_t *tissues, double depth, double ppo2)
+{
+	deco_tissues_t future = *tissues;
+	deco_factors_t factors;
+	unsigned int tts = 0;
+
+	double ceiling = deco_depth (state, deco_ceiling (state, &future));
+	double stop = ceil (ceiling / STOP_STEP) * STOP_STEP;
+	if (stop > depth)
+		stop = depth;
+
+	// Ascend to the first stop, at the average depth.
+	unsigned int interval = (depth - stop) * 60.0 / ASCENT_RATE;
+	if (interval) {
+		deco_factors (&factors, interval);
+		deco_breathe (state, &future, &factors, deco_pressure (state, (depth + stop) / 2.0), ppo2);
+		tts += interval;
+	}
+
+	// The low gradient factor applies at the first stop.
+	double anchor = state->anchor;
+	if (deco_pressure (state, stop) > state->anchor)
+		state->anchor = deco_pressure (state, stop);
+
+	while (stop > 0.0 && tts < TTS_MAX) {
+		double next = stop - STOP_STEP;
+		if (next < 0.0)
+			next = 0.0;
+
+		if (deco_ceiling (state, &future) > deco_pressure (state, next)) {
+			deco_breathe (state, &future, &state->stop, deco_pressure (state, stop), ppo2);
+			tts += STOP_TIME;
+			continue;
+		}
+
+		deco_breathe (state, &future, &state->step, deco_pressure (state, (stop + next) / 2.0), ppo2);
+		tts += STEP_TIME;
+		stop = next;
+	}
+
+	state->anchor = anchor;
+
+	return tts;
+}
+
+static double
+deco_cns (double ppo2, unsigned int interval)
+{
+	if (ppo2 <= 0.5)
+		return 0.0;
+
+	double limit = 0.0;
+	double index = (ppo2 - 0.5) * 10.0;
+	unsigned int n = sizeof (cns_limit) / sizeof (cns_limit[0]);
+	if (index >= n - 1) {
+		limit = cns_limit[n - 1];
+	} else {
+		unsigned int i = (unsigned int) index;
+		limit = cns_limit[i] + (cns_limit[i + 1] - cns_limit[i]) * (index - i);
+	}
+
+	return interval / (limit * 60.0);
+}
+
+static void
+deco_gasmix (dc_parser_t *parser, deco_state_t *state, unsigned int idx, unsigned int ngasmixes, double *fo2)
+{
+	dc_gasmix_t gasmix;
+
+	if (idx >= ngasmixes || dc_parser_get_field (parser, DC_FIELD_GASMIX, idx, &gasmix) != DC_STATUS_SUCCESS) {
+		// Assume air.
+		gasmix.oxygen = 1.0 - AIR_N2;
+		gasmix.helium = 0.0;
+		gasmix.nitrogen = AIR_N2;
+	}
+
+	state->fn2 = gasmix.nitrogen;
+	state->fhe = gasmix.helium;
+	*fo2 = gasmix.oxygen;
+}
+
+void
+sample_deco_compute (dc_parser_t *parser, const dc_sample_table_t *table, dc_sample_derived_t *derived, double atmospheric, double density)
+{
+	deco_state_t state;
+	deco_tissues_t tissues;
+	deco_factors_t factors;
+	unsigned int ngasmixes = 0;
+	dc_divemode_t divemode = DC_DIVEMODE_OC;
+	double fo2 = 0.0, cns = 0.0;
+
+	state.atmospheric = atmospheric;
+	state.density = density;
+	state.gflow = (derived->gflow ? derived->gflow : 100) / 100.0;
+	state.gfhigh = (derived->gfhigh ? derived->gfhigh : 100) / 100.0;
+	state.anchor = 0.0;
+	deco_factors (&state.stop, STOP_TIME);
+	deco_factors (&state.step, STEP_TIME);
+
+	if (dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes) != DC_STATUS_SUCCESS)
+		ngasmixes = 0;
+
+	// Only a rebreather breathes the ppO2 of the samples.
+	if (dc_parser_get_field (parser, DC_FIELD_DIVEMODE, 0, &divemode) != DC_STATUS_SUCCESS)
+		divemode = DC_DIVEMODE_OC;
+	int rebreather = divemode == DC_DIVEMODE_CCR || divemode == DC_DIVEMODE_SCR;
+
+	// The dive starts with the first gas mix, and tissues saturated
+	// with air at the surface.
+	deco_gasmix (parser, &state, 0, ngasmixes, &fo2);
+	for (unsigned int i = 0; i < NCOMPARTMENTS; ++i) {
+		tissues.n2[i] = (atmospheric - WATERVAPOUR) * AIR_N2;
+		tissues.he[i] = 0.0;
+	}
+	memset (&factors, 0, sizeof (factors));
+
+	unsigned int previous = 0;
+	double depth = 0.0, ppo2 = 0.0;
+	for (unsigned int i = 0; i < table->count; ++i) {
+		double current = depth;
+		if (HAS (table, i, DC_SAMPLE_DEPTH))
+			current = table->depth[i];
+
+		// Load the tissues over the interval ending at this row, at the
+		// average depth, with the gas of the previous row.
+		unsigned int interval = table->time[i] > previous ? table->time[i] - previous : 0;
+		if (interval) {
+			if (interval != factors.interval)
+				deco_factors (&factors, interval);
+
+			double pressure = deco_pressure (&state, (depth + current) / 2.0);
+			deco_breathe (&state, &tissues, &factors, pressure, ppo2);
+			cns += deco_cns (ppo2 > 0.0 ? ppo2 : fo2 * pressure, interval);
+		}
+		previous = table->time[i];
+		depth = current;
+
+		if (table->gasmix && HAS (table, i, DC_SAMPLE_GASMIX))
+			deco_gasmix (parser, &state, table->gasmix[i], ngasmixes, &fo2);
+		if (rebreather && table->ppo2 && HAS (table, i, DC_SAMPLE_PPO2))
+			ppo2 = table->ppo2[i];
+
+		double pressure = deco_pressure (&state, depth);
+
+		// Move the anchor of the gradient factors down to the deepest
+		// ceiling for the low gradient factor.
+		double first = deco_tolerated (&tissues, state.gflow);
+		if (first > state.anchor)
+			state.anchor = first;
+
+		double ceiling = deco_ceiling (&state, &tissues);
+		if (derived->ceiling)
+			derived->ceiling[i] = deco_depth (&state, ceiling);
+		if (derived->ndl)
+			derived->ndl[i] = ceiling > state.atmospheric ? 0 : deco_ndl (&state, &tissues, pressure, ppo2);
+		if (derived->tts)
+			derived->tts[i] = deco_tts (&state, &tissues, depth, ppo2);
+		if (derived->cns)
+			derived->cns[i] = cns;
+	}
+}
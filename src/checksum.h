@@ -41,6 +41,27 @@ checksum_xor_uint8 (const unsigned char data[], unsigned int size, unsigned char
 unsigned short
 checksum_crc_ccitt_uint16 (const unsigned char data[], unsigned int size);
 
+unsigned short
+checksum_crc_ccitt_update (const unsigned char data[], unsigned int size, unsigned short init);
+
+/*
+ * The copy variants calculate the same checksum as the corresponding
+ * function above, while copying the data to the destination buffer in
+ * the same pass. The buffers must not overlap.
+ */
+
+unsigned char
+checksum_add_uint8_copy (unsigned char dst[], const unsigned char src[], unsigned int size, unsigned char init);
+
+unsigned short
+checksum_add_uint16_copy (unsigned char dst[], const unsigned char src[], unsigned int size, unsigned short init);
+
+unsigned char
+checksum_xor_uint8_copy (unsigned char dst[], const unsigned char src[], unsigned int size, unsigned char init);
+
+unsigned short
+checksum_crc_ccitt_copy (unsigned char dst[], const unsigned char src[], unsigned int size, unsigned short init);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
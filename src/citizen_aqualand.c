@@ -83,6 +83,8 @@ citizen_aqualand_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (4800 8N1).
 	status = dc_iostream_configure (device->iostream, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -147,7 +149,7 @@ citizen_aqualand_device_set_fingerprint (dc_device_t *abstract, const unsigned c
 }
 
 static dc_status_t
-citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+citizen_aqualand_download (dc_device_t *abstract, dc_buffer_t *buffer, const unsigned char fingerprint[])
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	citizen_aqualand_device_t *device = (citizen_aqualand_device_t *) abstract;
@@ -190,6 +192,12 @@ citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			return status;
 		}
 
+		// The first packet contains the fingerprint. If the dive is
+		// already known, the remaining packets are not requested.
+		if (fingerprint && dc_buffer_get_size (buffer) == sizeof (answer) &&
+			memcmp (answer + 0x05, fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
 		// Send the command.
 		status = dc_iostream_write (device->iostream, command, sizeof (command), NULL);
 		if (status != DC_STATUS_SUCCESS) {
@@ -210,16 +218,22 @@ citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	return citizen_aqualand_download (abstract, buffer, NULL);
+}
+
 static dc_status_t
 citizen_aqualand_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
 	citizen_aqualand_device_t *device = (citizen_aqualand_device_t *) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = citizen_aqualand_device_dump (abstract, buffer);
+	dc_status_t rc = citizen_aqualand_download (abstract, buffer, device->fingerprint);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
 		return rc;
@@ -0,0 +1,177 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "parser-private.h"
+
+#define SPAN (SAMPLE_FLAGS_BEGIN | SAMPLE_FLAGS_END)
+
+/*
+ * Events that mark a single moment, and are never merged with the same
+ * event of the previous sample.
+ */
+static int
+sample_coalesce_instant (unsigned int type)
+{
+	switch (type) {
+	case SAMPLE_EVENT_BOOKMARK:
+	case SAMPLE_EVENT_GASCHANGE:
+	case SAMPLE_EVENT_GASCHANGE2:
+	case SAMPLE_EVENT_HEADING:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static int
+sample_coalesce_equal (const sample_coalesce_event_t *event, dc_sample_value_t value)
+{
+	if (event->type != value.event.type ||
+		event->value != value.event.value ||
+		event->flags != value.event.flags)
+		return 0;
+
+	if (event->name == NULL || value.event.name == NULL)
+		return event->name == value.event.name;
+
+	return strcmp (event->name, value.event.name) == 0;
+}
+
+static void
+sample_coalesce_end (sample_coalesce_t *coalesce, const sample_coalesce_event_t *event)
+{
+	dc_sample_value_t value = {0};
+
+	value.event.type = event->type;
+	value.event.time = 0;
+	value.event.name = event->name;
+	value.event.flags = event->flags | SAMPLE_FLAGS_END;
+	value.event.value = event->value;
+
+	coalesce->callback (DC_SAMPLE_EVENT, value, coalesce->userdata);
+}
+
+/*
+ * End the events that were not repeated in the current sample, and
+ * start looking for the others in the next sample.
+ */
+static void
+sample_coalesce_expire (sample_coalesce_t *coalesce)
+{
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < coalesce->count; ++i) {
+		if (coalesce->active[i].seen) {
+			coalesce->active[i].seen = 0;
+			coalesce->active[n++] = coalesce->active[i];
+		} else {
+			sample_coalesce_end (coalesce, coalesce->active + i);
+		}
+	}
+
+	coalesce->count = n;
+}
+
+void
+sample_coalesce_init (sample_coalesce_t *coalesce, dc_sample_callback_t callback, void *userdata)
+{
+	coalesce->callback = callback;
+	coalesce->userdata = userdata;
+	coalesce->count = 0;
+}
+
+void
+sample_coalesce_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_coalesce_t *coalesce = (sample_coalesce_t *) userdata;
+
+	if (coalesce->callback == NULL)
+		return;
+
+	if (type == DC_SAMPLE_TIME) {
+		// The end of a run belongs to the first sample without the
+		// event, which is complete once the next sample starts.
+		sample_coalesce_expire (coalesce);
+		coalesce->callback (type, value, coalesce->userdata);
+		return;
+	}
+
+	// Events with an explicit begin or end are already spans.
+	if (type != DC_SAMPLE_EVENT || (value.event.flags & SPAN) ||
+		sample_coalesce_instant (value.event.type)) {
+		coalesce->callback (type, value, coalesce->userdata);
+		return;
+	}
+
+	for (unsigned int i = 0; i < coalesce->count; ++i) {
+		if (sample_coalesce_equal (coalesce->active + i, value)) {
+			coalesce->active[i].seen = 1;
+			return;
+		}
+	}
+
+	// Without a free slot, the event is reported unchanged.
+	if (coalesce->count >= SAMPLE_COALESCE_MAX) {
+		coalesce->callback (type, value, coalesce->userdata);
+		return;
+	}
+
+	sample_coalesce_event_t *event = coalesce->active + coalesce->count++;
+	event->type = value.event.type;
+	event->name = value.event.name;
+	event->flags = value.event.flags;
+	event->value = value.event.value;
+	event->seen = 1;
+
+	value.event.flags |= SAMPLE_FLAGS_BEGIN;
+	coalesce->callback (type, value, coalesce->userdata);
+}
+
+void
+sample_coalesce_finish (sample_coalesce_t *coalesce)
+{
+	if (coalesce->callback == NULL)
+		return;
+
+	// The events of the last sample last until the end of the dive,
+	// and remain open.
+	sample_coalesce_expire (coalesce);
+	coalesce->count = 0;
+}
+
+dc_status_t
+sample_walk (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	if (!parser->coalesce)
+		return parser->vtable->samples_foreach (parser, callback, userdata);
+
+	sample_coalesce_t coalesce;
+	sample_coalesce_init (&coalesce, callback, userdata);
+
+	dc_status_t status = parser->vtable->samples_foreach (parser, sample_coalesce_cb, &coalesce);
+	if (status == DC_STATUS_SUCCESS)
+		sample_coalesce_finish (&coalesce);
+
+	return status;
+}
@@ -35,6 +35,9 @@
 
 #define MAXRETRIES 2
 
+#define SZ_SEGMENT     0x40000
+#define SZ_SEGMENT_LOW 0x10000
+
 #define COCHRAN_MODEL_COMMANDER_TM 0
 #define COCHRAN_MODEL_COMMANDER_PRE21000 1
 #define COCHRAN_MODEL_COMMANDER_AIR_NITROX 2
@@ -542,31 +545,51 @@ cochran_commander_read (cochran_commander_device_t *device, dc_event_progress_t
 static dc_status_t
 cochran_commander_read_retry (cochran_commander_device_t *device, dc_event_progress_t *progress, unsigned int address, unsigned char data[], unsigned int size)
 {
-	// Save the state of the progress events.
-	unsigned int saved = 0;
-	if (progress) {
-		saved = progress->current;
-	}
-
-	unsigned int nretries = 0;
-	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = cochran_commander_read (device, progress, address, data, size)) != DC_STATUS_SUCCESS) {
-		// Automatically discard a corrupted packet,
-		// and request a new one.
-		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
-			return rc;
+	// Large reads are split into segments, which are retried
+	// individually. This way a single transmission error doesn't restart
+	// a dump of several megabytes from the beginning. Every read command
+	// requires a new wake-up sequence at 9600 baud, so the segments are
+	// kept large enough to make this overhead negligible.
+	unsigned int segment = SZ_SEGMENT;
+	if (device->layout->baudrate == 9600)
+		segment = SZ_SEGMENT_LOW;
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
-			return rc;
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		unsigned int len = size - nbytes;
+		if (len > segment)
+			len = segment;
 
-		// Restore the state of the progress events.
+		// Save the state of the progress events.
+		unsigned int saved = 0;
 		if (progress) {
-			progress->current = saved;
+			saved = progress->current;
 		}
+
+		unsigned int nretries = 0;
+		dc_status_t rc = DC_STATUS_SUCCESS;
+		while ((rc = cochran_commander_read (device, progress, address + nbytes, data + nbytes, len)) != DC_STATUS_SUCCESS) {
+			// Automatically discard a corrupted packet,
+			// and request a new one.
+			if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
+				return rc;
+
+			// Abort if the maximum number of retries is reached.
+			if (nretries++ >= MAXRETRIES)
+				return rc;
+
+			device_stats_retry ((dc_device_t *) device);
+
+			// Restore the state of the progress events.
+			if (progress) {
+				progress->current = saved;
+			}
+		}
+
+		nbytes += len;
 	}
 
-	return rc;
+	return DC_STATUS_SUCCESS;
 }
 
 
@@ -678,6 +701,11 @@ cochran_commander_find_fingerprint(cochran_commander_device_t *device, cochran_d
 
 	// Loop through dives to find FP, Accumulate profile data size,
 	// and find the last dive with invalid profile
+	// The walk starts at the most recent dive and stops at the
+	// fingerprint, so it only visits the dives that are downloaded
+	// anyway. The profile sizes of all those dives are needed too, which
+	// is why locating the fingerprint with a binary search wouldn't
+	// reduce the amount of work.
 	for (unsigned int i = 0; i <= dive_count; ++i) {
 		unsigned int idx = (device->layout->rb_logbook_entry_count + head_dive - (i + 1)) % device->layout->rb_logbook_entry_count;
 
@@ -742,6 +770,8 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, const c
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	status = cochran_commander_serial_setup(device);
 	if (status != DC_STATUS_SUCCESS) {
 		goto error_close;
@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <libdivecomputer/units.h>
@@ -99,6 +100,7 @@ typedef struct cochran_commander_parser_t {
 	const cochran_parser_layout_t *layout;
 	const event_size_t *events;
 	unsigned int nevents;
+	unsigned char event_index[256];
 } cochran_commander_parser_t ;
 
 static dc_status_t cochran_commander_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
@@ -113,6 +115,9 @@ static const dc_parser_vtable_t cochran_commander_parser_vtable = {
 	cochran_commander_parser_get_datetime, /* datetime */
 	cochran_commander_parser_get_field, /* fields */
 	cochran_commander_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -272,20 +277,15 @@ cochran_commander_handle_event (cochran_commander_parser_t *parser, unsigned cha
 {
 	dc_parser_t *abstract = (dc_parser_t *) parser;
 
-	const cochran_events_t *event = NULL;
-	for (unsigned int i = 0; i < C_ARRAY_SIZE(cochran_events); ++i) {
-		if (cochran_events[i].code == code) {
-			event = cochran_events + i;
-			break;
-		}
-	}
-
-	if (event == NULL) {
+	unsigned int idx = parser->event_index[code];
+	if (idx == 0) {
 		// Unknown event, send warning so we know we missed something
 		WARNING(abstract->context, "Unknown event 0x%02x", code);
 		return 1;
 	}
 
+	const cochran_events_t *event = cochran_events + idx - 1;
+
 	switch (code) {
 	case 0xAB: // Ceiling decrease
 		// Indicated to lower ceiling by 10 ft (deeper)
@@ -307,8 +307,8 @@ cochran_commander_handle_event (cochran_commander_parser_t *parser, unsigned cha
 		// handled in calling function
 		break;
 	default:
-		// Don't send known events of type NONE
-		if (event->type != SAMPLE_EVENT_NONE) {
+		// Don't send known events of type NONE, or unwanted events.
+		if (event->type != SAMPLE_EVENT_NONE && SAMPLE_WANTED (abstract, DC_SAMPLE_EVENT)) {
 			dc_sample_value_t sample = {0};
 			sample.event.type = event->type;
 			sample.event.time = 0;
@@ -324,25 +324,47 @@ cochran_commander_handle_event (cochran_commander_parser_t *parser, unsigned cha
 
 /*
  * Used to find the end of a dive that has an incomplete dive-end
- * block. It parses backwards past inter-dive events.
+ * block. It parses backwards past inter-dive events. Because we are
+ * parsing backwards and the events vary in size, we can't be sure the
+ * byte that matches an event code is an event code or data from inside
+ * a longer or shorter event. Every chain of events that ends at the end
+ * of the data is a candidate, and the earliest start wins.
+ *
+ * A position is the start of a chain when an event of that size starts
+ * there, and ends at the end of the data or at the start of another
+ * chain. The events are shorter than 32 bytes, so a single pass from
+ * the end only needs to remember the positions of the last 32 bytes.
+ * Once none of them starts a chain, no earlier position can either.
+ * Every chain start counts as a record of the work limits.
  */
 static int
 cochran_commander_backparse(cochran_commander_parser_t *parser, const unsigned char *samples, int size)
 {
-	int result = size, best_result = size;
-
-	for (unsigned int i = 0; i < parser->nevents; i++) {
-		int ptr = size - parser->events[i].size;
-		if (ptr > 0 && samples[ptr] == parser->events[i].code) {
-			// Recurse to find the largest match. Because we are parsing backwards
-			// and the events vary in size we can't be sure the byte that matches
-			// the event code is an event code or data from inside a longer or shorter
-			// event.
-			result = cochran_commander_backparse(parser, samples, ptr);
+	int best_result = size;
+
+	if (dc_parser_work(&parser->base, 1, 0, 0) != DC_STATUS_SUCCESS)
+		return size;
+
+	// Bit n is set when the position n bytes after the current one is
+	// the start of a chain (or the end of the data).
+	unsigned int window = 1;
+
+	for (int ptr = size - 1; ptr > 0 && window != 0; ptr--) {
+		window <<= 1;
+
+		for (unsigned int i = 0; i < parser->nevents; i++) {
+			if (samples[ptr] == parser->events[i].code &&
+				parser->events[i].size < 32 &&
+				(window & (1u << parser->events[i].size))) {
+				window |= 1;
+				break;
+			}
 		}
 
-		if (result < best_result) {
-			best_result = result;
+		if (window & 1) {
+			best_result = ptr;
+			if (dc_parser_work(&parser->base, 1, 0, 0) != DC_STATUS_SUCCESS)
+				break;
 		}
 	}
 
@@ -396,6 +418,14 @@ cochran_commander_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 		goto error_free;
 	}
 
+	// Map the event codes to their (one based) index in the event table,
+	// to avoid searching the table for every event in the samples.
+	memset (parser->event_index, 0, sizeof (parser->event_index));
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(cochran_events); ++i) {
+		if (parser->event_index[cochran_events[i].code] == 0)
+			parser->event_index[cochran_events[i].code] = i + 1;
+	}
+
 	*out = (dc_parser_t *) parser;
 
 	return DC_STATUS_SUCCESS;
@@ -696,8 +726,17 @@ cochran_commander_parser_samples_foreach_emc (dc_parser_t *abstract, dc_sample_c
 		WARNING(abstract->context, "Incomplete dive on %02d/%02d/%02d at %02d:%02d:%02d, trying to parse samples",
 				d.year, d.month, d.day, d.hour, d.minute, d.second);
 
-		// Eliminate inter-dive events
-		size = cochran_commander_backparse(parser, samples, size);
+		// Eliminate inter-dive events. The search is an extra pass over
+		// the data, so the result is kept in the profile index for the
+		// next walk.
+		if (!abstract->index.valid) {
+			unsigned int end = cochran_commander_backparse(parser, samples, size);
+			if (abstract->work.exceeded)
+				return DC_STATUS_DATAFORMAT;
+			abstract->index.end = end;
+			abstract->index.valid = 1;
+		}
+		size = abstract->index.end;
 	}
 
 	// Cochran samples depth every second and varies between ascent rate
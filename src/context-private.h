@@ -27,8 +27,11 @@
 #endif
 
 #include <libdivecomputer/context.h>
+#include <libdivecomputer/buffer.h>
 #include <libdivecomputer/custom_io.h>
 
+#include "timer.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -72,12 +75,263 @@ dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *
 dc_status_t
 dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size);
 
+typedef struct dc_bluetooth_cache_t dc_bluetooth_cache_t;
+typedef struct dc_irda_cache_t dc_irda_cache_t;
+typedef struct dc_syncindex_t dc_syncindex_t;
+typedef struct dc_trace_t dc_trace_t;
+typedef struct dc_buffer_pool_t dc_buffer_pool_t;
+typedef struct suunto_eonsteel_cache_t suunto_eonsteel_cache_t;
+
+#define SYNCINDEX_MAXSIZE 32
+
 dc_custom_io_t*
 _dc_context_custom_io (dc_context_t *context);
 
+/*
+ * The extensions of the custom I/O, if it is still the one registered
+ * with the context, and none otherwise.
+ */
+void
+_dc_context_custom_io_ext (dc_context_t *context, dc_custom_io_t *io, dc_custom_io_ext_t *ext);
+
+dc_bluetooth_cache_t *
+dc_context_get_bluetooth_cache (dc_context_t *context);
+
+dc_irda_cache_t *
+dc_context_get_irda_cache (dc_context_t *context);
+
+suunto_eonsteel_cache_t *
+dc_context_get_eonsteel_cache (dc_context_t *context);
+
+void *
+dc_context_alloc (dc_context_t *context, size_t size);
+
+void *
+dc_context_realloc (dc_context_t *context, void *ptr, size_t oldsize, size_t newsize);
+
+void
+dc_context_release (dc_context_t *context, void *ptr);
+
+/*
+ * Attribute the memory allocated between the begin and the end of a
+ * scope (a device session or a parser call) to its statistics. The
+ * peak is the largest amount held by the statistics during any of its
+ * scopes. Scopes may be nested on the same thread.
+ */
+typedef struct dc_memory_scope_t {
+	size_t current;
+	size_t watermark;
+	unsigned int allocations;
+	unsigned int releases;
+} dc_memory_scope_t;
+
+void
+dc_context_memory_begin (dc_context_t *context, dc_memory_scope_t *scope);
+
+void
+dc_context_memory_end (dc_context_t *context, const dc_memory_scope_t *scope, dc_memory_stats_t *stats);
+
+struct dc_parser_pool_t *
+dc_context_get_parser_pool (dc_context_t *context);
+
+dc_buffer_pool_t *
+dc_context_get_buffer_pool (dc_context_t *context);
+
+dc_status_t
+dc_buffer_pool_new (dc_buffer_pool_t **pool, unsigned int size);
+
+void
+dc_buffer_pool_free (dc_buffer_pool_t *pool);
+
+/*
+ * Watch the I/O streams of the devices opened on the calling thread.
+ * The callback is invoked when a device attaches its stream, and again
+ * (with attached set to zero) right before any stream is closed, such
+ * that another thread can cancel a connection attempt in progress. A
+ * NULL callback removes the watch of the calling thread.
+ */
+typedef void (*dc_iostream_watch_t) (dc_iostream_t *iostream, int attached, void *userdata);
+
+dc_status_t
+dc_context_watch_iostream (dc_context_t *context, dc_iostream_watch_t callback, void *userdata);
+
+void
+dc_context_notify_iostream (dc_context_t *context, dc_iostream_t *iostream, int attached);
+
+unsigned int
+dc_context_get_blocksize (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial);
+
+void
+dc_context_set_blocksize (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int blocksize);
+
+/*
+ * Cache of the identifiers of a device, other than the serial number,
+ * which the backends would otherwise read again for every session. The
+ * serial number is the key, and should be read to validate the cached
+ * values. Returns non-zero if the device is found.
+ */
+int
+dc_context_get_identity (dc_context_t *context, dc_family_t family, unsigned int serial, unsigned int *firmware, unsigned int *hardware);
+
+void
+dc_context_set_identity (dc_context_t *context, dc_family_t family, unsigned int serial, unsigned int firmware, unsigned int hardware);
+
+/*
+ * Cache of the most recently downloaded dive manifest of a device. The
+ * backends may use it to stop downloading the manifest as soon as a
+ * known record appears. The cached manifest is copied into the buffer.
+ */
+int
+dc_context_get_manifest (dc_context_t *context, dc_family_t family, unsigned int serial, dc_buffer_t *buffer);
+
+void
+dc_context_set_manifest (dc_context_t *context, dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size);
+
+/*
+ * Mirror of the memory of a device, from a previous dump. The mirror is
+ * copied into the buffer if it has the expected size. The backends add
+ * the new mirror with dc_context_mirror_add after a successful dump.
+ */
+int
+dc_context_get_mirror (dc_context_t *context, dc_family_t family, unsigned int serial, unsigned char data[], unsigned int size);
+
+int
+dc_context_mirror_enabled (dc_context_t *context);
+
+/*
+ * Check a buffer of the given size against the memory budget. If it
+ * doesn't fit, an error is logged and DC_STATUS_NOMEMORY is returned.
+ */
+dc_status_t
+dc_context_check_memory (dc_context_t *context, size_t size);
+
+unsigned int
+dc_context_get_memory_budget (dc_context_t *context);
+
+/*
+ * Cache of the connection settings that were detected for a device on a
+ * particular port, such as the baudrate. The backends may use it to try
+ * the right variant first when the same port is opened again. A value of
+ * zero means nothing is known.
+ */
+unsigned int
+dc_context_get_profile (dc_context_t *context, dc_family_t family, const char *name);
+
+void
+dc_context_set_profile (dc_context_t *context, dc_family_t family, const char *name, unsigned int value);
+
+int
+dc_context_syncindex_contains (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size);
+
+int
+dc_context_syncindex_enabled (dc_context_t *context);
+
+/*
+ * The monotonic clock shared by everything that uses the context, in
+ * microseconds since the context was created. A caller that tolerates
+ * an error up to the given resolution (in microseconds) gets the faster
+ * coarse clock, if its resolution is good enough. Without a context,
+ * the origin of the clock is arbitrary.
+ */
+dc_status_t
+dc_context_clock (dc_context_t *context, dc_usecs_t resolution, dc_usecs_t *usecs);
+
+/*
+ * Trace spans. The begin function returns the start time of the span,
+ * and the end function records the span under the given static name.
+ * Both do nothing more than a check when the trace is disabled.
+ */
+dc_usecs_t
+dc_context_trace_begin (dc_context_t *context);
+
+void
+dc_context_trace_end (dc_context_t *context, const char *name, dc_usecs_t begin);
+
+typedef enum dc_parser_call_t {
+	DC_PARSER_CALL_SET_DATA,
+	DC_PARSER_CALL_DATETIME,
+	DC_PARSER_CALL_FIELD,
+	DC_PARSER_CALL_SAMPLES
+} dc_parser_call_t;
+
+/*
+ * Parser statistics. The begin function returns the start time of the
+ * call, and the end function adds the call to the counters of the
+ * family and model. Both do nothing more than a check when the
+ * statistics are disabled.
+ */
+dc_nsecs_t
+dc_context_parser_begin (dc_context_t *context);
+
+void
+dc_context_parser_end (dc_context_t *context, dc_family_t family, unsigned int model, dc_parser_call_t call, dc_nsecs_t begin, unsigned int nsamples, unsigned int nbytes);
+
 dc_status_t
 dc_custom_io_serial_open(dc_iostream_t **out, dc_context_t *context, const char *name);
 
+dc_status_t
+dc_bluetooth_cache_new (dc_bluetooth_cache_t **cache);
+
+void
+dc_bluetooth_cache_free (dc_bluetooth_cache_t *cache);
+
+dc_status_t
+dc_irda_cache_new (dc_irda_cache_t **cache);
+
+void
+dc_irda_cache_free (dc_irda_cache_t *cache);
+
+dc_status_t
+dc_syncindex_new (dc_syncindex_t **index);
+
+void
+dc_syncindex_free (dc_syncindex_t *index);
+
+dc_status_t
+dc_syncindex_add (dc_syncindex_t *index, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size);
+
+int
+dc_syncindex_contains (dc_syncindex_t *index, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size);
+
+void
+dc_syncindex_foreach (dc_syncindex_t *index, dc_syncindex_callback_t callback, void *userdata);
+
+void
+dc_syncindex_clear (dc_syncindex_t *index);
+
+dc_status_t
+dc_trace_new (dc_trace_t **trace, unsigned int size);
+
+void
+dc_trace_free (dc_trace_t *trace);
+
+dc_usecs_t
+dc_trace_now (dc_trace_t *trace);
+
+void
+dc_trace_add (dc_trace_t *trace, const char *name, dc_usecs_t begin, dc_usecs_t end);
+
+void
+dc_trace_foreach (dc_trace_t *trace, dc_trace_callback_t callback, void *userdata);
+
+dc_status_t
+suunto_eonsteel_cache_new (suunto_eonsteel_cache_t **cache);
+
+void
+suunto_eonsteel_cache_free (suunto_eonsteel_cache_t *cache);
+
+size_t
+dc_custom_io_packet_mtu(dc_context_t *context, dc_custom_io_t *io);
+
+dc_status_t
+dc_custom_io_packet_read_many(dc_context_t *context, dc_custom_io_t *io, void *data, size_t size, size_t *actual);
+
+dc_status_t
+dc_custom_io_packet_set_params(dc_context_t *context, dc_custom_io_t *io, unsigned int hints);
+
+dc_status_t
+dc_custom_io_serial_set_params(dc_iostream_t *iostream, unsigned int hints);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -30,23 +30,130 @@
 #endif
 
 #include "context-private.h"
+#include "parser-private.h"
+#include "thread.h"
+#include "cpu-private.h"
 #include "timer.h"
 
 #include <libdivecomputer/custom_io.h>
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define NBLOCKSIZES 8
+
+#define NMANIFESTS 4
+
+#define NIDENTITIES 8
+
+#define NMIRRORS 4
+#define NWATCHES 8
+
+#define NPROFILES 4
+#define NPARSERSTATS 32
+#define SZ_PROFILE_NAME 128
+
+#define NCATEGORIES (DC_LOGCATEGORY_PARSER + 1)
+
+#ifdef ENABLE_LOGGING
+typedef struct dc_logqueue_t dc_logqueue_t;
+#endif
+
+typedef struct dc_blocksize_t {
+	dc_family_t family;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int blocksize;
+} dc_blocksize_t;
+
+typedef struct dc_identity_t {
+	dc_family_t family;
+	unsigned int serial;
+	unsigned int firmware;
+	unsigned int hardware;
+} dc_identity_t;
+
+typedef struct dc_manifest_t {
+	dc_family_t family;
+	unsigned int serial;
+	unsigned char *data;
+	unsigned int size;
+} dc_manifest_t;
+
+typedef struct dc_mirror_t {
+	dc_family_t family;
+	unsigned int serial;
+	unsigned char *data;
+	unsigned int size;
+} dc_mirror_t;
+
+typedef struct dc_watch_t {
+	unsigned long long thread;
+	dc_iostream_watch_t callback;
+	void *userdata;
+} dc_watch_t;
+
+typedef struct dc_profile_t {
+	dc_family_t family;
+	char name[SZ_PROFILE_NAME];
+	unsigned int value;
+} dc_profile_t;
+
 struct dc_context_t {
 	dc_loglevel_t loglevel;
+	dc_loglevel_t loglevels[NCATEGORIES];
+	dc_loglevel_t minlevel;
 	dc_logfunc_t logfunc;
 	void *userdata;
 #ifdef ENABLE_LOGGING
-	char msg[8192 + 32];
-	dc_timer_t *timer;
+	dc_logqueue_t *logqueue;
 #endif
+	dc_usecs_t epoch;
+	dc_usecs_t coarse;
 	dc_custom_io_t *custom_io;
+	dc_custom_io_ext_t custom_io_ext;
 	dc_user_device_t *user_device;
+	dc_parser_pool_t *parser_pool;
+	dc_buffer_pool_t *buffer_pool;
+	dc_bluetooth_cache_t *bluetooth_cache;
+	dc_irda_cache_t *irda_cache;
+	dc_syncindex_t *syncindex;
+	dc_trace_t *trace;
+	dc_parser_stats_t *parserstats;
+	unsigned int nparserstats;
+	suunto_eonsteel_cache_t *eonsteel_cache;
+	dc_allocfunc_t allocfunc;
+	dc_freefunc_t freefunc;
+	void *allocdata;
+	unsigned int memstats;
+	dc_memory_stats_t memory;
+	size_t watermark;
+	dc_mutex_t *memory_mutex;
+	dc_mutex_t *mutex;
+	dc_blocksize_t blocksizes[NBLOCKSIZES];
+	unsigned int nblocksizes;
+	dc_identity_t identities[NIDENTITIES];
+	unsigned int nidentities;
+	dc_manifest_t manifests[NMANIFESTS];
+	unsigned int nmanifests;
+	dc_mirror_t mirrors[NMIRRORS];
+	unsigned int nmirrors;
+	unsigned int mirror;
+	unsigned int memory_budget;
+	unsigned int cpufeatures;
+	dc_profile_t profiles[NPROFILES];
+	unsigned int nprofiles;
+	dc_watch_t watches[NWATCHES];
+	unsigned int nwatches;
 };
 
 #ifdef ENABLE_LOGGING
+/*
+ * The messages are formatted in a buffer on the stack, rather than in
+ * the context, such that logging from multiple threads sharing the same
+ * context is safe (as long as the log function itself is thread-safe).
+ */
+#define MSGSIZE (8192 + 32)
+
 /*
  * A wrapper for the vsnprintf function, which will always null terminate the
  * string and returns a negative value if the destination buffer is too small.
@@ -128,13 +235,22 @@ l_hexdump (char *str, size_t size, const unsigned char data[], size_t n)
 	return (n > maxlength ? -1 : length * 2);
 }
 
+static void
+l_hexdump_message (char *str, size_t size, const char *prefix, const unsigned char data[], size_t n, unsigned int total)
+{
+	int len = l_snprintf (str, size, "%s: size=%u, data=", prefix, total);
+	if (len >= 0) {
+		l_hexdump (str + len, size - len, data, n);
+	}
+}
+
 static void
 logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg, void *userdata)
 {
 	const char *loglevels[] = {"NONE", "ERROR", "WARNING", "INFO", "DEBUG", "ALL"};
 
 	dc_usecs_t now = 0;
-	dc_timer_now (context->timer, &now);
+	dc_context_clock (context, 0, &now);
 
 	unsigned long seconds = now / 1000000;
 	unsigned long microseconds = now % 1000000;
@@ -149,6 +265,276 @@ logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsign
 			loglevels[loglevel], msg);
 	}
 }
+
+/*
+ * In asynchronous mode, the formatted messages are appended to a ring
+ * buffer, and delivered to the log function by a background thread. The
+ * lock is only held while copying a message in or out of the buffer, and
+ * never while the log function is running. When the buffer is full, the
+ * caller waits for the background thread, so no messages are lost.
+ */
+typedef struct dc_logrecord_t {
+	dc_loglevel_t loglevel;
+	const char *file;
+	unsigned int line;
+	const char *function;
+	// Length of the message, or the hexdump prefix (including the
+	// terminator), and the number of raw hexdump bytes following it.
+	size_t length;
+	size_t nbytes;
+	// Hexdump records are formatted by the background thread.
+	int hexdump;
+	unsigned int size;
+} dc_logrecord_t;
+
+struct dc_logqueue_t {
+	dc_context_t *context;
+	dc_mutex_t *mutex;
+	dc_cond_t *available;
+	dc_cond_t *space;
+	dc_thread_t *thread;
+	int quit;
+	size_t head;
+	size_t count;
+	size_t size;
+	unsigned char buffer[];
+};
+
+static void
+logqueue_write (dc_logqueue_t *queue, const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *) data;
+
+	if (size == 0)
+		return;
+
+	size_t tail = (queue->head + queue->count) % queue->size;
+
+	size_t n = queue->size - tail;
+	if (n > size)
+		n = size;
+
+	memcpy (queue->buffer + tail, p, n);
+	memcpy (queue->buffer, p + n, size - n);
+
+	queue->count += size;
+}
+
+static void
+logqueue_read (dc_logqueue_t *queue, void *data, size_t size)
+{
+	unsigned char *p = (unsigned char *) data;
+
+	size_t n = queue->size - queue->head;
+	if (n > size)
+		n = size;
+
+	memcpy (p, queue->buffer + queue->head, n);
+	memcpy (p + n, queue->buffer, size - n);
+
+	queue->head = (queue->head + size) % queue->size;
+	queue->count -= size;
+}
+
+/*
+ * The log function and its userdata are read together under the lock,
+ * such that they can be replaced while other threads are logging.
+ */
+static dc_logfunc_t
+logfunc_get (dc_context_t *context, void **userdata)
+{
+	dc_mutex_lock (context->mutex);
+	dc_logfunc_t func = context->logfunc;
+	*userdata = context->userdata;
+	dc_mutex_unlock (context->mutex);
+
+	return func;
+}
+
+static void
+logcall (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg)
+{
+	void *userdata = NULL;
+	dc_logfunc_t func = logfunc_get (context, &userdata);
+
+	if (func)
+		func (context, loglevel, file, line, function, msg, userdata);
+}
+
+static void
+logqueue_thread (void *userdata)
+{
+	dc_logqueue_t *queue = (dc_logqueue_t *) userdata;
+	dc_context_t *context = queue->context;
+	dc_logrecord_t record;
+	char msg[MSGSIZE];
+	char prefix[MSGSIZE];
+	unsigned char data[MSGSIZE / 2];
+
+	dc_mutex_lock (queue->mutex);
+	while (1) {
+		while (queue->count == 0 && !queue->quit)
+			dc_cond_wait (queue->available, queue->mutex, -1);
+
+		// Exit only after all pending messages are delivered.
+		if (queue->count == 0)
+			break;
+
+		logqueue_read (queue, &record, sizeof (record));
+		logqueue_read (queue, record.hexdump ? prefix : msg, record.length);
+		logqueue_read (queue, data, record.nbytes);
+		dc_cond_broadcast (queue->space);
+
+		// Take the log function together with the message, while the
+		// queue is still locked. The context lock is never held while
+		// logging, so it can safely be taken inside the queue lock.
+		void *logdata = NULL;
+		dc_logfunc_t func = logfunc_get (context, &logdata);
+
+		dc_mutex_unlock (queue->mutex);
+		if (record.hexdump)
+			l_hexdump_message (msg, sizeof (msg), prefix, data, record.nbytes, record.size);
+		if (func)
+			func (context, record.loglevel, record.file, record.line, record.function, msg, logdata);
+		dc_mutex_lock (queue->mutex);
+	}
+	dc_mutex_unlock (queue->mutex);
+}
+
+static void
+logqueue_free (dc_logqueue_t *queue)
+{
+	if (queue == NULL)
+		return;
+
+	if (queue->thread) {
+		dc_mutex_lock (queue->mutex);
+		queue->quit = 1;
+		dc_cond_signal (queue->available);
+		dc_mutex_unlock (queue->mutex);
+		dc_thread_join (queue->thread);
+	}
+
+	dc_cond_free (queue->space);
+	dc_cond_free (queue->available);
+	dc_mutex_free (queue->mutex);
+	free (queue);
+}
+
+static dc_status_t
+logqueue_new (dc_logqueue_t **out, dc_context_t *context, size_t size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Every message must fit in the buffer.
+	if (size < sizeof (dc_logrecord_t) + MSGSIZE)
+		size = sizeof (dc_logrecord_t) + MSGSIZE;
+
+	dc_logqueue_t *queue = (dc_logqueue_t *) malloc (sizeof (*queue) + size);
+	if (queue == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	queue->context = context;
+	queue->mutex = NULL;
+	queue->available = NULL;
+	queue->space = NULL;
+	queue->thread = NULL;
+	queue->quit = 0;
+	queue->head = 0;
+	queue->count = 0;
+	queue->size = size;
+
+	status = dc_mutex_new (&queue->mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&queue->available);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&queue->space);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_thread_new (&queue->thread, logqueue_thread, queue);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	*out = queue;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	logqueue_free (queue);
+	return status;
+}
+
+static void
+logqueue_push (dc_logqueue_t *queue, const dc_logrecord_t *record, const char *text, const unsigned char data[])
+{
+	size_t needed = sizeof (*record) + record->length + record->nbytes;
+
+	dc_mutex_lock (queue->mutex);
+	while (queue->size - queue->count < needed)
+		dc_cond_wait (queue->space, queue->mutex, -1);
+	logqueue_write (queue, record, sizeof (*record));
+	logqueue_write (queue, text, record->length);
+	logqueue_write (queue, data, record->nbytes);
+	dc_cond_signal (queue->available);
+	dc_mutex_unlock (queue->mutex);
+}
+
+static void
+logdeliver (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg)
+{
+	dc_logqueue_t *queue = context->logqueue;
+
+	if (queue == NULL) {
+		logcall (context, loglevel, file, line, function, msg);
+		return;
+	}
+
+	dc_logrecord_t record;
+	record.loglevel = loglevel;
+	record.file = file;
+	record.line = line;
+	record.function = function;
+	record.length = strlen (msg) + 1;
+	record.nbytes = 0;
+	record.hexdump = 0;
+	record.size = 0;
+
+	logqueue_push (queue, &record, msg, NULL);
+}
+
+/*
+ * The category of a message is derived from the name of the source file,
+ * such that no changes are needed at the call sites.
+ */
+static dc_logcategory_t
+logcategory (const char *file)
+{
+	const char *transport[] = {
+		"bluetooth.", "custom.", "custom_io.", "iostream.", "irda.",
+		"serial_posix.", "serial_win32.", "socket.", "usbhid."};
+
+	// Strip the directory.
+	const char *name = file;
+	for (const char *p = file; *p; ++p) {
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (transport); ++i) {
+		if (strncmp (name, transport[i], strlen (transport[i])) == 0)
+			return DC_LOGCATEGORY_TRANSPORT;
+	}
+
+	if (strncmp (name, "parser.", 7) == 0 || strstr (name, "_parser.") != NULL)
+		return DC_LOGCATEGORY_PARSER;
+
+	return DC_LOGCATEGORY_PROTOCOL;
+}
 #endif
 
 dc_status_t
@@ -170,15 +556,79 @@ dc_context_new (dc_context_t **out)
 	context->loglevel = DC_LOGLEVEL_NONE;
 	context->logfunc = NULL;
 #endif
+	for (unsigned int i = 0; i < NCATEGORIES; ++i)
+		context->loglevels[i] = context->loglevel;
+	context->minlevel = context->loglevel;
 	context->userdata = NULL;
 
 #ifdef ENABLE_LOGGING
-	memset (context->msg, 0, sizeof (context->msg));
-	context->timer = NULL;
-	dc_timer_new (&context->timer);
+	context->logqueue = NULL;
 #endif
 
+	// The resolution of the coarse clock is fixed, so it's queried
+	// only once. The clocks share the same origin.
+	context->epoch = 0;
+	context->coarse = dc_timer_resolution (1);
+	dc_timer_clock (0, &context->epoch);
+
 	context->custom_io = NULL;
+	memset (&context->custom_io_ext, 0, sizeof (context->custom_io_ext));
+
+	context->parser_pool = NULL;
+	context->buffer_pool = NULL;
+
+	// The transport caches are created on first use, such that a
+	// context that is only used for parsing doesn't pay for them.
+	context->bluetooth_cache = NULL;
+	context->irda_cache = NULL;
+
+	context->syncindex = NULL;
+
+	context->trace = NULL;
+
+	context->parserstats = NULL;
+	context->nparserstats = 0;
+
+	context->eonsteel_cache = NULL;
+#ifdef ENABLE_FAMILY_SUUNTO
+	suunto_eonsteel_cache_new (&context->eonsteel_cache);
+#endif
+
+	context->allocfunc = NULL;
+	context->freefunc = NULL;
+	context->allocdata = NULL;
+
+	context->memstats = 0;
+	memset (&context->memory, 0, sizeof (context->memory));
+	context->watermark = 0;
+
+	// The caches may be shared by several threads. Without thread
+	// support, the mutex functions are no-ops for a NULL mutex. The
+	// memory statistics have a lock of their own, because the caches
+	// may allocate memory while they hold the other one.
+	context->mutex = NULL;
+	dc_mutex_new (&context->mutex);
+	context->memory_mutex = NULL;
+	dc_mutex_new (&context->memory_mutex);
+
+	memset (context->blocksizes, 0, sizeof (context->blocksizes));
+	context->nblocksizes = 0;
+
+	memset (context->identities, 0, sizeof (context->identities));
+	context->nidentities = 0;
+
+	memset (context->manifests, 0, sizeof (context->manifests));
+	context->nmanifests = 0;
+
+	memset (context->mirrors, 0, sizeof (context->mirrors));
+	context->nmirrors = 0;
+	context->mirror = 0;
+	context->memory_budget = 0;
+	context->cpufeatures = ~0u;
+
+	memset (context->profiles, 0, sizeof (context->profiles));
+	context->nprofiles = 0;
+	context->nwatches = 0;
 
 	*out = context;
 
@@ -191,7 +641,29 @@ dc_context_free (dc_context_t *context)
 	if (context == NULL)
 		return DC_STATUS_SUCCESS;
 
-	dc_timer_free (context->timer);
+#ifdef ENABLE_LOGGING
+	logqueue_free (context->logqueue);
+#endif
+	dc_parser_pool_free (context->parser_pool);
+	dc_bluetooth_cache_free (context->bluetooth_cache);
+	dc_irda_cache_free (context->irda_cache);
+	dc_syncindex_free (context->syncindex);
+	dc_trace_free (context->trace);
+	free (context->parserstats);
+#ifdef ENABLE_FAMILY_SUUNTO
+	suunto_eonsteel_cache_free (context->eonsteel_cache);
+#endif
+	// The buffers freed above may still have been returned to the
+	// buffer pool, so the pool goes last.
+	dc_buffer_pool_t *buffer_pool = context->buffer_pool;
+	context->buffer_pool = NULL;
+	dc_buffer_pool_free (buffer_pool);
+	for (unsigned int i = 0; i < NMANIFESTS; ++i)
+		free (context->manifests[i].data);
+	for (unsigned int i = 0; i < NMIRRORS; ++i)
+		free (context->mirrors[i].data);
+	dc_mutex_free (context->mutex);
+	dc_mutex_free (context->memory_mutex);
 	free (context);
 
 	return DC_STATUS_SUCCESS;
@@ -203,8 +675,39 @@ dc_context_set_custom_io (dc_context_t *context, dc_custom_io_t *custom_io, dc_u
 	if (context == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	// The custom I/O is looked up only when a connection is opened, and
+	// bound to it afterwards. Replacing it doesn't affect the devices
+	// that are already open.
+	dc_mutex_lock (context->mutex);
 	context->custom_io = custom_io;
-	custom_io->user_device = user_device;
+	if (custom_io)
+		custom_io->user_device = user_device;
+	memset (&context->custom_io_ext, 0, sizeof (context->custom_io_ext));
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_custom_io_ext (dc_context_t *context, const dc_custom_io_ext_t *ext)
+{
+	if (context == NULL || (ext && ext->size < sizeof (ext->size)))
+		return DC_STATUS_INVALIDARGS;
+
+	// Copy only the members the application knows about.
+	dc_custom_io_ext_t copy;
+	memset (&copy, 0, sizeof (copy));
+	if (ext)
+		memcpy (&copy, ext, ext->size < sizeof (copy) ? ext->size : sizeof (copy));
+	copy.size = sizeof (copy);
+
+	dc_mutex_lock (context->mutex);
+	if (context->custom_io == NULL) {
+		dc_mutex_unlock (context->mutex);
+		return DC_STATUS_INVALIDARGS;
+	}
+	context->custom_io_ext = copy;
+	dc_mutex_unlock (context->mutex);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -212,127 +715,1270 @@ dc_context_set_custom_io (dc_context_t *context, dc_custom_io_t *custom_io, dc_u
 dc_custom_io_t*
 _dc_context_custom_io (dc_context_t *context)
 {
-	return context->custom_io;
+	dc_mutex_lock (context->mutex);
+	dc_custom_io_t *custom_io = context->custom_io;
+	dc_mutex_unlock (context->mutex);
+
+	return custom_io;
+}
+
+void
+_dc_context_custom_io_ext (dc_context_t *context, dc_custom_io_t *io, dc_custom_io_ext_t *ext)
+{
+	dc_mutex_lock (context->mutex);
+	if (io != NULL && io == context->custom_io) {
+		*ext = context->custom_io_ext;
+	} else {
+		memset (ext, 0, sizeof (*ext));
+		ext->size = sizeof (*ext);
+	}
+	dc_mutex_unlock (context->mutex);
 }
 
 dc_status_t
-dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel)
+dc_context_set_parser_pool (dc_context_t *context, unsigned int size)
 {
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parser_pool_t *pool = NULL;
+
 	if (context == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-#ifdef ENABLE_LOGGING
-	context->loglevel = loglevel;
-#endif
+	if (size) {
+		status = dc_parser_pool_new (&pool, size);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	dc_parser_pool_free (context->parser_pool);
+	context->parser_pool = pool;
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_parser_pool_t *
+dc_context_get_parser_pool (dc_context_t *context)
+{
+	if (context == NULL)
+		return NULL;
+
+	return context->parser_pool;
+}
+
 dc_status_t
-dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata)
+dc_context_set_buffer_pool (dc_context_t *context, unsigned int size)
 {
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_buffer_pool_t *pool = NULL, *old = NULL;
+
 	if (context == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-#ifdef ENABLE_LOGGING
-	context->logfunc = logfunc;
-	context->userdata = userdata;
-#endif
+	if (size) {
+		status = dc_buffer_pool_new (&pool, size);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	// Detach the old pool first, because freeing its buffers must not
+	// return them to a pool again.
+	old = context->buffer_pool;
+	context->buffer_pool = NULL;
+	dc_buffer_pool_free (old);
+	context->buffer_pool = pool;
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
+dc_buffer_pool_t *
+dc_context_get_buffer_pool (dc_context_t *context)
 {
-#ifdef ENABLE_LOGGING
-	va_list ap;
-#endif
+	if (context == NULL)
+		return NULL;
+
+	return context->buffer_pool;
+}
+
+dc_bluetooth_cache_t *
+dc_context_get_bluetooth_cache (dc_context_t *context)
+{
+	dc_bluetooth_cache_t *cache = NULL;
 
 	if (context == NULL)
-		return DC_STATUS_INVALIDARGS;
+		return NULL;
 
-#ifdef ENABLE_LOGGING
-	if (loglevel > context->loglevel)
-		return DC_STATUS_SUCCESS;
+	dc_mutex_lock (context->mutex);
+	if (context->bluetooth_cache == NULL)
+		dc_bluetooth_cache_new (&context->bluetooth_cache);
+	cache = context->bluetooth_cache;
+	dc_mutex_unlock (context->mutex);
 
-	if (context->logfunc == NULL)
-		return DC_STATUS_SUCCESS;
+	return cache;
+}
 
-	va_start (ap, format);
-	l_vsnprintf (context->msg, sizeof (context->msg), format, ap);
-	va_end (ap);
+dc_irda_cache_t *
+dc_context_get_irda_cache (dc_context_t *context)
+{
+	dc_irda_cache_t *cache = NULL;
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
-#endif
+	if (context == NULL)
+		return NULL;
 
-	return DC_STATUS_SUCCESS;
+	dc_mutex_lock (context->mutex);
+	if (context->irda_cache == NULL)
+		dc_irda_cache_new (&context->irda_cache);
+	cache = context->irda_cache;
+	dc_mutex_unlock (context->mutex);
+
+	return cache;
+}
+
+suunto_eonsteel_cache_t *
+dc_context_get_eonsteel_cache (dc_context_t *context)
+{
+	if (context == NULL)
+		return NULL;
+
+	return context->eonsteel_cache;
 }
 
 dc_status_t
-dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode)
+dc_context_set_syncindex (dc_context_t *context, unsigned int enable)
 {
-	const char *errmsg = NULL;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_syncindex_t *index = NULL;
 
-#ifdef _WIN32
-	char buffer[256];
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
 
-	DWORD rc = FormatMessageA (FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-			NULL, errcode, 0, buffer, sizeof (buffer), NULL);
+	dc_mutex_lock (context->mutex);
 
-	/* Remove the CRLF and period at the end of the error message. */
-	while (rc > 0 && (
-		buffer[rc - 1] == '\n' ||
-		buffer[rc - 1] == '\r' ||
-		buffer[rc - 1] == '.'))
-	{
-		buffer[rc - 1] = '\0';
-		rc--;
+	if (enable && context->syncindex == NULL) {
+		status = dc_syncindex_new (&index);
+		if (status == DC_STATUS_SUCCESS)
+			context->syncindex = index;
+	} else if (!enable) {
+		dc_syncindex_free (context->syncindex);
+		context->syncindex = NULL;
 	}
 
-	if (rc > 0)
-		errmsg = buffer;
-#elif defined (HAVE_STRERROR_R)
-	char buffer[256];
+	dc_mutex_unlock (context->mutex);
 
-	int rc = strerror_r (errcode, buffer, sizeof (buffer));
-	if (rc == 0)
-		errmsg = buffer;
-#else
-	/* Fallback to the non-threadsafe function. */
-	errmsg = strerror (errcode);
-#endif
+	return status;
+}
 
-	if (errmsg == NULL)
-		errmsg = "Unknown system error";
+dc_status_t
+dc_context_syncindex_add (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
 
-	return dc_context_log (context, loglevel, file, line, function, "%s (%d)", errmsg, errcode);
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->mutex);
+
+	if (context->syncindex == NULL)
+		status = DC_STATUS_UNSUPPORTED;
+	else
+		status = dc_syncindex_add (context->syncindex, family, model, serial, fingerprint, size);
+
+	dc_mutex_unlock (context->mutex);
+
+	return status;
 }
 
 dc_status_t
-dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size)
+dc_context_syncindex_foreach (dc_context_t *context, dc_syncindex_callback_t callback, void *userdata)
 {
-#ifdef ENABLE_LOGGING
-	int n;
-#endif
+	if (context == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
 
-	if (context == NULL || prefix == NULL)
+	dc_mutex_lock (context->mutex);
+	dc_syncindex_foreach (context->syncindex, callback, userdata);
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_syncindex_clear (dc_context_t *context)
+{
+	if (context == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-#ifdef ENABLE_LOGGING
-	if (loglevel > context->loglevel)
-		return DC_STATUS_SUCCESS;
+	dc_mutex_lock (context->mutex);
+	dc_syncindex_clear (context->syncindex);
+	dc_mutex_unlock (context->mutex);
 
-	if (context->logfunc == NULL)
-		return DC_STATUS_SUCCESS;
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_trace (dc_context_t *context, unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_trace_t *trace = NULL;
 
-	n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", prefix, size);
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
 
-	if (n >= 0) {
-		n = l_hexdump (context->msg + n, sizeof (context->msg) - n, data, size);
+	if (size) {
+		status = dc_trace_new (&trace, size);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
 	}
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	dc_mutex_lock (context->mutex);
+	dc_trace_free (context->trace);
+	context->trace = trace;
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_trace_foreach (dc_context_t *context, dc_trace_callback_t callback, void *userdata)
+{
+	if (context == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->mutex);
+	dc_trace_foreach (context->trace, callback, userdata);
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_parser_stats (dc_context_t *context, unsigned int enable)
+{
+	dc_parser_stats_t *stats = NULL;
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (enable) {
+		stats = (dc_parser_stats_t *) malloc (NPARSERSTATS * sizeof (dc_parser_stats_t));
+		if (stats == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	dc_mutex_lock (context->mutex);
+	if (stats && context->parserstats) {
+		// Keep the counters when already enabled.
+		free (stats);
+	} else {
+		free (context->parserstats);
+		context->parserstats = stats;
+		context->nparserstats = 0;
+	}
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_get_parser_stats (dc_context_t *context, dc_parser_stats_t stats[], unsigned int size, unsigned int *count)
+{
+	if (context == NULL || (stats == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->mutex);
+	unsigned int n = context->nparserstats;
+	if (n > size)
+		n = size;
+	if (n)
+		memcpy (stats, context->parserstats, n * sizeof (dc_parser_stats_t));
+	if (count)
+		*count = context->nparserstats;
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_nsecs_t
+dc_context_parser_begin (dc_context_t *context)
+{
+	dc_nsecs_t now = 0;
+
+	if (context == NULL || context->parserstats == NULL)
+		return 0;
+
+	dc_timer_clock_nsecs (&now);
+
+	return now;
+}
+
+void
+dc_context_parser_end (dc_context_t *context, dc_family_t family, unsigned int model, dc_parser_call_t call, dc_nsecs_t begin, unsigned int nsamples, unsigned int nbytes)
+{
+	dc_nsecs_t now = 0;
+
+	if (context == NULL || context->parserstats == NULL)
+		return;
+
+	dc_timer_clock_nsecs (&now);
+
+	dc_mutex_lock (context->mutex);
+
+	dc_parser_stats_t *stats = NULL;
+	for (unsigned int i = 0; i < context->nparserstats; ++i) {
+		if (context->parserstats[i].family == family &&
+			context->parserstats[i].model == model) {
+			stats = context->parserstats + i;
+			break;
+		}
+	}
+
+	if (stats == NULL && context->nparserstats < NPARSERSTATS) {
+		stats = context->parserstats + context->nparserstats++;
+		memset (stats, 0, sizeof (*stats));
+		stats->family = family;
+		stats->model = model;
+	}
+
+	if (stats) {
+		dc_parser_counter_t *counter = NULL;
+		switch (call) {
+		case DC_PARSER_CALL_SET_DATA:
+			counter = &stats->set_data;
+			break;
+		case DC_PARSER_CALL_DATETIME:
+			counter = &stats->datetime;
+			break;
+		case DC_PARSER_CALL_FIELD:
+			counter = &stats->field;
+			break;
+		default:
+			counter = &stats->samples;
+			break;
+		}
+
+		counter->calls++;
+		counter->nsecs += now > begin ? now - begin : 0;
+		stats->nsamples += nsamples;
+		stats->nbytes += nbytes;
+	}
+
+	dc_mutex_unlock (context->mutex);
+}
+
+dc_status_t
+dc_context_clock (dc_context_t *context, dc_usecs_t resolution, dc_usecs_t *usecs)
+{
+	if (context == NULL)
+		return dc_timer_clock (0, usecs);
+
+	unsigned int coarse = context->coarse && context->coarse <= resolution;
+
+	dc_usecs_t now = 0;
+	dc_status_t status = dc_timer_clock (coarse, &now);
+
+	// The coarse clock may lag slightly behind the creation time.
+	if (usecs)
+		*usecs = now > context->epoch ? now - context->epoch : 0;
+
+	return status;
+}
+
+// The trace is only changed while no devices or parsers are in use, so
+// the hot paths can check it without taking the lock.
+dc_usecs_t
+dc_context_trace_begin (dc_context_t *context)
+{
+	if (context == NULL || context->trace == NULL)
+		return 0;
+
+	return dc_trace_now (context->trace);
+}
+
+void
+dc_context_trace_end (dc_context_t *context, const char *name, dc_usecs_t begin)
+{
+	if (context == NULL || context->trace == NULL)
+		return;
+
+	dc_trace_add (context->trace, name, begin, dc_trace_now (context->trace));
+}
+
+int
+dc_context_syncindex_enabled (dc_context_t *context)
+{
+	if (context == NULL)
+		return 0;
+
+	dc_mutex_lock (context->mutex);
+	int enabled = context->syncindex != NULL;
+	dc_mutex_unlock (context->mutex);
+
+	return enabled;
+}
+
+int
+dc_context_syncindex_contains (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size)
+{
+	if (context == NULL)
+		return 0;
+
+	dc_mutex_lock (context->mutex);
+	int found = dc_syncindex_contains (context->syncindex, family, model, serial, fingerprint, size);
+	dc_mutex_unlock (context->mutex);
+
+	return found;
+}
+
+typedef int (*dc_table_match_t) (const void *entry, const void *key);
+
+/*
+ * Look up the entry that matches the key, in one of the small tables of
+ * the context. The count holds the number of entries that were added,
+ * and wraps between n and 2 * n once the table is full, such that the
+ * oldest entry is always at count % n. Without a match, and with the
+ * add flag set, the slot for a new entry is returned instead.
+ */
+static void *
+dc_table_lookup (void *table, size_t size, unsigned int n, unsigned int *count, dc_table_match_t match, const void *key, int add)
+{
+	unsigned char *entries = (unsigned char *) table;
+
+	unsigned int used = *count < n ? *count : n;
+	for (unsigned int i = 0; i < used; ++i) {
+		if (match (entries + i * size, key))
+			return entries + i * size;
+	}
+
+	if (!add)
+		return NULL;
+
+	// Add a new entry, replacing the oldest one when the table is full.
+	unsigned char *entry = entries + (*count % n) * size;
+	(*count)++;
+	if (*count == 2 * n)
+		*count = n;
+
+	return entry;
+}
+
+#define TABLE_LOOKUP(table, count, match, key, add) \
+	dc_table_lookup (table, sizeof (table[0]), C_ARRAY_SIZE (table), &(count), match, key, add)
+
+static int
+dc_blocksize_match (const void *entry, const void *key)
+{
+	const dc_blocksize_t *a = (const dc_blocksize_t *) entry;
+	const dc_blocksize_t *b = (const dc_blocksize_t *) key;
+
+	return a->family == b->family && a->model == b->model && a->serial == b->serial;
+}
+
+unsigned int
+dc_context_get_blocksize (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial)
+{
+	if (context == NULL)
+		return 0;
+
+	unsigned int blocksize = 0;
+	dc_blocksize_t key = {family, model, serial, 0};
+
+	dc_mutex_lock (context->mutex);
+
+	const dc_blocksize_t *entry = (const dc_blocksize_t *) TABLE_LOOKUP (context->blocksizes, context->nblocksizes, dc_blocksize_match, &key, 0);
+	if (entry)
+		blocksize = entry->blocksize;
+
+	dc_mutex_unlock (context->mutex);
+
+	return blocksize;
+}
+
+void
+dc_context_set_blocksize (dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int blocksize)
+{
+	if (context == NULL)
+		return;
+
+	dc_blocksize_t key = {family, model, serial, blocksize};
+
+	dc_mutex_lock (context->mutex);
+	dc_blocksize_t *entry = (dc_blocksize_t *) TABLE_LOOKUP (context->blocksizes, context->nblocksizes, dc_blocksize_match, &key, 1);
+	*entry = key;
+	dc_mutex_unlock (context->mutex);
+}
+
+static int
+dc_manifest_match (const void *entry, const void *key)
+{
+	const dc_manifest_t *a = (const dc_manifest_t *) entry;
+	const dc_manifest_t *b = (const dc_manifest_t *) key;
+
+	return a->family == b->family && a->serial == b->serial;
+}
+
+int
+dc_context_get_manifest (dc_context_t *context, dc_family_t family, unsigned int serial, dc_buffer_t *buffer)
+{
+	if (context == NULL || buffer == NULL)
+		return 0;
+
+	int found = 0;
+	dc_manifest_t key = {family, serial, NULL, 0};
+
+	dc_mutex_lock (context->mutex);
+
+	const dc_manifest_t *entry = (const dc_manifest_t *) TABLE_LOOKUP (context->manifests, context->nmanifests, dc_manifest_match, &key, 0);
+	if (entry) {
+		found = dc_buffer_clear (buffer) &&
+			dc_buffer_append (buffer, entry->data, entry->size);
+	}
+
+	dc_mutex_unlock (context->mutex);
+
+	return found;
+}
+
+void
+dc_context_set_manifest (dc_context_t *context, dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	if (context == NULL || (data == NULL && size))
+		return;
+
+	unsigned char *copy = (unsigned char *) malloc (size ? size : 1);
+	if (copy == NULL)
+		return;
+
+	if (size)
+		memcpy (copy, data, size);
+
+	dc_manifest_t key = {family, serial, copy, size};
+
+	dc_mutex_lock (context->mutex);
+
+	dc_manifest_t *entry = (dc_manifest_t *) TABLE_LOOKUP (context->manifests, context->nmanifests, dc_manifest_match, &key, 1);
+	free (entry->data);
+	*entry = key;
+
+	dc_mutex_unlock (context->mutex);
+}
+
+dc_status_t
+dc_context_set_mirror (dc_context_t *context, unsigned int enable)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->mutex);
+
+	context->mirror = (enable != 0);
+	if (!enable) {
+		for (unsigned int i = 0; i < NMIRRORS; ++i)
+			free (context->mirrors[i].data);
+		memset (context->mirrors, 0, sizeof (context->mirrors));
+		context->nmirrors = 0;
+	}
+
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_mirror_match (const void *entry, const void *key)
+{
+	const dc_mirror_t *a = (const dc_mirror_t *) entry;
+	const dc_mirror_t *b = (const dc_mirror_t *) key;
+
+	return a->family == b->family && a->serial == b->serial;
+}
+
+dc_status_t
+dc_context_mirror_add (dc_context_t *context, dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (context == NULL || data == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned char *copy = (unsigned char *) malloc (size);
+	if (copy == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	memcpy (copy, data, size);
+
+	dc_mirror_t key = {family, serial, copy, size};
+
+	dc_mutex_lock (context->mutex);
+
+	if (!context->mirror) {
+		free (copy);
+		status = DC_STATUS_UNSUPPORTED;
+		goto out;
+	}
+
+	dc_mirror_t *entry = (dc_mirror_t *) TABLE_LOOKUP (context->mirrors, context->nmirrors, dc_mirror_match, &key, 1);
+	free (entry->data);
+	*entry = key;
+
+out:
+	dc_mutex_unlock (context->mutex);
+
+	return status;
+}
+
+dc_status_t
+dc_context_mirror_foreach (dc_context_t *context, dc_mirror_callback_t callback, void *userdata)
+{
+	if (context == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->mutex);
+
+	for (unsigned int i = 0; i < NMIRRORS; ++i) {
+		const dc_mirror_t *entry = &context->mirrors[i];
+		if (entry->data != NULL)
+			callback (entry->family, entry->serial, entry->data, entry->size, userdata);
+	}
+
+	dc_mutex_unlock (context->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_context_get_mirror (dc_context_t *context, dc_family_t family, unsigned int serial, unsigned char data[], unsigned int size)
+{
+	if (context == NULL || data == NULL)
+		return 0;
+
+	int found = 0;
+	dc_mirror_t key = {family, serial, NULL, 0};
+
+	dc_mutex_lock (context->mutex);
+
+	const dc_mirror_t *entry = (const dc_mirror_t *) TABLE_LOOKUP (context->mirrors, context->nmirrors, dc_mirror_match, &key, 0);
+	if (entry && entry->size == size) {
+		memcpy (data, entry->data, size);
+		found = 1;
+	}
+
+	dc_mutex_unlock (context->mutex);
+
+	return found;
+}
+
+int
+dc_context_mirror_enabled (dc_context_t *context)
+{
+	if (context == NULL)
+		return 0;
+
+	dc_mutex_lock (context->mutex);
+	int enabled = context->mirror;
+	dc_mutex_unlock (context->mutex);
+
+	return enabled;
+}
+
+dc_status_t
+dc_context_set_memory_budget (dc_context_t *context, unsigned int size)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context->memory_budget = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_cpufeatures (dc_context_t *context, unsigned int mask)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context->cpufeatures = mask;
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+dc_context_get_cpufeatures (dc_context_t *context)
+{
+	if (context == NULL)
+		return dc_cpu_features ();
+
+	return dc_cpu_features () & context->cpufeatures;
+}
+
+unsigned int
+dc_context_get_memory_budget (dc_context_t *context)
+{
+	if (context == NULL)
+		return 0;
+
+	return context->memory_budget;
+}
+
+dc_status_t
+dc_context_check_memory (dc_context_t *context, size_t size)
+{
+	unsigned int budget = dc_context_get_memory_budget (context);
+
+	if (budget && size > budget) {
+		ERROR (context, "A buffer of %lu bytes exceeds the memory budget of %u bytes.",
+			(unsigned long) size, budget);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_watch_iostream (dc_context_t *context, dc_iostream_watch_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long thread = dc_thread_self ();
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->mutex);
+
+	unsigned int i = 0;
+	while (i < context->nwatches && context->watches[i].thread != thread)
+		i++;
+
+	if (callback == NULL) {
+		// Remove the watch of the calling thread.
+		if (i < context->nwatches) {
+			context->nwatches--;
+			context->watches[i] = context->watches[context->nwatches];
+		}
+	} else if (i < context->nwatches || context->nwatches < NWATCHES) {
+		if (i == context->nwatches)
+			context->nwatches++;
+		context->watches[i].thread = thread;
+		context->watches[i].callback = callback;
+		context->watches[i].userdata = userdata;
+	} else {
+		status = DC_STATUS_NOMEMORY;
+	}
+
+	dc_mutex_unlock (context->mutex);
+
+	return status;
+}
+
+void
+dc_context_notify_iostream (dc_context_t *context, dc_iostream_t *iostream, int attached)
+{
+	dc_iostream_watch_t callback = NULL;
+	void *userdata = NULL;
+
+	if (context == NULL)
+		return;
+
+	unsigned long long thread = dc_thread_self ();
+
+	dc_mutex_lock (context->mutex);
+	for (unsigned int i = 0; i < context->nwatches; ++i) {
+		if (context->watches[i].thread == thread) {
+			callback = context->watches[i].callback;
+			userdata = context->watches[i].userdata;
+			break;
+		}
+	}
+	dc_mutex_unlock (context->mutex);
+
+	if (callback)
+		callback (iostream, attached, userdata);
+}
+
+static int
+dc_profile_match (const void *entry, const void *key)
+{
+	const dc_profile_t *a = (const dc_profile_t *) entry;
+	const dc_profile_t *b = (const dc_profile_t *) key;
+
+	return a->family == b->family && strcmp (a->name, b->name) == 0;
+}
+
+unsigned int
+dc_context_get_profile (dc_context_t *context, dc_family_t family, const char *name)
+{
+	if (context == NULL || name == NULL || strlen (name) >= SZ_PROFILE_NAME)
+		return 0;
+
+	unsigned int value = 0;
+	dc_profile_t key = {family, {0}, 0};
+	strcpy (key.name, name);
+
+	dc_mutex_lock (context->mutex);
+
+	const dc_profile_t *entry = (const dc_profile_t *) TABLE_LOOKUP (context->profiles, context->nprofiles, dc_profile_match, &key, 0);
+	if (entry)
+		value = entry->value;
+
+	dc_mutex_unlock (context->mutex);
+
+	return value;
+}
+
+void
+dc_context_set_profile (dc_context_t *context, dc_family_t family, const char *name, unsigned int value)
+{
+	// Names that don't fit are simply not cached.
+	if (context == NULL || name == NULL || strlen (name) >= SZ_PROFILE_NAME)
+		return;
+
+	dc_profile_t key = {family, {0}, value};
+	strcpy (key.name, name);
+
+	dc_mutex_lock (context->mutex);
+	dc_profile_t *entry = (dc_profile_t *) TABLE_LOOKUP (context->profiles, context->nprofiles, dc_profile_match, &key, 1);
+	*entry = key;
+	dc_mutex_unlock (context->mutex);
+}
+
+static int
+dc_identity_match (const void *entry, const void *key)
+{
+	const dc_identity_t *a = (const dc_identity_t *) entry;
+	const dc_identity_t *b = (const dc_identity_t *) key;
+
+	return a->family == b->family && a->serial == b->serial;
+}
+
+int
+dc_context_get_identity (dc_context_t *context, dc_family_t family, unsigned int serial, unsigned int *firmware, unsigned int *hardware)
+{
+	if (context == NULL)
+		return 0;
+
+	int found = 0;
+	dc_identity_t key = {family, serial, 0, 0};
+
+	dc_mutex_lock (context->mutex);
+
+	const dc_identity_t *entry = (const dc_identity_t *) TABLE_LOOKUP (context->identities, context->nidentities, dc_identity_match, &key, 0);
+	if (entry) {
+		if (firmware)
+			*firmware = entry->firmware;
+		if (hardware)
+			*hardware = entry->hardware;
+		found = 1;
+	}
+
+	dc_mutex_unlock (context->mutex);
+
+	return found;
+}
+
+void
+dc_context_set_identity (dc_context_t *context, dc_family_t family, unsigned int serial, unsigned int firmware, unsigned int hardware)
+{
+	if (context == NULL)
+		return;
+
+	dc_identity_t key = {family, serial, firmware, hardware};
+
+	dc_mutex_lock (context->mutex);
+	dc_identity_t *entry = (dc_identity_t *) TABLE_LOOKUP (context->identities, context->nidentities, dc_identity_match, &key, 1);
+	*entry = key;
+	dc_mutex_unlock (context->mutex);
+}
+
+dc_status_t
+dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	// The levels are read without the lock by the threads that are
+	// logging, which at worst sees a mix of the old and new levels.
+	dc_mutex_lock (context->mutex);
+	context->loglevel = loglevel;
+	context->minlevel = loglevel;
+	for (unsigned int i = 0; i < NCATEGORIES; ++i)
+		context->loglevels[i] = loglevel;
+	dc_mutex_unlock (context->mutex);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_loglevel_category (dc_context_t *context, dc_logcategory_t category, dc_loglevel_t loglevel)
+{
+	if (context == NULL || category >= NCATEGORIES)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	dc_mutex_lock (context->mutex);
+	context->loglevels[category] = loglevel;
+
+	// Cache the range of levels, for a fast check without a category.
+	context->loglevel = context->minlevel = loglevel;
+	for (unsigned int i = 0; i < NCATEGORIES; ++i) {
+		if (context->loglevel < context->loglevels[i])
+			context->loglevel = context->loglevels[i];
+		if (context->minlevel > context->loglevels[i])
+			context->minlevel = context->loglevels[i];
+	}
+	dc_mutex_unlock (context->mutex);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	dc_mutex_lock (context->mutex);
+	context->logfunc = logfunc;
+	context->userdata = userdata;
+	dc_mutex_unlock (context->mutex);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_allocator (dc_context_t *context, dc_allocfunc_t allocfunc, dc_freefunc_t freefunc, void *userdata)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if ((allocfunc == NULL) != (freefunc == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	context->allocfunc = allocfunc;
+	context->freefunc = freefunc;
+	context->allocdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_memory_stats (dc_context_t *context, unsigned int enable)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->memory_mutex);
+	context->memstats = enable ? 1 : 0;
+	memset (&context->memory, 0, sizeof (context->memory));
+	context->watermark = 0;
+	dc_mutex_unlock (context->memory_mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_get_memory_stats (dc_context_t *context, dc_memory_stats_t *stats)
+{
+	if (context == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (context->memory_mutex);
+	*stats = context->memory;
+	dc_mutex_unlock (context->memory_mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_context_memory_begin (dc_context_t *context, dc_memory_scope_t *scope)
+{
+	memset (scope, 0, sizeof (*scope));
+
+	if (context == NULL || !context->memstats)
+		return;
+
+	dc_mutex_lock (context->memory_mutex);
+	scope->current = context->memory.current;
+	scope->watermark = context->watermark;
+	scope->allocations = context->memory.allocations;
+	scope->releases = context->memory.releases;
+	context->watermark = context->memory.current;
+	dc_mutex_unlock (context->memory_mutex);
+}
+
+void
+dc_context_memory_end (dc_context_t *context, const dc_memory_scope_t *scope, dc_memory_stats_t *stats)
+{
+	if (context == NULL || !context->memstats)
+		return;
+
+	dc_mutex_lock (context->memory_mutex);
+
+	// The amounts are relative to the start of the scope. The memory
+	// released during the scope may have been allocated before it, so
+	// the current amount wraps around like the unsigned type does.
+	size_t peak = stats->current + (context->watermark - scope->current);
+	if (stats->peak < peak)
+		stats->peak = peak;
+	stats->current += context->memory.current - scope->current;
+	stats->allocations += context->memory.allocations - scope->allocations;
+	stats->releases += context->memory.releases - scope->releases;
+
+	// Restore the watermark of the enclosing scope.
+	if (context->watermark < scope->watermark)
+		context->watermark = scope->watermark;
+
+	dc_mutex_unlock (context->memory_mutex);
+}
+
+/*
+ * With the memory statistics enabled, the size of a block is stored in
+ * a header in front of it. The header is large enough to keep the
+ * alignment of the block.
+ */
+#define MEMORY_HEADER 16
+
+static void
+dc_context_memory_account (dc_context_t *context, size_t size, int release)
+{
+	dc_mutex_lock (context->memory_mutex);
+	if (release) {
+		context->memory.current -= size;
+		context->memory.releases++;
+	} else {
+		context->memory.current += size;
+		context->memory.allocations++;
+		if (context->memory.peak < context->memory.current)
+			context->memory.peak = context->memory.current;
+		if (context->watermark < context->memory.current)
+			context->watermark = context->memory.current;
+	}
+	dc_mutex_unlock (context->memory_mutex);
+}
+
+void *
+dc_context_alloc (dc_context_t *context, size_t size)
+{
+	if (context == NULL)
+		return malloc (size);
+
+	if (!context->memstats) {
+		if (context->allocfunc == NULL)
+			return malloc (size);
+		return context->allocfunc (size, context->allocdata);
+	}
+
+	unsigned char *block = NULL;
+	if (context->allocfunc == NULL)
+		block = (unsigned char *) malloc (MEMORY_HEADER + size);
+	else
+		block = (unsigned char *) context->allocfunc (MEMORY_HEADER + size, context->allocdata);
+	if (block == NULL)
+		return NULL;
+
+	memcpy (block, &size, sizeof (size));
+	dc_context_memory_account (context, size, 0);
+
+	return block + MEMORY_HEADER;
+}
+
+void *
+dc_context_realloc (dc_context_t *context, void *ptr, size_t oldsize, size_t newsize)
+{
+	if (context == NULL || (context->allocfunc == NULL && !context->memstats))
+		return realloc (ptr, newsize);
+
+	// Without a reallocation function, the memory is moved to a new
+	// block. The old block remains valid if that fails, like realloc.
+	void *block = dc_context_alloc (context, newsize);
+	if (block == NULL)
+		return NULL;
+
+	if (ptr) {
+		memcpy (block, ptr, oldsize < newsize ? oldsize : newsize);
+		dc_context_release (context, ptr);
+	}
+
+	return block;
+}
+
+void
+dc_context_release (dc_context_t *context, void *ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	if (context == NULL) {
+		free (ptr);
+		return;
+	}
+
+	if (context->memstats) {
+		size_t size = 0;
+		ptr = (unsigned char *) ptr - MEMORY_HEADER;
+		memcpy (&size, ptr, sizeof (size));
+		dc_context_memory_account (context, size, 1);
+	}
+
+	if (context->freefunc == NULL) {
+		free (ptr);
+		return;
+	}
+
+	context->freefunc (ptr, context->allocdata);
+}
+
+#ifdef ENABLE_LOGGING
+static int
+logenabled (dc_context_t *context, dc_loglevel_t loglevel, const char *file)
+{
+	if (loglevel > context->loglevel)
+		return 0;
+
+	// Only look at the category if it can make a difference.
+	if (loglevel > context->minlevel)
+		return loglevel <= context->loglevels[logcategory (file)];
+
+	return 1;
+}
+#endif
+
+dc_status_t
+dc_context_set_logasync (dc_context_t *context, unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	// Flush and stop the current background thread, if any.
+	logqueue_free (context->logqueue);
+	context->logqueue = NULL;
+
+	if (size) {
+		status = logqueue_new (&context->logqueue, context, size);
+	}
+#else
+	if (size) {
+		status = DC_STATUS_UNSUPPORTED;
+	}
+#endif
+
+	return status;
+}
+
+dc_status_t
+dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
+{
+#ifdef ENABLE_LOGGING
+	char msg[MSGSIZE];
+	va_list ap;
+#endif
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	if (!logenabled (context, loglevel, file))
+		return DC_STATUS_SUCCESS;
+
+	if (context->logfunc == NULL)
+		return DC_STATUS_SUCCESS;
+
+	va_start (ap, format);
+	l_vsnprintf (msg, sizeof (msg), format, ap);
+	va_end (ap);
+
+	logdeliver (context, loglevel, file, line, function, msg);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode)
+{
+	const char *errmsg = NULL;
+
+#ifdef _WIN32
+	char buffer[256];
+
+	DWORD rc = FormatMessageA (FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+			NULL, errcode, 0, buffer, sizeof (buffer), NULL);
+
+	/* Remove the CRLF and period at the end of the error message. */
+	while (rc > 0 && (
+		buffer[rc - 1] == '\n' ||
+		buffer[rc - 1] == '\r' ||
+		buffer[rc - 1] == '.'))
+	{
+		buffer[rc - 1] = '\0';
+		rc--;
+	}
+
+	if (rc > 0)
+		errmsg = buffer;
+#elif defined (HAVE_STRERROR_R)
+	char buffer[256];
+
+	int rc = strerror_r (errcode, buffer, sizeof (buffer));
+	if (rc == 0)
+		errmsg = buffer;
+#else
+	/* Fallback to the non-threadsafe function. */
+	errmsg = strerror (errcode);
+#endif
+
+	if (errmsg == NULL)
+		errmsg = "Unknown system error";
+
+	return dc_context_log (context, loglevel, file, line, function, "%s (%d)", errmsg, errcode);
+}
+
+dc_status_t
+dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size)
+{
+#ifdef ENABLE_LOGGING
+	char msg[MSGSIZE];
+#endif
+
+	if (context == NULL || prefix == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	if (!logenabled (context, loglevel, file))
+		return DC_STATUS_SUCCESS;
+
+	if (context->logfunc == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// In asynchronous mode, queue the raw bytes, and leave the
+	// formatting to the background thread.
+	size_t length = strlen (prefix) + 1;
+	if (context->logqueue && length < MSGSIZE / 2) {
+		dc_logrecord_t record;
+		record.loglevel = loglevel;
+		record.file = file;
+		record.line = line;
+		record.function = function;
+		record.length = length;
+		record.nbytes = size < MSGSIZE / 2 ? size : MSGSIZE / 2;
+		record.hexdump = 1;
+		record.size = size;
+
+		logqueue_push (context->logqueue, &record, prefix, data);
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	l_hexdump_message (msg, sizeof (msg), prefix, data, size, size);
+
+	logdeliver (context, loglevel, file, line, function, msg);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -0,0 +1,43 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CPU_PRIVATE_H
+#define DC_CPU_PRIVATE_H
+
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * The processor features (see dc_cpufeature_t) of the machine. The
+ * features are detected on the first call, and the value is cached.
+ * The kernels use the features allowed by their context instead (see
+ * dc_context_get_cpufeatures).
+ */
+unsigned int
+dc_cpu_features (void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CPU_PRIVATE_H */
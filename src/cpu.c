@@ -0,0 +1,149 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define USE_CPUID
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define USE_BUILTIN
+#endif
+
+#if defined(_WIN32) && (defined(_M_ARM64) || defined(_M_ARM))
+#define NOGDI
+#include <windows.h>
+#elif defined(HAVE_SYS_AUXV_H) && defined(HAVE_GETAUXVAL) && (defined(__aarch64__) || defined(__arm__))
+#include <sys/auxv.h>
+#define USE_AUXV
+// The bits of the kernel, for C libraries that don't define them.
+#if defined(__aarch64__) && !defined(HWCAP_AES)
+#define HWCAP_AES (1 << 3)
+#endif
+#if defined(__arm__) && !defined(HWCAP_NEON)
+#define HWCAP_NEON (1 << 12)
+#endif
+#if defined(__arm__) && !defined(HWCAP2_AES)
+#define HWCAP2_AES (1 << 0)
+#endif
+#endif
+
+#include "cpu-private.h"
+
+// Set once the features are detected. Detecting the features twice
+// yields the same value, so a race between two threads is harmless.
+#define DETECTED 0x80000000u
+
+static volatile unsigned int g_cpu_detected = 0;
+
+#ifdef USE_CPUID
+static unsigned int
+dc_cpu_detect_cpuid (void)
+{
+	unsigned int features = 0;
+	int info[4] = {0};
+
+	__cpuid (info, 0);
+	int nleaves = info[0];
+	if (nleaves < 1)
+		return 0;
+
+	__cpuid (info, 1);
+	if (info[3] & (1 << 26))
+		features |= DC_CPUFEATURE_SSE2;
+	if (info[2] & (1 << 9))
+		features |= DC_CPUFEATURE_SSSE3;
+	if (info[2] & (1 << 25))
+		features |= DC_CPUFEATURE_AESNI;
+
+	// AVX2 also needs the operating system to save the AVX registers.
+	int osxsave = (info[2] & (1 << 27)) != 0;
+	if (nleaves >= 7 && osxsave && (_xgetbv (0) & 0x06) == 0x06) {
+		__cpuidex (info, 7, 0);
+		if (info[1] & (1 << 5))
+			features |= DC_CPUFEATURE_AVX2;
+	}
+
+	return features;
+}
+#endif
+
+static unsigned int
+dc_cpu_detect (void)
+{
+	unsigned int features = 0;
+
+#if defined(USE_CPUID)
+	features = dc_cpu_detect_cpuid ();
+#elif defined(USE_BUILTIN)
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("sse2"))
+		features |= DC_CPUFEATURE_SSE2;
+	if (__builtin_cpu_supports ("ssse3"))
+		features |= DC_CPUFEATURE_SSSE3;
+	if (__builtin_cpu_supports ("avx2"))
+		features |= DC_CPUFEATURE_AVX2;
+	if (__builtin_cpu_supports ("aes"))
+		features |= DC_CPUFEATURE_AESNI;
+#elif defined(__aarch64__) || defined(_M_ARM64)
+	// NEON is a mandatory part of ARMv8-A.
+	features |= DC_CPUFEATURE_NEON;
+#if defined(USE_AUXV)
+	if (getauxval (AT_HWCAP) & HWCAP_AES)
+		features |= DC_CPUFEATURE_ARMCRYPTO;
+#elif defined(_WIN32)
+	if (IsProcessorFeaturePresent (PF_ARM_V8_CRYPTO_INSTRUCTIONS_AVAILABLE))
+		features |= DC_CPUFEATURE_ARMCRYPTO;
+#elif defined(__APPLE__) || defined(__ARM_FEATURE_CRYPTO)
+	features |= DC_CPUFEATURE_ARMCRYPTO;
+#endif
+#elif defined(__arm__) || defined(_M_ARM)
+#if defined(USE_AUXV)
+	if (getauxval (AT_HWCAP) & HWCAP_NEON)
+		features |= DC_CPUFEATURE_NEON;
+#if defined(AT_HWCAP2)
+	if (getauxval (AT_HWCAP2) & HWCAP2_AES)
+		features |= DC_CPUFEATURE_ARMCRYPTO;
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM)
+	features |= DC_CPUFEATURE_NEON;
+#endif
+#endif
+
+	return features;
+}
+
+unsigned int
+dc_cpu_features (void)
+{
+	unsigned int detected = g_cpu_detected;
+
+	if (!(detected & DETECTED)) {
+		detected = dc_cpu_detect () | DETECTED;
+		g_cpu_detected = detected;
+	}
+
+	return detected & ~DETECTED;
+}
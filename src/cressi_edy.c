@@ -19,7 +19,7 @@
  * MA 02110-1301 USA
  */
 
-#include <string.h> // memcpy, memcmp
+#include <string.h> // memcpy, memcmp, strdup
 #include <stdlib.h> // malloc, free
 #include <assert.h> // assert
 
@@ -42,6 +42,12 @@
 #define IQ700 0x05
 #define EDY   0x08
 
+// The state of the port in the profile cache: the model number, and
+// whether the device was left in the download mode at 4800 baud.
+#define PROFILE_MODEL  0x00FF
+#define PROFILE_ACTIVE 0x0100
+#define PROFILE_VALID  0x0200
+
 typedef struct cressi_edy_layout_t {
 	unsigned int memsize;
 	unsigned int rb_profile_begin;
@@ -59,6 +65,7 @@ typedef struct cressi_edy_device_t {
 	const cressi_edy_layout_t *layout;
 	unsigned char fingerprint[SZ_PAGE / 2];
 	unsigned int model;
+	char *name;
 } cressi_edy_device_t;
 
 static dc_status_t cressi_edy_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -164,6 +171,8 @@ cressi_edy_transfer (cressi_edy_device_t *device, const unsigned char command[],
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Delay the next attempt.
 		dc_iostream_sleep (device->iostream, 300);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
@@ -217,6 +226,36 @@ cressi_edy_quit (cressi_edy_device_t *device)
 }
 
 
+/*
+ * Check whether the device is still in the download mode after a
+ * previous connection that was not closed properly. The init commands
+ * are then answered at the wrong baudrate, and would only fail after
+ * all their retries. A single read of the first page is attempted
+ * instead, without retries.
+ */
+static dc_status_t
+cressi_edy_resume (cressi_edy_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	status = dc_iostream_configure (device->iostream, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->base.context, "Failed to set the terminal attributes.");
+		return status;
+	}
+
+	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+
+	unsigned char command[3] = {0x52, 0x00, 0x00};
+	unsigned char answer[SZ_PACKET + 1] = {0};
+	status = cressi_edy_packet (device, command, sizeof (command), answer, sizeof (answer), 1);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -237,8 +276,19 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 	device->iostream = NULL;
 	device->layout = NULL;
 	device->model = 0;
+	device->name = NULL;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 
+	// Keep the name, to update the state of the port when closing.
+	if (name) {
+		device->name = strdup (name);
+		if (device->name == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+	}
+
 	// Open the device.
 	status = dc_serial_open (&device->iostream, context, name);
 	if (status != DC_STATUS_SUCCESS) {
@@ -246,6 +296,8 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (1200 8N1).
 	status = dc_iostream_configure (device->iostream, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -274,14 +326,46 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_close;
 	}
 
-	// Make sure everything is in a sane state.
-	dc_iostream_sleep(device->iostream, 300);
-	dc_iostream_purge(device->iostream, DC_DIRECTION_ALL);
+	// Skip the init sequence if the device is still in the download mode.
+	unsigned int profile = dc_context_get_profile (context, DC_FAMILY_CRESSI_EDY, name);
+	int resumed = 0;
+	if (profile & PROFILE_ACTIVE) {
+		if (cressi_edy_resume (device) == DC_STATUS_SUCCESS) {
+			device->model = profile & PROFILE_MODEL;
+			resumed = 1;
+		} else {
+			// Set the serial communication protocol (1200 8N1).
+			status = dc_iostream_configure (device->iostream, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to set the terminal attributes.");
+				goto error_close;
+			}
+		}
+	}
+
+	if (!resumed) {
+		// Make sure everything is in a sane state.
+		dc_iostream_sleep(device->iostream, 300);
+		dc_iostream_purge(device->iostream, DC_DIRECTION_ALL);
 
-	// Send the init commands.
-	cressi_edy_init1 (device);
-	cressi_edy_init2 (device);
-	cressi_edy_init3 (device);
+		// Send the init commands. Without an answer to the model
+		// request, the model of the previous connection is used.
+		cressi_edy_init1 (device);
+		if (cressi_edy_init2 (device) != DC_STATUS_SUCCESS && (profile & PROFILE_VALID))
+			device->model = profile & PROFILE_MODEL;
+		cressi_edy_init3 (device);
+
+		// Set the serial communication protocol (4800 8N1).
+		status = dc_iostream_configure (device->iostream, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to set the terminal attributes.");
+			goto error_close;
+		}
+
+		// Make sure everything is in a sane state.
+		dc_iostream_sleep(device->iostream, 300);
+		dc_iostream_purge(device->iostream, DC_DIRECTION_ALL);
+	}
 
 	if (device->model == IQ700) {
 		device->layout = &tusa_iq700_layout;
@@ -289,16 +373,8 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		device->layout = &cressi_edy_layout;
 	}
 
-	// Set the serial communication protocol (4800 8N1).
-	status = dc_iostream_configure (device->iostream, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to set the terminal attributes.");
-		goto error_close;
-	}
-
-	// Make sure everything is in a sane state.
-	dc_iostream_sleep(device->iostream, 300);
-	dc_iostream_purge(device->iostream, DC_DIRECTION_ALL);
+	dc_context_set_profile (context, DC_FAMILY_CRESSI_EDY, name,
+		(device->model & PROFILE_MODEL) | PROFILE_ACTIVE | PROFILE_VALID);
 
 	*out = (dc_device_t*) device;
 
@@ -307,6 +383,7 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 error_close:
 	dc_iostream_close (device->iostream);
 error_free:
+	free (device->name);
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
@@ -319,10 +396,14 @@ cressi_edy_device_close (dc_device_t *abstract)
 	cressi_edy_device_t *device = (cressi_edy_device_t*) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
-	// Send the quit command.
+	// Send the quit command. The device is back in its initial state
+	// only when the command succeeds.
 	rc = cressi_edy_quit (device);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_status_set_error(&status, rc);
+	} else {
+		dc_context_set_profile (abstract->context, DC_FAMILY_CRESSI_EDY, device->name,
+			(device->model & PROFILE_MODEL) | PROFILE_VALID);
 	}
 
 	// Close the device.
@@ -331,6 +412,8 @@ cressi_edy_device_close (dc_device_t *abstract)
 		dc_status_set_error(&status, rc);
 	}
 
+	free (device->name);
+
 	return status;
 }
 
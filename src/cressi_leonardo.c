@@ -30,6 +30,7 @@
 #include "checksum.h"
 #include "array.h"
 #include "ringbuffer.h"
+#include "rbstream.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &cressi_leonardo_device_vtable)
 
@@ -71,9 +72,6 @@ static const dc_device_vtable_t cressi_leonardo_device_vtable = {
 	cressi_leonardo_device_close /* close */
 };
 
-static dc_status_t
-cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static void
 cressi_leonardo_make_ascii (const unsigned char raw[], unsigned int rsize, unsigned char ascii[], unsigned int asize)
 {
@@ -133,6 +131,7 @@ cressi_leonardo_packet (cressi_leonardo_device_t *device, const unsigned char co
 	unsigned short crc = array_uint16_be (checksum);
 	unsigned short ccrc = checksum_crc_ccitt_uint16 (answer + 1, asize - 6);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -155,6 +154,8 @@ cressi_leonardo_transfer (cressi_leonardo_device_t *device, const unsigned char
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Discard any garbage bytes.
 		dc_iostream_sleep (device->iostream, 100);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
@@ -190,6 +191,8 @@ cressi_leonardo_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -411,32 +414,192 @@ cressi_leonardo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 cressi_leonardo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
-	if (buffer == NULL)
-		return DC_STATUS_NOMEMORY;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
 
-	dc_status_t rc = cressi_leonardo_device_dump (abstract, buffer);
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = SZ_MEMORY;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the configuration data.
+	unsigned char config[RB_LOGBOOK_BEGIN] = {0};
+	rc = cressi_leonardo_device_read (abstract, 0, config, sizeof (config));
 	if (rc != DC_STATUS_SUCCESS) {
-		dc_buffer_free (buffer);
+		ERROR (abstract->context, "Failed to read the configuration data.");
 		return rc;
 	}
 
-	unsigned char *data = dc_buffer_get_data (buffer);
+	// Update and emit a progress event.
+	progress.current += sizeof (config);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Emit a device info event.
 	dc_event_devinfo_t devinfo;
-	devinfo.model = data[0];
+	devinfo.model = config[0];
 	devinfo.firmware = 0;
-	devinfo.serial = array_uint24_le (data + 1);
+	devinfo.serial = array_uint24_le (config + 1);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	rc = cressi_leonardo_extract_dives (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), callback, userdata);
+	// Get the logbook pointer.
+	unsigned int last = array_uint16_le(config + 0x64);
+	if (last < RB_LOGBOOK_BEGIN || last > RB_LOGBOOK_END ||
+		((last - RB_LOGBOOK_BEGIN) % RB_LOGBOOK_SIZE) != 0) {
+		ERROR (abstract->context, "Invalid logbook pointer (0x%04x).", last);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Convert to an index.
+	unsigned int latest = (last - RB_LOGBOOK_BEGIN) / RB_LOGBOOK_SIZE;
+
+	// Get the profile pointer.
+	unsigned int eop = array_uint16_le(config + 0x66);
+	if (eop < RB_PROFILE_BEGIN || eop > RB_PROFILE_END) {
+		ERROR (abstract->context, "Invalid profile pointer (0x%04x).", eop);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Allocate memory for the logbook entries.
+	unsigned char *logbook = (unsigned char *) malloc (RB_LOGBOOK_COUNT * RB_LOGBOOK_SIZE);
+	if (logbook == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Read the logbook entries, newest first, until the fingerprint is
+	// found. Only the profile data of these new dives is downloaded.
+	unsigned int count = 0;
+	unsigned int total = 0;
+	unsigned int previous = eop;
+	unsigned int remaining = RB_PROFILE_END - RB_PROFILE_BEGIN;
+	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
+		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
+		unsigned int offset = RB_LOGBOOK_BEGIN + idx * RB_LOGBOOK_SIZE;
+		unsigned char *entry = logbook + i * RB_LOGBOOK_SIZE;
+
+		// Read the logbook entry.
+		rc = cressi_leonardo_device_read (abstract, offset, entry, RB_LOGBOOK_SIZE);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the logbook entry.");
+			free (logbook);
+			return rc;
+		}
+
+		// Update and emit a progress event.
+		progress.current += RB_LOGBOOK_SIZE;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+		// Ignore uninitialized header entries.
+		if (array_isequal (entry, RB_LOGBOOK_SIZE, 0xFF))
+			break;
+
+		// Get the ringbuffer pointers.
+		unsigned int header = array_uint16_le (entry + 2);
+		unsigned int footer = array_uint16_le (entry + 4);
+		if (header < RB_PROFILE_BEGIN || header + 2 > RB_PROFILE_END ||
+			footer < RB_PROFILE_BEGIN || footer + 2 > RB_PROFILE_END)
+		{
+			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", header, footer);
+			free (logbook);
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		if (previous && previous != footer + 2) {
+			ERROR (abstract->context, "Profiles are not continuous (0x%04x 0x%04x 0x%04x).", header, footer, previous);
+			free (logbook);
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		// Check the fingerprint data.
+		if (memcmp (entry + 8, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
+		// Get the profile length, including the two pointers.
+		unsigned int length = RB_PROFILE_DISTANCE (header, footer) + 2;
+		if (remaining && remaining >= length) {
+			remaining -= length;
+			total += length;
+		} else {
+			remaining = 0;
+		}
+
+		previous = header;
+		count++;
+	}
+
+	// Update and emit a progress event.
+	progress.maximum = progress.current + total;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	dc_buffer_free (buffer);
+	// Create the ringbuffer stream.
+	dc_rbstream_t *rbstream = NULL;
+	rc = dc_rbstream_new (&rbstream, abstract, 1, PACKETSIZE, RB_PROFILE_BEGIN, RB_PROFILE_END, eop);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+		free (logbook);
+		return rc;
+	}
+
+	// Allocate memory for the largest possible dive. The profile data is
+	// read together with the two pointers that surround it, such that the
+	// trailing pointer ends up past the profile, and the leading pointer
+	// in the last two bytes of the logbook entry.
+	unsigned char *buffer = (unsigned char *) malloc (RB_LOGBOOK_SIZE + RB_PROFILE_END - RB_PROFILE_BEGIN + 2);
+	if (buffer == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		dc_rbstream_free (rbstream);
+		free (logbook);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	remaining = RB_PROFILE_END - RB_PROFILE_BEGIN;
+	for (unsigned int i = 0; i < count; ++i) {
+		const unsigned char *entry = logbook + i * RB_LOGBOOK_SIZE;
+
+		// Calculate the profile length.
+		unsigned int header = array_uint16_le (entry + 2);
+		unsigned int footer = array_uint16_le (entry + 4);
+		unsigned int length = RB_PROFILE_DISTANCE (header, footer) - 2;
+
+		if (remaining && remaining >= length + 4) {
+			// Read the profile data.
+			rc = dc_rbstream_read (rbstream, &progress, buffer + RB_LOGBOOK_SIZE - 2, length + 4);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to read the dive.");
+				break;
+			}
+
+			// Get the same pointers from the profile.
+			unsigned int header2 = array_uint16_le (buffer + RB_LOGBOOK_SIZE + length);
+			unsigned int footer2 = array_uint16_le (buffer + RB_LOGBOOK_SIZE - 2);
+			if (header2 != header || footer2 != footer) {
+				ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", header2, footer2);
+				rc = DC_STATUS_DATAFORMAT;
+				break;
+			}
+
+			remaining -= length + 4;
+		} else {
+			// No more profile data available!
+			remaining = 0;
+			length = 0;
+		}
+
+		// Copy the logbook entry.
+		memcpy (buffer, entry, RB_LOGBOOK_SIZE);
+
+		if (callback && !callback (buffer, RB_LOGBOOK_SIZE + length, buffer + 8, sizeof (device->fingerprint), userdata))
+			break;
+	}
+
+	dc_rbstream_free (rbstream);
+	free (buffer);
+	free (logbook);
 
 	return rc;
 }
 
-static dc_status_t
+dc_status_t
 cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	cressi_leonardo_device_t *device = (cressi_leonardo_device_t *) abstract;
@@ -524,14 +687,9 @@ cressi_leonardo_extract_dives (dc_device_t *abstract, const unsigned char data[]
 			}
 
 			// Copy the profile data.
-			if (address + length > RB_PROFILE_END) {
-				unsigned int len_a = RB_PROFILE_END - address;
-				unsigned int len_b = length - len_a;
-				memcpy (buffer + RB_LOGBOOK_SIZE, data + address, len_a);
-				memcpy (buffer + RB_LOGBOOK_SIZE + len_a, data + RB_PROFILE_BEGIN, len_b);
-			} else {
-				memcpy (buffer + RB_LOGBOOK_SIZE, data + address, length);
-			}
+			ringbuffer_span_t span;
+			ringbuffer_span (&span, address, length, RB_PROFILE_BEGIN, RB_PROFILE_END);
+			ringbuffer_span_copy (buffer + RB_LOGBOOK_SIZE, data, &span);
 
 			remaining -= length + 4;
 		} else {
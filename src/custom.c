@@ -59,13 +59,17 @@ static const dc_iostream_vtable_t dc_custom_vtable = {
 	dc_custom_set_rts, /* set_rts */
 	dc_custom_get_lines, /* get_lines */
 	dc_custom_get_available, /* get_received */
+	NULL, /* poll */
 	dc_custom_configure, /* configure */
 	dc_custom_read, /* read */
 	dc_custom_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
 	dc_custom_flush, /* flush */
 	dc_custom_purge, /* purge */
 	dc_custom_sleep, /* sleep */
 	dc_custom_close, /* close */
+	NULL, /* cancel */
 };
 
 dc_status_t
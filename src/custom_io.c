@@ -20,6 +20,7 @@
  */
 
 #include <stdlib.h> // malloc, free
+#include <string.h> // memcpy
 
 #include <libdivecomputer/context.h>
 
@@ -36,13 +37,38 @@ typedef struct dc_custom_t {
 	dc_iostream_t base;
 	/* Internal state. */
 	dc_context_t *context;
+	dc_custom_io_t *io;
+	/* Optional transfer buffers. */
+	size_t buffersize;
+	unsigned char *rbuffer;
+	size_t roffset, rlength, available;
+	unsigned char *wbuffer;
+	size_t wlength;
 } dc_custom_t;
 
+static dc_status_t
+dc_custom_drain (dc_custom_t *custom)
+{
+	dc_custom_io_t *io = custom->io;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	if (custom->wlength == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (io->serial_write)
+		status = io->serial_write(io, custom->wbuffer, custom->wlength, &nbytes);
+
+	custom->wlength = 0;
+
+	return status;
+}
+
 static dc_status_t
 dc_custom_set_timeout (dc_iostream_t *abstract, int timeout)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_set_timeout)
 		return DC_STATUS_SUCCESS;
@@ -60,11 +86,15 @@ static dc_status_t
 dc_custom_set_break (dc_iostream_t *abstract, unsigned int value)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_set_break)
 		return DC_STATUS_SUCCESS;
 
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
 	return io->serial_set_break(io, value);
 }
 
@@ -72,11 +102,15 @@ static dc_status_t
 dc_custom_set_dtr (dc_iostream_t *abstract, unsigned int value)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_set_dtr)
 		return DC_STATUS_SUCCESS;
 
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
 	return io->serial_set_dtr(io, value);
 }
 
@@ -84,11 +118,15 @@ static dc_status_t
 dc_custom_set_rts (dc_iostream_t *abstract, unsigned int value)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_set_rts)
 		return DC_STATUS_SUCCESS;
 
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
 	return io->serial_set_rts(io, value);
 }
 
@@ -102,23 +140,44 @@ static dc_status_t
 dc_custom_get_available (dc_iostream_t *abstract, size_t *value)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
+
+	size_t buffered = custom->rlength - custom->roffset;
 
-	if (!io->serial_get_available)
+	// The caller may be waiting for the answer to the pending writes.
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (!io->serial_get_available) {
+		*value = buffered;
 		return DC_STATUS_SUCCESS;
+	}
+
+	status = io->serial_get_available(io, value);
+	if (status == DC_STATUS_SUCCESS) {
+		// Remember the amount, such that a read of exactly that much
+		// doesn't need to ask again.
+		custom->available = *value;
+		*value += buffered;
+	}
 
-	return io->serial_get_available(io, value);
+	return status;
 }
 
 static dc_status_t
 dc_custom_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_configure)
 		return DC_STATUS_SUCCESS;
 
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
 	return io->serial_configure(io, baudrate, databits, parity, stopbits, flowcontrol);
 }
 
@@ -126,37 +185,123 @@ static dc_status_t
 dc_custom_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_read)
 		return DC_STATUS_SUCCESS;
 
-	return io->serial_read(io, data, size, actual);
+	if (custom->buffersize == 0)
+		return io->serial_read(io, data, size, actual);
+
+	// The request may be the answer to the pending writes.
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	unsigned char *p = (unsigned char *) data;
+	size_t nbytes = 0;
+
+	while (1) {
+		// Serve the buffered data first.
+		size_t n = custom->rlength - custom->roffset;
+		if (n > size - nbytes)
+			n = size - nbytes;
+		memcpy (p + nbytes, custom->rbuffer + custom->roffset, n);
+		custom->roffset += n;
+		nbytes += n;
+
+		if (nbytes == size)
+			break;
+
+		// Fetch everything that has already arrived in a single call,
+		// if that is more than the remainder of the request. Otherwise
+		// read the remainder directly, which blocks as usual. The amount
+		// of a preceding get_available call is used without asking again.
+		size_t available = custom->available;
+		custom->available = 0;
+		if (available == 0 && io->serial_get_available &&
+			io->serial_get_available(io, &available) != DC_STATUS_SUCCESS)
+			available = 0;
+		if (available <= size - nbytes) {
+			size_t received = 0;
+			status = io->serial_read(io, p + nbytes, size - nbytes, &received);
+			nbytes += received;
+			break;
+		}
+
+		if (available > custom->buffersize)
+			available = custom->buffersize;
+
+		size_t received = 0;
+		status = io->serial_read(io, custom->rbuffer, available, &received);
+		custom->roffset = 0;
+		custom->rlength = received;
+		if (status != DC_STATUS_SUCCESS) {
+			// Hand out the data that was received before the error.
+			n = received < size - nbytes ? received : size - nbytes;
+			memcpy (p + nbytes, custom->rbuffer, n);
+			custom->roffset = n;
+			nbytes += n;
+			break;
+		}
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
 }
 
 static dc_status_t
 dc_custom_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
 
 	if (!io->serial_write)
 		return DC_STATUS_SUCCESS;
 
-	return io->serial_write(io, data, size, actual);
+	if (custom->buffersize == 0)
+		return io->serial_write(io, data, size, actual);
+
+	// Send the pending data first if the new data doesn't fit.
+	if (custom->wlength + size > custom->buffersize) {
+		dc_status_t status = dc_custom_drain (custom);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	// Large writes are not worth copying.
+	if (size >= custom->buffersize)
+		return io->serial_write(io, data, size, actual);
+
+	memcpy (custom->wbuffer + custom->wlength, data, size);
+	custom->wlength += size;
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
 dc_custom_flush (dc_iostream_t *abstract)
 {
-	return DC_STATUS_SUCCESS;
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	return dc_custom_drain (custom);
 }
 
 static dc_status_t
 dc_custom_purge (dc_iostream_t *abstract, dc_direction_t direction)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
+
+	if (direction & DC_DIRECTION_INPUT)
+		custom->roffset = custom->rlength = custom->available = 0;
+	if (direction & DC_DIRECTION_OUTPUT)
+		custom->wlength = 0;
 
 	if (!io->serial_purge)
 		return DC_STATUS_SUCCESS;
@@ -167,14 +312,20 @@ dc_custom_purge (dc_iostream_t *abstract, dc_direction_t direction)
 static dc_status_t
 dc_custom_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
 {
-	return DC_STATUS_SUCCESS;
+	dc_custom_t *custom = (dc_custom_t *) abstract;
+
+	// The delay is usually meant to follow the data on the wire.
+	return dc_custom_drain (custom);
 }
 
 static dc_status_t
 dc_custom_close (dc_iostream_t *abstract)
 {
 	dc_custom_t *custom = (dc_custom_t *) abstract;
-	dc_custom_io_t *io = _dc_context_custom_io(custom->context);
+	dc_custom_io_t *io = custom->io;
+
+	dc_custom_drain (custom);
+	free (custom->rbuffer);
 
 	if (!io->serial_close)
 		return DC_STATUS_SUCCESS;
@@ -191,13 +342,17 @@ static const dc_iostream_vtable_t dc_custom_vtable = {
 	dc_custom_set_rts, /* set_rts */
 	dc_custom_get_lines, /* get_lines */
 	dc_custom_get_available, /* get_received */
+	NULL, /* poll */
 	dc_custom_configure, /* configure */
 	dc_custom_read, /* read */
 	dc_custom_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
 	dc_custom_flush, /* flush */
 	dc_custom_purge, /* purge */
 	dc_custom_sleep, /* sleep */
 	dc_custom_close, /* close */
+	NULL, /* cancel */
 };
 
 dc_status_t
@@ -206,13 +361,97 @@ dc_custom_io_serial_open(dc_iostream_t **out, dc_context_t *context, const char
 	dc_custom_io_t *io = _dc_context_custom_io(context);
 	dc_custom_t *custom;
 
+	dc_custom_io_ext_t ext;
+	_dc_context_custom_io_ext(context, io, &ext);
+
 	custom = (dc_custom_t *) dc_iostream_allocate (context, &dc_custom_vtable);
 	if (!custom) {
 		ERROR (context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	// The custom I/O is bound to the connection, such that changing
+	// the one of the context doesn't affect the open connections.
 	custom->context = context;
+	custom->io = io;
+	custom->buffersize = 0;
+	custom->rbuffer = NULL;
+	custom->roffset = custom->rlength = custom->available = 0;
+	custom->wbuffer = NULL;
+	custom->wlength = 0;
+	if (ext.serial_buffer_size) {
+		// A single allocation holds both buffers.
+		custom->rbuffer = (unsigned char *) malloc (2 * ext.serial_buffer_size);
+		if (custom->rbuffer) {
+			custom->buffersize = ext.serial_buffer_size;
+			custom->wbuffer = custom->rbuffer + custom->buffersize;
+		} else {
+			WARNING (context, "Failed to allocate the transfer buffers.");
+		}
+	}
+
+	dc_status_t status = io->serial_open(io, context, name);
+	if (status != DC_STATUS_SUCCESS) {
+		free (custom->rbuffer);
+		dc_iostream_deallocate ((dc_iostream_t *) custom);
+		return status;
+	}
+
 	*out = (dc_iostream_t *) custom;
-	return io->serial_open(io, context, name);
+	return DC_STATUS_SUCCESS;
+}
+
+size_t
+dc_custom_io_packet_mtu(dc_context_t *context, dc_custom_io_t *io)
+{
+	dc_custom_io_ext_t ext;
+	_dc_context_custom_io_ext(context, io, &ext);
+
+	size_t mtu = 0;
+	if (ext.packet_get_mtu && ext.packet_get_mtu(io, &mtu) == DC_STATUS_SUCCESS && mtu > (size_t) io->packet_size)
+		return mtu;
+
+	return io->packet_size;
+}
+
+dc_status_t
+dc_custom_io_packet_read_many(dc_context_t *context, dc_custom_io_t *io, void *data, size_t size, size_t *actual)
+{
+	dc_custom_io_ext_t ext;
+	_dc_context_custom_io_ext(context, io, &ext);
+
+	if (ext.packet_read_many)
+		return ext.packet_read_many(io, data, size, actual);
+
+	// Fall back to a single packet.
+	return io->packet_read(io, data, size, actual);
+}
+
+dc_status_t
+dc_custom_io_packet_set_params(dc_context_t *context, dc_custom_io_t *io, unsigned int hints)
+{
+	dc_custom_io_ext_t ext;
+	_dc_context_custom_io_ext(context, io, &ext);
+
+	if (!ext.packet_set_params)
+		return DC_STATUS_UNSUPPORTED;
+
+	return ext.packet_set_params(io, hints);
+}
+
+dc_status_t
+dc_custom_io_serial_set_params(dc_iostream_t *iostream, unsigned int hints)
+{
+	dc_custom_t *custom = (dc_custom_t *) iostream;
+
+	// Only the custom serial transfer has link parameters.
+	if (!dc_iostream_isinstance (iostream, &dc_custom_vtable))
+		return DC_STATUS_UNSUPPORTED;
+
+	// The pending writes still belong to the previous parameters.
+	dc_status_t status = dc_custom_drain (custom);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	return dc_custom_io_packet_set_params(custom->context, custom->io, hints);
 }
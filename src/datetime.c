@@ -24,6 +24,7 @@
 #endif
 
 #include <time.h>
+#include <limits.h>
 
 #include <libdivecomputer/datetime.h>
 
@@ -44,62 +45,80 @@ dc_localtime_r (const time_t *t, struct tm *tm)
 #endif
 }
 
-static struct tm *
-dc_gmtime_r (const time_t *t, struct tm *tm)
+/*
+ * Conversion between a date in the proleptic Gregorian calendar and
+ * the number of days since 1970-01-01. The calculation uses eras of
+ * 400 years, which keeps all intermediate values non-negative, and
+ * doesn't need the C library. Unlike gmtime and timegm, it never
+ * takes the (process wide) timezone lock of the C library, which
+ * matters when many dives are parsed in parallel.
+ */
+static dc_ticks_t
+dc_days_from_civil (dc_ticks_t year, unsigned int month, unsigned int day)
 {
-#ifdef HAVE_GMTIME_R
-	return gmtime_r (t, tm);
-#else
-	struct tm *p = gmtime (t);
-	if (p == NULL)
-		return NULL;
+	year -= (month <= 2);
+	dc_ticks_t era = (year >= 0 ? year : year - 399) / 400;
+	unsigned int yoe = year - era * 400;
+	unsigned int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
 
-	if (tm)
-		*tm = *p;
+static void
+dc_civil_from_days (dc_ticks_t days, dc_ticks_t *year, unsigned int *month, unsigned int *day)
+{
+	days += 719468;
+	dc_ticks_t era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned int doe = days - era * 146097;
+	unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned int mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = era * 400 + yoe + (*month <= 2);
+}
 
-	return tm;
-#endif
+/*
+ * Convert a broken-down UTC time to seconds since the epoch. Fields
+ * outside their normal range are normalized, like timegm does.
+ */
+static dc_ticks_t
+dc_timegm (int year, int month, int day, int hour, int minute, int second)
+{
+	// Normalize the month into the range 1 to 12.
+	dc_ticks_t y = year;
+	dc_ticks_t m = (dc_ticks_t) month - 1;
+	y += (m >= 0 ? m : m - 11) / 12;
+	m -= ((m >= 0 ? m : m - 11) / 12) * 12;
+
+	dc_ticks_t days = dc_days_from_civil (y, m + 1, 1) + (dc_ticks_t) day - 1;
+
+	return ((days * 24 + hour) * 60 + minute) * 60 + second;
 }
 
-static time_t
-dc_timegm (struct tm *tm)
+static dc_datetime_t *
+dc_gmtime (dc_datetime_t *result, dc_ticks_t ticks)
 {
-#if defined(HAVE_TIMEGM)
-	return timegm (tm);
-#elif defined (HAVE__MKGMTIME)
-	return _mkgmtime (tm);
-#else
-	static const unsigned int mdays[] = {
-		0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
-	};
-
-	if (tm == NULL ||
-		tm->tm_mon  < 0 || tm->tm_mon  > 11 ||
-		tm->tm_mday < 1 || tm->tm_mday > 31 ||
-		tm->tm_hour < 0 || tm->tm_hour > 23 ||
-		tm->tm_min  < 0 || tm->tm_min  > 59 ||
-		tm->tm_sec  < 0 || tm->tm_sec  > 60)
-		return (time_t) -1;
-
-	/* Number of leap days since 1970-01-01. */
-	int year = tm->tm_year + 1900 - (tm->tm_mon < 2);
-	int leapdays =
-		((year / 4) - (year / 100) + (year / 400)) -
-		((1969 / 4) - (1969 / 100) + (1969 / 400));
-
-	time_t result = 0;
-	result += (tm->tm_year - 70) * 365;
-	result += leapdays;
-	result += mdays[tm->tm_mon];
-	result += tm->tm_mday - 1;
-	result *= 24;
-	result += tm->tm_hour;
-	result *= 60;
-	result += tm->tm_min;
-	result *= 60;
-	result += tm->tm_sec;
+	dc_ticks_t days = (ticks >= 0 ? ticks : ticks - 86399) / 86400;
+	unsigned int seconds = ticks - days * 86400;
+
+	dc_ticks_t year = 0;
+	unsigned int month = 0, day = 0;
+	dc_civil_from_days (days, &year, &month, &day);
+	if (year < INT_MIN || year > INT_MAX)
+		return NULL;
+
+	if (result) {
+		result->year = year;
+		result->month = month;
+		result->day = day;
+		result->hour = seconds / 3600;
+		result->minute = (seconds % 3600) / 60;
+		result->second = seconds % 60;
+		result->timezone = 0;
+	}
+
 	return result;
-#endif
 }
 
 dc_ticks_t
@@ -122,12 +141,8 @@ dc_datetime_localtime (dc_datetime_t *result,
 #ifdef HAVE_STRUCT_TM_TM_GMTOFF
 	offset = tm.tm_gmtoff;
 #else
-	struct tm tmp = tm;
-	time_t t_local = dc_timegm (&tmp);
-	if (t_local == (time_t) -1)
-		return NULL;
-
-	offset = t_local - t;
+	offset = dc_timegm (tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+		tm.tm_hour, tm.tm_min, tm.tm_sec) - t;
 #endif
 
 	if (result) {
@@ -147,23 +162,7 @@ dc_datetime_t *
 dc_datetime_gmtime (dc_datetime_t *result,
                     dc_ticks_t ticks)
 {
-	time_t t = ticks;
-
-	struct tm tm;
-	if (dc_gmtime_r (&t, &tm) == NULL)
-		return NULL;
-
-	if (result) {
-		result->year = tm.tm_year + 1900;
-		result->month = tm.tm_mon + 1;
-		result->day = tm.tm_mday;
-		result->hour = tm.tm_hour;
-		result->minute = tm.tm_min;
-		result->second = tm.tm_sec;
-		result->timezone = 0;
-	}
-
-	return result;
+	return dc_gmtime (result, ticks);
 }
 
 dc_ticks_t
@@ -172,18 +171,8 @@ dc_datetime_mktime (const dc_datetime_t *dt)
 	if (dt == NULL)
 		return -1;
 
-	struct tm tm;
-	tm.tm_year = dt->year - 1900;
-	tm.tm_mon = dt->month - 1;
-	tm.tm_mday = dt->day;
-	tm.tm_hour = dt->hour;
-	tm.tm_min = dt->minute;
-	tm.tm_sec = dt->second;
-	tm.tm_isdst = 0;
-
-	time_t t = dc_timegm (&tm);
-	if (t == (time_t) -1)
-		return t;
+	dc_ticks_t t = dc_timegm (dt->year, dt->month, dt->day,
+		dt->hour, dt->minute, dt->second);
 
 	if (dt->timezone != DC_TIMEZONE_NONE) {
 		t -= dt->timezone;
@@ -0,0 +1,219 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+
+#include <libdivecomputer/units.h>
+
+#include "parser-private.h"
+
+#define HAS(table,row,type) (((table)->mask[(row)] & (1u << (type))) != 0)
+
+#define DENSITY_FRESH 1000.0
+#define DENSITY_SALT  1025.0
+
+typedef struct derived_environment_t {
+	double atmospheric; /* bar */
+	double density;     /* kg/m3 */
+} derived_environment_t;
+
+static void
+derived_environment (dc_parser_t *parser, derived_environment_t *env)
+{
+	double atmospheric = 0.0;
+	dc_salinity_t salinity = {DC_WATER_SALT, 0.0};
+
+	env->atmospheric = ATM / BAR;
+	env->density = DENSITY_SALT;
+
+	if (dc_parser_get_field (parser, DC_FIELD_ATMOSPHERIC, 0, &atmospheric) == DC_STATUS_SUCCESS &&
+		atmospheric > 0.0)
+		env->atmospheric = atmospheric;
+
+	if (dc_parser_get_field (parser, DC_FIELD_SALINITY, 0, &salinity) == DC_STATUS_SUCCESS) {
+		if (salinity.density > 0.0)
+			env->density = salinity.density;
+		else if (salinity.type == DC_WATER_FRESH)
+			env->density = DENSITY_FRESH;
+	}
+}
+
+/*
+ * The ambient pressure, relative to the surface, such that a pressure
+ * drop divided by the time integral of this factor is the consumption
+ * at the surface.
+ */
+static double
+derived_factor (const derived_environment_t *env, double depth)
+{
+	return 1.0 + depth * env->density * GRAVITY / BAR / env->atmospheric;
+}
+
+static void
+derived_fill (double column[], unsigned int stride, unsigned int begin, unsigned int end, double value)
+{
+	for (unsigned int i = begin; i < end; ++i)
+		column[i * stride] = value;
+}
+
+static void
+derived_ascent (const dc_sample_table_t *table, dc_sample_derived_t *derived)
+{
+	unsigned int count = table->count;
+	unsigned int previous = 0, found = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (!HAS (table, i, DC_SAMPLE_DEPTH))
+			continue;
+
+		double rate = 0.0;
+		if (found && table->time[i] > table->time[previous]) {
+			rate = (table->depth[previous] - table->depth[i]) * 60.0 / (table->time[i] - table->time[previous]);
+			if (rate > derived->maxascent)
+				derived->maxascent = rate;
+			if (-rate > derived->maxdescent)
+				derived->maxdescent = -rate;
+		}
+
+		// The rows since the previous depth share the same rate.
+		if (derived->ascent)
+			derived_fill (derived->ascent, 1, found ? previous + 1 : 0, i + 1, rate);
+
+		previous = i;
+		found = 1;
+	}
+
+	if (derived->ascent)
+		derived_fill (derived->ascent, 1, found ? previous + 1 : 0, count, 0.0);
+}
+
+static void
+derived_consumption (dc_parser_t *parser, const dc_sample_table_t *table, dc_sample_derived_t *derived, const derived_environment_t *env)
+{
+	unsigned int count = table->count;
+	unsigned int ntanks = table->ntanks;
+	double liters = 0.0, integral = 0.0;
+
+	if (derived->sac)
+		derived_fill (derived->sac, 1, 0, count * ntanks, 0.0);
+	if (derived->rmv)
+		derived_fill (derived->rmv, 1, 0, count, 0.0);
+
+	// Process one tank at a time, such that the state of a tank is
+	// just a few scalars.
+	for (unsigned int n = 0; n < ntanks; ++n) {
+		dc_tank_t tank;
+		double volume = 0.0;
+		if (dc_parser_get_field (parser, DC_FIELD_TANK, n, &tank) == DC_STATUS_SUCCESS)
+			volume = tank.volume;
+
+		double factor = 1.0;
+		double pressure = 0.0, start = 0.0;
+		unsigned int previous = 0, found = 0;
+		integral = 0.0;
+		for (unsigned int i = 0; i < count; ++i) {
+			// Integrate the ambient pressure over the interval ending
+			// at this row, with the depth at the start of the interval.
+			if (i > 0 && table->time[i] > table->time[i - 1])
+				integral += factor * (table->time[i] - table->time[i - 1]);
+			if (HAS (table, i, DC_SAMPLE_DEPTH))
+				factor = derived_factor (env, table->depth[i]);
+
+			if (!HAS (table, i, DC_SAMPLE_PRESSURE))
+				continue;
+
+			double value = table->pressure[i * ntanks + n];
+			if (value <= 0.0 || (found && value == pressure))
+				continue;
+
+			if (found && value < pressure && integral > start) {
+				double used = pressure - value;
+				double sac = used * 60.0 / (integral - start);
+				if (derived->sac)
+					derived_fill (derived->sac + n, ntanks, previous + 1, i + 1, sac);
+				if (derived->rmv && volume > 0.0) {
+					for (unsigned int j = previous + 1; j <= i; ++j)
+						derived->rmv[j] += sac * volume;
+				}
+				liters += used * volume;
+			}
+
+			pressure = value;
+			start = integral;
+			previous = i;
+			found = 1;
+		}
+	}
+
+	// The integral of the last tank covers the entire dive.
+	if (integral > 0.0)
+		derived->rmv_average = liters * 60.0 / integral;
+}
+
+static void
+derived_gastime (const dc_sample_table_t *table, dc_sample_derived_t *derived)
+{
+	unsigned int count = table->count;
+	unsigned int gasmix = 0, previous = 0;
+
+	for (unsigned int i = 0; i < derived->ngasmixes; ++i)
+		derived->gastime[i] = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		// A row covers the interval since the previous row, and a gas
+		// switch takes effect from the next interval.
+		if (table->time[i] > previous && gasmix < derived->ngasmixes)
+			derived->gastime[gasmix] += table->time[i] - previous;
+		previous = table->time[i];
+
+		if (HAS (table, i, DC_SAMPLE_GASMIX))
+			gasmix = table->gasmix[i];
+	}
+}
+
+void
+sample_derived_compute (dc_parser_t *parser, const dc_sample_table_t *table, dc_sample_derived_t *derived)
+{
+	derived->maxascent = 0.0;
+	derived->maxdescent = 0.0;
+	derived->rmv_average = 0.0;
+
+	if (table->mask == NULL || table->time == NULL)
+		return;
+
+	if (table->depth)
+		derived_ascent (table, derived);
+
+	if (table->gasmix && derived->gastime)
+		derived_gastime (table, derived);
+
+	if (table->depth == NULL)
+		return;
+
+	derived_environment_t env;
+	derived_environment (parser, &env);
+
+	if (table->pressure && table->ntanks)
+		derived_consumption (parser, table, derived, &env);
+
+	if (derived->ceiling || derived->ndl || derived->tts || derived->cns)
+		sample_deco_compute (parser, table, derived, env.atmospheric, env.density);
+}
@@ -38,6 +38,17 @@ typedef int (*dc_filter_t) (dc_transport_t transport, const void *userdata);
 dc_filter_t
 dc_descriptor_get_filter (dc_descriptor_t *descriptor);
 
+dc_memory_t
+dc_family_get_memory (dc_family_t family, unsigned int *download, unsigned int *dump);
+
+/*
+ * The baudrates which the devices of a family can use, fastest first.
+ * Only the families where the baudrate depends on the model or the
+ * firmware are listed. The return value is the number of baudrates.
+ */
+unsigned int
+dc_family_get_baudrates (dc_family_t family, const unsigned int **baudrates);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
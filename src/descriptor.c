@@ -49,10 +49,18 @@
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
+#ifdef ENABLE_FAMILY_UWATEC
 static int dc_filter_uwatec (dc_transport_t transport, const void *userdata);
+#endif
+#ifdef ENABLE_FAMILY_SUUNTO
 static int dc_filter_suunto (dc_transport_t transport, const void *userdata);
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
 static int dc_filter_shearwater (dc_transport_t transport, const void *userdata);
+#endif
+#ifdef ENABLE_FAMILY_HW
 static int dc_filter_hw (dc_transport_t transport, const void *userdata);
+#endif
 
 static dc_status_t dc_descriptor_iterator_next (dc_iterator_t *iterator, void *item);
 
@@ -67,6 +75,9 @@ struct dc_descriptor_t {
 typedef struct dc_descriptor_iterator_t {
 	dc_iterator_t base;
 	size_t current;
+	// Only the descriptors with this filter, if enabled.
+	int match;
+	dc_filter_t filter;
 } dc_descriptor_iterator_t;
 
 static const dc_iterator_vtable_t dc_descriptor_iterator_vtable = {
@@ -83,6 +94,7 @@ static const dc_iterator_vtable_t dc_descriptor_iterator_vtable = {
  */
 
 static const dc_descriptor_t g_descriptors[] = {
+#ifdef ENABLE_FAMILY_SUUNTO
 	/* Suunto Solution */
 	{"Suunto", "Solution", DC_FAMILY_SUUNTO_SOLUTION, 0, NULL},
 	/* Suunto Eon */
@@ -121,6 +133,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Suunto", "EON Steel", DC_FAMILY_SUUNTO_EONSTEEL, 0, dc_filter_suunto},
 	{"Suunto", "EON Core",  DC_FAMILY_SUUNTO_EONSTEEL, 1, dc_filter_suunto},
 #endif
+#endif
+#ifdef ENABLE_FAMILY_UWATEC
 	/* Uwatec Aladin */
 	{"Uwatec", "Aladin Air Twin",     DC_FAMILY_UWATEC_ALADIN, 0x1C, NULL},
 	{"Uwatec", "Aladin Sport Plus",   DC_FAMILY_UWATEC_ALADIN, 0x3E, NULL},
@@ -163,10 +177,14 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Scubapro", "Aladin Square",       DC_FAMILY_UWATEC_G2, 0x22, dc_filter_uwatec},
 	{"Scubapro", "G2",                  DC_FAMILY_UWATEC_G2, 0x32, dc_filter_uwatec},
 #endif
+#endif
+#ifdef ENABLE_FAMILY_REEFNET
 	/* Reefnet */
 	{"Reefnet", "Sensus",       DC_FAMILY_REEFNET_SENSUS, 1, NULL},
 	{"Reefnet", "Sensus Pro",   DC_FAMILY_REEFNET_SENSUSPRO, 2, NULL},
 	{"Reefnet", "Sensus Ultra", DC_FAMILY_REEFNET_SENSUSULTRA, 3, NULL},
+#endif
+#ifdef ENABLE_FAMILY_OCEANIC
 	/* Oceanic VT Pro */
 	{"Aeris",    "500 AI",     DC_FAMILY_OCEANIC_VTPRO, 0x4151, NULL},
 	{"Oceanic",  "Versa Pro",  DC_FAMILY_OCEANIC_VTPRO, 0x4155, NULL},
@@ -243,6 +261,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Aqualung", "i450T",               DC_FAMILY_OCEANIC_ATOM2, 0x4641, NULL},
 	{"Aqualung", "i550",                DC_FAMILY_OCEANIC_ATOM2, 0x4642, NULL},
 	{"Aqualung", "i200",                DC_FAMILY_OCEANIC_ATOM2, 0x4646, NULL},
+#endif
+#ifdef ENABLE_FAMILY_MARES
 	/* Mares Nemo */
 	{"Mares", "Nemo",         DC_FAMILY_MARES_NEMO, 0, NULL},
 	{"Mares", "Nemo Steel",   DC_FAMILY_MARES_NEMO, 0, NULL},
@@ -271,6 +291,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Mares", "Puck 2",            DC_FAMILY_MARES_ICONHD , 0x1F, NULL},
 	{"Mares", "Quad Air",          DC_FAMILY_MARES_ICONHD , 0x23, NULL},
 	{"Mares", "Quad",              DC_FAMILY_MARES_ICONHD , 0x29, NULL},
+#endif
+#ifdef ENABLE_FAMILY_HW
 	/* Heinrichs Weikamp */
 	{"Heinrichs Weikamp", "OSTC",     DC_FAMILY_HW_OSTC, 0, NULL},
 	{"Heinrichs Weikamp", "OSTC Mk2", DC_FAMILY_HW_OSTC, 1, NULL},
@@ -289,6 +311,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x12, dc_filter_hw},
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x13, dc_filter_hw},
 	{"Heinrichs Weikamp", "OSTC 2 TR",  DC_FAMILY_HW_OSTC3, 0x33, dc_filter_hw},
+#endif
+#ifdef ENABLE_FAMILY_CRESSI
 	/* Cressi Edy */
 	{"Tusa",   "IQ-700", DC_FAMILY_CRESSI_EDY, 0x05, NULL},
 	{"Cressi", "Edy",    DC_FAMILY_CRESSI_EDY, 0x08, NULL},
@@ -302,11 +326,15 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Apeks",     "Quantum X",  DC_FAMILY_ZEAGLE_N2ITION3, 0, NULL},
 	{"Dive Rite", "NiTek Trio", DC_FAMILY_ZEAGLE_N2ITION3, 0, NULL},
 	{"Scubapro",  "XTender 5",  DC_FAMILY_ZEAGLE_N2ITION3, 0, NULL},
+#endif
+#ifdef ENABLE_FAMILY_ATOMICS
 	/* Atomic Aquatics Cobalt */
 #ifdef HAVE_LIBUSB
 	{"Atomic Aquatics", "Cobalt", DC_FAMILY_ATOMICS_COBALT, 0, NULL},
 	{"Atomic Aquatics", "Cobalt 2", DC_FAMILY_ATOMICS_COBALT, 2, NULL},
 #endif
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
 	/* Shearwater Predator */
 	{"Shearwater", "Predator", DC_FAMILY_SHEARWATER_PREDATOR, 2, dc_filter_shearwater},
 	/* Shearwater Petrel */
@@ -316,10 +344,16 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Shearwater", "Perdix",    DC_FAMILY_SHEARWATER_PETREL, 5, dc_filter_shearwater},
 	{"Shearwater", "Perdix AI", DC_FAMILY_SHEARWATER_PETREL, 6, dc_filter_shearwater},
 	{"Shearwater", "Nerd 2",    DC_FAMILY_SHEARWATER_PETREL, 7, dc_filter_shearwater},
+#endif
+#ifdef ENABLE_FAMILY_DIVERITE
 	/* Dive Rite NiTek Q */
 	{"Dive Rite", "NiTek Q",   DC_FAMILY_DIVERITE_NITEKQ, 0, NULL},
+#endif
+#ifdef ENABLE_FAMILY_CITIZEN
 	/* Citizen Hyper Aqualand */
 	{"Citizen", "Hyper Aqualand", DC_FAMILY_CITIZEN_AQUALAND, 0, NULL},
+#endif
+#ifdef ENABLE_FAMILY_DIVESYSTEM
 	/* DiveSystem/Ratio iDive */
 	{"DiveSystem", "Orca",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x02, NULL},
 	{"DiveSystem", "iDive Pro",     DC_FAMILY_DIVESYSTEM_IDIVE, 0x03, NULL},
@@ -343,6 +377,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Ratio",      "iDive Deep",    DC_FAMILY_DIVESYSTEM_IDIVE, 0x44, NULL},
 	{"Ratio",      "iDive Tech+",   DC_FAMILY_DIVESYSTEM_IDIVE, 0x45, NULL},
 	{"Seac",       "Jack",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x1000, NULL},
+#endif
+#ifdef ENABLE_FAMILY_COCHRAN
 	/* Cochran Commander */
 	{"Cochran", "Commander TM", DC_FAMILY_COCHRAN_COMMANDER, 0, NULL},
 	{"Cochran", "Commander I",  DC_FAMILY_COCHRAN_COMMANDER, 1, NULL},
@@ -350,103 +386,184 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Cochran", "EMC-14",       DC_FAMILY_COCHRAN_COMMANDER, 3, NULL},
 	{"Cochran", "EMC-16",       DC_FAMILY_COCHRAN_COMMANDER, 4, NULL},
 	{"Cochran", "EMC-20H",      DC_FAMILY_COCHRAN_COMMANDER, 5, NULL},
+#endif
 };
 
-static int
-dc_filter_internal_name (const char *name, const char *values[], size_t count)
+#if defined(ENABLE_FAMILY_UWATEC) || defined(ENABLE_FAMILY_SHEARWATER) || defined(ENABLE_FAMILY_HW)
+#define NAMES
+
+typedef struct dc_name_t {
+	const char *name;
+	unsigned int prefix;
+	dc_transport_t transport;
+	dc_filter_t filter;
+} dc_name_t;
+
+/*
+ * The names reported by the devices over the irda and bluetooth
+ * transports, with the filter of the descriptors accepting them. A
+ * prefix entry matches all names starting with it. The table is sorted
+ * on the name (case insensitive), to allow a binary search, and there
+ * are no other entries starting with a prefix entry.
+ */
+static const dc_name_t g_names[] = {
+#ifdef ENABLE_FAMILY_UWATEC
+	{"Aladin Smart Com", 0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+	{"Aladin Smart Pro", 0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+	{"Aladin Smart Tec", 0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+	{"Aladin Smart Z",   0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+#endif
+#ifdef ENABLE_FAMILY_HW
+	{"FROG",             1, DC_TRANSPORT_BLUETOOTH, dc_filter_hw},
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
+	{"Nerd",             0, DC_TRANSPORT_BLUETOOTH, dc_filter_shearwater},
+#endif
+#ifdef ENABLE_FAMILY_HW
+	{"OSTC",             1, DC_TRANSPORT_BLUETOOTH, dc_filter_hw},
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
+	{"Perdix",           0, DC_TRANSPORT_BLUETOOTH, dc_filter_shearwater},
+	{"Petrel",           0, DC_TRANSPORT_BLUETOOTH, dc_filter_shearwater},
+	{"Predator",         0, DC_TRANSPORT_BLUETOOTH, dc_filter_shearwater},
+#endif
+#ifdef ENABLE_FAMILY_UWATEC
+	{"Uwatec Aladin",      0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+	{"UWATEC Galileo",     0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+	{"UWATEC Galileo Sol", 0, DC_TRANSPORT_IRDA, dc_filter_uwatec},
+#endif
+};
+
+static const dc_name_t *
+dc_name_lookup (dc_transport_t transport, const char *name)
 {
 	if (name == NULL)
-		return 0;
+		return NULL;
 
-	for (size_t i = 0; i < count; ++i) {
-		if (strcasecmp (name, values[i]) == 0) {
-			return 1;
-		}
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_names);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const dc_name_t *entry = &g_names[mid];
+		int cmp = entry->prefix ?
+			strncasecmp (name, entry->name, strlen (entry->name)) :
+			strcasecmp (name, entry->name);
+		if (cmp == 0)
+			return entry->transport == transport ? entry : NULL;
+		else if (cmp > 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	return 0;
+	return NULL;
 }
 
 static int
-dc_filter_internal_usb (const dc_usb_desc_t *desc, const dc_usb_desc_t values[], size_t count)
+dc_filter_internal_name (dc_transport_t transport, const char *name, dc_filter_t filter)
+{
+	const dc_name_t *entry = dc_name_lookup (transport, name);
+
+	return entry != NULL && entry->filter == filter;
+}
+#endif
+
+typedef struct dc_usb_device_t {
+	unsigned short vid;
+	unsigned short pid;
+	dc_family_t type;
+	unsigned int model;
+} dc_usb_device_t;
+
+/*
+ * The known USB devices. The table is sorted on the vendor and product
+ * id, to allow a binary search.
+ */
+static const dc_usb_device_t g_usb_devices[] = {
+	{0x1493, 0x0030, DC_FAMILY_SUUNTO_EONSTEEL, 0}, // Eon Steel
+	{0x1493, 0x0033, DC_FAMILY_SUUNTO_EONSTEEL, 1}, // Eon Core
+	{0x2e6c, 0x3201, DC_FAMILY_UWATEC_G2, 0x32}, // G2
+	{0xc251, 0x2006, DC_FAMILY_UWATEC_G2, 0x22}, // Aladin Square
+};
+
+static const dc_usb_device_t *
+dc_usb_lookup (unsigned int vid, unsigned int pid)
+{
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_usb_devices);
+	unsigned int key = (vid << 16) | pid;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const dc_usb_device_t *device = &g_usb_devices[mid];
+		unsigned int value = (device->vid << 16) | device->pid;
+		if (value == key)
+			return device;
+		else if (value < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+#if defined(ENABLE_FAMILY_UWATEC) || defined(ENABLE_FAMILY_SUUNTO)
+static int
+dc_filter_internal_usb (const dc_usb_desc_t *desc, dc_family_t type)
 {
 	if (desc == NULL)
 		return 0;
 
-	for (size_t i = 0; i < count; ++i) {
-		if (desc->vid == values[i].vid &&
-			desc->pid == values[i].pid) {
-			return 1;
-		}
-	}
+	const dc_usb_device_t *device = dc_usb_lookup (desc->vid, desc->pid);
 
-	return 0;
+	return device != NULL && device->type == type;
 }
+#endif
 
+#ifdef ENABLE_FAMILY_UWATEC
 static int dc_filter_uwatec (dc_transport_t transport, const void *userdata)
 {
-	static const char *irda[] = {
-		"Aladin Smart Com",
-		"Aladin Smart Pro",
-		"Aladin Smart Tec",
-		"Aladin Smart Z",
-		"Uwatec Aladin",
-		"UWATEC Galileo",
-		"UWATEC Galileo Sol",
-	};
-	static const dc_usb_desc_t usbhid[] = {
-		{0x2e6c, 0x3201}, // G2
-		{0xc251, 0x2006}, // Aladin Square
-	};
-
 	if (transport == DC_TRANSPORT_IRDA) {
-		return dc_filter_internal_name ((const char *) userdata, irda, C_ARRAY_SIZE(irda));
+		return dc_filter_internal_name (transport, (const char *) userdata, dc_filter_uwatec);
 	} else if (transport == DC_TRANSPORT_USBHID) {
-		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, usbhid, C_ARRAY_SIZE(usbhid));
+		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, DC_FAMILY_UWATEC_G2);
 	}
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_FAMILY_SUUNTO
 static int dc_filter_suunto (dc_transport_t transport, const void *userdata)
 {
-	static const dc_usb_desc_t usbhid[] = {
-		{0x1493, 0x0030}, // Eon Steel
-		{0x1493, 0x0033}, // Eon Core
-	};
-
 	if (transport == DC_TRANSPORT_USBHID) {
-		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, usbhid, C_ARRAY_SIZE(usbhid));
+		return dc_filter_internal_usb ((const dc_usb_desc_t *) userdata, DC_FAMILY_SUUNTO_EONSTEEL);
 	}
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_FAMILY_HW
 static int dc_filter_hw (dc_transport_t transport, const void *userdata)
 {
 	if (transport == DC_TRANSPORT_BLUETOOTH) {
-		return strncasecmp ((const char *) userdata, "OSTC", 4) == 0 ||
-			strncasecmp ((const char *) userdata, "FROG", 4) == 0;
+		return dc_filter_internal_name (transport, (const char *) userdata, dc_filter_hw);
 	}
 
 	return 1;
 }
+#endif
 
+#ifdef ENABLE_FAMILY_SHEARWATER
 static int dc_filter_shearwater (dc_transport_t transport, const void *userdata)
 {
-	static const char *bluetooth[] = {
-		"Predator",
-		"Petrel",
-		"Nerd",
-		"Perdix",
-	};
-
 	if (transport == DC_TRANSPORT_BLUETOOTH) {
-		return dc_filter_internal_name ((const char *) userdata, bluetooth, C_ARRAY_SIZE(bluetooth));
+		return dc_filter_internal_name (transport, (const char *) userdata, dc_filter_shearwater);
 	}
 
 	return 1;
 }
+#endif
 
 dc_status_t
 dc_descriptor_iterator (dc_iterator_t **out)
@@ -461,18 +578,106 @@ dc_descriptor_iterator (dc_iterator_t **out)
 		return DC_STATUS_NOMEMORY;
 
 	iterator->current = 0;
+	iterator->match = 0;
+	iterator->filter = NULL;
+
+	*out = (dc_iterator_t *) iterator;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_descriptor_match_name (dc_iterator_t **out, dc_transport_t transport, const char *name)
+{
+	dc_descriptor_iterator_t *iterator = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	iterator = (dc_descriptor_iterator_t *) dc_iterator_allocate (NULL, &dc_descriptor_iterator_vtable);
+	if (iterator == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	iterator->current = 0;
+	iterator->match = 1;
+	iterator->filter = NULL;
+
+	// Look up the name only once. Without a match, there are no
+	// descriptors to return at all.
+#ifdef NAMES
+	const dc_name_t *entry = dc_name_lookup (transport, name);
+	if (entry) {
+		iterator->filter = entry->filter;
+	} else {
+		iterator->current = C_ARRAY_SIZE (g_descriptors);
+	}
+#else
+	iterator->current = C_ARRAY_SIZE (g_descriptors);
+#endif
 
 	*out = (dc_iterator_t *) iterator;
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_descriptor_find_by_name (dc_descriptor_t **out, const char *vendor, const char *product)
+{
+	if (out == NULL || vendor == NULL || product == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		if (strcasecmp (g_descriptors[i].product, product) == 0 &&
+			strcasecmp (g_descriptors[i].vendor, vendor) == 0) {
+			*out = (dc_descriptor_t *) &g_descriptors[i];
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	return DC_STATUS_NODEVICE;
+}
+
+dc_status_t
+dc_descriptor_find_by_model (dc_descriptor_t **out, dc_family_t type, unsigned int model)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		if (g_descriptors[i].type == type &&
+			g_descriptors[i].model == model) {
+			*out = (dc_descriptor_t *) &g_descriptors[i];
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	return DC_STATUS_NODEVICE;
+}
+
+dc_status_t
+dc_descriptor_find_by_usb (dc_descriptor_t **out, unsigned int vid, unsigned int pid)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const dc_usb_device_t *device = dc_usb_lookup (vid, pid);
+	if (device == NULL)
+		return DC_STATUS_NODEVICE;
+
+	return dc_descriptor_find_by_model (out, device->type, device->model);
+}
+
 static dc_status_t
 dc_descriptor_iterator_next (dc_iterator_t *abstract, void *out)
 {
 	dc_descriptor_iterator_t *iterator = (dc_descriptor_iterator_t *) abstract;
 	dc_descriptor_t **item = (dc_descriptor_t **) out;
 
+	while (iterator->match &&
+		iterator->current < C_ARRAY_SIZE (g_descriptors) &&
+		g_descriptors[iterator->current].filter != iterator->filter)
+		iterator->current++;
+
 	if (iterator->current >= C_ARRAY_SIZE (g_descriptors))
 		return DC_STATUS_DONE;
 
@@ -548,6 +753,115 @@ dc_descriptor_get_transport (dc_descriptor_t *descriptor)
 		return DC_TRANSPORT_SERIAL;
 }
 
+typedef struct dc_memory_entry_t {
+	dc_family_t type;
+	dc_memory_t memory;
+	unsigned int download;
+	unsigned int dump;
+} dc_memory_entry_t;
+
+/*
+ * The peak memory of the families, for their largest model. The
+ * download size is the largest buffer of dc_device_foreach, and the
+ * dump size the memory image of dc_device_dump. The Uwatec families,
+ * except for the Aladin, download all new dives in a single answer,
+ * and check its size once it is known.
+ */
+static const dc_memory_entry_t g_memory[] = {
+	{DC_FAMILY_SUUNTO_SOLUTION,     DC_MEMORY_IMAGE,   0x100,    0x100},
+	{DC_FAMILY_SUUNTO_EON,          DC_MEMORY_IMAGE,   0x900,    0x900},
+	{DC_FAMILY_SUUNTO_VYPER,        DC_MEMORY_PROFILE, 0x2000,   0x2000},
+	{DC_FAMILY_SUUNTO_VYPER2,       DC_MEMORY_PROFILE, 0x8000,   0x8000},
+	{DC_FAMILY_SUUNTO_D9,           DC_MEMORY_PROFILE, 0x10000,  0x10000},
+	{DC_FAMILY_SUUNTO_EONSTEEL,     DC_MEMORY_DIVE,    0,        0},
+	{DC_FAMILY_REEFNET_SENSUS,      DC_MEMORY_IMAGE,   32768,    32768},
+	{DC_FAMILY_REEFNET_SENSUSPRO,   DC_MEMORY_IMAGE,   56320,    56320},
+	{DC_FAMILY_REEFNET_SENSUSULTRA, DC_MEMORY_IMAGE,   2080768,  2080768},
+	{DC_FAMILY_UWATEC_ALADIN,       DC_MEMORY_IMAGE,   2048,     2048},
+	{DC_FAMILY_UWATEC_MEMOMOUSE,    DC_MEMORY_IMAGE,   0x10002,  0x10002},
+	{DC_FAMILY_UWATEC_SMART,        DC_MEMORY_IMAGE,   0,        0},
+	{DC_FAMILY_UWATEC_MERIDIAN,     DC_MEMORY_IMAGE,   0,        0},
+	{DC_FAMILY_UWATEC_G2,           DC_MEMORY_IMAGE,   0,        0},
+	{DC_FAMILY_OCEANIC_VTPRO,       DC_MEMORY_PROFILE, 0x20000,  0x20000},
+	{DC_FAMILY_OCEANIC_VEO250,      DC_MEMORY_PROFILE, 0x8000,   0x8000},
+	{DC_FAMILY_OCEANIC_ATOM2,       DC_MEMORY_PROFILE, 0x40000,  0x40000},
+	{DC_FAMILY_MARES_NEMO,          DC_MEMORY_IMAGE,   0x4000,   0x4000},
+	{DC_FAMILY_MARES_PUCK,          DC_MEMORY_IMAGE,   0x8000,   0x8000},
+	{DC_FAMILY_MARES_DARWIN,        DC_MEMORY_PROFILE, 0x4000,   0x4000},
+	{DC_FAMILY_MARES_ICONHD,        DC_MEMORY_PROFILE, 0x100000, 0x100000},
+	{DC_FAMILY_HW_OSTC,             DC_MEMORY_IMAGE,   0x1010A,  0x1010A},
+	{DC_FAMILY_HW_FROG,             DC_MEMORY_DIVE,    0,        0},
+	{DC_FAMILY_HW_OSTC3,            DC_MEMORY_DIVE,    0,        0x400000},
+	{DC_FAMILY_CRESSI_EDY,          DC_MEMORY_PROFILE, 0x8000,   0x8000},
+	{DC_FAMILY_CRESSI_LEONARDO,     DC_MEMORY_PROFILE, 32000,    32000},
+	{DC_FAMILY_ZEAGLE_N2ITION3,     DC_MEMORY_IMAGE,   0x8000,   0x8000},
+	{DC_FAMILY_ATOMICS_COBALT,      DC_MEMORY_DIVE,    0x1D2000, 0},
+	{DC_FAMILY_SHEARWATER_PREDATOR, DC_MEMORY_IMAGE,   0x20080,  0x20080},
+	{DC_FAMILY_SHEARWATER_PETREL,   DC_MEMORY_DIVE,    0,        0},
+	{DC_FAMILY_DIVERITE_NITEKQ,     DC_MEMORY_IMAGE,   0x8100,   0x8100},
+	{DC_FAMILY_CITIZEN_AQUALAND,    DC_MEMORY_IMAGE,   0,        0},
+	{DC_FAMILY_DIVESYSTEM_IDIVE,    DC_MEMORY_DIVE,    0,        0},
+	{DC_FAMILY_COCHRAN_COMMANDER,   DC_MEMORY_DIVE,    0,        0x200000},
+};
+
+dc_memory_t
+dc_family_get_memory (dc_family_t family, unsigned int *download, unsigned int *dump)
+{
+	const dc_memory_entry_t *entry = NULL;
+
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (g_memory); ++i) {
+		if (g_memory[i].type == family) {
+			entry = &g_memory[i];
+			break;
+		}
+	}
+
+	if (download)
+		*download = entry ? entry->download : 0;
+	if (dump)
+		*dump = entry ? entry->dump : 0;
+
+	return entry ? entry->memory : DC_MEMORY_DIVE;
+}
+
+#define NBAUDRATES 4
+
+typedef struct dc_baudrate_entry_t {
+	dc_family_t type;
+	unsigned int count;
+	unsigned int baudrates[NBAUDRATES];
+} dc_baudrate_entry_t;
+
+/*
+ * The baudrates of the families which have no fixed baudrate. The
+ * correct one can only be found by trying them.
+ */
+static const dc_baudrate_entry_t g_baudrates[] = {
+	{DC_FAMILY_SUUNTO_D9, 2, {115200, 9600}},
+};
+
+unsigned int
+dc_family_get_baudrates (dc_family_t family, const unsigned int **baudrates)
+{
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (g_baudrates); ++i) {
+		if (g_baudrates[i].type == family) {
+			if (baudrates)
+				*baudrates = g_baudrates[i].baudrates;
+			return g_baudrates[i].count;
+		}
+	}
+
+	if (baudrates)
+		*baudrates = NULL;
+	return 0;
+}
+
+dc_memory_t
+dc_descriptor_get_memory (dc_descriptor_t *descriptor, unsigned int *download, unsigned int *dump)
+{
+	return dc_family_get_memory (descriptor ? descriptor->type : DC_FAMILY_NULL, download, dump);
+}
+
 dc_filter_t
 dc_descriptor_get_filter (dc_descriptor_t *descriptor)
 {
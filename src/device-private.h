@@ -26,8 +26,10 @@
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/iostream.h>
 
 #include "common-private.h"
+#include "timer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,10 +37,14 @@ extern "C" {
 
 #define EVENT_PROGRESS_INITIALIZER {0, UINT_MAX}
 
+// Not in any phase.
+#define DEVICE_PHASE_NONE DC_EVENT_STATS_NPHASES
+
 struct dc_device_t;
 struct dc_device_vtable_t;
 
 typedef struct dc_device_vtable_t dc_device_vtable_t;
+typedef struct dc_eventqueue_t dc_eventqueue_t;
 
 struct dc_device_t {
 	const dc_device_vtable_t *vtable;
@@ -51,9 +57,43 @@ struct dc_device_t {
 	// Cancellation support.
 	dc_cancel_callback_t cancel_callback;
 	void *cancel_userdata;
+	volatile int cancelled;
 	// Cached events for the parsers.
 	dc_event_devinfo_t devinfo;
 	dc_event_clock_t clock;
+	// Pipelined dive delivery.
+	unsigned int pipeline;
+	// Queued event delivery.
+	dc_eventqueue_t *eventqueue;
+	// Memory dump checkpoint.
+	dc_buffer_t *checkpoint;
+	// Progress throttling.
+	unsigned int progress_interval;
+	unsigned int progress_delta;
+	dc_timer_t *progress_timer;
+	dc_event_progress_t progress_last;
+	dc_usecs_t progress_time;
+	unsigned int progress_valid;
+	// Transport statistics.
+	dc_iostream_t *iostream;
+	unsigned int retries;
+	unsigned int checksums;
+	// Throughput estimate.
+	unsigned int throughput_valid;
+	unsigned int throughput_maximum;
+	unsigned int throughput_refined;
+	unsigned int throughput_current;
+	double throughput_rate;
+	dc_usecs_t throughput_begin;
+	dc_usecs_t throughput_time;
+	dc_usecs_t throughput_advanced;
+	// Phase timing.
+	dc_timer_t *phase_timer;
+	unsigned int phase;
+	dc_usecs_t phase_begin;
+	dc_usecs_t phases[DC_EVENT_STATS_NPHASES];
+	// Memory statistics of the session.
+	dc_memory_stats_t memory;
 };
 
 struct dc_device_vtable_t {
@@ -91,9 +131,87 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 int
 device_is_cancelled (dc_device_t *device);
 
+/*
+ * Register the I/O stream of the device, to include its counters in
+ * the transport statistics.
+ */
+void
+device_set_iostream (dc_device_t *device, dc_iostream_t *iostream);
+
+void
+device_stats_retry (dc_device_t *device);
+
+void
+device_stats_checksum (dc_device_t *device);
+
+/*
+ * Switch to another phase, and return the previous one. The time since
+ * the previous switch is attributed to the previous phase.
+ */
+unsigned int
+device_set_phase (dc_device_t *device, unsigned int phase);
+
+int
+device_is_known (dc_device_t *device, const unsigned char fingerprint[], unsigned int size);
+
 dc_status_t
 device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize);
 
+/*
+ * Checkpoint support for the backends that dump the memory in blocks.
+ * device_checkpoint_resume copies the checkpoint into the dump, and
+ * returns the offset of the last block of the checkpoint, where the
+ * download starts. device_checkpoint_verify compares a downloaded block
+ * against the checkpoint, and drops the checkpoint on a mismatch, in
+ * which case the download starts over from the beginning.
+ * device_checkpoint_emit reports the completed part of the dump.
+ */
+unsigned int
+device_checkpoint_resume (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize);
+
+int
+device_checkpoint_verify (dc_device_t *device, unsigned int offset, const unsigned char data[], unsigned int size);
+
+void
+device_checkpoint_emit (dc_device_t *device, const unsigned char data[], unsigned int size);
+
+dc_status_t
+device_dump_read_adaptive (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize, unsigned int maxsize);
+
+typedef dc_status_t (*device_probe_t) (dc_device_t *device, void *userdata);
+
+/*
+ * Select the fastest baudrate of the family (see dc_family_get_baudrates)
+ * which works with both the device and the serial adapter. The baudrate
+ * that worked before on the same port is tried first, then the hint (the
+ * baudrate of the model, or zero if not known), and then the others from
+ * the fastest to the slowest. Each baudrate is verified with the probe
+ * function, a cheap command with a known answer. A baudrate which the
+ * adapter rejects, or which fails the probe, is skipped. The baudrate
+ * that works is remembered for the port.
+ */
+dc_status_t
+device_serial_upshift (dc_device_t *device, dc_iostream_t *iostream, const char *name, unsigned int hint,
+	unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol,
+	device_probe_t probe, void *userdata);
+
+/*
+ * A range of memory addresses, from begin (inclusive) to end
+ * (exclusive).
+ */
+typedef struct device_range_t {
+	unsigned int begin;
+	unsigned int end;
+} device_range_t;
+
+/*
+ * Read only the given ranges of the memory into the buffer, leaving the
+ * rest of the buffer untouched. This is used to update the mirror of a
+ * previous dump with the parts that can have changed.
+ */
+dc_status_t
+device_dump_ranges (dc_device_t *device, unsigned char data[], unsigned int size, const device_range_t ranges[], unsigned int count, unsigned int blocksize);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
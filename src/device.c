@@ -20,6 +20,7 @@
  */
 
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -59,7 +60,105 @@
 #include "cochran_commander.h"
 
 #include "device-private.h"
+#include "descriptor-private.h"
+#include "iostream-private.h"
 #include "context-private.h"
+#include "mapping.h"
+#include "probe.h"
+#include "thread.h"
+#include "timer.h"
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+// Polling interval for the cancellation checks (milliseconds).
+#define PIPELINE_POLL 100
+
+// Latency budget for growing the adaptive dump block size (microseconds).
+#define DUMP_LATENCY 500000
+
+// Maximum number of concurrent connection attempts.
+#define RACE_MAXNAMES 8
+
+// Maximum number of threads for the parallel dive extraction.
+#define EXTRACT_MAXTHREADS 32
+
+// Minimum window (microseconds) and time constant (seconds) of the
+// smoothed transfer rate.
+#define THROUGHPUT_WINDOW    250000
+#define THROUGHPUT_SMOOTHING 3.0
+
+typedef struct dc_pipeline_item_t {
+	unsigned char *data;
+	unsigned int size;
+	unsigned char *fingerprint;
+	unsigned int fsize;
+} dc_pipeline_item_t;
+
+typedef struct dc_pipeline_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+	unsigned int depth;
+	unsigned int head;
+	unsigned int count;
+	unsigned int finished;
+	unsigned int stopped;
+	dc_pipeline_item_t items[];
+} dc_pipeline_t;
+
+typedef struct dc_eventqueue_item_t {
+	dc_event_type_t event;
+	union {
+		dc_event_progress_t progress;
+		dc_event_throughput_t throughput;
+		dc_event_devinfo_t devinfo;
+		dc_event_clock_t clock;
+		dc_event_vendor_t vendor;
+		dc_event_stats_t stats;
+		dc_event_divedata_t divedata;
+		dc_event_logbook_t logbook;
+		dc_event_checkpoint_t checkpoint;
+	} data;
+	// Copy of the data the event points to.
+	dc_buffer_t *payload;
+} dc_eventqueue_item_t;
+
+/*
+ * The events are copied into a ring of slots. The lock is only held to
+ * move an event in or out of the ring, and never while the callback is
+ * running. The payload buffers are recycled: the producer copies into
+ * the staging buffer and swaps it with the buffer of the free slot, and
+ * the consumer does the same with the scratch buffer.
+ *
+ * The checkpoints are coalesced into a single queued event, which
+ * refers to the checkpoint buffer at the time it is delivered. The two
+ * checkpoint buffers hold a prefix of the memory dump, and are swapped
+ * on delivery, such that usually only the new part of the dump needs
+ * to be copied. The generation changes when the dump starts over.
+ */
+struct dc_eventqueue_t {
+	dc_device_t *device;
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+	dc_thread_t *thread;
+	unsigned int quit;
+	unsigned int busy;
+	unsigned int depth;
+	unsigned int head;
+	unsigned int count;
+	dc_buffer_t *staging;
+	dc_buffer_t *scratch;
+	unsigned int checkpoint_pending;
+	unsigned int checkpoint_size;
+	unsigned int generation;
+	dc_buffer_t *checkpoint[2];
+	unsigned int checkpoint_generation[2];
+	dc_eventqueue_item_t items[];
+};
+
+static void dc_eventqueue_free (dc_eventqueue_t *queue);
 
 dc_device_t *
 dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
@@ -70,7 +169,7 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_device_t));
 
 	// Allocate memory.
-	device = (dc_device_t *) malloc (vtable->size);
+	device = (dc_device_t *) dc_context_alloc (context, vtable->size);
 	if (device == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return device;
@@ -86,17 +185,56 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 
 	device->cancel_callback = NULL;
 	device->cancel_userdata = NULL;
+	device->cancelled = 0;
 
 	memset (&device->devinfo, 0, sizeof (device->devinfo));
 	memset (&device->clock, 0, sizeof (device->clock));
 
+	device->pipeline = 0;
+
+	device->eventqueue = NULL;
+
+	device->checkpoint = NULL;
+
+	device->progress_interval = 0;
+	device->progress_delta = 0;
+	device->progress_timer = NULL;
+	device->progress_valid = 0;
+	device->progress_time = 0;
+	memset (&device->progress_last, 0, sizeof (device->progress_last));
+
+	device->throughput_valid = 0;
+
+	device->iostream = NULL;
+	device->retries = 0;
+	device->checksums = 0;
+
+	// The backends allocate the device at the start of the open, so
+	// the open phase starts with the timer. Without a timer, the phases
+	// are not measured.
+	device->phase_timer = NULL;
+	device->phase = DC_PHASE_OPEN;
+	device->phase_begin = 0;
+	memset (device->phases, 0, sizeof (device->phases));
+	memset (&device->memory, 0, sizeof (device->memory));
+	if (dc_timer_new (&device->phase_timer) != DC_STATUS_SUCCESS) {
+		WARNING (context, "Failed to create a timer.");
+	}
+
 	return device;
 }
 
 void
 dc_device_deallocate (dc_device_t *device)
 {
-	free (device);
+	if (device == NULL)
+		return;
+
+	dc_eventqueue_free (device->eventqueue);
+	dc_buffer_free (device->checkpoint);
+	dc_timer_free (device->phase_timer);
+	dc_timer_free (device->progress_timer);
+	dc_context_release (device->context, device);
 }
 
 dc_status_t
@@ -104,11 +242,17 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
+	dc_memory_scope_t scope;
+	dc_memory_stats_t memory = {0};
 
 	if (out == NULL || descriptor == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	// The memory of the session includes the device itself.
+	dc_context_memory_begin (context, &scope);
+
 	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_FAMILY_SUUNTO
 	case DC_FAMILY_SUUNTO_SOLUTION:
 		rc = suunto_solution_device_open (&device, context, name);
 		break;
@@ -127,6 +271,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_SUUNTO_EONSTEEL:
 		rc = suunto_eonsteel_device_open (&device, context, name, dc_descriptor_get_model(descriptor));
 		break;
+#endif
+#ifdef ENABLE_FAMILY_UWATEC
 	case DC_FAMILY_UWATEC_ALADIN:
 		rc = uwatec_aladin_device_open (&device, context, name);
 		break;
@@ -142,6 +288,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_UWATEC_G2:
 		rc = scubapro_g2_device_open (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_FAMILY_REEFNET
 	case DC_FAMILY_REEFNET_SENSUS:
 		rc = reefnet_sensus_device_open (&device, context, name);
 		break;
@@ -151,6 +299,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_REEFNET_SENSUSULTRA:
 		rc = reefnet_sensusultra_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_OCEANIC
 	case DC_FAMILY_OCEANIC_VTPRO:
 		rc = oceanic_vtpro_device_open (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
@@ -160,6 +310,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_OCEANIC_ATOM2:
 		rc = oceanic_atom2_device_open (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_FAMILY_MARES
 	case DC_FAMILY_MARES_NEMO:
 		rc = mares_nemo_device_open (&device, context, name);
 		break;
@@ -172,6 +324,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_MARES_ICONHD:
 		rc = mares_iconhd_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_device_open (&device, context, name);
 		break;
@@ -181,6 +335,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_CRESSI
 	case DC_FAMILY_CRESSI_EDY:
 		rc = cressi_edy_device_open (&device, context, name);
 		break;
@@ -190,29 +346,50 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_ZEAGLE_N2ITION3:
 		rc = zeagle_n2ition3_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_ATOMICS
 	case DC_FAMILY_ATOMICS_COBALT:
 		rc = atomics_cobalt_device_open (&device, context);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_device_open (&device, context, name);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_DIVERITE
 	case DC_FAMILY_DIVERITE_NITEKQ:
 		rc = diverite_nitekq_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_CITIZEN
 	case DC_FAMILY_CITIZEN_AQUALAND:
 		rc = citizen_aqualand_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_DIVESYSTEM
 	case DC_FAMILY_DIVESYSTEM_IDIVE:
 		rc = divesystem_idive_device_open (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_FAMILY_COCHRAN
 	case DC_FAMILY_COCHRAN_COMMANDER:
 		rc = cochran_commander_device_open (&device, context, name);
 		break;
+#endif
 	default:
-		return DC_STATUS_INVALIDARGS;
+		rc = DC_STATUS_INVALIDARGS;
+		break;
+	}
+
+	dc_context_memory_end (context, &scope, &memory);
+
+	if (rc == DC_STATUS_SUCCESS) {
+		device->memory = memory;
+		device_set_phase (device, DEVICE_PHASE_NONE);
 	}
 
 	*out = device;
@@ -220,6 +397,142 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	return rc;
 }
 
+typedef struct dc_race_t dc_race_t;
+
+typedef struct dc_race_attempt_t {
+	dc_race_t *race;
+	const char *name;
+	dc_thread_t *thread;
+	dc_iostream_t *iostream;
+	dc_device_t *device;
+	dc_status_t status;
+} dc_race_attempt_t;
+
+struct dc_race_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	dc_mutex_t *mutex;
+	dc_race_attempt_t *winner;
+	unsigned int count;
+	dc_race_attempt_t attempts[RACE_MAXNAMES];
+};
+
+static void
+dc_race_watch_cb (dc_iostream_t *iostream, int attached, void *userdata)
+{
+	dc_race_attempt_t *attempt = (dc_race_attempt_t *) userdata;
+	dc_race_t *race = attempt->race;
+
+	dc_mutex_lock (race->mutex);
+	if (attached) {
+		attempt->iostream = iostream;
+		// Give up right away if another attempt already won.
+		if (race->winner)
+			dc_iostream_cancel (iostream);
+	} else if (attempt->iostream == iostream) {
+		attempt->iostream = NULL;
+	}
+	dc_mutex_unlock (race->mutex);
+}
+
+static void
+dc_race_attempt_run (void *userdata)
+{
+	dc_race_attempt_t *attempt = (dc_race_attempt_t *) userdata;
+	dc_race_t *race = attempt->race;
+	dc_device_t *device = NULL;
+
+	dc_context_watch_iostream (race->context, dc_race_watch_cb, attempt);
+	dc_status_t status = dc_device_open (&device, race->context, race->descriptor, attempt->name);
+	dc_context_watch_iostream (race->context, NULL, NULL);
+
+	dc_mutex_lock (race->mutex);
+	attempt->iostream = NULL;
+	attempt->device = (status == DC_STATUS_SUCCESS ? device : NULL);
+	attempt->status = status;
+	if (status == DC_STATUS_SUCCESS && race->winner == NULL) {
+		race->winner = attempt;
+		INFO (race->context, "Connected first over '%s'.", attempt->name ? attempt->name : "");
+
+		// Cancel the other attempts.
+		for (unsigned int i = 0; i < race->count; ++i) {
+			if (race->attempts[i].iostream)
+				dc_iostream_cancel (race->attempts[i].iostream);
+		}
+	}
+	dc_mutex_unlock (race->mutex);
+}
+
+dc_status_t
+dc_device_open_race (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, const char *names[], unsigned int count)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_race_t race;
+
+	if (out == NULL || descriptor == NULL || names == NULL ||
+		count == 0 || count > RACE_MAXNAMES)
+		return DC_STATUS_INVALIDARGS;
+
+	if (count == 1)
+		return dc_device_open (out, context, descriptor, names[0]);
+
+	race.context = context;
+	race.descriptor = descriptor;
+	race.mutex = NULL;
+	race.winner = NULL;
+	race.count = count;
+	for (unsigned int i = 0; i < count; ++i) {
+		race.attempts[i].race = &race;
+		race.attempts[i].name = names[i];
+		race.attempts[i].thread = NULL;
+		race.attempts[i].iostream = NULL;
+		race.attempts[i].device = NULL;
+		race.attempts[i].status = DC_STATUS_CANCELLED;
+	}
+
+	// Without thread support, the mutex functions are no-ops for a
+	// NULL mutex, and the attempts are made one after the other.
+	dc_mutex_new (&race.mutex);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_mutex_lock (race.mutex);
+		int finished = (race.winner != NULL);
+		dc_mutex_unlock (race.mutex);
+		if (finished)
+			break;
+
+		if (dc_thread_new (&race.attempts[i].thread, dc_race_attempt_run, &race.attempts[i]) != DC_STATUS_SUCCESS) {
+			race.attempts[i].thread = NULL;
+			dc_race_attempt_run (&race.attempts[i]);
+		}
+	}
+
+	// The cancelled attempts fail at their next I/O call, or right
+	// away on the transports that can interrupt a blocking call.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (race.attempts[i].thread)
+			dc_thread_join (race.attempts[i].thread);
+	}
+
+	dc_mutex_free (race.mutex);
+
+	// Close the devices that connected too late.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (&race.attempts[i] != race.winner)
+			dc_device_close (race.attempts[i].device);
+	}
+
+	if (race.winner == NULL) {
+		status = race.attempts[0].status;
+		ERROR (context, "Failed to connect over any of the %u transports.", count);
+		return status;
+	}
+
+	*out = race.winner->device;
+
+	return DC_STATUS_SUCCESS;
+}
+
 
 int
 dc_device_isinstance (dc_device_t *device, const dc_device_vtable_t *vtable)
@@ -253,6 +566,25 @@ dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_device_cancel (dc_device_t *device)
+{
+	if (device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	device->cancelled = 1;
+
+	// Interrupt any blocking I/O. Transports that can't interrupt a call
+	// in progress still fail every call made after this point.
+	if (device->iostream) {
+		dc_status_t rc = dc_iostream_cancel (device->iostream);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata)
@@ -281,193 +613,1753 @@ dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsi
 }
 
 
-dc_status_t
-dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
+static dc_buffer_t *
+dc_eventqueue_payload (dc_context_t *context, dc_buffer_t **payload, const unsigned char data[], size_t size)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (*payload == NULL && (*payload = dc_buffer_new2 (context, size)) == NULL)
+		return NULL;
 
-	if (device->vtable->read == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (!dc_buffer_clear (*payload) || !dc_buffer_append (*payload, data, size))
+		return NULL;
 
-	return device->vtable->read (device, address, data, size);
+	return *payload;
 }
 
 
-dc_status_t
-dc_device_write (dc_device_t *device, unsigned int address, const unsigned char data[], unsigned int size)
+/*
+ * Copy the event into the item, with the variable data in the staging
+ * buffer. The pointers are restored when the event is delivered.
+ */
+static int
+dc_eventqueue_copy (dc_eventqueue_t *queue, dc_eventqueue_item_t *item, dc_event_type_t event, const void *data)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	item->event = event;
 
-	if (device->vtable->write == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	switch (event) {
+	case DC_EVENT_PROGRESS:
+		item->data.progress = *(const dc_event_progress_t *) data;
+		break;
+	case DC_EVENT_THROUGHPUT:
+		item->data.throughput = *(const dc_event_throughput_t *) data;
+		break;
+	case DC_EVENT_DEVINFO:
+		item->data.devinfo = *(const dc_event_devinfo_t *) data;
+		break;
+	case DC_EVENT_CLOCK:
+		item->data.clock = *(const dc_event_clock_t *) data;
+		break;
+	case DC_EVENT_STATS:
+		item->data.stats = *(const dc_event_stats_t *) data;
+		break;
+	case DC_EVENT_VENDOR:
+		item->data.vendor = *(const dc_event_vendor_t *) data;
+		if (dc_eventqueue_payload (queue->device->context, &queue->staging, item->data.vendor.data, item->data.vendor.size) == NULL)
+			return 0;
+		break;
+	case DC_EVENT_DIVEDATA:
+		item->data.divedata = *(const dc_event_divedata_t *) data;
+		if (dc_eventqueue_payload (queue->device->context, &queue->staging, item->data.divedata.data, item->data.divedata.size) == NULL)
+			return 0;
+		break;
+	case DC_EVENT_LOGBOOK:
+		// The entries are followed by their fingerprints.
+		item->data.logbook = *(const dc_event_logbook_t *) data;
+		if (dc_eventqueue_payload (queue->device->context, &queue->staging, (const unsigned char *) item->data.logbook.entries,
+			item->data.logbook.count * sizeof (dc_logbook_entry_t)) == NULL)
+			return 0;
+		for (unsigned int i = 0; i < item->data.logbook.count; ++i) {
+			const dc_logbook_entry_t *entry = item->data.logbook.entries + i;
+			if (!dc_buffer_append (queue->staging, entry->fingerprint, entry->fsize))
+				return 0;
+		}
+		break;
+	default:
+		break;
+	}
 
-	return device->vtable->write (device, address, data, size);
+	item->payload = queue->staging;
+
+	return 1;
 }
 
 
-dc_status_t
-dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
+static void
+dc_eventqueue_restore (dc_eventqueue_item_t *item)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	unsigned char *payload = dc_buffer_get_data (item->payload);
 
-	if (device->vtable->dump == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	switch (item->event) {
+	case DC_EVENT_VENDOR:
+		item->data.vendor.data = payload;
+		break;
+	case DC_EVENT_DIVEDATA:
+		item->data.divedata.data = payload;
+		break;
+	case DC_EVENT_LOGBOOK: {
+		dc_logbook_entry_t *entries = (dc_logbook_entry_t *) payload;
+		unsigned char *fingerprint = payload + item->data.logbook.count * sizeof (dc_logbook_entry_t);
+		for (unsigned int i = 0; i < item->data.logbook.count; ++i) {
+			entries[i].fingerprint = entries[i].fsize ? fingerprint : NULL;
+			fingerprint += entries[i].fsize;
+		}
+		item->data.logbook.entries = entries;
+		break;
+	}
+	default:
+		break;
+	}
+}
 
-	if (buffer == NULL)
-		return DC_STATUS_INVALIDARGS;
 
-	dc_buffer_clear (buffer);
+/*
+ * Update the checkpoint buffer, with the lock held. Returns zero if the
+ * checkpoint is already queued, or if the copy failed.
+ */
+static int
+dc_eventqueue_checkpoint (dc_eventqueue_t *queue, const dc_event_checkpoint_t *checkpoint)
+{
+	// A smaller checkpoint means the dump started over.
+	if (checkpoint->size < queue->checkpoint_size)
+		queue->generation++;
+	queue->checkpoint_size = checkpoint->size;
+
+	if (queue->checkpoint[0] == NULL &&
+		(queue->checkpoint[0] = dc_buffer_new2 (queue->device->context, checkpoint->size)) == NULL)
+		return 0;
+
+	dc_buffer_t *buffer = queue->checkpoint[0];
+	size_t size = dc_buffer_get_size (buffer);
+	if (queue->checkpoint_generation[0] != queue->generation || size > checkpoint->size) {
+		dc_buffer_clear (buffer);
+		queue->checkpoint_generation[0] = queue->generation;
+		size = 0;
+	}
 
-	return device->vtable->dump (device, buffer);
+	if (!dc_buffer_append (buffer, checkpoint->data + size, checkpoint->size - size)) {
+		// Start from scratch with the next checkpoint.
+		queue->checkpoint_generation[0] = queue->generation - 1;
+		return 0;
+	}
+
+	return !queue->checkpoint_pending;
 }
 
 
-dc_status_t
-device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
+static void
+dc_eventqueue_post (dc_eventqueue_t *queue, dc_event_type_t event, const void *data)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	dc_device_t *device = queue->device;
+	dc_eventqueue_item_t item;
+
+	if (event == DC_EVENT_CHECKPOINT) {
+		item.event = event;
+		item.payload = queue->staging;
+	} else if (!dc_eventqueue_copy (queue, &item, event, data)) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return;
+	}
 
-	if (device->vtable->read == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	dc_mutex_lock (queue->mutex);
 
-	// Enable progress notifications.
-	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = size;
-	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+	if (event == DC_EVENT_CHECKPOINT) {
+		if (!dc_eventqueue_checkpoint (queue, (const dc_event_checkpoint_t *) data)) {
+			dc_mutex_unlock (queue->mutex);
+			return;
+		}
+		queue->checkpoint_pending = 1;
+	}
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the packet size.
-		unsigned int len = size - nbytes;
-		if (len > blocksize)
-			len = blocksize;
+	// Wait for a free slot, while checking for cancellation.
+	int cancelled = 0;
+	while (queue->count == queue->depth) {
+		dc_mutex_unlock (queue->mutex);
+		cancelled = device_is_cancelled (device);
+		dc_mutex_lock (queue->mutex);
+		if (cancelled)
+			break;
+		if (queue->count == queue->depth)
+			dc_cond_wait (queue->cond, queue->mutex, PIPELINE_POLL);
+	}
 
-		// Read the packet.
-		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+	if (cancelled) {
+		if (event == DC_EVENT_CHECKPOINT)
+			queue->checkpoint_pending = 0;
+	} else {
+		dc_eventqueue_item_t *slot = queue->items + (queue->head + queue->count) % queue->depth;
+		queue->staging = slot->payload;
+		*slot = item;
+		queue->count++;
+		dc_cond_broadcast (queue->cond);
+	}
 
-		// Update and emit a progress event.
-		progress.current += len;
-		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+	dc_mutex_unlock (queue->mutex);
+}
 
-		nbytes += len;
+
+/*
+ * Deliver the queued events. With the wait flag, the function waits for
+ * new events until the queue is stopped.
+ */
+static void
+dc_eventqueue_drain (dc_eventqueue_t *queue, int wait)
+{
+	dc_device_t *device = queue->device;
+
+	dc_mutex_lock (queue->mutex);
+	while (1) {
+		while (wait && queue->count == 0 && !queue->quit)
+			dc_cond_wait (queue->cond, queue->mutex, -1);
+
+		if (queue->count == 0)
+			break;
+
+		dc_eventqueue_item_t *slot = queue->items + queue->head;
+		dc_eventqueue_item_t item = *slot;
+		slot->payload = queue->scratch;
+		queue->scratch = item.payload;
+		queue->head = (queue->head + 1) % queue->depth;
+		queue->count--;
+
+		if (item.event == DC_EVENT_CHECKPOINT) {
+			dc_buffer_t *buffer = queue->checkpoint[0];
+			unsigned int generation = queue->checkpoint_generation[0];
+			queue->checkpoint[0] = queue->checkpoint[1];
+			queue->checkpoint_generation[0] = queue->checkpoint_generation[1];
+			queue->checkpoint[1] = buffer;
+			queue->checkpoint_generation[1] = generation;
+			queue->checkpoint_pending = 0;
+			item.data.checkpoint.data = dc_buffer_get_data (buffer);
+			item.data.checkpoint.size = dc_buffer_get_size (buffer);
+		}
+
+		queue->busy = 1;
+		dc_cond_broadcast (queue->cond);
+		dc_mutex_unlock (queue->mutex);
+
+		dc_eventqueue_restore (&item);
+		if (device->event_callback)
+			device->event_callback (device, item.event, &item.data, device->event_userdata);
+
+		dc_mutex_lock (queue->mutex);
+		queue->busy = 0;
+		dc_cond_broadcast (queue->cond);
 	}
+	dc_mutex_unlock (queue->mutex);
+}
 
-	return DC_STATUS_SUCCESS;
+
+static void
+dc_eventqueue_consumer (void *userdata)
+{
+	dc_eventqueue_drain ((dc_eventqueue_t *) userdata, 1);
 }
 
 
-dc_status_t
-dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+/*
+ * Wait until the background thread has delivered all events. Without
+ * a background thread, the application pumps the events.
+ */
+static void
+dc_eventqueue_flush (dc_eventqueue_t *queue)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (queue == NULL || queue->thread == NULL)
+		return;
 
-	if (device->vtable->foreach == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	dc_mutex_lock (queue->mutex);
+	while (queue->count || queue->busy)
+		dc_cond_wait (queue->cond, queue->mutex, -1);
+	dc_mutex_unlock (queue->mutex);
+}
+
+
+/*
+ * A new memory dump may not start with the data of the previous one.
+ */
+static void
+dc_eventqueue_restart (dc_eventqueue_t *queue)
+{
+	if (queue == NULL)
+		return;
 
-	return device->vtable->foreach (device, callback, userdata);
+	dc_mutex_lock (queue->mutex);
+	queue->generation++;
+	queue->checkpoint_size = 0;
+	dc_mutex_unlock (queue->mutex);
 }
 
 
-dc_status_t
-dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime)
+static void
+dc_eventqueue_free (dc_eventqueue_t *queue)
 {
-	if (device == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (queue == NULL)
+		return;
 
-	if (device->vtable->timesync == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	// The background thread delivers the remaining events first.
+	if (queue->thread) {
+		dc_mutex_lock (queue->mutex);
+		queue->quit = 1;
+		dc_cond_broadcast (queue->cond);
+		dc_mutex_unlock (queue->mutex);
+		dc_thread_join (queue->thread);
+	}
 
-	return device->vtable->timesync (device, datetime);
+	for (unsigned int i = 0; i < queue->depth; ++i)
+		dc_buffer_free (queue->items[i].payload);
+	dc_buffer_free (queue->staging);
+	dc_buffer_free (queue->scratch);
+	dc_buffer_free (queue->checkpoint[0]);
+	dc_buffer_free (queue->checkpoint[1]);
+	dc_cond_free (queue->cond);
+	dc_mutex_free (queue->mutex);
+	dc_context_release (queue->device->context, queue);
 }
 
 
 dc_status_t
-dc_device_close (dc_device_t *device)
+dc_device_set_event_queue (dc_device_t *device, unsigned int depth, unsigned int background)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_eventqueue_t *queue = NULL;
 
 	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_eventqueue_free (device->eventqueue);
+	device->eventqueue = NULL;
+
+	if (depth == 0)
 		return DC_STATUS_SUCCESS;
 
-	// Disable the cancellation callback.
-	device->cancel_callback = NULL;
-	device->cancel_userdata = NULL;
+	// Allocate memory.
+	queue = (dc_eventqueue_t *) dc_context_alloc (device->context, sizeof (dc_eventqueue_t) + depth * sizeof (dc_eventqueue_item_t));
+	if (queue == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
 
-	if (device->vtable->close) {
-		status = device->vtable->close (device);
+	memset (queue, 0, sizeof (dc_eventqueue_t) + depth * sizeof (dc_eventqueue_item_t));
+	queue->device = device;
+	queue->depth = depth;
+
+	status = dc_mutex_new (&queue->mutex);
+	if (status == DC_STATUS_SUCCESS)
+		status = dc_cond_new (&queue->cond);
+	if (status == DC_STATUS_SUCCESS && background)
+		status = dc_thread_new (&queue->thread, dc_eventqueue_consumer, queue);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to start the event queue.");
+		queue->thread = NULL;
+		dc_eventqueue_free (queue);
+		return status;
 	}
 
-	dc_device_deallocate (device);
+	device->eventqueue = queue;
 
-	return status;
+	return DC_STATUS_SUCCESS;
 }
 
 
-void
-device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
+dc_status_t
+dc_device_pump_events (dc_device_t *device)
 {
-	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+	if (device == NULL)
+		return DC_STATUS_INVALIDARGS;
 
-	// Check the event data for errors.
-	switch (event) {
-	case DC_EVENT_WAITING:
-		assert (data == NULL);
-		break;
-	case DC_EVENT_PROGRESS:
-		assert (progress != NULL);
-		assert (progress->maximum != 0);
-		assert (progress->maximum >= progress->current);
-		break;
-	case DC_EVENT_DEVINFO:
-		assert (data != NULL);
-		break;
-	case DC_EVENT_CLOCK:
-		assert (data != NULL);
-		break;
-	default:
-		break;
-	}
+	if (device->eventqueue == NULL)
+		return DC_STATUS_SUCCESS;
 
-	if (device == NULL)
-		return;
+	dc_eventqueue_drain (device->eventqueue, 0);
 
-	// Cache the event data.
-	switch (event) {
-	case DC_EVENT_DEVINFO:
-		device->devinfo = *(const dc_event_devinfo_t *) data;
-		break;
-	case DC_EVENT_CLOCK:
-		device->clock = *(const dc_event_clock_t *) data;
-		break;
-	default:
-		break;
-	}
+	return DC_STATUS_SUCCESS;
+}
 
-	// Check if there is a callback function registered.
-	if (device->event_callback == NULL)
-		return;
 
-	// Check the event mask.
-	if ((event & device->event_mask) == 0)
-		return;
+dc_status_t
+dc_device_set_pipeline (dc_device_t *device, unsigned int depth)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	device->pipeline = depth;
 
-	device->event_callback (device, event, data, device->event_userdata);
+	return DC_STATUS_SUCCESS;
 }
 
 
-int
-device_is_cancelled (dc_device_t *device)
+dc_status_t
+dc_device_set_checkpoint (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (data == NULL && size)
+		return DC_STATUS_INVALIDARGS;
+
+	if (size == 0) {
+		dc_buffer_free (device->checkpoint);
+		device->checkpoint = NULL;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (device->checkpoint == NULL) {
+		device->checkpoint = dc_buffer_new2 (device->context, size);
+		if (device->checkpoint == NULL) {
+			ERROR (device->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	if (!dc_buffer_clear (device->checkpoint) ||
+		!dc_buffer_append (device->checkpoint, data, size)) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_progress_throttle (dc_device_t *device, unsigned int interval, unsigned int delta)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (interval && device->progress_timer == NULL) {
+		dc_status_t status = dc_timer_new (&device->progress_timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to create a timer.");
+			return status;
+		}
+	}
+
+	device->progress_interval = interval;
+	device->progress_delta = delta;
+	device->progress_valid = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return device->vtable->read (device, address, data, size);
+}
+
+
+dc_status_t
+dc_device_write (dc_device_t *device, unsigned int address, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->write == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return device->vtable->write (device, address, data, size);
+}
+
+
+dc_status_t
+dc_device_get_stats (dc_device_t *device, dc_event_stats_t *stats)
+{
+	if (device == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_iostream_get_stats (device->iostream, stats);
+	stats->retries += device->retries;
+	stats->checksums += device->checksums;
+
+	for (unsigned int i = 0; i < DC_EVENT_STATS_NPHASES; ++i) {
+		stats->phases[i] = device->phases[i];
+	}
+
+	stats->memory = device->memory;
+
+	// Include the current phase up to now.
+	dc_usecs_t now = 0;
+	if (device->phase != DEVICE_PHASE_NONE &&
+		dc_timer_now (device->phase_timer, &now) == DC_STATUS_SUCCESS &&
+		now > device->phase_begin)
+		stats->phases[device->phase] += now - device->phase_begin;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+device_emit_stats (dc_device_t *device)
+{
+	dc_event_stats_t stats;
+
+	if (device->event_callback == NULL || (device->event_mask & DC_EVENT_STATS) == 0)
+		return;
+
+	dc_device_get_stats (device, &stats);
+	device_event_emit (device, DC_EVENT_STATS, &stats);
+}
+
+
+dc_status_t
+dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->dump == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Fail early if the memory image doesn't fit in the budget.
+	unsigned int size = 0;
+	dc_family_get_memory (device->vtable->type, NULL, &size);
+	dc_status_t rc = dc_context_check_memory (device->context, size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	dc_buffer_clear (buffer);
+
+	device->throughput_valid = 0;
+
+	unsigned int phase = device_set_phase (device, DC_PHASE_DOWNLOAD);
+
+	dc_eventqueue_restart (device->eventqueue);
+
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (device->context, &scope);
+
+	dc_status_t status = device->vtable->dump (device, buffer);
+
+	dc_context_memory_end (device->context, &scope, &device->memory);
+
+	// The checkpoint is used only once.
+	if (status == DC_STATUS_SUCCESS)
+		dc_device_set_checkpoint (device, NULL, 0);
+
+	device_set_phase (device, phase);
+
+	device_emit_stats (device);
+
+	dc_eventqueue_flush (device->eventqueue);
+
+	return status;
+}
+
+
+dc_status_t
+device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// Resume from the checkpoint.
+	unsigned int nbytes = device_checkpoint_resume (device, data, size, blocksize);
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.current = nbytes;
+	progress.maximum = size;
+	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+	while (nbytes < size) {
+		// Calculate the packet size.
+		unsigned int len = size - nbytes;
+		if (len > blocksize)
+			len = blocksize;
+
+		// Read the packet.
+		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		// Start over if the memory changed since the checkpoint.
+		if (!device_checkpoint_verify (device, nbytes, data + nbytes, len)) {
+			nbytes = 0;
+			progress.current = 0;
+			continue;
+		}
+
+		// Update and emit a progress event.
+		progress.current = nbytes + len;
+		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+		nbytes += len;
+
+		device_checkpoint_emit (device, data, nbytes);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+unsigned int
+device_checkpoint_resume (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
+{
+	if (device == NULL || device->checkpoint == NULL || blocksize == 0)
+		return 0;
+
+	// Only complete blocks are used, and the last one is downloaded
+	// again to verify the checkpoint.
+	unsigned int length = dc_buffer_get_size (device->checkpoint);
+	if (length > size)
+		length = size;
+	length -= length % blocksize;
+	if (length < 2 * blocksize)
+		return 0;
+
+	memcpy (data, dc_buffer_get_data (device->checkpoint), length - blocksize);
+
+	INFO (device->context, "Resuming the dump at offset 0x%08x.", length - blocksize);
+
+	return length - blocksize;
+}
+
+
+int
+device_checkpoint_verify (dc_device_t *device, unsigned int offset, const unsigned char data[], unsigned int size)
+{
+	if (device == NULL || device->checkpoint == NULL)
+		return 1;
+
+	// Only the region overlapping with the checkpoint is verified.
+	unsigned int length = dc_buffer_get_size (device->checkpoint);
+	if (offset >= length)
+		return 1;
+	if (size > length - offset)
+		size = length - offset;
+
+	if (memcmp (dc_buffer_get_data (device->checkpoint) + offset, data, size) == 0)
+		return 1;
+
+	WARNING (device->context, "The memory changed since the checkpoint. Starting over.");
+	dc_buffer_free (device->checkpoint);
+	device->checkpoint = NULL;
+
+	return 0;
+}
+
+
+void
+device_checkpoint_emit (dc_device_t *device, const unsigned char data[], unsigned int size)
+{
+	dc_event_checkpoint_t checkpoint;
+	checkpoint.data = data;
+	checkpoint.size = size;
+	device_event_emit (device, DC_EVENT_CHECKPOINT, &checkpoint);
+}
+
+
+dc_status_t
+device_dump_ranges (dc_device_t *device, unsigned char data[], unsigned int size, const device_range_t ranges[], unsigned int count, unsigned int blocksize)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (blocksize == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (ranges[i].begin > ranges[i].end || ranges[i].end > size)
+			return DC_STATUS_INVALIDARGS;
+		total += ranges[i].end - ranges[i].begin;
+	}
+
+	if (total == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = total;
+	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int address = ranges[i].begin;
+		while (address < ranges[i].end) {
+			// Calculate the packet size.
+			unsigned int len = ranges[i].end - address;
+			if (len > blocksize)
+				len = blocksize;
+
+			// Read the packet.
+			dc_status_t rc = device->vtable->read (device, address, data + address, len);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
+			// Update and emit a progress event.
+			progress.current += len;
+			device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+			address += len;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static int
+device_has_baudrate (const unsigned int baudrates[], unsigned int count, unsigned int baudrate)
+{
+	for (unsigned int i = 0; i < count; ++i) {
+		if (baudrates[i] == baudrate)
+			return 1;
+	}
+
+	return 0;
+}
+
+dc_status_t
+device_serial_upshift (dc_device_t *device, dc_iostream_t *iostream, const char *name, unsigned int hint,
+	unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol,
+	device_probe_t probe, void *userdata)
+{
+	dc_status_t status = DC_STATUS_UNSUPPORTED;
+	dc_family_t family = device->vtable->type;
+
+	const unsigned int *baudrates = NULL;
+	unsigned int count = dc_family_get_baudrates (family, &baudrates);
+	if (count == 0)
+		return DC_STATUS_UNSUPPORTED;
+
+	// The baudrates in the order they are tried: the baudrate of the
+	// previous connection, the hint, and the others from the fastest.
+	unsigned int order[8];
+	unsigned int n = 0;
+	const unsigned int preferred[] = {
+		dc_context_get_profile (device->context, family, name),
+		hint};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (preferred); ++i) {
+		if (device_has_baudrate (baudrates, count, preferred[i]) &&
+			!device_has_baudrate (order, n, preferred[i]))
+			order[n++] = preferred[i];
+	}
+	for (unsigned int i = 0; i < count && n < C_ARRAY_SIZE (order); ++i) {
+		if (!device_has_baudrate (order, n, baudrates[i]))
+			order[n++] = baudrates[i];
+	}
+
+	for (unsigned int i = 0; i < n; ++i) {
+		status = dc_iostream_configure (iostream, order[i], databits, parity, stopbits, flowcontrol);
+		if (status != DC_STATUS_SUCCESS) {
+			// The serial adapter doesn't support this baudrate.
+			WARNING (device->context, "Failed to set the baudrate %u.", order[i]);
+			continue;
+		}
+
+		status = probe (device, userdata);
+		if (status == DC_STATUS_SUCCESS) {
+			dc_context_set_profile (device->context, family, name, order[i]);
+			break;
+		}
+
+		if (status == DC_STATUS_CANCELLED)
+			break;
+	}
+
+	return status;
+}
+
+dc_status_t
+device_dump_read_adaptive (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize, unsigned int maxsize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (blocksize == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// The maximum must be a multiple of the default block size.
+	maxsize -= maxsize % blocksize;
+	if (maxsize <= blocksize)
+		return device_dump_read (device, data, size, blocksize);
+
+	// Without a timer, the latency can't be measured.
+	dc_timer_t *timer = NULL;
+	if (dc_timer_new (&timer) != DC_STATUS_SUCCESS)
+		return device_dump_read (device, data, size, blocksize);
+
+	// Start with the block size from a previous download, if any.
+	dc_family_t family = device->vtable->type;
+	unsigned int model = device->devinfo.model;
+	unsigned int serial = device->devinfo.serial;
+	unsigned int current = dc_context_get_blocksize (device->context, family, model, serial);
+	if (current < blocksize || current > maxsize || current % blocksize != 0)
+		current = blocksize;
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = size;
+	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		// Calculate the packet size.
+		unsigned int len = size - nbytes;
+		if (len > current)
+			len = current;
+
+		dc_usecs_t begin = 0, end = 0;
+		dc_timer_now (timer, &begin);
+
+		// Read the packet.
+		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
+		if (rc != DC_STATUS_SUCCESS) {
+			// Retry a failed read with a smaller block size.
+			if ((rc == DC_STATUS_TIMEOUT || rc == DC_STATUS_PROTOCOL) && current > blocksize) {
+				current /= 2;
+				current -= current % blocksize;
+				if (current < blocksize)
+					current = blocksize;
+				WARNING (device->context, "Read failed, reducing the block size to %u bytes.", current);
+				continue;
+			}
+			status = rc;
+			break;
+		}
+
+		dc_timer_now (timer, &end);
+
+		// Grow the block size while the reads are fast enough.
+		if (len == current && end - begin < DUMP_LATENCY && current < maxsize) {
+			current *= 2;
+			if (current > maxsize)
+				current = maxsize;
+			DEBUG (device->context, "Increasing the block size to %u bytes.", current);
+		}
+
+		// Update and emit a progress event.
+		progress.current += len;
+		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+		nbytes += len;
+	}
+
+	// Remember the block size for the next download.
+	dc_context_set_blocksize (device->context, family, model, serial, current);
+
+	dc_timer_free (timer);
+
+	return status;
+}
+
+static void
+dc_pipeline_item_free (dc_pipeline_t *pipeline, dc_pipeline_item_t *item)
+{
+	dc_context_release (pipeline->device->context, item->data);
+	dc_context_release (pipeline->device->context, item->fingerprint);
+	item->data = NULL;
+	item->fingerprint = NULL;
+}
+
+
+static int
+dc_pipeline_producer_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_pipeline_t *pipeline = (dc_pipeline_t *) userdata;
+	dc_pipeline_item_t item = {NULL, size, NULL, fsize};
+
+	// Copy the dive, because the data is only valid during the callback.
+	item.data = (unsigned char *) dc_context_alloc (pipeline->device->context, size ? size : 1);
+	item.fingerprint = (unsigned char *) dc_context_alloc (pipeline->device->context, fsize ? fsize : 1);
+	if (item.data == NULL || item.fingerprint == NULL) {
+		ERROR (pipeline->device->context, "Failed to allocate memory.");
+		dc_pipeline_item_free (pipeline, &item);
+		return 0;
+	}
+	if (size)
+		memcpy (item.data, data, size);
+	if (fsize)
+		memcpy (item.fingerprint, fingerprint, fsize);
+
+	dc_mutex_lock (pipeline->mutex);
+
+	// Wait for a free slot, while checking for cancellation.
+	while (pipeline->count == pipeline->depth && !pipeline->stopped) {
+		dc_mutex_unlock (pipeline->mutex);
+		int cancelled = device_is_cancelled (pipeline->device);
+		dc_mutex_lock (pipeline->mutex);
+		if (cancelled) {
+			pipeline->stopped = 1;
+			dc_cond_broadcast (pipeline->cond);
+			break;
+		}
+		if (pipeline->count == pipeline->depth)
+			dc_cond_wait (pipeline->cond, pipeline->mutex, PIPELINE_POLL);
+	}
+
+	int stopped = pipeline->stopped;
+	if (!stopped) {
+		unsigned int idx = (pipeline->head + pipeline->count) % pipeline->depth;
+		pipeline->items[idx] = item;
+		pipeline->count++;
+		dc_cond_broadcast (pipeline->cond);
+	}
+
+	dc_mutex_unlock (pipeline->mutex);
+
+	if (stopped) {
+		dc_pipeline_item_free (pipeline, &item);
+		return 0;
+	}
+
+	return 1;
+}
+
+
+static void
+dc_pipeline_consumer (void *userdata)
+{
+	dc_pipeline_t *pipeline = (dc_pipeline_t *) userdata;
+
+	dc_mutex_lock (pipeline->mutex);
+	while (1) {
+		while (pipeline->count == 0 && !pipeline->finished && !pipeline->stopped)
+			dc_cond_wait (pipeline->cond, pipeline->mutex, -1);
+
+		if (pipeline->stopped || pipeline->count == 0)
+			break;
+
+		dc_pipeline_item_t item = pipeline->items[pipeline->head];
+		pipeline->head = (pipeline->head + 1) % pipeline->depth;
+		pipeline->count--;
+		dc_cond_broadcast (pipeline->cond);
+		dc_mutex_unlock (pipeline->mutex);
+
+		// The callback runs concurrently with the download, so its time
+		// is accumulated directly, without switching the phase. Only
+		// this thread updates that entry.
+		dc_device_t *device = pipeline->device;
+		dc_usecs_t begin = 0, end = 0;
+		int timed = dc_timer_now (device->phase_timer, &begin) == DC_STATUS_SUCCESS;
+
+		dc_usecs_t traced = dc_context_trace_begin (device->context);
+		DC_PROBE2 (dive__entry, device, item.size);
+
+		int proceed = 1;
+		if (pipeline->callback)
+			proceed = pipeline->callback (item.data, item.size, item.fingerprint, item.fsize, pipeline->userdata);
+		dc_pipeline_item_free (pipeline, &item);
+
+		DC_PROBE2 (dive__return, device, proceed);
+		dc_context_trace_end (device->context, "dc_dive_callback", traced);
+
+		if (timed && dc_timer_now (device->phase_timer, &end) == DC_STATUS_SUCCESS)
+			device->phases[DC_PHASE_CALLBACK] += end - begin;
+
+		dc_mutex_lock (pipeline->mutex);
+		if (!proceed) {
+			pipeline->stopped = 1;
+			dc_cond_broadcast (pipeline->cond);
+		}
+	}
+	dc_mutex_unlock (pipeline->mutex);
+}
+
+
+static dc_status_t
+dc_device_foreach_pipelined (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_pipeline_t *pipeline = NULL;
+	dc_thread_t *thread = NULL;
+
+	// Allocate memory.
+	pipeline = (dc_pipeline_t *) dc_context_alloc (device->context, sizeof (dc_pipeline_t) + device->pipeline * sizeof (dc_pipeline_item_t));
+	if (pipeline == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	pipeline->device = device;
+	pipeline->callback = callback;
+	pipeline->userdata = userdata;
+	pipeline->mutex = NULL;
+	pipeline->cond = NULL;
+	pipeline->depth = device->pipeline;
+	pipeline->head = 0;
+	pipeline->count = 0;
+	pipeline->finished = 0;
+	pipeline->stopped = 0;
+
+	if (dc_mutex_new (&pipeline->mutex) != DC_STATUS_SUCCESS ||
+		dc_cond_new (&pipeline->cond) != DC_STATUS_SUCCESS ||
+		dc_thread_new (&thread, dc_pipeline_consumer, pipeline) != DC_STATUS_SUCCESS) {
+		// Fall back to the synchronous delivery.
+		WARNING (device->context, "Failed to start the pipeline thread.");
+		status = device->vtable->foreach (device, callback, userdata);
+		goto error_free;
+	}
+
+	status = device->vtable->foreach (device, dc_pipeline_producer_cb, pipeline);
+
+	// Let the consumer deliver the remaining dives. After a failure,
+	// the queued dives are dropped.
+	dc_mutex_lock (pipeline->mutex);
+	pipeline->finished = 1;
+	if (status != DC_STATUS_SUCCESS)
+		pipeline->stopped = 1;
+	dc_cond_broadcast (pipeline->cond);
+	dc_mutex_unlock (pipeline->mutex);
+
+	dc_thread_join (thread);
+
+	for (unsigned int i = 0; i < pipeline->count; ++i) {
+		dc_pipeline_item_free (pipeline, &pipeline->items[(pipeline->head + i) % pipeline->depth]);
+	}
+
+error_free:
+	dc_cond_free (pipeline->cond);
+	dc_mutex_free (pipeline->mutex);
+	dc_context_release (device->context, pipeline);
+
+	return status;
+}
+
+
+typedef struct dc_phase_filter_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} dc_phase_filter_t;
+
+static int
+dc_phase_filter_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_phase_filter_t *filter = (dc_phase_filter_t *) userdata;
+
+	dc_usecs_t begin = dc_context_trace_begin (filter->device->context);
+	DC_PROBE2 (dive__entry, filter->device, size);
+
+	unsigned int phase = device_set_phase (filter->device, DC_PHASE_CALLBACK);
+	int proceed = filter->callback (data, size, fingerprint, fsize, filter->userdata);
+	device_set_phase (filter->device, phase);
+
+	DC_PROBE2 (dive__return, filter->device, proceed);
+	dc_context_trace_end (filter->device->context, "dc_dive_callback", begin);
+
+	return proceed;
+}
+
+
+typedef struct dc_syncindex_filter_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} dc_syncindex_filter_t;
+
+static int
+dc_syncindex_filter_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_syncindex_filter_t *filter = (dc_syncindex_filter_t *) userdata;
+	dc_device_t *device = filter->device;
+
+	// Skip the dives which are already known.
+	if (device_is_known (device, fingerprint, fsize)) {
+		DEBUG (device->context, "Skipping known dive.");
+		return 1;
+	}
+
+	int proceed = 1;
+	if (filter->callback)
+		proceed = filter->callback (data, size, fingerprint, fsize, filter->userdata);
+
+	if (fsize) {
+		dc_context_syncindex_add (device->context, device->vtable->type,
+			device->devinfo.model, device->devinfo.serial, fingerprint, fsize);
+	}
+
+	return proceed;
+}
+
+
+dc_status_t
+dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+{
+	dc_syncindex_filter_t filter;
+	dc_phase_filter_t timing;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// Fail early if the largest buffer doesn't fit in the budget.
+	unsigned int size = 0;
+	dc_family_get_memory (device->vtable->type, &size, NULL);
+	dc_status_t rc = dc_context_check_memory (device->context, size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Time the dive callback. The pipeline measures it on the consumer
+	// thread instead.
+	if (callback && !device->pipeline) {
+		timing.device = device;
+		timing.callback = callback;
+		timing.userdata = userdata;
+		callback = dc_phase_filter_cb;
+		userdata = &timing;
+	}
+
+	if (dc_context_syncindex_enabled (device->context)) {
+		filter.device = device;
+		filter.callback = callback;
+		filter.userdata = userdata;
+		callback = dc_syncindex_filter_cb;
+		userdata = &filter;
+	}
+
+	device->throughput_valid = 0;
+
+	unsigned int phase = device_set_phase (device, DC_PHASE_DOWNLOAD);
+
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (device->context, &scope);
+
+	dc_status_t status = DC_STATUS_SUCCESS;
+	if (device->pipeline)
+		status = dc_device_foreach_pipelined (device, callback, userdata);
+	else
+		status = device->vtable->foreach (device, callback, userdata);
+
+	dc_context_memory_end (device->context, &scope, &device->memory);
+
+	device_set_phase (device, phase);
+
+	device_emit_stats (device);
+
+	dc_eventqueue_flush (device->eventqueue);
+
+	return status;
+}
+
+
+dc_status_t
+dc_device_timesync (dc_device_t *device, const dc_datetime_t *datetime)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->timesync == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return device->vtable->timesync (device, datetime);
+}
+
+
+dc_status_t
+dc_device_keepalive (dc_device_t *device)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	switch (device->vtable->type) {
+#ifdef ENABLE_FAMILY_OCEANIC
+	case DC_FAMILY_OCEANIC_ATOM2:
+		return oceanic_atom2_device_keepalive (device);
+	case DC_FAMILY_OCEANIC_VEO250:
+		return oceanic_veo250_device_keepalive (device);
+	case DC_FAMILY_OCEANIC_VTPRO:
+		return oceanic_vtpro_device_keepalive (device);
+#endif
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+}
+
+
+dc_status_t
+dc_device_extract (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (descriptor == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_FAMILY_SUUNTO
+	case DC_FAMILY_SUUNTO_SOLUTION:
+		rc = suunto_solution_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_SUUNTO_EON:
+		rc = suunto_eon_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_UWATEC
+	case DC_FAMILY_UWATEC_ALADIN:
+		rc = uwatec_aladin_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_MEMOMOUSE:
+		rc = uwatec_memomouse_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_SMART:
+		rc = uwatec_smart_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_MERIDIAN:
+		rc = uwatec_meridian_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_G2:
+		rc = scubapro_g2_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_REEFNET
+	case DC_FAMILY_REEFNET_SENSUS:
+		rc = reefnet_sensus_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_REEFNET_SENSUSPRO:
+		rc = reefnet_sensuspro_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_MARES
+	case DC_FAMILY_MARES_NEMO:
+		rc = mares_nemo_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_MARES_PUCK:
+		rc = mares_puck_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_HW
+	case DC_FAMILY_HW_OSTC:
+		rc = hw_ostc_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_CRESSI
+	case DC_FAMILY_CRESSI_LEONARDO:
+		rc = cressi_leonardo_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
+	case DC_FAMILY_SHEARWATER_PREDATOR:
+		rc = shearwater_predator_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_FAMILY_DIVERITE
+	case DC_FAMILY_DIVERITE_NITEKQ:
+		rc = diverite_nitekq_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+	default:
+		ERROR (context, "Dive extraction is not supported for this family.");
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	return rc;
+}
+
+
+typedef struct dc_extract_scan_t {
+	dc_context_t *context;
+	const unsigned char *data;
+	unsigned int size;
+	dc_buffer_t *spans;
+	dc_buffer_t *copies;
+	int error;
+} dc_extract_scan_t;
+
+static int
+dc_extract_contains (const dc_extract_scan_t *scan, const unsigned char *data, unsigned int size)
+{
+	if (size == 0)
+		return 1;
+
+	return data >= scan->data && size <= scan->size &&
+		(size_t) (data - scan->data) <= scan->size - size;
+}
+
+static int
+dc_extract_scan_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_extract_scan_t *scan = (dc_extract_scan_t *) userdata;
+	dc_dive_span_t span;
+
+	span.size = size;
+	span.fsize = fsize;
+
+	if (dc_extract_contains (scan, data, size) &&
+		dc_extract_contains (scan, fingerprint, fsize)) {
+		span.offset = size ? data - scan->data : 0;
+		span.fingerprint = fsize ? fingerprint - scan->data : 0;
+		span.copied = 0;
+	} else {
+		span.offset = dc_buffer_get_size (scan->copies);
+		span.fingerprint = span.offset + size;
+		span.copied = 1;
+		if (!dc_buffer_append (scan->copies, data, size) ||
+			!dc_buffer_append (scan->copies, fingerprint, fsize)) {
+			ERROR (scan->context, "Failed to allocate memory.");
+			scan->error = 1;
+			return 0;
+		}
+	}
+
+	if (!dc_buffer_append (scan->spans, (const unsigned char *) &span, sizeof (span))) {
+		ERROR (scan->context, "Failed to allocate memory.");
+		scan->error = 1;
+		return 0;
+	}
+
+	return 1;
+}
+
+dc_status_t
+dc_device_extract_spans (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_buffer_t *spans, dc_buffer_t *copies)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_extract_scan_t scan;
+
+	if (spans == NULL || copies == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	scan.context = context;
+	scan.data = data;
+	scan.size = size;
+	scan.spans = spans;
+	scan.copies = copies;
+	scan.error = 0;
+
+	rc = dc_device_extract (context, descriptor, data, size, dc_extract_scan_cb, &scan);
+	if (rc == DC_STATUS_SUCCESS && scan.error)
+		rc = DC_STATUS_NOMEMORY;
+
+	return rc;
+}
+
+typedef struct dc_extract_pool_t {
+	const unsigned char *data;
+	const unsigned char *copies;
+	const dc_dive_span_t *spans;
+	unsigned int count;
+	dc_mutex_t *mutex;
+	unsigned int next;
+	unsigned int stopped;
+	dc_dive_callback_t callback;
+	void *userdata;
+} dc_extract_pool_t;
+
+static void
+dc_extract_worker (void *userdata)
+{
+	dc_extract_pool_t *pool = (dc_extract_pool_t *) userdata;
+
+	while (1) {
+		dc_mutex_lock (pool->mutex);
+		unsigned int idx = pool->next;
+		int finished = pool->stopped || idx >= pool->count;
+		if (!finished)
+			pool->next++;
+		dc_mutex_unlock (pool->mutex);
+		if (finished)
+			break;
+
+		const dc_dive_span_t *span = pool->spans + idx;
+		const unsigned char *base = span->copied ? pool->copies : pool->data;
+		if (!pool->callback (base + span->offset, span->size, base + span->fingerprint, span->fsize, pool->userdata)) {
+			dc_mutex_lock (pool->mutex);
+			pool->stopped = 1;
+			dc_mutex_unlock (pool->mutex);
+		}
+	}
+}
+
+dc_status_t
+dc_device_extract_parallel (dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, unsigned int nthreads, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_thread_t *threads[EXTRACT_MAXTHREADS];
+	dc_extract_pool_t pool;
+
+	if (callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (nthreads > EXTRACT_MAXTHREADS)
+		nthreads = EXTRACT_MAXTHREADS;
+
+	// Phase one: a sequential scan for the location of the dives.
+	dc_buffer_t *spans = dc_buffer_new (0);
+	dc_buffer_t *copies = dc_buffer_new (0);
+	if (spans == NULL || copies == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		rc = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	rc = dc_device_extract_spans (context, descriptor, data, size, spans, copies);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	pool.data = data;
+	pool.copies = dc_buffer_get_data (copies);
+	pool.spans = (const dc_dive_span_t *) dc_buffer_get_data (spans);
+	pool.count = dc_buffer_get_size (spans) / sizeof (dc_dive_span_t);
+	pool.mutex = NULL;
+	pool.next = 0;
+	pool.stopped = 0;
+	pool.callback = callback;
+	pool.userdata = userdata;
+
+	// Phase two: the dive callbacks on the worker threads. Without
+	// thread support, the mutex functions are no-ops for a NULL mutex,
+	// and the calling thread processes all dives.
+	unsigned int nworkers = 0;
+	if (nthreads > 1 && pool.count > 1 && dc_mutex_new (&pool.mutex) == DC_STATUS_SUCCESS) {
+		while (nworkers + 1 < nthreads && nworkers + 1 < pool.count) {
+			if (dc_thread_new (&threads[nworkers], dc_extract_worker, &pool) != DC_STATUS_SUCCESS)
+				break;
+			nworkers++;
+		}
+	}
+
+	dc_extract_worker (&pool);
+
+	for (unsigned int i = 0; i < nworkers; ++i) {
+		dc_thread_join (threads[i]);
+	}
+
+	dc_mutex_free (pool.mutex);
+
+error_free:
+	dc_buffer_free (copies);
+	dc_buffer_free (spans);
+	return rc;
+}
+
+
+dc_status_t
+dc_device_extract_file (dc_context_t *context, dc_descriptor_t *descriptor, const char *filename, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_mapping_t mapping;
+
+	if (descriptor == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mapping_init (&mapping);
+
+	rc = dc_mapping_open (&mapping, context, filename);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_close;
+
+	if (mapping.size > (unsigned int) -1) {
+		ERROR (context, "The memory image is too large.");
+		rc = DC_STATUS_DATAFORMAT;
+		goto error_close;
+	}
+
+	rc = dc_device_extract (context, descriptor, mapping.data, mapping.size, callback, userdata);
+
+error_close:
+	dc_mapping_close (&mapping);
+	return rc;
+}
+
+
+dc_status_t
+dc_device_close (dc_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Disable the cancellation callback.
+	device->cancel_callback = NULL;
+	device->cancel_userdata = NULL;
+
+	if (device->vtable->close) {
+		status = device->vtable->close (device);
+	}
+
+	dc_device_deallocate (device);
+
+	return status;
+}
+
+
+void
+device_set_iostream (dc_device_t *device, dc_iostream_t *iostream)
+{
+	if (device == NULL)
+		return;
+
+	device->iostream = iostream;
+
+	dc_context_notify_iostream (device->context, iostream, 1);
+}
+
+
+void
+device_stats_retry (dc_device_t *device)
+{
+	if (device == NULL)
+		return;
+
+	device->retries++;
+}
+
+
+void
+device_stats_checksum (dc_device_t *device)
+{
+	if (device == NULL)
+		return;
+
+	device->checksums++;
+}
+
+
+unsigned int
+device_set_phase (dc_device_t *device, unsigned int phase)
+{
+	dc_usecs_t now = 0;
+
+	if (device == NULL)
+		return DEVICE_PHASE_NONE;
+
+	unsigned int previous = device->phase;
+
+	if (dc_timer_now (device->phase_timer, &now) != DC_STATUS_SUCCESS)
+		now = device->phase_begin;
+
+	if (previous != DEVICE_PHASE_NONE && now > device->phase_begin)
+		device->phases[previous] += now - device->phase_begin;
+
+	device->phase = phase;
+	device->phase_begin = now;
+
+	return previous;
+}
+
+
+/*
+ * Decide whether a progress event passes the throttle, and remember
+ * the delivered event.
+ */
+static int
+device_progress_deliver (dc_device_t *device, const dc_event_progress_t *progress)
+{
+	dc_usecs_t now = 0;
+
+	if (device->progress_interval == 0 && device->progress_delta == 0)
+		return 1;
+
+	if (device->progress_interval)
+		dc_timer_now (device->progress_timer, &now);
+
+	if (device->progress_valid &&
+		progress->current != progress->maximum &&
+		progress->maximum == device->progress_last.maximum &&
+		progress->current >= device->progress_last.current) {
+		if (progress->current - device->progress_last.current < device->progress_delta)
+			return 0;
+		if (now - device->progress_time < device->progress_interval * 1000ULL)
+			return 0;
+	}
+
+	device->progress_last = *progress;
+	device->progress_time = now;
+	device->progress_valid = 1;
+
+	return 1;
+}
+
+
+static void
+device_throughput_update (dc_device_t *device, const dc_event_progress_t *progress, dc_event_throughput_t *throughput)
+{
+	dc_usecs_t now = 0;
+
+	if (dc_timer_now (device->phase_timer, &now) != DC_STATUS_SUCCESS)
+		now = 0;
+
+	if (!device->throughput_valid) {
+		device->throughput_valid = 1;
+		device->throughput_maximum = progress->maximum;
+		device->throughput_refined = 0;
+		device->throughput_current = progress->current;
+		device->throughput_rate = 0.0;
+		device->throughput_begin = now;
+		device->throughput_time = now;
+		device->throughput_advanced = now;
+	}
+
+	if (progress->maximum != device->throughput_maximum) {
+		device->throughput_maximum = progress->maximum;
+		device->throughput_refined = 1;
+	}
+
+	if (progress->current > device->throughput_current) {
+		device->throughput_advanced = now;
+
+		// Update the smoothed rate, at most once per window, such that
+		// a burst of small packets doesn't count as a very high rate.
+		dc_usecs_t elapsed = now - device->throughput_time;
+		if (elapsed >= THROUGHPUT_WINDOW) {
+			double seconds = elapsed / 1000000.0;
+			double rate = (progress->current - device->throughput_current) / seconds;
+			if (device->throughput_rate == 0.0) {
+				device->throughput_rate = rate;
+			} else {
+				double alpha = 1.0 - exp (-seconds / THROUGHPUT_SMOOTHING);
+				device->throughput_rate += alpha * (rate - device->throughput_rate);
+			}
+			device->throughput_current = progress->current;
+			device->throughput_time = now;
+		}
+	} else if (progress->current < device->throughput_current) {
+		// Some backends rewind the progress to retry a transfer.
+		device->throughput_current = progress->current;
+		device->throughput_time = now;
+	}
+
+	throughput->current = progress->current;
+	throughput->maximum = progress->maximum;
+	throughput->rate = device->throughput_rate;
+	throughput->eta = 0;
+	if (device->throughput_rate > 0.0)
+		throughput->eta = (progress->maximum - progress->current) * 1000.0 / device->throughput_rate;
+	throughput->elapsed = (now - device->throughput_begin) / 1000;
+	throughput->idle = (now - device->throughput_advanced) / 1000;
+	throughput->refined = device->throughput_refined;
+}
+
+
+static void
+device_event_deliver (dc_device_t *device, dc_event_type_t event, const void *data)
+{
+	if (device->eventqueue)
+		dc_eventqueue_post (device->eventqueue, event, data);
+	else
+		device->event_callback (device, event, data, device->event_userdata);
+}
+
+
+void
+device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
+{
+	const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+
+	// Check the event data for errors.
+	switch (event) {
+	case DC_EVENT_WAITING:
+		assert (data == NULL);
+		break;
+	case DC_EVENT_PROGRESS:
+		assert (progress != NULL);
+		assert (progress->maximum != 0);
+		assert (progress->maximum >= progress->current);
+		break;
+	case DC_EVENT_DEVINFO:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_CLOCK:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_STATS:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_DIVEDATA:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_LOGBOOK:
+		assert (data != NULL);
+		break;
+	case DC_EVENT_CHECKPOINT:
+		assert (data != NULL);
+		break;
+	default:
+		break;
+	}
+
+	if (device == NULL)
+		return;
+
+	// Cache the event data.
+	switch (event) {
+	case DC_EVENT_DEVINFO:
+		device->devinfo = *(const dc_event_devinfo_t *) data;
+		break;
+	case DC_EVENT_CLOCK:
+		device->clock = *(const dc_event_clock_t *) data;
+		break;
+	default:
+		break;
+	}
+
+	// Check if there is a callback function registered.
+	if (device->event_callback == NULL)
+		return;
+
+	if (event == DC_EVENT_PROGRESS) {
+		unsigned int mask = device->event_mask & (DC_EVENT_PROGRESS | DC_EVENT_THROUGHPUT);
+		if (mask == 0)
+			return;
+
+		// The estimate follows all progress events, but is only
+		// delivered together with the progress event.
+		dc_event_throughput_t throughput;
+		if (mask & DC_EVENT_THROUGHPUT)
+			device_throughput_update (device, progress, &throughput);
+
+		// Throttle the progress events.
+		if (!device_progress_deliver (device, progress))
+			return;
+
+		if (mask & DC_EVENT_PROGRESS)
+			device_event_deliver (device, DC_EVENT_PROGRESS, data);
+		if (mask & DC_EVENT_THROUGHPUT)
+			device_event_deliver (device, DC_EVENT_THROUGHPUT, &throughput);
+		return;
+	}
+
+	// Check the event mask.
+	if ((event & device->event_mask) == 0)
+		return;
+
+	device_event_deliver (device, event, data);
+}
+
+
+int
+device_is_known (dc_device_t *device, const unsigned char fingerprint[], unsigned int size)
+{
+	if (device == NULL || size == 0)
+		return 0;
+
+	return dc_context_syncindex_contains (device->context, device->vtable->type,
+		device->devinfo.model, device->devinfo.serial, fingerprint, size);
+}
+
+
+int
+device_is_cancelled (dc_device_t *device)
 {
 	if (device == NULL)
 		return 0;
 
+	if (device->cancelled)
+		return 1;
+
 	if (device->cancel_callback == NULL)
 		return 0;
 
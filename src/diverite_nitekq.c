@@ -73,9 +73,6 @@ static const dc_device_vtable_t diverite_nitekq_device_vtable = {
 	diverite_nitekq_device_close /* close */
 };
 
-static dc_status_t
-diverite_nitekq_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static dc_status_t
 diverite_nitekq_send (diverite_nitekq_device_t *device, unsigned char cmd)
 {
@@ -174,6 +171,8 @@ diverite_nitekq_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -251,8 +250,46 @@ diverite_nitekq_device_set_fingerprint (dc_device_t *abstract, const unsigned ch
 }
 
 
+static unsigned int
+diverite_nitekq_span (diverite_nitekq_device_t *device, const unsigned char data[])
+{
+	// Get the end of profile pointer.
+	unsigned int eop = array_uint16_be(data + EOP);
+	if (eop < RB_PROFILE_BEGIN || eop >= RB_PROFILE_END)
+		return SZ_MEMORY;
+
+	// Find the end of the profile data of the dives newer than the
+	// fingerprint. If the data of a new dive wraps around the end of the
+	// ringbuffer, or a pointer is invalid, the entire memory is needed.
+	unsigned int end = RB_PROFILE_BEGIN;
+	unsigned int previous = eop;
+	for (unsigned int i = 0; i < 10; ++i) {
+		const unsigned char *p = data + LOGBOOK + i * SZ_LOGBOOK;
+		if (array_isequal (p, SZ_LOGBOOK, 0x00))
+			break;
+
+		unsigned int address = array_uint16_be(data + ADDRESS + i * 2);
+		if (address < RB_PROFILE_BEGIN || address >= RB_PROFILE_END)
+			return SZ_MEMORY;
+
+		if (memcmp (p, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
+		if (previous <= address)
+			return SZ_MEMORY;
+
+		if (end < previous)
+			end = previous;
+
+		previous = address;
+	}
+
+	return end;
+}
+
+
 static dc_status_t
-diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+diverite_nitekq_download (dc_device_t *abstract, dc_buffer_t *buffer, int partial)
 {
 	diverite_nitekq_device_t *device = (diverite_nitekq_device_t*) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
@@ -309,7 +346,12 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return rc;
 	}
 
-	for (unsigned int i = 0; i < 128; ++i) {
+	// The memory blocks can only be downloaded in sequential order, but
+	// the download can be stopped at any block. For a partial download,
+	// the blocks containing the logbook and pointers are read first, and
+	// the download stops after the last block with new profile data.
+	unsigned int nblocks = SZ_MEMORY / SZ_PACKET;
+	for (unsigned int i = 0; i < nblocks; ++i) {
 		// Request the next memory block.
 		rc = diverite_nitekq_send (device, BLOCK);
 		if (rc != DC_STATUS_SUCCESS) {
@@ -324,6 +366,12 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 		dc_buffer_append (buffer, packet, sizeof (packet));
 
+		if (partial && i + 1 == (RB_PROFILE_BEGIN + SZ_PACKET - 1) / SZ_PACKET) {
+			unsigned int end = diverite_nitekq_span (device, dc_buffer_get_data (buffer) + SZ_PACKET);
+			nblocks = (end + SZ_PACKET - 1) / SZ_PACKET;
+			progress.maximum = SZ_PACKET + nblocks * SZ_PACKET;
+		}
+
 		// Update and emit a progress event.
 		progress.current += SZ_PACKET;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -333,19 +381,34 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 }
 
 
+static dc_status_t
+diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	return diverite_nitekq_download (abstract, buffer, 0);
+}
+
+
 static dc_status_t
 diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = diverite_nitekq_device_dump (abstract, buffer);
+	dc_status_t rc = diverite_nitekq_download (abstract, buffer, 1);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
 		return rc;
 	}
 
+	// The blocks that were not downloaded contain no new dives, and are
+	// never accessed.
+	if (!dc_buffer_resize (buffer, SZ_PACKET + SZ_MEMORY)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		dc_buffer_free (buffer);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	rc = diverite_nitekq_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
@@ -355,7 +418,7 @@ diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 }
 
 
-static dc_status_t
+dc_status_t
 diverite_nitekq_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	diverite_nitekq_device_t *device = (diverite_nitekq_device_t *) abstract;
@@ -60,6 +60,9 @@ static const dc_parser_vtable_t diverite_nitekq_parser_vtable = {
 	diverite_nitekq_parser_get_datetime, /* datetime */
 	diverite_nitekq_parser_get_field, /* fields */
 	diverite_nitekq_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -291,16 +294,19 @@ diverite_nitekq_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callbac
 		}
 	}
 
-	// Cache the data for later use.
-	for (unsigned int i = 0; i < ngasmixes; ++i) {
-		parser->he[i] = helium[i];
-		parser->o2[i] = oxygen[i];
+	// Cache the data for later use. Once cached, the parser state is
+	// only read, such that a prepared parser can be shared.
+	if (!parser->cached) {
+		for (unsigned int i = 0; i < ngasmixes; ++i) {
+			parser->he[i] = helium[i];
+			parser->o2[i] = oxygen[i];
+		}
+		parser->ngasmixes = ngasmixes;
+		parser->maxdepth = maxdepth;
+		parser->divetime = time;
+		parser->metric = metric;
+		parser->cached = 1;
 	}
-	parser->ngasmixes = ngasmixes;
-	parser->maxdepth = maxdepth;
-	parser->divetime = time;
-	parser->metric = metric;
-	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
 }
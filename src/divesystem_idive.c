@@ -39,6 +39,7 @@
 #define MAXRETRIES 9
 
 #define MAXPACKET 0xFF
+#define PIPELINE  4
 #define START     0x55
 #define ACK       0x06
 #define NAK       0x15
@@ -72,6 +73,7 @@ typedef struct divesystem_idive_device_t {
 	dc_iostream_t *iostream;
 	unsigned char fingerprint[4];
 	unsigned int model;
+	unsigned int pipeline;
 } divesystem_idive_device_t;
 
 static dc_status_t divesystem_idive_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -134,6 +136,7 @@ divesystem_idive_device_open (dc_device_t **out, dc_context_t *context, const ch
 	device->iostream = NULL;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 	device->model = model;
+	device->pipeline = 1;
 
 	// Open the device.
 	status = dc_serial_open (&device->iostream, context, name);
@@ -142,6 +145,8 @@ divesystem_idive_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -287,6 +292,7 @@ divesystem_idive_receive (divesystem_idive_device_t *device, unsigned char answe
 	unsigned short crc = array_uint16_be (packet + len + 2);
 	unsigned short ccrc = checksum_crc_ccitt_uint16 (packet, len + 2);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected packet checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -299,7 +305,7 @@ divesystem_idive_receive (divesystem_idive_device_t *device, unsigned char answe
 
 
 static dc_status_t
-divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+divesystem_idive_answer (divesystem_idive_device_t *device, unsigned char cmd, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -307,12 +313,6 @@ divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char
 	unsigned int length = sizeof(packet);
 	unsigned int errcode = 0;
 
-	// Send the command.
-	status = divesystem_idive_send (device, command, csize);
-	if (status != DC_STATUS_SUCCESS) {
-		goto error;
-	}
-
 	// Receive the answer.
 	status = divesystem_idive_receive (device, packet, &length);
 	if (status != DC_STATUS_SUCCESS) {
@@ -320,7 +320,7 @@ divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char
 	}
 
 	// Verify the command byte.
-	if (packet[0] != command[0]) {
+	if (packet[0] != cmd) {
 		ERROR (abstract->context, "Unexpected packet header.");
 		status = DC_STATUS_PROTOCOL;
 		goto error;
@@ -361,6 +361,25 @@ error:
 }
 
 
+static dc_status_t
+divesystem_idive_packet (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Send the command.
+	status = divesystem_idive_send (device, command, csize);
+	if (status != DC_STATUS_SUCCESS) {
+		if (errorcode) {
+			*errorcode = 0;
+		}
+		return status;
+	}
+
+	// Receive the answer.
+	return divesystem_idive_answer (device, command[0], answer, asize, errorcode);
+}
+
+
 static dc_status_t
 divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int *errorcode)
 {
@@ -382,6 +401,8 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 		if (nretries++ >= MAXRETRIES)
 			break;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Delay the next attempt.
 		dc_iostream_sleep (device->iostream, 100);
 	}
@@ -393,6 +414,19 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 	return status;
 }
 
+
+static void
+divesystem_idive_drain (divesystem_idive_device_t *device)
+{
+	// Discard all incoming data, until the line remains quiet. The
+	// answers carry no sequence number, so a late answer would otherwise
+	// be mistaken for the answer to the next command.
+	do {
+		dc_iostream_sleep (device->iostream, 100);
+		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+	} while (dc_iostream_poll (device->iostream, 100) == DC_STATUS_SUCCESS);
+}
+
 static dc_status_t
 divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -461,7 +495,7 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 	progress.maximum = ndives * NSTEPS;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	dc_buffer_t *buffer = dc_buffer_new(0);
+	dc_buffer_t *buffer = dc_buffer_new2(abstract->context, 0);
 	if (buffer == NULL) {
 		return DC_STATUS_NOMEMORY;
 	}
@@ -485,6 +519,10 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 		if (memcmp(packet + 7, device->fingerprint, sizeof(device->fingerprint)) == 0)
 			break;
 
+		// Skip the samples of the dives which are already known.
+		if (device_is_known (abstract, packet + 7, sizeof(device->fingerprint)))
+			continue;
+
 		unsigned int nsamples = array_uint16_le (packet + 1);
 
 		// Update and emit a progress event.
@@ -500,15 +538,58 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 			return rc;
 		}
 
-		for (unsigned int j = 0; j < nsamples; j += commands->nsamples) {
-			unsigned int idx = j + 1;
-			unsigned char cmd_sample[] = {commands->sample.cmd,
-				(idx     ) & 0xFF,
-				(idx >> 8) & 0xFF};
-			rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, commands->sample.size * commands->nsamples, &errcode);
-			if (rc != DC_STATUS_SUCCESS) {
-				dc_buffer_free(buffer);
-				return rc;
+		// The sample requests are pipelined: up to $PIPELINE requests are
+		// sent ahead, and the answers are matched to the requests in the
+		// order they were sent. The answers carry no sequence number, so
+		// after a lost or corrupted answer there is no way to tell which
+		// of the answers already received belong to which request. In that
+		// case, the pending answers are discarded, and the samples of the
+		// dive are downloaded again with regular request/response
+		// transfers, for this and all remaining dives.
+		unsigned int nsent = 0;
+		unsigned int j = 0;
+		while (j < nsamples) {
+			if (device->pipeline) {
+				while (nsent < nsamples && nsent < j + PIPELINE * commands->nsamples) {
+					unsigned int idx = nsent + 1;
+					unsigned char cmd_sample[] = {commands->sample.cmd,
+						(idx     ) & 0xFF,
+						(idx >> 8) & 0xFF};
+					rc = divesystem_idive_send (device, cmd_sample, sizeof(cmd_sample));
+					if (rc != DC_STATUS_SUCCESS) {
+						dc_buffer_free(buffer);
+						return rc;
+					}
+
+					nsent += commands->nsamples;
+				}
+
+				rc = divesystem_idive_answer (device, commands->sample.cmd, packet, commands->sample.size * commands->nsamples, &errcode);
+				if (rc != DC_STATUS_SUCCESS) {
+					if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT) {
+						dc_buffer_free(buffer);
+						return rc;
+					}
+
+					WARNING (abstract->context, "Pipelined transfer failed, falling back to single requests.");
+					device_stats_retry (abstract);
+					divesystem_idive_drain (device);
+					device->pipeline = 0;
+
+					dc_buffer_resize (buffer, commands->header.size);
+					j = 0;
+					continue;
+				}
+			} else {
+				unsigned int idx = j + 1;
+				unsigned char cmd_sample[] = {commands->sample.cmd,
+					(idx     ) & 0xFF,
+					(idx >> 8) & 0xFF};
+				rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, commands->sample.size * commands->nsamples, &errcode);
+				if (rc != DC_STATUS_SUCCESS) {
+					dc_buffer_free(buffer);
+					return rc;
+				}
 			}
 
 			// If the number of samples is not an exact multiple of the
@@ -528,6 +609,8 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 				dc_buffer_free(buffer);
 				return rc;
 			}
+
+			j += n;
 		}
 
 		unsigned char *data = dc_buffer_get_data(buffer);
@@ -80,6 +80,9 @@ static const dc_parser_vtable_t divesystem_idive_parser_vtable = {
 	divesystem_idive_parser_get_datetime, /* datetime */
 	divesystem_idive_parser_get_field, /* fields */
 	divesystem_idive_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -422,18 +425,21 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		offset += samplesize;
 	}
 
-	// Cache the data for later use.
-	parser->beginpressure = beginpressure;
-	parser->endpressure = endpressure;
-	for (unsigned int i = 0; i < ngasmixes; ++i) {
-		parser->helium[i] = helium[i];
-		parser->oxygen[i] = oxygen[i];
+	// Cache the data for later use. Once cached, the parser state is
+	// only read, such that a prepared parser can be shared.
+	if (!parser->cached) {
+		parser->beginpressure = beginpressure;
+		parser->endpressure = endpressure;
+		for (unsigned int i = 0; i < ngasmixes; ++i) {
+			parser->helium[i] = helium[i];
+			parser->oxygen[i] = oxygen[i];
+		}
+		parser->ngasmixes = ngasmixes;
+		parser->maxdepth = maxdepth;
+		parser->divetime = time;
+		parser->divemode = divemode;
+		parser->cached = 1;
 	}
-	parser->ngasmixes = ngasmixes;
-	parser->maxdepth = maxdepth;
-	parser->divetime = time;
-	parser->divemode = divemode;
-	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -0,0 +1,842 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <errno.h>
+#include <time.h>	// nanosleep
+#endif
+
+#include <libdivecomputer/emulator.h>
+
+#include "emulator-private.h"
+#include "iostream-private.h"
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define SZ_REQUEST  512
+#define SZ_RESPONSE 1024
+
+// Shearwater
+#define SHEARWATER_BASE  0xDD000000
+#define SHEARWATER_BLOCK 0x80
+
+// SLIP special character codes
+#define END       0xC0
+#define ESC       0xDB
+#define ESC_END   0xDC
+#define ESC_ESC   0xDD
+
+// Suunto
+#define SUUNTO_VERSION 4
+
+// Oceanic
+#define OCEANIC_VERSION 16
+#define OCEANIC_PAGE    16
+
+#define ACK 0x5A
+#define NAK 0xA5
+
+typedef struct dc_emulator_t dc_emulator_t;
+
+typedef struct dc_emulator_engine_t {
+	dc_family_t family;
+	size_t vsize;
+	// Returns the number of bytes of the first complete command in the
+	// request buffer, or zero if more data is needed.
+	size_t (*parse) (dc_emulator_t *emulator);
+	void (*process) (dc_emulator_t *emulator, const unsigned char command[], size_t size);
+} dc_emulator_engine_t;
+
+struct dc_emulator_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	const dc_emulator_engine_t *engine;
+	unsigned char *buffer;
+	const unsigned char *version;
+	unsigned char *memory;
+	size_t memsize;
+	unsigned int echo;
+	// Received commands.
+	unsigned char request[SZ_REQUEST];
+	size_t rqlength;
+	// Pending answers.
+	unsigned char response[SZ_RESPONSE];
+	size_t rsoffset;
+	size_t rslength;
+	// Protocol state.
+	unsigned int address;
+	unsigned int end;
+	unsigned int block;
+	unsigned int writing;
+	// Line model.
+	dc_replay_pacing_t pacing;
+	unsigned int baudrate;
+	unsigned int loss;
+	unsigned int seed;
+	int timeout;
+	dc_usecs_t latency;
+	dc_usecs_t charusecs;
+	dc_usecs_t elapsed;
+};
+
+static dc_status_t dc_emulator_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_emulator_set_value (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_emulator_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_emulator_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_emulator_poll (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_emulator_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_emulator_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_emulator_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_emulator_flush (dc_iostream_t *abstract);
+static dc_status_t dc_emulator_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_emulator_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_emulator_close (dc_iostream_t *abstract);
+
+static size_t dc_emulator_shearwater_parse (dc_emulator_t *emulator);
+static void dc_emulator_shearwater_process (dc_emulator_t *emulator, const unsigned char command[], size_t size);
+static size_t dc_emulator_suunto_parse (dc_emulator_t *emulator);
+static void dc_emulator_suunto_process (dc_emulator_t *emulator, const unsigned char command[], size_t size);
+static size_t dc_emulator_oceanic_parse (dc_emulator_t *emulator);
+static void dc_emulator_oceanic_process (dc_emulator_t *emulator, const unsigned char command[], size_t size);
+
+static const dc_iostream_vtable_t dc_emulator_vtable = {
+	sizeof(dc_emulator_t),
+	dc_emulator_set_timeout, /* set_timeout */
+	dc_emulator_set_value, /* set_latency */
+	dc_emulator_set_value, /* set_break */
+	dc_emulator_set_value, /* set_dtr */
+	dc_emulator_set_value, /* set_rts */
+	dc_emulator_get_lines, /* get_lines */
+	dc_emulator_get_available, /* get_available */
+	dc_emulator_poll, /* poll */
+	dc_emulator_configure, /* configure */
+	dc_emulator_read, /* read */
+	dc_emulator_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_emulator_flush, /* flush */
+	dc_emulator_purge, /* purge */
+	dc_emulator_sleep, /* sleep */
+	dc_emulator_close, /* close */
+	NULL, /* cancel */
+};
+
+static const dc_emulator_engine_t g_engines[] = {
+	{DC_FAMILY_SHEARWATER_PREDATOR, 0, dc_emulator_shearwater_parse, dc_emulator_shearwater_process},
+	{DC_FAMILY_SUUNTO_D9, SUUNTO_VERSION, dc_emulator_suunto_parse, dc_emulator_suunto_process},
+	{DC_FAMILY_SUUNTO_VYPER2, SUUNTO_VERSION, dc_emulator_suunto_parse, dc_emulator_suunto_process},
+	{DC_FAMILY_OCEANIC_ATOM2, OCEANIC_VERSION, dc_emulator_oceanic_parse, dc_emulator_oceanic_process},
+};
+
+dc_status_t
+dc_emulator_open (dc_iostream_t **out, dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], size_t size, dc_replay_pacing_t pacing, unsigned int baudrate, unsigned int latency, unsigned int loss)
+{
+	dc_emulator_t *emulator = NULL;
+	const dc_emulator_engine_t *engine = NULL;
+
+	if (out == NULL || descriptor == NULL || data == NULL ||
+		pacing > DC_REPLAY_PACING_MODEL || loss > 1000)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_family_t family = dc_descriptor_get_type (descriptor);
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_engines); ++i) {
+		if (g_engines[i].family == family) {
+			engine = &g_engines[i];
+			break;
+		}
+	}
+
+	if (engine == NULL) {
+		ERROR (context, "No emulator available for this device.");
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	if (size <= engine->vsize) {
+		ERROR (context, "Invalid memory image.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	INFO (context, "Open: emulator=%s %s",
+		dc_descriptor_get_vendor (descriptor),
+		dc_descriptor_get_product (descriptor));
+
+	// Allocate memory.
+	emulator = (dc_emulator_t *) dc_iostream_allocate (context, &dc_emulator_vtable);
+	if (emulator == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Keep a private copy, because the image can be written.
+	emulator->buffer = (unsigned char *) malloc (size);
+	if (emulator->buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_iostream_deallocate ((dc_iostream_t *) emulator);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memcpy (emulator->buffer, data, size);
+
+	emulator->engine = engine;
+	emulator->version = emulator->buffer;
+	emulator->memory = emulator->buffer + engine->vsize;
+	emulator->memsize = size - engine->vsize;
+	emulator->echo = (family == DC_FAMILY_SUUNTO_D9);
+	emulator->rqlength = 0;
+	emulator->rsoffset = 0;
+	emulator->rslength = 0;
+	emulator->address = 0;
+	emulator->end = 0;
+	emulator->block = 0;
+	emulator->writing = 0;
+	emulator->pacing = pacing;
+	emulator->baudrate = baudrate;
+	emulator->loss = loss;
+	emulator->seed = 0x2545F491;
+	emulator->timeout = -1;
+	emulator->latency = latency * 1000ULL;
+	emulator->charusecs = 0;
+	emulator->elapsed = 0;
+
+	// Model the explicit baudrate as 8N1, until the backend configures
+	// the line.
+	if (baudrate) {
+		emulator->charusecs = (10 * 1000000ULL + baudrate - 1) / baudrate;
+	}
+
+	*out = (dc_iostream_t *) emulator;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_emulator_get_elapsed (dc_iostream_t *abstract, unsigned long long *usecs)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	if (!dc_iostream_isinstance (abstract, &dc_emulator_vtable) || usecs == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*usecs = emulator->elapsed;
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_emulator_isinstance (dc_iostream_t *iostream)
+{
+	return dc_iostream_isinstance (iostream, &dc_emulator_vtable);
+}
+
+static void
+dc_emulator_usleep (dc_usecs_t usecs)
+{
+#ifdef _WIN32
+	Sleep ((DWORD) ((usecs + 999) / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec  = (usecs / 1000000);
+	ts.tv_nsec = (usecs % 1000000) * 1000;
+
+	while (nanosleep (&ts, &ts) != 0 && errno == EINTR) {
+	}
+#endif
+}
+
+/*
+ * Account for the modelled duration, and wait for it when pacing.
+ */
+static void
+dc_emulator_wait (dc_emulator_t *emulator, dc_usecs_t duration)
+{
+	emulator->elapsed += duration;
+
+	if (emulator->pacing != DC_REPLAY_PACING_NONE && duration)
+		dc_emulator_usleep (duration);
+}
+
+/*
+ * Queue an answer, unless it is lost. The whole answer of a command is
+ * queued at once, such that a loss drops it completely.
+ */
+static void
+dc_emulator_respond (dc_emulator_t *emulator, const unsigned char data[], size_t size)
+{
+	if (emulator->loss) {
+		// Xorshift pseudo random number generator.
+		unsigned int x = emulator->seed;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		emulator->seed = x;
+
+		if (x % 1000 < emulator->loss) {
+			DEBUG (emulator->base.context, "Dropped an answer of %u bytes.", (unsigned int) size);
+			return;
+		}
+	}
+
+	// Discard the answers that were not read yet, when running out of
+	// space. A backend would have to purge them anyway.
+	if (emulator->rslength + size > sizeof (emulator->response)) {
+		emulator->rsoffset = emulator->rslength = 0;
+		if (size > sizeof (emulator->response))
+			return;
+	}
+
+	memcpy (emulator->response + emulator->rslength, data, size);
+	emulator->rslength += size;
+}
+
+/*
+ * Shearwater Predator
+ *
+ * SLIP framed packets, with the request and answer header of the
+ * Shearwater protocol. Only the uncompressed download is supported.
+ */
+
+static size_t
+dc_emulator_shearwater_parse (dc_emulator_t *emulator)
+{
+	const unsigned char *end = (const unsigned char *) memchr (emulator->request, END, emulator->rqlength);
+	if (end == NULL)
+		return 0;
+
+	return end - emulator->request + 1;
+}
+
+static void
+dc_emulator_shearwater_answer (dc_emulator_t *emulator, const unsigned char data[], size_t size)
+{
+	unsigned char packet[4 + 2 + SHEARWATER_BLOCK];
+	unsigned char buffer[2 * sizeof (packet) + 1];
+	size_t n = 0;
+
+	packet[0] = 0x01;
+	packet[1] = 0xFF;
+	packet[2] = size + 1;
+	packet[3] = 0x00;
+	memcpy (packet + 4, data, size);
+
+	// Encode the packet, escaping the END and ESC characters.
+	for (size_t i = 0; i < size + 4; ++i) {
+		switch (packet[i]) {
+		case END:
+			buffer[n++] = ESC;
+			buffer[n++] = ESC_END;
+			break;
+		case ESC:
+			buffer[n++] = ESC;
+			buffer[n++] = ESC_ESC;
+			break;
+		default:
+			buffer[n++] = packet[i];
+			break;
+		}
+	}
+	buffer[n++] = END;
+
+	dc_emulator_respond (emulator, buffer, n);
+}
+
+static void
+dc_emulator_shearwater_process (dc_emulator_t *emulator, const unsigned char command[], size_t size)
+{
+	unsigned char packet[SZ_REQUEST];
+	size_t n = 0;
+
+	// Decode the packet.
+	for (size_t i = 0; i < size; ++i) {
+		unsigned char c = command[i];
+		if (c == END)
+			break;
+		if (c == ESC && i + 1 < size) {
+			c = command[++i];
+			if (c == ESC_END)
+				c = END;
+			else if (c == ESC_ESC)
+				c = ESC;
+		}
+		packet[n++] = c;
+	}
+
+	// Ignore the empty packets.
+	if (n == 0)
+		return;
+
+	if (n < 5 || packet[0] != 0xFF || packet[1] != 0x01 ||
+		packet[2] != n - 3 || packet[3] != 0x00) {
+		WARNING (emulator->base.context, "Invalid request packet.");
+		return;
+	}
+
+	const unsigned char *p = packet + 4;
+	size_t length = n - 4;
+
+	if (p[0] == 0x35 && length == 10) {
+		unsigned int address = array_uint32_be (p + 3);
+		unsigned int count = array_uint24_be (p + 7);
+		if (p[1] != 0x00) {
+			WARNING (emulator->base.context, "Compressed downloads are not supported.");
+			return;
+		}
+		if (address < SHEARWATER_BASE ||
+			address - SHEARWATER_BASE > emulator->memsize ||
+			count > emulator->memsize - (address - SHEARWATER_BASE)) {
+			WARNING (emulator->base.context, "Invalid download address.");
+			return;
+		}
+		emulator->address = address - SHEARWATER_BASE;
+		emulator->end = emulator->address + count;
+		emulator->block = 1;
+
+		const unsigned char answer[] = {0x75, 0x10, SHEARWATER_BLOCK + 2};
+		dc_emulator_shearwater_answer (emulator, answer, sizeof (answer));
+	} else if (p[0] == 0x36 && length == 2) {
+		unsigned char answer[2 + SHEARWATER_BLOCK];
+		unsigned int count = emulator->end - emulator->address;
+		if (count > SHEARWATER_BLOCK)
+			count = SHEARWATER_BLOCK;
+
+		if (p[1] != (emulator->block & 0xFF)) {
+			WARNING (emulator->base.context, "Unexpected block number.");
+			return;
+		}
+
+		answer[0] = 0x76;
+		answer[1] = p[1];
+		memcpy (answer + 2, emulator->memory + emulator->address, count);
+		dc_emulator_shearwater_answer (emulator, answer, count + 2);
+
+		emulator->address += count;
+		emulator->block++;
+	} else if (p[0] == 0x37 && length == 1) {
+		const unsigned char answer[] = {0x77, 0x00};
+		dc_emulator_shearwater_answer (emulator, answer, sizeof (answer));
+	} else {
+		WARNING (emulator->base.context, "Unsupported command (%02x).", p[0]);
+	}
+}
+
+/*
+ * Suunto D9 and Vyper2
+ *
+ * Every command ends with an XOR checksum. The answer repeats the
+ * command byte and the parameters. The D9 interface also echoes the
+ * command itself.
+ */
+
+static size_t
+dc_emulator_suunto_parse (dc_emulator_t *emulator)
+{
+	const unsigned char *p = emulator->request;
+	size_t n = emulator->rqlength;
+	size_t length = 0;
+
+	switch (p[0]) {
+	case 0x0F: // Version
+	case 0x20: // Reset maximum depth
+		length = 4;
+		break;
+	case 0x05: // Read
+		length = 7;
+		break;
+	case 0x06: // Write
+		if (n < 3)
+			return 0;
+		length = p[2] + 4;
+		break;
+	default:
+		WARNING (emulator->base.context, "Unsupported command (%02x).", p[0]);
+		return n;
+	}
+
+	return n >= length ? length : 0;
+}
+
+static void
+dc_emulator_suunto_process (dc_emulator_t *emulator, const unsigned char command[], size_t size)
+{
+	unsigned char buffer[2 * (0xFF + 7)];
+	unsigned int address = 0, count = 0;
+	size_t n = 0;
+
+	if (size < 4 || checksum_xor_uint8 (command, size, 0x00) != 0) {
+		WARNING (emulator->base.context, "Unexpected command checksum.");
+		return;
+	}
+
+	if (emulator->echo) {
+		memcpy (buffer, command, size);
+		n = size;
+	}
+
+	unsigned char *answer = buffer + n;
+	switch (command[0]) {
+	case 0x0F:
+		answer[0] = command[0];
+		answer[1] = 0x00;
+		answer[2] = SUUNTO_VERSION;
+		memcpy (answer + 3, emulator->version, SUUNTO_VERSION);
+		n += 3 + SUUNTO_VERSION;
+		break;
+	case 0x20:
+		answer[0] = command[0];
+		answer[1] = 0x00;
+		answer[2] = 0x00;
+		n += 3;
+		break;
+	case 0x05:
+	case 0x06:
+		if (size < 7)
+			return;
+		address = array_uint16_be (command + 3);
+		count = command[5];
+		if (address + count > emulator->memsize) {
+			WARNING (emulator->base.context, "Invalid memory address.");
+			return;
+		}
+		if (command[0] == 0x06 && size != count + 7)
+			return;
+		answer[0] = command[0];
+		answer[1] = 0x00;
+		answer[2] = 0x03;
+		memcpy (answer + 3, command + 3, 3);
+		n += 6;
+		if (command[0] == 0x05) {
+			answer[2] = count + 3;
+			memcpy (answer + 6, emulator->memory + address, count);
+			n += count;
+		} else {
+			memcpy (emulator->memory + address, command + 6, count);
+		}
+		break;
+	}
+
+	buffer[n] = checksum_xor_uint8 (answer, buffer + n - answer, 0x00);
+	n++;
+
+	dc_emulator_respond (emulator, buffer, n);
+}
+
+/*
+ * Oceanic Atom2
+ *
+ * Every command is acknowledged with a single byte, followed by the
+ * data and an additive checksum. The pages are 16 bytes.
+ */
+
+static size_t
+dc_emulator_oceanic_parse (dc_emulator_t *emulator)
+{
+	const unsigned char *p = emulator->request;
+	size_t n = emulator->rqlength;
+	size_t length = 0;
+
+	if (emulator->writing) {
+		length = OCEANIC_PAGE + 2;
+	} else {
+		switch (p[0]) {
+		case 0x84: // Version
+			length = 2;
+			break;
+		case 0xB1: // Read 1 page
+		case 0xB4: // Read 8 pages
+		case 0xB8: // Read 16 pages
+		case 0xB2: // Write
+		case 0x91: // Keepalive
+		case 0x6A: // Quit
+			length = 4;
+			break;
+		default:
+			WARNING (emulator->base.context, "Unsupported command (%02x).", p[0]);
+			return n;
+		}
+	}
+
+	return n >= length ? length : 0;
+}
+
+static void
+dc_emulator_oceanic_process (dc_emulator_t *emulator, const unsigned char command[], size_t size)
+{
+	unsigned char answer[1 + 16 * OCEANIC_PAGE + 2];
+	unsigned int npages = 0;
+	unsigned int crcsize = 1;
+	const unsigned char *data = NULL;
+
+	answer[0] = ACK;
+
+	if (emulator->writing) {
+		emulator->writing = 0;
+		if (checksum_add_uint8 (command, OCEANIC_PAGE, 0x00) != command[OCEANIC_PAGE]) {
+			WARNING (emulator->base.context, "Unexpected command checksum.");
+			return;
+		}
+		memcpy (emulator->memory + emulator->address, command, OCEANIC_PAGE);
+		dc_emulator_respond (emulator, answer, 1);
+		return;
+	}
+
+	switch (command[0]) {
+	case 0x84:
+		npages = 1;
+		data = emulator->version;
+		break;
+	case 0xB1:
+	case 0xB4:
+	case 0xB8:
+	case 0xB2:
+		npages = (command[0] == 0xB8) ? 16 : (command[0] == 0xB4) ? 8 : 1;
+		emulator->address = array_uint16_be (command + 1) * OCEANIC_PAGE;
+		if (emulator->address + npages * OCEANIC_PAGE > emulator->memsize) {
+			WARNING (emulator->base.context, "Invalid memory address.");
+			return;
+		}
+		if (command[0] == 0xB2) {
+			emulator->writing = 1;
+			npages = 0;
+		} else {
+			data = emulator->memory + emulator->address;
+		}
+		if (command[0] == 0xB8)
+			crcsize = 2;
+		break;
+	case 0x6A:
+		answer[0] = NAK;
+		break;
+	}
+
+	size_t n = 1;
+	if (npages) {
+		memcpy (answer + 1, data, npages * OCEANIC_PAGE);
+		n += npages * OCEANIC_PAGE;
+		if (crcsize == 2) {
+			unsigned short crc = checksum_add_uint16 (answer + 1, n - 1, 0x0000);
+			answer[n + 0] = (crc     ) & 0xFF;
+			answer[n + 1] = (crc >> 8) & 0xFF;
+		} else {
+			answer[n] = checksum_add_uint8 (answer + 1, n - 1, 0x00);
+		}
+		n += crcsize;
+	}
+
+	dc_emulator_respond (emulator, answer, n);
+}
+
+static dc_status_t
+dc_emulator_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	emulator->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_set_value (dc_iostream_t *abstract, unsigned int value)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	if (value)
+		*value = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	if (value)
+		*value = emulator->rslength - emulator->rsoffset;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	if (emulator->rslength != emulator->rsoffset)
+		return DC_STATUS_SUCCESS;
+
+	if (timeout > 0)
+		dc_emulator_wait (emulator, timeout * 1000ULL);
+
+	return DC_STATUS_TIMEOUT;
+}
+
+static dc_status_t
+dc_emulator_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	if (baudrate == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// An explicit baudrate overrides the one of the backend.
+	if (emulator->baudrate)
+		baudrate = emulator->baudrate;
+
+	// The number of bits per character, including the start bit.
+	unsigned int nbits = 1 + databits +
+		(parity != DC_PARITY_NONE) +
+		(stopbits == DC_STOPBITS_ONE ? 1 : 2);
+
+	emulator->charusecs = (nbits * 1000000ULL + baudrate - 1) / baudrate;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+	dc_usecs_t duration = 0;
+
+	size_t nbytes = emulator->rslength - emulator->rsoffset;
+	if (nbytes > size)
+		nbytes = size;
+
+	memcpy (data, emulator->response + emulator->rsoffset, nbytes);
+	emulator->rsoffset += nbytes;
+	if (emulator->rsoffset == emulator->rslength)
+		emulator->rsoffset = emulator->rslength = 0;
+
+	// Without enough data, the read waits for the timeout.
+	if (nbytes < size) {
+		status = DC_STATUS_TIMEOUT;
+		if (emulator->timeout > 0)
+			duration += emulator->timeout * 1000ULL;
+	}
+
+	duration += emulator->latency + nbytes * emulator->charusecs;
+	dc_emulator_wait (emulator, duration);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_emulator_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+	const unsigned char *p = (const unsigned char *) data;
+	size_t nbytes = 0;
+
+	while (nbytes < size) {
+		size_t n = sizeof (emulator->request) - emulator->rqlength;
+		if (n > size - nbytes)
+			n = size - nbytes;
+
+		memcpy (emulator->request + emulator->rqlength, p + nbytes, n);
+		emulator->rqlength += n;
+		nbytes += n;
+
+		// Process all complete commands.
+		size_t length = 0;
+		while (emulator->rqlength && (length = emulator->engine->parse (emulator)) != 0) {
+			emulator->engine->process (emulator, emulator->request, length);
+			memmove (emulator->request, emulator->request + length, emulator->rqlength - length);
+			emulator->rqlength -= length;
+		}
+
+		// Drop a command that does not fit.
+		if (emulator->rqlength == sizeof (emulator->request)) {
+			WARNING (abstract->context, "Dropped an oversized command.");
+			emulator->rqlength = 0;
+		}
+	}
+
+	dc_emulator_wait (emulator, emulator->latency + size * emulator->charusecs);
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_flush (dc_iostream_t *abstract)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	if (direction & DC_DIRECTION_INPUT) {
+		emulator->rsoffset = emulator->rslength = 0;
+	}
+
+	if (direction & DC_DIRECTION_OUTPUT) {
+		emulator->rqlength = 0;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	dc_emulator_wait (emulator, milliseconds * 1000ULL);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_emulator_close (dc_iostream_t *abstract)
+{
+	dc_emulator_t *emulator = (dc_emulator_t *) abstract;
+
+	free (emulator->buffer);
+
+	return DC_STATUS_SUCCESS;
+}
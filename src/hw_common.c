@@ -0,0 +1,140 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+
+#include "hw_common.h"
+#include "context-private.h"
+#include "array.h"
+
+#define MINTIMEOUT 1000
+
+#define MAXRETRIES 2
+
+dc_status_t
+hw_common_echo (dc_iostream_t *iostream, unsigned char data[], unsigned int size, int timeout)
+{
+	// The echo arrives after one round trip, so a lost command is
+	// detected after the measured round trip time instead of the full
+	// timeout, which is still used for the data itself. The command is
+	// never sent again, because the device could take a second copy
+	// for a parameter byte, so the timeout is kept well above the round
+	// trip time of a slow link.
+	int rto = dc_iostream_get_rto (iostream, MINTIMEOUT, timeout);
+	if (rto != timeout)
+		dc_iostream_set_timeout (iostream, rto);
+
+	dc_status_t status = dc_iostream_read (iostream, data, size, NULL);
+
+	if (rto != timeout)
+		dc_iostream_set_timeout (iostream, timeout);
+
+	return status;
+}
+
+
+dc_status_t
+hw_common_device_logbook (dc_device_t *abstract, const hw_common_logbook_t *layout, const unsigned char header[], unsigned int latest, unsigned int nheaders, unsigned int ndives)
+{
+	if (ndives == 0)
+		return DC_STATUS_SUCCESS;
+
+	dc_logbook_entry_t *entries = (dc_logbook_entry_t *) dc_context_alloc (abstract->context, ndives * sizeof (dc_logbook_entry_t));
+	if (entries == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < nheaders && count < ndives; ++i) {
+		unsigned int idx = (latest + layout->count - i) % layout->count;
+		const unsigned char *p = header + idx * layout->size;
+		const unsigned char *datetime = p + layout->fingerprint;
+
+		if (device_is_known (abstract, datetime, layout->fsize))
+			continue;
+
+		dc_logbook_entry_t *entry = &entries[count++];
+		entry->fingerprint = datetime;
+		entry->fsize = layout->fsize;
+		entry->flags = DC_LOGBOOK_DATETIME | DC_LOGBOOK_MAXDEPTH | DC_LOGBOOK_DIVETIME;
+		if (layout->date == HW_COMMON_MDY) {
+			entry->datetime.year   = datetime[2] + 2000;
+			entry->datetime.month  = datetime[0];
+			entry->datetime.day    = datetime[1];
+		} else {
+			entry->datetime.year   = datetime[0] + 2000;
+			entry->datetime.month  = datetime[1];
+			entry->datetime.day    = datetime[2];
+		}
+		entry->datetime.hour   = datetime[3];
+		entry->datetime.minute = datetime[4];
+		entry->datetime.second = 0;
+		entry->datetime.timezone = DC_TIMEZONE_NONE;
+		entry->maxdepth = array_uint16_le (p + layout->maxdepth) / 100.0;
+		entry->divetime = array_uint16_le (p + layout->divetime) * 60 + p[layout->divetime + 2];
+	}
+
+	dc_event_logbook_t event;
+	event.entries = entries;
+	event.count = count;
+	device_event_emit (abstract, DC_EVENT_LOGBOOK, &event);
+
+	dc_context_release (abstract->context, entries);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+hw_common_device_dive (dc_device_t *abstract, dc_iostream_t *iostream, dc_event_progress_t *progress, hw_common_dive_t dive, unsigned char number, unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// The DIVE command can't be resumed at an offset, so after a
+	// transmission error only the current dive is requested again,
+	// instead of aborting the entire download.
+	unsigned int nretries = 0;
+	unsigned int current = progress->current;
+	while ((status = dive (abstract, progress, number, data, size)) != DC_STATUS_SUCCESS) {
+		if ((status != DC_STATUS_TIMEOUT && status != DC_STATUS_PROTOCOL) ||
+			nretries++ >= MAXRETRIES)
+			break;
+
+		WARNING (abstract->context, "Failed to read the dive (attempt %u).", nretries);
+		device_stats_retry (abstract);
+
+		// Wait until the device has finished sending the remainder
+		// of the dive, and discard it.
+		dc_iostream_sleep (iostream, 1000);
+		dc_iostream_purge (iostream, DC_DIRECTION_INPUT);
+
+		// Rewind the progress.
+		progress->current = current;
+	}
+
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the dive.");
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef HW_COMMON_H
+#define HW_COMMON_H
+
+#include "device-private.h"
+#include "iostream-private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef enum hw_common_date_t {
+	HW_COMMON_YMD, // Year, month, day.
+	HW_COMMON_MDY, // Month, day, year.
+} hw_common_date_t;
+
+typedef struct hw_common_logbook_t {
+	// Logbook ringbuffer.
+	unsigned int size;
+	unsigned int count;
+	// The fingerprint is the date and time of the dive.
+	unsigned int fingerprint;
+	unsigned int fsize;
+	hw_common_date_t date;
+	// Dive summary.
+	unsigned int maxdepth;
+	unsigned int divetime;
+} hw_common_logbook_t;
+
+typedef dc_status_t (*hw_common_dive_t) (dc_device_t *device, dc_event_progress_t *progress, unsigned char number, unsigned char data[], unsigned int size);
+
+dc_status_t
+hw_common_echo (dc_iostream_t *iostream, unsigned char data[], unsigned int size, int timeout);
+
+dc_status_t
+hw_common_device_logbook (dc_device_t *device, const hw_common_logbook_t *layout, const unsigned char header[], unsigned int latest, unsigned int nheaders, unsigned int ndives);
+
+dc_status_t
+hw_common_device_dive (dc_device_t *device, dc_iostream_t *iostream, dc_event_progress_t *progress, hw_common_dive_t dive, unsigned char number, unsigned char data[], unsigned int size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* HW_COMMON_H */
@@ -23,8 +23,11 @@
 #include <stdlib.h> // malloc, free
 
 #include "hw_frog.h"
+#include "hw_common.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "probe.h"
+#include "iostream-private.h"
 #include "serial.h"
 #include "checksum.h"
 #include "ringbuffer.h"
@@ -53,6 +56,8 @@
 #define INIT       0xBB
 #define EXIT       0xFF
 
+#define TIMEOUT 3000
+
 typedef struct hw_frog_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
@@ -76,6 +81,18 @@ static const dc_device_vtable_t hw_frog_device_vtable = {
 	hw_frog_device_close /* close */
 };
 
+// The fingerprint is the date and time at the end of the dive, stored
+// as month, day, year, hour and minute.
+static const hw_common_logbook_t hw_frog_logbook = {
+	RB_LOGBOOK_SIZE, /* size */
+	RB_LOGBOOK_COUNT, /* count */
+	9,  /* fingerprint */
+	5,  /* fsize */
+	HW_COMMON_MDY, /* date */
+	14, /* maxdepth */
+	16, /* divetime */
+};
+
 
 static int
 hw_frog_strncpy (unsigned char *data, unsigned int size, const char *text)
@@ -98,13 +115,13 @@ hw_frog_strncpy (unsigned char *data, unsigned int size, const char *text)
 
 
 static dc_status_t
-hw_frog_transfer (hw_frog_device_t *device,
-                  dc_event_progress_t *progress,
-                  unsigned char cmd,
-                  const unsigned char input[],
-                  unsigned int isize,
-                  unsigned char output[],
-                  unsigned int osize)
+hw_frog_packet (hw_frog_device_t *device,
+                dc_event_progress_t *progress,
+                unsigned char cmd,
+                const unsigned char input[],
+                unsigned int isize,
+                unsigned char output[],
+                unsigned int osize)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -123,7 +140,7 @@ hw_frog_transfer (hw_frog_device_t *device,
 	if (cmd != INIT && cmd != HEADER) {
 		// Read the echo.
 		unsigned char answer[1] = {0};
-		status = dc_iostream_read (device->iostream, answer, sizeof (answer), NULL);
+		status = hw_common_echo (device->iostream, answer, sizeof (answer), TIMEOUT);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the echo.");
 			return status;
@@ -197,6 +214,27 @@ hw_frog_transfer (hw_frog_device_t *device,
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+hw_frog_transfer (hw_frog_device_t *device,
+                  dc_event_progress_t *progress,
+                  unsigned char cmd,
+                  const unsigned char input[],
+                  unsigned int isize,
+                  unsigned char output[],
+                  unsigned int osize)
+{
+	dc_context_t *context = device->base.context;
+	dc_usecs_t begin = dc_context_trace_begin (context);
+	DC_PROBE3 (transfer__entry, dc_device_get_type ((dc_device_t *) device), cmd, isize);
+
+	dc_status_t status = hw_frog_packet (device, progress, cmd, input, isize, output, osize);
+
+	DC_PROBE3 (transfer__return, dc_device_get_type ((dc_device_t *) device), cmd, status);
+	dc_context_trace_end (context, "hw_frog_transfer", begin);
+
+	return status;
+}
+
 
 dc_status_t
 hw_frog_device_open (dc_device_t **out, dc_context_t *context, const char *name)
@@ -225,6 +263,8 @@ hw_frog_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -233,7 +273,7 @@ hw_frog_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 	}
 
 	// Set the timeout for receiving data (3000ms).
-	status = dc_iostream_set_timeout (device->iostream, 3000);
+	status = dc_iostream_set_timeout (device->iostream, TIMEOUT);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to set the timeout.");
 		goto error_close;
@@ -323,6 +363,16 @@ hw_frog_device_version (dc_device_t *abstract, unsigned char data[], unsigned in
 }
 
 
+static dc_status_t
+hw_frog_device_dive (dc_device_t *abstract, dc_event_progress_t *progress, unsigned char number, unsigned char data[], unsigned int size)
+{
+	hw_frog_device_t *device = (hw_frog_device_t *) abstract;
+
+	unsigned char command[1] = {number};
+	return hw_frog_transfer (device, progress, DIVE, command, sizeof (command), data, size);
+}
+
+
 static dc_status_t
 hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -349,19 +399,21 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	devinfo.serial = array_uint16_le (id + 0);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory.
-	unsigned char *header = (unsigned char *) malloc (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT);
+	// Allocate memory. Unlike the OSTC3, the Frog has no compact logbook
+	// headers, so the full logbook headers are always needed.
+	unsigned char *header = (unsigned char *) dc_context_alloc (abstract->context, RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT);
 	if (header == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
 	// Download the logbook headers.
+	device_set_phase (abstract, DC_PHASE_LOGBOOK);
 	rc = hw_frog_transfer (device, &progress, HEADER,
               NULL, 0, header, RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the header.");
-		free (header);
+		dc_context_release (abstract->context, header);
 		return rc;
 	}
 
@@ -390,6 +442,7 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	}
 
 	// Calculate the total and maximum size.
+	unsigned int nheaders = 0;
 	unsigned int ndives = 0;
 	unsigned int size = 0;
 	unsigned int maxsize = 0;
@@ -406,7 +459,7 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 			end >= RB_PROFILE_END)
 		{
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).", begin, end);
-			free (header);
+			dc_context_release (abstract->context, header);
 			return DC_STATUS_DATAFORMAT;
 		}
 
@@ -417,6 +470,12 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		if (memcmp (header + offset + 9, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
 
+		nheaders++;
+
+		// Skip the dives which are already known.
+		if (device_is_known (abstract, header + offset + 9, sizeof (device->fingerprint)))
+			continue;
+
 		if (length > maxsize)
 			maxsize = length;
 		size += length;
@@ -427,25 +486,38 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	progress.maximum = (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT) + size;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	// Report the new dives from the logbook headers.
+	rc = hw_common_device_logbook (abstract, &hw_frog_logbook, header, latest, nheaders, ndives);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_context_release (abstract->context, header);
+		return rc;
+	}
+
 	// Finish immediately if there are no dives available.
 	if (ndives == 0) {
-		free (header);
+		dc_context_release (abstract->context, header);
 		return DC_STATUS_SUCCESS;
 	}
 
 	// Allocate enough memory for the largest dive.
-	unsigned char *profile = (unsigned char *) malloc (maxsize);
-	if (profile == NULL) {
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, maxsize);
+	if (buffer == NULL || !dc_buffer_resize (buffer, maxsize)) {
 		ERROR (abstract->context, "Failed to allocate memory.");
-		free (header);
+		dc_buffer_free (buffer);
+		dc_context_release (abstract->context, header);
 		return DC_STATUS_NOMEMORY;
 	}
+	unsigned char *profile = dc_buffer_get_data (buffer);
 
 	// Download the dives.
-	for (unsigned int i = 0; i < ndives; ++i) {
+	device_set_phase (abstract, DC_PHASE_PROFILE);
+	for (unsigned int i = 0; i < nheaders; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
 		unsigned int offset = idx * RB_LOGBOOK_SIZE;
 
+		if (device_is_known (abstract, header + offset + 9, sizeof (device->fingerprint)))
+			continue;
+
 		// Get the ringbuffer pointers.
 		unsigned int begin = array_uint24_le (header + offset + 2);
 		unsigned int end   = array_uint24_le (header + offset + 5);
@@ -454,31 +526,27 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 		unsigned int length = RB_LOGBOOK_SIZE + RB_PROFILE_DISTANCE (begin, end) - 6;
 
 		// Download the dive.
-		unsigned char number[1] = {idx};
-		rc = hw_frog_transfer (device, &progress, DIVE,
-			number, sizeof (number), profile, length);
+		rc = hw_common_device_dive (abstract, device->iostream, &progress, hw_frog_device_dive, idx, profile, length);
 		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read the dive.");
-			free (profile);
-			free (header);
+			dc_buffer_free (buffer);
+			dc_context_release (abstract->context, header);
 			return rc;
 		}
 
 		// Verify the header in the logbook and profile are identical.
 		if (memcmp (profile, header + offset, RB_LOGBOOK_SIZE) != 0) {
 			ERROR (abstract->context, "Unexpected profile header.");
-			free (profile);
-			free (header);
-			return rc;
-
+			dc_buffer_free (buffer);
+			dc_context_release (abstract->context, header);
+			return DC_STATUS_DATAFORMAT;
 		}
 
 		if (callback && !callback (profile, length, profile + 9, sizeof (device->fingerprint), userdata))
 			break;
 	}
 
-	free (profile);
-	free (header);
+	dc_buffer_free (buffer);
+	dc_context_release (abstract->context, header);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -85,9 +85,6 @@ static const dc_device_vtable_t hw_ostc_device_vtable = {
 	hw_ostc_device_close /* close */
 };
 
-static dc_status_t
-hw_ostc_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static dc_status_t
 hw_ostc_send (hw_ostc_device_t *device, unsigned char cmd, unsigned int echo)
 {
@@ -149,6 +146,8 @@ hw_ostc_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -224,7 +223,10 @@ hw_ostc_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	progress.maximum = SZ_HEADER + SZ_FW_NEW;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Send the command.
+	// Send the command. This is the only download command of the
+	// original OSTC. It always sends the entire profile memory, and the
+	// header doesn't contain anything to locate the most recent dive, so
+	// there is no way to detect in advance that there are no new dives.
 	unsigned char command[1] = {'a'};
 	status = dc_iostream_write (device->iostream, command, sizeof (command), NULL);
 	if (status != DC_STATUS_SUCCESS) {
@@ -309,7 +311,7 @@ hw_ostc_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 hw_ostc_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -630,7 +632,7 @@ hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_f
 }
 
 
-static dc_status_t
+dc_status_t
 hw_ostc_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	hw_ostc_device_t *device = (hw_ostc_device_t *) abstract;
@@ -809,6 +811,8 @@ hw_ostc_firmware_setup (hw_ostc_device_t *device, unsigned int maxretries)
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= maxretries)
 			break;
+
+		device_stats_retry ((dc_device_t *) device);
 	}
 
 	return rc;
@@ -860,6 +864,8 @@ hw_ostc_firmware_write (hw_ostc_device_t *device, unsigned char *data, unsigned
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
 			break;
+
+		device_stats_retry ((dc_device_t *) device);
 	}
 
 	return rc;
@@ -940,9 +946,20 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		return rc;
 	}
 
+	// Count the number of blocks to upload. Only the blocks present in
+	// the hex file are sent. Blocks are never skipped based on a previous
+	// upload, because the bootloader provides no way to read back or
+	// identify the current flash contents, and every block must be
+	// acknowledged before the next one is sent.
+	unsigned int nblocks = 0;
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(firmware->bitmap); ++i) {
+		if (firmware->bitmap[i])
+			nblocks++;
+	}
+
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = C_ARRAY_SIZE(firmware->bitmap);
+	progress.maximum = nblocks;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	for (unsigned int i = 0; i < C_ARRAY_SIZE(firmware->bitmap); ++i) {
@@ -970,7 +987,7 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		}
 
 		// Update and emit a progress event.
-		progress.current = i + 1;
+		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
@@ -25,8 +25,11 @@
 #include <stdio.h>  // FILE, fopen
 
 #include "hw_ostc3.h"
+#include "hw_common.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "probe.h"
+#include "iostream-private.h"
 #include "serial.h"
 #include "array.h"
 #include "aes.h"
@@ -34,6 +37,8 @@
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &hw_ostc3_device_vtable)
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #define SZ_DISPLAY    16
 #define SZ_CUSTOMTEXT 60
 #define SZ_VERSION    (SZ_CUSTOMTEXT + 4)
@@ -82,6 +87,8 @@
 
 #define NODELAY 0
 
+#define TIMEOUT 3000
+
 typedef enum hw_ostc3_state_t {
 	OPEN,
 	DOWNLOAD,
@@ -100,9 +107,8 @@ typedef struct hw_ostc3_device_t {
 } hw_ostc3_device_t;
 
 typedef struct hw_ostc3_logbook_t {
-	unsigned int size;
+	hw_common_logbook_t base;
 	unsigned int profile;
-	unsigned int fingerprint;
 	unsigned int number;
 } hw_ostc3_logbook_t;
 
@@ -142,16 +148,30 @@ static const dc_device_vtable_t hw_ostc3_device_vtable = {
 };
 
 static const hw_ostc3_logbook_t hw_ostc3_logbook_compact = {
-	RB_LOGBOOK_SIZE_COMPACT, /* size */
+	{
+		RB_LOGBOOK_SIZE_COMPACT, /* size */
+		RB_LOGBOOK_COUNT, /* count */
+		3,  /* fingerprint */
+		5,  /* fsize */
+		HW_COMMON_YMD, /* date */
+		8,  /* maxdepth */
+		10, /* divetime */
+	},
 	0,  /* profile */
-	3,  /* fingerprint */
 	13, /* number */
 };
 
 static const hw_ostc3_logbook_t hw_ostc3_logbook_full = {
-	RB_LOGBOOK_SIZE_FULL, /* size */
+	{
+		RB_LOGBOOK_SIZE_FULL, /* size */
+		RB_LOGBOOK_COUNT, /* count */
+		12, /* fingerprint */
+		5,  /* fsize */
+		HW_COMMON_YMD, /* date */
+		17, /* maxdepth */
+		19, /* divetime */
+	},
 	9,  /* profile */
-	12, /* fingerprint */
 	80, /* number */
 };
 
@@ -177,14 +197,14 @@ hw_ostc3_strncpy (unsigned char *data, unsigned int size, const char *text)
 
 
 static dc_status_t
-hw_ostc3_transfer (hw_ostc3_device_t *device,
-                  dc_event_progress_t *progress,
-                  unsigned char cmd,
-                  const unsigned char input[],
-                  unsigned int isize,
-                  unsigned char output[],
-                  unsigned int osize,
-                  unsigned int delay)
+hw_ostc3_packet (hw_ostc3_device_t *device,
+                 dc_event_progress_t *progress,
+                 unsigned char cmd,
+                 const unsigned char input[],
+                 unsigned int isize,
+                 unsigned char output[],
+                 unsigned int osize,
+                 unsigned int delay)
 {
 	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t status = DC_STATUS_SUCCESS;
@@ -205,7 +225,7 @@ hw_ostc3_transfer (hw_ostc3_device_t *device,
 
 	// Read the echo.
 	unsigned char echo[1] = {0};
-	status = dc_iostream_read (device->iostream, echo, sizeof (echo), NULL);
+	status = hw_common_echo (device->iostream, echo, sizeof (echo), TIMEOUT);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the echo.");
 		return status;
@@ -314,6 +334,28 @@ hw_ostc3_transfer (hw_ostc3_device_t *device,
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+hw_ostc3_transfer (hw_ostc3_device_t *device,
+                  dc_event_progress_t *progress,
+                  unsigned char cmd,
+                  const unsigned char input[],
+                  unsigned int isize,
+                  unsigned char output[],
+                  unsigned int osize,
+                  unsigned int delay)
+{
+	dc_context_t *context = device->base.context;
+	dc_usecs_t begin = dc_context_trace_begin (context);
+	DC_PROBE3 (transfer__entry, dc_device_get_type ((dc_device_t *) device), cmd, isize);
+
+	dc_status_t status = hw_ostc3_packet (device, progress, cmd, input, isize, output, osize, delay);
+
+	DC_PROBE3 (transfer__return, dc_device_get_type ((dc_device_t *) device), cmd, status);
+	dc_context_trace_end (context, "hw_ostc3_transfer", begin);
+
+	return status;
+}
+
 
 dc_status_t
 hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, const char *name)
@@ -345,6 +387,8 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, const char *name
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -353,7 +397,7 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, const char *name
 	}
 
 	// Set the timeout for receiving data (3000ms).
-	status = dc_iostream_set_timeout (device->iostream, 3000);
+	status = dc_iostream_set_timeout (device->iostream, TIMEOUT);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to set the timeout.");
 		goto error_close;
@@ -606,6 +650,16 @@ hw_ostc3_device_hardware (dc_device_t *abstract, unsigned char data[], unsigned
 }
 
 
+static dc_status_t
+hw_ostc3_device_dive (dc_device_t *abstract, dc_event_progress_t *progress, unsigned char number, unsigned char data[], unsigned int size)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	unsigned char command[1] = {number};
+	return hw_ostc3_transfer (device, progress, DIVE, command, sizeof (command), data, size, NODELAY);
+}
+
+
 static dc_status_t
 hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -647,8 +701,10 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory.
-	unsigned char *header = (unsigned char *) malloc (RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+	// Allocate memory for the compact logbook headers only. The full
+	// logbook headers are sixteen times larger, and are only needed for
+	// older firmware versions.
+	unsigned char *header = (unsigned char *) dc_context_alloc (abstract->context, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT);
 	if (header == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -657,17 +713,29 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	// Download the compact logbook headers. If the firmware doesn't support
 	// compact headers yet, fallback to downloading the full logbook headers.
 	// This is slower, but also works for older firmware versions.
+	device_set_phase (abstract, DC_PHASE_LOGBOOK);
 	unsigned int compact = 1;
 	rc = hw_ostc3_transfer (device, &progress, COMPACT,
               NULL, 0, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT, NODELAY);
 	if (rc == DC_STATUS_UNSUPPORTED) {
 		compact = 0;
+
+		// Grow the buffer for the full logbook headers.
+		unsigned char *full = (unsigned char *) dc_context_realloc (abstract->context, header,
+			RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+		if (full == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			dc_context_release (abstract->context, header);
+			return DC_STATUS_NOMEMORY;
+		}
+		header = full;
+
 		rc = hw_ostc3_transfer (device, &progress, HEADER,
 		          NULL, 0, header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT, NODELAY);
 	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the header.");
-		free (header);
+		dc_context_release (abstract->context, header);
 		return rc;
 	}
 
@@ -687,10 +755,10 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	unsigned int latest = 0;
 	unsigned int maximum = 0;
 	for (unsigned int i = 0; i < RB_LOGBOOK_COUNT; ++i) {
-		unsigned int offset = i * logbook->size;
+		unsigned int offset = i * logbook->base.size;
 
 		// Ignore uninitialized header entries.
-		if (array_isequal (header + offset, logbook->size, 0xFF))
+		if (array_isequal (header + offset, logbook->base.size, 0xFF))
 			continue;
 
 		// Get the internal dive number.
@@ -704,17 +772,18 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 
 	// Calculate the total and maximum size.
+	unsigned int nheaders = 0;
 	unsigned int ndives = 0;
 	unsigned int size = 0;
 	unsigned int maxsize = 0;
 	for (unsigned int i = 0; i < count; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
-		unsigned int offset = idx * logbook->size;
+		unsigned int offset = idx * logbook->base.size;
 
 		// Uninitialized header entries should no longer be present at this
 		// stage, unless the dives are interleaved with empty entries. But
 		// that's something we don't support at all.
-		if (array_isequal (header + offset, logbook->size, 0xFF)) {
+		if (array_isequal (header + offset, logbook->base.size, 0xFF)) {
 			WARNING (abstract->context, "Unexpected empty header found.");
 			break;
 		}
@@ -729,14 +798,20 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		}
 		if (length < RB_LOGBOOK_SIZE_FULL) {
 			ERROR (abstract->context, "Invalid profile length (%u bytes).", length);
-			free (header);
+			dc_context_release (abstract->context, header);
 			return DC_STATUS_DATAFORMAT;
 		}
 
 		// Check the fingerprint data.
-		if (memcmp (header + offset + logbook->fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
+		if (memcmp (header + offset + logbook->base.fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
 
+		nheaders++;
+
+		// Skip the dives which are already known.
+		if (device_is_known (abstract, header + offset + logbook->base.fingerprint, sizeof (device->fingerprint)))
+			continue;
+
 		if (length > maxsize)
 			maxsize = length;
 		size += length;
@@ -744,27 +819,43 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 
 	// Update and emit a progress event.
-	progress.maximum = (logbook->size * RB_LOGBOOK_COUNT) + size + ndives;
+	progress.maximum = (logbook->base.size * RB_LOGBOOK_COUNT) + size + ndives;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	// Report the new dives from the logbook headers.
+	rc = hw_common_device_logbook (abstract, &logbook->base, header, latest, nheaders, ndives);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_context_release (abstract->context, header);
+		return rc;
+	}
+
 	// Finish immediately if there are no dives available.
 	if (ndives == 0) {
-		free (header);
+		dc_context_release (abstract->context, header);
 		return DC_STATUS_SUCCESS;
 	}
 
 	// Allocate enough memory for the largest dive.
-	unsigned char *profile = (unsigned char *) malloc (maxsize);
-	if (profile == NULL) {
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, maxsize);
+	if (buffer == NULL || !dc_buffer_resize (buffer, maxsize)) {
 		ERROR (abstract->context, "Failed to allocate memory.");
-		free (header);
+		dc_buffer_free (buffer);
+		dc_context_release (abstract->context, header);
 		return DC_STATUS_NOMEMORY;
 	}
+	unsigned char *profile = dc_buffer_get_data (buffer);
+
+	// Ask for a fast link during the dive downloads.
+	dc_custom_io_serial_set_params (device->iostream, DC_LINK_BULK);
 
 	// Download the dives.
-	for (unsigned int i = 0; i < ndives; ++i) {
+	device_set_phase (abstract, DC_PHASE_PROFILE);
+	for (unsigned int i = 0; i < nheaders; ++i) {
 		unsigned int idx = (latest + RB_LOGBOOK_COUNT - i) % RB_LOGBOOK_COUNT;
-		unsigned int offset = idx * logbook->size;
+		unsigned int offset = idx * logbook->base.size;
+
+		if (device_is_known (abstract, header + offset + logbook->base.fingerprint, sizeof (device->fingerprint)))
+			continue;
 
 		// Calculate the profile length.
 		unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + offset + logbook->profile) - 3;
@@ -776,21 +867,20 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		}
 
 		// Download the dive.
-		unsigned char number[1] = {idx};
-		rc = hw_ostc3_transfer (device, &progress, DIVE,
-			number, sizeof (number), profile, length, NODELAY);
+		rc = hw_common_device_dive (abstract, device->iostream, &progress, hw_ostc3_device_dive, idx, profile, length);
 		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read the dive.");
-			free (profile);
-			free (header);
+			dc_custom_io_serial_set_params (device->iostream, 0);
+			dc_buffer_free (buffer);
+			dc_context_release (abstract->context, header);
 			return rc;
 		}
 
 		// Verify the header in the logbook and profile are identical.
-		if (!compact && memcmp (profile, header + offset, logbook->size) != 0) {
+		if (!compact && memcmp (profile, header + offset, logbook->base.size) != 0) {
 			ERROR (abstract->context, "Unexpected profile header.");
-			free (profile);
-			free (header);
+			dc_custom_io_serial_set_params (device->iostream, 0);
+			dc_buffer_free (buffer);
+			dc_context_release (abstract->context, header);
 			return rc;
 		}
 
@@ -818,8 +908,9 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 			break;
 	}
 
-	free (profile);
-	free (header);
+	dc_custom_io_serial_set_params (device->iostream, 0);
+	dc_buffer_free (buffer);
+	dc_context_release (abstract->context, header);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -994,45 +1085,47 @@ hw_ostc3_firmware_checksum (const unsigned char data[], unsigned int size)
 }
 
 static dc_status_t
-hw_ostc3_firmware_readline (FILE *fp, dc_context_t *context, unsigned int addr, unsigned char data[], unsigned int size)
+hw_ostc3_firmware_readline (const unsigned char ascii[], size_t asize, size_t *offset, dc_context_t *context, unsigned int addr, unsigned char data[], unsigned int size)
 {
-	unsigned char ascii[39];
 	unsigned char faddr_byte[3];
 	unsigned int faddr = 0;
-	int n = 0;
+	size_t n = *offset;
 
 	if (size > 16) {
 		ERROR (context, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	// Read the start code.
+	// Find the start code.
 	while (1) {
-		n = fread (ascii, 1, 1, fp);
-		if (n != 1) {
+		if (n >= asize) {
 			ERROR (context, "Failed to read the start code.");
 			return DC_STATUS_IO;
 		}
 
-		if (ascii[0] == ':')
+		if (ascii[n] == ':')
 			break;
 
 		// Ignore CR and LF characters.
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (context, "Unexpected character (0x%02x).", ascii[0]);
+		if (ascii[n] != '\n' && ascii[n] != '\r') {
+			ERROR (context, "Unexpected character (0x%02x).", ascii[n]);
 			return DC_STATUS_DATAFORMAT;
 		}
+
+		n++;
 	}
 
-	// Read the payload.
-	n = fread (ascii + 1, 1, 6 + size * 2, fp);
-	if (n != 6 + size * 2) {
+	// Skip the start code.
+	n++;
+
+	// Check the payload.
+	if (asize - n < 6 + size * 2) {
 		ERROR (context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
 	// Convert the address to binary representation.
-	if (array_convert_hex2bin(ascii + 1, 6, faddr_byte, sizeof(faddr_byte)) != 0) {
+	if (array_convert_hex2bin(ascii + n, 6, faddr_byte, sizeof(faddr_byte)) != 0) {
 		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
@@ -1045,11 +1138,48 @@ hw_ostc3_firmware_readline (FILE *fp, dc_context_t *context, unsigned int addr,
 	}
 
 	// Convert the payload to binary representation.
-	if (array_convert_hex2bin (ascii + 1 + 6, size * 2, data, size) != 0) {
+	if (array_convert_hex2bin (ascii + n + 6, size * 2, data, size) != 0) {
 		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	*offset = n + 6 + size * 2;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+hw_ostc3_firmware_readall (dc_buffer_t *buffer, dc_context_t *context, const char *filename)
+{
+	FILE *fp = NULL;
+
+	// Open the file.
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	// Read the entire file into the buffer.
+	size_t n = 0;
+	unsigned char block[4096] = {0};
+	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (buffer, block, n)) {
+			ERROR (context, "Insufficient buffer space available.");
+			fclose (fp);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	if (ferror (fp)) {
+		ERROR (context, "Failed to read the file.");
+		fclose (fp);
+		return DC_STATUS_IO;
+	}
+
+	// Close the file.
+	fclose (fp);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -1058,10 +1188,8 @@ static dc_status_t
 hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *context, const char *filename)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	FILE *fp = NULL;
+	dc_buffer_t *buffer = NULL;
 	unsigned char iv[16] = {0};
-	unsigned char tmpbuf[16] = {0};
-	unsigned char encrypted[16] = {0};
 	unsigned int bytes = 0, addr = 0;
 	unsigned char checksum[4];
 
@@ -1074,48 +1202,53 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 	memset (firmware->data, 0xFF, sizeof (firmware->data));
 	firmware->checksum = 0;
 
-	fp = fopen (filename, "rb");
-	if (fp == NULL) {
-		ERROR (context, "Failed to open the file.");
-		return DC_STATUS_IO;
+	// The entire file is read into memory, and parsed from there in a
+	// single pass, without any further small reads.
+	buffer = dc_buffer_new2 (context, 0);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
 	}
 
-	rc = hw_ostc3_firmware_readline (fp, context, 0, iv, sizeof(iv));
+	rc = hw_ostc3_firmware_readall (buffer, context, filename);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (buffer);
+		return rc;
+	}
+
+	const unsigned char *data = dc_buffer_get_data (buffer);
+	size_t size = dc_buffer_get_size (buffer);
+	size_t offset = 0;
+
+	rc = hw_ostc3_firmware_readline (data, size, &offset, context, 0, iv, sizeof(iv));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to parse header.");
-		fclose (fp);
+		dc_buffer_free (buffer);
 		return rc;
 	}
 	bytes += 16;
 
-	// Load the iv for AES-FCB-mode
-	AES128_ECB_encrypt (iv, ostc3_key, tmpbuf);
-
 	for (addr = 0; addr < SZ_FIRMWARE; addr += 16, bytes += 16) {
-		rc = hw_ostc3_firmware_readline (fp, context, bytes, encrypted, sizeof(encrypted));
+		rc = hw_ostc3_firmware_readline (data, size, &offset, context, bytes, firmware->data + addr, 16);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (context, "Failed to parse file data.");
-			fclose (fp);
+			dc_buffer_free (buffer);
 			return rc;
 		}
-
-		// Decrypt AES-FCB data
-		for (unsigned int i = 0; i < 16; i++)
-			firmware->data[addr + i] = encrypted[i] ^ tmpbuf[i];
-
-		// Run the next round of encryption
-		AES128_ECB_encrypt (encrypted, ostc3_key, tmpbuf);
 	}
 
+	// Decrypt the AES-CFB data in place.
+	AES128_CFB_decrypt_buffer (firmware->data, firmware->data, SZ_FIRMWARE, ostc3_key, iv, dc_context_get_cpufeatures (context));
+
 	// This file format contains a tail with the checksum in
-	rc = hw_ostc3_firmware_readline (fp, context, bytes, checksum, sizeof(checksum));
+	rc = hw_ostc3_firmware_readline (data, size, &offset, context, bytes, checksum, sizeof(checksum));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to parse file tail.");
-		fclose (fp);
+		dc_buffer_free (buffer);
 		return rc;
 	}
 
-	fclose (fp);
+	dc_buffer_free (buffer);
 
 	unsigned int csum1 = array_uint32_le (checksum);
 	unsigned int csum2 = hw_ostc3_firmware_checksum (firmware->data, sizeof(firmware->data));
@@ -1132,33 +1265,15 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 static dc_status_t
 hw_ostc3_firmware_readfile4 (dc_buffer_t *buffer, dc_context_t *context, const char *filename)
 {
-	FILE *fp = NULL;
-
 	if (buffer == NULL) {
 		ERROR (context, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	// Open the file.
-	fp = fopen (filename, "rb");
-	if (fp == NULL) {
-		ERROR (context, "Failed to open the file.");
-		return DC_STATUS_IO;
-	}
-
 	// Read the entire file into the buffer.
-	size_t n = 0;
-	unsigned char block[1024] = {0};
-	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
-		if (!dc_buffer_append (buffer, block, n)) {
-			ERROR (context, "Insufficient buffer space available.");
-			fclose (fp);
-			return DC_STATUS_NOMEMORY;
-		}
-	}
-
-	// Close the file.
-	fclose (fp);
+	dc_status_t rc = hw_ostc3_firmware_readall (buffer, context, filename);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	// Verify the minimum size.
 	size_t size = dc_buffer_get_size (buffer);
@@ -1259,9 +1374,9 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
 	// Enable progress notifications.
-	// load, erase, upload FZ, verify FZ, reprogram
+	// load, compare/upload/verify every block, reprogram
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = 3 + SZ_FIRMWARE * 2 / SZ_FIRMWARE_BLOCK;
+	progress.maximum = 2 + SZ_FIRMWARE * 3 / SZ_FIRMWARE_BLOCK;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Allocate memory for the firmware data.
@@ -1282,60 +1397,101 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	progress.current++;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	hw_ostc3_device_display (abstract, " Erasing FW...");
+	// The firmware area usually still contains the image of a previous
+	// update. Only the blocks that differ from the new image are erased
+	// and uploaded again. For a point release, that's typically only a
+	// handful of blocks, instead of the entire image.
+	unsigned char changed[SZ_FIRMWARE / SZ_FIRMWARE_BLOCK] = {0};
+	unsigned int nchanged = 0;
 
-	rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA, SZ_FIRMWARE);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to erase old firmware");
-		free (firmware);
-		return rc;
-	}
+	hw_ostc3_device_display (abstract, " Comparing...");
 
-	// Memory erased
-	progress.current++;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
-	hw_ostc3_device_display (abstract, " Uploading...");
-
-	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
-		char status[SZ_DISPLAY + 1]; // Status message on the display
-		snprintf (status, sizeof(status), " Uploading %2d%%", (100 * len) / SZ_FIRMWARE);
-		hw_ostc3_device_display (abstract, status);
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(changed); ++i) {
+		unsigned char block[SZ_FIRMWARE_BLOCK];
+		unsigned int len = i * SZ_FIRMWARE_BLOCK;
 
-		rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, firmware->data + len, SZ_FIRMWARE_BLOCK);
+		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
 		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (context, "Failed to write block to device");
-			free(firmware);
+			ERROR (context, "Failed to read block.");
+			free (firmware);
 			return rc;
 		}
-		// One block uploaded
+
+		if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
+			changed[i] = 1;
+			nchanged++;
+		}
+
+		// One block compared
 		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
-	hw_ostc3_device_display (abstract, " Verifying...");
+	INFO (context, "Uploading %u of %u firmware blocks.",
+		nchanged, (unsigned int) C_ARRAY_SIZE(changed));
 
-	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
-		unsigned char block[SZ_FIRMWARE_BLOCK];
-		char status[SZ_DISPLAY + 1]; // Status message on the display
-		snprintf (status, sizeof(status), " Verifying %2d%%", (100 * len) / SZ_FIRMWARE);
-		hw_ostc3_device_display (abstract, status);
+	// The protocol is strictly request/response, so the transfers can't
+	// overlap. To minimize the number of round-trips, every consecutive
+	// run of changed blocks is erased with a single command, and each
+	// block is verified immediately after it's written, while it's still
+	// available in memory.
+	unsigned int i = 0;
+	while (i < C_ARRAY_SIZE(changed)) {
+		if (!changed[i]) {
+			// Skip the upload and verification.
+			progress.current += 2;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+			i++;
+			continue;
+		}
 
-		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
+		// Find the end of the run.
+		unsigned int n = i + 1;
+		while (n < C_ARRAY_SIZE(changed) && changed[n])
+			n++;
+
+		rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA + i * SZ_FIRMWARE_BLOCK, (n - i) * SZ_FIRMWARE_BLOCK);
 		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (context, "Failed to read block.");
+			ERROR (context, "Failed to erase old firmware");
 			free (firmware);
 			return rc;
 		}
-		if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
-			ERROR (context, "Failed verify.");
-			hw_ostc3_device_display (abstract, " Verify FAILED");
-			free (firmware);
-			return DC_STATUS_PROTOCOL;
+
+		for (; i < n; ++i) {
+			unsigned char block[SZ_FIRMWARE_BLOCK];
+			unsigned int len = i * SZ_FIRMWARE_BLOCK;
+			char status[SZ_DISPLAY + 1]; // Status message on the display
+			snprintf (status, sizeof(status), " Uploading %2d%%", (100 * len) / SZ_FIRMWARE);
+			hw_ostc3_device_display (abstract, status);
+
+			rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, firmware->data + len, SZ_FIRMWARE_BLOCK);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to write block to device");
+				free(firmware);
+				return rc;
+			}
+
+			// One block uploaded
+			progress.current++;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+			rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to read block.");
+				free (firmware);
+				return rc;
+			}
+			if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
+				ERROR (context, "Failed verify.");
+				hw_ostc3_device_display (abstract, " Verify FAILED");
+				free (firmware);
+				return DC_STATUS_PROTOCOL;
+			}
+
+			// One block verified
+			progress.current++;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 		}
-		// One block verified
-		progress.current++;
-		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
 	hw_ostc3_device_display (abstract, " Programming...");
@@ -1365,7 +1521,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
 	// Allocate memory for the firmware data.
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		status = DC_STATUS_NOMEMORY;
@@ -1578,7 +1734,10 @@ hw_ostc3_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 	unsigned char *data = dc_buffer_get_data (buffer);
 
-	unsigned int nbytes = 0;
+	// Resume from the checkpoint.
+	unsigned int nbytes = device_checkpoint_resume (abstract, data, SZ_MEMORY, SZ_FIRMWARE_BLOCK);
+	progress.current = nbytes;
+
 	while (nbytes < SZ_MEMORY) {
 		// packet size. Can be almost arbetary size.
 		unsigned int len = SZ_FIRMWARE_BLOCK;
@@ -1590,11 +1749,20 @@ hw_ostc3_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			return rc;
 		}
 
+		// Start over if the memory changed since the checkpoint.
+		if (!device_checkpoint_verify (abstract, nbytes, data + nbytes, len)) {
+			nbytes = 0;
+			progress.current = 0;
+			continue;
+		}
+
 		// Update and emit a progress event.
 		progress.current += len;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 		nbytes += len;
+
+		device_checkpoint_emit (abstract, data, nbytes);
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -120,6 +120,8 @@ typedef struct hw_ostc_parser_t {
 	unsigned int initial_setpoint;
 	unsigned int initial_cns;
 	hw_ostc_gasmix_t gasmix[NGASMIXES];
+	unsigned int nconfig;
+	hw_ostc_sample_info_t info[MAXCONFIG];
 } hw_ostc_parser_t;
 
 static dc_status_t hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -134,6 +136,9 @@ static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	hw_ostc_parser_get_datetime, /* datetime */
 	hw_ostc_parser_get_field, /* fields */
 	hw_ostc_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -313,6 +318,32 @@ hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 		WARNING(abstract->context, "No initial gas mix available.");
 	}
 
+	// Get the extended sample configuration. The descriptors are only
+	// decoded here, and validated when the profile is parsed, because a
+	// dive without profile data may have an incomplete configuration.
+	unsigned int nconfig = 0;
+	hw_ostc_sample_info_t info[MAXCONFIG] = {{0}};
+	if (version == 0x23 || version == 0x24) {
+		if (size >= header + 5)
+			nconfig = data[header + 4];
+	} else {
+		nconfig = 6;
+	}
+	if (nconfig <= MAXCONFIG && ((version != 0x23 && version != 0x24) ||
+		size >= header + 5 + 3 * nconfig)) {
+		for (unsigned int i = 0; i < nconfig; ++i) {
+			if (version == 0x23 || version == 0x24) {
+				info[i].type    = data[header + 5 + 3 * i + 0];
+				info[i].size    = data[header + 5 + 3 * i + 1];
+				info[i].divisor = data[header + 5 + 3 * i + 2];
+			} else {
+				info[i].type    = i;
+				info[i].divisor = (data[37 + i] & 0x0F);
+				info[i].size    = (data[37 + i] & 0xF0) >> 4;
+			}
+		}
+	}
+
 	// Cache the data for later use.
 	parser->version = version;
 	parser->header = header;
@@ -325,6 +356,10 @@ hw_ostc_parser_cache (hw_ostc_parser_t *parser)
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->gasmix[i] = gasmix[i];
 	}
+	parser->nconfig = nconfig;
+	for (unsigned int i = 0; i < MAXCONFIG; ++i) {
+		parser->info[i] = info[i];
+	}
 	parser->cached = HEADER;
 
 	return DC_STATUS_SUCCESS;
@@ -480,8 +515,9 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
+	// Cache the profile data. Only the gas mixes depend on the
+	// profile, because of the manual gas mixes and bailout events.
+	if (parser->cached < PROFILE && (type == DC_FIELD_GASMIX_COUNT || type == DC_FIELD_GASMIX)) {
 		rc = hw_ostc_parser_samples_foreach (abstract, NULL, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -694,7 +730,8 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 	// Exit if no profile data available.
 	if (size == header || (size == header + 2 &&
 		data[header] == 0xFD && data[header + 1] == 0xFD)) {
-		parser->cached = PROFILE;
+		if (parser->cached < PROFILE)
+			parser->cached = PROFILE;
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -722,11 +759,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 	double hydrostatic = GRAVITY * salinity * 10.0;
 
 	// Get the number of sample descriptors.
-	unsigned int nconfig = 0;
-	if (version == 0x23 || version == 0x24)
-		nconfig = data[header + 4];
-	else
-		nconfig = 6;
+	unsigned int nconfig = parser->nconfig;
 	if (nconfig > MAXCONFIG) {
 		ERROR(abstract->context, "Too many sample descriptors.");
 		return DC_STATUS_DATAFORMAT;
@@ -740,19 +773,9 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		}
 	}
 
-	// Get the extended sample configuration.
-	hw_ostc_sample_info_t info[MAXCONFIG] = {{0}};
+	// Check the extended sample configuration.
+	const hw_ostc_sample_info_t *info = parser->info;
 	for (unsigned int i = 0; i < nconfig; ++i) {
-		if (version == 0x23 || version == 0x24) {
-			info[i].type    = data[header + 5 + 3 * i + 0];
-			info[i].size    = data[header + 5 + 3 * i + 1];
-			info[i].divisor = data[header + 5 + 3 * i + 2];
-		} else {
-			info[i].type    = i;
-			info[i].divisor = (data[37 + i] & 0x0F);
-			info[i].size    = (data[37 + i] & 0xF0) >> 4;
-		}
-
 		if (info[i].divisor) {
 			switch (info[i].type) {
 			case 0: // Temperature
@@ -789,8 +812,14 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		firmware = array_uint16_be (data + layout->firmware);
 	}
 
+	// Count down the samples until the next occurrence of each
+	// extended sample, instead of a division for every sample.
+	unsigned int countdown[MAXCONFIG] = {0};
+	for (unsigned int i = 0; i < nconfig; ++i) {
+		countdown[i] = info[i].divisor;
+	}
+
 	unsigned int time = 0;
-	unsigned int nsamples = 0;
 	unsigned int tank = parser->initial != UNDEFINED ? parser->initial : 0;
 
 	unsigned int offset = header;
@@ -799,8 +828,6 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 	while (offset + 3 <= size) {
 		dc_sample_value_t sample = {0};
 
-		nsamples++;
-
 		// Time (seconds).
 		time += samplerate;
 		sample.time = time;
@@ -974,7 +1001,8 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 
 		// Extended sample info.
 		for (unsigned int i = 0; i < nconfig; ++i) {
-			if (info[i].divisor && (nsamples % info[i].divisor) == 0) {
+			if (info[i].divisor && --countdown[i] == 0) {
+				countdown[i] = info[i].divisor;
 				if (length < info[i].size) {
 					ERROR (abstract->context, "Buffer overflow detected!");
 					return DC_STATUS_DATAFORMAT;
@@ -1095,7 +1123,10 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	parser->cached = PROFILE;
+	// Once the profile is cached, the parser state is only read, such
+	// that a prepared parser can be shared.
+	if (parser->cached < PROFILE)
+		parser->cached = PROFILE;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -29,9 +29,17 @@
 #include "checksum.h"
 #include "array.h"
 
+#include <libdivecomputer/buffer.h>
+
+/*
+ * The entire file is loaded into memory when it's opened, and all
+ * records are parsed directly from there. Firmware files are small
+ * enough, and this avoids many tiny reads through the stdio layer.
+ */
 struct dc_ihex_file_t {
 	dc_context_t *context;
-	FILE *fp;
+	dc_buffer_t *buffer;
+	size_t offset;
 };
 
 dc_status_t
@@ -51,14 +59,46 @@ dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *f
 	}
 
 	file->context = context;
+	file->offset = 0;
+
+	file->buffer = dc_buffer_new (0);
+	if (file->buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		free (file);
+		return DC_STATUS_NOMEMORY;
+	}
 
-	file->fp = fopen (filename, "rb");
-	if (file->fp == NULL) {
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
 		ERROR (context, "Failed to open the file.");
+		dc_buffer_free (file->buffer);
 		free (file);
 		return DC_STATUS_IO;
 	}
 
+	// Read the entire file into the buffer.
+	size_t n = 0;
+	unsigned char block[4096];
+	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (file->buffer, block, n)) {
+			ERROR (context, "Insufficient buffer space available.");
+			fclose (fp);
+			dc_buffer_free (file->buffer);
+			free (file);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	if (ferror (fp)) {
+		ERROR (context, "Failed to read the file.");
+		fclose (fp);
+		dc_buffer_free (file->buffer);
+		free (file);
+		return DC_STATUS_IO;
+	}
+
+	fclose (fp);
+
 	*result = file;
 
 	return DC_STATUS_SUCCESS;
@@ -67,68 +107,70 @@ dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *f
 dc_status_t
 dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 {
-	unsigned char ascii[9 + 2 * 255 + 2] = {0};
 	unsigned char data[4 + 255 + 1] = {0};
 	unsigned int type, length, address;
 	unsigned char csum_a, csum_b;
-	size_t n;
 
 	if (file == NULL || entry == NULL) {
 		ERROR (file ? file->context : NULL, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	/* Read the start code. */
+	const unsigned char *ascii = dc_buffer_get_data (file->buffer);
+	size_t size = dc_buffer_get_size (file->buffer);
+	size_t offset = file->offset;
+
+	/* Find the start code. */
 	while (1) {
-		n = fread (ascii, 1, 1, file->fp);
-		if (n != 1) {
-			if (feof (file->fp)) {
-				return DC_STATUS_DONE;
-			} else {
-				ERROR (file->context, "Failed to read the start code.");
-				return DC_STATUS_IO;
-			}
-		}
+		if (offset >= size)
+			return DC_STATUS_DONE;
 
-		if (ascii[0] == ':')
+		if (ascii[offset] == ':')
 			break;
 
 		/* Ignore CR and LF characters. */
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (file->context, "Unexpected character (0x%02x).", ascii[0]);
+		if (ascii[offset] != '\n' && ascii[offset] != '\r') {
+			ERROR (file->context, "Unexpected character (0x%02x).", ascii[offset]);
 			return DC_STATUS_DATAFORMAT;
 		}
+
+		offset++;
 	}
 
-	/* Read the record length, address and type. */
-	n = fread (ascii + 1, 1, 8, file->fp);
-	if (n != 8) {
+	/* Skip the start code. */
+	offset++;
+
+	/* Check the record length, address and type. */
+	if (size - offset < 8) {
 		ERROR (file->context, "Failed to read the header.");
 		return DC_STATUS_IO;
 	}
 
 	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 1, 8, data, 4) != 0) {
+	if (array_convert_hex2bin (ascii + offset, 8, data, 4) != 0) {
 		ERROR (file->context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	offset += 8;
+
 	/* Get the record length. */
 	length = data[0];
 
-	/* Read the record payload. */
-	n = fread (ascii + 9, 1, 2 * length + 2, file->fp);
-	if (n != 2 * length + 2) {
+	/* Check the record payload. */
+	if (size - offset < 2 * length + 2) {
 		ERROR (file->context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
 	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 9, 2 * length + 2, data + 4, length + 1) != 0) {
+	if (array_convert_hex2bin (ascii + offset, 2 * length + 2, data + 4, length + 1) != 0) {
 		ERROR (file->context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	offset += 2 * length + 2;
+
 	/* Verify the checksum. */
 	csum_a = data[4 + length];
 	csum_b = ~checksum_add_uint8 (data, 4 + length, 0x00) + 1;
@@ -169,6 +211,9 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 		}
 	}
 
+	/* Advance to the next record. */
+	file->offset = offset;
+
 	/* Set the record fields. */
 	entry->type = type;
 	entry->address = address;
@@ -189,7 +234,7 @@ dc_ihex_file_reset (dc_ihex_file_t *file)
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	rewind (file->fp);
+	file->offset = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -198,7 +243,7 @@ dc_status_t
 dc_ihex_file_close (dc_ihex_file_t *file)
 {
 	if (file) {
-		fclose (file->fp);
+		dc_buffer_free (file->buffer);
 		free (file);
 	}
 
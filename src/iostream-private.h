@@ -25,6 +25,9 @@
 #include <libdivecomputer/common.h>
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/iostream.h>
+#include <libdivecomputer/device.h>
+
+#include "timer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +38,21 @@ typedef struct dc_iostream_vtable_t dc_iostream_vtable_t;
 struct dc_iostream_t {
 	const dc_iostream_vtable_t *vtable;
 	dc_context_t *context;
+	// Transport statistics.
+	dc_event_stats_t stats;
+	dc_usecs_t written;
+	int pending;
+	// Time of the most recently received data.
+	dc_usecs_t received;
+	int received_valid;
+	// Round trip time estimator (in microseconds).
+	dc_usecs_t srtt;
+	dc_usecs_t rttvar;
+	unsigned int rtt_valid;
+	unsigned int rtt_backoff;
+	unsigned int rtt_skip;
+	// Cancellation request, set from another thread.
+	volatile int cancelled;
 };
 
 struct dc_iostream_vtable_t {
@@ -54,12 +72,18 @@ struct dc_iostream_vtable_t {
 
 	dc_status_t (*get_available) (dc_iostream_t *iostream, size_t *value);
 
+	dc_status_t (*poll) (dc_iostream_t *iostream, int timeout);
+
 	dc_status_t (*configure) (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
 
 	dc_status_t (*read) (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 
 	dc_status_t (*write) (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+	dc_status_t (*readv) (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
+	dc_status_t (*writev) (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
 	dc_status_t (*flush) (dc_iostream_t *iostream);
 
 	dc_status_t (*purge) (dc_iostream_t *iostream, dc_direction_t direction);
@@ -67,6 +91,8 @@ struct dc_iostream_vtable_t {
 	dc_status_t (*sleep) (dc_iostream_t *iostream, unsigned int milliseconds);
 
 	dc_status_t (*close) (dc_iostream_t *iostream);
+
+	dc_status_t (*cancel) (dc_iostream_t *iostream);
 };
 
 dc_iostream_t *
@@ -78,6 +104,40 @@ dc_iostream_deallocate (dc_iostream_t *iostream);
 int
 dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vtable);
 
+/*
+ * Get the transport statistics. Only the counters that are known at the
+ * I/O stream level are filled in, the others are zero.
+ */
+void
+dc_iostream_get_stats (dc_iostream_t *iostream, dc_event_stats_t *stats);
+
+/*
+ * Get a retransmission timeout (in milliseconds) derived from the
+ * measured round trip times. The smoothed round trip time and its
+ * variance are estimated as in TCP (RFC 6298), from the round trips
+ * that are already timed for the statistics. The timeout is doubled
+ * after every read that timed out waiting for a response, until the
+ * next valid measurement, and clamped between the minimum and maximum.
+ * Without any measurement yet, the maximum is returned.
+ */
+int
+dc_iostream_get_rto (dc_iostream_t *iostream, int minimum, int maximum);
+
+/*
+ * Get the time (in milliseconds) since data was last received, or -1
+ * if nothing was received yet. The backends can use it to skip a
+ * keepalive command when the device has just answered another command.
+ */
+int
+dc_iostream_get_idle (dc_iostream_t *iostream);
+
+/*
+ * Advance the position (index and offset) in the array of buffers with
+ * the given number of bytes. Empty buffers are skipped.
+ */
+void
+dc_iovec_advance (const dc_iovec_t iov[], size_t count, size_t *index, size_t *offset, size_t nbytes);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
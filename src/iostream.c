@@ -21,10 +21,36 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "iostream-private.h"
 #include "context-private.h"
+#include "probe.h"
+
+// Size of the buffer for the emulated gather writes.
+#define GATHERSIZE 256
+
+// Clock granularity of the round trip time estimator (in microseconds).
+#define RTT_GRANULARITY 1000
+
+// Maximum number of timeout doublings.
+#define RTT_MAXBACKOFF  6
+
+/*
+ * An interrupted call fails with whatever error the transport reports
+ * (typically a timeout or an I/O error), which is replaced with the
+ * cancellation status.
+ */
+static dc_status_t
+dc_iostream_check_cancelled (dc_iostream_t *iostream, dc_status_t status)
+{
+	if (status != DC_STATUS_SUCCESS && iostream->cancelled)
+		return DC_STATUS_CANCELLED;
+
+	return status;
+}
 
 dc_iostream_t *
 dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable)
@@ -35,7 +61,7 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_iostream_t));
 
 	// Allocate memory.
-	iostream = (dc_iostream_t *) malloc (vtable->size);
+	iostream = (dc_iostream_t *) dc_context_alloc (context, vtable->size);
 	if (iostream == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return iostream;
@@ -45,13 +71,31 @@ dc_iostream_allocate (dc_context_t *context, const dc_iostream_vtable_t *vtable)
 	iostream->vtable = vtable;
 	iostream->context = context;
 
+	// The round trip times are measured with the clock of the context.
+	memset (&iostream->stats, 0, sizeof (iostream->stats));
+	iostream->written = 0;
+	iostream->pending = 0;
+	iostream->received = 0;
+	iostream->received_valid = 0;
+
+	iostream->srtt = 0;
+	iostream->rttvar = 0;
+	iostream->rtt_valid = 0;
+	iostream->rtt_backoff = 0;
+	iostream->rtt_skip = 0;
+
+	iostream->cancelled = 0;
+
 	return iostream;
 }
 
 void
 dc_iostream_deallocate (dc_iostream_t *iostream)
 {
-	free (iostream);
+	if (iostream == NULL)
+		return;
+
+	dc_context_release (iostream->context, iostream);
 }
 
 int
@@ -63,6 +107,127 @@ dc_iostream_isinstance (dc_iostream_t *iostream, const dc_iostream_vtable_t *vta
 	return iostream->vtable == vtable;
 }
 
+void
+dc_iostream_get_stats (dc_iostream_t *iostream, dc_event_stats_t *stats)
+{
+	if (iostream == NULL) {
+		memset (stats, 0, sizeof (*stats));
+		return;
+	}
+
+	*stats = iostream->stats;
+}
+
+int
+dc_iostream_get_rto (dc_iostream_t *iostream, int minimum, int maximum)
+{
+	if (iostream == NULL || !iostream->rtt_valid)
+		return maximum;
+
+	// The variance term is at least the clock granularity.
+	dc_usecs_t variance = 4 * iostream->rttvar;
+	if (variance < RTT_GRANULARITY)
+		variance = RTT_GRANULARITY;
+
+	dc_usecs_t rto = ((iostream->srtt + variance) << iostream->rtt_backoff) / 1000;
+	if (rto > (dc_usecs_t) maximum)
+		return maximum;
+	if (rto < (dc_usecs_t) minimum)
+		return minimum;
+
+	return rto;
+}
+
+int
+dc_iostream_get_idle (dc_iostream_t *iostream)
+{
+	dc_usecs_t now = 0;
+
+	if (iostream == NULL || !iostream->received_valid ||
+		dc_context_clock (iostream->context, 0, &now) != DC_STATUS_SUCCESS)
+		return -1;
+
+	dc_usecs_t msecs = (now - iostream->received) / 1000;
+	if (msecs > INT_MAX)
+		return INT_MAX;
+
+	return msecs;
+}
+
+static void
+dc_iostream_rtt_update (dc_iostream_t *iostream, dc_usecs_t rtt)
+{
+	// After a timeout, the response may belong to either the original
+	// request or its retransmission. Such an ambiguous round trip is
+	// not used for the estimate (Karn's algorithm).
+	if (iostream->rtt_skip) {
+		iostream->rtt_skip = 0;
+		return;
+	}
+
+	if (!iostream->rtt_valid) {
+		iostream->srtt = rtt;
+		iostream->rttvar = rtt / 2;
+		iostream->rtt_valid = 1;
+	} else {
+		dc_usecs_t delta = iostream->srtt > rtt ?
+			iostream->srtt - rtt : rtt - iostream->srtt;
+		iostream->rttvar = (3 * iostream->rttvar + delta) / 4;
+		iostream->srtt = (7 * iostream->srtt + rtt) / 8;
+	}
+
+	iostream->rtt_backoff = 0;
+}
+
+static void
+dc_iostream_stats_read (dc_iostream_t *iostream, dc_status_t status, size_t nbytes)
+{
+	dc_usecs_t now = 0;
+
+	iostream->stats.reads++;
+	iostream->stats.bytes_in += nbytes;
+	if (status == DC_STATUS_TIMEOUT) {
+		iostream->stats.timeouts++;
+
+		// No response at all, most likely a lost packet.
+		if (iostream->pending && nbytes == 0) {
+			if (iostream->rtt_backoff < RTT_MAXBACKOFF)
+				iostream->rtt_backoff++;
+			iostream->rtt_skip = 1;
+		}
+	}
+
+	if (nbytes == 0 || dc_context_clock (iostream->context, 0, &now) != DC_STATUS_SUCCESS)
+		return;
+
+	iostream->received = now;
+	iostream->received_valid = 1;
+
+	// The first data after a write completes the round trip.
+	if (iostream->pending) {
+		dc_usecs_t msecs = (now - iostream->written) / 1000;
+		unsigned int i = 0;
+		while (i < DC_EVENT_STATS_NBUCKETS - 1 && msecs >= (1U << i))
+			i++;
+		iostream->stats.rtt[i]++;
+		iostream->pending = 0;
+
+		dc_iostream_rtt_update (iostream, now - iostream->written);
+	}
+}
+
+static void
+dc_iostream_stats_write (dc_iostream_t *iostream, dc_status_t status, size_t nbytes)
+{
+	iostream->stats.writes++;
+	iostream->stats.bytes_out += nbytes;
+	if (status == DC_STATUS_TIMEOUT)
+		iostream->stats.timeouts++;
+
+	if (dc_context_clock (iostream->context, 0, &iostream->written) == DC_STATUS_SUCCESS)
+		iostream->pending = 1;
+}
+
 dc_status_t
 dc_iostream_set_timeout (dc_iostream_t *iostream, int timeout)
 {
@@ -136,6 +301,18 @@ dc_iostream_get_available (dc_iostream_t *iostream, size_t *value)
 	return iostream->vtable->get_available (iostream, value);
 }
 
+dc_status_t
+dc_iostream_poll (dc_iostream_t *iostream, int timeout)
+{
+	if (iostream == NULL || iostream->vtable->poll == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (iostream->cancelled)
+		return DC_STATUS_CANCELLED;
+
+	return dc_iostream_check_cancelled (iostream, iostream->vtable->poll (iostream, timeout));
+}
+
 dc_status_t
 dc_iostream_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
@@ -159,7 +336,20 @@ dc_iostream_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actu
 		goto out;
 	}
 
-	status = iostream->vtable->read (iostream, data, size, &nbytes);
+	if (iostream->cancelled) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	dc_usecs_t begin = dc_context_trace_begin (iostream->context);
+	DC_PROBE2 (iostream__read__entry, iostream, size);
+
+	status = dc_iostream_check_cancelled (iostream, iostream->vtable->read (iostream, data, size, &nbytes));
+
+	DC_PROBE3 (iostream__read__return, iostream, nbytes, status);
+	dc_context_trace_end (iostream->context, "dc_iostream_read", begin);
+
+	dc_iostream_stats_read (iostream, status, nbytes);
 
 	HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
 
@@ -181,7 +371,20 @@ dc_iostream_write (dc_iostream_t *iostream, const void *data, size_t size, size_
 		goto out;
 	}
 
-	status = iostream->vtable->write (iostream, data, size, &nbytes);
+	if (iostream->cancelled) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	dc_usecs_t begin = dc_context_trace_begin (iostream->context);
+	DC_PROBE2 (iostream__write__entry, iostream, size);
+
+	status = dc_iostream_check_cancelled (iostream, iostream->vtable->write (iostream, data, size, &nbytes));
+
+	DC_PROBE3 (iostream__write__return, iostream, nbytes, status);
+	dc_context_trace_end (iostream->context, "dc_iostream_write", begin);
+
+	dc_iostream_stats_write (iostream, status, nbytes);
 
 	HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
 
@@ -192,6 +395,154 @@ out:
 	return status;
 }
 
+void
+dc_iovec_advance (const dc_iovec_t iov[], size_t count, size_t *index, size_t *offset, size_t nbytes)
+{
+	size_t i = *index, n = *offset + nbytes;
+
+	while (i < count && n >= iov[i].size) {
+		n -= iov[i].size;
+		i++;
+	}
+
+	*index = i;
+	*offset = (i < count ? n : 0);
+}
+
+dc_status_t
+dc_iostream_readv (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	if (iostream == NULL || iostream->vtable->read == NULL) {
+		status = DC_STATUS_UNSUPPORTED;
+		goto out;
+	}
+
+	if (iostream->cancelled) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	dc_usecs_t begin = dc_context_trace_begin (iostream->context);
+	DC_PROBE2 (iostream__readv__entry, iostream, count);
+
+	if (iostream->vtable->readv) {
+		status = iostream->vtable->readv (iostream, iov, count, &nbytes);
+	} else {
+		// Emulate with one read per buffer.
+		for (size_t i = 0; i < count; ++i) {
+			size_t n = 0;
+			status = iostream->vtable->read (iostream, iov[i].data, iov[i].size, &n);
+			nbytes += n;
+			if (status != DC_STATUS_SUCCESS || n != iov[i].size)
+				break;
+		}
+	}
+
+	status = dc_iostream_check_cancelled (iostream, status);
+
+	DC_PROBE3 (iostream__readv__return, iostream, nbytes, status);
+	dc_context_trace_end (iostream->context, "dc_iostream_readv", begin);
+
+	dc_iostream_stats_read (iostream, status, nbytes);
+
+	// Log the data, buffer by buffer.
+	size_t remaining = nbytes;
+	for (size_t i = 0; i < count && remaining; ++i) {
+		size_t n = (iov[i].size < remaining ? iov[i].size : remaining);
+		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Read", (const unsigned char *) iov[i].data, n);
+		remaining -= n;
+	}
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+dc_status_t
+dc_iostream_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	if (iostream == NULL || iostream->vtable->write == NULL) {
+		status = DC_STATUS_UNSUPPORTED;
+		goto out;
+	}
+
+	if (iostream->cancelled) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	dc_usecs_t begin = dc_context_trace_begin (iostream->context);
+	DC_PROBE2 (iostream__writev__entry, iostream, count);
+
+	if (iostream->vtable->writev) {
+		status = iostream->vtable->writev (iostream, iov, count, &nbytes);
+	} else {
+		// Emulate by gathering the small buffers into a local buffer,
+		// and writing the large buffers directly.
+		unsigned char buffer[GATHERSIZE];
+		size_t buffered = 0;
+		for (size_t i = 0; i <= count; ++i) {
+			int last = (i == count);
+			if (!last && buffered + iov[i].size <= sizeof (buffer)) {
+				memcpy (buffer + buffered, iov[i].data, iov[i].size);
+				buffered += iov[i].size;
+				continue;
+			}
+
+			size_t n = 0;
+			if (buffered) {
+				status = iostream->vtable->write (iostream, buffer, buffered, &n);
+				nbytes += n;
+				if (status != DC_STATUS_SUCCESS || n != buffered)
+					break;
+				buffered = 0;
+			}
+
+			if (last)
+				break;
+
+			if (iov[i].size > sizeof (buffer)) {
+				status = iostream->vtable->write (iostream, iov[i].data, iov[i].size, &n);
+				nbytes += n;
+				if (status != DC_STATUS_SUCCESS || n != iov[i].size)
+					break;
+			} else {
+				memcpy (buffer, iov[i].data, iov[i].size);
+				buffered = iov[i].size;
+			}
+		}
+	}
+
+	status = dc_iostream_check_cancelled (iostream, status);
+
+	DC_PROBE3 (iostream__writev__return, iostream, nbytes, status);
+	dc_context_trace_end (iostream->context, "dc_iostream_writev", begin);
+
+	dc_iostream_stats_write (iostream, status, nbytes);
+
+	// Log the data, buffer by buffer.
+	size_t remaining = nbytes;
+	for (size_t i = 0; i < count && remaining; ++i) {
+		size_t n = (iov[i].size < remaining ? iov[i].size : remaining);
+		HEXDUMP (iostream->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) iov[i].data, n);
+		remaining -= n;
+	}
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
 dc_status_t
 dc_iostream_flush (dc_iostream_t *iostream)
 {
@@ -222,7 +573,26 @@ dc_iostream_sleep (dc_iostream_t *iostream, unsigned int milliseconds)
 
 	INFO (iostream->context, "Sleep: value=%u", milliseconds);
 
-	return iostream->vtable->sleep (iostream, milliseconds);
+	if (iostream->cancelled)
+		return DC_STATUS_CANCELLED;
+
+	return dc_iostream_check_cancelled (iostream, iostream->vtable->sleep (iostream, milliseconds));
+}
+
+dc_status_t
+dc_iostream_cancel (dc_iostream_t *iostream)
+{
+	if (iostream == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	INFO (iostream->context, "Cancel");
+
+	iostream->cancelled = 1;
+
+	if (iostream->vtable->cancel == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return iostream->vtable->cancel (iostream);
 }
 
 dc_status_t
@@ -233,6 +603,8 @@ dc_iostream_close (dc_iostream_t *iostream)
 	if (iostream == NULL)
 		return DC_STATUS_SUCCESS;
 
+	dc_context_notify_iostream (iostream->context, iostream, 0);
+
 	if (iostream->vtable->close) {
 		status = iostream->vtable->close (iostream);
 	}
@@ -27,6 +27,8 @@
 #include <stdio.h>	// snprintf
 #include <string.h>
 
+#include <libdivecomputer/datetime.h>
+
 #include "socket.h"
 
 #ifdef _WIN32
@@ -51,12 +53,17 @@
 #include "descriptor-private.h"
 #include "array.h"
 #include "platform.h"
+#include "thread.h"
 
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_irda_vtable)
 
 #define DISCOVER_MAX_DEVICES 16	// Maximum number of devices.
 #define DISCOVER_MAX_RETRIES 4	// Maximum number of retries.
 
+#define NCACHE        DISCOVER_MAX_DEVICES
+#define DISCOVERY_TTL 0
+#define CONNECT_TTL   3600
+
 #ifdef _WIN32
 #define DISCOVER_BUFSIZE sizeof (DEVICELIST) + \
 				sizeof (IRDA_DEVICE_INFO) * (DISCOVER_MAX_DEVICES - 1)
@@ -72,6 +79,19 @@ struct dc_irda_device_t {
 	char name[22];
 };
 
+typedef struct dc_irda_cache_entry_t {
+	dc_irda_device_t device;
+	dc_ticks_t timestamp;
+} dc_irda_cache_entry_t;
+
+struct dc_irda_cache_t {
+	dc_mutex_t *mutex;
+	unsigned int discovery;
+	unsigned int connect;
+	dc_irda_cache_entry_t entries[NCACHE];
+	unsigned int count;
+};
+
 #ifdef IRDA
 static dc_status_t dc_irda_iterator_next (dc_iterator_t *iterator, void *item);
 
@@ -97,13 +117,17 @@ static const dc_iostream_vtable_t dc_irda_vtable = {
 	dc_socket_set_rts, /* set_rts */
 	dc_socket_get_lines, /* get_lines */
 	dc_socket_get_available, /* get_received */
+	dc_socket_poll, /* poll */
 	dc_socket_configure, /* configure */
 	dc_socket_read, /* read */
 	dc_socket_write, /* write */
+	NULL, /* readv */
+	dc_socket_writev, /* writev */
 	dc_socket_flush, /* flush */
 	dc_socket_purge, /* purge */
 	dc_socket_sleep, /* sleep */
 	dc_socket_close, /* close */
+	dc_socket_cancel, /* cancel */
 };
 #endif
 
@@ -131,6 +155,195 @@ dc_irda_device_free (dc_irda_device_t *device)
 	free (device);
 }
 
+dc_status_t
+dc_irda_cache_new (dc_irda_cache_t **out)
+{
+	dc_irda_cache_t *cache = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	cache = (dc_irda_cache_t *) malloc (sizeof (dc_irda_cache_t));
+	if (cache == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Without thread support, the mutex remains NULL.
+	cache->mutex = NULL;
+	dc_mutex_new (&cache->mutex);
+
+	cache->discovery = DISCOVERY_TTL;
+	cache->connect = CONNECT_TTL;
+	cache->count = 0;
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_irda_cache_free (dc_irda_cache_t *cache)
+{
+	if (cache == NULL)
+		return;
+
+	dc_mutex_free (cache->mutex);
+	free (cache);
+}
+
+static int
+dc_irda_cache_fresh (const dc_irda_cache_entry_t *entry, unsigned int ttl, dc_ticks_t now)
+{
+	return ttl && now - entry->timestamp < (dc_ticks_t) ttl;
+}
+
+static dc_irda_cache_entry_t *
+dc_irda_cache_find (dc_irda_cache_t *cache, unsigned int address)
+{
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (cache->entries[i].device.address == address)
+			return &cache->entries[i];
+	}
+
+	return NULL;
+}
+
+#ifdef IRDA
+static void
+dc_irda_cache_update (dc_context_t *context, const dc_irda_device_t *device, dc_ticks_t timestamp)
+{
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL)
+		return;
+
+	dc_mutex_lock (cache->mutex);
+
+	dc_irda_cache_entry_t *entry = dc_irda_cache_find (cache, device->address);
+	if (entry == NULL) {
+		if (cache->count < NCACHE) {
+			entry = &cache->entries[cache->count++];
+		} else {
+			// Replace the least recently seen device.
+			entry = &cache->entries[0];
+			for (unsigned int i = 1; i < cache->count; ++i) {
+				if (cache->entries[i].timestamp < entry->timestamp)
+					entry = &cache->entries[i];
+			}
+		}
+	}
+
+	entry->device = *device;
+	entry->timestamp = timestamp;
+
+	dc_mutex_unlock (cache->mutex);
+}
+
+static void
+dc_irda_cache_touch (dc_context_t *context, unsigned int address, dc_ticks_t timestamp)
+{
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL)
+		return;
+
+	dc_mutex_lock (cache->mutex);
+	dc_irda_cache_entry_t *entry = dc_irda_cache_find (cache, address);
+	if (entry && entry->timestamp < timestamp)
+		entry->timestamp = timestamp;
+	dc_mutex_unlock (cache->mutex);
+}
+
+static unsigned int
+dc_irda_cache_snapshot (dc_context_t *context, dc_irda_device_t devices[])
+{
+	unsigned int count = 0;
+
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL)
+		return 0;
+
+	dc_ticks_t now = dc_datetime_now ();
+
+	dc_mutex_lock (cache->mutex);
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		if (dc_irda_cache_fresh (&cache->entries[i], cache->discovery, now))
+			devices[count++] = cache->entries[i].device;
+	}
+	dc_mutex_unlock (cache->mutex);
+
+	return count;
+}
+#endif
+
+dc_status_t
+dc_irda_cache_set_ttl (dc_context_t *context, unsigned int discovery, unsigned int connect)
+{
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (cache->mutex);
+	cache->discovery = discovery;
+	cache->connect = connect;
+	dc_mutex_unlock (cache->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+dc_irda_cache_lookup (dc_context_t *context, dc_irda_match_t match)
+{
+	unsigned int address = 0;
+	dc_ticks_t timestamp = 0;
+
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL || match == NULL)
+		return 0;
+
+	dc_ticks_t now = dc_datetime_now ();
+
+	// Pick the most recently seen device with a matching name.
+	dc_mutex_lock (cache->mutex);
+	for (unsigned int i = 0; i < cache->count; ++i) {
+		const dc_irda_cache_entry_t *entry = &cache->entries[i];
+		if (dc_irda_cache_fresh (entry, cache->connect, now) &&
+			entry->timestamp >= timestamp &&
+			match (entry->device.name[0] ? entry->device.name : NULL)) {
+			address = entry->device.address;
+			timestamp = entry->timestamp;
+		}
+	}
+	dc_mutex_unlock (cache->mutex);
+
+	return address;
+}
+
+void
+dc_irda_cache_invalidate (dc_context_t *context, unsigned int address)
+{
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL)
+		return;
+
+	dc_mutex_lock (cache->mutex);
+	dc_irda_cache_entry_t *entry = dc_irda_cache_find (cache, address);
+	if (entry)
+		*entry = cache->entries[--cache->count];
+	dc_mutex_unlock (cache->mutex);
+}
+
+dc_status_t
+dc_irda_cache_clear (dc_context_t *context)
+{
+	dc_irda_cache_t *cache = dc_context_get_irda_cache (context);
+	if (cache == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (cache->mutex);
+	cache->count = 0;
+	dc_mutex_unlock (cache->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_t *descriptor)
 {
@@ -147,6 +360,31 @@ dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_
 		return DC_STATUS_NOMEMORY;
 	}
 
+	dc_filter_t filter = dc_descriptor_get_filter (descriptor);
+
+	// Skip the device discovery if the cached results are recent enough.
+	dc_irda_device_t cached[NCACHE];
+	unsigned int ncached = dc_irda_cache_snapshot (context, cached);
+	if (ncached) {
+		INFO (context, "Discover: using %u cached devices", ncached);
+
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < ncached; ++i) {
+			if (filter && !filter (DC_TRANSPORT_IRDA, cached[i].name)) {
+				continue;
+			}
+
+			iterator->items[count++] = cached[i];
+		}
+
+		iterator->current = 0;
+		iterator->count = count;
+
+		*out = (dc_iterator_t *) iterator;
+
+		return DC_STATUS_SUCCESS;
+	}
+
 	// Initialize the socket library.
 	status = dc_socket_init (context);
 	if (status != DC_STATUS_SUCCESS) {
@@ -211,7 +449,7 @@ dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_
 	S_CLOSE (fd);
 	dc_socket_exit (context);
 
-	dc_filter_t filter = dc_descriptor_get_filter (descriptor);
+	dc_ticks_t now = dc_datetime_now ();
 
 	unsigned int count = 0;
 #ifdef _WIN32
@@ -232,16 +470,21 @@ dc_irda_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descriptor_
 		INFO (context, "Discover: address=%08x, name=%s, charset=%02x, hints=%04x",
 			address, name, charset, hints);
 
+		dc_irda_device_t item;
+		strncpy(item.name, name, sizeof(item.name) - 1);
+		item.name[sizeof(item.name) - 1] = '\0';
+		item.address = address;
+		item.charset = charset;
+		item.hints = hints;
+
+		// Remember all devices, also the ones filtered out here.
+		dc_irda_cache_update (context, &item, now);
+
 		if (filter && !filter (DC_TRANSPORT_IRDA, name)) {
 			continue;
 		}
 
-		strncpy(iterator->items[count].name, name, sizeof(iterator->items[count].name) - 1);
-		iterator->items[count].name[sizeof(iterator->items[count].name) - 1] = '\0';
-		iterator->items[count].address = address;
-		iterator->items[count].charset = charset;
-		iterator->items[count].hints = hints;
-		count++;
+		iterator->items[count++] = item;
 	}
 
 	iterator->current = 0;
@@ -333,6 +576,9 @@ dc_irda_open (dc_iostream_t **out, dc_context_t *context, unsigned int address,
 		goto error_close;
 	}
 
+	// The device is still around at this address.
+	dc_irda_cache_touch (context, address, dc_datetime_now ());
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
@@ -86,6 +86,66 @@ dc_irda_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descri
 dc_status_t
 dc_irda_open (dc_iostream_t **iostream, dc_context_t *context, unsigned int address, unsigned int lsap);
 
+/**
+ * IrDA device name matching function.
+ *
+ * @param[in]  name  The name of the device, or NULL if unknown.
+ * @returns Non-zero if the device matches, or zero otherwise.
+ */
+typedef int (*dc_irda_match_t) (const char *name);
+
+/**
+ * Set the lifetime of the IrDA device cache entries.
+ *
+ * Every context remembers the devices that were discovered. If a device
+ * was seen less than the discovery lifetime ago, the iterator returns
+ * the cached devices instead of performing a new discovery. The backends
+ * connect directly to a device that was seen less than the connect
+ * lifetime ago, and only fall back to a discovery if that fails. A
+ * successful connection counts as seeing the device again. By default,
+ * the discovery cache is disabled, and addresses are remembered for one
+ * hour.
+ *
+ * @param[in]  context    A valid context object.
+ * @param[in]  discovery  The discovery lifetime (in seconds), or zero to disable.
+ * @param[in]  connect    The connect lifetime (in seconds), or zero to disable.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_irda_cache_set_ttl (dc_context_t *context, unsigned int discovery, unsigned int connect);
+
+/**
+ * Look up the address of the most recently seen IrDA device with a
+ * matching name, within the connect lifetime.
+ *
+ * @param[in]  context  A valid context object.
+ * @param[in]  match    The name matching function.
+ * @returns The device address, or zero if no device was found.
+ */
+unsigned int
+dc_irda_cache_lookup (dc_context_t *context, dc_irda_match_t match);
+
+/**
+ * Remove a device from the IrDA device cache, for example after the
+ * connection to its remembered address failed.
+ *
+ * @param[in]  context  A valid context object.
+ * @param[in]  address  The IrDA device address.
+ */
+void
+dc_irda_cache_invalidate (dc_context_t *context, unsigned int address);
+
+/**
+ * Remove all devices from the IrDA device cache.
+ *
+ * @param[in]  context    A valid context object.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_irda_cache_clear (dc_context_t *context);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,182 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#elif defined(HAVE_SYS_MMAN_H)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mapping.h"
+#include "context-private.h"
+
+void
+dc_mapping_init (dc_mapping_t *mapping)
+{
+	mapping->data = NULL;
+	mapping->size = 0;
+#ifdef _WIN32
+	mapping->hFile = INVALID_HANDLE_VALUE;
+	mapping->hMapping = NULL;
+#else
+	mapping->mapped = 0;
+#endif
+}
+
+dc_status_t
+dc_mapping_open (dc_mapping_t *mapping, dc_context_t *context, const char *filename)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+
+	mapping->hFile = CreateFileA (filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mapping->hFile == INVALID_HANDLE_VALUE) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	if (!GetFileSizeEx (mapping->hFile, &size) || (ULONGLONG) size.QuadPart > (size_t) -1) {
+		ERROR (context, "Failed to get the file size.");
+		return DC_STATUS_IO;
+	}
+
+	mapping->size = (size_t) size.QuadPart;
+	if (mapping->size == 0)
+		return DC_STATUS_SUCCESS;
+
+	mapping->hMapping = CreateFileMappingA (mapping->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping->hMapping == NULL) {
+		ERROR (context, "Failed to map the file.");
+		return DC_STATUS_IO;
+	}
+
+	mapping->data = (const unsigned char *) MapViewOfFile (mapping->hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapping->data == NULL) {
+		ERROR (context, "Failed to map the file.");
+		return DC_STATUS_IO;
+	}
+#elif defined(HAVE_SYS_MMAN_H)
+	struct stat st;
+
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	if (fstat (fd, &st) != 0 || (unsigned long long) st.st_size > (size_t) -1) {
+		ERROR (context, "Failed to get the file size.");
+		close (fd);
+		return DC_STATUS_IO;
+	}
+
+	mapping->size = st.st_size;
+	if (mapping->size == 0) {
+		close (fd);
+		return DC_STATUS_SUCCESS;
+	}
+
+	// The mapping stays valid after closing the file descriptor.
+	void *data = mmap (NULL, mapping->size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED) {
+		ERROR (context, "Failed to map the file.");
+		return DC_STATUS_IO;
+	}
+
+	mapping->data = (const unsigned char *) data;
+	mapping->mapped = 1;
+#else
+	// Without memory mapping, the file is read into memory instead.
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	unsigned char *data = NULL;
+	size_t size = 0, capacity = 0;
+	while (1) {
+		if (size == capacity) {
+			capacity = capacity ? 2 * capacity : 65536;
+			unsigned char *tmp = (unsigned char *) realloc (data, capacity);
+			if (tmp == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				free (data);
+				fclose (fp);
+				return DC_STATUS_NOMEMORY;
+			}
+			data = tmp;
+		}
+
+		size_t n = fread (data + size, 1, capacity - size, fp);
+		if (n == 0)
+			break;
+		size += n;
+	}
+
+	if (ferror (fp)) {
+		ERROR (context, "Failed to read the file.");
+		free (data);
+		fclose (fp);
+		return DC_STATUS_IO;
+	}
+
+	fclose (fp);
+
+	mapping->data = data;
+	mapping->size = size;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_mapping_close (dc_mapping_t *mapping)
+{
+#ifdef _WIN32
+	if (mapping->data)
+		UnmapViewOfFile (mapping->data);
+	if (mapping->hMapping)
+		CloseHandle (mapping->hMapping);
+	if (mapping->hFile != INVALID_HANDLE_VALUE)
+		CloseHandle (mapping->hFile);
+#elif defined(HAVE_SYS_MMAN_H)
+	if (mapping->mapped)
+		munmap ((void *) mapping->data, mapping->size);
+#else
+	free ((void *) mapping->data);
+#endif
+
+	dc_mapping_init (mapping);
+}
@@ -0,0 +1,67 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_MAPPING_H
+#define DC_MAPPING_H
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#endif
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A read-only view of the contents of a file. Where the platform
+ * supports it, the file is memory mapped, otherwise it is read into
+ * memory. For an empty file, the data pointer remains NULL.
+ */
+typedef struct dc_mapping_t {
+	const unsigned char *data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE hFile;
+	HANDLE hMapping;
+#else
+	int mapped;
+#endif
+} dc_mapping_t;
+
+void
+dc_mapping_init (dc_mapping_t *mapping);
+
+dc_status_t
+dc_mapping_open (dc_mapping_t *mapping, dc_context_t *context, const char *filename);
+
+void
+dc_mapping_close (dc_mapping_t *mapping);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_MAPPING_H */
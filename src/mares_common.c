@@ -27,9 +27,14 @@
 #include "mares_common.h"
 #include "checksum.h"
 #include "array.h"
+#include "ringbuffer.h"
+#include "rbstream.h"
 
 #define MAXRETRIES 4
 
+// The time for a complete answer at 9600 baud, with some margin (ms).
+#define ANSWERTIME 200
+
 #define FP_OFFSET 8
 #define FP_SIZE   5
 
@@ -55,6 +60,7 @@ mares_common_device_init (mares_common_device_t *device)
 	device->iostream = NULL;
 	device->echo = 0;
 	device->delay = 0;
+	device->pipeline = 1;
 }
 
 
@@ -78,6 +84,31 @@ mares_common_make_ascii (const unsigned char raw[], unsigned int rsize, unsigned
 }
 
 
+static dc_status_t
+mares_common_verify (mares_common_device_t *device, const unsigned char answer[], unsigned int asize)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	// Verify the header and trailer of the packet.
+	if (answer[0] != '<' || answer[asize - 1] != '>') {
+		ERROR (abstract->context, "Unexpected answer header/trailer byte.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	// Verify the checksum of the packet.
+	unsigned char crc = 0;
+	unsigned char ccrc = checksum_add_uint8 (answer + 1, asize - 4, 0x00);
+	array_convert_hex2bin (answer + asize - 3, 2, &crc, 1);
+	if (crc != ccrc) {
+		device_stats_checksum (abstract);
+		ERROR (abstract->context, "Unexpected answer checksum.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 mares_common_packet (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
@@ -120,22 +151,7 @@ mares_common_packet (mares_common_device_t *device, const unsigned char command[
 		return status;
 	}
 
-	// Verify the header and trailer of the packet.
-	if (answer[0] != '<' || answer[asize - 1] != '>') {
-		ERROR (abstract->context, "Unexpected answer header/trailer byte.");
-		return DC_STATUS_PROTOCOL;
-	}
-
-	// Verify the checksum of the packet.
-	unsigned char crc = 0;
-	unsigned char ccrc = checksum_add_uint8 (answer + 1, asize - 4, 0x00);
-	array_convert_hex2bin (answer + asize - 3, 2, &crc, 1);
-	if (crc != ccrc) {
-		ERROR (abstract->context, "Unexpected answer checksum.");
-		return DC_STATUS_PROTOCOL;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return mares_common_verify (device, answer, asize);
 }
 
 
@@ -154,6 +170,8 @@ mares_common_transfer (mares_common_device_t *device, const unsigned char comman
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Discard any garbage bytes.
 		dc_iostream_sleep (device->iostream, 100);
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
@@ -163,27 +181,140 @@ mares_common_transfer (mares_common_device_t *device, const unsigned char comman
 }
 
 
+static void
+mares_common_make_read (unsigned int address, unsigned int len, unsigned char command[2 * (4 + 2)])
+{
+	// Build the raw command.
+	unsigned char raw[] = {0x51,
+		(address     ) & 0xFF, // Low
+		(address >> 8) & 0xFF, // High
+		len}; // Count
+
+	// Build the ascii command.
+	mares_common_make_ascii (raw, sizeof (raw), command, 2 * (sizeof (raw) + 2));
+}
+
+
+static dc_status_t
+mares_common_read_pipelined (mares_common_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	// Send all read commands at once, without waiting for the answers.
+	unsigned char command[MAXPIPELINE * 2 * (4 + 2)] = {0};
+	unsigned int npackets = 0, csize = 0;
+	for (unsigned int nbytes = 0; nbytes < size; nbytes += PACKETSIZE) {
+		unsigned int len = size - nbytes;
+		if (len > PACKETSIZE)
+			len = PACKETSIZE;
+		mares_common_make_read (address + nbytes, len, command + csize);
+		csize += 2 * (4 + 2);
+		npackets++;
+	}
+
+	status = dc_iostream_write (device->iostream, command, csize, NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to send the command.");
+		return status;
+	}
+
+	// Receive and verify the answers, in the same order.
+	for (unsigned int i = 0; i < npackets; ++i) {
+		unsigned int nbytes = i * PACKETSIZE;
+		unsigned int len = size - nbytes;
+		if (len > PACKETSIZE)
+			len = PACKETSIZE;
+
+		unsigned char answer[2 * (PACKETSIZE + 2)] = {0};
+		status = dc_iostream_read (device->iostream, answer, 2 * (len + 2), NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			return status;
+		}
+
+		status = mares_common_verify (device, answer, 2 * (len + 2));
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		// Extract the raw data from the packet.
+		array_convert_hex2bin (answer + 1, 2 * len, data + nbytes, len);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+/*
+ * The answers to the remaining commands of a failed batch may still be
+ * arriving. Wait until the line stays idle for the time of a complete
+ * answer, and discard everything that was received.
+ */
+static void
+mares_common_drain (mares_common_device_t *device)
+{
+	for (unsigned int i = 0; i <= MAXPIPELINE; ++i) {
+		dc_iostream_sleep (device->iostream, ANSWERTIME);
+
+		size_t available = 0;
+		dc_status_t rc = dc_iostream_get_available (device->iostream, &available);
+		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+		if (rc != DC_STATUS_SUCCESS || available == 0)
+			break;
+	}
+}
+
+
 dc_status_t
 mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
 	mares_common_device_t *device = (mares_common_device_t*) abstract;
 
+	// Pipelining is only possible without an echo or inter-command delay,
+	// because the commands are sent while the answers are still arriving.
+	unsigned int pipeline = device->pipeline;
+	if (pipeline > MAXPIPELINE || device->echo || device->delay)
+		pipeline = 1;
+
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
+		if (pipeline > 1 && size - nbytes > PACKETSIZE) {
+			// Calculate the size of the batch.
+			unsigned int len = size - nbytes;
+			if (len > pipeline * PACKETSIZE)
+				len = pipeline * PACKETSIZE;
+
+			dc_status_t rc = mares_common_read_pipelined (device, address, data, len);
+			if (rc == DC_STATUS_SUCCESS) {
+				nbytes += len;
+				address += len;
+				data += len;
+				continue;
+			}
+
+			if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
+				return rc;
+
+			// Fallback to one command at a time for the rest of the
+			// session, and read the same data again.
+			WARNING (abstract->context, "Pipelined read failed, disabling pipelining.");
+			device->pipeline = pipeline = 1;
+
+			// Discard the answers of the failed batch.
+			mares_common_drain (device);
+		}
+
 		// Calculate the packet size.
 		unsigned int len = size - nbytes;
 		if (len > PACKETSIZE)
 			len = PACKETSIZE;
 
-		// Build the raw command.
-		unsigned char raw[] = {0x51,
-			(address     ) & 0xFF, // Low
-			(address >> 8) & 0xFF, // High
-			len}; // Count
-
 		// Build the ascii command.
-		unsigned char command[2 * (sizeof (raw) + 2)] = {0};
-		mares_common_make_ascii (raw, sizeof (raw), command, sizeof (command));
+		unsigned char command[2 * (4 + 2)] = {0};
+		mares_common_make_read (address, len, command);
 
 		// Send the command and receive the answer.
 		unsigned char answer[2 * (PACKETSIZE + 2)] = {0};
@@ -203,37 +334,88 @@ mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned
 }
 
 
-dc_status_t
-mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata)
+typedef struct mares_common_stream_t {
+	const mares_common_layout_t *layout;
+	// Memory dump, or NULL when reading from the device.
+	const unsigned char *data;
+	// Device and ringbuffer stream, for reading from the device.
+	dc_device_t *device;
+	dc_rbstream_t *rbstream;
+	dc_event_progress_t *progress;
+	// Linear copy of the profile ringbuffer, filled backwards from the
+	// end of the profile data, and the offset of the oldest byte in it.
+	unsigned char *buffer;
+	unsigned int available;
+	// Current position in the memory dump.
+	unsigned int address;
+} mares_common_stream_t;
+
+
+static dc_status_t
+mares_common_stream_fill (mares_common_stream_t *stream, unsigned int offset)
 {
-	assert (layout != NULL);
+	const mares_common_layout_t *layout = stream->layout;
 
-	// Get the freedive mode for this model.
-	unsigned int model = data[1];
-	unsigned int freedive = FREEDIVE;
-	if (model == NEMOWIDE || model == NEMOAIR || model == PUCK || model == PUCKAIR)
-		freedive = GAUGE;
+	if (offset >= stream->available)
+		return DC_STATUS_SUCCESS;
 
-	// Get the end of the profile ring buffer.
-	unsigned int eop = array_uint16_le (data + 0x6B);
-	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
-		ERROR (context, "Ringbuffer pointer out of range (0x%04x).", eop);
-		return DC_STATUS_DATAFORMAT;
+	unsigned int length = stream->available - offset;
+
+	if (stream->rbstream) {
+		dc_status_t rc = dc_rbstream_read (stream->rbstream, stream->progress, stream->buffer + offset, length);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (stream->device->context, "Failed to read the dive.");
+			return rc;
+		}
+	} else {
+		ringbuffer_span_t span;
+		ringbuffer_span_backward (&span, stream->address, length, layout->rb_profile_begin, layout->rb_profile_end);
+		ringbuffer_span_copy (stream->buffer + offset, stream->data, &span);
+		stream->address = span.segment[0].address;
 	}
 
-	// Make the ringbuffer linear, to avoid having to deal
-	// with the wrap point. The buffer has extra space to
-	// store the profile data for the freedives.
-	unsigned char *buffer = (unsigned char *) malloc (
-		layout->rb_profile_end - layout->rb_profile_begin +
-		layout->rb_freedives_end - layout->rb_freedives_begin);
-	if (buffer == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		return DC_STATUS_NOMEMORY;
+	stream->available = offset;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+mares_common_stream_freedives (mares_common_stream_t *stream, unsigned char data[])
+{
+	const mares_common_layout_t *layout = stream->layout;
+	unsigned int size = layout->rb_freedives_end - layout->rb_freedives_begin;
+
+	if (stream->rbstream == NULL) {
+		memcpy (data, stream->data + layout->rb_freedives_begin, size);
+		return DC_STATUS_SUCCESS;
+	}
+
+	dc_status_t rc = dc_device_read (stream->device, layout->rb_freedives_begin, data, size);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (stream->device->context, "Failed to read the freedive profiles.");
+		return rc;
 	}
 
-	memcpy (buffer + 0, data + eop, layout->rb_profile_end - eop);
-	memcpy (buffer + layout->rb_profile_end - eop, data + layout->rb_profile_begin, eop - layout->rb_profile_begin);
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+mares_common_process (dc_context_t *context, mares_common_stream_t *stream, unsigned int model, const unsigned char fingerprint[], dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	const mares_common_layout_t *layout = stream->layout;
+
+	// Get the freedive mode for this model.
+	unsigned int freedive = FREEDIVE;
+	if (model == NEMOWIDE || model == NEMOAIR || model == PUCK || model == PUCKAIR)
+		freedive = GAUGE;
+
+	// The profile ringbuffer is made linear, to avoid having to deal
+	// with the wrap point. The buffer has extra space to store the
+	// profile data for the freedives.
+	unsigned char *buffer = stream->buffer;
 
 	// For a freedive session, the Mares Nemo stores all the freedives of
 	// that session in a single logbook entry, and each sample is actually
@@ -247,6 +429,10 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 	while (offset >= 3) {
 		// Check for the presence of extra header bytes, which can be detected
 		// by means of a three byte marker sequence.
+		rc = mares_common_stream_fill (stream, offset - 3);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		unsigned int extra = 0;
 		const unsigned char marker[3] = {0xAA, 0xBB, 0xCC};
 		if (memcmp (buffer + offset - 3, marker, sizeof (marker)) == 0) {
@@ -260,6 +446,10 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		if (offset < extra + 3)
 			break;
 
+		rc = mares_common_stream_fill (stream, offset - extra - 3);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		// Check the dive mode of the logbook entry. Valid modes are
 		// 0 (air), 1 (EANx), 2 (freedive) or 3 (bottom timer).
 		// If the ringbuffer has never reached the wrap point before,
@@ -299,28 +489,43 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		// Move to the start of the dive.
 		offset -= nbytes;
 
+		rc = mares_common_stream_fill (stream, offset);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		// Verify that the length that is stored in the profile data
 		// equals the calculated length. If both values are different,
 		// something is wrong and an error is returned.
 		unsigned int length = array_uint16_le (buffer + offset);
 		if (length != nbytes) {
 			ERROR (context, "Calculated and stored size are not equal (%u %u).", length, nbytes);
-			free (buffer);
 			return DC_STATUS_DATAFORMAT;
 		}
 
+		unsigned int fp_offset = offset + length - extra - FP_OFFSET;
+		if (fingerprint && memcmp (buffer + fp_offset, fingerprint, FP_SIZE) == 0)
+			return DC_STATUS_SUCCESS;
+
 		// Process the profile data for the most recent freedive entry.
 		// Since we are processing the entries backwards (newest to oldest),
-		// this entry will always be the first one.
+		// this entry will always be the first one. The profile data is
+		// appended directly to the logbook entry. The buffer is guaranteed
+		// to have enough space, and the dives that will be overwritten
+		// have already been processed.
 		if (mode == freedive && nfreedives == 1) {
+			unsigned char *freedives = buffer + offset + nbytes;
+			rc = mares_common_stream_freedives (stream, freedives);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
 			// Count the number of freedives in the profile data.
 			unsigned int count = 0;
-			unsigned int idx = layout->rb_freedives_begin;
-			while (idx + 2 <= layout->rb_freedives_end &&
+			unsigned int idx = 0;
+			while (idx + 2 <= layout->rb_freedives_end - layout->rb_freedives_begin &&
 				count != nsamples)
 			{
 				// Each freedive in the session ends with a zero sample.
-				unsigned int sample = array_uint16_le (data + idx);
+				unsigned int sample = array_uint16_le (freedives + idx);
 				if (sample == 0)
 					count++;
 
@@ -333,30 +538,139 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 			// both values are different, the profile data is incomplete.
 			if (count != nsamples) {
 				ERROR (context, "Unexpected number of freedive sessions (%u %u).", count, nsamples);
-				free (buffer);
 				return DC_STATUS_DATAFORMAT;
 			}
 
-			// Append the profile data to the main logbook entry. The
-			// buffer is guaranteed to have enough space, and the dives
-			// that will be overwritten have already been processed.
-			memcpy (buffer + offset + nbytes, data + layout->rb_freedives_begin, idx - layout->rb_freedives_begin);
-			nbytes += idx - layout->rb_freedives_begin;
+			nbytes += idx;
 		}
 
-		unsigned int fp_offset = offset + length - extra - FP_OFFSET;
-		if (fingerprint && memcmp (buffer + fp_offset, fingerprint, FP_SIZE) == 0) {
-			free (buffer);
+		if (callback && !callback (buffer + offset, nbytes, buffer + fp_offset, FP_SIZE, userdata))
 			return DC_STATUS_SUCCESS;
-		}
+	}
 
-		if (callback && !callback (buffer + offset, nbytes, buffer + fp_offset, FP_SIZE, userdata)) {
-			free (buffer);
-			return DC_STATUS_SUCCESS;
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+mares_common_device_foreach (dc_device_t *abstract, const mares_common_layout_t *layout, const unsigned char fingerprint[], dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	mares_common_device_t *device = (mares_common_device_t *) abstract;
+
+	assert (layout != NULL);
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = layout->rb_profile_begin +
+		(layout->rb_profile_end - layout->rb_profile_begin);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the header, which precedes the profile ringbuffer.
+	unsigned char header[0x70] = {0};
+	assert (layout->rb_profile_begin <= sizeof (header));
+	rc = dc_device_read (abstract, 0, header, layout->rb_profile_begin);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory.");
+		return rc;
+	}
+
+	// Update and emit a progress event.
+	progress.current += layout->rb_profile_begin;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Emit a device info event.
+	dc_event_devinfo_t devinfo;
+	devinfo.model = header[1];
+	devinfo.firmware = 0;
+	devinfo.serial = array_uint16_be (header + 8);
+	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
+
+	// Get the end of the profile ring buffer.
+	unsigned int eop = array_uint16_le (header + 0x6B);
+	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
+		ERROR (abstract->context, "Ringbuffer pointer out of range (0x%04x).", eop);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Create the ringbuffer stream. The dives are read newest first, and
+	// the download stops as soon as the fingerprint is found.
+	dc_rbstream_t *rbstream = NULL;
+	rc = dc_rbstream_new (&rbstream, abstract, 1, PACKETSIZE, layout->rb_profile_begin, layout->rb_profile_end, eop);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+		return rc;
+	}
+
+	if (device->pipeline > 1) {
+		rc = dc_rbstream_set_readahead (rbstream, device->pipeline * PACKETSIZE, 0);
+		if (rc != DC_STATUS_SUCCESS) {
+			dc_rbstream_free (rbstream);
+			return rc;
 		}
 	}
 
+	unsigned char *buffer = (unsigned char *) malloc (
+		layout->rb_profile_end - layout->rb_profile_begin +
+		layout->rb_freedives_end - layout->rb_freedives_begin);
+	if (buffer == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		dc_rbstream_free (rbstream);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	mares_common_stream_t stream;
+	stream.layout = layout;
+	stream.data = NULL;
+	stream.device = abstract;
+	stream.rbstream = rbstream;
+	stream.progress = &progress;
+	stream.buffer = buffer;
+	stream.available = layout->rb_profile_end - layout->rb_profile_begin;
+	stream.address = eop;
+
+	rc = mares_common_process (abstract->context, &stream, header[1], fingerprint, callback, userdata);
+
+	dc_rbstream_free (rbstream);
 	free (buffer);
 
-	return DC_STATUS_SUCCESS;
+	return rc;
+}
+
+
+dc_status_t
+mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata)
+{
+	assert (layout != NULL);
+
+	// Get the end of the profile ring buffer.
+	unsigned int eop = array_uint16_le (data + 0x6B);
+	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
+		ERROR (context, "Ringbuffer pointer out of range (0x%04x).", eop);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	unsigned char *buffer = (unsigned char *) malloc (
+		layout->rb_profile_end - layout->rb_profile_begin +
+		layout->rb_freedives_end - layout->rb_freedives_begin);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	mares_common_stream_t stream;
+	stream.layout = layout;
+	stream.data = data;
+	stream.device = NULL;
+	stream.rbstream = NULL;
+	stream.progress = NULL;
+	stream.buffer = buffer;
+	stream.available = layout->rb_profile_end - layout->rb_profile_begin;
+	stream.address = eop;
+
+	dc_status_t rc = mares_common_process (context, &stream, data[1], fingerprint, callback, userdata);
+
+	free (buffer);
+
+	return rc;
 }
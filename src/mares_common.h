@@ -31,6 +31,8 @@ extern "C" {
 
 #define PACKETSIZE 0x20
 
+#define MAXPIPELINE 8
+
 typedef struct mares_common_layout_t {
 	unsigned int memsize;
 	unsigned int rb_profile_begin;
@@ -44,6 +46,7 @@ typedef struct mares_common_device_t {
 	dc_iostream_t *iostream;
 	unsigned int echo;
 	unsigned int delay;
+	unsigned int pipeline;
 } mares_common_device_t;
 
 void
@@ -52,6 +55,9 @@ mares_common_device_init (mares_common_device_t *device);
 dc_status_t
 mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
 
+dc_status_t
+mares_common_device_foreach (dc_device_t *device, const mares_common_layout_t *layout, const unsigned char fingerprint[], dc_dive_callback_t callback, void *userdata);
+
 dc_status_t
 mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata);
 
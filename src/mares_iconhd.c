@@ -48,6 +48,8 @@
 #define ACK 0xAA
 #define EOF 0xEA
 
+#define MAXPACKETSIZE 4096
+
 #define AIR       0
 #define GAUGE     1
 #define NITROX    2
@@ -72,6 +74,7 @@ typedef struct mares_iconhd_device_t {
 	unsigned char version[140];
 	unsigned int model;
 	unsigned int packetsize;
+	unsigned int maxpacketsize;
 } mares_iconhd_device_t;
 
 static dc_status_t mares_iconhd_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -213,6 +216,62 @@ mares_iconhd_transfer (mares_iconhd_device_t *device,
 }
 
 
+static dc_status_t
+mares_iconhd_probe_packetsize (mares_iconhd_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	// The packet size is negotiated only once, on the first download.
+	if (device->maxpacketsize)
+		return DC_STATUS_SUCCESS;
+
+	if (device->packetsize >= MAXPACKETSIZE) {
+		device->maxpacketsize = device->packetsize;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// The default packet size for the newer models is conservative, and
+	// some firmware versions support larger packets. Try to read a single
+	// packet of the maximum size, and if that succeeds, use the larger
+	// size for all further reads. This reduces the number of round-trips
+	// for the ringbuffer walk by an order of magnitude.
+	unsigned char *packet = (unsigned char *) malloc (MAXPACKETSIZE);
+	if (packet == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned int address = device->layout->rb_profile_begin;
+	unsigned char command[] = {0xE7, 0x42,
+		(address      ) & 0xFF,
+		(address >>  8) & 0xFF,
+		(address >> 16) & 0xFF,
+		(address >> 24) & 0xFF,
+		(MAXPACKETSIZE      ) & 0xFF,
+		(MAXPACKETSIZE >>  8) & 0xFF,
+		(MAXPACKETSIZE >> 16) & 0xFF,
+		(MAXPACKETSIZE >> 24) & 0xFF};
+	dc_status_t status = mares_iconhd_transfer (device, command, sizeof (command), packet, MAXPACKETSIZE);
+
+	free (packet);
+
+	if (status == DC_STATUS_SUCCESS) {
+		INFO (abstract->context, "Using %u byte packets.", MAXPACKETSIZE);
+		device->maxpacketsize = MAXPACKETSIZE;
+	} else if (status == DC_STATUS_TIMEOUT || status == DC_STATUS_PROTOCOL) {
+		// Discard any remaining data, and keep the default size.
+		INFO (abstract->context, "Using %u byte packets.", device->packetsize);
+		dc_iostream_sleep (device->iostream, 100);
+		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+		device->maxpacketsize = device->packetsize;
+	} else {
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -236,6 +295,7 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, const char *
 	memset (device->version, 0, sizeof (device->version));
 	device->model = 0;
 	device->packetsize = 0;
+	device->maxpacketsize = 0;
 
 	// Open the device.
 	status = dc_serial_open (&device->iostream, context, name);
@@ -244,6 +304,8 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, const char *
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8E1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_EVEN, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -368,12 +430,17 @@ mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
 
+	// Until the packet size is negotiated, only the default size is safe.
+	unsigned int packetsize = device->maxpacketsize;
+	if (packetsize == 0)
+		packetsize = device->packetsize;
+
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		// Calculate the packet size.
 		unsigned int len = size - nbytes;
-		if (len > device->packetsize)
-			len = device->packetsize;
+		if (len > packetsize)
+			len = packetsize;
 
 		// Read the packet.
 		unsigned char command[] = {0xE7, 0x42,
@@ -403,6 +470,11 @@ mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 {
 	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
 
+	// Negotiate the packet size.
+	dc_status_t rc = mares_iconhd_probe_packetsize (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	// Allocate the required amount of memory.
 	if (!dc_buffer_resize (buffer, device->layout->memsize)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
@@ -415,8 +487,10 @@ mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), device->packetsize);
+	// The dump starts at the default packet size, and grows up to the
+	// negotiated size while the reads stay fast.
+	return device_dump_read_adaptive (abstract, dc_buffer_get_data (buffer),
+		dc_buffer_get_size (buffer), device->packetsize, device->maxpacketsize);
 }
 
 
@@ -429,6 +503,11 @@ mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	if (!ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
+	// Negotiate the packet size.
+	rc = mares_iconhd_probe_packetsize (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	const mares_iconhd_layout_t *layout = device->layout;
 
 	// Enable progress notifications.
@@ -505,7 +584,7 @@ mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
-	rc = dc_rbstream_new (&rbstream, abstract, 1, device->packetsize, layout->rb_profile_begin, layout->rb_profile_end, eop);
+	rc = dc_rbstream_new (&rbstream, abstract, 1, device->maxpacketsize, layout->rb_profile_begin, layout->rb_profile_end, eop);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
 		return rc;
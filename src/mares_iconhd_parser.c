@@ -55,6 +55,7 @@ struct mares_iconhd_parser_t {
 	unsigned int nsamples;
 	unsigned int footer;
 	unsigned int samplesize;
+	unsigned int extrasize;
 	unsigned int settings;
 	unsigned int interval;
 	unsigned int samplerate;
@@ -75,6 +76,9 @@ static const dc_parser_vtable_t mares_iconhd_parser_vtable = {
 	mares_iconhd_parser_get_datetime, /* datetime */
 	mares_iconhd_parser_get_field, /* fields */
 	mares_iconhd_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -179,10 +183,16 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 		samplerate = 1;
 	}
 
+	// Get the size of the extra data, stored after every fourth sample.
+	unsigned int extrasize = 0;
+	if (parser->model == ICONHDNET || parser->model == QUADAIR) {
+		extrasize = 8;
+	}
+
 	// Calculate the total number of bytes for this dive.
 	unsigned int nbytes = 4 + headersize + nsamples * samplesize;
-	if (parser->model == ICONHDNET || parser->model == QUADAIR) {
-		nbytes += (nsamples / 4) * 8;
+	if (extrasize) {
+		nbytes += (nsamples / 4) * extrasize;
 	} else if (parser->model == SMARTAPNEA) {
 		unsigned int divetime = array_uint32_le (p + 0x24);
 		nbytes += divetime * samplerate * 2;
@@ -231,6 +241,7 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 	parser->nsamples = nsamples;
 	parser->footer = length - headersize;
 	parser->samplesize = samplesize;
+	parser->extrasize = extrasize;
 	parser->settings = settings;
 	parser->interval = interval;
 	parser->samplerate = samplerate;
@@ -494,138 +505,185 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 
 
 static dc_status_t
-mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+mares_iconhd_parser_samples_apnea (mares_iconhd_parser_t *parser, dc_sample_callback_t callback, void *userdata)
 {
-	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
-
-	// Cache the parser data.
-	dc_status_t rc = mares_iconhd_parser_cache (parser);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-
-	const unsigned char *data = abstract->data;
+	const unsigned char *data = parser->base.data;
+	unsigned int samplesize = parser->samplesize;
+	unsigned int interval = parser->interval;
+	unsigned int stride = 2 * parser->samplerate;
 
 	if (parser->samplerate > 1) {
 		// The Smart Apnea supports multiple samples per second
 		// (e.g. 2, 4 or 8). Since our smallest unit of time is one
 		// second, we can't represent this, and the extra samples
 		// will get dropped.
-		WARNING(abstract->context, "Multiple samples per second are not supported!");
+		WARNING(parser->base.context, "Multiple samples per second are not supported!");
 	}
 
-	// Previous gas mix - initialize with impossible value
-	unsigned int gasmix_previous = 0xFFFFFFFF;
-
 	unsigned int time = 0;
 	unsigned int offset = 4;
-	unsigned int nsamples = 0;
-	while (nsamples < parser->nsamples) {
+	for (unsigned int n = 0; n < parser->nsamples; ++n) {
 		dc_sample_value_t sample = {0};
 
-		if (parser->model == SMARTAPNEA) {
-			unsigned int maxdepth = array_uint16_le (data + offset + 0);
-			unsigned int divetime = array_uint16_le (data + offset + 2);
-			unsigned int surftime = array_uint16_le (data + offset + 4);
+		unsigned int divetime = array_uint16_le (data + offset + 2);
+		unsigned int surftime = array_uint16_le (data + offset + 4);
 
-			// Surface Time (seconds).
-			time += surftime;
+		// Surface Time (seconds).
+		time += surftime;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Surface Depth (0 m).
+		sample.depth = 0.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		offset += samplesize;
+
+		for (unsigned int i = 0; i < divetime; ++i) {
+			// Time (seconds).
+			time += interval;
 			sample.time = time;
 			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-			// Surface Depth (0 m).
-			sample.depth = 0.0;
+			// Depth (1/10 m).
+			unsigned int depth = array_uint16_le (data + offset);
+			sample.depth = depth / 10.0;
 			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
-			offset += parser->samplesize;
-			nsamples++;
+			offset += stride;
+		}
+	}
 
-			for (unsigned int i = 0; i < divetime; ++i) {
-				// Time (seconds).
-				time += parser->interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+	return DC_STATUS_SUCCESS;
+}
 
-				// Depth (1/10 m).
-				unsigned int depth = array_uint16_le (data + offset);
-				sample.depth = depth / 10.0;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+static dc_status_t
+mares_iconhd_parser_samples_freedive (mares_iconhd_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	const unsigned char *data = parser->base.data;
+	unsigned int samplesize = parser->samplesize;
 
-				offset += 2 * parser->samplerate;
-			}
-		} else if (parser->mode == FREEDIVE) {
-			unsigned int maxdepth = array_uint16_le (data + offset + 0);
-			unsigned int divetime = array_uint16_le (data + offset + 2);
-			unsigned int surftime = array_uint16_le (data + offset + 4);
+	unsigned int time = 0;
+	unsigned int offset = 4;
+	for (unsigned int n = 0; n < parser->nsamples; ++n) {
+		dc_sample_value_t sample = {0};
 
-			// Surface Time (seconds).
-			time += surftime;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		unsigned int maxdepth = array_uint16_le (data + offset + 0);
+		unsigned int divetime = array_uint16_le (data + offset + 2);
+		unsigned int surftime = array_uint16_le (data + offset + 4);
 
-			// Surface Depth (0 m).
-			sample.depth = 0.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		// Surface Time (seconds).
+		time += surftime;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-			// Dive Time (seconds).
-			time += divetime;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		// Surface Depth (0 m).
+		sample.depth = 0.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
-			// Maximum Depth (1/10 m).
-			sample.depth = maxdepth / 10.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		// Dive Time (seconds).
+		time += divetime;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-			offset += parser->samplesize;
-			nsamples++;
-		} else {
-			// Time (seconds).
-			time += parser->interval;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		// Maximum Depth (1/10 m).
+		sample.depth = maxdepth / 10.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
-			// Depth (1/10 m).
-			unsigned int depth = array_uint16_le (data + offset + 0);
-			sample.depth = depth / 10.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		offset += samplesize;
+	}
 
-			// Temperature (1/10 °C).
-			unsigned int temperature = array_uint16_le (data + offset + 2) & 0x0FFF;
-			sample.temperature = temperature / 10.0;
-			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+	return DC_STATUS_SUCCESS;
+}
 
-			// Current gas mix
-			unsigned int gasmix = (data[offset + 3] & 0xF0) >> 4;
-			if (parser->ngasmixes > 0) {
-				if (gasmix >= parser->ngasmixes) {
-					ERROR (abstract->context, "Invalid gas mix index.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				if (gasmix != gasmix_previous) {
-					sample.gasmix = gasmix;
-					if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-					gasmix_previous = gasmix;
-				}
-			}
+static dc_status_t
+mares_iconhd_parser_samples_scuba (mares_iconhd_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+	unsigned int samplesize = parser->samplesize;
+	unsigned int extrasize = parser->extrasize;
+	unsigned int interval = parser->interval;
+	unsigned int ngasmixes = parser->ngasmixes;
+	unsigned int ntanks = parser->ntanks;
 
-			offset += parser->samplesize;
-			nsamples++;
-
-			// Some extra data.
-			if ((parser->model == ICONHDNET || parser->model == QUADAIR) && (nsamples % 4) == 0) {
-				// Pressure (1/100 bar).
-				unsigned int pressure = array_uint16_le(data + offset);
-				if (gasmix < parser->ntanks) {
-					sample.pressure.tank = gasmix;
-					sample.pressure.value = pressure / 100.0;
-					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
-				} else if (pressure != 0) {
-					WARNING (abstract->context, "Invalid tank with non-zero pressure.");
-				}
+	// Previous gas mix - initialize with impossible value
+	unsigned int gasmix_previous = 0xFFFFFFFF;
 
-				offset += 8;
+	unsigned int time = 0;
+	unsigned int offset = 4;
+	unsigned int countdown = 4;
+	for (unsigned int n = 0; n < parser->nsamples; ++n) {
+		dc_sample_value_t sample = {0};
+
+		// Time (seconds).
+		time += interval;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Depth (1/10 m).
+		unsigned int depth = array_uint16_le (data + offset + 0);
+		sample.depth = depth / 10.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		// Temperature (1/10 °C).
+		unsigned int temperature = array_uint16_le (data + offset + 2) & 0x0FFF;
+		sample.temperature = temperature / 10.0;
+		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+
+		// Current gas mix
+		unsigned int gasmix = (data[offset + 3] & 0xF0) >> 4;
+		if (ngasmixes > 0) {
+			if (gasmix >= ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
 			}
+			if (gasmix != gasmix_previous) {
+				sample.gasmix = gasmix;
+				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				gasmix_previous = gasmix;
+			}
+		}
+
+		offset += samplesize;
+
+		// Some extra data.
+		if (extrasize && --countdown == 0) {
+			// Pressure (1/100 bar).
+			unsigned int pressure = array_uint16_le(data + offset);
+			if (gasmix < ntanks) {
+				sample.pressure.tank = gasmix;
+				sample.pressure.value = pressure / 100.0;
+				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+			} else if (pressure != 0) {
+				WARNING (abstract->context, "Invalid tank with non-zero pressure.");
+			}
+
+			offset += extrasize;
+			countdown = 4;
 		}
 	}
 
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
+
+	// Cache the parser data.
+	dc_status_t rc = mares_iconhd_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The sample format depends only on the model and the dive mode,
+	// so select the decoder once for the whole dive.
+	if (parser->model == SMARTAPNEA) {
+		return mares_iconhd_parser_samples_apnea (parser, callback, userdata);
+	} else if (parser->mode == FREEDIVE) {
+		return mares_iconhd_parser_samples_freedive (parser, callback, userdata);
+	} else {
+		return mares_iconhd_parser_samples_scuba (parser, callback, userdata);
+	}
+}
@@ -110,6 +110,8 @@ mares_nemo_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -264,6 +266,7 @@ mares_nemo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			WARNING (abstract->context, "Only the second packet has a correct checksum.");
 			dc_buffer_append (buffer, packet + PACKETSIZE + 1, PACKETSIZE);
 		} else {
+			device_stats_checksum (abstract);
 			ERROR (abstract->context, "Unexpected answer checksum.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -282,9 +285,7 @@ mares_nemo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 mares_nemo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	mares_nemo_device_t *device = (mares_nemo_device_t *) abstract;
-
-	dc_buffer_t *buffer = dc_buffer_new (MEMORYSIZE);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, MEMORYSIZE);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -302,6 +303,26 @@ mares_nemo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	devinfo.serial = array_uint16_be (data + 8);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	rc = mares_nemo_extract_dives (abstract, data, dc_buffer_get_size (buffer), callback, userdata);
+
+	dc_buffer_free (buffer);
+
+	return rc;
+}
+
+
+dc_status_t
+mares_nemo_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	mares_nemo_device_t *device = (mares_nemo_device_t *) abstract;
+	dc_context_t *context = (abstract ? abstract->context : NULL);
+
+	if (abstract && !ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (size < MEMORYSIZE)
+		return DC_STATUS_DATAFORMAT;
+
 	const mares_common_layout_t *layout = NULL;
 	switch (data[1]) {
 	case NEMO:
@@ -312,14 +333,10 @@ mares_nemo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		layout = &mares_nemo_apneist_layout;
 		break;
 	default: // Unknown, try nemo
-		WARNING (abstract->context, "Unsupported model %02x detected!", data[1]);
+		WARNING (context, "Unsupported model %02x detected!", data[1]);
 		layout = &mares_nemo_layout;
 		break;
 	}
 
-	rc = mares_common_extract_dives (abstract->context, layout, device->fingerprint, data, callback, userdata);
-
-	dc_buffer_free (buffer);
-
-	return rc;
+	return mares_common_extract_dives (context, layout, device ? device->fingerprint : NULL, data, callback, userdata);
 }
@@ -86,6 +86,22 @@ static const mares_common_layout_t mares_nemowide_layout = {
 };
 
 
+static const mares_common_layout_t *
+mares_puck_get_layout (unsigned int model)
+{
+	switch (model) {
+	case NEMOWIDE:
+		return &mares_nemowide_layout;
+	case NEMOAIR:
+	case PUCKAIR:
+		return &mares_nemoair_layout;
+	case PUCK:
+		return &mares_puck_layout;
+	default: // Unknown, try puck
+		return &mares_puck_layout;
+	}
+}
+
 dc_status_t
 mares_puck_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -116,6 +132,8 @@ mares_puck_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->base.iostream);
+
 	// Set the serial communication protocol (38400 8N1).
 	status = dc_iostream_configure (device->base.iostream, 38400, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -154,22 +172,11 @@ mares_puck_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_close;
 	}
 
+	// Queue multiple read commands.
+	device->base.pipeline = MAXPIPELINE;
+
 	// Override the base class values.
-	switch (header[1]) {
-	case NEMOWIDE:
-		device->layout = &mares_nemowide_layout;
-		break;
-	case NEMOAIR:
-	case PUCKAIR:
-		device->layout = &mares_nemoair_layout;
-		break;
-	case PUCK:
-		device->layout = &mares_puck_layout;
-		break;
-	default: // Unknown, try puck
-		device->layout = &mares_puck_layout;
-		break;
-	}
+	device->layout = mares_puck_get_layout (header[1]);
 
 	*out = (dc_device_t*) device;
 
@@ -231,7 +238,7 @@ mares_puck_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	}
 
 	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), PACKETSIZE);
+		dc_buffer_get_size (buffer), PACKETSIZE * device->base.pipeline);
 }
 
 
@@ -242,27 +249,28 @@ mares_puck_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 
 	assert (device->layout != NULL);
 
-	dc_buffer_t *buffer = dc_buffer_new (device->layout->memsize);
-	if (buffer == NULL)
-		return DC_STATUS_NOMEMORY;
+	return mares_common_device_foreach (abstract, device->layout,
+		device->fingerprint, callback, userdata);
+}
 
-	dc_status_t rc = mares_puck_device_dump (abstract, buffer);
-	if (rc != DC_STATUS_SUCCESS) {
-		dc_buffer_free (buffer);
-		return rc;
-	}
 
-	// Emit a device info event.
-	unsigned char *data = dc_buffer_get_data (buffer);
-	dc_event_devinfo_t devinfo;
-	devinfo.model = data[1];
-	devinfo.firmware = 0;
-	devinfo.serial = array_uint16_be (data + 8);
-	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
+dc_status_t
+mares_puck_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	mares_puck_device_t *device = (mares_puck_device_t *) abstract;
+	dc_context_t *context = (abstract ? abstract->context : NULL);
+
+	if (abstract && !ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
 
-	rc = mares_common_extract_dives (abstract->context, device->layout, device->fingerprint, data, callback, userdata);
+	if (size < 2)
+		return DC_STATUS_DATAFORMAT;
 
-	dc_buffer_free (buffer);
+	// Without a device, the layout is derived from the model number.
+	const mares_common_layout_t *layout = device ?
+		device->layout : mares_puck_get_layout (data[1]);
+	if (size < layout->memsize)
+		return DC_STATUS_DATAFORMAT;
 
-	return rc;
+	return mares_common_extract_dives (context, layout, device ? device->fingerprint : NULL, data, callback, userdata);
 }
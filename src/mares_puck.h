@@ -33,6 +33,9 @@ extern "C" {
 dc_status_t
 mares_puck_device_open (dc_device_t **device, dc_context_t *context, const char *name);
 
+dc_status_t
+mares_puck_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -26,6 +26,8 @@
 #include "oceanic_common.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "probe.h"
+#include "iostream-private.h"
 #include "serial.h"
 #include "array.h"
 #include "ringbuffer.h"
@@ -38,8 +40,13 @@
 
 #define MAXRETRIES 2
 #define MAXDELAY   16
+#define TIMEOUT    1000
+#define MINTIMEOUT 100
 #define INVALID    0xFFFFFFFF
 
+#define NPAGES     16
+#define MAXPAGES   32
+
 #define CMD_INIT      0xA8
 #define CMD_VERSION   0x84
 #define CMD_READ1     0xB1
@@ -52,17 +59,28 @@
 #define ACK 0x5A
 #define NAK 0xA5
 
+typedef struct oceanic_atom2_page_t {
+	unsigned int page;
+	unsigned int stamp;
+	unsigned char data[256];
+} oceanic_atom2_page_t;
+
 typedef struct oceanic_atom2_device_t {
 	oceanic_common_device_t base;
 	dc_iostream_t *iostream;
 	unsigned int delay;
 	unsigned int bigpage;
-	unsigned char cache[256];
-	unsigned int cached;
+	unsigned int confirmed;
+	// Cache with the most recently used pages.
+	oceanic_atom2_page_t cache[MAXPAGES];
+	unsigned int npages;
+	unsigned int stamp;
 } oceanic_atom2_device_t;
 
 static dc_status_t oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
 static dc_status_t oceanic_atom2_device_write (dc_device_t *abstract, unsigned int address, const unsigned char data[], unsigned int size);
+static dc_status_t oceanic_atom2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
+static dc_status_t oceanic_atom2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
 static dc_status_t oceanic_atom2_device_close (dc_device_t *abstract);
 
 static const oceanic_common_device_vtable_t oceanic_atom2_device_vtable = {
@@ -72,8 +90,8 @@ static const oceanic_common_device_vtable_t oceanic_atom2_device_vtable = {
 		oceanic_common_device_set_fingerprint, /* set_fingerprint */
 		oceanic_atom2_device_read, /* read */
 		oceanic_atom2_device_write, /* write */
-		oceanic_common_device_dump, /* dump */
-		oceanic_common_device_foreach, /* foreach */
+		oceanic_atom2_device_dump, /* dump */
+		oceanic_atom2_device_foreach, /* foreach */
 		NULL, /* timesync */
 		oceanic_atom2_device_close /* close */
 	},
@@ -195,6 +213,31 @@ static const oceanic_common_version_t aqualung_i450t_version[] = {
 	{"AQUAI450 \0\0 2048"},
 };
 
+/*
+ * The largest multi-page read command to use for each model. Models
+ * which are not listed use the single page command. The A300CS and F11
+ * families are known to support their command. For the other models,
+ * the command is tried first, and if the device rejects it, the next
+ * smaller command is used instead.
+ */
+static const oceanic_common_version_t oceanic_read16_version[] = {
+	{"AER300CS \0\0 2048"},
+	{"OCEANVTX \0\0 2048"},
+	{"AQUAI750 \0\0 2048"},
+	{"AQUAI450 \0\0 2048"},
+	{"HOLLDG04 \0\0 2048"},
+};
+
+static const oceanic_common_version_t oceanic_read8_version[] = {
+	{"AERISF11 \0\0 1024"},
+	{"OCEANF11 \0\0 1024"},
+	{"OCEATOM3 \0\0 1024"},
+	{"ATOM31  \0\0  1024"},
+	{"OCEANVT4 \0\0 1024"},
+	{"OCEAVT41 \0\0 1024"},
+	{"OCEANOCI \0\0 1024"},
+};
+
 static const oceanic_common_layout_t aeris_f10_layout = {
 	0x10000, /* memsize */
 	0x0000, /* cf_devinfo */
@@ -461,8 +504,13 @@ static const oceanic_common_layout_t aqualung_i450t_layout = {
 	0, /* pt_mode_serial */
 };
 
+/*
+ * Send a command and receive the answer. If a payload buffer is
+ * provided, the answer without the checksum is copied into it while the
+ * checksum is calculated.
+ */
 static dc_status_t
-oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int crc_size)
+oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int crc_size, unsigned char payload[])
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -487,9 +535,17 @@ oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char comman
 		ack = NAK;
 	}
 
-	// Receive the response (ACK/NAK) of the dive computer.
+	// Receive the response (ACK/NAK) of the dive computer. The ACK byte
+	// follows the command after one round trip, so a lost packet is
+	// detected after the measured round trip time instead of the full
+	// timeout. The answer itself uses the standard timeout again.
 	unsigned char response = 0;
+	int rto = dc_iostream_get_rto (device->iostream, MINTIMEOUT, TIMEOUT);
+	if (rto != TIMEOUT)
+		dc_iostream_set_timeout (device->iostream, rto);
 	status = dc_iostream_read (device->iostream, &response, 1, NULL);
+	if (rto != TIMEOUT)
+		dc_iostream_set_timeout (device->iostream, TIMEOUT);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to receive the answer.");
 		return status;
@@ -513,12 +569,19 @@ oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char comman
 		unsigned short crc, ccrc;
 		if (crc_size == 2) {
 			crc = array_uint16_le (answer + asize - 2);
-			ccrc = checksum_add_uint16 (answer, asize - 2, 0x0000);
+			if (payload)
+				ccrc = checksum_add_uint16_copy (payload, answer, asize - 2, 0x0000);
+			else
+				ccrc = checksum_add_uint16 (answer, asize - 2, 0x0000);
 		} else {
 			crc = answer[asize - 1];
-			ccrc = checksum_add_uint8 (answer, asize - 1, 0x00);
+			if (payload)
+				ccrc = checksum_add_uint8_copy (payload, answer, asize - 1, 0x00);
+			else
+				ccrc = checksum_add_uint8 (answer, asize - 1, 0x00);
 		}
 		if (crc != ccrc) {
+			device_stats_checksum (abstract);
 			ERROR (abstract->context, "Unexpected answer checksum.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -529,7 +592,7 @@ oceanic_atom2_packet (oceanic_atom2_device_t *device, const unsigned char comman
 
 
 static dc_status_t
-oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int crc_size)
+oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned int crc_size, unsigned char payload[])
 {
 	// Send the command to the device. If the device responds with an
 	// ACK byte, the command was received successfully and the answer
@@ -537,15 +600,21 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 	// a NAK byte, we try to resend the command a number of times before
 	// returning an error.
 
+	dc_context_t *context = device->base.base.context;
+	dc_usecs_t begin = dc_context_trace_begin (context);
+	DC_PROBE3 (transfer__entry, dc_device_get_type ((dc_device_t *) device), command[0], csize);
+
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = oceanic_atom2_packet (device, command, csize, answer, asize, crc_size)) != DC_STATUS_SUCCESS) {
+	while ((rc = oceanic_atom2_packet (device, command, csize, answer, asize, crc_size, payload)) != DC_STATUS_SUCCESS) {
 		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
-			return rc;
+			break;
 
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
-			return rc;
+			break;
+
+		device_stats_retry ((dc_device_t *) device);
 
 		// Increase the inter packet delay.
 		if (device->delay < MAXDELAY)
@@ -556,7 +625,10 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 		dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
 	}
 
-	return DC_STATUS_SUCCESS;
+	DC_PROBE3 (transfer__return, dc_device_get_type ((dc_device_t *) device), command[0], rc);
+	dc_context_trace_end (context, "oceanic_atom2_transfer", begin);
+
+	return rc;
 }
 
 
@@ -565,7 +637,7 @@ oceanic_atom2_quit (oceanic_atom2_device_t *device)
 {
 	// Send the command to the dive computer.
 	unsigned char command[4] = {CMD_QUIT, 0x05, 0xA5, 0x00};
-	dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), NULL, 0, 0);
+	dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), NULL, 0, 0, NULL);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -573,6 +645,46 @@ oceanic_atom2_quit (oceanic_atom2_device_t *device)
 }
 
 
+static void
+oceanic_atom2_cache_invalidate (oceanic_atom2_device_t *device)
+{
+	for (unsigned int i = 0; i < MAXPAGES; ++i) {
+		device->cache[i].page = INVALID;
+		device->cache[i].stamp = 0;
+	}
+}
+
+
+static oceanic_atom2_page_t *
+oceanic_atom2_cache_lookup (oceanic_atom2_device_t *device, unsigned int page)
+{
+	for (unsigned int i = 0; i < device->npages; ++i) {
+		if (device->cache[i].page == page) {
+			device->cache[i].stamp = ++device->stamp;
+			return &device->cache[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+static oceanic_atom2_page_t *
+oceanic_atom2_cache_victim (oceanic_atom2_device_t *device)
+{
+	// Pick an unused slot, or else the least recently used page.
+	oceanic_atom2_page_t *victim = &device->cache[0];
+	for (unsigned int i = 0; i < device->npages; ++i) {
+		if (device->cache[i].page == INVALID)
+			return &device->cache[i];
+		if (device->cache[i].stamp < victim->stamp)
+			victim = &device->cache[i];
+	}
+
+	return victim;
+}
+
+
 dc_status_t
 oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char *name, unsigned int model)
 {
@@ -596,8 +708,10 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 	device->iostream = NULL;
 	device->delay = 0;
 	device->bigpage = 1; // no big pages
-	device->cached = INVALID;
-	memset(device->cache, 0, sizeof(device->cache));
+	device->confirmed = 0;
+	device->npages = NPAGES;
+	device->stamp = 0;
+	oceanic_atom2_cache_invalidate (device);
 
 	// Open the device.
 	status = dc_serial_open (&device->iostream, context, name);
@@ -606,6 +720,8 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Get the correct baudrate.
 	unsigned int baudrate = 38400;
 	if (model == VTX || model == I750TC) {
@@ -620,7 +736,7 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 	}
 
 	// Set the timeout for receiving data (1000 ms).
-	status = dc_iostream_set_timeout (device->iostream, 1000);
+	status = dc_iostream_set_timeout (device->iostream, TIMEOUT);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to set the timeout.");
 		goto error_close;
@@ -657,7 +773,6 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 		device->base.layout = &aeris_f10_layout;
 	} else if (OCEANIC_COMMON_MATCH (device->base.version, aeris_f11_version)) {
 		device->base.layout = &aeris_f11_layout;
-		device->bigpage = 8;
 	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom1_version)) {
 		device->base.layout = &oceanic_atom1_layout;
 	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_atom2_version)) {
@@ -694,7 +809,6 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 		device->base.layout = &oceanic_reactpro_layout;
 	} else if (OCEANIC_COMMON_MATCH (device->base.version, aeris_a300cs_version)) {
 		device->base.layout = &aeris_a300cs_layout;
-		device->bigpage = 16;
 	} else if (OCEANIC_COMMON_MATCH (device->base.version, aqualung_i450t_version)) {
 		device->base.layout = &aqualung_i450t_layout;
 	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_default_version)) {
@@ -715,6 +829,13 @@ oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char
 		}
 	}
 
+	// Use the largest multi-page read command.
+	if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_read16_version)) {
+		device->bigpage = 16;
+	} else if (OCEANIC_COMMON_MATCH (device->base.version, oceanic_read8_version)) {
+		device->bigpage = 8;
+	}
+
 	*out = (dc_device_t*) device;
 
 	return DC_STATUS_SUCCESS;
@@ -750,6 +871,33 @@ oceanic_atom2_device_close (dc_device_t *abstract)
 }
 
 
+/*
+ * A device that stays open between downloads (persistent sessions) may
+ * have recorded new dives since the last run, so the cached pages are
+ * never reused across runs.
+ */
+static dc_status_t
+oceanic_atom2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+
+	oceanic_atom2_cache_invalidate (device);
+
+	return oceanic_common_device_dump (abstract, buffer);
+}
+
+
+static dc_status_t
+oceanic_atom2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+
+	oceanic_atom2_cache_invalidate (device);
+
+	return oceanic_common_device_foreach (abstract, callback, userdata);
+}
+
+
 dc_status_t
 oceanic_atom2_device_keepalive (dc_device_t *abstract)
 {
@@ -758,9 +906,12 @@ oceanic_atom2_device_keepalive (dc_device_t *abstract)
 	if (!ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
+	if (!oceanic_common_keepalive_needed (device->iostream))
+		return DC_STATUS_SUCCESS;
+
 	// Send the command to the dive computer.
 	unsigned char command[4] = {CMD_KEEPALIVE, 0x05, 0xA5, 0x00};
-	dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), NULL, 0, 0);
+	dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), NULL, 0, 0, NULL);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -768,6 +919,24 @@ oceanic_atom2_device_keepalive (dc_device_t *abstract)
 }
 
 
+dc_status_t
+oceanic_atom2_device_set_cache (dc_device_t *abstract, unsigned int npages)
+{
+	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (npages > MAXPAGES)
+		npages = MAXPAGES;
+
+	oceanic_atom2_cache_invalidate (device);
+	device->npages = npages;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 oceanic_atom2_device_version (dc_device_t *abstract, unsigned char data[], unsigned int size)
 {
@@ -781,12 +950,10 @@ oceanic_atom2_device_version (dc_device_t *abstract, unsigned char data[], unsig
 
 	unsigned char answer[PAGESIZE + 1] = {0};
 	unsigned char command[2] = {CMD_VERSION, 0x00};
-	dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), answer, sizeof (answer), 1);
+	dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), answer, sizeof (answer), 1, data);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	memcpy (data, answer, PAGESIZE);
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -800,55 +967,91 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 		(size    % PAGESIZE != 0))
 		return DC_STATUS_INVALIDARGS;
 
-	// Pick the correct read command and number of checksum bytes.
-	unsigned char read_cmd = 0x00;
-	unsigned int crc_size = 0;
-	switch (device->bigpage) {
-	case 1:
-		read_cmd = CMD_READ1;
-		crc_size = 1;
-		break;
-	case 8:
-		read_cmd = CMD_READ8;
-		crc_size = 1;
-		break;
-	case 16:
-		read_cmd = CMD_READ16;
-		crc_size = 2;
-		break;
-	default:
-		return DC_STATUS_INVALIDARGS;
-	}
-
-	// Pick the best pagesize to use.
-	unsigned int pagesize = device->bigpage * PAGESIZE;
-
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
+		// Pick the correct read command and number of checksum bytes.
+		unsigned char read_cmd = 0x00;
+		unsigned int crc_size = 0;
+		switch (device->bigpage) {
+		case 1:
+			read_cmd = CMD_READ1;
+			crc_size = 1;
+			break;
+		case 8:
+			read_cmd = CMD_READ8;
+			crc_size = 1;
+			break;
+		case 16:
+			read_cmd = CMD_READ16;
+			crc_size = 2;
+			break;
+		default:
+			return DC_STATUS_INVALIDARGS;
+		}
+
+		// Pick the best pagesize to use.
+		unsigned int pagesize = device->bigpage * PAGESIZE;
+
 		unsigned int page = address / pagesize;
-		if (page != device->cached) {
+		unsigned char answer[256 + 2] = {0}; // Maximum we support for the known commands.
+		const unsigned char *cached = NULL;
+
+		unsigned int offset = address % pagesize;
+		unsigned int length = pagesize - offset;
+		if (nbytes + length > size)
+			length = size - nbytes;
+
+		oceanic_atom2_page_t *entry = oceanic_atom2_cache_lookup (device, page);
+		if (entry) {
+			cached = entry->data;
+		} else {
+			// The page is copied into the cache, or directly into the
+			// output buffer for a complete page, while the checksum is
+			// verified. The cache slot is released first, because its
+			// contents are overwritten even if the checksum is wrong.
+			unsigned char *payload = NULL;
+			if (device->npages) {
+				entry = oceanic_atom2_cache_victim (device);
+				entry->page = INVALID;
+				entry->stamp = 0;
+				payload = entry->data;
+			} else if (length == pagesize) {
+				payload = data;
+			}
+
 			// Read the package.
 			unsigned int number = page * device->bigpage; // This is always PAGESIZE, even in big page mode.
-			unsigned char answer[256 + 2] = {0};          // Maximum we support for the known commands.
 			unsigned char command[4] = {read_cmd,
 					(number >> 8) & 0xFF, // high
 					(number     ) & 0xFF, // low
 					0};
-			dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), answer,  pagesize + crc_size, crc_size);
-			if (rc != DC_STATUS_SUCCESS)
+			dc_status_t rc = oceanic_atom2_transfer (device, command, sizeof (command), answer,  pagesize + crc_size, crc_size, payload);
+			if (rc != DC_STATUS_SUCCESS) {
+				// If the multi-page command was never accepted, fall
+				// back to the next smaller one and try again.
+				if (device->bigpage > 1 && !device->confirmed &&
+					(rc == DC_STATUS_PROTOCOL || rc == DC_STATUS_TIMEOUT)) {
+					WARNING (abstract->context, "Multi-page read command (%u pages) not supported.", device->bigpage);
+					device->bigpage = (device->bigpage == 16) ? 8 : 1;
+					oceanic_atom2_cache_invalidate (device);
+					continue;
+				}
 				return rc;
+			}
+
+			device->confirmed = 1;
 
 			// Cache the page.
-			memcpy (device->cache, answer, pagesize);
-			device->cached = page;
-		}
+			if (entry) {
+				entry->page = page;
+				entry->stamp = ++device->stamp;
+			}
 
-		unsigned int offset = address % pagesize;
-		unsigned int length = pagesize - offset;
-		if (nbytes + length > size)
-			length = size - nbytes;
+			cached = payload ? payload : answer;
+		}
 
-		memcpy (data, device->cache + offset, length);
+		if (cached != data)
+			memcpy (data, cached + offset, length);
 
 		nbytes += length;
 		address += length;
@@ -869,7 +1072,7 @@ oceanic_atom2_device_write (dc_device_t *abstract, unsigned int address, const u
 		return DC_STATUS_INVALIDARGS;
 
 	// Invalidate the cache.
-	device->cached = INVALID;
+	oceanic_atom2_cache_invalidate (device);
 
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
@@ -879,7 +1082,7 @@ oceanic_atom2_device_write (dc_device_t *abstract, unsigned int address, const u
 				(number >> 8) & 0xFF, // high
 				(number     ) & 0xFF, // low
 				0x00};
-		dc_status_t rc = oceanic_atom2_transfer (device, prepare, sizeof (prepare), NULL, 0, 0);
+		dc_status_t rc = oceanic_atom2_transfer (device, prepare, sizeof (prepare), NULL, 0, 0, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -887,7 +1090,7 @@ oceanic_atom2_device_write (dc_device_t *abstract, unsigned int address, const u
 		unsigned char command[PAGESIZE + 2] = {0};
 		memcpy (command, data, PAGESIZE);
 		command[PAGESIZE] = checksum_add_uint8 (command, PAGESIZE, 0x00);
-		rc = oceanic_atom2_transfer (device, command, sizeof (command), NULL, 0, 0);
+		rc = oceanic_atom2_transfer (device, command, sizeof (command), NULL, 0, 0, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -97,14 +97,64 @@
 #define HEADER  1
 #define PROFILE 2
 
+#define TEMPERATURE_DELTA  0
+#define TEMPERATURE_BYTE   1
+#define TEMPERATURE_PACKED 2
+
+#define PRESSURE_NONE   0
+#define PRESSURE_DELTA  1
+#define PRESSURE_U12    2
+#define PRESSURE_U16    3
+#define PRESSURE_PACKED 4
+
+#define TANKSWITCH_SINGLE 0
+#define TANKSWITCH_1PSI   1
+#define TANKSWITCH_2PSI   2
+
+#define DEPTH_U12   0
+#define DEPTH_ATOM1 1
+
 typedef struct oceanic_atom2_parser_t oceanic_atom2_parser_t;
 
+// The encoding of the samples for a model. The layout is selected once,
+// when the parser is created, such that no model checks are needed while
+// decoding the samples.
+typedef struct oceanic_atom2_layout_t {
+	unsigned int samplesize;
+	unsigned int interval;
+	unsigned int timestamp;
+	unsigned int temperature;
+	unsigned int temperature_offset;
+	unsigned int sign_offset;
+	unsigned int sign_mask;
+	unsigned int sign_invert;
+	unsigned int pressure;
+	unsigned int pressure_offset;
+	unsigned int pressure_initial;
+	unsigned int tankswitch;
+	unsigned int tankswitch_offset;
+	unsigned int depth;
+	unsigned int depth_offset;
+	unsigned int gasmix;
+	unsigned int deco;
+	unsigned int decostop_offset;
+	unsigned int decostop_mask;
+	unsigned int decostop_shift;
+	unsigned int decotime_offset;
+	unsigned int decotime_mask;
+	unsigned int rbt;
+	unsigned int rbt_offset;
+	unsigned int rbt_mask;
+	unsigned int bookmark;
+} oceanic_atom2_layout_t;
+
 struct oceanic_atom2_parser_t {
 	dc_parser_t base;
 	unsigned int model;
 	unsigned int headersize;
 	unsigned int footersize;
 	unsigned int serial;
+	oceanic_atom2_layout_t layout;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int header;
@@ -129,10 +179,229 @@ static const dc_parser_vtable_t oceanic_atom2_parser_vtable = {
 	oceanic_atom2_parser_get_datetime, /* datetime */
 	oceanic_atom2_parser_get_field, /* fields */
 	oceanic_atom2_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
 
+static void
+oceanic_atom2_parser_layout (oceanic_atom2_layout_t *layout, unsigned int model)
+{
+	memset (layout, 0, sizeof (*layout));
+
+	// Sample size.
+	if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == TX1 || model == A300CS ||
+		model == VTX || model == I450T ||
+		model == I750TC) {
+		layout->samplesize = PAGESIZE;
+	} else {
+		layout->samplesize = PAGESIZE / 2;
+	}
+
+	// Sample interval.
+	if (model == A300CS || model == VTX ||
+		model == I450T || model == I750TC) {
+		layout->interval = 0x1f;
+	} else {
+		layout->interval = 0x17;
+	}
+
+	// Time.
+	layout->timestamp = (model == I450T);
+
+	// Temperature (°F)
+	if (model == GEO || model == ATOM1 ||
+		model == ELEMENT2 || model == MANTA ||
+		model == ZEN) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 6;
+	} else if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300 ||
+		model == I200) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 3;
+	} else if (model == OCS || model == TX1) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 1;
+	} else if (model == VT4 || model == VT41 ||
+		model == ATOM3 || model == ATOM31 ||
+		model == A300AI || model == VISION ||
+		model == XPAIR) {
+		layout->temperature = TEMPERATURE_PACKED;
+	} else if (model == A300CS || model == VTX ||
+		model == I750TC) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 11;
+	} else {
+		layout->temperature = TEMPERATURE_DELTA;
+		if (model == DG03 || model == PROPLUS3 ||
+			model == I550) {
+			layout->sign_offset = 5;
+			layout->sign_mask = 0x04;
+			layout->sign_invert = 1;
+		} else if (model == VOYAGER2G || model == AMPHOS ||
+			model == AMPHOSAIR || model == ZENAIR) {
+			layout->sign_offset = 5;
+			layout->sign_mask = 0x04;
+			layout->sign_invert = 0;
+		} else if (model == ATOM2 || model == PROPLUS21 ||
+			model == EPICA || model == EPICB ||
+			model == ATMOSAI2 ||
+			model == WISDOM2 || model == WISDOM3) {
+			layout->sign_offset = 0;
+			layout->sign_mask = 0x80;
+			layout->sign_invert = 0;
+		} else {
+			layout->sign_offset = 0;
+			layout->sign_mask = 0x80;
+			layout->sign_invert = 1;
+		}
+	}
+
+	// Tank Pressure (psi)
+	if (model == VEO30 || model == OCS ||
+		model == ELEMENT2 || model == VEO20 ||
+		model == A300 || model == ZEN ||
+		model == GEO || model == GEO20 ||
+		model == MANTA || model == I300 ||
+		model == I200) {
+		layout->pressure = PRESSURE_NONE;
+	} else if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == I450T) {
+		layout->pressure = PRESSURE_U12;
+		layout->pressure_offset = 10;
+	} else if (model == VT4 || model == VT41||
+		model == ATOM3 || model == ATOM31 ||
+		model == ZENAIR ||model == A300AI ||
+		model == DG03 || model == PROPLUS3 ||
+		model == AMPHOSAIR || model == I550 ||
+		model == VISION || model == XPAIR) {
+		layout->pressure = PRESSURE_PACKED;
+	} else if (model == TX1 || model == A300CS ||
+		model == VTX || model == I750TC) {
+		layout->pressure = PRESSURE_U16;
+		layout->pressure_offset = 4;
+	} else {
+		layout->pressure = PRESSURE_DELTA;
+		layout->pressure_offset = 1;
+	}
+
+	// Initial tank pressure.
+	if (model == A300CS || model == VTX ||
+		model == I750TC) {
+		layout->pressure_initial = 16;
+	} else {
+		layout->pressure_initial = 2;
+	}
+
+	// Tank switch.
+	if (model == DATAMASK || model == COMPUMASK) {
+		layout->tankswitch = TANKSWITCH_SINGLE;
+		layout->tankswitch_offset = 6;
+	} else if (model == A300CS || model == VTX ||
+		model == I750TC) {
+		layout->tankswitch = TANKSWITCH_1PSI;
+		layout->tankswitch_offset = 6;
+	} else if (model == ATOM2 || model == EPICA || model == EPICB) {
+		layout->tankswitch = TANKSWITCH_2PSI;
+		layout->tankswitch_offset = 3;
+	} else {
+		layout->tankswitch = TANKSWITCH_2PSI;
+		layout->tankswitch_offset = 4;
+	}
+
+	// Depth (1/16 ft)
+	if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300 ||
+		model == I200) {
+		layout->depth = DEPTH_U12;
+		layout->depth_offset = 4;
+	} else if (model == ATOM1) {
+		layout->depth = DEPTH_ATOM1;
+		layout->depth_offset = 3;
+	} else {
+		layout->depth = DEPTH_U12;
+		layout->depth_offset = 2;
+	}
+
+	// Gas mix
+	layout->gasmix = (model == TX1);
+
+	// NDL / Deco
+	layout->deco = 1;
+	if (model == A300CS || model == VTX ||
+		model == I450T || model == I750TC) {
+		layout->decostop_offset = 15;
+		layout->decostop_mask = 0x70;
+		layout->decostop_shift = 4;
+		layout->decotime_offset = 6;
+		layout->decotime_mask = 0x03FF;
+	} else if (model == ZEN || model == DG03) {
+		layout->decostop_offset = 5;
+		layout->decostop_mask = 0xF0;
+		layout->decostop_shift = 4;
+		layout->decotime_offset = 4;
+		layout->decotime_mask = 0x0FFF;
+	} else if (model == TX1) {
+		layout->decostop_offset = 10;
+		layout->decostop_mask = 0xFF;
+		layout->decostop_shift = 0;
+		layout->decotime_offset = 6;
+		layout->decotime_mask = 0xFFFF;
+	} else if (model == ATOM31 || model == VISION ||
+		model == XPAIR || model == I550) {
+		layout->decostop_offset = 5;
+		layout->decostop_mask = 0xF0;
+		layout->decostop_shift = 4;
+		layout->decotime_offset = 4;
+		layout->decotime_mask = 0x03FF;
+	} else if (model == I200 || model == I300 ||
+		model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI) {
+		layout->decostop_offset = 7;
+		layout->decostop_mask = 0xF0;
+		layout->decostop_shift = 4;
+		layout->decotime_offset = 6;
+		layout->decotime_mask = 0x0FFF;
+	} else {
+		layout->deco = 0;
+	}
+
+	// RBT
+	layout->rbt = 1;
+	if (model == ATOM31) {
+		layout->rbt_offset = 6;
+		layout->rbt_mask = 0x01FF;
+	} else if (model == I450T || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI) {
+		layout->rbt_offset = 8;
+		layout->rbt_mask = 0x01FF;
+	} else if (model == VISION || model == XPAIR ||
+		model == I550) {
+		layout->rbt_offset = 6;
+		layout->rbt_mask = 0x03FF;
+	} else {
+		layout->rbt = 0;
+	}
+
+	// Bookmarks
+	layout->bookmark = (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI);
+}
+
+
 dc_status_t
 oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial)
 {
@@ -179,6 +448,8 @@ oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 		parser->headersize = 5 * PAGESIZE;
 	}
 
+	oceanic_atom2_parser_layout (&parser->layout, model);
+
 	parser->serial = serial;
 	parser->cached = 0;
 	parser->header = 0;
@@ -478,6 +749,23 @@ oceanic_atom2_parser_cache (oceanic_atom2_parser_t *parser)
 }
 
 
+static unsigned int
+oceanic_atom2_parser_samplesize (oceanic_atom2_parser_t *parser)
+{
+	if (parser->mode == FREEDIVE) {
+		if (parser->model == F10A || parser->model == F10B ||
+			parser->model == F11A || parser->model == F11B ||
+			parser->model == MUNDIAL2 || parser->model == MUNDIAL3) {
+			return 2;
+		} else {
+			return 4;
+		}
+	}
+
+	return parser->layout.samplesize;
+}
+
+
 static dc_status_t
 oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
@@ -492,11 +780,24 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
+	// The vendor data doesn't need the profile data.
+	if (type == DC_FIELD_VENDOR) {
+		dc_field_vendor_t *vendor = (dc_field_vendor_t *) value;
+		if (vendor) {
+			unsigned int samplesize = oceanic_atom2_parser_samplesize (parser);
+			vendor->type = SAMPLE_VENDOR_OCEANIC_ATOM2;
+			vendor->offset = parser->headersize;
+			vendor->stride = samplesize;
+			vendor->count = (size - parser->footersize - parser->headersize) / samplesize;
+			vendor->data = data + parser->headersize;
+		}
+		return DC_STATUS_SUCCESS;
+	}
+
 	// Cache the profile data.
 	if (parser->cached < PROFILE) {
 		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		status = oceanic_atom2_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
+		status = dc_parser_get_statistics (abstract, &statistics);
 		if (status != DC_STATUS_SUCCESS)
 			return status;
 
@@ -587,6 +888,10 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 static void
 oceanic_atom2_parser_vendor (oceanic_atom2_parser_t *parser, const unsigned char *data, unsigned int size, unsigned int samplesize, dc_sample_callback_t callback, void *userdata)
 {
+	// Skip the vendor data if nobody is interested.
+	if (callback == NULL || !SAMPLE_WANTED (&parser->base, DC_SAMPLE_VENDOR))
+		return;
+
 	unsigned int offset = 0;
 	while (offset + samplesize <= size) {
 		dc_sample_value_t sample = {0};
@@ -625,6 +930,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	oceanic_atom2_parser_t *parser = (oceanic_atom2_parser_t *) abstract;
+	const oceanic_atom2_layout_t *layout = &parser->layout;
 
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
@@ -639,11 +945,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	unsigned int interval = 1;
 	unsigned int samplerate = 1;
 	if (parser->mode != FREEDIVE) {
-		unsigned int idx = 0x17;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I450T || parser->model == I750TC)
-			idx = 0x1f;
-		switch (data[idx] & 0x03) {
+		switch (data[layout->interval] & 0x03) {
 		case 0:
 			interval = 2;
 			break;
@@ -683,33 +985,13 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		}
 	}
 
-	unsigned int samplesize = PAGESIZE / 2;
-	if (parser->mode == FREEDIVE) {
-		if (parser->model == F10A || parser->model == F10B ||
-			parser->model == F11A || parser->model == F11B ||
-			parser->model == MUNDIAL2 || parser->model == MUNDIAL3) {
-			samplesize = 2;
-		} else {
-			samplesize = 4;
-		}
-	} else if (parser->model == OC1A || parser->model == OC1B ||
-		parser->model == OC1C || parser->model == OCI ||
-		parser->model == TX1 || parser->model == A300CS ||
-		parser->model == VTX || parser->model == I450T ||
-		parser->model == I750TC) {
-		samplesize = PAGESIZE;
-	}
+	unsigned int samplesize = oceanic_atom2_parser_samplesize (parser);
 
 	unsigned int have_temperature = 1, have_pressure = 1;
 	if (parser->mode == FREEDIVE) {
 		have_temperature = 0;
 		have_pressure = 0;
-	} else if (parser->model == VEO30 || parser->model == OCS ||
-		parser->model == ELEMENT2 || parser->model == VEO20 ||
-		parser->model == A300 || parser->model == ZEN ||
-		parser->model == GEO || parser->model == GEO20 ||
-		parser->model == MANTA || parser->model == I300 ||
-		parser->model == I200) {
+	} else if (layout->pressure == PRESSURE_NONE) {
 		have_pressure = 0;
 	}
 
@@ -723,11 +1005,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	unsigned int tank = 0;
 	unsigned int pressure = 0;
 	if (have_pressure) {
-		unsigned int idx = 2;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I750TC)
-			idx = 16;
-		pressure = array_uint16_le(data + parser->header + idx);
+		pressure = array_uint16_le(data + parser->header + layout->pressure_initial);
 		if (pressure == 10000)
 			have_pressure = 0;
 	}
@@ -773,22 +1051,23 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 		// Check for a tank switch sample.
 		if (sampletype == 0xAA) {
-			if (parser->model == DATAMASK || parser->model == COMPUMASK) {
+			unsigned int idx = offset + layout->tankswitch_offset;
+			switch (layout->tankswitch) {
+			case TANKSWITCH_SINGLE:
 				// Tank pressure (1 psi) and number
 				tank = 0;
-				pressure = (((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF);
-			} else if (parser->model == A300CS || parser->model == VTX ||
-				parser->model == I750TC) {
+				pressure = array_uint16_le (data + idx) & 0x0FFF;
+				break;
+			case TANKSWITCH_1PSI:
 				// Tank pressure (1 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
-				pressure = ((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF;
-			} else {
+				pressure = array_uint16_le (data + idx) & 0x0FFF;
+				break;
+			default:
 				// Tank pressure (2 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
-				if (parser->model == ATOM2 || parser->model == EPICA || parser->model == EPICB)
-					pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
-				else
-					pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				pressure = (array_uint16_be (data + idx) & 0x0FFF) * 2;
+				break;
 			}
 		} else if (sampletype == 0xBB) {
 			// The surface time is not always a nice multiple of the samplerate.
@@ -827,7 +1106,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			}
 
 			// Time.
-			if (parser->model == I450T) {
+			if (layout->timestamp) {
 				unsigned int minute = bcd2dec(data[offset + 0]);
 				unsigned int hour   = bcd2dec(data[offset + 1] & 0x0F);
 				unsigned int second = bcd2dec(data[offset + 2]);
@@ -855,43 +1134,13 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Temperature (°F)
 			if (have_temperature) {
-				if (parser->model == GEO || parser->model == ATOM1 ||
-					parser->model == ELEMENT2 || parser->model == MANTA ||
-					parser->model == ZEN) {
-					temperature = data[offset + 6];
-				} else if (parser->model == GEO20 || parser->model == VEO20 ||
-					parser->model == VEO30 || parser->model == OC1A ||
-					parser->model == OC1B || parser->model == OC1C ||
-					parser->model == OCI || parser->model == A300 ||
-					parser->model == I450T || parser->model == I300 ||
-					parser->model == I200) {
-					temperature = data[offset + 3];
-				} else if (parser->model == OCS || parser->model == TX1) {
-					temperature = data[offset + 1];
-				} else if (parser->model == VT4 || parser->model == VT41 ||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == A300AI || parser->model == VISION ||
-					parser->model == XPAIR) {
+				if (layout->temperature == TEMPERATURE_BYTE) {
+					temperature = data[offset + layout->temperature_offset];
+				} else if (layout->temperature == TEMPERATURE_PACKED) {
 					temperature = ((data[offset + 7] & 0xF0) >> 4) | ((data[offset + 7] & 0x0C) << 2) | ((data[offset + 5] & 0x0C) << 4);
-				} else if (parser->model == A300CS || parser->model == VTX ||
-					parser->model == I750TC) {
-					temperature = data[offset + 11];
 				} else {
-					unsigned int sign;
-					if (parser->model == DG03 || parser->model == PROPLUS3 ||
-						parser->model == I550)
-						sign = (~data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == VOYAGER2G || parser->model == AMPHOS ||
-						parser->model == AMPHOSAIR || parser->model == ZENAIR)
-						sign = (data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == ATOM2 || parser->model == PROPLUS21 ||
-						parser->model == EPICA || parser->model == EPICB ||
-						parser->model == ATMOSAI2 ||
-						parser->model == WISDOM2 || parser->model == WISDOM3)
-						sign = (data[offset + 0] & 0x80) >> 7;
-					else
-						sign = (~data[offset + 0] & 0x80) >> 7;
-					if (sign)
+					unsigned int sign = (data[offset + layout->sign_offset] & layout->sign_mask) ? 1 : 0;
+					if (sign ^ layout->sign_invert)
 						temperature -= (data[offset + 7] & 0x0C) >> 2;
 					else
 						temperature += (data[offset + 7] & 0x0C) >> 2;
@@ -902,22 +1151,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Tank Pressure (psi)
 			if (have_pressure) {
-				if (parser->model == OC1A || parser->model == OC1B ||
-					parser->model == OC1C || parser->model == OCI ||
-					parser->model == I450T)
-					pressure = (data[offset + 10] + (data[offset + 11] << 8)) & 0x0FFF;
-				else if (parser->model == VT4 || parser->model == VT41||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == ZENAIR ||parser->model == A300AI ||
-					parser->model == DG03 || parser->model == PROPLUS3 ||
-					parser->model == AMPHOSAIR || parser->model == I550 ||
-					parser->model == VISION || parser->model == XPAIR)
+				if (layout->pressure == PRESSURE_U12)
+					pressure = array_uint16_le (data + offset + layout->pressure_offset) & 0x0FFF;
+				else if (layout->pressure == PRESSURE_PACKED)
 					pressure = (((data[offset + 0] & 0x03) << 8) + data[offset + 1]) * 5;
-				else if (parser->model == TX1 || parser->model == A300CS ||
-					parser->model == VTX || parser->model == I750TC)
-					pressure = array_uint16_le (data + offset + 4);
+				else if (layout->pressure == PRESSURE_U16)
+					pressure = array_uint16_le (data + offset + layout->pressure_offset);
 				else
-					pressure -= data[offset + 1];
+					pressure -= data[offset + layout->pressure_offset];
 				sample.pressure.tank = tank;
 				sample.pressure.value = pressure * PSI / BAR;
 				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
@@ -927,66 +1168,31 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			unsigned int depth;
 			if (parser->mode == FREEDIVE)
 				depth = array_uint16_le (data + offset);
-			else if (parser->model == GEO20 || parser->model == VEO20 ||
-				parser->model == VEO30 || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI || parser->model == A300 ||
-				parser->model == I450T || parser->model == I300 ||
-				parser->model == I200)
-				depth = (data[offset + 4] + (data[offset + 5] << 8)) & 0x0FFF;
-			else if (parser->model == ATOM1)
-				depth = data[offset + 3] * 16;
+			else if (layout->depth == DEPTH_ATOM1)
+				depth = data[offset + layout->depth_offset] * 16;
 			else
-				depth = (data[offset + 2] + (data[offset + 3] << 8)) & 0x0FFF;
+				depth = array_uint16_le (data + offset + layout->depth_offset) & 0x0FFF;
 			sample.depth = depth / 16.0 * FEET;
 			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
 			// Gas mix
-			unsigned int have_gasmix = 0;
-			unsigned int gasmix = 0;
-			if (parser->model == TX1) {
-				gasmix = data[offset] & 0x07;
-				have_gasmix = 1;
-			}
-			if (have_gasmix && gasmix != gasmix_previous) {
-				if (gasmix < 1 || gasmix > parser->ngasmixes) {
-					ERROR (abstract->context, "Invalid gas mix index (%u).", gasmix);
-					return DC_STATUS_DATAFORMAT;
+			if (layout->gasmix) {
+				unsigned int gasmix = data[offset] & 0x07;
+				if (gasmix != gasmix_previous) {
+					if (gasmix < 1 || gasmix > parser->ngasmixes) {
+						ERROR (abstract->context, "Invalid gas mix index (%u).", gasmix);
+						return DC_STATUS_DATAFORMAT;
+					}
+					sample.gasmix = gasmix - 1;
+					if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+					gasmix_previous = gasmix;
 				}
-				sample.gasmix = gasmix - 1;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-				gasmix_previous = gasmix;
 			}
 
 			// NDL / Deco
-			unsigned int have_deco = 0;
-			unsigned int decostop = 0, decotime = 0;
-			if (parser->model == A300CS || parser->model == VTX ||
-				parser->model == I450T || parser->model == I750TC) {
-				decostop = (data[offset + 15] & 0x70) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == ZEN || parser->model == DG03) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x0FFF;
-				have_deco = 1;
-			} else if (parser->model == TX1) {
-				decostop = data[offset + 10];
-				decotime = array_uint16_le(data + offset + 6);
-				have_deco = 1;
-			} else if (parser->model == ATOM31 || parser->model == VISION ||
-				parser->model == XPAIR || parser->model == I550) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == I200 || parser->model == I300 ||
-				parser->model == OC1A || parser->model == OC1B ||
-				parser->model == OC1C || parser->model == OCI) {
-				decostop = (data[offset + 7] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x0FFF;
-				have_deco = 1;
-			}
-			if (have_deco) {
+			if (layout->deco) {
+				unsigned int decostop = (data[offset + layout->decostop_offset] & layout->decostop_mask) >> layout->decostop_shift;
+				unsigned int decotime = array_uint16_le (data + offset + layout->decotime_offset) & layout->decotime_mask;
 				if (decostop) {
 					sample.deco.type = DC_DECO_DECOSTOP;
 					sample.deco.depth = decostop * 10 * FEET;
@@ -998,33 +1204,14 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 				if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
 			}
 
-			unsigned int have_rbt = 0;
-			unsigned int rbt = 0;
-			if (parser->model == ATOM31) {
-				rbt = array_uint16_le(data + offset + 6) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == I450T || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI) {
-				rbt = array_uint16_le(data + offset + 8) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == VISION || parser->model == XPAIR ||
-				parser->model == I550) {
-				rbt = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_rbt = 1;
-			}
-			if (have_rbt) {
-				sample.rbt = rbt;
+			// RBT
+			if (layout->rbt) {
+				sample.rbt = array_uint16_le (data + offset + layout->rbt_offset) & layout->rbt_mask;
 				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
 			}
 
 			// Bookmarks
-			unsigned int have_bookmark = 0;
-			if (parser->model == OC1A || parser->model == OC1B ||
-				parser->model == OC1C || parser->model == OCI) {
-				have_bookmark = data[offset + 12] & 0x80;
-			}
-			if (have_bookmark) {
+			if (layout->bookmark && (data[offset + 12] & 0x80)) {
 				sample.event.type = SAMPLE_EVENT_BOOKMARK;
 				sample.event.time = 0;
 				sample.event.flags = 0;
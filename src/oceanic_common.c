@@ -26,6 +26,7 @@
 #include "oceanic_common.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "iostream-private.h"
 #include "ringbuffer.h"
 #include "rbstream.h"
 #include "array.h"
@@ -40,6 +41,33 @@
 
 #define INVALID 0
 
+#define READAHEAD (PAGESIZE * 64)
+
+#define KEEPALIVE_IDLE 2000
+
+typedef struct oceanic_common_dive_t {
+	unsigned int entry;
+	unsigned int size;
+	unsigned int gap;
+} oceanic_common_dive_t;
+
+typedef struct oceanic_common_logbook_t {
+	const unsigned char *fingerprint;
+	dc_context_t *context;
+	unsigned int found;
+} oceanic_common_logbook_t;
+
+typedef struct oceanic_common_profile_t {
+	const oceanic_common_layout_t *layout;
+	const unsigned char *logbooks;
+	const oceanic_common_dive_t *dives;
+	unsigned int ndives;
+	unsigned int current;
+	unsigned int cancelled;
+	dc_dive_callback_t callback;
+	void *userdata;
+} oceanic_common_profile_t;
+
 static unsigned int
 get_profile_first (const unsigned char data[], const oceanic_common_layout_t *layout)
 {
@@ -124,6 +152,18 @@ oceanic_common_device_init (oceanic_common_device_t *device)
 	device->multipage = 1;
 }
 
+int
+oceanic_common_keepalive_needed (dc_iostream_t *iostream)
+{
+	// Any command resets the inactivity timeout of the device, so a
+	// keepalive is only needed if the link has been idle for a while.
+	int idle = dc_iostream_get_idle (iostream);
+	if (idle >= 0 && idle < KEEPALIVE_IDLE)
+		return 0;
+
+	return 1;
+}
+
 
 dc_status_t
 oceanic_common_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
@@ -173,6 +213,34 @@ oceanic_common_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 }
 
 
+static dc_status_t
+oceanic_common_logbook_record (unsigned char data[], unsigned int size, dc_rbstream_record_t *next, void *userdata)
+{
+	oceanic_common_logbook_t *logbook = (oceanic_common_logbook_t *) userdata;
+
+	// Check for uninitialized entries. Normally, such entries are
+	// never present, except when the ringbuffer is actually empty,
+	// but the ringbuffer pointers are not set to their empty values.
+	// This appears to happen on some devices, and we attempt to
+	// fix this here.
+	if (array_isequal (data, size, 0xFF)) {
+		WARNING (logbook->context, "Uninitialized logbook entries detected!");
+		logbook->found = 1;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Compare the fingerprint to identify previously downloaded entries.
+	if (memcmp (data, logbook->fingerprint, size) == 0) {
+		logbook->found = 1;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// The entry before the current one.
+	next->size = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook)
 {
@@ -271,39 +339,21 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 	// entries first. If an already downloaded entry is identified (by means
 	// of its fingerprint), the transfer is aborted immediately to reduce
 	// the transfer time.
-	unsigned int nbytes = 0;
-	unsigned int offset = rb_logbook_size;
-	while (nbytes < rb_logbook_size) {
-		// Move to the start of the current entry.
-		offset -= layout->rb_logbook_entry_size;
-
-		// Read the logbook entry.
-		rc = dc_rbstream_read (rbstream, progress, logbooks + offset, layout->rb_logbook_entry_size);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read the memory.");
-			dc_rbstream_free (rbstream);
-			return rc;
-		}
-
-		nbytes += layout->rb_logbook_entry_size;
+	oceanic_common_logbook_t state = {device->fingerprint, abstract->context, 0};
+	dc_rbstream_record_t first = {layout->rb_logbook_entry_size, 0};
+	unsigned int offset = 0;
+	rc = dc_rbstream_walk (rbstream, progress, logbooks, rb_logbook_size, &first, oceanic_common_logbook_record, &state, &offset);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory.");
+		dc_rbstream_free (rbstream);
+		return rc;
+	}
 
-		// Check for uninitialized entries. Normally, such entries are
-		// never present, except when the ringbuffer is actually empty,
-		// but the ringbuffer pointers are not set to their empty values.
-		// This appears to happen on some devices, and we attempt to
-		// fix this here.
-		if (array_isequal (logbooks + offset, layout->rb_logbook_entry_size, 0xFF)) {
-			WARNING (abstract->context, "Uninitialized logbook entries detected!");
-			offset += layout->rb_logbook_entry_size;
-			break;
-		}
+	unsigned int nbytes = rb_logbook_size - offset;
 
-		// Compare the fingerprint to identify previously downloaded entries.
-		if (memcmp (logbooks + offset, device->fingerprint, layout->rb_logbook_entry_size) == 0) {
-			offset += layout->rb_logbook_entry_size;
-			break;
-		}
-	}
+	// Exclude the entry that stopped the walk.
+	if (state.found)
+		offset += layout->rb_logbook_entry_size;
 
 	// Update and emit a progress event.
 	progress->maximum -= rb_logbook_size - nbytes;
@@ -317,6 +367,31 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 }
 
 
+static dc_status_t
+oceanic_common_profile_record (unsigned char data[], unsigned int size, dc_rbstream_record_t *next, void *userdata)
+{
+	oceanic_common_profile_t *profile = (oceanic_common_profile_t *) userdata;
+	const oceanic_common_layout_t *layout = profile->layout;
+	const oceanic_common_dive_t *dive = &profile->dives[profile->current];
+
+	// Prepend the logbook entry to the profile data, in the space
+	// reserved in front of the dive.
+	memcpy (data, profile->logbooks + dive->entry, layout->rb_logbook_entry_size);
+
+	if (profile->callback && !profile->callback (data, dive->size + layout->rb_logbook_entry_size, data, layout->rb_logbook_entry_size, profile->userdata)) {
+		profile->cancelled = 1;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// The profiles are read in the same order, most recent dives first.
+	if (++profile->current < profile->ndives) {
+		next->size = profile->dives[profile->current].size + profile->dives[profile->current].gap;
+		next->reserve = layout->rb_logbook_entry_size;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook, dc_dive_callback_t callback, void *userdata)
 {
@@ -336,10 +411,22 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 
 	// Go through the logbook entries a first time, to get the end of
 	// profile pointer and calculate the total amount of bytes in the
-	// profile ringbuffer.
+	// profile ringbuffer. The location of every profile is stored, so
+	// the pointers don't need to be decoded again when reading them.
 	unsigned int rb_profile_end  = INVALID;
 	unsigned int rb_profile_size = 0;
 
+	unsigned int ndives = 0;
+	oceanic_common_dive_t *dives = (oceanic_common_dive_t *) malloc (
+		(rb_logbook_size / layout->rb_logbook_entry_size + 1) * sizeof (oceanic_common_dive_t));
+	if (dives == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// An invalid pointer is reported after all dives before it.
+	dc_status_t status = DC_STATUS_SUCCESS;
+
 	// Traverse the logbook ringbuffer backwards to retrieve the most recent
 	// dives first. The logbook ringbuffer is linearized at this point, so
 	// we do not have to take into account any memory wrapping near the end
@@ -361,6 +448,7 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 		{
 			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
 				rb_entry_first, rb_entry_last);
+			status = DC_STATUS_DATAFORMAT;
 			break;
 		}
 
@@ -390,10 +478,20 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 		// Update the total profile size.
 		rb_profile_size += rb_entry_size + gap;
 
+		dives[ndives].entry = entry;
+		dives[ndives].size = rb_entry_size;
+		dives[ndives].gap = gap;
+		ndives++;
+
 		remaining -= rb_entry_size + gap;
 		previous = rb_entry_first;
 	}
 
+	if (ndives == 0) {
+		free (dives);
+		return status;
+	}
+
 	// At this point, we know the exact amount of data
 	// that needs to be transfered for the profiles.
 	progress->maximum -= (layout->rb_profile_end - layout->rb_profile_begin) - rb_profile_size;
@@ -404,6 +502,16 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 	rc = dc_rbstream_new (&rbstream, abstract, PAGESIZE, PAGESIZE * device->multipage, layout->rb_profile_begin, layout->rb_profile_end, rb_profile_end);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+		free (dives);
+		return rc;
+	}
+
+	// Read ahead, up to the total size of the profile data. The profiles
+	// are read back to back, so the stream merges them into large reads.
+	rc = dc_rbstream_set_readahead (rbstream, READAHEAD, rb_profile_size);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_rbstream_free (rbstream);
+		free (dives);
 		return rc;
 	}
 
@@ -412,88 +520,30 @@ oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progr
 	if (profiles == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		dc_rbstream_free (rbstream);
+		free (dives);
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Keep track of the current position.
-	unsigned int offset = rb_profile_size + rb_logbook_size;
-
-	// Traverse the logbook ringbuffer backwards to retrieve the most recent
-	// dives first. The logbook ringbuffer is linearized at this point, so
-	// we do not have to take into account any memory wrapping near the end
-	// of the memory buffer.
-	remaining = rb_profile_size;
-	previous = rb_profile_end;
-	entry = rb_logbook_size;
-	while (entry) {
-		// Move to the start of the current entry.
-		entry -= layout->rb_logbook_entry_size;
-
-		// Get the profile pointers.
-		unsigned int rb_entry_first = get_profile_first (logbooks + entry, layout);
-		unsigned int rb_entry_last  = get_profile_last (logbooks + entry, layout);
-		if (rb_entry_first < layout->rb_profile_begin ||
-			rb_entry_first >= layout->rb_profile_end ||
-			rb_entry_last < layout->rb_profile_begin ||
-			rb_entry_last >= layout->rb_profile_end)
-		{
-			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
-				rb_entry_first, rb_entry_last);
-			dc_rbstream_free (rbstream);
-			free (profiles);
-			return DC_STATUS_DATAFORMAT;
-		}
-
-		// Calculate the end pointer and the number of bytes.
-		unsigned int rb_entry_end   = RB_PROFILE_INCR (rb_entry_last, PAGESIZE, layout);
-		unsigned int rb_entry_size  = RB_PROFILE_DISTANCE (rb_entry_first, rb_entry_last, layout) + PAGESIZE;
-
-		// Skip gaps between the profiles.
-		unsigned int gap = 0;
-		if (rb_entry_end != previous) {
-			WARNING (abstract->context, "Profiles are not continuous.");
-			gap = RB_PROFILE_DISTANCE (rb_entry_end, previous, layout);
-		}
-
-		// Make sure the profile size is valid.
-		if (rb_entry_size + gap > remaining) {
-			WARNING (abstract->context, "Unexpected profile size.");
-			break;
-		}
-
-		// Move to the start of the current dive.
-		offset -= rb_entry_size + gap;
-
-		// Read the dive.
-		rc = dc_rbstream_read (rbstream, progress, profiles + offset, rb_entry_size + gap);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to read the dive.");
-			dc_rbstream_free (rbstream);
-			free (profiles);
-			return rc;
-		}
-
-		remaining -= rb_entry_size + gap;
-		previous = rb_entry_first;
-
-		// Prepend the logbook entry to the profile data. The memory buffer is
-		// large enough to store this entry.
-		offset -= layout->rb_logbook_entry_size;
-		memcpy (profiles + offset, logbooks + entry, layout->rb_logbook_entry_size);
-
-		unsigned char *p = profiles + offset;
-		if (callback && !callback (p, rb_entry_size + layout->rb_logbook_entry_size, p, layout->rb_logbook_entry_size, userdata)) {
-			break;
-		}
+	// Read the profiles in the same order, most recent dives first. The
+	// memory buffer is large enough to store a logbook entry in front of
+	// every profile.
+	oceanic_common_profile_t state = {layout, logbooks, dives, ndives, 0, 0, callback, userdata};
+	dc_rbstream_record_t first = {dives[0].size + dives[0].gap, layout->rb_logbook_entry_size};
+	rc = dc_rbstream_walk (rbstream, progress, profiles, rb_profile_size + rb_logbook_size, &first, oceanic_common_profile_record, &state, NULL);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the dive.");
+		status = rc;
+	} else if (state.cancelled) {
+		status = DC_STATUS_SUCCESS;
 	}
 
 	dc_rbstream_free (rbstream);
 	free (profiles);
+	free (dives);
 
-	return DC_STATUS_SUCCESS;
+	return status;
 }
 
-
 dc_status_t
 oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -545,12 +595,13 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Memory buffer for the logbook data.
-	dc_buffer_t *logbook = dc_buffer_new (0);
+	dc_buffer_t *logbook = dc_buffer_new2 (abstract->context, 0);
 	if (logbook == NULL) {
 		return DC_STATUS_NOMEMORY;
 	}
 
 	// Download the logbook ringbuffer.
+	device_set_phase (abstract, DC_PHASE_LOGBOOK);
 	rc = VTABLE(abstract)->logbook (abstract, &progress, logbook);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (logbook);
@@ -564,6 +615,7 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	}
 
 	// Download the profile ringbuffer.
+	device_set_phase (abstract, DC_PHASE_PROFILE);
 	rc = VTABLE(abstract)->profile (abstract, &progress, logbook, callback, userdata);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (logbook);
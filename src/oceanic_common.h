@@ -80,6 +80,9 @@ oceanic_common_match (const unsigned char *version, const oceanic_common_version
 void
 oceanic_common_device_init (oceanic_common_device_t *device);
 
+int
+oceanic_common_keepalive_needed (dc_iostream_t *iostream);
+
 dc_status_t
 oceanic_common_device_logbook (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook);
 
@@ -148,6 +148,8 @@ oceanic_veo250_transfer (oceanic_veo250_device_t *device, const unsigned char co
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Delay the next attempt.
 		dc_iostream_sleep (device->iostream, 100);
 	}
@@ -258,6 +260,8 @@ oceanic_veo250_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -360,6 +364,9 @@ oceanic_veo250_device_keepalive (dc_device_t *abstract)
 	if (!ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
+	if (!oceanic_common_keepalive_needed (device->iostream))
+		return DC_STATUS_SUCCESS;
+
 	unsigned char answer[2] = {0};
 	unsigned char command[4] = {0x91,
 		(device->last     ) & 0xFF, // low
@@ -400,6 +407,7 @@ oceanic_veo250_device_version (dc_device_t *abstract, unsigned char data[], unsi
 	unsigned char crc = answer[PAGESIZE];
 	unsigned char ccrc = checksum_add_uint8 (answer, PAGESIZE, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -448,6 +456,7 @@ oceanic_veo250_device_read (dc_device_t *abstract, unsigned int address, unsigne
 			unsigned char crc = answer[offset + PAGESIZE];
 			unsigned char ccrc = checksum_add_uint8 (answer + offset, PAGESIZE, 0x00);
 			if (crc != ccrc) {
+				device_stats_checksum (abstract);
 				ERROR (abstract->context, "Unexpected answer checksum.");
 				return DC_STATUS_PROTOCOL;
 			}
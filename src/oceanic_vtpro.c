@@ -185,6 +185,8 @@ oceanic_vtpro_transfer (oceanic_vtpro_device_t *device, const unsigned char comm
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
 			return rc;
+
+		device_stats_retry ((dc_device_t *) device);
 	}
 
 	if (asize) {
@@ -351,6 +353,7 @@ oceanic_aeris500ai_device_logbook (dc_device_t *abstract, dc_event_progress_t *p
 		unsigned char crc = answer[PAGESIZE / 2];
 		unsigned char ccrc = checksum_add_uint4 (answer, PAGESIZE / 2, 0x00);
 		if (crc != ccrc) {
+			device_stats_checksum (abstract);
 			ERROR (abstract->context, "Unexpected answer checksum.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -426,6 +429,8 @@ oceanic_vtpro_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -537,6 +542,9 @@ oceanic_vtpro_device_keepalive (dc_device_t *abstract)
 	if (!ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
+	if (!oceanic_common_keepalive_needed (device->iostream))
+		return DC_STATUS_SUCCESS;
+
 	// Send the command to the dive computer.
 	unsigned char answer[1] = {0};
 	unsigned char command[4] = {0x6A, 0x08, 0x00, 0x00};
@@ -579,6 +587,7 @@ oceanic_vtpro_device_version (dc_device_t *abstract, unsigned char data[], unsig
 	unsigned char crc = ans[PAGESIZE / 2];
 	unsigned char ccrc = checksum_add_uint4 (ans, PAGESIZE / 2, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -597,6 +606,7 @@ oceanic_vtpro_device_version (dc_device_t *abstract, unsigned char data[], unsig
 			unsigned char crc = answer[PAGESIZE / 2];
 			unsigned char ccrc = checksum_add_uint4 (answer, PAGESIZE / 2, 0x00);
 			if (crc != ccrc) {
+				device_stats_checksum (abstract);
 				ERROR (abstract->context, "Unexpected answer checksum.");
 				return DC_STATUS_PROTOCOL;
 			}
@@ -655,6 +665,7 @@ oceanic_vtpro_device_read (dc_device_t *abstract, unsigned int address, unsigned
 			unsigned char crc = answer[offset + PAGESIZE];
 			unsigned char ccrc = checksum_add_uint8 (answer + offset, PAGESIZE, 0x00);
 			if (crc != ccrc) {
+				device_stats_checksum (abstract);
 				ERROR (abstract->context, "Unexpected answer checksum.");
 				return DC_STATUS_PROTOCOL;
 			}
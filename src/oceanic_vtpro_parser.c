@@ -56,6 +56,9 @@ static const dc_parser_vtable_t oceanic_vtpro_parser_vtable = {
 	oceanic_vtpro_parser_get_datetime, /* datetime */
 	oceanic_vtpro_parser_get_field, /* fields */
 	oceanic_vtpro_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -158,10 +161,22 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
+	// The vendor data doesn't need the profile data.
+	if (type == DC_FIELD_VENDOR) {
+		dc_field_vendor_t *vendor = (dc_field_vendor_t *) value;
+		if (vendor) {
+			vendor->type = SAMPLE_VENDOR_OCEANIC_VTPRO;
+			vendor->offset = 5 * PAGESIZE / 2;
+			vendor->stride = PAGESIZE / 2;
+			vendor->count = (size - PAGESIZE - 5 * PAGESIZE / 2) / (PAGESIZE / 2);
+			vendor->data = data + 5 * PAGESIZE / 2;
+		}
+		return DC_STATUS_SUCCESS;
+	}
+
 	if (!parser->cached) {
 		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = oceanic_vtpro_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
+		dc_status_t rc = dc_parser_get_statistics (abstract, &statistics);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -31,16 +31,103 @@ extern "C" {
 
 struct dc_parser_t;
 struct dc_parser_vtable_t;
+struct dc_parser_pool_t;
 
 typedef struct dc_parser_vtable_t dc_parser_vtable_t;
+typedef struct dc_parser_pool_t dc_parser_pool_t;
+
+typedef struct sample_statistics_t {
+	unsigned int divetime;
+	double maxdepth;
+} sample_statistics_t;
+
+#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0}
+
+#define SUMMARY_FIELDS 7
+
+typedef struct dc_parser_summary_t {
+	// Memoized summary fields (one bit per slot).
+	unsigned int cached;
+	dc_status_t status[SUMMARY_FIELDS];
+	union {
+		unsigned int u;
+		double d;
+	} value[SUMMARY_FIELDS];
+	// Statistics of the last complete profile walk.
+	unsigned int profile;
+	sample_statistics_t statistics;
+} dc_parser_summary_t;
+
+/*
+ * Profile index, filled by the backends during their first sweep over
+ * the profile data, and reused by the later passes. Each record holds
+ * the offset of a sample record, and the gas mix index of a gas switch
+ * in that record (or DC_GASMIX_UNKNOWN). The end field holds the end of
+ * the profile data, for backends that have to search for it.
+ */
+typedef struct dc_profile_record_t {
+	unsigned int offset;
+	unsigned int gasmix;
+} dc_profile_record_t;
+
+typedef struct dc_profile_index_t {
+	unsigned int valid;
+	unsigned int end;
+	unsigned int count;
+	unsigned int capacity;
+	dc_profile_record_t *records;
+} dc_profile_index_t;
+
+/*
+ * The work of the current call, counted against the work limits.
+ */
+typedef struct dc_parser_work_t {
+	unsigned int records;
+	unsigned int bytes;
+	unsigned int descriptors;
+	unsigned int exceeded;
+} dc_parser_work_t;
 
 struct dc_parser_t {
 	const dc_parser_vtable_t *vtable;
 	dc_context_t *context;
 	const unsigned char *data;
 	unsigned int size;
+	// Creation parameters (for the parser pool).
+	dc_family_t family;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	// Summary cache.
+	dc_parser_summary_t summary;
+	// Profile index.
+	dc_profile_index_t index;
+	// Sample decimation.
+	dc_decimation_t decimation;
+	unsigned int npoints;
+	// Wanted sample types.
+	unsigned int samples;
+	// Resampling interval, and the types with step interpolation.
+	unsigned int resample;
+	unsigned int interpolation;
+	// Merge the repeated events into spans.
+	unsigned int coalesce;
+	// Derived metrics.
+	dc_sample_derived_t *derived;
+	// Work limits, and the work of the current call.
+	dc_parser_limits_t limits;
+	dc_parser_work_t work;
+	// Memory statistics of the current dive.
+	dc_memory_stats_t memory;
 };
 
+/*
+ * Check whether the application wants samples of the given type.
+ * Backends use this to skip the expensive decoding of unwanted types.
+ */
+#define SAMPLE_WANTED(parser, type) (((parser)->samples & (1u << (type))) != 0)
+
 struct dc_parser_vtable_t {
 	size_t size;
 
@@ -54,6 +141,16 @@ struct dc_parser_vtable_t {
 
 	dc_status_t (*samples_foreach) (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+	dc_status_t (*samples_batch) (dc_parser_t *parser, dc_sample_table_t *table);
+
+	// Report at least all rows in the time range [begin, end], preceded
+	// by the gas mix in effect at the start of the range.
+	dc_status_t (*samples_range) (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata);
+
+	// Consume the next size bytes of the dive data, and report the samples
+	// that are complete. A size of zero marks the end of the data.
+	dc_status_t (*samples_feed) (dc_parser_t *parser, const unsigned char data[], unsigned int size, dc_sample_callback_t callback, void *userdata);
+
 	dc_status_t (*destroy) (dc_parser_t *parser);
 };
 
@@ -66,16 +163,92 @@ dc_parser_deallocate (dc_parser_t *parser);
 int
 dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable);
 
-typedef struct sample_statistics_t {
-	unsigned int divetime;
-	double maxdepth;
-} sample_statistics_t;
+/*
+ * Forget the memoized summary fields. Backends call this from every
+ * setter that changes the result of the fields, such as a calibration.
+ */
+void
+dc_parser_invalidate_summary (dc_parser_t *parser);
 
-#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0}
+dc_status_t
+dc_parser_pool_new (dc_parser_pool_t **pool, unsigned int size);
+
+void
+dc_parser_pool_free (dc_parser_pool_t *pool);
+
+void
+dc_profile_index_reset (dc_profile_index_t *index);
+
+dc_status_t
+dc_profile_index_append (dc_parser_t *parser, unsigned int offset, unsigned int gasmix);
+
+/*
+ * Account for the work of the backend. Once one of the limits is
+ * exceeded, DC_STATUS_DATAFORMAT is returned, and the exceeded flag of
+ * the work remains set until the next call on the parser.
+ */
+dc_status_t
+dc_parser_work (dc_parser_t *parser, unsigned int records, unsigned int bytes, unsigned int descriptors);
 
 void
 sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+dc_status_t
+dc_parser_get_statistics (dc_parser_t *parser, sample_statistics_t *statistics);
+
+void
+sample_table_reset (dc_sample_table_t *table);
+
+void
+sample_table_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+
+dc_status_t
+sample_resample (dc_parser_t *parser, dc_sample_table_t *table);
+
+#define SAMPLE_COALESCE_MAX 16
+
+typedef struct sample_coalesce_event_t {
+	unsigned int type;
+	const char *name;
+	unsigned int flags;
+	unsigned int value;
+	unsigned int seen;
+} sample_coalesce_event_t;
+
+/*
+ * Event coalescing filter, between a backend and a sample callback.
+ * The events of the current run are kept, with a flag whether they
+ * were repeated in the current sample.
+ */
+typedef struct sample_coalesce_t {
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int count;
+	sample_coalesce_event_t active[SAMPLE_COALESCE_MAX];
+} sample_coalesce_t;
+
+void
+sample_coalesce_init (sample_coalesce_t *coalesce, dc_sample_callback_t callback, void *userdata);
+
+void
+sample_coalesce_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+
+void
+sample_coalesce_finish (sample_coalesce_t *coalesce);
+
+/*
+ * Walk the samples of the backend, with the event coalescing of the
+ * parser applied.
+ */
+dc_status_t
+sample_walk (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+
+void
+sample_derived_compute (dc_parser_t *parser, const dc_sample_table_t *table, dc_sample_derived_t *derived);
+
+void
+sample_deco_compute (dc_parser_t *parser, const dc_sample_table_t *table, dc_sample_derived_t *derived, double atmospheric, double density);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -20,7 +20,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "suunto_d9.h"
 #include "suunto_eon.h"
@@ -60,9 +62,107 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "device-private.h"
+#include "probe.h"
+#include "thread.h"
 
 #define REACTPROWHITE 0x4354
 
+typedef struct sample_forward_t {
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int mask;
+	sample_statistics_t statistics;
+	unsigned int count;
+} sample_forward_t;
+
+static void
+sample_forward_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_forward_t *forward = (sample_forward_t *) userdata;
+
+	sample_statistics_cb (type, value, &forward->statistics);
+
+	if (type == DC_SAMPLE_TIME)
+		forward->count++;
+
+	if (forward->callback && (forward->mask & (1u << type)))
+		forward->callback (type, value, forward->userdata);
+}
+
+struct dc_parser_pool_t {
+	dc_mutex_t *mutex;
+	unsigned int size;
+	unsigned int count;
+	dc_parser_t *parsers[];
+};
+
+static dc_parser_t *
+dc_parser_pool_get (dc_parser_pool_t *pool, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
+{
+	dc_parser_t *parser = NULL;
+
+	if (pool == NULL)
+		return NULL;
+
+	dc_mutex_lock (pool->mutex);
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		if (pool->parsers[i]->family == family &&
+			pool->parsers[i]->model == model &&
+			pool->parsers[i]->serial == serial &&
+			pool->parsers[i]->devtime == devtime &&
+			pool->parsers[i]->systime == systime) {
+			// Remove the parser from the pool.
+			parser = pool->parsers[i];
+			pool->count--;
+			pool->parsers[i] = pool->parsers[pool->count];
+			break;
+		}
+	}
+
+	dc_mutex_unlock (pool->mutex);
+
+	return parser;
+}
+
+static int
+dc_parser_pool_put (dc_parser_pool_t *pool, dc_parser_t *parser)
+{
+	int stored = 0;
+
+	if (pool == NULL)
+		return 0;
+
+	// Only parsers created with dc_parser_new_internal can be reused.
+	if (parser->family == DC_FAMILY_NULL)
+		return 0;
+
+	// Release the per-dive state.
+	if (dc_parser_reset (parser) != DC_STATUS_SUCCESS)
+		return 0;
+
+	// Restore the default settings for the next user.
+	parser->decimation = DC_DECIMATION_NONE;
+	parser->npoints = 0;
+	parser->samples = DC_SAMPLE_MASK_ALL;
+	parser->resample = 0;
+	parser->interpolation = 0;
+	parser->coalesce = 0;
+	parser->derived = NULL;
+	memset (&parser->limits, 0, sizeof (parser->limits));
+
+	dc_mutex_lock (pool->mutex);
+
+	if (pool->count < pool->size) {
+		pool->parsers[pool->count++] = parser;
+		stored = 1;
+	}
+
+	dc_mutex_unlock (pool->mutex);
+
+	return stored;
+}
+
 static dc_status_t
 dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
 {
@@ -72,7 +172,19 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	if (out == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	// Re-use a pooled parser with the same parameters.
+	parser = dc_parser_pool_get (dc_context_get_parser_pool (context),
+		family, model, serial, devtime, systime);
+	if (parser) {
+		*out = parser;
+		return DC_STATUS_SUCCESS;
+	}
+
+	// The create functions take different arguments per family, so a
+	// table would need a wrapper for each of them. The switch costs only
+	// a few comparisons, which is negligible next to the allocation.
 	switch (family) {
+#ifdef ENABLE_FAMILY_SUUNTO
 	case DC_FAMILY_SUUNTO_SOLUTION:
 		rc = suunto_solution_parser_create (&parser, context);
 		break;
@@ -92,6 +204,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_SUUNTO_EONSTEEL:
 		rc = suunto_eonsteel_parser_create(&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_UWATEC
 	case DC_FAMILY_UWATEC_ALADIN:
 	case DC_FAMILY_UWATEC_MEMOMOUSE:
 		rc = uwatec_memomouse_parser_create (&parser, context, devtime, systime);
@@ -101,6 +215,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_UWATEC_G2:
 		rc = uwatec_smart_parser_create (&parser, context, model, devtime, systime);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_REEFNET
 	case DC_FAMILY_REEFNET_SENSUS:
 		rc = reefnet_sensus_parser_create (&parser, context, devtime, systime);
 		break;
@@ -110,6 +226,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_REEFNET_SENSUSULTRA:
 		rc = reefnet_sensusultra_parser_create (&parser, context, devtime, systime);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_OCEANIC
 	case DC_FAMILY_OCEANIC_VTPRO:
 		rc = oceanic_vtpro_parser_create (&parser, context, model);
 		break;
@@ -122,6 +240,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 		else
 			rc = oceanic_atom2_parser_create (&parser, context, model, serial);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_MARES
 	case DC_FAMILY_MARES_NEMO:
 	case DC_FAMILY_MARES_PUCK:
 		rc = mares_nemo_parser_create (&parser, context, model);
@@ -132,6 +252,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_MARES_ICONHD:
 		rc = mares_iconhd_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_parser_create (&parser, context, serial, 0);
 		break;
@@ -139,6 +261,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_parser_create (&parser, context, serial, model);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_CRESSI
 	case DC_FAMILY_CRESSI_EDY:
 	case DC_FAMILY_ZEAGLE_N2ITION3:
 		rc = cressi_edy_parser_create (&parser, context, model);
@@ -146,31 +270,52 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_CRESSI_LEONARDO:
 		rc = cressi_leonardo_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_ATOMICS
 	case DC_FAMILY_ATOMICS_COBALT:
 		rc = atomics_cobalt_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_parser_create (&parser, context, model, serial);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_parser_create (&parser, context, model, serial);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_DIVERITE
 	case DC_FAMILY_DIVERITE_NITEKQ:
 		rc = diverite_nitekq_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_CITIZEN
 	case DC_FAMILY_CITIZEN_AQUALAND:
 		rc = citizen_aqualand_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_DIVESYSTEM
 	case DC_FAMILY_DIVESYSTEM_IDIVE:
 		rc = divesystem_idive_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_FAMILY_COCHRAN
 	case DC_FAMILY_COCHRAN_COMMANDER:
 		rc = cochran_commander_parser_create (&parser, context, model);
 		break;
+#endif
 	default:
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	if (rc == DC_STATUS_SUCCESS) {
+		parser->family = family;
+		parser->model = model;
+		parser->serial = serial;
+		parser->devtime = devtime;
+		parser->systime = systime;
+	}
+
 	*out = parser;
 
 	return rc;
@@ -208,7 +353,7 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_parser_t));
 
 	// Allocate memory.
-	parser = (dc_parser_t *) malloc (vtable->size);
+	parser = (dc_parser_t *) dc_context_alloc (context, vtable->size);
 	if (parser == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return parser;
@@ -219,6 +364,23 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	parser->context = context;
 	parser->data = NULL;
 	parser->size = 0;
+	parser->family = DC_FAMILY_NULL;
+	parser->model = 0;
+	parser->serial = 0;
+	parser->devtime = 0;
+	parser->systime = 0;
+	memset (&parser->summary, 0, sizeof (parser->summary));
+	memset (&parser->index, 0, sizeof (parser->index));
+	parser->decimation = DC_DECIMATION_NONE;
+	parser->npoints = 0;
+	parser->samples = DC_SAMPLE_MASK_ALL;
+	parser->resample = 0;
+	parser->interpolation = 0;
+	parser->coalesce = 0;
+	parser->derived = NULL;
+	memset (&parser->limits, 0, sizeof (parser->limits));
+	memset (&parser->work, 0, sizeof (parser->work));
+	memset (&parser->memory, 0, sizeof (parser->memory));
 
 	return parser;
 }
@@ -226,7 +388,53 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 void
 dc_parser_deallocate (dc_parser_t *parser)
 {
-	free (parser);
+	if (parser == NULL)
+		return;
+
+	dc_context_release (parser->context, parser->index.records);
+	dc_context_release (parser->context, parser);
+}
+
+dc_status_t
+dc_parser_pool_new (dc_parser_pool_t **out, unsigned int size)
+{
+	dc_parser_pool_t *pool = NULL;
+
+	if (out == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	pool = (dc_parser_pool_t *) malloc (sizeof (*pool) + size * sizeof (dc_parser_t *));
+	if (pool == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Without thread support, the pool is simply not protected.
+	pool->mutex = NULL;
+	dc_mutex_new (&pool->mutex);
+
+	pool->size = size;
+	pool->count = 0;
+
+	*out = pool;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_parser_pool_free (dc_parser_pool_t *pool)
+{
+	if (pool == NULL)
+		return;
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_t *parser = pool->parsers[i];
+		if (parser->vtable->destroy)
+			parser->vtable->destroy (parser);
+		dc_parser_deallocate (parser);
+	}
+
+	dc_mutex_free (pool->mutex);
+	free (pool);
 }
 
 int
@@ -238,6 +446,12 @@ dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable)
 	return parser->vtable == vtable;
 }
 
+void
+dc_parser_invalidate_summary (dc_parser_t *parser)
+{
+	memset (&parser->summary, 0, sizeof (parser->summary));
+}
+
 
 dc_family_t
 dc_parser_get_type (dc_parser_t *parser)
@@ -248,6 +462,60 @@ dc_parser_get_type (dc_parser_t *parser)
 	return parser->vtable->type;
 }
 
+/*
+ * Without limits, the work isn't counted, and the parser state is not
+ * written, such that a prepared parser can be shared between threads.
+ */
+static int
+dc_parser_work_limited (const dc_parser_t *parser)
+{
+	return parser->limits.records || parser->limits.bytes || parser->limits.descriptors;
+}
+
+static void
+dc_parser_work_reset (dc_parser_t *parser)
+{
+	if (!dc_parser_work_limited (parser))
+		return;
+
+	memset (&parser->work, 0, sizeof (parser->work));
+}
+
+static int
+dc_parser_work_add (unsigned int *work, unsigned int amount, unsigned int limit)
+{
+	if (limit && (*work > limit || amount > limit - *work))
+		return 0;
+
+	*work += amount;
+
+	return 1;
+}
+
+dc_status_t
+dc_parser_work (dc_parser_t *parser, unsigned int records, unsigned int bytes, unsigned int descriptors)
+{
+	dc_parser_work_t *work = &parser->work;
+	const dc_parser_limits_t *limits = &parser->limits;
+
+	if (!dc_parser_work_limited (parser))
+		return DC_STATUS_SUCCESS;
+
+	if (work->exceeded)
+		return DC_STATUS_DATAFORMAT;
+
+	if (!dc_parser_work_add (&work->records, records, limits->records) ||
+		!dc_parser_work_add (&work->bytes, bytes, limits->bytes) ||
+		!dc_parser_work_add (&work->descriptors, descriptors, limits->descriptors)) {
+		ERROR (parser->context, "Work limit exceeded (%u records, %u bytes, %u descriptors).",
+			work->records, work->bytes, work->descriptors);
+		work->exceeded = 1;
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 
 dc_status_t
 dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size)
@@ -261,7 +529,32 @@ dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int
 	parser->data = data;
 	parser->size = size;
 
-	return parser->vtable->set_data (parser, data, size);
+	// Invalidate the summary cache and the profile index.
+	dc_parser_invalidate_summary (parser);
+	dc_profile_index_reset (&parser->index);
+	dc_parser_work_reset (parser);
+	memset (&parser->memory, 0, sizeof (parser->memory));
+
+	dc_usecs_t begin = dc_context_trace_begin (parser->context);
+	dc_nsecs_t start = dc_context_parser_begin (parser->context);
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (parser->context, &scope);
+
+	dc_status_t status = parser->vtable->set_data (parser, data, size);
+
+	dc_context_memory_end (parser->context, &scope, &parser->memory);
+
+	dc_context_parser_end (parser->context, parser->vtable->type, parser->model, DC_PARSER_CALL_SET_DATA, start, 0, size);
+	dc_context_trace_end (parser->context, "dc_parser_set_data", begin);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_reset (dc_parser_t *parser)
+{
+	return dc_parser_set_data (parser, NULL, 0);
 }
 
 
@@ -274,67 +567,1309 @@ dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime)
 	if (parser->vtable->datetime == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return parser->vtable->datetime (parser, datetime);
+	dc_parser_work_reset (parser);
+
+	dc_nsecs_t start = dc_context_parser_begin (parser->context);
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (parser->context, &scope);
+
+	dc_status_t status = parser->vtable->datetime (parser, datetime);
+
+	dc_context_memory_end (parser->context, &scope, &parser->memory);
+
+	dc_context_parser_end (parser->context, parser->vtable->type, parser->model, DC_PARSER_CALL_DATETIME, start, 0, 0);
+
+	return status;
+}
+
+static int
+dc_parser_summary_slot (dc_field_type_t type, size_t *size)
+{
+	switch (type) {
+	case DC_FIELD_DIVETIME:
+		*size = sizeof (unsigned int);
+		return 0;
+	case DC_FIELD_MAXDEPTH:
+		*size = sizeof (double);
+		return 1;
+	case DC_FIELD_AVGDEPTH:
+		*size = sizeof (double);
+		return 2;
+	case DC_FIELD_GASMIX_COUNT:
+		*size = sizeof (unsigned int);
+		return 3;
+	case DC_FIELD_TEMPERATURE_MINIMUM:
+		*size = sizeof (double);
+		return 4;
+	case DC_FIELD_TEMPERATURE_MAXIMUM:
+		*size = sizeof (double);
+		return 5;
+	case DC_FIELD_TANK_COUNT:
+		*size = sizeof (unsigned int);
+		return 6;
+	default:
+		return -1;
+	}
+}
+
+static dc_status_t
+dc_parser_get_field_uncached (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
+{
+	dc_nsecs_t start = dc_context_parser_begin (parser->context);
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (parser->context, &scope);
+
+	dc_status_t status = parser->vtable->field (parser, type, flags, value);
+
+	dc_context_memory_end (parser->context, &scope, &parser->memory);
+
+	dc_context_parser_end (parser->context, parser->vtable->type, parser->model, DC_PARSER_CALL_FIELD, start, 0, 0);
+
+	return status;
 }
 
 dc_status_t
 dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
 {
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t size = 0;
+
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
 	if (parser->vtable->field == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return parser->vtable->field (parser, type, flags, value);
+	dc_parser_work_reset (parser);
+
+	// Fields without a fixed size value are never cached.
+	int slot = dc_parser_summary_slot (type, &size);
+	if (slot < 0 || value == NULL)
+		return dc_parser_get_field_uncached (parser, type, flags, value);
+
+	dc_parser_summary_t *summary = &parser->summary;
+
+	// Return the memoized result.
+	if (summary->cached & (1 << slot)) {
+		if (summary->status[slot] == DC_STATUS_SUCCESS)
+			memcpy (value, &summary->value[slot], size);
+		return summary->status[slot];
+	}
+
+	status = dc_parser_get_field_uncached (parser, type, flags, value);
+
+	// Memoize the result.
+	summary->cached |= (1 << slot);
+	summary->status[slot] = status;
+	if (status == DC_STATUS_SUCCESS)
+		memcpy (&summary->value[slot], value, size);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_get_fields (dc_parser_t *parser, dc_field_request_t requests[], unsigned int count)
+{
+	if (requests == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser == NULL || parser->vtable->field == NULL) {
+		for (unsigned int i = 0; i < count; ++i)
+			requests[i].status = DC_STATUS_UNSUPPORTED;
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		requests[i].status = dc_parser_get_field (parser, requests[i].type, requests[i].flags, requests[i].value);
+	}
+
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+dc_parser_prepare (dc_parser_t *parser)
 {
+	static const dc_field_type_t fields[] = {
+		DC_FIELD_DIVETIME,
+		DC_FIELD_MAXDEPTH,
+		DC_FIELD_AVGDEPTH,
+		DC_FIELD_GASMIX_COUNT,
+		DC_FIELD_TEMPERATURE_MINIMUM,
+		DC_FIELD_TEMPERATURE_MAXIMUM,
+		DC_FIELD_TANK_COUNT,
+	};
+	dc_datetime_t datetime;
+	union {
+		unsigned int u;
+		double d;
+	} value;
+
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->samples_foreach == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	// The header is cached by the backends on its first use. Missing
+	// fields are not an error, their status is memoized as well.
+	if (parser->vtable->datetime)
+		parser->vtable->datetime (parser, &datetime);
+
+	for (unsigned int i = 0; i < sizeof (fields) / sizeof (fields[0]); ++i) {
+		dc_parser_get_field (parser, fields[i], 0, &value);
+	}
+
+	// Walk the profile once, to build the profile index and the
+	// statistics.
+	if (parser->vtable->samples_foreach) {
+		sample_statistics_t statistics;
+		dc_status_t status = dc_parser_get_statistics (parser, &statistics);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
 
-	return parser->vtable->samples_foreach (parser, callback, userdata);
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_parser_destroy (dc_parser_t *parser)
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->samples = mask;
+
+	return DC_STATUS_SUCCESS;
+}
+
 
+dc_status_t
+dc_parser_set_decimation (dc_parser_t *parser, dc_decimation_t mode, unsigned int npoints)
+{
 	if (parser == NULL)
-		return DC_STATUS_SUCCESS;
+		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->destroy) {
-		status = parser->vtable->destroy (parser);
+	switch (mode) {
+	case DC_DECIMATION_NONE:
+		npoints = 0;
+		break;
+	case DC_DECIMATION_ENVELOPE:
+	case DC_DECIMATION_LTTB:
+		// At least the first, the last and one other row.
+		if (npoints < 3)
+			return DC_STATUS_INVALIDARGS;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
 	}
 
-	dc_parser_deallocate (parser);
+	parser->decimation = mode;
+	parser->npoints = npoints;
 
-	return status;
+	return DC_STATUS_SUCCESS;
 }
 
 
-void
-sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+dc_status_t
+dc_parser_set_resampling (dc_parser_t *parser, unsigned int interval)
 {
-	sample_statistics_t *statistics  = (sample_statistics_t *) userdata;
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->resample = interval;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_interpolation (dc_parser_t *parser, dc_sample_type_t type, dc_interpolation_t mode)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
 
 	switch (type) {
-	case DC_SAMPLE_TIME:
-		statistics->divetime = value.time;
-		break;
 	case DC_SAMPLE_DEPTH:
-		if (statistics->maxdepth < value.depth)
-			statistics->maxdepth = value.depth;
+	case DC_SAMPLE_PRESSURE:
+	case DC_SAMPLE_TEMPERATURE:
+	case DC_SAMPLE_PPO2:
 		break;
 	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	switch (mode) {
+	case DC_INTERPOLATION_LINEAR:
+		parser->interpolation &= ~(1u << type);
+		break;
+	case DC_INTERPOLATION_STEP:
+		parser->interpolation |= (1u << type);
 		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_coalescing (dc_parser_t *parser, unsigned int enable)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->coalesce = enable ? 1 : 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_derived (dc_parser_t *parser, dc_sample_derived_t *derived)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->derived = derived;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_get_memory_stats (dc_parser_t *parser, dc_memory_stats_t *stats)
+{
+	if (parser == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*stats = parser->memory;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_limits (dc_parser_t *parser, const dc_parser_limits_t *limits)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (limits)
+		parser->limits = *limits;
+	else
+		memset (&parser->limits, 0, sizeof (parser->limits));
+
+	// Start counting again, also when the limits are removed.
+	memset (&parser->work, 0, sizeof (parser->work));
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+typedef struct sample_point_t {
+	unsigned int time;
+	double depth;
+} sample_point_t;
+
+typedef struct sample_collect_t {
+	dc_status_t status;
+	sample_statistics_t statistics;
+	// Time of the current row.
+	unsigned int time;
+	unsigned int have_time;
+	unsigned int have_depth;
+	// Rows with a depth sample.
+	unsigned int count;
+	unsigned int capacity;
+	sample_point_t *points;
+	dc_context_t *context;
+} sample_collect_t;
+
+static void
+sample_collect_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_collect_t *collect = (sample_collect_t *) userdata;
+
+	sample_statistics_cb (type, value, &collect->statistics);
+
+	if (collect->status != DC_STATUS_SUCCESS)
+		return;
+
+	if (type == DC_SAMPLE_TIME) {
+		collect->time = value.time;
+		collect->have_time = 1;
+		collect->have_depth = 0;
+		return;
+	}
+
+	if (type != DC_SAMPLE_DEPTH || !collect->have_time)
+		return;
+
+	// Only the last depth of each row is kept.
+	if (collect->have_depth) {
+		collect->points[collect->count - 1].depth = value.depth;
+		return;
 	}
+
+	if (collect->count >= collect->capacity) {
+		unsigned int capacity = collect->capacity ? 2 * collect->capacity : 1024;
+		sample_point_t *points = (sample_point_t *) dc_context_realloc (collect->context, collect->points,
+			collect->capacity * sizeof (sample_point_t), capacity * sizeof (sample_point_t));
+		if (points == NULL) {
+			collect->status = DC_STATUS_NOMEMORY;
+			return;
+		}
+		collect->points = points;
+		collect->capacity = capacity;
+	}
+
+	collect->points[collect->count].time = collect->time;
+	collect->points[collect->count].depth = value.depth;
+	collect->count++;
+	collect->have_depth = 1;
+}
+
+static void
+sample_point_report (const sample_point_t *point, dc_sample_callback_t callback, void *userdata)
+{
+	dc_sample_value_t sample = {0};
+
+	sample.time = point->time;
+	callback (DC_SAMPLE_TIME, sample, userdata);
+
+	sample.depth = point->depth;
+	callback (DC_SAMPLE_DEPTH, sample, userdata);
+}
+
+static void
+sample_envelope (const sample_point_t *points, unsigned int count, unsigned int npoints, dc_sample_callback_t callback, void *userdata)
+{
+	// The first and last row are reported separately, and each bucket
+	// of the remaining rows contributes its minimum and maximum.
+	unsigned int ninner = count - 2;
+	unsigned int nbuckets = (npoints - 2) / 2;
+	if (nbuckets == 0)
+		nbuckets = 1;
+
+	sample_point_report (&points[0], callback, userdata);
+
+	for (unsigned int i = 0; i < nbuckets; ++i) {
+		unsigned int begin = 1 + (unsigned int) ((unsigned long long) i * ninner / nbuckets);
+		unsigned int end = 1 + (unsigned int) ((unsigned long long) (i + 1) * ninner / nbuckets);
+		if (begin >= end)
+			continue;
+
+		unsigned int min = begin, max = begin;
+		for (unsigned int j = begin + 1; j < end; ++j) {
+			if (points[j].depth < points[min].depth)
+				min = j;
+			if (points[j].depth > points[max].depth)
+				max = j;
+		}
+
+		// Report in chronological order.
+		unsigned int first = min < max ? min : max;
+		unsigned int second = min < max ? max : min;
+		sample_point_report (&points[first], callback, userdata);
+		if (second != first)
+			sample_point_report (&points[second], callback, userdata);
+	}
+
+	sample_point_report (&points[count - 1], callback, userdata);
+}
+
+static void
+sample_lttb (const sample_point_t *points, unsigned int count, unsigned int npoints, dc_sample_callback_t callback, void *userdata)
+{
+	// Size of the buckets, excluding the first and last row.
+	double every = (double) (count - 2) / (npoints - 2);
+
+	unsigned int a = 0;
+	sample_point_report (&points[a], callback, userdata);
+
+	for (unsigned int i = 0; i < npoints - 2; ++i) {
+		// Average of the next bucket (or the last row).
+		unsigned int begin = (unsigned int) ((i + 1) * every) + 1;
+		unsigned int end = (unsigned int) ((i + 2) * every) + 1;
+		if (end > count)
+			end = count;
+		if (begin >= end) {
+			begin = count - 1;
+			end = count;
+		}
+
+		double avgtime = 0.0, avgdepth = 0.0;
+		for (unsigned int j = begin; j < end; ++j) {
+			avgtime += points[j].time;
+			avgdepth += points[j].depth;
+		}
+		avgtime /= end - begin;
+		avgdepth /= end - begin;
+
+		// Select the row of the current bucket with the largest
+		// triangle, formed with the previous selected row, and the
+		// average of the next bucket.
+		unsigned int first = (unsigned int) (i * every) + 1;
+		unsigned int last = (unsigned int) ((i + 1) * every) + 1;
+		if (last > count - 1)
+			last = count - 1;
+
+		double atime = points[a].time, adepth = points[a].depth;
+		double maxarea = -1.0;
+		unsigned int next = first;
+		for (unsigned int j = first; j < last; ++j) {
+			double area = fabs ((atime - avgtime) * (points[j].depth - adepth) -
+				(atime - points[j].time) * (avgdepth - adepth));
+			if (area > maxarea) {
+				maxarea = area;
+				next = j;
+			}
+		}
+
+		if (first < last) {
+			sample_point_report (&points[next], callback, userdata);
+			a = next;
+		}
+	}
+
+	sample_point_report (&points[count - 1], callback, userdata);
+}
+
+static dc_status_t
+dc_parser_samples_decimate (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata, unsigned int *nsamples)
+{
+	sample_collect_t collect = {DC_STATUS_SUCCESS, SAMPLE_STATISTICS_INITIALIZER, 0, 0, 0, 0, 0, NULL, parser->context};
+
+	dc_status_t status = parser->vtable->samples_foreach (parser, sample_collect_cb, &collect);
+	*nsamples = collect.count;
+	if (status == DC_STATUS_SUCCESS)
+		status = collect.status;
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (!parser->summary.profile) {
+		parser->summary.profile = 1;
+		parser->summary.statistics = collect.statistics;
+	}
+
+	if (callback == NULL)
+		goto error_free;
+
+	if (collect.count <= parser->npoints) {
+		for (unsigned int i = 0; i < collect.count; ++i) {
+			sample_point_report (&collect.points[i], callback, userdata);
+		}
+	} else if (parser->decimation == DC_DECIMATION_ENVELOPE) {
+		sample_envelope (collect.points, collect.count, parser->npoints, callback, userdata);
+	} else {
+		sample_lttb (collect.points, collect.count, parser->npoints, callback, userdata);
+	}
+
+error_free:
+	dc_context_release (parser->context, collect.points);
+	return status;
+}
+
+
+dc_status_t
+dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usecs_t begin = dc_context_trace_begin (parser->context);
+	dc_nsecs_t start = dc_context_parser_begin (parser->context);
+	unsigned int nsamples = 0;
+	DC_PROBE2 (parser__samples__entry, parser->vtable->type, parser->model);
+
+	dc_parser_work_reset (parser);
+
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (parser->context, &scope);
+
+	if (parser->decimation != DC_DECIMATION_NONE) {
+		status = dc_parser_samples_decimate (parser, callback, userdata, &nsamples);
+	} else {
+		// Collect the profile statistics as a side effect.
+		sample_forward_t forward = {callback, userdata, parser->samples, SAMPLE_STATISTICS_INITIALIZER, 0};
+		status = sample_walk (parser, sample_forward_cb, &forward);
+		nsamples = forward.count;
+		// After the first walk, the statistics are only read, such
+		// that a prepared parser can be shared between threads.
+		if (status == DC_STATUS_SUCCESS && !parser->summary.profile) {
+			parser->summary.profile = 1;
+			parser->summary.statistics = forward.statistics;
+		}
+	}
+
+	dc_context_memory_end (parser->context, &scope, &parser->memory);
+
+	dc_context_parser_end (parser->context, parser->vtable->type, parser->model, DC_PARSER_CALL_SAMPLES, start, nsamples, 0);
+	DC_PROBE3 (parser__samples__return, parser->vtable->type, nsamples, status);
+	dc_context_trace_end (parser->context, "dc_parser_samples_foreach", begin);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_samples_feed (dc_parser_t *parser, const unsigned char data[], unsigned int size, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (data == NULL && size)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->vtable->samples_feed == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// The backend keeps no reference to the forward state between calls.
+	sample_forward_t forward = {callback, userdata, parser->samples, SAMPLE_STATISTICS_INITIALIZER, 0};
+
+	dc_nsecs_t start = dc_context_parser_begin (parser->context);
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (parser->context, &scope);
+
+	dc_status_t status = parser->vtable->samples_feed (parser, data, size, sample_forward_cb, &forward);
+
+	dc_context_memory_end (parser->context, &scope, &parser->memory);
+
+	dc_context_parser_end (parser->context, parser->vtable->type, parser->model, DC_PARSER_CALL_SAMPLES, start, forward.count, size);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_samples_get_batch (dc_parser_t *parser, dc_sample_table_t *table)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (table == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (!parser->resample && parser->vtable->samples_batch == NULL && parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	sample_table_reset (table);
+	dc_parser_work_reset (parser);
+
+	dc_memory_scope_t scope;
+	dc_context_memory_begin (parser->context, &scope);
+
+	if (parser->resample) {
+		// Build the grid rows from the sample callbacks.
+		status = sample_resample (parser, table);
+	} else if (parser->vtable->samples_batch && (!parser->coalesce || parser->vtable->samples_foreach == NULL)) {
+		// Let the backend fill the columns directly. The backends
+		// report the events as they are stored, so the table is built
+		// from the sample callbacks for the event coalescing.
+		status = parser->vtable->samples_batch (parser, table);
+	} else {
+		// Build the table from the sample callbacks.
+		status = sample_walk (parser, sample_table_cb, table);
+	}
+
+	dc_context_memory_end (parser->context, &scope, &parser->memory);
+
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// Without an events array, the events are counted but not stored.
+	if (table->count > table->capacity || (table->events && table->nevents > table->events_capacity))
+		return DC_STATUS_NOMEMORY;
+
+	if (parser->derived)
+		sample_derived_compute (parser, table, parser->derived);
+
+	// A complete table of the device rows also provides the statistics
+	// of a profile walk, for the backends that need them.
+	if (!parser->summary.profile && !parser->resample && table->mask && table->time && table->depth &&
+		SAMPLE_WANTED (parser, DC_SAMPLE_TIME) && SAMPLE_WANTED (parser, DC_SAMPLE_DEPTH)) {
+		dc_sample_summary_t summary = {0};
+		if (dc_sample_table_summarize (table, &summary) == DC_STATUS_SUCCESS) {
+			parser->summary.statistics.divetime = summary.divetime;
+			parser->summary.statistics.maxdepth = summary.maxdepth;
+			parser->summary.profile = 1;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+typedef struct sample_range_t {
+	unsigned int begin;
+	unsigned int end;
+	unsigned int step;
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int mask;
+	// Current row.
+	unsigned int inside;
+	unsigned int nrows;
+	// Gas mix in effect, and the last reported gas mix.
+	unsigned int gasmix;
+	unsigned int reported;
+} sample_range_t;
+
+static void
+sample_range_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_range_t *range = (sample_range_t *) userdata;
+
+	if (type == DC_SAMPLE_TIME) {
+		range->inside = 0;
+		if (value.time >= range->begin && value.time <= range->end) {
+			range->inside = (range->nrows % range->step) == 0;
+			range->nrows++;
+		}
+
+		if (!range->inside)
+			return;
+
+		if (range->mask & (1u << DC_SAMPLE_TIME))
+			range->callback (type, value, range->userdata);
+
+		// Report the gas mix in effect, if it was changed in a row
+		// that was not reported.
+		if (range->gasmix != range->reported && (range->mask & (1u << DC_SAMPLE_GASMIX))) {
+			dc_sample_value_t sample = {0};
+			sample.gasmix = range->gasmix;
+			range->callback (DC_SAMPLE_GASMIX, sample, range->userdata);
+			range->reported = range->gasmix;
+		}
+		return;
+	}
+
+	if (type == DC_SAMPLE_GASMIX)
+		range->gasmix = value.gasmix;
+
+	if (!range->inside)
+		return;
+
+	if ((range->mask & (1u << type)) == 0)
+		return;
+
+	if (type == DC_SAMPLE_GASMIX)
+		range->reported = value.gasmix;
+
+	range->callback (type, value, range->userdata);
+}
+
+static dc_status_t
+dc_parser_samples_window (dc_parser_t *parser, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser->vtable->samples_range == NULL && parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	sample_coalesce_t coalesce;
+	if (parser->coalesce) {
+		sample_coalesce_init (&coalesce, callback, userdata);
+		callback = sample_coalesce_cb;
+		userdata = &coalesce;
+	}
+
+	if (parser->vtable->samples_range)
+		status = parser->vtable->samples_range (parser, begin, end, callback, userdata);
+	else
+		status = parser->vtable->samples_foreach (parser, callback, userdata);
+
+	if (status == DC_STATUS_SUCCESS && parser->coalesce)
+		sample_coalesce_finish (&coalesce);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_samples_range (dc_parser_t *parser, unsigned int begin, unsigned int end, unsigned int step, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (callback == NULL || begin > end)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_work_reset (parser);
+
+	sample_range_t range = {0};
+	range.begin = begin;
+	range.end = end;
+	range.step = step ? step : 1;
+	range.callback = callback;
+	range.userdata = userdata;
+	range.mask = parser->samples;
+	range.gasmix = DC_GASMIX_UNKNOWN;
+	range.reported = DC_GASMIX_UNKNOWN;
+
+	return dc_parser_samples_window (parser, begin, end, sample_range_cb, &range);
+}
+
+
+typedef struct sample_item_t {
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} sample_item_t;
+
+typedef struct sample_row_t {
+	unsigned int time;
+	unsigned int gasmix;
+	unsigned int have_depth;
+	double depth;
+	unsigned int count;
+	unsigned int capacity;
+	sample_item_t *items;
+} sample_row_t;
+
+typedef struct sample_minmax_t {
+	unsigned int begin;
+	unsigned int end;
+	unsigned int interval;
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int mask;
+	dc_status_t status;
+	// Gas mix in effect, and the last reported gas mix.
+	unsigned int gasmix;
+	unsigned int reported;
+	// Current bucket and row.
+	unsigned int bucket;
+	unsigned int inside;
+	unsigned int have_min, have_max;
+	sample_row_t row, min, max;
+	dc_context_t *context;
+} sample_minmax_t;
+
+static int
+sample_row_reserve (dc_context_t *context, sample_row_t *row, unsigned int count)
+{
+	if (count <= row->capacity)
+		return 1;
+
+	unsigned int capacity = row->capacity ? row->capacity : 16;
+	while (capacity < count)
+		capacity *= 2;
+
+	sample_item_t *items = (sample_item_t *) dc_context_realloc (context, row->items,
+		row->capacity * sizeof (sample_item_t), capacity * sizeof (sample_item_t));
+	if (items == NULL)
+		return 0;
+
+	row->items = items;
+	row->capacity = capacity;
+
+	return 1;
+}
+
+static void
+sample_row_copy (sample_minmax_t *minmax, sample_row_t *dst, const sample_row_t *src)
+{
+	if (!sample_row_reserve (minmax->context, dst, src->count)) {
+		minmax->status = DC_STATUS_NOMEMORY;
+		return;
+	}
+
+	memcpy (dst->items, src->items, src->count * sizeof (sample_item_t));
+	dst->count = src->count;
+	dst->time = src->time;
+	dst->gasmix = src->gasmix;
+	dst->have_depth = src->have_depth;
+	dst->depth = src->depth;
+}
+
+static void
+sample_row_report (sample_minmax_t *minmax, const sample_row_t *row)
+{
+	for (unsigned int i = 0; i < row->count; ++i) {
+		if (minmax->mask & (1u << row->items[i].type))
+			minmax->callback (row->items[i].type, row->items[i].value, minmax->userdata);
+
+		// The gas mix is reported right after the time sample.
+		if (i == 0 && row->gasmix != minmax->reported && (minmax->mask & (1u << DC_SAMPLE_GASMIX))) {
+			dc_sample_value_t sample = {0};
+			sample.gasmix = row->gasmix;
+			minmax->callback (DC_SAMPLE_GASMIX, sample, minmax->userdata);
+			minmax->reported = row->gasmix;
+		}
+	}
+}
+
+static void
+sample_minmax_flush (sample_minmax_t *minmax)
+{
+	if (minmax->have_min && minmax->have_max) {
+		// Report the rows in chronological order, and only once if
+		// the minimum and maximum are in the same row.
+		const sample_row_t *first = &minmax->min, *second = &minmax->max;
+		if (first->time > second->time) {
+			first = &minmax->max;
+			second = &minmax->min;
+		}
+		sample_row_report (minmax, first);
+		if (second->time != first->time)
+			sample_row_report (minmax, second);
+	}
+
+	minmax->have_min = 0;
+	minmax->have_max = 0;
+}
+
+static void
+sample_minmax_finish (sample_minmax_t *minmax)
+{
+	sample_row_t *row = &minmax->row;
+
+	if (!minmax->inside || !row->have_depth)
+		return;
+
+	// The gas mix in effect at the end of the row.
+	row->gasmix = minmax->gasmix;
+
+	if (!minmax->have_min || row->depth < minmax->min.depth) {
+		sample_row_copy (minmax, &minmax->min, row);
+		minmax->have_min = 1;
+	}
+
+	if (!minmax->have_max || row->depth > minmax->max.depth) {
+		sample_row_copy (minmax, &minmax->max, row);
+		minmax->have_max = 1;
+	}
+}
+
+static void
+sample_minmax_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_minmax_t *minmax = (sample_minmax_t *) userdata;
+	sample_row_t *row = &minmax->row;
+
+	if (minmax->status != DC_STATUS_SUCCESS)
+		return;
+
+	if (type == DC_SAMPLE_TIME) {
+		sample_minmax_finish (minmax);
+
+		minmax->inside = (value.time >= minmax->begin && value.time <= minmax->end);
+		if (minmax->inside) {
+			unsigned int bucket = (value.time - minmax->begin) / minmax->interval;
+			if (bucket != minmax->bucket) {
+				sample_minmax_flush (minmax);
+				minmax->bucket = bucket;
+			}
+		}
+
+		row->time = value.time;
+		row->have_depth = 0;
+		row->depth = 0.0;
+		row->count = 0;
+	}
+
+	if (type == DC_SAMPLE_GASMIX) {
+		minmax->gasmix = value.gasmix;
+		return;
+	}
+
+	if (!minmax->inside || type == DC_SAMPLE_VENDOR)
+		return;
+
+	if (type == DC_SAMPLE_DEPTH) {
+		row->depth = value.depth;
+		row->have_depth = 1;
+	}
+
+	// The time sample is always stored, because it starts the row.
+	if (type != DC_SAMPLE_TIME && (minmax->mask & (1u << type)) == 0)
+		return;
+
+	if (!sample_row_reserve (minmax->context, row, row->count + 1)) {
+		minmax->status = DC_STATUS_NOMEMORY;
+		return;
+	}
+
+	row->items[row->count].type = type;
+	row->items[row->count].value = value;
+	row->count++;
+}
+
+
+dc_status_t
+dc_parser_samples_minmax (dc_parser_t *parser, unsigned int begin, unsigned int end, unsigned int interval, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (callback == NULL || begin > end || interval == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_work_reset (parser);
+
+	sample_minmax_t minmax = {0};
+	minmax.begin = begin;
+	minmax.end = end;
+	minmax.interval = interval;
+	minmax.callback = callback;
+	minmax.userdata = userdata;
+	minmax.mask = parser->samples;
+	minmax.status = DC_STATUS_SUCCESS;
+	minmax.gasmix = DC_GASMIX_UNKNOWN;
+	minmax.reported = DC_GASMIX_UNKNOWN;
+	minmax.context = parser->context;
+
+	dc_status_t status = dc_parser_samples_window (parser, begin, end, sample_minmax_cb, &minmax);
+	if (status == DC_STATUS_SUCCESS)
+		status = minmax.status;
+
+	// Report the last bucket.
+	if (status == DC_STATUS_SUCCESS) {
+		sample_minmax_finish (&minmax);
+		sample_minmax_flush (&minmax);
+		status = minmax.status;
+	}
+
+	dc_context_release (parser->context, minmax.row.items);
+	dc_context_release (parser->context, minmax.min.items);
+	dc_context_release (parser->context, minmax.max.items);
+
+	return status;
+}
+
+
+dc_status_t
+dc_parser_destroy (dc_parser_t *parser)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Return the parser to the pool, if enabled.
+	if (dc_parser_pool_put (dc_context_get_parser_pool (parser->context), parser))
+		return DC_STATUS_SUCCESS;
+
+	if (parser->vtable->destroy) {
+		status = parser->vtable->destroy (parser);
+	}
+
+	dc_parser_deallocate (parser);
+
+	return status;
+}
+
+
+typedef struct dc_parse_many_t {
+	dc_context_t *context;
+	const dc_parse_job_t *jobs;
+	unsigned int count;
+	dc_parse_callback_t callback;
+	void *userdata;
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+	unsigned int next;
+	unsigned int cancelled;
+	unsigned char *done;
+	dc_status_t *status;
+} dc_parse_many_t;
+
+static dc_status_t
+dc_parse_many_job (dc_parse_many_t *state, unsigned int index)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+	const dc_parse_job_t *job = state->jobs + index;
+
+	rc = dc_parser_new2 (&parser, state->context, job->descriptor, job->devtime, job->systime);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	rc = dc_parser_set_data (parser, job->data, job->size);
+	if (rc == DC_STATUS_SUCCESS && state->callback)
+		rc = state->callback (parser, index, state->userdata);
+
+	dc_parser_destroy (parser);
+
+	return rc;
+}
+
+static void
+dc_parse_many_worker (void *userdata)
+{
+	dc_parse_many_t *state = (dc_parse_many_t *) userdata;
+
+	dc_mutex_lock (state->mutex);
+	while (!state->cancelled && state->next < state->count) {
+		unsigned int index = state->next++;
+		dc_mutex_unlock (state->mutex);
+
+		dc_status_t rc = dc_parse_many_job (state, index);
+
+		dc_mutex_lock (state->mutex);
+		state->status[index] = rc;
+		state->done[index] = 1;
+		dc_cond_broadcast (state->cond);
+	}
+	dc_mutex_unlock (state->mutex);
+}
+
+dc_status_t
+dc_parse_many (dc_context_t *context, const dc_parse_job_t jobs[], unsigned int count, unsigned int nthreads, dc_parse_callback_t callback, dc_parse_result_callback_t result, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_parse_many_t state;
+	dc_thread_t **threads = NULL;
+	unsigned int nstarted = 0;
+
+	if (jobs == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	state.context = context;
+	state.jobs = jobs;
+	state.count = count;
+	state.callback = callback;
+	state.userdata = userdata;
+	state.mutex = NULL;
+	state.cond = NULL;
+	state.next = 0;
+	state.cancelled = 0;
+	state.done = NULL;
+	state.status = NULL;
+
+	if (nthreads > count)
+		nthreads = count;
+
+	// Start the worker threads. If that fails, the jobs are
+	// processed sequentially on the calling thread instead.
+	if (nthreads > 1 &&
+		dc_mutex_new (&state.mutex) == DC_STATUS_SUCCESS &&
+		dc_cond_new (&state.cond) == DC_STATUS_SUCCESS) {
+		threads = (dc_thread_t **) dc_context_alloc (context, nthreads * sizeof (dc_thread_t *));
+		state.done = (unsigned char *) dc_context_alloc (context, count * sizeof (unsigned char));
+		state.status = (dc_status_t *) dc_context_alloc (context, count * sizeof (dc_status_t));
+		if (threads && state.done && state.status) {
+			memset (state.done, 0, count * sizeof (unsigned char));
+			for (nstarted = 0; nstarted < nthreads; ++nstarted) {
+				if (dc_thread_new (&threads[nstarted], dc_parse_many_worker, &state) != DC_STATUS_SUCCESS)
+					break;
+			}
+			if (nstarted < nthreads) {
+				WARNING (context, "Failed to start all worker threads (%u of %u).", nstarted, nthreads);
+			}
+		}
+	}
+
+	if (nstarted == 0) {
+		for (unsigned int i = 0; i < count; ++i) {
+			dc_status_t rc = dc_parse_many_job (&state, i);
+			if (result && !result (i, rc, userdata)) {
+				status = DC_STATUS_CANCELLED;
+				break;
+			}
+		}
+	} else {
+		// Deliver the results in order.
+		for (unsigned int i = 0; i < count; ++i) {
+			dc_mutex_lock (state.mutex);
+			while (!state.done[i])
+				dc_cond_wait (state.cond, state.mutex, -1);
+			dc_status_t rc = state.status[i];
+			dc_mutex_unlock (state.mutex);
+
+			if (result && !result (i, rc, userdata)) {
+				dc_mutex_lock (state.mutex);
+				state.cancelled = 1;
+				dc_mutex_unlock (state.mutex);
+				status = DC_STATUS_CANCELLED;
+				break;
+			}
+		}
+
+		for (unsigned int i = 0; i < nstarted; ++i) {
+			dc_thread_join (threads[i]);
+		}
+	}
+
+	dc_context_release (context, state.status);
+	dc_context_release (context, state.done);
+	dc_context_release (context, threads);
+	dc_cond_free (state.cond);
+	dc_mutex_free (state.mutex);
+
+	return status;
+}
+
+void
+dc_profile_index_reset (dc_profile_index_t *index)
+{
+	// The memory is kept for the next dive.
+	index->valid = 0;
+	index->end = 0;
+	index->count = 0;
+}
+
+
+dc_status_t
+dc_profile_index_append (dc_parser_t *parser, unsigned int offset, unsigned int gasmix)
+{
+	dc_profile_index_t *index = &parser->index;
+
+	if (index->count >= index->capacity) {
+		unsigned int capacity = index->capacity ? 2 * index->capacity : 256;
+		dc_profile_record_t *records = (dc_profile_record_t *) dc_context_realloc (parser->context, index->records,
+			index->capacity * sizeof (dc_profile_record_t), capacity * sizeof (dc_profile_record_t));
+		if (records == NULL)
+			return DC_STATUS_NOMEMORY;
+
+		index->records = records;
+		index->capacity = capacity;
+	}
+
+	index->records[index->count].offset = offset;
+	index->records[index->count].gasmix = gasmix;
+	index->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_statistics_t *statistics  = (sample_statistics_t *) userdata;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		statistics->divetime = value.time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		if (statistics->maxdepth < value.depth)
+			statistics->maxdepth = value.depth;
+		break;
+	default:
+		break;
+	}
+}
+
+
+dc_status_t
+dc_parser_get_statistics (dc_parser_t *parser, sample_statistics_t *statistics)
+{
+	if (!parser->summary.profile) {
+		sample_statistics_t tmp = SAMPLE_STATISTICS_INITIALIZER;
+		dc_status_t status = parser->vtable->samples_foreach (parser, sample_statistics_cb, &tmp);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		parser->summary.profile = 1;
+		parser->summary.statistics = tmp;
+	}
+
+	*statistics = parser->summary.statistics;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+sample_table_reset (dc_sample_table_t *table)
+{
+	table->count = 0;
+	table->nevents = 0;
+}
+
+
+void
+sample_table_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_sample_table_t *table = (dc_sample_table_t *) userdata;
+
+	// A time sample starts a new row.
+	if (type == DC_SAMPLE_TIME) {
+		unsigned int row = table->count++;
+		if (row >= table->capacity)
+			return;
+
+		if (table->mask)
+			table->mask[row] = (1 << DC_SAMPLE_TIME);
+		if (table->time)
+			table->time[row] = value.time;
+		if (table->pressure) {
+			for (unsigned int i = 0; i < table->ntanks; ++i)
+				table->pressure[row * table->ntanks + i] = 0.0;
+		}
+		return;
+	}
+
+	// Ignore samples before the first time sample.
+	if (table->count == 0)
+		return;
+
+	unsigned int row = table->count - 1;
+
+	if (type == DC_SAMPLE_EVENT) {
+		unsigned int n = table->nevents++;
+		if (table->events == NULL || n >= table->events_capacity)
+			return;
+
+		table->events[n].row = row;
+		table->events[n].type = value.event.type;
+		table->events[n].time = value.event.time;
+		table->events[n].flags = value.event.flags;
+		table->events[n].value = value.event.value;
+		table->events[n].name = value.event.name;
+		return;
+	}
+
+	if (row >= table->capacity)
+		return;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		if (table->depth == NULL)
+			return;
+		table->depth[row] = value.depth;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (table->pressure == NULL || value.pressure.tank >= table->ntanks)
+			return;
+		table->pressure[row * table->ntanks + value.pressure.tank] = value.pressure.value;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (table->temperature == NULL)
+			return;
+		table->temperature[row] = value.temperature;
+		break;
+	case DC_SAMPLE_PPO2:
+		if (table->ppo2 == NULL)
+			return;
+		table->ppo2[row] = value.ppo2;
+		break;
+	case DC_SAMPLE_DECO:
+		if (table->deco_type)
+			table->deco_type[row] = value.deco.type;
+		if (table->deco_time)
+			table->deco_time[row] = value.deco.time;
+		if (table->deco_depth)
+			table->deco_depth[row] = value.deco.depth;
+		break;
+	case DC_SAMPLE_GASMIX:
+		if (table->gasmix == NULL)
+			return;
+		table->gasmix[row] = value.gasmix;
+		break;
+	default:
+		return;
+	}
+
+	if (table->mask)
+		table->mask[row] |= (1 << type);
 }
@@ -0,0 +1,64 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+
+#ifndef DC_PROBE_H
+#define DC_PROBE_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * Statically defined tracepoints (USDT) of the libdivecomputer provider,
+ * for tools like bpftrace, perf, SystemTap and DTrace. A probe is a
+ * single no-op instruction until a tool attaches to it, and disappears
+ * entirely without --enable-probes. The probes with an entry and a
+ * return pair follow the naming convention of those tools, where the
+ * double underscore becomes a dash (for example iostream-read-entry).
+ *
+ * iostream__read__entry     (iostream, size)
+ * iostream__read__return    (iostream, nbytes, status)
+ * iostream__write__entry    (iostream, size)
+ * iostream__write__return   (iostream, nbytes, status)
+ * iostream__readv__entry    (iostream, count)
+ * iostream__readv__return   (iostream, nbytes, status)
+ * iostream__writev__entry   (iostream, count)
+ * iostream__writev__return  (iostream, nbytes, status)
+ * transfer__entry           (family, command, size)
+ * transfer__return          (family, command, status)
+ * rbstream__read__entry     (rbstream, size)
+ * rbstream__read__return    (rbstream, size, status)
+ * dive__entry               (device, size)
+ * dive__return              (device, proceed)
+ * parser__samples__entry    (family, model)
+ * parser__samples__return   (family, nsamples, status)
+ */
+#ifdef ENABLE_PROBES
+#include <sys/sdt.h>
+#define DC_PROBE2(name,a,b) DTRACE_PROBE2 (libdivecomputer, name, a, b)
+#define DC_PROBE3(name,a,b,c) DTRACE_PROBE3 (libdivecomputer, name, a, b, c)
+#else
+#define DC_PROBE2(name,a,b) do { } while (0)
+#define DC_PROBE3(name,a,b,c) do { } while (0)
+#endif
+
+#endif /* DC_PROBE_H */
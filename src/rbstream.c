@@ -25,6 +25,10 @@
 #include "rbstream.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "probe.h"
+
+// The read-ahead cache may use this fraction of the memory budget.
+#define BUDGET_FRACTION 8
 
 struct dc_rbstream_t {
 	dc_device_t *device;
@@ -35,7 +39,10 @@ struct dc_rbstream_t {
 	unsigned int address;
 	unsigned int available;
 	unsigned int skip;
-	unsigned char cache[];
+	unsigned int remaining;
+	unsigned int direct;
+	unsigned int cachesize;
+	unsigned char *cache;
 };
 
 static unsigned int
@@ -85,12 +92,19 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 	}
 
 	// Allocate memory.
-	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream) + packetsize);
+	rbstream = (dc_rbstream_t *) malloc (sizeof(*rbstream));
 	if (rbstream == NULL) {
 		ERROR (device->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	rbstream->cache = (unsigned char *) malloc (packetsize);
+	if (rbstream->cache == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		free (rbstream);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	rbstream->device = device;
 	rbstream->pagesize = pagesize;
 	rbstream->packetsize = packetsize;
@@ -99,6 +113,9 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 	rbstream->address = iceil(address, pagesize);
 	rbstream->available = 0;
 	rbstream->skip = rbstream->address - address;
+	rbstream->remaining = 0;
+	rbstream->direct = 0;
+	rbstream->cachesize = packetsize;
 
 	*out = rbstream;
 
@@ -106,16 +123,54 @@ dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize
 }
 
 dc_status_t
-dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+dc_rbstream_set_readahead (dc_rbstream_t *rbstream, unsigned int size, unsigned int total)
 {
-	dc_status_t rc = DC_STATUS_SUCCESS;
-
 	if (rbstream == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	// Round up to a multiple of the packet size.
+	size = iceil (size, rbstream->packetsize);
+	if (size == 0)
+		size = rbstream->packetsize;
+
+	// Never read more than the entire ringbuffer at once.
+	unsigned int rbsize = iceil (rbstream->end - rbstream->begin, rbstream->packetsize);
+	if (size > rbsize)
+		size = rbsize;
+
+	// Keep the cache within a fraction of the memory budget.
+	unsigned int budget = dc_context_get_memory_budget (rbstream->device->context) / BUDGET_FRACTION;
+	if (budget && size > budget)
+		size = budget / rbstream->packetsize * rbstream->packetsize;
+	if (size == 0)
+		size = rbstream->packetsize;
+
+	// Grow the cache. The cached data is always stored at the start
+	// of the cache, and is preserved by the reallocation.
+	if (size > rbstream->cachesize) {
+		unsigned char *cache = (unsigned char *) realloc (rbstream->cache, size);
+		if (cache == NULL) {
+			ERROR (rbstream->device->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		rbstream->cache = cache;
+	}
+
+	rbstream->cachesize = size;
+	rbstream->remaining = total;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_rbstream_fetch (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
 	unsigned int address = rbstream->address;
 	unsigned int available = rbstream->available;
 	unsigned int skip = rbstream->skip;
+	unsigned int remaining = rbstream->remaining;
 
 	unsigned int nbytes = 0;
 	unsigned int offset = size;
@@ -125,16 +180,58 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 			if (address == rbstream->begin)
 				address = rbstream->end;
 
-			// Calculate the packet size.
-			unsigned int len = rbstream->packetsize;
+			// Read all complete packets directly into the output
+			// buffer. Only the unaligned head and tail of the
+			// requested range need to pass through the cache.
+			if (skip == 0) {
+				unsigned int len = size - nbytes;
+				if (rbstream->begin + len > address)
+					len = address - rbstream->begin;
+				len -= len % rbstream->packetsize;
+
+				if (len) {
+					address -= len;
+					offset -= len;
+
+					rc = dc_device_read (rbstream->device, address, data + offset, len);
+					if (rc != DC_STATUS_SUCCESS)
+						return rc;
+
+					if (remaining > len)
+						remaining -= len;
+					else
+						remaining = 0;
+
+					rbstream->direct += len;
+
+					// Update and emit a progress event.
+					if (progress) {
+						progress->current += len;
+						device_event_emit (rbstream->device, DC_EVENT_PROGRESS, progress);
+					}
+
+					nbytes += len;
+					continue;
+				}
+			}
+
+			// Calculate the packet size. With read-ahead enabled, as
+			// many packets as fit in the cache are read at once, but
+			// never more than the remaining amount of data.
+			unsigned int len = rbstream->cachesize;
+			if (remaining) {
+				unsigned int needed = iceil (remaining + skip, rbstream->packetsize);
+				if (len > needed)
+					len = needed;
+			}
 			if (rbstream->begin + len > address)
 				len = address - rbstream->begin;
 
 			// Move to the begin of the current packet.
 			address -= len;
 
-			// Read the packet into the cache.
-			rc = dc_device_read (rbstream->device, address, rbstream->cache, rbstream->packetsize);
+			// Read the packets into the cache.
+			rc = dc_device_read (rbstream->device, address, rbstream->cache, iceil (len, rbstream->packetsize));
 			if (rc != DC_STATUS_SUCCESS)
 				return rc;
 
@@ -149,6 +246,11 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 		offset -= length;
 		available -= length;
 
+		if (remaining > length)
+			remaining -= length;
+		else
+			remaining = 0;
+
 		memcpy (data + offset, rbstream->cache + available, length);
 
 		// Update and emit a progress event.
@@ -163,13 +265,90 @@ dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsign
 	rbstream->address = address;
 	rbstream->available = available;
 	rbstream->skip = skip;
+	rbstream->remaining = remaining;
+
+	return rc;
+}
+
+dc_status_t
+dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	if (rbstream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_context_t *context = rbstream->device->context;
+	dc_usecs_t begin = dc_context_trace_begin (context);
+	DC_PROBE2 (rbstream__read__entry, rbstream, size);
+
+	dc_status_t rc = dc_rbstream_fetch (rbstream, progress, data, size);
+
+	DC_PROBE3 (rbstream__read__return, rbstream, size, rc);
+	dc_context_trace_end (context, "dc_rbstream_read", begin);
+
+	return rc;
+}
+
+dc_status_t
+dc_rbstream_walk (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size, const dc_rbstream_record_t *first, dc_rbstream_callback_t callback, void *userdata, unsigned int *offset)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (rbstream == NULL || first == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int current = size;
+	dc_rbstream_record_t record = *first;
+	while (record.size && current) {
+		unsigned int length = record.size + record.reserve;
+		if (length < record.size || length > current) {
+			ERROR (rbstream->device->context, "Unexpected record size (%u %u %u).", record.size, record.reserve, current);
+			rc = DC_STATUS_DATAFORMAT;
+			break;
+		}
+
+		// Move to the start of the current record.
+		current -= length;
+
+		// Read the record.
+		rc = dc_rbstream_read (rbstream, progress, data + current + record.reserve, record.size);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
+		dc_rbstream_record_t next = {0, 0};
+		rc = callback (data + current, length, &next, userdata);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
+		record = next;
+	}
+
+	if (offset)
+		*offset = current;
 
 	return rc;
 }
 
+dc_status_t
+dc_rbstream_get_statistics (dc_rbstream_t *rbstream, unsigned int *direct)
+{
+	if (rbstream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (direct)
+		*direct = rbstream->direct;
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_rbstream_free (dc_rbstream_t *rbstream)
 {
+	if (rbstream == NULL)
+		return DC_STATUS_SUCCESS;
+
+	DEBUG (rbstream->device->context, "Ringbuffer stream: %u bytes read without copying.", rbstream->direct);
+
+	free (rbstream->cache);
 	free (rbstream);
 
 	return DC_STATUS_SUCCESS;
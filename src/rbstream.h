@@ -49,6 +49,25 @@ typedef struct dc_rbstream_t dc_rbstream_t;
 dc_status_t
 dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address);
 
+/**
+ * Enable read-ahead on the ringbuffer stream.
+ *
+ * Instead of a single packet, up to size bytes (rounded up to a multiple
+ * of the packet size) are read from the device at once, and cached for
+ * subsequent reads. If the total amount of data that will be read from
+ * the stream is known in advance, the read-ahead is limited to that
+ * amount, to avoid reading past the last dive.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  size      The maximum read size in bytes.
+ * @param[in]  total     The total number of bytes that will be read
+ *                       from the stream, or zero if unknown.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_set_readahead (dc_rbstream_t *rbstream, unsigned int size, unsigned int total);
+
 /**
  * Read data from the ringbuffer stream.
  *
@@ -62,6 +81,62 @@ dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pag
 dc_status_t
 dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size);
 
+/**
+ * The location of the next record in a ringbuffer walk.
+ */
+typedef struct dc_rbstream_record_t {
+	unsigned int size;    /* The number of bytes to read, or zero to stop. */
+	unsigned int reserve; /* The number of bytes to keep free in front. */
+} dc_rbstream_record_t;
+
+/**
+ * Record callback for the ringbuffer walk.
+ *
+ * The record data starts with the reserved bytes. The location of the
+ * next (and older) record is stored in the next parameter, which is
+ * initialized to stop the walk.
+ */
+typedef dc_status_t (*dc_rbstream_callback_t) (unsigned char data[], unsigned int size, dc_rbstream_record_t *next, void *userdata);
+
+/**
+ * Walk backwards through the records in the ringbuffer stream.
+ *
+ * The records are read back to back into a single memory buffer, from
+ * the end towards the start of the buffer, with the most recent record
+ * first. The callback is invoked as soon as a record is available, and
+ * decides where the next record is located, or stops the walk, for
+ * example when a previously downloaded record is reached. The walk also
+ * stops when the memory buffer is full.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[in]  progress  An (optional) progress event structure.
+ * @param[out] data      The memory buffer to read the records into.
+ * @param[in]  size      The size of the memory buffer in bytes.
+ * @param[in]  first     The location of the first (most recent) record.
+ * @param[in]  callback  The record callback function.
+ * @param[in]  userdata  User data passed to the callback function.
+ * @param[out] offset    The offset of the last record in the buffer.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_walk (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size, const dc_rbstream_record_t *first, dc_rbstream_callback_t callback, void *userdata, unsigned int *offset);
+
+/**
+ * Get the ringbuffer stream statistics.
+ *
+ * Complete packets are read directly into the output buffer, bypassing
+ * the internal cache. The number of bytes read this way, and thus not
+ * copied, is reported here.
+ *
+ * @param[in]  rbstream  A valid ringbuffer stream.
+ * @param[out] direct    The number of bytes read without copying.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_rbstream_get_statistics (dc_rbstream_t *rbstream, unsigned int *direct);
+
 /**
  * Destroy the ringbuffer stream.
  *
@@ -61,9 +61,6 @@ static const dc_device_vtable_t reefnet_sensus_device_vtable = {
 	reefnet_sensus_device_close /* close */
 };
 
-static dc_status_t
-reefnet_sensus_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static dc_status_t
 reefnet_sensus_cancel (reefnet_sensus_device_t *device)
 {
@@ -116,6 +113,8 @@ reefnet_sensus_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (19200 8N1).
 	status = dc_iostream_configure (device->iostream, 19200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -279,8 +278,10 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	reefnet_sensus_device_t *device = (reefnet_sensus_device_t*) abstract;
 
-	// Pre-allocate the required amount of memory.
-	if (!dc_buffer_reserve (buffer, SZ_MEMORY)) {
+	// Allocate the required amount of memory. The answer, including
+	// the header, checksum and trailer, is received directly into the
+	// buffer.
+	if (!dc_buffer_resize (buffer, 4 + SZ_MEMORY + 2 + 3)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -308,9 +309,17 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 	// Receive the answer from the device.
 	unsigned int nbytes = 0;
-	unsigned char answer[4 + SZ_MEMORY + 2 + 3] = {0};
-	while (nbytes < sizeof (answer)) {
-		unsigned int len = sizeof (answer) - nbytes;
+	unsigned char *answer = dc_buffer_get_data (buffer);
+	unsigned int asize = dc_buffer_get_size (buffer);
+	while (nbytes < asize) {
+		// The device sends the entire memory at once, and the
+		// remaining data is discarded when the transfer is cancelled.
+		if (device_is_cancelled (abstract)) {
+			dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+			return DC_STATUS_CANCELLED;
+		}
+
+		unsigned int len = asize - nbytes;
 		if (len > 128)
 			len = 128;
 
@@ -329,7 +338,7 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 	// Verify the headers of the package.
 	if (memcmp (answer, "DATA", 4) != 0 ||
-		memcmp (answer + sizeof (answer) - 3, "END", 3) != 0) {
+		memcmp (answer + asize - 3, "END", 3) != 0) {
 		ERROR (abstract->context, "Unexpected answer start or end byte(s).");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -338,11 +347,13 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	unsigned short crc = array_uint16_le (answer + 4 + SZ_MEMORY);
 	unsigned short ccrc = checksum_add_uint16 (answer + 4, SZ_MEMORY, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
 
-	dc_buffer_append (buffer, answer + 4, SZ_MEMORY);
+	// Remove the header, checksum and trailer bytes.
+	dc_buffer_slice (buffer, 4, SZ_MEMORY);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -351,7 +362,7 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 reefnet_sensus_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 4 + SZ_MEMORY + 2 + 3);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -370,7 +381,7 @@ reefnet_sensus_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 }
 
 
-static dc_status_t
+dc_status_t
 reefnet_sensus_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	reefnet_sensus_device_t *device = (reefnet_sensus_device_t*) abstract;
@@ -385,6 +396,13 @@ reefnet_sensus_extract_dives (dc_device_t *abstract, const unsigned char data[],
 	while (current > 0) {
 		current--;
 		if (data[current] == 0xFF && data[current + 6] == 0xFE) {
+			// Automatically abort when a dive is older than the
+			// provided timestamp. The end of such a dive is not
+			// needed, and isn't searched.
+			unsigned int timestamp = array_uint32_le (data + current + 2);
+			if (device && timestamp <= device->timestamp)
+				return DC_STATUS_SUCCESS;
+
 			// Once a start marker is found, start searching
 			// for the end of the dive. The search is now
 			// limited to the start of the previous dive.
@@ -424,11 +442,6 @@ reefnet_sensus_extract_dives (dc_device_t *abstract, const unsigned char data[],
 				return DC_STATUS_DATAFORMAT;
 			}
 
-			// Automatically abort when a dive is older than the provided timestamp.
-			unsigned int timestamp = array_uint32_le (data + current + 2);
-			if (device && timestamp <= device->timestamp)
-				return DC_STATUS_SUCCESS;
-
 			if (callback && !callback (data + current, offset - current, data + current + 2, 4, userdata))
 				return DC_STATUS_SUCCESS;
 
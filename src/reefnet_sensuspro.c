@@ -60,9 +60,6 @@ static const dc_device_vtable_t reefnet_sensuspro_device_vtable = {
 	reefnet_sensuspro_device_close /* close */
 };
 
-static dc_status_t
-reefnet_sensuspro_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 dc_status_t
 reefnet_sensuspro_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -93,6 +90,8 @@ reefnet_sensuspro_device_open (dc_device_t **out, dc_context_t *context, const c
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (19200 8N1).
 	status = dc_iostream_configure (device->iostream, 19200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -207,6 +206,7 @@ reefnet_sensuspro_handshake (reefnet_sensuspro_device_t *device)
 	unsigned short crc = array_uint16_le (handshake + SZ_HANDSHAKE);
 	unsigned short ccrc = checksum_crc_ccitt_uint16 (handshake, SZ_HANDSHAKE);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -271,8 +271,9 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	reefnet_sensuspro_device_t *device = (reefnet_sensuspro_device_t*) abstract;
 
-	// Pre-allocate the required amount of memory.
-	if (!dc_buffer_reserve (buffer, SZ_MEMORY)) {
+	// Allocate the required amount of memory. The answer, including
+	// the checksum, is received directly into the buffer.
+	if (!dc_buffer_resize (buffer, SZ_MEMORY + 2)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -288,9 +289,16 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return rc;
 
 	unsigned int nbytes = 0;
-	unsigned char answer[SZ_MEMORY + 2] = {0};
-	while (nbytes < sizeof (answer)) {
-		unsigned int len = sizeof (answer) - nbytes;
+	unsigned char *answer = dc_buffer_get_data (buffer);
+	while (nbytes < SZ_MEMORY + 2) {
+		// The device sends the entire memory at once, and the
+		// remaining data is discarded when the transfer is cancelled.
+		if (device_is_cancelled (abstract)) {
+			dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+			return DC_STATUS_CANCELLED;
+		}
+
+		unsigned int len = SZ_MEMORY + 2 - nbytes;
 		if (len > 256)
 			len = 256;
 
@@ -310,11 +318,13 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	unsigned short crc = array_uint16_le (answer + SZ_MEMORY);
 	unsigned short ccrc = checksum_crc_ccitt_uint16 (answer, SZ_MEMORY);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
 
-	dc_buffer_append (buffer, answer, SZ_MEMORY);
+	// Remove the checksum bytes.
+	dc_buffer_slice (buffer, 0, SZ_MEMORY);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -323,7 +333,7 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 reefnet_sensuspro_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, SZ_MEMORY + 2);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -371,7 +381,7 @@ reefnet_sensuspro_device_write_interval (dc_device_t *abstract, unsigned char in
 }
 
 
-static dc_status_t
+dc_status_t
 reefnet_sensuspro_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	reefnet_sensuspro_device_t *device = (reefnet_sensuspro_device_t*) abstract;
@@ -388,6 +398,13 @@ reefnet_sensuspro_extract_dives (dc_device_t *abstract, const unsigned char data
 	while (current > 0) {
 		current--;
 		if (memcmp (data + current, header, sizeof (header)) == 0) {
+			// Automatically abort when a dive is older than the
+			// provided timestamp. The end of such a dive is not
+			// needed, and isn't searched.
+			unsigned int timestamp = array_uint32_le (data + current + 6);
+			if (device && timestamp <= device->timestamp)
+				return DC_STATUS_SUCCESS;
+
 			// Once a start marker is found, start searching
 			// for the corresponding stop marker. The search is
 			// now limited to the start of the previous dive.
@@ -406,11 +423,6 @@ reefnet_sensuspro_extract_dives (dc_device_t *abstract, const unsigned char data
 			if (!found)
 				return DC_STATUS_DATAFORMAT;
 
-			// Automatically abort when a dive is older than the provided timestamp.
-			unsigned int timestamp = array_uint32_le (data + current + 6);
-			if (device && timestamp <= device->timestamp)
-				return DC_STATUS_SUCCESS;
-
 			if (callback && !callback (data + current, offset + 2 - current, data + current + 6, 4, userdata))
 				return DC_STATUS_SUCCESS;
 
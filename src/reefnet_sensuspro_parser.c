@@ -59,6 +59,9 @@ static const dc_parser_vtable_t reefnet_sensuspro_parser_vtable = {
 	reefnet_sensuspro_parser_get_datetime, /* datetime */
 	reefnet_sensuspro_parser_get_field, /* fields */
 	reefnet_sensuspro_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -118,6 +121,8 @@ reefnet_sensuspro_parser_set_calibration (dc_parser_t *abstract, double atmosphe
 	parser->atmospheric = atmospheric;
 	parser->hydrostatic = hydrostatic;
 
+	dc_parser_invalidate_summary (abstract);
+
 	return DC_STATUS_SUCCESS;
 }
 
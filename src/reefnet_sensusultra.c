@@ -100,6 +100,8 @@ reefnet_sensusultra_device_open (dc_device_t **out, dc_context_t *context, const
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -232,8 +234,13 @@ reefnet_sensusultra_send_ushort (reefnet_sensusultra_device_t *device, unsigned
 }
 
 
+/*
+ * Receive a packet and verify its checksum. If a payload buffer is
+ * provided, the bytes between the header and the checksum are copied
+ * into it while the checksum is calculated.
+ */
 static dc_status_t
-reefnet_sensusultra_packet (reefnet_sensusultra_device_t *device, unsigned char *data, unsigned int size, unsigned int header)
+reefnet_sensusultra_packet (reefnet_sensusultra_device_t *device, unsigned char *data, unsigned int size, unsigned int header, unsigned char payload[])
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
@@ -252,8 +259,13 @@ reefnet_sensusultra_packet (reefnet_sensusultra_device_t *device, unsigned char
 
 	// Verify the checksum of the packet.
 	unsigned short crc = array_uint16_le (data + size - 2);
-	unsigned short ccrc = checksum_crc_ccitt_uint16 (data + header, size - header - 2);
+	unsigned short ccrc = 0;
+	if (payload)
+		ccrc = checksum_crc_ccitt_copy (payload, data + header, size - header - 2, 0xffff);
+	else
+		ccrc = checksum_crc_ccitt_uint16 (data + header, size - header - 2);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -267,7 +279,7 @@ reefnet_sensusultra_handshake (reefnet_sensusultra_device_t *device, unsigned sh
 {
 	// Wake-up the device.
 	unsigned char handshake[SZ_HANDSHAKE + 2] = {0};
-	dc_status_t rc = reefnet_sensusultra_packet (device, handshake, sizeof (handshake), 0);
+	dc_status_t rc = reefnet_sensusultra_packet (device, handshake, sizeof (handshake), 0, NULL);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -307,7 +319,7 @@ reefnet_sensusultra_handshake (reefnet_sensusultra_device_t *device, unsigned sh
 
 
 static dc_status_t
-reefnet_sensusultra_page (reefnet_sensusultra_device_t *device, unsigned char *data, unsigned int size, unsigned int pagenum)
+reefnet_sensusultra_page (reefnet_sensusultra_device_t *device, unsigned char *data, unsigned int size, unsigned int pagenum, unsigned char payload[])
 {
 	dc_device_t *abstract = (dc_device_t *) device;
 
@@ -315,7 +327,7 @@ reefnet_sensusultra_page (reefnet_sensusultra_device_t *device, unsigned char *d
 
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = reefnet_sensusultra_packet (device, data, size, 2)) != DC_STATUS_SUCCESS) {
+	while ((rc = reefnet_sensusultra_packet (device, data, size, 2, payload)) != DC_STATUS_SUCCESS) {
 		// Automatically discard a corrupted packet,
 		// and request a new one.
 		if (rc != DC_STATUS_PROTOCOL)
@@ -325,6 +337,8 @@ reefnet_sensusultra_page (reefnet_sensusultra_device_t *device, unsigned char *d
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// Reject the packet.
 		rc = reefnet_sensusultra_send_uchar (device, REJECT);
 		if (rc != DC_STATUS_SUCCESS)
@@ -338,6 +352,12 @@ reefnet_sensusultra_page (reefnet_sensusultra_device_t *device, unsigned char *d
 		return DC_STATUS_PROTOCOL;
 	}
 
+	// Accept the packet right away. The device can then transmit the next
+	// page while the caller is still processing this one.
+	rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -361,6 +381,8 @@ reefnet_sensusultra_send (reefnet_sensusultra_device_t *device, unsigned short c
 		if (nretries++ >= MAXRETRIES)
 			return rc;
 
+		device_stats_retry ((dc_device_t *) device);
+
 		// According to the developers guide, a 250 ms delay is suggested to
 		// guarantee that the prompt byte sent after the handshake packet is
 		// not accidentally buffered by the host and (mis)interpreted as part
@@ -400,7 +422,7 @@ reefnet_sensusultra_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	while (nbytes < SZ_MEMORY) {
 		// Receive the packet.
 		unsigned char packet[SZ_PACKET + 4] = {0};
-		rc = reefnet_sensusultra_page (device, packet, sizeof (packet), npages);
+		rc = reefnet_sensusultra_page (device, packet, sizeof (packet), npages, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -414,11 +436,6 @@ reefnet_sensusultra_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			return DC_STATUS_NOMEMORY;
 		}
 
-		// Accept the packet.
-		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
 		nbytes += SZ_PACKET;
 		npages++;
 	}
@@ -450,15 +467,8 @@ reefnet_sensusultra_device_read_user (dc_device_t *abstract, unsigned char *data
 	while (nbytes < SZ_USER) {
 		// Receive the packet.
 		unsigned char packet[SZ_PACKET + 4] = {0};
-		rc = reefnet_sensusultra_page (device, packet, sizeof (packet), npages);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
 		// Append the packet to the buffer.
-		memcpy (data + nbytes, packet + 2, SZ_PACKET);
-
-		// Accept the packet.
-		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
+		rc = reefnet_sensusultra_page (device, packet, sizeof (packet), npages, data + nbytes);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
@@ -587,12 +597,10 @@ reefnet_sensusultra_device_sense (dc_device_t *abstract, unsigned char *data, un
 
 	// Receive the packet.
 	unsigned char package[SZ_SENSE + 2] = {0};
-	rc = reefnet_sensusultra_packet (device, package, sizeof (package), 0);
+	rc = reefnet_sensusultra_packet (device, package, sizeof (package), 0, data);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	memcpy (data, package, SZ_SENSE);
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -672,7 +680,7 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 {
 	reefnet_sensusultra_device_t *device = (reefnet_sensusultra_device_t*) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, SZ_MEMORY);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -699,7 +707,7 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 	while (nbytes < SZ_MEMORY) {
 		// Receive the packet.
 		unsigned char packet[SZ_PACKET + 4] = {0};
-		rc = reefnet_sensusultra_page (device, packet, sizeof (packet), npages);
+		rc = reefnet_sensusultra_page (device, packet, sizeof (packet), npages, NULL);
 		if (rc != DC_STATUS_SUCCESS) {
 			dc_buffer_free (buffer);
 			return rc;
@@ -735,13 +743,6 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 		if (aborted)
 			break;
 
-		// Accept the packet.
-		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
-		if (rc != DC_STATUS_SUCCESS) {
-			dc_buffer_free (buffer);
-			return rc;
-		}
-
 		nbytes += SZ_PACKET;
 		npages++;
 	}
@@ -0,0 +1,1043 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <errno.h>
+#include <time.h>	// nanosleep
+#endif
+
+#include <libdivecomputer/replay.h>
+
+#include "emulator-private.h"
+#include "iostream-private.h"
+#include "context-private.h"
+#include "timer.h"
+#include "array.h"
+
+#define SZ_HEADER 16
+#define SZ_EVENT  40
+
+#define FORMAT_VERSION 1
+
+/*
+ * File layout (all values are little endian):
+ *
+ *   header: magic (8 bytes), version (4 bytes), reserved (4 bytes)
+ *   event:  type, status, timestamp (8 bytes, in microseconds since the
+ *           stream was opened), five parameters and the data size,
+ *           followed by the data.
+ *
+ * The parameters depend on the type of the event. For reads and writes,
+ * the first parameter is the requested size, and the data contains the
+ * bytes that were actually transferred.
+ */
+static const unsigned char magic[8] = {'D', 'C', 'R', 'E', 'P', 'L', 'A', 'Y'};
+
+typedef enum dc_replay_event_t {
+	EVENT_TIMEOUT,
+	EVENT_LATENCY,
+	EVENT_BREAK,
+	EVENT_DTR,
+	EVENT_RTS,
+	EVENT_LINES,
+	EVENT_AVAILABLE,
+	EVENT_POLL,
+	EVENT_CONFIGURE,
+	EVENT_READ,
+	EVENT_WRITE,
+	EVENT_FLUSH,
+	EVENT_PURGE,
+	EVENT_SLEEP,
+} dc_replay_event_t;
+
+typedef struct dc_recorder_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	dc_iostream_t *iostream;
+	dc_timer_t *timer;
+	FILE *fp;
+} dc_recorder_t;
+
+typedef struct dc_replay_chunk_t {
+	const unsigned char *data;
+	unsigned int size;
+	dc_status_t status;
+	size_t txpos;
+	dc_usecs_t timestamp;
+} dc_replay_chunk_t;
+
+typedef struct dc_replay_t {
+	/* Base class. */
+	dc_iostream_t base;
+	/* Internal state. */
+	unsigned char *buffer;
+	dc_replay_chunk_t *chunks;
+	size_t nchunks;
+	unsigned char *tx;
+	size_t txsize;
+	// Position in the capture.
+	size_t chunk;
+	size_t offset;
+	size_t txpos;
+	dc_status_t pending;
+	unsigned int mismatch;
+	// Pacing.
+	dc_replay_pacing_t pacing;
+	dc_timer_t *timer;
+	dc_usecs_t latency;
+	dc_usecs_t charusecs;
+	dc_usecs_t elapsed;
+} dc_replay_t;
+
+static dc_status_t dc_recorder_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_recorder_set_latency (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_recorder_set_break (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_recorder_set_dtr (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_recorder_set_rts (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_recorder_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_recorder_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_recorder_poll (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_recorder_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_recorder_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_recorder_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_recorder_flush (dc_iostream_t *abstract);
+static dc_status_t dc_recorder_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_recorder_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_recorder_close (dc_iostream_t *abstract);
+
+static dc_status_t dc_replay_set_timeout (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_replay_set_value (dc_iostream_t *abstract, unsigned int value);
+static dc_status_t dc_replay_get_lines (dc_iostream_t *abstract, unsigned int *value);
+static dc_status_t dc_replay_get_available (dc_iostream_t *abstract, size_t *value);
+static dc_status_t dc_replay_poll (dc_iostream_t *abstract, int timeout);
+static dc_status_t dc_replay_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_replay_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_replay_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_replay_flush (dc_iostream_t *abstract);
+static dc_status_t dc_replay_purge (dc_iostream_t *abstract, dc_direction_t direction);
+static dc_status_t dc_replay_sleep (dc_iostream_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_replay_close (dc_iostream_t *abstract);
+
+static const dc_iostream_vtable_t dc_recorder_vtable = {
+	sizeof(dc_recorder_t),
+	dc_recorder_set_timeout, /* set_timeout */
+	dc_recorder_set_latency, /* set_latency */
+	dc_recorder_set_break, /* set_break */
+	dc_recorder_set_dtr, /* set_dtr */
+	dc_recorder_set_rts, /* set_rts */
+	dc_recorder_get_lines, /* get_lines */
+	dc_recorder_get_available, /* get_available */
+	dc_recorder_poll, /* poll */
+	dc_recorder_configure, /* configure */
+	dc_recorder_read, /* read */
+	dc_recorder_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_recorder_flush, /* flush */
+	dc_recorder_purge, /* purge */
+	dc_recorder_sleep, /* sleep */
+	dc_recorder_close, /* close */
+	NULL, /* cancel */
+};
+
+static const dc_iostream_vtable_t dc_replay_vtable = {
+	sizeof(dc_replay_t),
+	dc_replay_set_timeout, /* set_timeout */
+	dc_replay_set_value, /* set_latency */
+	dc_replay_set_value, /* set_break */
+	dc_replay_set_value, /* set_dtr */
+	dc_replay_set_value, /* set_rts */
+	dc_replay_get_lines, /* get_lines */
+	dc_replay_get_available, /* get_available */
+	dc_replay_poll, /* poll */
+	dc_replay_configure, /* configure */
+	dc_replay_read, /* read */
+	dc_replay_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_replay_flush, /* flush */
+	dc_replay_purge, /* purge */
+	dc_replay_sleep, /* sleep */
+	dc_replay_close, /* close */
+	NULL, /* cancel */
+};
+
+static dc_status_t
+dc_recorder_event (dc_recorder_t *recorder, dc_replay_event_t type, dc_status_t status, const unsigned int params[], unsigned int nparams, const void *data, size_t size)
+{
+	unsigned char header[SZ_EVENT] = {0};
+	dc_usecs_t now = 0;
+
+	if (recorder->fp == NULL)
+		return status;
+
+	if (dc_timer_now (recorder->timer, &now) != DC_STATUS_SUCCESS)
+		now = 0;
+
+	array_uint32_le_set (header + 0, type);
+	array_uint32_le_set (header + 4, (unsigned int) status);
+	array_uint32_le_set (header + 8, now & 0xFFFFFFFF);
+	array_uint32_le_set (header + 12, (now >> 32) & 0xFFFFFFFF);
+	for (unsigned int i = 0; i < nparams; ++i) {
+		array_uint32_le_set (header + 16 + 4 * i, params[i]);
+	}
+	array_uint32_le_set (header + 36, size);
+
+	if (fwrite (header, sizeof (header), 1, recorder->fp) != 1 ||
+		(size && fwrite (data, size, 1, recorder->fp) != 1)) {
+		// Stop recording, but keep the stream itself working.
+		ERROR (recorder->base.context, "Failed to write the capture file.");
+		fclose (recorder->fp);
+		recorder->fp = NULL;
+	}
+
+	return status;
+}
+
+static dc_status_t
+dc_recorder_value (dc_recorder_t *recorder, dc_replay_event_t type, dc_status_t status, unsigned int value)
+{
+	return dc_recorder_event (recorder, type, status, &value, 1, NULL, 0);
+}
+
+dc_status_t
+dc_recorder_open (dc_iostream_t **out, dc_context_t *context, dc_iostream_t *iostream, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_recorder_t *recorder = NULL;
+	unsigned char header[SZ_HEADER] = {0};
+
+	if (out == NULL || iostream == NULL || filename == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: recorder=%s", filename);
+
+	// Allocate memory.
+	recorder = (dc_recorder_t *) dc_iostream_allocate (context, &dc_recorder_vtable);
+	if (recorder == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	recorder->iostream = iostream;
+
+	status = dc_timer_new (&recorder->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_free;
+	}
+
+	recorder->fp = fopen (filename, "wb");
+	if (recorder->fp == NULL) {
+		ERROR (context, "Failed to open the capture file.");
+		status = DC_STATUS_IO;
+		goto error_timer_free;
+	}
+
+	memcpy (header, magic, sizeof (magic));
+	array_uint32_le_set (header + 8, FORMAT_VERSION);
+	if (fwrite (header, sizeof (header), 1, recorder->fp) != 1) {
+		ERROR (context, "Failed to write the capture file.");
+		status = DC_STATUS_IO;
+		goto error_fclose;
+	}
+
+	*out = (dc_iostream_t *) recorder;
+
+	return DC_STATUS_SUCCESS;
+
+error_fclose:
+	fclose (recorder->fp);
+error_timer_free:
+	dc_timer_free (recorder->timer);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) recorder);
+	return status;
+}
+
+static dc_status_t
+dc_recorder_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->set_timeout == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->set_timeout (iostream, timeout);
+
+	return dc_recorder_value (recorder, EVENT_TIMEOUT, status, (unsigned int) timeout);
+}
+
+static dc_status_t
+dc_recorder_set_latency (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->set_latency == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->set_latency (iostream, value);
+
+	return dc_recorder_value (recorder, EVENT_LATENCY, status, value);
+}
+
+static dc_status_t
+dc_recorder_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->set_break == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->set_break (iostream, value);
+
+	return dc_recorder_value (recorder, EVENT_BREAK, status, value);
+}
+
+static dc_status_t
+dc_recorder_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->set_dtr == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->set_dtr (iostream, value);
+
+	return dc_recorder_value (recorder, EVENT_DTR, status, value);
+}
+
+static dc_status_t
+dc_recorder_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->set_rts == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->set_rts (iostream, value);
+
+	return dc_recorder_value (recorder, EVENT_RTS, status, value);
+}
+
+static dc_status_t
+dc_recorder_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+	unsigned int lines = 0;
+
+	if (iostream->vtable->get_lines == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->get_lines (iostream, &lines);
+
+	if (value)
+		*value = lines;
+
+	return dc_recorder_value (recorder, EVENT_LINES, status, lines);
+}
+
+static dc_status_t
+dc_recorder_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+	size_t available = 0;
+
+	if (iostream->vtable->get_available == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->get_available (iostream, &available);
+
+	if (value)
+		*value = available;
+
+	return dc_recorder_value (recorder, EVENT_AVAILABLE, status, available);
+}
+
+static dc_status_t
+dc_recorder_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->poll == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->poll (iostream, timeout);
+
+	return dc_recorder_value (recorder, EVENT_POLL, status, (unsigned int) timeout);
+}
+
+static dc_status_t
+dc_recorder_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+	unsigned int params[] = {baudrate, databits, parity, stopbits, flowcontrol};
+
+	if (iostream->vtable->configure == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->configure (iostream, baudrate, databits, parity, stopbits, flowcontrol);
+
+	return dc_recorder_event (recorder, EVENT_CONFIGURE, status, params, 5, NULL, 0);
+}
+
+static dc_status_t
+dc_recorder_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+	unsigned int params[] = {size};
+	size_t nbytes = 0;
+
+	dc_status_t status = iostream->vtable->read (iostream, data, size, &nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return dc_recorder_event (recorder, EVENT_READ, status, params, 1, data, nbytes);
+}
+
+static dc_status_t
+dc_recorder_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+	unsigned int params[] = {size};
+	size_t nbytes = 0;
+
+	dc_status_t status = iostream->vtable->write (iostream, data, size, &nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return dc_recorder_event (recorder, EVENT_WRITE, status, params, 1, data, nbytes);
+}
+
+static dc_status_t
+dc_recorder_flush (dc_iostream_t *abstract)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->flush == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->flush (iostream);
+
+	return dc_recorder_event (recorder, EVENT_FLUSH, status, NULL, 0, NULL, 0);
+}
+
+static dc_status_t
+dc_recorder_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->purge == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->purge (iostream, direction);
+
+	return dc_recorder_value (recorder, EVENT_PURGE, status, direction);
+}
+
+static dc_status_t
+dc_recorder_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+	dc_iostream_t *iostream = recorder->iostream;
+
+	if (iostream->vtable->sleep == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_status_t status = iostream->vtable->sleep (iostream, milliseconds);
+
+	return dc_recorder_value (recorder, EVENT_SLEEP, status, milliseconds);
+}
+
+static dc_status_t
+dc_recorder_close (dc_iostream_t *abstract)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_recorder_t *recorder = (dc_recorder_t *) abstract;
+
+	if (recorder->fp && fclose (recorder->fp) != 0) {
+		ERROR (abstract->context, "Failed to write the capture file.");
+		status = DC_STATUS_IO;
+	}
+
+	dc_status_t rc = dc_iostream_close (recorder->iostream);
+	if (status == DC_STATUS_SUCCESS)
+		status = rc;
+
+	dc_timer_free (recorder->timer);
+
+	return status;
+}
+
+static dc_status_t
+dc_replay_load (dc_context_t *context, const char *filename, unsigned char **data, size_t *size)
+{
+	unsigned char *buffer = NULL;
+	size_t nbytes = 0, capacity = 0;
+
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the capture file.");
+		return DC_STATUS_IO;
+	}
+
+	while (1) {
+		if (nbytes == capacity) {
+			capacity = capacity ? 2 * capacity : 65536;
+			unsigned char *tmp = (unsigned char *) realloc (buffer, capacity);
+			if (tmp == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				free (buffer);
+				fclose (fp);
+				return DC_STATUS_NOMEMORY;
+			}
+			buffer = tmp;
+		}
+
+		size_t n = fread (buffer + nbytes, 1, capacity - nbytes, fp);
+		if (n == 0)
+			break;
+		nbytes += n;
+	}
+
+	if (ferror (fp)) {
+		ERROR (context, "Failed to read the capture file.");
+		free (buffer);
+		fclose (fp);
+		return DC_STATUS_IO;
+	}
+
+	fclose (fp);
+
+	*data = buffer;
+	*size = nbytes;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_replay_open (dc_iostream_t **out, dc_context_t *context, const char *filename, dc_replay_pacing_t pacing, unsigned int latency)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_replay_t *replay = NULL;
+	size_t size = 0;
+
+	if (out == NULL || filename == NULL || pacing > DC_REPLAY_PACING_MODEL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: replay=%s", filename);
+
+	// Allocate memory.
+	replay = (dc_replay_t *) dc_iostream_allocate (context, &dc_replay_vtable);
+	if (replay == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	replay->buffer = NULL;
+	replay->chunks = NULL;
+	replay->nchunks = 0;
+	replay->tx = NULL;
+	replay->txsize = 0;
+	replay->chunk = 0;
+	replay->offset = 0;
+	replay->txpos = 0;
+	replay->pending = DC_STATUS_SUCCESS;
+	replay->mismatch = 0;
+	replay->pacing = pacing;
+	replay->timer = NULL;
+	replay->latency = latency * 1000ULL;
+	replay->charusecs = 0;
+	replay->elapsed = 0;
+
+	status = dc_replay_load (context, filename, &replay->buffer, &size);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (size < SZ_HEADER ||
+		memcmp (replay->buffer, magic, sizeof (magic)) != 0 ||
+		array_uint32_le (replay->buffer + 8) != FORMAT_VERSION) {
+		ERROR (context, "Invalid capture file header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_free;
+	}
+
+	// Count the reads and the written bytes, and find the end of the
+	// last complete event.
+	size_t nchunks = 0, txsize = 0, end = SZ_HEADER;
+	while (end + SZ_EVENT <= size) {
+		const unsigned char *p = replay->buffer + end;
+		unsigned int type = array_uint32_le (p);
+		unsigned int length = array_uint32_le (p + 36);
+		if (length > size - end - SZ_EVENT)
+			break;
+		if (type == EVENT_READ)
+			nchunks++;
+		else if (type == EVENT_WRITE)
+			txsize += length;
+		end += SZ_EVENT + length;
+	}
+
+	if (end != size) {
+		WARNING (context, "Ignoring an incomplete event at the end of the capture file.");
+	}
+
+	replay->chunks = (dc_replay_chunk_t *) malloc ((nchunks ? nchunks : 1) * sizeof (dc_replay_chunk_t));
+	replay->tx = (unsigned char *) malloc (txsize ? txsize : 1);
+	if (replay->chunks == NULL || replay->tx == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	// Split the events into the received chunks and the written data.
+	size_t offset = SZ_HEADER;
+	while (offset < end) {
+		const unsigned char *p = replay->buffer + offset;
+		unsigned int type = array_uint32_le (p);
+		unsigned int length = array_uint32_le (p + 36);
+		if (type == EVENT_READ) {
+			dc_replay_chunk_t *chunk = &replay->chunks[replay->nchunks++];
+			chunk->data = p + SZ_EVENT;
+			chunk->size = length;
+			chunk->status = (dc_status_t) (int) array_uint32_le (p + 4);
+			chunk->txpos = replay->txsize;
+			chunk->timestamp = array_uint32_le (p + 8) |
+				((dc_usecs_t) array_uint32_le (p + 12) << 32);
+		} else if (type == EVENT_WRITE) {
+			memcpy (replay->tx + replay->txsize, p + SZ_EVENT, length);
+			replay->txsize += length;
+		}
+		offset += SZ_EVENT + length;
+	}
+
+	if (pacing != DC_REPLAY_PACING_NONE) {
+		status = dc_timer_new (&replay->timer);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to create a high resolution timer.");
+			goto error_free;
+		}
+	}
+
+	*out = (dc_iostream_t *) replay;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	free (replay->tx);
+	free (replay->chunks);
+	free (replay->buffer);
+	dc_iostream_deallocate ((dc_iostream_t *) replay);
+	return status;
+}
+
+dc_status_t
+dc_replay_get_elapsed (dc_iostream_t *abstract, unsigned long long *usecs)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	if (!dc_iostream_isinstance (abstract, &dc_replay_vtable) || usecs == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*usecs = replay->elapsed;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_replay_usleep (dc_usecs_t usecs)
+{
+#ifdef _WIN32
+	Sleep ((DWORD) ((usecs + 999) / 1000));
+#else
+	struct timespec ts;
+	ts.tv_sec  = (usecs / 1000000);
+	ts.tv_nsec = (usecs % 1000000) * 1000;
+
+	while (nanosleep (&ts, &ts) != 0 && errno == EINTR) {
+	}
+#endif
+}
+
+/*
+ * Account for the modelled duration of a transfer, and wait for it when
+ * pacing with the model.
+ */
+static void
+dc_replay_transfer (dc_replay_t *replay, size_t nbytes)
+{
+	dc_usecs_t duration = replay->latency + nbytes * replay->charusecs;
+
+	replay->elapsed += duration;
+
+	if (replay->pacing == DC_REPLAY_PACING_MODEL && duration)
+		dc_replay_usleep (duration);
+}
+
+/*
+ * Wait until the time at which the chunk was received in the capture.
+ */
+static void
+dc_replay_wait (dc_replay_t *replay, const dc_replay_chunk_t *chunk)
+{
+	dc_usecs_t now = 0;
+
+	if (replay->pacing != DC_REPLAY_PACING_REALTIME)
+		return;
+
+	if (dc_timer_now (replay->timer, &now) == DC_STATUS_SUCCESS && now < chunk->timestamp)
+		dc_replay_usleep (chunk->timestamp - now);
+}
+
+static dc_status_t
+dc_replay_set_timeout (dc_iostream_t *abstract, int timeout)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_set_value (dc_iostream_t *abstract, unsigned int value)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	if (value)
+		*value = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	size_t available = 0;
+
+	// Sum the chunks that are already released, up to the next
+	// recorded error.
+	size_t offset = replay->offset;
+	if (replay->pending == DC_STATUS_SUCCESS) {
+		for (size_t i = replay->chunk; i < replay->nchunks; ++i) {
+			const dc_replay_chunk_t *chunk = &replay->chunks[i];
+			if (chunk->txpos > replay->txpos)
+				break;
+			available += chunk->size - offset;
+			offset = 0;
+			if (chunk->status != DC_STATUS_SUCCESS)
+				break;
+		}
+	}
+
+	if (value)
+		*value = available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_poll (dc_iostream_t *abstract, int timeout)
+{
+	size_t available = 0;
+
+	dc_replay_get_available (abstract, &available);
+
+	return available ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+}
+
+static dc_status_t
+dc_replay_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	if (baudrate == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	// The number of bits per character, including the start bit.
+	unsigned int nbits = 1 + databits +
+		(parity != DC_PARITY_NONE) +
+		(stopbits == DC_STOPBITS_ONE ? 1 : 2);
+
+	replay->charusecs = (nbits * 1000000ULL + baudrate - 1) / baudrate;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+	unsigned char *p = (unsigned char *) data;
+	size_t nbytes = 0;
+
+	while (nbytes < size) {
+		// Report a recorded error once all data before it is consumed.
+		if (replay->pending != DC_STATUS_SUCCESS) {
+			status = replay->pending;
+			replay->pending = DC_STATUS_SUCCESS;
+			break;
+		}
+
+		// Without any released data, the device does not answer.
+		if (replay->chunk >= replay->nchunks ||
+			replay->chunks[replay->chunk].txpos > replay->txpos) {
+			status = DC_STATUS_TIMEOUT;
+			break;
+		}
+
+		const dc_replay_chunk_t *chunk = &replay->chunks[replay->chunk];
+		if (replay->offset == 0)
+			dc_replay_wait (replay, chunk);
+
+		size_t n = chunk->size - replay->offset;
+		if (n > size - nbytes)
+			n = size - nbytes;
+
+		memcpy (p + nbytes, chunk->data + replay->offset, n);
+		replay->offset += n;
+		nbytes += n;
+
+		if (replay->offset == chunk->size) {
+			replay->pending = chunk->status;
+			replay->chunk++;
+			replay->offset = 0;
+		}
+	}
+
+	dc_replay_transfer (replay, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_replay_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	if (!replay->mismatch &&
+		(size > replay->txsize - replay->txpos ||
+		memcmp (replay->tx + replay->txpos, data, size) != 0)) {
+		WARNING (abstract->context, "Written data differs from the capture at offset %u.",
+			(unsigned int) replay->txpos);
+		replay->mismatch = 1;
+	}
+
+	replay->txpos += size;
+
+	dc_replay_transfer (replay, size);
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_flush (dc_iostream_t *abstract)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_sleep (dc_iostream_t *abstract, unsigned int milliseconds)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	replay->elapsed += milliseconds * 1000ULL;
+
+	if (replay->pacing != DC_REPLAY_PACING_NONE)
+		dc_replay_usleep (milliseconds * 1000ULL);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_close (dc_iostream_t *abstract)
+{
+	dc_replay_t *replay = (dc_replay_t *) abstract;
+
+	if (replay->chunk < replay->nchunks) {
+		WARNING (abstract->context, "Closed before the end of the capture (%u of %u chunks).",
+			(unsigned int) replay->chunk, (unsigned int) replay->nchunks);
+	}
+
+	dc_timer_free (replay->timer);
+	free (replay->tx);
+	free (replay->chunks);
+	free (replay->buffer);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Serial callbacks for the custom I/O. The generic I/O stream layer
+ * already logs the calls, so the vtable is used directly.
+ */
+
+static dc_status_t
+dc_replay_io_open (dc_custom_io_t *io, dc_context_t *context, const char *name)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_io_close (dc_custom_io_t *io)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_replay_io_read (dc_custom_io_t *io, void *data, size_t size, size_t *actual)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->read (iostream, data, size, actual);
+}
+
+static dc_status_t
+dc_replay_io_write (dc_custom_io_t *io, const void *data, size_t size, size_t *actual)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->write (iostream, data, size, actual);
+}
+
+static dc_status_t
+dc_replay_io_purge (dc_custom_io_t *io, dc_direction_t direction)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->purge (iostream, direction);
+}
+
+static dc_status_t
+dc_replay_io_get_available (dc_custom_io_t *io, size_t *value)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->get_available (iostream, value);
+}
+
+static dc_status_t
+dc_replay_io_set_timeout (dc_custom_io_t *io, long timeout)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->set_timeout (iostream, (int) timeout);
+}
+
+static dc_status_t
+dc_replay_io_configure (dc_custom_io_t *io, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->configure (iostream, baudrate, databits, parity, stopbits, flowcontrol);
+}
+
+static dc_status_t
+dc_replay_io_set_dtr (dc_custom_io_t *io, int level)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->set_dtr (iostream, level);
+}
+
+static dc_status_t
+dc_replay_io_set_rts (dc_custom_io_t *io, int level)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->set_rts (iostream, level);
+}
+
+static dc_status_t
+dc_replay_io_set_break (dc_custom_io_t *io, unsigned int level)
+{
+	dc_iostream_t *iostream = (dc_iostream_t *) io->userdata;
+
+	return iostream->vtable->set_break (iostream, level);
+}
+
+dc_status_t
+dc_replay_custom_io (dc_custom_io_t *io, dc_iostream_t *iostream)
+{
+	if (io == NULL ||
+		!(dc_iostream_isinstance (iostream, &dc_recorder_vtable) ||
+		dc_iostream_isinstance (iostream, &dc_replay_vtable) ||
+		dc_emulator_isinstance (iostream)))
+		return DC_STATUS_INVALIDARGS;
+
+	memset (io, 0, sizeof (*io));
+
+	io->userdata = iostream;
+	io->serial_open = dc_replay_io_open;
+	io->serial_close = dc_replay_io_close;
+	io->serial_read = dc_replay_io_read;
+	io->serial_write = dc_replay_io_write;
+	io->serial_purge = dc_replay_io_purge;
+	io->serial_get_available = dc_replay_io_get_available;
+	io->serial_set_timeout = dc_replay_io_set_timeout;
+	io->serial_configure = dc_replay_io_configure;
+	io->serial_set_dtr = dc_replay_io_set_dtr;
+	io->serial_set_rts = dc_replay_io_set_rts;
+	io->serial_set_break = dc_replay_io_set_break;
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,311 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+
+#include "context-private.h"
+#include "parser-private.h"
+
+#define STEP(resample,type) (((resample)->step & (1u << (type))) != 0)
+
+/*
+ * The last sample of a type, which is held (step interpolation) or
+ * interpolated towards the next sample (linear interpolation).
+ */
+typedef struct resample_track_t {
+	unsigned int valid;
+	unsigned int time;
+	double value;
+} resample_track_t;
+
+typedef struct resample_t {
+	dc_sample_table_t *table;
+	unsigned int interval;
+	unsigned int step;
+	// Time of the first grid row, and the number of rows so far.
+	unsigned int begin;
+	unsigned int count;
+	// Time of the current raw sample.
+	unsigned int started;
+	unsigned int time;
+	resample_track_t depth;
+	resample_track_t temperature;
+	resample_track_t ppo2;
+	resample_track_t *pressure;
+	unsigned int gasmix_valid;
+	unsigned int gasmix;
+	unsigned int deco_valid;
+	unsigned int deco_type;
+	unsigned int deco_time;
+	double deco_depth;
+} resample_t;
+
+/*
+ * The first grid row with a time after (or at) the given time.
+ */
+static unsigned int
+resample_row_after (const resample_t *resample, unsigned int time, unsigned int inclusive)
+{
+	if (time < resample->begin || (inclusive && time == resample->begin))
+		return 0;
+
+	unsigned int delta = time - resample->begin;
+	unsigned int row = delta / resample->interval;
+	if (!inclusive || delta % resample->interval)
+		row++;
+
+	return row;
+}
+
+static void
+resample_mark (resample_t *resample, unsigned int begin, unsigned int end, dc_sample_type_t type)
+{
+	dc_sample_table_t *table = resample->table;
+
+	if (table->mask == NULL)
+		return;
+
+	for (unsigned int i = begin; i < end; ++i)
+		table->mask[i] |= (1u << type);
+}
+
+/*
+ * Store a new sample of a numeric column. With linear interpolation,
+ * the rows since the previous sample get the interpolated values. With
+ * step interpolation, or without a previous sample, only a row at the
+ * same time gets the new value. The next rows are created later, and
+ * receive the held value with step interpolation only.
+ */
+static void
+resample_value (resample_t *resample, resample_track_t *track, double column[], unsigned int stride, dc_sample_type_t type, double value)
+{
+	dc_sample_table_t *table = resample->table;
+	unsigned int time = resample->time;
+	unsigned int end = resample->count < table->capacity ? resample->count : table->capacity;
+
+	if (!STEP (resample, type) && track->valid && track->time < time) {
+		unsigned int begin = resample_row_after (resample, track->time, 0);
+		if (begin < end) {
+			if (column) {
+				double slope = (value - track->value) / (time - track->time);
+				double offset = resample->begin - (double) track->time;
+				for (unsigned int i = begin; i < end; ++i)
+					column[i * stride] = track->value + slope * (offset + (double) i * resample->interval);
+			}
+			resample_mark (resample, begin, end, type);
+		}
+	} else {
+		unsigned int row = resample_row_after (resample, time, 1);
+		if (row < end) {
+			if (column)
+				column[row * stride] = value;
+			resample_mark (resample, row, row + 1, type);
+		}
+	}
+
+	track->valid = 1;
+	track->time = time;
+	track->value = value;
+}
+
+static void
+resample_hold (resample_t *resample, const resample_track_t *track, double column[], unsigned int stride, dc_sample_type_t type, unsigned int row)
+{
+	if (!track->valid || !STEP (resample, type))
+		return;
+
+	if (column)
+		column[row * stride] = track->value;
+	resample_mark (resample, row, row + 1, type);
+}
+
+static void
+resample_row (resample_t *resample)
+{
+	dc_sample_table_t *table = resample->table;
+	unsigned int row = resample->count++;
+
+	if (row >= table->capacity)
+		return;
+
+	if (table->mask)
+		table->mask[row] = (1u << DC_SAMPLE_TIME);
+	if (table->time)
+		table->time[row] = resample->begin + row * resample->interval;
+	if (table->pressure) {
+		for (unsigned int i = 0; i < table->ntanks; ++i)
+			table->pressure[row * table->ntanks + i] = 0.0;
+	}
+
+	resample_hold (resample, &resample->depth, table->depth, 1, DC_SAMPLE_DEPTH, row);
+	resample_hold (resample, &resample->temperature, table->temperature, 1, DC_SAMPLE_TEMPERATURE, row);
+	resample_hold (resample, &resample->ppo2, table->ppo2, 1, DC_SAMPLE_PPO2, row);
+	if (resample->pressure) {
+		for (unsigned int i = 0; i < table->ntanks; ++i)
+			resample_hold (resample, resample->pressure + i, table->pressure ? table->pressure + i : NULL, table->ntanks, DC_SAMPLE_PRESSURE, row);
+	}
+
+	// The gas mix and the decompression status always hold.
+	if (resample->gasmix_valid) {
+		if (table->gasmix)
+			table->gasmix[row] = resample->gasmix;
+		resample_mark (resample, row, row + 1, DC_SAMPLE_GASMIX);
+	}
+
+	if (resample->deco_valid) {
+		if (table->deco_type)
+			table->deco_type[row] = resample->deco_type;
+		if (table->deco_time)
+			table->deco_time[row] = resample->deco_time;
+		if (table->deco_depth)
+			table->deco_depth[row] = resample->deco_depth;
+		resample_mark (resample, row, row + 1, DC_SAMPLE_DECO);
+	}
+}
+
+static void
+resample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	resample_t *resample = (resample_t *) userdata;
+	dc_sample_table_t *table = resample->table;
+
+	if (type == DC_SAMPLE_TIME) {
+		if (!resample->started) {
+			resample->begin = (value.time + resample->interval - 1) / resample->interval * resample->interval;
+			resample->started = 1;
+		}
+
+		// Time going backwards is ignored.
+		if (value.time > resample->time || resample->count == 0)
+			resample->time = value.time;
+
+		// Create the grid rows up to the new time.
+		while (resample->begin + resample->count * resample->interval <= resample->time)
+			resample_row (resample);
+		return;
+	}
+
+	// Ignore samples before the first time sample.
+	if (!resample->started)
+		return;
+
+	unsigned int end = resample->count < table->capacity ? resample->count : table->capacity;
+	unsigned int row = resample_row_after (resample, resample->time, 1);
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		resample_value (resample, &resample->depth, table->depth, 1, type, value.depth);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		resample_value (resample, &resample->temperature, table->temperature, 1, type, value.temperature);
+		break;
+	case DC_SAMPLE_PPO2:
+		resample_value (resample, &resample->ppo2, table->ppo2, 1, type, value.ppo2);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (resample->pressure == NULL || value.pressure.tank >= table->ntanks)
+			break;
+		resample_value (resample, resample->pressure + value.pressure.tank,
+			table->pressure ? table->pressure + value.pressure.tank : NULL,
+			table->ntanks, type, value.pressure.value);
+		break;
+	case DC_SAMPLE_GASMIX:
+		resample->gasmix_valid = 1;
+		resample->gasmix = value.gasmix;
+		if (row < end) {
+			if (table->gasmix)
+				table->gasmix[row] = value.gasmix;
+			resample_mark (resample, row, row + 1, type);
+		}
+		break;
+	case DC_SAMPLE_DECO:
+		resample->deco_valid = 1;
+		resample->deco_type = value.deco.type;
+		resample->deco_time = value.deco.time;
+		resample->deco_depth = value.deco.depth;
+		if (row < end) {
+			if (table->deco_type)
+				table->deco_type[row] = value.deco.type;
+			if (table->deco_time)
+				table->deco_time[row] = value.deco.time;
+			if (table->deco_depth)
+				table->deco_depth[row] = value.deco.depth;
+			resample_mark (resample, row, row + 1, type);
+		}
+		break;
+	case DC_SAMPLE_EVENT:
+		// An event belongs to the first row at or after its time.
+		if (table->events && table->nevents < table->events_capacity) {
+			dc_sample_table_event_t *event = table->events + table->nevents;
+			event->row = row;
+			event->type = value.event.type;
+			event->time = value.event.time;
+			event->flags = value.event.flags;
+			event->value = value.event.value;
+			event->name = value.event.name;
+		}
+		table->nevents++;
+		break;
+	default:
+		break;
+	}
+}
+
+dc_status_t
+sample_resample (dc_parser_t *parser, dc_sample_table_t *table)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	resample_t resample = {0};
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	resample.table = table;
+	resample.interval = parser->resample;
+	resample.step = parser->interpolation;
+
+	if (table->ntanks) {
+		resample.pressure = (resample_track_t *) dc_context_alloc (parser->context, table->ntanks * sizeof (resample_track_t));
+		if (resample.pressure == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		for (unsigned int i = 0; i < table->ntanks; ++i)
+			resample.pressure[i].valid = 0;
+	}
+
+	status = sample_walk (parser, resample_cb, &resample);
+
+	table->count = resample.count;
+
+	// Events after the last row belong to the last row.
+	if (table->events && resample.count) {
+		unsigned int n = table->nevents < table->events_capacity ? table->nevents : table->events_capacity;
+		for (unsigned int i = 0; i < n; ++i) {
+			if (table->events[i].row >= resample.count)
+				table->events[i].row = resample.count - 1;
+		}
+	}
+
+	dc_context_release (parser->context, resample.pressure);
+
+	return status;
+}
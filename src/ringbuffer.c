@@ -20,6 +20,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #include "ringbuffer.h"
 
@@ -100,3 +101,48 @@ ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, un
 
 	return decrement (a - begin, delta, end - begin) + begin;
 }
+
+
+unsigned int
+ringbuffer_span (ringbuffer_span_t *span, unsigned int a, unsigned int length, unsigned int begin, unsigned int end)
+{
+	assert (end > begin);
+	assert (a >= begin);
+	assert (length <= end - begin);
+
+	unsigned int address = normalize (a - begin, end - begin) + begin;
+	unsigned int available = end - address;
+
+	span->segment[0].address = address;
+	span->segment[1].address = begin;
+	if (length > available) {
+		span->segment[0].length = available;
+		span->segment[1].length = length - available;
+		span->count = 2;
+	} else {
+		span->segment[0].length = length;
+		span->segment[1].length = 0;
+		span->count = 1;
+	}
+
+	return span->count;
+}
+
+
+unsigned int
+ringbuffer_span_backward (ringbuffer_span_t *span, unsigned int a, unsigned int length, unsigned int begin, unsigned int end)
+{
+	assert (end > begin);
+	assert (a >= begin);
+	assert (length <= end - begin);
+
+	return ringbuffer_span (span, decrement (a - begin, length, end - begin) + begin, length, begin, end);
+}
+
+
+void
+ringbuffer_span_copy (unsigned char output[], const unsigned char data[], const ringbuffer_span_t *span)
+{
+	memcpy (output, data + span->segment[0].address, span->segment[0].length);
+	memcpy (output + span->segment[0].length, data + span->segment[1].address, span->segment[1].length);
+}
@@ -38,6 +38,41 @@ ringbuffer_increment (unsigned int a, unsigned int delta, unsigned int begin, un
 unsigned int
 ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, unsigned int end);
 
+/*
+ * A logical range of the ringbuffer, split at the wrap point into at
+ * most two contiguous physical segments. Unused segments have a zero
+ * length.
+ */
+typedef struct ringbuffer_segment_t {
+	unsigned int address;
+	unsigned int length;
+} ringbuffer_segment_t;
+
+typedef struct ringbuffer_span_t {
+	unsigned int count;
+	ringbuffer_segment_t segment[2];
+} ringbuffer_span_t;
+
+/*
+ * Split the range of length bytes starting at address a. The length
+ * should not exceed the size of the ringbuffer. Returns the number of
+ * segments.
+ */
+unsigned int
+ringbuffer_span (ringbuffer_span_t *span, unsigned int a, unsigned int length, unsigned int begin, unsigned int end);
+
+/*
+ * Split the range of length bytes ending at address a (exclusive).
+ */
+unsigned int
+ringbuffer_span_backward (ringbuffer_span_t *span, unsigned int a, unsigned int length, unsigned int begin, unsigned int end);
+
+/*
+ * Copy the segments from a memory dump into a linear output buffer.
+ */
+void
+ringbuffer_span_copy (unsigned char output[], const unsigned char data[], const ringbuffer_span_t *span);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,446 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <libdivecomputer/parser.h>
+
+#define VERSION 1
+
+#define MODE_CONSTANT 0
+#define MODE_DELTA    1
+
+/*
+ * Fixed-point scale of the double columns: millimeters, millibar,
+ * hundredths of a degree Celsius and millibar.
+ */
+#define SCALE_DEPTH       1000.0
+#define SCALE_PRESSURE    1000.0
+#define SCALE_TEMPERATURE 100.0
+#define SCALE_PPO2        1000.0
+
+typedef enum codec_column_t {
+	COLUMN_MASK,
+	COLUMN_TIME,
+	COLUMN_DEPTH,
+	COLUMN_PRESSURE,
+	COLUMN_TEMPERATURE,
+	COLUMN_PPO2,
+	COLUMN_DECO_TYPE,
+	COLUMN_DECO_TIME,
+	COLUMN_DECO_DEPTH,
+	COLUMN_GASMIX,
+	COLUMN_EVENTS,
+} codec_column_t;
+
+typedef struct codec_writer_t {
+	dc_buffer_t *buffer;
+	int error;
+	long long previous;
+	unsigned int zeros;
+} codec_writer_t;
+
+typedef struct codec_reader_t {
+	const unsigned char *data;
+	unsigned int size;
+	unsigned int offset;
+	int error;
+	long long previous;
+	unsigned int zeros;
+} codec_reader_t;
+
+static long long
+codec_quantize (double value, double scale)
+{
+	double scaled = value * scale;
+	return (long long) (scaled >= 0.0 ? scaled + 0.5 : scaled - 0.5);
+}
+
+static void
+codec_put_varint (codec_writer_t *writer, unsigned long long value)
+{
+	unsigned char data[10];
+	unsigned int n = 0;
+
+	while (value >= 0x80) {
+		data[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+
+	if (!writer->error && !dc_buffer_append (writer->buffer, data, n))
+		writer->error = 1;
+}
+
+static void
+codec_put_signed (codec_writer_t *writer, long long value)
+{
+	// Zig-zag encoding, such that small negative values stay small.
+	codec_put_varint (writer, ((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63));
+}
+
+static void
+codec_put_bytes (codec_writer_t *writer, const void *data, unsigned int size)
+{
+	if (!writer->error && !dc_buffer_append (writer->buffer, (const unsigned char *) data, size))
+		writer->error = 1;
+}
+
+static unsigned long long
+codec_get_varint (codec_reader_t *reader)
+{
+	unsigned long long value = 0;
+	unsigned int shift = 0;
+
+	while (1) {
+		if (reader->offset >= reader->size || shift >= 64) {
+			reader->error = 1;
+			return 0;
+		}
+
+		unsigned char byte = reader->data[reader->offset++];
+		value |= (unsigned long long) (byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			break;
+		shift += 7;
+	}
+
+	return value;
+}
+
+static long long
+codec_get_signed (codec_reader_t *reader)
+{
+	unsigned long long value = codec_get_varint (reader);
+	return (long long) (value >> 1) ^ -(long long) (value & 1);
+}
+
+/*
+ * The delta stream stores the zig-zag encoded difference with the
+ * previous value. A zero delta is followed by the number of zero deltas
+ * that come after it, such that a run of equal values takes two bytes.
+ */
+static void
+codec_delta_begin (codec_writer_t *writer)
+{
+	writer->previous = 0;
+	writer->zeros = 0;
+}
+
+static void
+codec_delta_flush (codec_writer_t *writer)
+{
+	if (writer->zeros) {
+		codec_put_varint (writer, 0);
+		codec_put_varint (writer, writer->zeros - 1);
+		writer->zeros = 0;
+	}
+}
+
+static void
+codec_delta_put (codec_writer_t *writer, long long value)
+{
+	long long delta = value - writer->previous;
+	writer->previous = value;
+
+	if (delta == 0) {
+		writer->zeros++;
+		return;
+	}
+
+	codec_delta_flush (writer);
+	codec_put_signed (writer, delta);
+}
+
+static void
+codec_delta_reset (codec_reader_t *reader, long long initial)
+{
+	reader->previous = initial;
+	reader->zeros = 0;
+}
+
+static long long
+codec_delta_get (codec_reader_t *reader)
+{
+	if (reader->zeros) {
+		reader->zeros--;
+		return reader->previous;
+	}
+
+	long long delta = codec_get_signed (reader);
+	if (delta == 0)
+		reader->zeros = codec_get_varint (reader);
+
+	reader->previous += delta;
+	return reader->previous;
+}
+
+static int
+codec_has (const dc_sample_table_t *table, unsigned int row, unsigned int type)
+{
+	return table->mask == NULL || (table->mask[row] & (1u << type)) != 0;
+}
+
+/*
+ * Encode a column. A row without a value repeats the value of the
+ * previous row, which costs nothing in a run of zero deltas.
+ */
+static void
+codec_encode_column (codec_writer_t *writer, const dc_sample_table_t *table, const unsigned int uvalues[], const double dvalues[], unsigned int stride, unsigned int type, double scale)
+{
+	unsigned int count = table->count;
+	long long first = 0, value = 0;
+	unsigned int constant = 1, found = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		if (!codec_has (table, i, type))
+			continue;
+		value = uvalues ? uvalues[i * stride] : codec_quantize (dvalues[i * stride], scale);
+		if (!found) {
+			first = value;
+			found = 1;
+		} else if (value != first) {
+			constant = 0;
+			break;
+		}
+	}
+
+	if (constant) {
+		codec_put_varint (writer, MODE_CONSTANT);
+		codec_put_signed (writer, first);
+		return;
+	}
+
+	codec_put_varint (writer, MODE_DELTA);
+	codec_delta_begin (writer);
+	value = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (codec_has (table, i, type))
+			value = uvalues ? uvalues[i * stride] : codec_quantize (dvalues[i * stride], scale);
+		codec_delta_put (writer, value);
+	}
+	codec_delta_flush (writer);
+}
+
+static void
+codec_decode_column (codec_reader_t *reader, unsigned int count, unsigned int uvalues[], double dvalues[], unsigned int stride, double scale)
+{
+	unsigned int mode = codec_get_varint (reader);
+
+	if (mode == MODE_CONSTANT) {
+		long long value = codec_get_signed (reader);
+		if (uvalues) {
+			for (unsigned int i = 0; i < count; ++i)
+				uvalues[i * stride] = value;
+		} else if (dvalues) {
+			double converted = value / scale;
+			for (unsigned int i = 0; i < count; ++i)
+				dvalues[i * stride] = converted;
+		}
+	} else if (mode == MODE_DELTA) {
+		codec_delta_reset (reader, 0);
+		for (unsigned int i = 0; i < count && !reader->error; ++i) {
+			long long value = codec_delta_get (reader);
+			if (uvalues)
+				uvalues[i * stride] = value;
+			else if (dvalues)
+				dvalues[i * stride] = value / scale;
+		}
+	} else {
+		reader->error = 1;
+	}
+}
+
+dc_status_t
+dc_sample_table_encode (const dc_sample_table_t *table, dc_buffer_t *buffer)
+{
+	codec_writer_t writer = {buffer, 0, 0, 0};
+
+	if (table == NULL || buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (table->count > table->capacity || (table->events && table->nevents > table->events_capacity))
+		return DC_STATUS_INVALIDARGS;
+
+	const void *columns[] = {
+		table->mask, table->time, table->depth, table->pressure,
+		table->temperature, table->ppo2, table->deco_type,
+		table->deco_time, table->deco_depth, table->gasmix,
+		table->events};
+	unsigned int present = 0;
+	for (unsigned int i = 0; i < sizeof (columns) / sizeof (columns[0]); ++i) {
+		if (columns[i])
+			present |= (1u << i);
+	}
+	if (table->ntanks == 0)
+		present &= ~(1u << COLUMN_PRESSURE);
+
+	unsigned int nevents = table->events ? table->nevents : 0;
+
+	codec_put_varint (&writer, VERSION);
+	codec_put_varint (&writer, present);
+	codec_put_varint (&writer, table->count);
+	codec_put_varint (&writer, table->ntanks);
+	codec_put_varint (&writer, nevents);
+
+	if (table->mask)
+		codec_encode_column (&writer, table, table->mask, NULL, 1, DC_SAMPLE_TIME, 1.0);
+	if (table->time)
+		codec_encode_column (&writer, table, table->time, NULL, 1, DC_SAMPLE_TIME, 1.0);
+	if (table->depth)
+		codec_encode_column (&writer, table, NULL, table->depth, 1, DC_SAMPLE_DEPTH, SCALE_DEPTH);
+	if (present & (1u << COLUMN_PRESSURE)) {
+		for (unsigned int i = 0; i < table->ntanks; ++i)
+			codec_encode_column (&writer, table, NULL, table->pressure + i, table->ntanks, DC_SAMPLE_PRESSURE, SCALE_PRESSURE);
+	}
+	if (table->temperature)
+		codec_encode_column (&writer, table, NULL, table->temperature, 1, DC_SAMPLE_TEMPERATURE, SCALE_TEMPERATURE);
+	if (table->ppo2)
+		codec_encode_column (&writer, table, NULL, table->ppo2, 1, DC_SAMPLE_PPO2, SCALE_PPO2);
+	if (table->deco_type)
+		codec_encode_column (&writer, table, table->deco_type, NULL, 1, DC_SAMPLE_DECO, 1.0);
+	if (table->deco_time)
+		codec_encode_column (&writer, table, table->deco_time, NULL, 1, DC_SAMPLE_DECO, 1.0);
+	if (table->deco_depth)
+		codec_encode_column (&writer, table, NULL, table->deco_depth, 1, DC_SAMPLE_DECO, SCALE_DEPTH);
+	if (table->gasmix)
+		codec_encode_column (&writer, table, table->gasmix, NULL, 1, DC_SAMPLE_GASMIX, 1.0);
+
+	unsigned int row = 0, time = 0;
+	for (unsigned int i = 0; i < nevents; ++i) {
+		const dc_sample_table_event_t *event = table->events + i;
+		codec_put_signed (&writer, (long long) event->row - row);
+		codec_put_signed (&writer, (long long) event->time - time);
+		codec_put_varint (&writer, event->type);
+		codec_put_varint (&writer, event->flags);
+		codec_put_varint (&writer, event->value);
+		if (event->name) {
+			unsigned int length = strlen (event->name);
+			codec_put_varint (&writer, length + 1);
+			codec_put_bytes (&writer, event->name, length + 1);
+		} else {
+			codec_put_varint (&writer, 0);
+		}
+		row = event->row;
+		time = event->time;
+	}
+
+	if (writer.error)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_sample_table_decode (dc_sample_table_t *table, const unsigned char data[], unsigned int size)
+{
+	codec_reader_t reader = {data, size, 0, 0, 0, 0};
+
+	if (table == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int version = codec_get_varint (&reader);
+	unsigned int present = codec_get_varint (&reader);
+	unsigned int count = codec_get_varint (&reader);
+	unsigned int ntanks = codec_get_varint (&reader);
+	unsigned int nevents = codec_get_varint (&reader);
+	if (reader.error || version != VERSION)
+		return DC_STATUS_DATAFORMAT;
+
+	table->count = count;
+	table->nevents = nevents;
+	if (count > table->capacity || (table->events && nevents > table->events_capacity))
+		return DC_STATUS_NOMEMORY;
+
+	// The columns that are present in the data, but not in the table,
+	// are decoded anyway, to get to the next column.
+	if (present & (1u << COLUMN_MASK))
+		codec_decode_column (&reader, count, table->mask, NULL, 1, 1.0);
+	if (present & (1u << COLUMN_TIME))
+		codec_decode_column (&reader, count, table->time, NULL, 1, 1.0);
+	if (present & (1u << COLUMN_DEPTH))
+		codec_decode_column (&reader, count, NULL, table->depth, 1, SCALE_DEPTH);
+	if (present & (1u << COLUMN_PRESSURE)) {
+		for (unsigned int i = 0; i < ntanks; ++i) {
+			double *column = NULL;
+			if (table->pressure && i < table->ntanks)
+				column = table->pressure + i;
+			codec_decode_column (&reader, count, NULL, column, table->ntanks, SCALE_PRESSURE);
+		}
+	}
+	if (table->pressure) {
+		// Tanks that are missing in the data have no value.
+		unsigned int decoded = (present & (1u << COLUMN_PRESSURE)) ? ntanks : 0;
+		for (unsigned int i = 0; i < count; ++i) {
+			for (unsigned int j = decoded; j < table->ntanks; ++j)
+				table->pressure[i * table->ntanks + j] = 0.0;
+		}
+	}
+	if (present & (1u << COLUMN_TEMPERATURE))
+		codec_decode_column (&reader, count, NULL, table->temperature, 1, SCALE_TEMPERATURE);
+	if (present & (1u << COLUMN_PPO2))
+		codec_decode_column (&reader, count, NULL, table->ppo2, 1, SCALE_PPO2);
+	if (present & (1u << COLUMN_DECO_TYPE))
+		codec_decode_column (&reader, count, table->deco_type, NULL, 1, 1.0);
+	if (present & (1u << COLUMN_DECO_TIME))
+		codec_decode_column (&reader, count, table->deco_time, NULL, 1, 1.0);
+	if (present & (1u << COLUMN_DECO_DEPTH))
+		codec_decode_column (&reader, count, NULL, table->deco_depth, 1, SCALE_DEPTH);
+	if (present & (1u << COLUMN_GASMIX))
+		codec_decode_column (&reader, count, table->gasmix, NULL, 1, 1.0);
+
+	long long row = 0, time = 0;
+	for (unsigned int i = 0; i < nevents && !reader.error; ++i) {
+		row += codec_get_signed (&reader);
+		time += codec_get_signed (&reader);
+		unsigned int type = codec_get_varint (&reader);
+		unsigned int flags = codec_get_varint (&reader);
+		unsigned int value = codec_get_varint (&reader);
+		unsigned int length = codec_get_varint (&reader);
+		const char *name = NULL;
+		if (length) {
+			// The name is stored with its terminator, and is borrowed
+			// from the data.
+			if (length > reader.size - reader.offset || data[reader.offset + length - 1] != 0) {
+				reader.error = 1;
+				break;
+			}
+			name = (const char *) data + reader.offset;
+			reader.offset += length;
+		}
+
+		if (table->events) {
+			dc_sample_table_event_t *event = table->events + i;
+			event->row = row;
+			event->time = time;
+			event->type = type;
+			event->flags = flags;
+			event->value = value;
+			event->name = name;
+		}
+	}
+
+	if (reader.error)
+		return DC_STATUS_DATAFORMAT;
+
+	return DC_STATUS_SUCCESS;
+}
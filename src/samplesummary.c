@@ -0,0 +1,151 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stddef.h>
+#include <float.h>
+
+#include "parser-private.h"
+
+/*
+ * The reductions are branch-free loops over the columns: the rows
+ * without a value are masked with a select, rather than skipped, such
+ * that the compiler can vectorize the loops for the target.
+ */
+
+static unsigned int
+summary_count (const unsigned int *mask, unsigned int count, unsigned int bit)
+{
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < count; ++i)
+		n += (mask[i] & bit) != 0;
+
+	return n;
+}
+
+static double
+summary_maximum (const double *column, const unsigned int *mask, unsigned int count, unsigned int bit, double initial)
+{
+	double maximum = initial;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		double value = (mask[i] & bit) ? column[i] : initial;
+		maximum = value > maximum ? value : maximum;
+	}
+
+	return maximum;
+}
+
+static double
+summary_minimum (const double *column, const unsigned int *mask, unsigned int count, unsigned int bit, double initial)
+{
+	double minimum = initial;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		double value = (mask[i] & bit) ? column[i] : initial;
+		minimum = value < minimum ? value : minimum;
+	}
+
+	return minimum;
+}
+
+/*
+ * The time-weighted average, with the trapezoidal rule over the pairs
+ * of consecutive rows that both have a value.
+ */
+static double
+summary_average (const double *column, const unsigned int *time, const unsigned int *mask, unsigned int count, unsigned int bit)
+{
+	double area = 0.0, duration = 0.0;
+
+	for (unsigned int i = 1; i < count; ++i) {
+		unsigned int both = (mask[i - 1] & mask[i] & bit) != 0;
+		double dt = both && time[i] > time[i - 1] ? (double) (time[i] - time[i - 1]) : 0.0;
+		double a = both ? column[i - 1] : 0.0;
+		double b = both ? column[i] : 0.0;
+		area += (a + b) * dt;
+		duration += dt;
+	}
+
+	return duration > 0.0 ? area / (2.0 * duration) : 0.0;
+}
+
+dc_status_t
+dc_sample_table_summarize (const dc_sample_table_t *table, dc_sample_summary_t *summary)
+{
+	if (table == NULL || summary == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (table->mask == NULL || table->time == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	unsigned int count = table->count < table->capacity ? table->count : table->capacity;
+	const unsigned int *mask = table->mask;
+
+	summary->types = 0;
+	summary->divetime = count ? table->time[count - 1] : 0;
+	summary->maxdepth = 0.0;
+	summary->avgdepth = 0.0;
+	summary->mintemperature = 0.0;
+	summary->maxtemperature = 0.0;
+
+	if (table->depth) {
+		unsigned int bit = 1u << DC_SAMPLE_DEPTH;
+		if (summary_count (mask, count, bit)) {
+			summary->types |= bit;
+			summary->maxdepth = summary_maximum (table->depth, mask, count, bit, 0.0);
+			summary->avgdepth = summary_average (table->depth, table->time, mask, count, bit);
+		}
+	}
+
+	if (table->temperature) {
+		unsigned int bit = 1u << DC_SAMPLE_TEMPERATURE;
+		if (summary_count (mask, count, bit)) {
+			summary->types |= bit;
+			summary->mintemperature = summary_minimum (table->temperature, mask, count, bit, DBL_MAX);
+			summary->maxtemperature = summary_maximum (table->temperature, mask, count, bit, -DBL_MAX);
+		}
+	}
+
+	// The first and last pressure of each tank. Tanks without a value
+	// in a row are zero, and thus need no mask.
+	for (unsigned int n = 0; n < table->ntanks; ++n) {
+		double begin = 0.0, end = 0.0;
+		if (table->pressure) {
+			for (unsigned int i = 0; i < count && begin == 0.0; ++i) {
+				if (mask[i] & (1u << DC_SAMPLE_PRESSURE))
+					begin = table->pressure[i * table->ntanks + n];
+			}
+			for (unsigned int i = count; i > 0 && end == 0.0; --i) {
+				if (mask[i - 1] & (1u << DC_SAMPLE_PRESSURE))
+					end = table->pressure[(i - 1) * table->ntanks + n];
+			}
+			if (begin != 0.0)
+				summary->types |= 1u << DC_SAMPLE_PRESSURE;
+		}
+		if (summary->pressure_begin)
+			summary->pressure_begin[n] = begin;
+		if (summary->pressure_end)
+			summary->pressure_end[n] = end;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -35,6 +35,12 @@
 #define RX_PACKET_SIZE 64
 #define TX_PACKET_SIZE 32
 
+// The payload length is a single byte, so a larger packet is useless.
+#define RX_PACKET_MAX  256
+
+// Minimum number of bytes between two progress events.
+#define PROGRESS_STEP  1024
+
 #define ALADINSPORTMATRIX 0x17
 #define ALADINSQUARE      0x22
 #define G2                0x32
@@ -44,6 +50,8 @@ typedef struct scubapro_g2_device_t {
 	unsigned int timestamp;
 	unsigned int devtime;
 	dc_ticks_t systime;
+	unsigned int packetsize;
+	dc_custom_io_t *io;
 } scubapro_g2_device_t;
 
 static dc_status_t scubapro_g2_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
@@ -63,19 +71,17 @@ static const dc_device_vtable_t scubapro_g2_device_vtable = {
 	scubapro_g2_device_close /* close */
 };
 
-static dc_status_t
-scubapro_g2_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static int receive_data(scubapro_g2_device_t *g2, unsigned char *buffer, int size, dc_event_progress_t *progress)
 {
-	dc_custom_io_t *io = _dc_context_custom_io(g2->base.context);
+	dc_custom_io_t *io = g2->io;
+	unsigned int reported = progress ? progress->current : 0;
 	while (size) {
-		unsigned char buf[RX_PACKET_SIZE] = { 0 };
+		unsigned char buf[RX_PACKET_MAX] = { 0 };
 		size_t transferred = 0;
 		dc_status_t rc;
 		int len;
 
-		rc = io->packet_read(io, buf, sizeof(buf), &transferred);
+		rc = io->packet_read(io, buf, g2->packetsize, &transferred);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR(g2->base.context, "read interrupt transfer failed");
 			return -1;
@@ -89,7 +95,7 @@ static int receive_data(scubapro_g2_device_t *g2, unsigned char *buffer, int siz
 			ERROR(g2->base.context, "small packet read (got %zu, expected at least %d)", transferred, len + 1);
 			return -1;
 		}
-		if (len >= sizeof(buf)) {
+		if (len >= g2->packetsize) {
 			ERROR(g2->base.context, "read interrupt transfer returns impossible packet size (%d)", len);
 			return -1;
 		}
@@ -102,10 +108,14 @@ static int receive_data(scubapro_g2_device_t *g2, unsigned char *buffer, int siz
 		size -= len;
 		buffer += len;
 
-		// Update and emit a progress event?
+		// Update and emit a progress event? With small packets, the
+		// events are coalesced to one per PROGRESS_STEP bytes.
 		if (progress) {
 			progress->current += len;
-			device_event_emit(&g2->base, DC_EVENT_PROGRESS, progress);
+			if (progress->current - reported >= PROGRESS_STEP || size == 0) {
+				device_event_emit(&g2->base, DC_EVENT_PROGRESS, progress);
+				reported = progress->current;
+			}
 		}
 	}
 	return 0;
@@ -114,7 +124,7 @@ static int receive_data(scubapro_g2_device_t *g2, unsigned char *buffer, int siz
 static dc_status_t
 scubapro_g2_transfer(scubapro_g2_device_t *g2, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
-	dc_custom_io_t *io = _dc_context_custom_io(g2->base.context);
+	dc_custom_io_t *io = g2->io;
 	unsigned char buf[TX_PACKET_SIZE+1] = { 0 }; // the +1 is for the report type byte
 	dc_status_t status = DC_STATUS_SUCCESS;
 	size_t transferred = 0;
@@ -237,18 +247,21 @@ scubapro_g2_device_open(dc_device_t **out, dc_context_t *context, const char *na
 	device->timestamp = 0;
 	device->systime = (dc_ticks_t) -1;
 	device->devtime = 0;
+	device->packetsize = RX_PACKET_SIZE;
 
+	// The custom I/O is bound to the device when it is opened, such
+	// that the context can be shared with other downloads.
 	dc_custom_io_t *io = _dc_context_custom_io(context);
-	if (io && io->packet_open)
+	if (io && io->packet_open) {
 		status = io->packet_open(io, context, name);
-	else {
+	} else {
 		const struct usb_id *id = get_usb_id(model);
 		if (!id) {
 			ERROR(context, "Unknown USB ID for Scubapro model %#04x", model);
 			status = DC_STATUS_IO;
 			goto error_free;
 		}
-		status = dc_usbhid_custom_io(context, id->vendor, id->device);
+		status = dc_usbhid_custom_io(&io, context, id->vendor, id->device);
 	}
 
 	if (status != DC_STATUS_SUCCESS) {
@@ -256,6 +269,18 @@ scubapro_g2_device_open(dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	// The USB HID reports have a fixed size, but over BLE the device
+	// can send larger notifications if a larger MTU was negotiated.
+	device->io = io;
+	if (io->packet_size < RX_PACKET_SIZE) {
+		size_t mtu = dc_custom_io_packet_mtu(context, io);
+		if (mtu > RX_PACKET_MAX)
+			mtu = RX_PACKET_MAX;
+		if (mtu > RX_PACKET_SIZE)
+			device->packetsize = mtu;
+		DEBUG (context, "BLE packet size: %u", device->packetsize);
+	}
+
 	// Perform the handshaking.
 	status = scubapro_g2_handshake(device, model);
 	if (status != DC_STATUS_SUCCESS) {
@@ -278,7 +303,8 @@ error_free:
 static dc_status_t
 scubapro_g2_device_close (dc_device_t *abstract)
 {
-	dc_custom_io_t *io = _dc_context_custom_io(abstract->context);
+	scubapro_g2_device_t *g2 = (scubapro_g2_device_t *) abstract;
+	dc_custom_io_t *io = g2->io;
 
 	return io->packet_close(io);
 }
@@ -382,6 +408,10 @@ scubapro_g2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_SUCCESS;
 
 	// Allocate the required amount of memory.
+	rc = dc_context_check_memory (abstract->context, length);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	if (!dc_buffer_resize (buffer, length)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
@@ -406,7 +436,11 @@ scubapro_g2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_PROTOCOL;
 	}
 
-	if (receive_data(device, data, length, &progress)) {
+	// Ask for a fast link during the bulk transfer.
+	dc_custom_io_packet_set_params (abstract->context, device->io, DC_LINK_BULK);
+	int fail = receive_data(device, data, length, &progress);
+	dc_custom_io_packet_set_params (abstract->context, device->io, 0);
+	if (fail) {
 		ERROR (abstract->context, "Received an unexpected size.");
 		return DC_STATUS_IO;
 	}
@@ -418,7 +452,7 @@ scubapro_g2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 scubapro_g2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -437,7 +471,7 @@ scubapro_g2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 }
 
 
-static dc_status_t
+dc_status_t
 scubapro_g2_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
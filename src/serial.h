@@ -45,6 +45,26 @@ typedef struct dc_serial_device_t dc_serial_device_t;
 const char *
 dc_serial_device_get_name (dc_serial_device_t *device);
 
+/**
+ * Get the USB vendor id (VID) of the serial device.
+ *
+ * @param[in]  device  A valid serial device.
+ * @returns The vendor id, or zero if the device is not a USB device,
+ * or the id is not available on this platform.
+ */
+unsigned int
+dc_serial_device_get_vid (dc_serial_device_t *device);
+
+/**
+ * Get the USB product id (PID) of the serial device.
+ *
+ * @param[in]  device  A valid serial device.
+ * @returns The product id, or zero if the device is not a USB device,
+ * or the id is not available on this platform.
+ */
+unsigned int
+dc_serial_device_get_pid (dc_serial_device_t *device);
+
 /**
  * Destroy the serial device and free all resources.
  *
@@ -65,6 +85,68 @@ dc_serial_device_free (dc_serial_device_t *device);
 dc_status_t
 dc_serial_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor);
 
+/**
+ * Opaque object representing a serial hotplug monitor.
+ */
+typedef struct dc_serial_hotplug_t dc_serial_hotplug_t;
+
+/**
+ * Serial hotplug events.
+ */
+typedef enum dc_serial_hotplug_event_t {
+	DC_SERIAL_HOTPLUG_ARRIVED,
+	DC_SERIAL_HOTPLUG_LEFT,
+} dc_serial_hotplug_event_t;
+
+/**
+ * Hotplug callback.
+ *
+ * The device is only valid for the duration of the callback.
+ */
+typedef void (*dc_serial_hotplug_callback_t) (dc_serial_hotplug_event_t event, dc_serial_device_t *device, void *userdata);
+
+/**
+ * Create a hotplug monitor for the serial devices.
+ *
+ * Only the devices added or removed after creating the monitor are
+ * reported. Create the monitor before enumerating the devices with
+ * #dc_serial_iterator_new, to avoid missing a device.
+ *
+ * @param[out] hotplug     A location to store the hotplug monitor.
+ * @param[in]  context     A valid context object.
+ * @param[in]  descriptor  A valid device descriptor or NULL.
+ * @param[in]  callback    The hotplug callback.
+ * @param[in]  userdata    User data to pass to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * change notifications are not available on this platform, or another
+ * #dc_status_t code on failure.
+ */
+dc_status_t
+dc_serial_hotplug_new (dc_serial_hotplug_t **hotplug, dc_context_t *context, dc_descriptor_t *descriptor, dc_serial_hotplug_callback_t callback, void *userdata);
+
+/**
+ * Wait for hotplug events, and report them to the callback.
+ *
+ * @param[in]  hotplug  A valid hotplug monitor.
+ * @param[in]  timeout  The timeout in milliseconds, or a negative value
+ *                      to wait forever.
+ * @returns #DC_STATUS_SUCCESS if one or more events were reported,
+ * #DC_STATUS_TIMEOUT if the timeout expired, or another #dc_status_t
+ * code on failure.
+ */
+dc_status_t
+dc_serial_hotplug_wait (dc_serial_hotplug_t *hotplug, int timeout);
+
+/**
+ * Destroy the hotplug monitor and free all resources.
+ *
+ * @param[in]  hotplug  A valid hotplug monitor.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_hotplug_free (dc_serial_hotplug_t *hotplug);
+
 /**
  * Open a serial connection.
  *
@@ -24,12 +24,14 @@
 #endif
 
 #include <stdlib.h> // malloc, free
-#include <string.h>	// strerror
+#include <string.h>	// strerror, memcpy
 #include <errno.h>	// errno
 #include <unistd.h>	// open, close, read, write
 #include <fcntl.h>	// fcntl
 #include <termios.h>	// tcgetattr, tcsetattr, cfsetispeed, cfsetospeed, tcflush, tcsendbreak
 #include <sys/ioctl.h>	// ioctl
+#include <sys/uio.h>	// writev
+#include <poll.h>	// poll
 #include <time.h>	// nanosleep
 #ifdef HAVE_LINUX_SERIAL_H
 #include <linux/serial.h>
@@ -41,6 +43,9 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <fnmatch.h>
+#ifdef HAVE_LIBUDEV
+#include <libudev.h>
+#endif
 
 #ifndef TIOCINQ
 #define TIOCINQ FIONREAD
@@ -53,16 +58,28 @@
 #endif
 
 #include "serial.h"
+#include "tcp.h"
 
 #include "common-private.h"
 #include "context-private.h"
 #include "iostream-private.h"
 #include "iterator-private.h"
 #include "descriptor-private.h"
-#include "timer.h"
 
 #define DIRNAME "/dev"
 
+// Maximum number of buffers per writev call.
+#define MAXIOV 16
+
+// Size of the receive buffer.
+#define SZ_RXBUF 4096
+
+// Tolerated error of a deadline (in microseconds), which allows the use
+// of the coarse clock for the longer timeouts (in milliseconds).
+#define RESOLUTION(timeout) ((dc_usecs_t) (timeout) * 1000 / 100)
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 static dc_status_t dc_serial_iterator_next (dc_iterator_t *iterator, void *item);
 static dc_status_t dc_serial_iterator_free (dc_iterator_t *iterator);
 
@@ -75,22 +92,43 @@ static dc_status_t dc_serial_get_lines (dc_iostream_t *iostream, unsigned int *v
 static dc_status_t dc_serial_get_available (dc_iostream_t *iostream, size_t *value);
 static dc_status_t dc_serial_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
 static dc_status_t dc_serial_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_poll (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_serial_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
 static dc_status_t dc_serial_flush (dc_iostream_t *iostream);
 static dc_status_t dc_serial_purge (dc_iostream_t *iostream, dc_direction_t direction);
 static dc_status_t dc_serial_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 static dc_status_t dc_serial_close (dc_iostream_t *iostream);
+static dc_status_t dc_serial_cancel (dc_iostream_t *iostream);
 
 struct dc_serial_device_t {
 	char name[256];
+	unsigned int vid, pid;
 };
 
 typedef struct dc_serial_iterator_t {
 	dc_iterator_t base;
 	dc_filter_t filter;
+#ifdef HAVE_LIBUDEV
+	struct udev *udev;
+	struct udev_enumerate *enumerate;
+	struct udev_list_entry *current;
+#else
 	DIR *dp;
+#endif
 } dc_serial_iterator_t;
 
+#ifdef HAVE_LIBUDEV
+struct dc_serial_hotplug_t {
+	dc_context_t *context;
+	dc_filter_t filter;
+	dc_serial_hotplug_callback_t callback;
+	void *userdata;
+	struct udev *udev;
+	struct udev_monitor *monitor;
+};
+#endif
+
 typedef struct dc_serial_t {
 	dc_iostream_t base;
 	/*
@@ -98,13 +136,26 @@ typedef struct dc_serial_t {
 	 */
 	int fd;
 	int timeout;
-	dc_timer_t *timer;
+	/*
+	 * Self-pipe used to wake up a blocking poll when the stream is
+	 * cancelled from another thread. Both ends are -1 if the pipe
+	 * could not be created.
+	 */
+	int cancelfd[2];
 	/*
 	 * Serial port settings are saved into this variable immediately
 	 * after the port is opened. These settings are restored when the
 	 * serial port is closed.
 	 */
 	struct termios tty;
+	/*
+	 * Receive buffer. Small reads fetch as much data as is available,
+	 * and the excess is kept here to serve the next reads without any
+	 * system call.
+	 */
+	unsigned char rxbuf[SZ_RXBUF];
+	size_t rxoffset;
+	size_t rxcount;
 } dc_serial_t;
 
 static const dc_iterator_vtable_t dc_serial_iterator_vtable = {
@@ -122,13 +173,17 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_set_rts, /* set_rts */
 	dc_serial_get_lines, /* get_lines */
 	dc_serial_get_available, /* get_received */
+	dc_serial_poll, /* poll */
 	dc_serial_configure, /* configure */
 	dc_serial_read, /* read */
 	dc_serial_write, /* write */
+	NULL, /* readv */
+	dc_serial_writev, /* writev */
 	dc_serial_flush, /* flush */
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
 	dc_serial_close, /* close */
+	dc_serial_cancel, /* cancel */
 };
 
 static dc_status_t
@@ -144,11 +199,129 @@ syserror(int errcode)
 	case EACCES:
 	case EBUSY:
 		return DC_STATUS_NOACCESS;
+	case ECANCELED:
+		return DC_STATUS_CANCELLED;
 	default:
 		return DC_STATUS_IO;
 	}
 }
 
+/*
+ * The device nodes of the serial ports, excluding the virtual consoles
+ * and pseudo terminals.
+ */
+static const char *g_serial_patterns[] = {
+#if defined (__APPLE__)
+	"tty.*",
+#else
+	"ttyS*",
+	"ttyUSB*",
+	"ttyACM*",
+	"rfcomm*",
+#endif
+};
+
+static int
+dc_serial_match (const char *name)
+{
+	for (size_t i = 0; i < C_ARRAY_SIZE (g_serial_patterns); ++i) {
+		if (fnmatch (g_serial_patterns[i], name, 0) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_LIBUDEV
+static unsigned int
+dc_serial_udev_hex (const char *value)
+{
+	return value ? strtoul (value, NULL, 16) : 0;
+}
+
+/*
+ * Get the USB vendor and product id of a tty device. The properties are
+ * also present in the removal events, after the parent device is gone.
+ */
+static void
+dc_serial_udev_usb (struct udev_device *dev, unsigned int *vid, unsigned int *pid)
+{
+	*vid = dc_serial_udev_hex (udev_device_get_property_value (dev, "ID_VENDOR_ID"));
+	*pid = dc_serial_udev_hex (udev_device_get_property_value (dev, "ID_MODEL_ID"));
+	if (*vid || *pid)
+		return;
+
+	struct udev_device *usb = udev_device_get_parent_with_subsystem_devtype (dev, "usb", "usb_device");
+	if (usb) {
+		*vid = dc_serial_udev_hex (udev_device_get_sysattr_value (usb, "idVendor"));
+		*pid = dc_serial_udev_hex (udev_device_get_sysattr_value (usb, "idProduct"));
+	}
+}
+#elif defined (__linux__)
+static int
+dc_serial_sysfs_hex (const char *dirname, const char *attribute, unsigned int *value)
+{
+	char filename[512];
+	int n = snprintf (filename, sizeof (filename), "%s/%s", dirname, attribute);
+	if (n < 0 || (size_t) n >= sizeof (filename))
+		return 0;
+
+	FILE *fp = fopen (filename, "r");
+	if (fp == NULL)
+		return 0;
+
+	int rc = fscanf (fp, "%x", value);
+	fclose (fp);
+
+	return rc == 1;
+}
+
+/*
+ * Get the USB vendor and product id of a tty device, from the first
+ * ancestor in the sysfs device hierarchy that has the id attributes.
+ */
+static void
+dc_serial_sysfs_usb (const char *name, unsigned int *vid, unsigned int *pid)
+{
+	char path[512];
+	int n = snprintf (path, sizeof (path), "/sys/class/tty/%s/device", name);
+	if (n < 0 || (size_t) n >= sizeof (path))
+		return;
+
+	char *dirname = realpath (path, NULL);
+	if (dirname == NULL)
+		return;
+
+	char *p = NULL;
+	while ((p = strrchr (dirname, '/')) != NULL && p != dirname) {
+		if (dc_serial_sysfs_hex (dirname, "idVendor", vid) &&
+			dc_serial_sysfs_hex (dirname, "idProduct", pid))
+			break;
+		*vid = *pid = 0;
+		*p = '\0';
+	}
+
+	free (dirname);
+}
+#endif
+
+static dc_serial_device_t *
+dc_serial_device_new (dc_context_t *context, const char *name, unsigned int vid, unsigned int pid)
+{
+	dc_serial_device_t *device = (dc_serial_device_t *) malloc (sizeof(dc_serial_device_t));
+	if (device == NULL) {
+		SYSERROR (context, ENOMEM);
+		return NULL;
+	}
+
+	strncpy (device->name, name, sizeof (device->name));
+	device->name[sizeof (device->name) - 1] = '\0';
+	device->vid = vid;
+	device->pid = pid;
+
+	return device;
+}
+
 const char *
 dc_serial_device_get_name (dc_serial_device_t *device)
 {
@@ -158,6 +331,24 @@ dc_serial_device_get_name (dc_serial_device_t *device)
 	return device->name;
 }
 
+unsigned int
+dc_serial_device_get_vid (dc_serial_device_t *device)
+{
+	if (device == NULL)
+		return 0;
+
+	return device->vid;
+}
+
+unsigned int
+dc_serial_device_get_pid (dc_serial_device_t *device)
+{
+	if (device == NULL)
+		return 0;
+
+	return device->pid;
+}
+
 void
 dc_serial_device_free (dc_serial_device_t *device)
 {
@@ -179,6 +370,27 @@ dc_serial_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descripto
 		return DC_STATUS_NOMEMORY;
 	}
 
+#ifdef HAVE_LIBUDEV
+	// Enumerate the tty devices from the udev database, which already
+	// contains the USB ids, instead of scanning the device directory.
+	iterator->udev = udev_new ();
+	if (iterator->udev == NULL) {
+		ERROR (context, "Failed to create the udev context.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	iterator->enumerate = udev_enumerate_new (iterator->udev);
+	if (iterator->enumerate == NULL ||
+		udev_enumerate_add_match_subsystem (iterator->enumerate, "tty") < 0 ||
+		udev_enumerate_scan_devices (iterator->enumerate) < 0) {
+		ERROR (context, "Failed to enumerate the tty devices.");
+		status = DC_STATUS_IO;
+		goto error_udev_unref;
+	}
+
+	iterator->current = udev_enumerate_get_list_entry (iterator->enumerate);
+#else
 	iterator->dp = opendir (DIRNAME);
 	if (iterator->dp == NULL) {
 		int errcode = errno;
@@ -186,6 +398,7 @@ dc_serial_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descripto
 		status = syserror (errcode);
 		goto error_free;
 	}
+#endif
 
 	iterator->filter = dc_descriptor_get_filter (descriptor);
 
@@ -193,6 +406,11 @@ dc_serial_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descripto
 
 	return DC_STATUS_SUCCESS;
 
+#ifdef HAVE_LIBUDEV
+error_udev_unref:
+	udev_enumerate_unref (iterator->enumerate);
+	udev_unref (iterator->udev);
+#endif
 error_free:
 	dc_iterator_deallocate ((dc_iterator_t *) iterator);
 	return status;
@@ -204,47 +422,66 @@ dc_serial_iterator_next (dc_iterator_t *abstract, void *out)
 	dc_serial_iterator_t *iterator = (dc_serial_iterator_t *) abstract;
 	dc_serial_device_t *device = NULL;
 
-	struct dirent *ep = NULL;
-	const char *patterns[] = {
-#if defined (__APPLE__)
-		"tty.*",
+#ifdef HAVE_LIBUDEV
+	while (iterator->current) {
+		const char *syspath = udev_list_entry_get_name (iterator->current);
+		iterator->current = udev_list_entry_get_next (iterator->current);
+
+		struct udev_device *dev = udev_device_new_from_syspath (iterator->udev, syspath);
+		if (dev == NULL)
+			continue;
+
+		const char *sysname = udev_device_get_sysname (dev);
+		const char *devnode = udev_device_get_devnode (dev);
+		if (sysname == NULL || devnode == NULL || !dc_serial_match (sysname) ||
+			(iterator->filter && !iterator->filter (DC_TRANSPORT_SERIAL, devnode))) {
+			udev_device_unref (dev);
+			continue;
+		}
+
+		unsigned int vid = 0, pid = 0;
+		dc_serial_udev_usb (dev, &vid, &pid);
+
+		device = dc_serial_device_new (abstract->context, devnode, vid, pid);
+		udev_device_unref (dev);
+		if (device == NULL)
+			return DC_STATUS_NOMEMORY;
+
+		*(dc_serial_device_t **) out = device;
+
+		return DC_STATUS_SUCCESS;
+	}
 #else
-		"ttyS*",
-		"ttyUSB*",
-		"ttyACM*",
-		"rfcomm*",
-#endif
-		NULL
-	};
+	struct dirent *ep = NULL;
 
 	while ((ep = readdir (iterator->dp)) != NULL) {
-		for (size_t i = 0; patterns[i] != NULL; ++i) {
-			if (fnmatch (patterns[i], ep->d_name, 0) != 0)
-				continue;
-
-			char filename[sizeof(device->name)];
-			int n = snprintf (filename, sizeof (filename), "%s/%s", DIRNAME, ep->d_name);
-			if (n < 0 || (size_t) n >= sizeof (filename)) {
-				return DC_STATUS_NOMEMORY;
-			}
+		if (!dc_serial_match (ep->d_name))
+			continue;
 
-			if (iterator->filter && !iterator->filter (DC_TRANSPORT_SERIAL, filename)) {
-				continue;
-			}
+		char filename[sizeof(device->name)];
+		int n = snprintf (filename, sizeof (filename), "%s/%s", DIRNAME, ep->d_name);
+		if (n < 0 || (size_t) n >= sizeof (filename)) {
+			return DC_STATUS_NOMEMORY;
+		}
 
-			device = (dc_serial_device_t *) malloc (sizeof(dc_serial_device_t));
-			if (device == NULL) {
-				SYSERROR (abstract->context, ENOMEM);
-				return DC_STATUS_NOMEMORY;
-			}
+		if (iterator->filter && !iterator->filter (DC_TRANSPORT_SERIAL, filename)) {
+			continue;
+		}
 
-			strncpy(device->name, filename, sizeof(device->name));
+		unsigned int vid = 0, pid = 0;
+#ifdef __linux__
+		dc_serial_sysfs_usb (ep->d_name, &vid, &pid);
+#endif
 
-			*(dc_serial_device_t **) out = device;
+		device = dc_serial_device_new (abstract->context, filename, vid, pid);
+		if (device == NULL)
+			return DC_STATUS_NOMEMORY;
 
-			return DC_STATUS_SUCCESS;
-		}
+		*(dc_serial_device_t **) out = device;
+
+		return DC_STATUS_SUCCESS;
 	}
+#endif
 
 	return DC_STATUS_DONE;
 }
@@ -254,9 +491,212 @@ dc_serial_iterator_free (dc_iterator_t *abstract)
 {
 	dc_serial_iterator_t *iterator = (dc_serial_iterator_t *) abstract;
 
+#ifdef HAVE_LIBUDEV
+	udev_enumerate_unref (iterator->enumerate);
+	udev_unref (iterator->udev);
+#else
 	closedir (iterator->dp);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_serial_hotplug_new (dc_serial_hotplug_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_serial_hotplug_callback_t callback, void *userdata)
+{
+#ifdef HAVE_LIBUDEV
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_hotplug_t *hotplug = NULL;
+
+	if (out == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	hotplug = (dc_serial_hotplug_t *) malloc (sizeof (dc_serial_hotplug_t));
+	if (hotplug == NULL) {
+		SYSERROR (context, ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	hotplug->context = context;
+	hotplug->filter = dc_descriptor_get_filter (descriptor);
+	hotplug->callback = callback;
+	hotplug->userdata = userdata;
+	hotplug->monitor = NULL;
+
+	hotplug->udev = udev_new ();
+	if (hotplug->udev == NULL) {
+		ERROR (context, "Failed to create the udev context.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	// Receive the events after they have been processed by udev, such
+	// that the device node and the properties are available.
+	hotplug->monitor = udev_monitor_new_from_netlink (hotplug->udev, "udev");
+	if (hotplug->monitor == NULL ||
+		udev_monitor_filter_add_match_subsystem_devtype (hotplug->monitor, "tty", NULL) < 0 ||
+		udev_monitor_enable_receiving (hotplug->monitor) < 0) {
+		ERROR (context, "Failed to create the udev monitor.");
+		status = DC_STATUS_IO;
+		goto error_udev_unref;
+	}
+
+	*out = hotplug;
+
+	return DC_STATUS_SUCCESS;
+
+error_udev_unref:
+	udev_monitor_unref (hotplug->monitor);
+	udev_unref (hotplug->udev);
+error_free:
+	free (hotplug);
+	return status;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+#ifdef HAVE_LIBUDEV
+/*
+ * Report all pending udev events. Returns the number of reported events.
+ */
+static unsigned int
+dc_serial_hotplug_dispatch (dc_serial_hotplug_t *hotplug)
+{
+	unsigned int count = 0;
+	struct udev_device *dev = NULL;
+
+	while ((dev = udev_monitor_receive_device (hotplug->monitor)) != NULL) {
+		const char *action = udev_device_get_action (dev);
+		const char *sysname = udev_device_get_sysname (dev);
+		const char *devnode = udev_device_get_devnode (dev);
+
+		dc_serial_hotplug_event_t event = DC_SERIAL_HOTPLUG_ARRIVED;
+		int valid = action != NULL && sysname != NULL && devnode != NULL;
+		if (valid && strcmp (action, "add") == 0) {
+			event = DC_SERIAL_HOTPLUG_ARRIVED;
+		} else if (valid && strcmp (action, "remove") == 0) {
+			event = DC_SERIAL_HOTPLUG_LEFT;
+		} else {
+			valid = 0;
+		}
+
+		if (valid && dc_serial_match (sysname) &&
+			(hotplug->filter == NULL || hotplug->filter (DC_TRANSPORT_SERIAL, devnode))) {
+			dc_serial_device_t device;
+			strncpy (device.name, devnode, sizeof (device.name));
+			device.name[sizeof (device.name) - 1] = '\0';
+			dc_serial_udev_usb (dev, &device.vid, &device.pid);
+
+			hotplug->callback (event, &device, hotplug->userdata);
+			count++;
+		}
+
+		udev_device_unref (dev);
+	}
+
+	return count;
+}
+#endif
+
+dc_status_t
+dc_serial_hotplug_wait (dc_serial_hotplug_t *hotplug, int timeout)
+{
+#ifdef HAVE_LIBUDEV
+	dc_usecs_t now = 0, deadline = 0;
+
+	if (hotplug == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (timeout > 0) {
+		dc_context_clock (hotplug->context, RESOLUTION (timeout), &now);
+		deadline = now + (dc_usecs_t) timeout * 1000;
+	}
+
+	while (1) {
+		int ms = timeout;
+		if (timeout > 0) {
+			dc_context_clock (hotplug->context, RESOLUTION (timeout), &now);
+			if (now >= deadline)
+				return DC_STATUS_TIMEOUT;
+			ms = (deadline - now + 999) / 1000;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = udev_monitor_get_fd (hotplug->monitor);
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		int rc = poll (&pfd, 1, ms);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			SYSERROR (hotplug->context, errcode);
+			return syserror (errcode);
+		} else if (rc == 0) {
+			return DC_STATUS_TIMEOUT;
+		}
+
+		// Events for other tty devices are not reported, and don't end
+		// the wait.
+		if (dc_serial_hotplug_dispatch (hotplug))
+			return DC_STATUS_SUCCESS;
+
+		if (timeout == 0)
+			return DC_STATUS_TIMEOUT;
+	}
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_serial_hotplug_free (dc_serial_hotplug_t *hotplug)
+{
+#ifdef HAVE_LIBUDEV
+	if (hotplug == NULL)
+		return DC_STATUS_SUCCESS;
+
+	udev_monitor_unref (hotplug->monitor);
+	udev_unref (hotplug->udev);
+	free (hotplug);
 
 	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+static int
+dc_serial_pipe (int fds[2])
+{
+	if (pipe (fds) != 0)
+		return -1;
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		int flags = fcntl (fds[i], F_GETFL);
+		if (flags == -1 ||
+			fcntl (fds[i], F_SETFL, flags | O_NONBLOCK) != 0 ||
+			fcntl (fds[i], F_SETFD, FD_CLOEXEC) != 0) {
+			close (fds[0]);
+			close (fds[1]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+dc_serial_pipe_close (int fds[2])
+{
+	for (unsigned int i = 0; i < 2; ++i) {
+		if (fds[i] != -1) {
+			close (fds[i]);
+			fds[i] = -1;
+		}
+	}
 }
 
 dc_status_t
@@ -272,6 +712,10 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 	if (_dc_context_custom_io(context))
 		return dc_custom_io_serial_open(out, context, name);
 
+	// Is the serial port behind a TCP bridge?
+	if (dc_tcp_match (name))
+		return dc_tcp_open (out, context, name);
+
 	INFO (context, "Open: name=%s", name);
 
 	// Allocate memory.
@@ -283,12 +727,15 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 
 	// Default to blocking reads.
 	device->timeout = -1;
-
-	// Create a high resolution timer.
-	status = dc_timer_new (&device->timer);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to create a high resolution timer.");
-		goto error_free;
+	device->cancelfd[0] = device->cancelfd[1] = -1;
+	device->rxoffset = 0;
+	device->rxcount = 0;
+
+	// Create the cancellation pipe. Without it, the stream still works,
+	// but blocking calls can no longer be interrupted.
+	if (dc_serial_pipe (device->cancelfd) != 0) {
+		WARNING (context, "Failed to create the cancellation pipe.");
+		device->cancelfd[0] = device->cancelfd[1] = -1;
 	}
 
 	// Open the device in non-blocking mode, to return immediately
@@ -298,7 +745,7 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		int errcode = errno;
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_timer_free;
+		goto error_pipe_close;
 	}
 
 #ifndef ENABLE_PTY
@@ -328,9 +775,8 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 
 error_close:
 	close (device->fd);
-error_timer_free:
-	dc_timer_free (device->timer);
-error_free:
+error_pipe_close:
+	dc_serial_pipe_close (device->cancelfd);
 	dc_iostream_deallocate ((dc_iostream_t *) device);
 	return status;
 }
@@ -364,11 +810,35 @@ dc_serial_close (dc_iostream_t *abstract)
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
-	dc_timer_free (device->timer);
+	dc_serial_pipe_close (device->cancelfd);
 
 	return status;
 }
 
+static dc_status_t
+dc_serial_cancel (dc_iostream_t *abstract)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+	const unsigned char byte = 0;
+
+	if (device->cancelfd[1] == -1)
+		return DC_STATUS_UNSUPPORTED;
+
+	// Wake up any thread blocked in poll. The pipe is never drained, so
+	// every subsequent wait returns immediately as well.
+	while (write (device->cancelfd[1], &byte, 1) < 0) {
+		int errcode = errno;
+		if (errcode == EINTR)
+			continue; // Retry.
+		if (errcode == EAGAIN)
+			break; // Already signalled.
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
@@ -667,6 +1137,55 @@ dc_serial_set_latency (dc_iostream_t *abstract, unsigned int milliseconds)
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * Wait for the file descriptor to become ready. Unlike select, poll has
+ * no upper limit on the value of the file descriptor, which matters for
+ * applications with many open files or concurrent downloads.
+ */
+static int
+dc_serial_wait (dc_serial_t *device, short events, int timeout)
+{
+	struct pollfd pfd[2];
+	pfd[0].fd = device->fd;
+	pfd[0].events = events;
+	pfd[0].revents = 0;
+	pfd[1].fd = device->cancelfd[0];
+	pfd[1].events = POLLIN;
+	pfd[1].revents = 0;
+
+	int rc = poll (pfd, device->cancelfd[0] != -1 ? 2 : 1, timeout);
+	if (rc > 0 && pfd[1].revents) {
+		errno = ECANCELED;
+		return -1;
+	}
+
+	return rc;
+}
+
+static dc_status_t
+dc_serial_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (device->rxcount)
+		return DC_STATUS_SUCCESS;
+
+	while (1) {
+		int rc = dc_serial_wait (device, POLLIN, timeout);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			return syserror (errcode);
+		} else if (rc == 0) {
+			return DC_STATUS_TIMEOUT;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
 static dc_status_t
 dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
 {
@@ -679,16 +1198,24 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 
 	int init = 1;
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (device->fd, &fds);
+		// Serve the buffered data first.
+		if (device->rxcount) {
+			size_t len = size - nbytes;
+			if (len > device->rxcount)
+				len = device->rxcount;
+			memcpy ((char *) data + nbytes, device->rxbuf + device->rxoffset, len);
+			device->rxoffset += len;
+			device->rxcount -= len;
+			nbytes += len;
+			continue;
+		}
 
-		struct timeval tv, *ptv = NULL;
+		int ms = -1;
 		if (device->timeout > 0) {
 			dc_usecs_t timeout = 0;
 
 			dc_usecs_t now = 0;
-			status = dc_timer_now (device->timer, &now);
+			status = dc_context_clock (abstract->context, RESOLUTION (device->timeout), &now);
 			if (status != DC_STATUS_SUCCESS) {
 				goto out;
 			}
@@ -707,16 +1234,13 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 					timeout = 0;
 				}
 			}
-			tv.tv_sec  = timeout / 1000000;
-			tv.tv_usec = timeout % 1000000;
-			ptv = &tv;
+			// Round up to whole milliseconds.
+			ms = (timeout + 999) / 1000;
 		} else if (device->timeout == 0) {
-			tv.tv_sec  = 0;
-			tv.tv_usec = 0;
-			ptv = &tv;
+			ms = 0;
 		}
 
-		int rc = select (device->fd + 1, &fds, NULL, NULL, ptv);
+		int rc = dc_serial_wait (device, POLLIN, ms);
 		if (rc < 0) {
 			int errcode = errno;
 			if (errcode == EINTR)
@@ -728,7 +1252,17 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			break; // Timeout.
 		}
 
-		ssize_t n = read (device->fd, (char *) data + nbytes, size - nbytes);
+		// Large requests are read directly into the output buffer. Small
+		// ones go through the receive buffer, to pick up any data that
+		// has already arrived for the next reads in the same call.
+		char *buffer = (char *) data + nbytes;
+		size_t length = size - nbytes;
+		if (length < SZ_RXBUF) {
+			buffer = (char *) device->rxbuf;
+			length = SZ_RXBUF;
+		}
+
+		ssize_t n = read (device->fd, buffer, length);
 		if (n < 0) {
 			int errcode = errno;
 			if (errcode == EINTR || errcode == EAGAIN)
@@ -740,7 +1274,12 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 			 break; // EOF.
 		}
 
-		nbytes += n;
+		if (buffer == (char *) device->rxbuf) {
+			device->rxoffset = 0;
+			device->rxcount = n;
+		} else {
+			nbytes += n;
+		}
 	}
 
 	if (nbytes != size) {
@@ -754,6 +1293,25 @@ out:
 	return status;
 }
 
+static dc_status_t
+dc_serial_drain (dc_serial_t *device)
+{
+#ifdef __ANDROID__
+	/* Android is missing tcdrain, so use ioctl version instead */
+	while (ioctl (device->fd, TCSBRK, 1) != 0) {
+#else
+	while (tcdrain (device->fd) != 0) {
+#endif
+		int errcode = errno;
+		if (errcode != EINTR ) {
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
 {
@@ -762,11 +1320,7 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	size_t nbytes = 0;
 
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (device->fd, &fds);
-
-		int rc = select (device->fd + 1, NULL, &fds, NULL, NULL);
+		int rc = dc_serial_wait (device, POLLOUT, -1);
 		if (rc < 0) {
 			int errcode = errno;
 			if (errcode == EINTR)
@@ -794,20 +1348,69 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	}
 
 	// Wait until all data has been transmitted.
-#ifdef __ANDROID__
-	/* Android is missing tcdrain, so use ioctl version instead */
-	while (ioctl (device->fd, TCSBRK, 1) != 0) {
-#else
-	while (tcdrain (device->fd) != 0) {
-#endif
-		int errcode = errno;
-		if (errcode != EINTR ) {
+	status = dc_serial_drain (device);
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_serial_t *device = (dc_serial_t *) abstract;
+	struct iovec vec[MAXIOV];
+	size_t nbytes = 0;
+
+	// Skip any leading empty buffers.
+	size_t index = 0, offset = 0;
+	dc_iovec_advance (iov, count, &index, &offset, 0);
+
+	while (index < count) {
+		// Describe the remaining data, up to the maximum number of
+		// buffers per system call.
+		int nvec = 0;
+		for (size_t i = index; i < count && nvec < MAXIOV; ++i) {
+			size_t skip = (i == index ? offset : 0);
+			vec[nvec].iov_base = (char *) iov[i].data + skip;
+			vec[nvec].iov_len = iov[i].size - skip;
+			nvec++;
+		}
+
+		int rc = dc_serial_wait (device, POLLOUT, -1);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
 			SYSERROR (abstract->context, errcode);
 			status = syserror (errcode);
 			goto out;
+		} else if (rc == 0) {
+			break; // Timeout.
 		}
+
+		ssize_t n = writev (device->fd, vec, nvec);
+		if (n < 0) {
+			int errcode = errno;
+			if (errcode == EINTR || errcode == EAGAIN)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+			goto out;
+		} else if (n == 0) {
+			 break; // EOF.
+		}
+
+		dc_iovec_advance (iov, count, &index, &offset, n);
+		nbytes += n;
 	}
 
+	// Wait until all data has been transmitted.
+	status = dc_serial_drain (device);
+
 out:
 	if (actual)
 		*actual = nbytes;
@@ -842,6 +1445,11 @@ dc_serial_purge (dc_iostream_t *abstract, dc_direction_t direction)
 		return syserror (errcode);
 	}
 
+	if (direction & DC_DIRECTION_INPUT) {
+		device->rxoffset = 0;
+		device->rxcount = 0;
+	}
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -914,7 +1522,7 @@ dc_serial_get_available (dc_iostream_t *abstract, size_t *value)
 	}
 
 	if (value)
-		*value = bytes;
+		*value = bytes + device->rxcount;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -950,6 +1558,42 @@ dc_serial_get_lines (dc_iostream_t *abstract, unsigned int *value)
 static dc_status_t
 dc_serial_sleep (dc_iostream_t *abstract, unsigned int timeout)
 {
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (device->cancelfd[0] != -1) {
+		// Sleep by waiting on the cancellation pipe, so the sleep can
+		// be interrupted. The remaining time is recalculated from the
+		// timer after every interruption by a signal.
+		dc_usecs_t now = 0, target = 0;
+		if (dc_context_clock (abstract->context, RESOLUTION (timeout), &now) != DC_STATUS_SUCCESS)
+			return DC_STATUS_IO;
+		target = now + (dc_usecs_t) timeout * 1000;
+
+		while (1) {
+			struct pollfd pfd;
+			pfd.fd = device->cancelfd[0];
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+
+			int ms = now < target ? (int) ((target - now + 999) / 1000) : 0;
+			int rc = poll (&pfd, 1, ms);
+			if (rc > 0) {
+				return DC_STATUS_CANCELLED;
+			} else if (rc == 0) {
+				return DC_STATUS_SUCCESS;
+			}
+
+			int errcode = errno;
+			if (errcode != EINTR) {
+				SYSERROR (abstract->context, errcode);
+				return syserror (errcode);
+			}
+
+			if (dc_context_clock (abstract->context, RESOLUTION (timeout), &now) != DC_STATUS_SUCCESS)
+				return DC_STATUS_IO;
+		}
+	}
+
 	struct timespec ts;
 	ts.tv_sec  = (timeout / 1000);
 	ts.tv_nsec = (timeout % 1000) * 1000000;
@@ -20,11 +20,13 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #define NOGDI
 #include <windows.h>
 
 #include "serial.h"
+#include "tcp.h"
 
 #include "common-private.h"
 #include "context-private.h"
@@ -42,6 +44,7 @@ static dc_status_t dc_serial_set_dtr (dc_iostream_t *iostream, unsigned int valu
 static dc_status_t dc_serial_set_rts (dc_iostream_t *iostream, unsigned int value);
 static dc_status_t dc_serial_get_lines (dc_iostream_t *iostream, unsigned int *value);
 static dc_status_t dc_serial_get_available (dc_iostream_t *iostream, size_t *value);
+static dc_status_t dc_serial_poll (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_serial_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
 static dc_status_t dc_serial_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 static dc_status_t dc_serial_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
@@ -49,6 +52,7 @@ static dc_status_t dc_serial_flush (dc_iostream_t *iostream);
 static dc_status_t dc_serial_purge (dc_iostream_t *iostream, dc_direction_t direction);
 static dc_status_t dc_serial_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 static dc_status_t dc_serial_close (dc_iostream_t *iostream);
+static dc_status_t dc_serial_cancel (dc_iostream_t *iostream);
 
 struct dc_serial_device_t {
 	char name[256];
@@ -68,6 +72,15 @@ typedef struct dc_serial_t {
 	 * The file descriptor corresponding to the serial port.
 	 */
 	HANDLE hFile;
+	/*
+	 * The port is opened for overlapped I/O, such that a blocking call
+	 * can wait for its completion and for the cancellation event at
+	 * the same time. The cancellation event is NULL if it could not be
+	 * created.
+	 */
+	HANDLE hReadEvent;
+	HANDLE hWriteEvent;
+	HANDLE hCancelEvent;
 	/*
 	 * Serial port settings are saved into this variables immediately
 	 * after the port is opened. These settings are restored when the
@@ -92,13 +105,17 @@ static const dc_iostream_vtable_t dc_serial_vtable = {
 	dc_serial_set_rts, /* set_rts */
 	dc_serial_get_lines, /* get_lines */
 	dc_serial_get_available, /* get_received */
+	dc_serial_poll, /* poll */
 	dc_serial_configure, /* configure */
 	dc_serial_read, /* read */
 	dc_serial_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
 	dc_serial_flush, /* flush */
 	dc_serial_purge, /* purge */
 	dc_serial_sleep, /* sleep */
 	dc_serial_close, /* close */
+	dc_serial_cancel, /* cancel */
 };
 
 static dc_status_t
@@ -127,6 +144,18 @@ dc_serial_device_get_name (dc_serial_device_t *device)
 	return device->name;
 }
 
+unsigned int
+dc_serial_device_get_vid (dc_serial_device_t *device)
+{
+	return 0;
+}
+
+unsigned int
+dc_serial_device_get_pid (dc_serial_device_t *device)
+{
+	return 0;
+}
+
 void
 dc_serial_device_free (dc_serial_device_t *device)
 {
@@ -251,6 +280,24 @@ dc_serial_iterator_free (dc_iterator_t *abstract)
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_serial_hotplug_new (dc_serial_hotplug_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_serial_hotplug_callback_t callback, void *userdata)
+{
+	return DC_STATUS_UNSUPPORTED;
+}
+
+dc_status_t
+dc_serial_hotplug_wait (dc_serial_hotplug_t *hotplug, int timeout)
+{
+	return DC_STATUS_UNSUPPORTED;
+}
+
+dc_status_t
+dc_serial_hotplug_free (dc_serial_hotplug_t *hotplug)
+{
+	return DC_STATUS_UNSUPPORTED;
+}
+
 dc_status_t
 dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 {
@@ -264,6 +311,10 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 	if (_dc_context_custom_io(context))
 		return dc_custom_io_serial_open(out, context, name);
 
+	// Is the serial port behind a TCP bridge?
+	if (dc_tcp_match (name))
+		return dc_tcp_open (out, context, name);
+
 	INFO (context, "Open: name=%s", name);
 
 	// Build the device name.
@@ -286,18 +337,37 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		return DC_STATUS_NOMEMORY;
 	}
 
+	device->hCancelEvent = NULL;
+
+	// Create the events for the overlapped I/O.
+	device->hReadEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	device->hWriteEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	if (device->hReadEvent == NULL || device->hWriteEvent == NULL) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_event_close;
+	}
+
+	// Create the cancellation event. Without it, the stream still works,
+	// but blocking calls can no longer be interrupted.
+	device->hCancelEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	if (device->hCancelEvent == NULL) {
+		WARNING (context, "Failed to create the cancellation event.");
+	}
+
 	// Open the device.
 	device->hFile = CreateFileA (devname,
 			GENERIC_READ | GENERIC_WRITE, 0,
 			NULL, // No security attributes.
 			OPEN_EXISTING,
-			0, // Non-overlapped I/O.
+			FILE_FLAG_OVERLAPPED,
 			NULL);
 	if (device->hFile == INVALID_HANDLE_VALUE) {
 		DWORD errcode = GetLastError ();
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_free;
+		goto error_event_close;
 	}
 
 	// Retrieve the current communication settings and timeouts,
@@ -312,13 +382,27 @@ dc_serial_open (dc_iostream_t **out, dc_context_t *context, const char *name)
 		goto error_close;
 	}
 
+	// Report the arrival of data, for polling.
+	if (!SetCommMask (device->hFile, EV_RXCHAR)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_close;
+	}
+
 	*out = (dc_iostream_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_close:
 	CloseHandle (device->hFile);
-error_free:
+error_event_close:
+	if (device->hCancelEvent)
+		CloseHandle (device->hCancelEvent);
+	if (device->hWriteEvent)
+		CloseHandle (device->hWriteEvent);
+	if (device->hReadEvent)
+		CloseHandle (device->hReadEvent);
 	dc_iostream_deallocate ((dc_iostream_t *) device);
 	return status;
 }
@@ -344,9 +428,66 @@ dc_serial_close (dc_iostream_t *abstract)
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
+	if (device->hCancelEvent)
+		CloseHandle (device->hCancelEvent);
+	CloseHandle (device->hWriteEvent);
+	CloseHandle (device->hReadEvent);
+
 	return status;
 }
 
+static dc_status_t
+dc_serial_cancel (dc_iostream_t *abstract)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	if (device->hCancelEvent == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// Wake up any thread waiting for an overlapped operation. The event
+	// is never reset, so every subsequent wait returns immediately too.
+	if (!SetEvent (device->hCancelEvent)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (abstract->context, errcode);
+		return syserror (errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Wait for a pending overlapped operation to complete. If the stream is
+ * cancelled, or the timeout expires first, the operation is cancelled,
+ * and the data that was already transferred is still reported.
+ */
+static dc_status_t
+dc_serial_wait (dc_serial_t *device, OVERLAPPED *overlapped, DWORD timeout, DWORD *transferred)
+{
+	HANDLE handles[2] = {overlapped->hEvent, device->hCancelEvent};
+	DWORD rc = WaitForMultipleObjects (device->hCancelEvent ? 2 : 1, handles, FALSE, timeout);
+	if (rc == WAIT_OBJECT_0 + 1 || rc == WAIT_TIMEOUT) {
+		CancelIo (device->hFile);
+		GetOverlappedResult (device->hFile, overlapped, transferred, TRUE);
+		return rc == WAIT_TIMEOUT ? DC_STATUS_TIMEOUT : DC_STATUS_CANCELLED;
+	} else if (rc != WAIT_OBJECT_0) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (device->base.context, errcode);
+		CancelIo (device->hFile);
+		GetOverlappedResult (device->hFile, overlapped, transferred, TRUE);
+		return syserror (errcode);
+	}
+
+	if (!GetOverlappedResult (device->hFile, overlapped, transferred, FALSE)) {
+		DWORD errcode = GetLastError ();
+		if (errcode == ERROR_OPERATION_ABORTED)
+			return DC_STATUS_CANCELLED;
+		SYSERROR (device->base.context, errcode);
+		return syserror (errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
@@ -513,11 +654,22 @@ dc_serial_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	DWORD dwRead = 0;
 
-	if (!ReadFile (device->hFile, data, size, &dwRead, NULL)) {
+	// The read completes according to the communication timeouts, as
+	// soon as all the data has arrived, or when the timeout expires.
+	OVERLAPPED overlapped;
+	memset (&overlapped, 0, sizeof (overlapped));
+	overlapped.hEvent = device->hReadEvent;
+	if (!ReadFile (device->hFile, data, size, &dwRead, &overlapped)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (abstract->context, errcode);
-		status = syserror (errcode);
-		goto out;
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+			goto out;
+		}
+
+		status = dc_serial_wait (device, &overlapped, INFINITE, &dwRead);
+		if (status != DC_STATUS_SUCCESS)
+			goto out;
 	}
 
 	if (dwRead != size) {
@@ -538,11 +690,20 @@ dc_serial_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 	dc_serial_t *device = (dc_serial_t *) abstract;
 	DWORD dwWritten = 0;
 
-	if (!WriteFile (device->hFile, data, size, &dwWritten, NULL)) {
+	OVERLAPPED overlapped;
+	memset (&overlapped, 0, sizeof (overlapped));
+	overlapped.hEvent = device->hWriteEvent;
+	if (!WriteFile (device->hFile, data, size, &dwWritten, &overlapped)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (abstract->context, errcode);
-		status = syserror (errcode);
-		goto out;
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (abstract->context, errcode);
+			status = syserror (errcode);
+			goto out;
+		}
+
+		status = dc_serial_wait (device, &overlapped, INFINITE, &dwWritten);
+		if (status != DC_STATUS_SUCCESS)
+			goto out;
 	}
 
 	if (dwWritten != size) {
@@ -673,6 +834,45 @@ dc_serial_get_available (dc_iostream_t *abstract, size_t *value)
 	return DC_STATUS_SUCCESS;
 }
 
+static dc_status_t
+dc_serial_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_serial_t *device = (dc_serial_t *) abstract;
+
+	size_t available = 0;
+	dc_status_t status = dc_serial_get_available (abstract, &available);
+	if (status != DC_STATUS_SUCCESS || available)
+		return status;
+
+	// Wait for the arrival of a character.
+	DWORD mask = 0, dummy = 0;
+	OVERLAPPED overlapped;
+	memset (&overlapped, 0, sizeof (overlapped));
+	overlapped.hEvent = device->hReadEvent;
+	if (!WaitCommEvent (device->hFile, &mask, &overlapped)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (abstract->context, errcode);
+			return syserror (errcode);
+		}
+
+		// Data that arrived just before the wait started doesn't trigger
+		// the event anymore.
+		status = dc_serial_get_available (abstract, &available);
+		if (status != DC_STATUS_SUCCESS || available) {
+			CancelIo (device->hFile);
+			GetOverlappedResult (device->hFile, &overlapped, &dummy, TRUE);
+			return status;
+		}
+
+		status = dc_serial_wait (device, &overlapped, timeout < 0 ? INFINITE : (DWORD) timeout, &dummy);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 static dc_status_t
 dc_serial_get_lines (dc_iostream_t *abstract, unsigned int *value)
 {
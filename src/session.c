@@ -0,0 +1,724 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/session.h>
+
+#include "context-private.h"
+#include "thread.h"
+
+#define NONE ((unsigned int) -1)
+
+typedef struct dc_session_resource_t {
+	char *name;
+	unsigned int limit;
+	unsigned int running;
+} dc_session_resource_t;
+
+typedef struct dc_session_t {
+	dc_session_manager_t *manager;
+	unsigned int index;
+	dc_descriptor_t *descriptor;
+	char *name;
+	unsigned char *fingerprint;
+	unsigned int fsize;
+	// Persistent mode.
+	dc_device_t *device;
+	unsigned char *newest;
+	unsigned int nsize;
+	unsigned int resource;
+	unsigned int expected;
+	unsigned int started;
+	dc_event_progress_t progress;
+	dc_status_t status;
+} dc_session_t;
+
+struct dc_session_manager_t {
+	dc_context_t *context;
+	unsigned int nthreads;
+	dc_session_t **sessions;
+	unsigned int count;
+	unsigned int capacity;
+	// Shared resources.
+	dc_session_resource_t *resources;
+	unsigned int nresources;
+	unsigned int rcapacity;
+	// Event notifications.
+	unsigned int events;
+	dc_session_event_callback_t event;
+	void *eventdata;
+	int persistent;
+	// Download state.
+	dc_session_dive_callback_t callback;
+	void *userdata;
+	dc_mutex_t *mutex;
+	dc_mutex_t *callbacks;
+	dc_cond_t *cond;
+	unsigned int pending;
+	volatile int cancelled;
+	unsigned int running;
+};
+
+static char *
+dc_session_strdup (const char *str)
+{
+	if (str == NULL)
+		return NULL;
+
+	size_t len = strlen (str) + 1;
+	char *copy = (char *) malloc (len);
+	if (copy)
+		memcpy (copy, str, len);
+
+	return copy;
+}
+
+static unsigned int
+dc_session_resource_find (dc_session_manager_t *manager, const char *name, int create)
+{
+	for (unsigned int i = 0; i < manager->nresources; ++i) {
+		if (strcmp (manager->resources[i].name, name) == 0)
+			return i;
+	}
+
+	if (!create)
+		return NONE;
+
+	if (manager->nresources == manager->rcapacity) {
+		unsigned int capacity = manager->rcapacity ? manager->rcapacity * 2 : 4;
+		dc_session_resource_t *resources = (dc_session_resource_t *) realloc (manager->resources, capacity * sizeof (dc_session_resource_t));
+		if (resources == NULL)
+			return NONE;
+		manager->resources = resources;
+		manager->rcapacity = capacity;
+	}
+
+	dc_session_resource_t *resource = &manager->resources[manager->nresources];
+	resource->name = dc_session_strdup (name);
+	if (resource->name == NULL)
+		return NONE;
+	resource->limit = 0;
+	resource->running = 0;
+
+	return manager->nresources++;
+}
+
+static void
+dc_session_free (dc_session_t *session)
+{
+	if (session == NULL)
+		return;
+
+	dc_device_close (session->device);
+	free (session->newest);
+	free (session->fingerprint);
+	free (session->name);
+	free (session);
+}
+
+static int
+dc_session_cancel_cb (void *userdata)
+{
+	dc_session_t *session = (dc_session_t *) userdata;
+
+	return session->manager->cancelled;
+}
+
+static void
+dc_session_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	dc_session_t *session = (dc_session_t *) userdata;
+	dc_session_manager_t *manager = session->manager;
+
+	if (event == DC_EVENT_PROGRESS) {
+		const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+		dc_mutex_lock (manager->mutex);
+		session->progress = *progress;
+		dc_mutex_unlock (manager->mutex);
+	}
+
+	if (manager->event && (manager->events & event)) {
+		dc_mutex_lock (manager->callbacks);
+		manager->event (session->index, event, data, manager->eventdata);
+		dc_mutex_unlock (manager->callbacks);
+	}
+}
+
+static int
+dc_session_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_session_t *session = (dc_session_t *) userdata;
+	dc_session_manager_t *manager = session->manager;
+	int rc = 1;
+
+	// Remember the fingerprint of the newest dive, which comes first.
+	if (manager->persistent && session->newest == NULL && fsize) {
+		session->newest = (unsigned char *) malloc (fsize);
+		if (session->newest) {
+			memcpy (session->newest, fingerprint, fsize);
+			session->nsize = fsize;
+		}
+	}
+
+	if (manager->callback) {
+		dc_mutex_lock (manager->callbacks);
+		rc = manager->callback (session->index, data, size, fingerprint, fsize, manager->userdata);
+		dc_mutex_unlock (manager->callbacks);
+	}
+
+	return rc;
+}
+
+static dc_status_t
+dc_session_download (dc_session_t *session)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_session_manager_t *manager = session->manager;
+	dc_device_t *device = session->device;
+
+	if (manager->cancelled)
+		return DC_STATUS_CANCELLED;
+
+	// A device kept open by a previous run is still in download mode.
+	session->device = NULL;
+	if (device == NULL) {
+		rc = dc_device_open (&device, manager->context, session->descriptor, session->name);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (manager->context, "Failed to open the device (session %u).", session->index);
+			return rc;
+		}
+	}
+
+	// The progress events are always requested, to maintain the
+	// accumulated progress. Other events only when required.
+	unsigned int events = DC_EVENT_PROGRESS;
+	if (manager->event)
+		events |= manager->events;
+
+	rc = dc_device_set_events (device, events, dc_session_event_cb, session);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_close;
+
+	rc = dc_device_set_cancel (device, dc_session_cancel_cb, session);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_close;
+
+	if (session->fsize) {
+		rc = dc_device_set_fingerprint (device, session->fingerprint, session->fsize);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			goto error_close;
+	}
+
+	rc = dc_device_foreach (device, dc_session_dive_cb, session);
+	if (rc != DC_STATUS_SUCCESS || !manager->persistent)
+		goto error_close;
+
+	// The newest dive becomes the fingerprint of the next run.
+	if (session->newest) {
+		free (session->fingerprint);
+		session->fingerprint = session->newest;
+		session->fsize = session->nsize;
+		session->newest = NULL;
+		session->nsize = 0;
+	}
+
+	session->device = device;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	free (session->newest);
+	session->newest = NULL;
+	session->nsize = 0;
+	dc_device_close (device);
+	return rc;
+}
+
+static void
+dc_session_finish (dc_session_manager_t *manager, dc_session_t *session, dc_status_t rc, dc_session_result_callback_t result, void *userdata)
+{
+	dc_mutex_lock (manager->mutex);
+	session->status = rc;
+	dc_mutex_unlock (manager->mutex);
+
+	if (result) {
+		dc_mutex_lock (manager->callbacks);
+		result (session->index, rc, userdata);
+		dc_mutex_unlock (manager->callbacks);
+	}
+}
+
+typedef struct dc_session_worker_t {
+	dc_session_manager_t *manager;
+	dc_session_result_callback_t result;
+	void *userdata;
+} dc_session_worker_t;
+
+/*
+ * Pick the pending session with the largest expected size, among the
+ * sessions with a resource below its limit. Ties are resolved in the
+ * order of the sessions. Must be called with the mutex locked.
+ */
+static dc_session_t *
+dc_session_pick (dc_session_manager_t *manager)
+{
+	dc_session_t *best = NULL;
+
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		dc_session_t *session = manager->sessions[i];
+		if (session->started)
+			continue;
+
+		if (session->resource != NONE) {
+			const dc_session_resource_t *resource = &manager->resources[session->resource];
+			if (resource->limit && resource->running >= resource->limit)
+				continue;
+		}
+
+		if (best == NULL || session->expected > best->expected)
+			best = session;
+	}
+
+	return best;
+}
+
+static void
+dc_session_worker (void *userdata)
+{
+	dc_session_worker_t *worker = (dc_session_worker_t *) userdata;
+	dc_session_manager_t *manager = worker->manager;
+
+	dc_mutex_lock (manager->mutex);
+	while (manager->pending) {
+		dc_session_t *session = dc_session_pick (manager);
+		if (session == NULL) {
+			// All pending sessions wait for a busy resource.
+			dc_cond_wait (manager->cond, manager->mutex, -1);
+			continue;
+		}
+
+		session->started = 1;
+		manager->pending--;
+		if (session->resource != NONE)
+			manager->resources[session->resource].running++;
+		dc_mutex_unlock (manager->mutex);
+
+		dc_status_t rc = dc_session_download (session);
+		dc_session_finish (manager, session, rc, worker->result, worker->userdata);
+
+		dc_mutex_lock (manager->mutex);
+		if (session->resource != NONE)
+			manager->resources[session->resource].running--;
+		if (session->progress.maximum)
+			session->expected = session->progress.maximum;
+		dc_cond_broadcast (manager->cond);
+	}
+	dc_mutex_unlock (manager->mutex);
+}
+
+dc_status_t
+dc_session_manager_new (dc_session_manager_t **out, dc_context_t *context, unsigned int nthreads)
+{
+	dc_session_manager_t *manager = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	manager = (dc_session_manager_t *) malloc (sizeof (dc_session_manager_t));
+	if (manager == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	manager->context = context;
+	manager->nthreads = nthreads ? nthreads : 1;
+	manager->sessions = NULL;
+	manager->count = 0;
+	manager->capacity = 0;
+	manager->resources = NULL;
+	manager->nresources = 0;
+	manager->rcapacity = 0;
+	manager->events = 0;
+	manager->event = NULL;
+	manager->eventdata = NULL;
+	manager->persistent = 0;
+	manager->callback = NULL;
+	manager->userdata = NULL;
+	manager->mutex = NULL;
+	manager->callbacks = NULL;
+	manager->cond = NULL;
+	manager->pending = 0;
+	manager->cancelled = 0;
+	manager->running = 0;
+
+	// Without thread support, the mutexes remain NULL, and all
+	// sessions are processed sequentially on the calling thread.
+	dc_mutex_new (&manager->mutex);
+	dc_mutex_new (&manager->callbacks);
+	dc_cond_new (&manager->cond);
+
+	// Only one irda connection at a time is possible.
+	unsigned int irda = dc_session_resource_find (manager, "irda", 1);
+	if (irda != NONE)
+		manager->resources[irda].limit = 1;
+
+	*out = manager;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_add (dc_session_manager_t *manager, dc_descriptor_t *descriptor, const char *name, const unsigned char data[], unsigned int size, unsigned int *index)
+{
+	dc_session_t *session = NULL;
+
+	if (manager == NULL || descriptor == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	if (manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	if (manager->count == manager->capacity) {
+		unsigned int capacity = manager->capacity ? manager->capacity * 2 : 4;
+		dc_session_t **sessions = (dc_session_t **) realloc (manager->sessions, capacity * sizeof (dc_session_t *));
+		if (sessions == NULL) {
+			ERROR (manager->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		manager->sessions = sessions;
+		manager->capacity = capacity;
+	}
+
+	session = (dc_session_t *) calloc (1, sizeof (dc_session_t));
+	if (session == NULL) {
+		ERROR (manager->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	session->manager = manager;
+	session->index = manager->count;
+	session->descriptor = descriptor;
+	session->name = dc_session_strdup (name);
+	if (size) {
+		session->fingerprint = (unsigned char *) malloc (size);
+		if (session->fingerprint)
+			memcpy (session->fingerprint, data, size);
+		session->fsize = size;
+	}
+	session->status = DC_STATUS_SUCCESS;
+
+	// The bluetooth and irda sessions share the radio or dongle.
+	session->resource = NONE;
+	switch (dc_descriptor_get_transport (descriptor)) {
+	case DC_TRANSPORT_BLUETOOTH:
+		session->resource = dc_session_resource_find (manager, "bluetooth", 1);
+		break;
+	case DC_TRANSPORT_IRDA:
+		session->resource = dc_session_resource_find (manager, "irda", 1);
+		break;
+	default:
+		break;
+	}
+
+	if ((name && session->name == NULL) || (size && session->fingerprint == NULL)) {
+		ERROR (manager->context, "Failed to allocate memory.");
+		dc_session_free (session);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	manager->sessions[manager->count++] = session;
+
+	if (index)
+		*index = session->index;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_set_resource (dc_session_manager_t *manager, unsigned int index, const char *resource)
+{
+	if (manager == NULL || manager->running || index >= manager->count)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int idx = NONE;
+	if (resource) {
+		idx = dc_session_resource_find (manager, resource, 1);
+		if (idx == NONE) {
+			ERROR (manager->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	manager->sessions[index]->resource = idx;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_set_limit (dc_session_manager_t *manager, const char *resource, unsigned int limit)
+{
+	if (manager == NULL || manager->running || resource == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int idx = dc_session_resource_find (manager, resource, 1);
+	if (idx == NONE) {
+		ERROR (manager->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	manager->resources[idx].limit = limit;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_set_size (dc_session_manager_t *manager, unsigned int index, unsigned int size)
+{
+	if (manager == NULL || manager->running || index >= manager->count)
+		return DC_STATUS_INVALIDARGS;
+
+	manager->sessions[index]->expected = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_set_persistent (dc_session_manager_t *manager, int persistent)
+{
+	if (manager == NULL || manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	manager->persistent = persistent;
+
+	// Leaving the persistent mode closes the devices.
+	if (!persistent)
+		dc_session_manager_close (manager);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_set_events (dc_session_manager_t *manager, unsigned int events, dc_session_event_callback_t callback, void *userdata)
+{
+	if (manager == NULL || manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	manager->events = events;
+	manager->event = callback;
+	manager->eventdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_run (dc_session_manager_t *manager, dc_session_dive_callback_t callback, dc_session_result_callback_t result, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_thread_t **threads = NULL;
+	unsigned int nthreads = 0, nstarted = 0;
+	dc_session_worker_t worker;
+
+	if (manager == NULL || manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	manager->callback = callback;
+	manager->userdata = userdata;
+	manager->pending = manager->count;
+	manager->cancelled = 0;
+	manager->running = 1;
+
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		dc_session_t *session = manager->sessions[i];
+		session->started = 0;
+		session->progress.current = 0;
+		session->progress.maximum = 0;
+		session->status = DC_STATUS_SUCCESS;
+	}
+
+	for (unsigned int i = 0; i < manager->nresources; ++i) {
+		manager->resources[i].running = 0;
+	}
+
+	worker.manager = manager;
+	worker.result = result;
+	worker.userdata = userdata;
+
+	nthreads = manager->nthreads;
+	if (nthreads > manager->count)
+		nthreads = manager->count;
+
+	// Start the worker threads. If that fails, the sessions are
+	// processed sequentially on the calling thread instead.
+	if (nthreads > 1 && manager->mutex && manager->callbacks && manager->cond) {
+		threads = (dc_thread_t **) malloc (nthreads * sizeof (dc_thread_t *));
+		if (threads) {
+			for (nstarted = 0; nstarted < nthreads; ++nstarted) {
+				if (dc_thread_new (&threads[nstarted], dc_session_worker, &worker) != DC_STATUS_SUCCESS)
+					break;
+			}
+			if (nstarted < nthreads) {
+				WARNING (manager->context, "Failed to start all worker threads (%u of %u).", nstarted, nthreads);
+			}
+		}
+	}
+
+	if (nstarted == 0) {
+		dc_session_worker (&worker);
+	} else {
+		for (unsigned int i = 0; i < nstarted; ++i) {
+			dc_thread_join (threads[i]);
+		}
+	}
+
+	free (threads);
+
+	// Report the first failure.
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		if (manager->sessions[i]->status != DC_STATUS_SUCCESS) {
+			status = manager->sessions[i]->status;
+			break;
+		}
+	}
+
+	if (manager->cancelled)
+		status = DC_STATUS_CANCELLED;
+
+	manager->callback = NULL;
+	manager->userdata = NULL;
+	manager->running = 0;
+
+	return status;
+}
+
+dc_status_t
+dc_session_manager_keepalive (dc_session_manager_t *manager)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (manager == NULL || manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		dc_session_t *session = manager->sessions[i];
+		if (session->device == NULL)
+			continue;
+
+		dc_status_t rc = dc_device_keepalive (session->device);
+		if (rc == DC_STATUS_SUCCESS || rc == DC_STATUS_UNSUPPORTED)
+			continue;
+
+		// The next run opens the device again.
+		WARNING (manager->context, "Failed to keep the device alive (session %u).", session->index);
+		dc_device_close (session->device);
+		session->device = NULL;
+		if (status == DC_STATUS_SUCCESS)
+			status = rc;
+	}
+
+	return status;
+}
+
+dc_status_t
+dc_session_manager_close (dc_session_manager_t *manager)
+{
+	if (manager == NULL || manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		dc_session_t *session = manager->sessions[i];
+		dc_device_close (session->device);
+		session->device = NULL;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_cancel (dc_session_manager_t *manager)
+{
+	if (manager == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	manager->cancelled = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_get_progress (dc_session_manager_t *manager, dc_event_progress_t *progress)
+{
+	if (manager == NULL || progress == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	progress->current = 0;
+	progress->maximum = 0;
+
+	dc_mutex_lock (manager->mutex);
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		progress->current += manager->sessions[i]->progress.current;
+		progress->maximum += manager->sessions[i]->progress.maximum;
+	}
+	dc_mutex_unlock (manager->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_get_status (dc_session_manager_t *manager, unsigned int index, dc_status_t *status)
+{
+	if (manager == NULL || status == NULL || index >= manager->count)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (manager->mutex);
+	*status = manager->sessions[index]->status;
+	dc_mutex_unlock (manager->mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_manager_free (dc_session_manager_t *manager)
+{
+	if (manager == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (manager->running)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < manager->count; ++i) {
+		dc_session_free (manager->sessions[i]);
+	}
+
+	for (unsigned int i = 0; i < manager->nresources; ++i) {
+		free (manager->resources[i].name);
+	}
+
+	free (manager->sessions);
+	free (manager->resources);
+	dc_cond_free (manager->cond);
+	dc_mutex_free (manager->callbacks);
+	dc_mutex_free (manager->mutex);
+	free (manager);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -26,6 +26,7 @@
 
 #include "context-private.h"
 #include "array.h"
+#include "probe.h"
 
 #define SZ_PACKET  254
 
@@ -47,6 +48,8 @@ shearwater_common_open (shearwater_common_device_t *device, dc_context_t *contex
 		return status;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_iostream_configure (device->iostream, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -65,6 +68,7 @@ shearwater_common_open (shearwater_common_device_t *device, dc_context_t *contex
 	// Make sure everything is in a sane state.
 	dc_iostream_sleep (device->iostream, 300);
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
+	device->roffset = device->rlength = 0;
 
 	return DC_STATUS_SUCCESS;
 
@@ -82,8 +86,64 @@ shearwater_common_close (shearwater_common_device_t *device)
 }
 
 
+typedef struct shearwater_lre_t {
+	dc_buffer_t *buffer;
+	unsigned char *data;
+	unsigned int size;
+	unsigned int capacity;
+	unsigned int done;
+} shearwater_lre_t;
+
+
 static int
-shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buffer_t *buffer, unsigned int *isfinal)
+shearwater_common_lre_init (shearwater_lre_t *lre, dc_buffer_t *buffer, unsigned int capacity)
+{
+	// Preallocate the output buffer for the expected amount of data.
+	if (!dc_buffer_resize (buffer, capacity))
+		return -1;
+
+	lre->buffer = buffer;
+	lre->data = dc_buffer_get_data (buffer);
+	lre->size = 0;
+	lre->capacity = capacity;
+	lre->done = 0;
+
+	return 0;
+}
+
+
+static int
+shearwater_common_lre_grow (shearwater_lre_t *lre, unsigned int n)
+{
+	if (lre->size + n <= lre->capacity)
+		return 0;
+
+	unsigned int capacity = lre->capacity * 2;
+	if (capacity < lre->size + n)
+		capacity = lre->size + n;
+
+	if (!dc_buffer_resize (lre->buffer, capacity))
+		return -1;
+
+	lre->data = dc_buffer_get_data (lre->buffer);
+	lre->capacity = capacity;
+
+	return 0;
+}
+
+
+static int
+shearwater_common_lre_finish (shearwater_lre_t *lre)
+{
+	if (!dc_buffer_resize (lre->buffer, lre->size))
+		return -1;
+
+	return 0;
+}
+
+
+static int
+shearwater_common_lre_decode (shearwater_lre_t *lre, const unsigned char data[], unsigned int size)
 {
 	// The RLE decompression algorithm does interpret the binary data as a
 	// stream of 9 bit values. Therefore, the total number of bits needs to be
@@ -92,49 +152,70 @@ shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buf
 	if (nbits % 9 != 0)
 		return -1;
 
+	// The bits are consumed from a 64 bit accumulator, which is refilled
+	// with as many bytes as possible at once.
+	unsigned long long bits = 0;
+	unsigned int navail = 0;
 	unsigned int offset = 0;
-	while (offset + 9 <= nbits) {
+
+	unsigned int count = nbits / 9;
+	for (unsigned int i = 0; i < count && !lre->done; ++i) {
+		if (navail < 9) {
+			while (navail <= 56 && offset < size) {
+				bits |= (unsigned long long) data[offset++] << (56 - navail);
+				navail += 8;
+			}
+		}
+
 		// Extract the 9 bit value.
-		unsigned int byte = offset / 8;
-		unsigned int bit  = offset % 8;
-		unsigned int shift = 16 - (bit + 9);
-		unsigned int value = (array_uint16_be (data + byte) >> shift) & 0x1FF;
+		unsigned int value = bits >> 55;
+		bits <<= 9;
+		navail -= 9;
 
 		// The 9th bit indicates whether the remaining 8 bits represent
 		// a run of zero bytes or not. If the bit is set, the value is
 		// not a run and doesn’t need expansion. If the bit is not set,
 		// the value contains the number of zero bytes in the run. A
 		// zero-length run indicates the end of the compressed stream.
+		//
+		// Each block of 32 bytes is also XOR'ed with the previous block,
+		// except for the first block, which is passed through unchanged.
+		// That is applied right away, while the bytes are written.
 		if (value & 0x100) {
-			// Append the data byte directly.
-			unsigned char c = value & 0xFF;
-			if (!dc_buffer_append (buffer, &c, 1))
+			if (shearwater_common_lre_grow (lre, 1) != 0)
 				return -1;
+
+			unsigned char c = value & 0xFF;
+			if (lre->size >= 32)
+				c ^= lre->data[lre->size - 32];
+			lre->data[lre->size++] = c;
 		} else if (value == 0) {
 			// Reached the end of the compressed stream.
-			if (isfinal)
-				*isfinal = 1;
-			break;
+			lre->done = 1;
 		} else {
-			// Expand the run with zero bytes.
-			if (!dc_buffer_resize (buffer, dc_buffer_get_size (buffer) + value))
+			if (shearwater_common_lre_grow (lre, value) != 0)
 				return -1;
-		}
-
-		offset += 9;
-	}
-
-	return 0;
-}
 
-
-static int
-shearwater_common_decompress_xor (unsigned char *data, unsigned int size)
-{
-	// Each block of 32 bytes is XOR'ed (in-place) with the previous block,
-	// except for the first block, which is passed through unchanged.
-	for (unsigned int i = 32; i < size; ++i) {
-		data[i] ^= data[i - 32];
+			// A zero byte XOR'ed with the previous block is a copy of
+			// that block, and new bytes in the first block remain zero.
+			unsigned char *p = lre->data + lre->size;
+			lre->size += value;
+			while (value) {
+				unsigned int position = p - lre->data;
+				unsigned int n = value;
+				if (position < 32) {
+					if (n > 32 - position)
+						n = 32 - position;
+					memset (p, 0, n);
+				} else {
+					if (n > 32)
+						n = 32;
+					memcpy (p, p - 32, n);
+				}
+				p += n;
+				value -= n;
+			}
+		}
 	}
 
 	return 0;
@@ -145,62 +226,39 @@ static dc_status_t
 shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned char data[], unsigned int size)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	const unsigned char end[] = {END};
-	const unsigned char esc_end[] = {ESC, ESC_END};
-	const unsigned char esc_esc[] = {ESC, ESC_ESC};
-	unsigned char buffer[32];
+	unsigned char buffer[2 * (SZ_PACKET + 4) + 1];
 	unsigned int nbytes = 0;
 
+	if (size > SZ_PACKET + 4)
+		return DC_STATUS_INVALIDARGS;
+
 #if 0
 	// Send an initial END character to flush out any data that may have
 	// accumulated in the receiver due to line noise.
-	status = dc_iostream_write (device->iostream, end, sizeof (end), NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		return status;
-	}
+	buffer[nbytes++] = END;
 #endif
 
+	// Encode the entire packet, escaping the END and ESC characters.
 	for (unsigned int i = 0; i < size; ++i) {
-		const unsigned char *seq = NULL;
-		unsigned int len = 0;
 		switch (data[i]) {
 		case END:
-			// Escape the END character.
-			seq = esc_end;
-			len = sizeof (esc_end);
+			buffer[nbytes++] = ESC;
+			buffer[nbytes++] = ESC_END;
 			break;
 		case ESC:
-			// Escape the ESC character.
-			seq = esc_esc;
-			len = sizeof (esc_esc);
+			buffer[nbytes++] = ESC;
+			buffer[nbytes++] = ESC_ESC;
 			break;
 		default:
-			// Normal character.
-			seq = data + i;
-			len = 1;
+			buffer[nbytes++] = data[i];
 			break;
 		}
-
-		// Flush the buffer if necessary.
-		if (nbytes + len + sizeof(end) > sizeof(buffer)) {
-			status = dc_iostream_write (device->iostream, buffer, nbytes, NULL);
-			if (status != DC_STATUS_SUCCESS) {
-				return status;
-			}
-
-			nbytes = 0;
-		}
-
-		// Append the escaped character.
-		memcpy(buffer + nbytes, seq, len);
-		nbytes += len;
 	}
 
 	// Append the END character to indicate the end of the packet.
-	memcpy(buffer + nbytes, end, sizeof(end));
-	nbytes += sizeof(end);
+	buffer[nbytes++] = END;
 
-	// Flush the buffer.
+	// Send the packet at once.
 	status = dc_iostream_write (device->iostream, buffer, nbytes, NULL);
 	if (status != DC_STATUS_SUCCESS) {
 		return status;
@@ -210,47 +268,58 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 }
 
 
+static dc_status_t
+shearwater_common_slip_fill (shearwater_common_device_t *device)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t available = 0;
+	size_t nbytes = 0;
+
+	// Read all the data that is already available, but at least one byte
+	// (blocking until the timeout expires).
+	dc_iostream_get_available (device->iostream, &available);
+	if (available < 1)
+		available = 1;
+	if (available > sizeof (device->rbuffer))
+		available = sizeof (device->rbuffer);
+
+	status = dc_iostream_read (device->iostream, device->rbuffer, available, &nbytes);
+
+	device->roffset = 0;
+	device->rlength = nbytes;
+
+	return status;
+}
+
+
 static dc_status_t
 shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char data[], unsigned int size, unsigned int *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	unsigned int received = 0;
+	unsigned int escaped = 0;
 
 	// Read bytes until a complete packet has been received. If the
 	// buffer runs out of space, bytes are dropped. The caller can
 	// detect this condition because the return value will be larger
 	// than the supplied buffer size.
 	while (1) {
-		unsigned char c = 0;
-
-		// Get a single character to process.
-		status = dc_iostream_read (device->iostream, &c, 1, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			return status;
-		}
-
-		switch (c) {
-		case END:
-			// If it's an END character then we're done.
-			// As a minor optimization, empty packets are ignored. This
-			// is to avoid bothering the upper layers with all the empty
-			// packets generated by the duplicate END characters which
-			// are sent to try to detect line noise.
-			if (received)
-				goto done;
-			else
-				break;
-		case ESC:
-			// If it's an ESC character, get another character and then
-			// figure out what to store in the packet based on that.
-			status = dc_iostream_read (device->iostream, &c, 1, NULL);
+		if (device->roffset == device->rlength) {
+			status = shearwater_common_slip_fill (device);
 			if (status != DC_STATUS_SUCCESS) {
 				return status;
 			}
+			continue;
+		}
 
+		const unsigned char *p = device->rbuffer + device->roffset;
+		const unsigned char *last = device->rbuffer + device->rlength;
+
+		if (escaped) {
 			// If it's not one of the two escaped characters, then we
 			// have a protocol violation. The best bet seems to be to
 			// leave the byte alone and just stuff it into the packet.
+			unsigned char c = *p;
 			switch (c) {
 			case ESC_END:
 				c = END;
@@ -259,15 +328,46 @@ shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char d
 				c = ESC;
 				break;
 			}
-			// Fall-through!
-		default:
 			if (received < size)
 				data[received] = c;
 			received++;
+			device->roffset++;
+			escaped = 0;
+			continue;
 		}
-	}
 
-done:
+		// Locate the next END or ESC character, and copy all normal
+		// characters in front of it at once.
+		const unsigned char *stop = (const unsigned char *) memchr (p, END, last - p);
+		const unsigned char *esc = (const unsigned char *) memchr (p, ESC, (stop ? stop : last) - p);
+		if (esc)
+			stop = esc;
+		if (stop == NULL)
+			stop = last;
+
+		unsigned int n = stop - p;
+		if (received < size)
+			memcpy (data + received, p, (n < size - received) ? n : size - received);
+		received += n;
+		device->roffset += n;
+
+		if (stop == last)
+			continue;
+
+		device->roffset++;
+		if (*stop == ESC) {
+			// If it's an ESC character, get another character and then
+			// figure out what to store in the packet based on that.
+			escaped = 1;
+		} else if (received) {
+			// If it's an END character then we're done.
+			// As a minor optimization, empty packets are ignored. This
+			// is to avoid bothering the upper layers with all the empty
+			// packets generated by the duplicate END characters which
+			// are sent to try to detect line noise.
+			break;
+		}
+	}
 
 	if (received > size)
 		return DC_STATUS_PROTOCOL;
@@ -279,17 +379,14 @@ done:
 }
 
 
-dc_status_t
-shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+static dc_status_t
+shearwater_common_packet (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned char packet[SZ_PACKET + 4];
 	unsigned int n = 0;
 
-	if (isize > SZ_PACKET || osize > SZ_PACKET)
-		return DC_STATUS_INVALIDARGS;
-
 	if (device_is_cancelled (abstract))
 		return DC_STATUS_CANCELLED;
 
@@ -342,6 +439,26 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 }
 
 
+dc_status_t
+shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (isize > SZ_PACKET || osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_usecs_t begin = dc_context_trace_begin (abstract->context);
+	DC_PROBE3 (transfer__entry, dc_device_get_type (abstract), isize ? input[0] : 0, isize);
+
+	dc_status_t status = shearwater_common_packet (device, input, isize, output, osize, actual);
+
+	DC_PROBE3 (transfer__return, dc_device_get_type (abstract), isize ? input[0] : 0, status);
+	dc_context_trace_end (abstract->context, "shearwater_common_transfer", begin);
+
+	return status;
+}
+
+
 dc_status_t
 shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression, dc_event_progress_t *progress)
 {
@@ -363,6 +480,7 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 	unsigned char req_block[] = {0x36, 0x00};
 	unsigned char req_quit[] = {0x37};
 	unsigned char response[SZ_PACKET];
+	shearwater_lre_t lre = {NULL, NULL, 0, 0, 0};
 
 	// Erase the current contents of the buffer.
 	if (!dc_buffer_clear (buffer)) {
@@ -370,6 +488,12 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		return DC_STATUS_NOMEMORY;
 	}
 
+	// The compressed data is decoded as it arrives.
+	if (compression && shearwater_common_lre_init (&lre, buffer, size) != 0) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
 	// Enable progress notifications.
 	unsigned int initial = 0, current = 0, maximum = 3 + size + 1;
 	if (progress) {
@@ -396,10 +520,9 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
 	}
 
-	unsigned int done = 0;
 	unsigned char block = 1;
 	unsigned int nbytes = 0;
-	while (nbytes < size && !done) {
+	while (nbytes < size && !(compression && lre.done)) {
 		// Transfer the block request.
 		req_block[1] = block;
 		rc = shearwater_common_transfer (device, req_block, sizeof (req_block), response, sizeof (response), &n);
@@ -428,7 +551,7 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		}
 
 		if (compression) {
-			if (shearwater_common_decompress_lre (response + 2, length, buffer, &done) != 0) {
+			if (shearwater_common_lre_decode (&lre, response + 2, length) != 0) {
 				ERROR (abstract->context, "Decompression error (LRE phase).");
 				return DC_STATUS_PROTOCOL;
 			}
@@ -443,11 +566,9 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		block++;
 	}
 
-	if (compression) {
-		if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer)) != 0) {
-			ERROR (abstract->context, "Decompression error (XOR phase).");
-			return DC_STATUS_PROTOCOL;
-		}
+	if (compression && shearwater_common_lre_finish (&lre) != 0) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
 	}
 
 	// Transfer the quit request.
@@ -43,9 +43,14 @@ extern "C" {
 #define NSTEPS    10000
 #define STEP(i,n) ((NSTEPS * (i) + (n) / 2) / (n))
 
+#define SZ_SLIPBUFFER 1024
+
 typedef struct shearwater_common_device_t {
 	dc_device_t base;
 	dc_iostream_t *iostream;
+	// Receive buffer for the SLIP decoder.
+	unsigned char rbuffer[SZ_SLIPBUFFER];
+	unsigned int roffset, rlength;
 } shearwater_common_device_t;
 
 dc_status_t
@@ -152,6 +152,48 @@ shearwater_petrel_device_set_fingerprint (dc_device_t *abstract, const unsigned
 }
 
 
+static dc_status_t
+shearwater_petrel_device_logbook (shearwater_petrel_device_t *device, const unsigned char data[], unsigned int size)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned int count = size / RECORD_SIZE;
+
+	if (count == 0)
+		return DC_STATUS_SUCCESS;
+
+	dc_logbook_entry_t *entries = (dc_logbook_entry_t *) dc_context_alloc (abstract->context, count * sizeof (dc_logbook_entry_t));
+	if (entries == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (entries, 0, count * sizeof (dc_logbook_entry_t));
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const unsigned char *record = data + i * RECORD_SIZE;
+
+		// The fingerprint is the timestamp of the dive, which is also
+		// stored in the dive header.
+		dc_logbook_entry_t *entry = &entries[i];
+		entry->fingerprint = record + 4;
+		entry->fsize = sizeof (device->fingerprint);
+		if (dc_datetime_gmtime (&entry->datetime, array_uint32_be (record + 4))) {
+			entry->datetime.timezone = DC_TIMEZONE_NONE;
+			entry->flags |= DC_LOGBOOK_DATETIME;
+		}
+	}
+
+	dc_event_logbook_t event;
+	event.entries = entries;
+	event.count = count;
+	device_event_emit (abstract, DC_EVENT_LOGBOOK, &event);
+
+	dc_context_release (abstract->context, entries);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -159,13 +201,14 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	// Allocate memory buffers for the manifests.
-	dc_buffer_t *buffer = dc_buffer_new (MANIFEST_SIZE);
-	dc_buffer_t *manifests = dc_buffer_new (MANIFEST_SIZE);
-	if (buffer == NULL || manifests == NULL) {
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, MANIFEST_SIZE);
+	dc_buffer_t *manifests = dc_buffer_new2 (abstract->context, MANIFEST_SIZE);
+	dc_buffer_t *records = dc_buffer_new2 (abstract->context, MANIFEST_SIZE);
+	dc_buffer_t *cache = dc_buffer_new2 (abstract->context, 0);
+	if (buffer == NULL || manifests == NULL || records == NULL || cache == NULL) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return DC_STATUS_NOMEMORY;
+		rc = DC_STATUS_NOMEMORY;
+		goto error_free;
 	}
 
 	// Enable progress notifications.
@@ -177,9 +220,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	rc = shearwater_common_identifier (&device->base, buffer, ID_SERIAL);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the serial number.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return rc;
+		goto error_free;
 	}
 
 	// Convert to a number.
@@ -187,35 +228,41 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	if (array_convert_hex2bin (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer),
 		serial, sizeof (serial)) != 0 ) {
 		ERROR (abstract->context, "Failed to convert the serial number.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return DC_STATUS_DATAFORMAT;
+		rc = DC_STATUS_DATAFORMAT;
+		goto error_free;
 
 	}
 
-	// Read the firmware version.
-	rc = shearwater_common_identifier (&device->base, buffer, ID_FIRMWARE);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to read the firmware version.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return rc;
-	}
+	// The firmware version and hardware type of a device seen earlier
+	// are taken from the cache, saving two round-trips. The serial
+	// number which was read above validates the cached values.
+	unsigned int serialnum = array_uint32_be (serial);
+	unsigned int firmware = 0, hardware = 0;
+	if (!dc_context_get_identity (abstract->context, DC_FAMILY_SHEARWATER_PETREL, serialnum, &firmware, &hardware)) {
+		// Read the firmware version.
+		rc = shearwater_common_identifier (&device->base, buffer, ID_FIRMWARE);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the firmware version.");
+			goto error_free;
+		}
 
-	// Convert to a number.
-	unsigned int firmware = str2num (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), 1);
+		// Convert to a number.
+		firmware = str2num (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), 1);
 
-	// Read the hardware type.
-	rc = shearwater_common_identifier (&device->base, buffer, ID_HARDWARE);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to read the hardware type.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return rc;
+		// Read the hardware type.
+		rc = shearwater_common_identifier (&device->base, buffer, ID_HARDWARE);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the hardware type.");
+			goto error_free;
+		}
+
+		// Convert to a number.
+		hardware = array_uint_be (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+
+		dc_context_set_identity (abstract->context, DC_FAMILY_SHEARWATER_PETREL, serialnum, firmware, hardware);
 	}
 
-	// Convert and map to the model number.
-	unsigned int hardware = array_uint_be (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+	// Map to the model number.
 	unsigned int model = 0;
 	switch (hardware) {
 	case 0x0101:
@@ -255,9 +302,19 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	dc_event_devinfo_t devinfo;
 	devinfo.model = model;
 	devinfo.firmware = firmware;
-	devinfo.serial = array_uint32_be (serial);
+	devinfo.serial = serialnum;
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	// Get the manifest records of the previous download. Once the first
+	// of these records appears again, the remainder of the manifest is
+	// already known and no more manifest pages need to be downloaded.
+	dc_context_get_manifest (abstract->context, DC_FAMILY_SHEARWATER_PETREL, serialnum, cache);
+	const unsigned char *cached = dc_buffer_get_data (cache);
+	unsigned int ncached = dc_buffer_get_size (cache);
+
+	device_set_phase (abstract, DC_PHASE_LOGBOOK);
+
+	unsigned int found = 0, complete = 0;
 	while (1) {
 		// Update the progress state.
 		// Assume the worst case scenario of a full manifest, and adjust the
@@ -271,9 +328,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		rc = shearwater_common_download (&device->base, buffer, MANIFEST_ADDR, MANIFEST_SIZE, 0, &progress);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to download the manifest.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return rc;
+			goto error_free;
 		}
 
 		// Cache the buffer pointer and size.
@@ -281,20 +336,29 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		unsigned int size = dc_buffer_get_size (buffer);
 
 		// Process the records in the manifest.
-		unsigned int count = 0;
+		unsigned int count = 0, nrecords = 0, known = 0;
 		unsigned int offset = 0;
-		while (offset < size) {
+		while (offset + RECORD_SIZE <= size) {
 			// Check for a valid dive header.
 			unsigned int header = array_uint16_be (data + offset);
 			if (header != 0xA5C4)
 				break;
 
-			// Check the fingerprint data.
-			if (memcmp (data + offset + 4, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			// Check for the first record of the previous download.
+			if (ncached && memcmp (data + offset, cached, RECORD_SIZE) == 0) {
+				known = 1;
 				break;
+			}
+
+			// Check the fingerprint data.
+			if (!found && memcmp (data + offset + 4, device->fingerprint, sizeof (device->fingerprint)) == 0)
+				found = 1;
+
+			if (!found)
+				count++;
 
 			offset += RECORD_SIZE;
-			count++;
+			nrecords++;
 		}
 
 		// Update the progress state.
@@ -302,16 +366,52 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		maximum -= RECORD_COUNT - count;
 
 		// Append the manifest records to the main buffer.
-		if (!dc_buffer_append (manifests, data, count * RECORD_SIZE)) {
+		if (!dc_buffer_append (manifests, data, count * RECORD_SIZE) ||
+			!dc_buffer_append (records, data, nrecords * RECORD_SIZE)) {
 			ERROR (abstract->context, "Insufficient buffer space available.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return DC_STATUS_NOMEMORY;
+			rc = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+
+		if (known) {
+			// Take the remaining records from the previous download.
+			unsigned int n = 0;
+			while (!found && n < ncached / RECORD_SIZE) {
+				if (memcmp (cached + n * RECORD_SIZE + 4, device->fingerprint, sizeof (device->fingerprint)) == 0)
+					found = 1;
+				else
+					n++;
+			}
+
+			maximum += n;
+
+			if (!dc_buffer_append (manifests, cached, n * RECORD_SIZE) ||
+				!dc_buffer_append (records, cached, ncached)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				rc = DC_STATUS_NOMEMORY;
+				goto error_free;
+			}
+
+			complete = 1;
+			break;
 		}
 
 		// Stop downloading manifest if there are no more records.
-		if (count != RECORD_COUNT)
+		if (nrecords != RECORD_COUNT) {
+			complete = 1;
 			break;
+		}
+
+		// Stop downloading manifest once a known dive appeared.
+		if (found)
+			break;
+	}
+
+	// Remember the manifest for the next download. A manifest which was
+	// cut short by the fingerprint is incomplete, and can't be used.
+	if (complete) {
+		dc_context_set_manifest (abstract->context, DC_FAMILY_SHEARWATER_PETREL, serialnum,
+			dc_buffer_get_data (records), dc_buffer_get_size (records));
 	}
 
 	// Update and emit a progress event.
@@ -323,6 +423,16 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	unsigned char *data = dc_buffer_get_data (manifests);
 	unsigned int size = dc_buffer_get_size (manifests);
 
+	// Report the new dives from the manifest.
+	rc = shearwater_petrel_device_logbook (device, data, size);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	// Ask for a fast link during the dive downloads.
+	dc_custom_io_serial_set_params (device->base.iostream, DC_LINK_BULK);
+
+	device_set_phase (abstract, DC_PHASE_PROFILE);
+
 	unsigned int offset = 0;
 	while (offset < size) {
 		// Get the address of the dive.
@@ -334,9 +444,7 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		rc = shearwater_common_download (&device->base, buffer, DIVE_ADDR + address, DIVE_SIZE, 1, &progress);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to download the dive.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return rc;
+			goto error_free;
 		}
 
 		// Update the progress state.
@@ -355,8 +463,11 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	progress.maximum = NSTEPS * maximum;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+error_free:
+	dc_custom_io_serial_set_params (device->base.iostream, 0);
+	dc_buffer_free (cache);
+	dc_buffer_free (records);
 	dc_buffer_free (manifests);
 	dc_buffer_free (buffer);
-
 	return rc;
 }
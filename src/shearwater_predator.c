@@ -27,12 +27,16 @@
 #include "context-private.h"
 #include "device-private.h"
 #include "array.h"
+#include "ringbuffer.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &shearwater_predator_device_vtable)
 
 #define SZ_BLOCK   0x80
+#define SZ_CHUNK   0x1000
 #define SZ_MEMORY  0x20080
 
+#define ADDR_MEMORY 0xDD000000
+
 #define RB_PROFILE_BEGIN 0
 #define RB_PROFILE_END   0x1F600
 
@@ -58,9 +62,6 @@ static const dc_device_vtable_t shearwater_predator_device_vtable = {
 	shearwater_predator_device_close /* close */
 };
 
-static dc_status_t
-shearwater_predator_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 dc_status_t
 shearwater_predator_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -138,35 +139,154 @@ shearwater_predator_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	progress.current = 0;
 	progress.maximum = NSTEPS;
 
-	return shearwater_common_download (device, buffer, 0xDD000000, SZ_MEMORY, 0, &progress);
+	return shearwater_common_download (device, buffer, ADDR_MEMORY, SZ_MEMORY, 0, &progress);
+}
+
+
+/*
+ * The Petrel sends the profile ringbuffer with the most recent dive
+ * first, so the download can stop as soon as the dive matching the
+ * fingerprint, or the first empty block, shows up. The memory after
+ * that point is left empty, which ends the extraction at the same
+ * dive as with a full memory dump. The final block, with the device
+ * information, is already downloaded by the caller.
+ */
+static dc_status_t
+shearwater_predator_download_petrel (shearwater_predator_device_t *device, dc_buffer_t *buffer, unsigned char data[], dc_event_progress_t *progress)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	memset (data, 0xFF, SZ_MEMORY - SZ_BLOCK);
+
+	unsigned int offset = RB_PROFILE_BEGIN;
+	while (offset < RB_PROFILE_END) {
+		unsigned int len = RB_PROFILE_END - offset;
+		if (len > SZ_CHUNK)
+			len = SZ_CHUNK;
+
+		rc = shearwater_common_download (&device->base, buffer, ADDR_MEMORY + offset, len, 0, progress);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		if (dc_buffer_get_size (buffer) != len) {
+			ERROR (abstract->context, "Unexpected number of bytes received.");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		memcpy (data + offset, dc_buffer_get_data (buffer), len);
+
+		// Scan the new blocks for the end of the new dives.
+		unsigned int done = 0;
+		for (unsigned int i = offset; i < offset + len; i += SZ_BLOCK) {
+			if (array_isequal (data + i, SZ_BLOCK, 0xFF) ||
+				(data[i + 0] == 0xFF && data[i + 1] == 0xFF &&
+				memcmp (data + i + 12, device->fingerprint, sizeof (device->fingerprint)) == 0)) {
+				done = 1;
+				break;
+			}
+		}
+
+		offset += len;
+
+		if (done)
+			break;
+	}
+
+	return DC_STATUS_SUCCESS;
 }
 
 
 static dc_status_t
 shearwater_predator_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	shearwater_predator_device_t *device = (shearwater_predator_device_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = shearwater_predator_device_dump (abstract, buffer);
-	if (rc != DC_STATUS_SUCCESS) {
-		dc_buffer_free (buffer);
-		return rc;
+	// Enable progress notifications. Assume the worst case scenario of
+	// a full ringbuffer, and jump to the end once the download is done.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.current = 0;
+	progress.maximum = NSTEPS * (1 + (RB_PROFILE_END - RB_PROFILE_BEGIN + SZ_CHUNK - 1) / SZ_CHUNK);
+
+	// Ask for a fast link during the download.
+	dc_custom_io_serial_set_params (device->base.iostream, DC_LINK_BULK);
+
+	// Download the final block first, to find out which model it is.
+	unsigned char final[SZ_BLOCK];
+	rc = shearwater_common_download (&device->base, buffer, ADDR_MEMORY + SZ_MEMORY - SZ_BLOCK, SZ_BLOCK, 0, &progress);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (dc_buffer_get_size (buffer) != SZ_BLOCK) {
+		ERROR (abstract->context, "Unexpected number of bytes received.");
+		rc = DC_STATUS_DATAFORMAT;
+		goto error_free;
 	}
 
+	memcpy (final, dc_buffer_get_data (buffer), SZ_BLOCK);
+
 	// Emit a device info event.
-	unsigned char *data = dc_buffer_get_data (buffer);
 	dc_event_devinfo_t devinfo;
-	devinfo.model = data[0x2000D];
-	devinfo.firmware = bcd2dec (data[0x2000A]);
-	devinfo.serial = array_uint32_be (data + 0x20002);
+	devinfo.model = final[0x0D];
+	devinfo.firmware = bcd2dec (final[0x0A]);
+	devinfo.serial = array_uint32_be (final + 0x02);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	rc = shearwater_predator_extract_dives (abstract, data, SZ_MEMORY, callback, userdata);
+	if (final[0x0D] == PETREL) {
+		// Download the new dives only.
+		if (!dc_buffer_resize (buffer, SZ_MEMORY)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			rc = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+
+		dc_buffer_t *chunk = dc_buffer_new2 (abstract->context, SZ_CHUNK);
+		if (chunk == NULL) {
+			rc = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+
+		unsigned char *data = dc_buffer_get_data (buffer);
+		memcpy (data + SZ_MEMORY - SZ_BLOCK, final, SZ_BLOCK);
+		rc = shearwater_predator_download_petrel (device, chunk, data, &progress);
+		dc_buffer_free (chunk);
+		if (rc != DC_STATUS_SUCCESS)
+			goto error_free;
 
-	dc_buffer_free (buffer);
+		progress.current = progress.maximum;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+	} else {
+		// The most recent dive can be anywhere in the ringbuffer of the
+		// Predator, and is only found after searching all of it. Only
+		// the memory before the final block remains to be downloaded.
+		progress.maximum = progress.current + NSTEPS;
+		rc = shearwater_common_download (&device->base, buffer, ADDR_MEMORY, SZ_MEMORY - SZ_BLOCK, 0, &progress);
+		if (rc != DC_STATUS_SUCCESS)
+			goto error_free;
+
+		if (dc_buffer_get_size (buffer) != SZ_MEMORY - SZ_BLOCK) {
+			ERROR (abstract->context, "Unexpected number of bytes received.");
+			rc = DC_STATUS_DATAFORMAT;
+			goto error_free;
+		}
+
+		if (!dc_buffer_append (buffer, final, SZ_BLOCK)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			rc = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+	}
+
+	rc = shearwater_predator_extract_dives (abstract, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
+error_free:
+	dc_custom_io_serial_set_params (device->base.iostream, 0);
+	dc_buffer_free (buffer);
 	return rc;
 }
 
@@ -241,34 +361,40 @@ shearwater_predator_extract_predator (dc_device_t *abstract, const unsigned char
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Linearize the ringbuffer.
-	memcpy (buffer + 0, data + eop, RB_PROFILE_END - eop);
-	memcpy (buffer + RB_PROFILE_END - eop, data + RB_PROFILE_BEGIN, eop - RB_PROFILE_BEGIN);
-
-	// Find the dives again in the linear buffer.
+	// Find the dives again, starting from the end of the most recent
+	// dive. Only the dives that are passed to the callback are copied,
+	// because the final block needs to be appended to each of them.
 	footer = 0;
 	have_footer = 0;
-	offset = RB_PROFILE_END;
-	while (offset != RB_PROFILE_BEGIN) {
+	offset = eop;
+	for (unsigned int nbytes = 0; nbytes < RB_PROFILE_END - RB_PROFILE_BEGIN; nbytes += SZ_BLOCK) {
+		// Handle the ringbuffer wrap point.
+		if (offset == RB_PROFILE_BEGIN)
+			offset = RB_PROFILE_END;
+
 		// Move to the start of the block.
 		offset -= SZ_BLOCK;
 
-		if (array_isequal (buffer + offset, SZ_BLOCK, 0xFF)) {
+		if (array_isequal (data + offset, SZ_BLOCK, 0xFF)) {
 			break;
-		} else if (buffer[offset + 0] == 0xFF && buffer[offset + 1] == 0xFF && have_footer) {
-			// Append the final block.
-			unsigned int length = footer + SZ_BLOCK - offset;
-			memcpy (buffer + offset + length, data + SZ_MEMORY - SZ_BLOCK, SZ_BLOCK);
+		} else if (data[offset + 0] == 0xFF && data[offset + 1] == 0xFF && have_footer) {
+			unsigned int length = ringbuffer_distance (offset, footer, 0, RB_PROFILE_BEGIN, RB_PROFILE_END) + SZ_BLOCK;
+
+			// Copy the dive and append the final block.
+			ringbuffer_span_t span;
+			ringbuffer_span (&span, offset, length, RB_PROFILE_BEGIN, RB_PROFILE_END);
+			ringbuffer_span_copy (buffer, data, &span);
+			memcpy (buffer + length, data + SZ_MEMORY - SZ_BLOCK, SZ_BLOCK);
 
 			// Check the fingerprint data.
-			if (device && memcmp (buffer + offset + 12, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			if (device && memcmp (buffer + 12, device->fingerprint, sizeof (device->fingerprint)) == 0)
 				break;
 
-			if (callback && !callback (buffer + offset, length + SZ_BLOCK, buffer + offset + 12, sizeof (device->fingerprint), userdata))
+			if (callback && !callback (buffer, length + SZ_BLOCK, buffer + 12, sizeof (device->fingerprint), userdata))
 				break;
 
 			have_footer = 0;
-		} else if (buffer[offset + 0] == 0xFF && buffer[offset + 1] == 0xFE) {
+		} else if (data[offset + 0] == 0xFF && data[offset + 1] == 0xFE) {
 			footer = offset;
 			have_footer = 1;
 		}
@@ -342,7 +468,7 @@ shearwater_predator_extract_petrel (dc_device_t *abstract, const unsigned char d
 }
 
 
-static dc_status_t
+dc_status_t
 shearwater_predator_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
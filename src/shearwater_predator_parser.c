@@ -54,13 +54,44 @@
 #define IMPERIAL 1
 
 #define NGASMIXES 10
-#define MAXSTRINGS 32
+#define MAXSTRINGS 8
+#define SZ_STRING  32
+
+#define STR_SERIAL      0
+#define STR_FIRMWARE    1
+#define STR_DECOMODEL   2
+#define STR_BATTERYTYPE 3
+#define STR_BATTERY     4
+#define STR_T1BATTERY   5
+#define STR_T2BATTERY   6
 
 #define PREDATOR 2
 #define PETREL   3
 
+#define NSENSORS 3
+
 typedef struct shearwater_predator_parser_t shearwater_predator_parser_t;
 
+/*
+ * The decode plan of the sample records. Everything that is the same
+ * for all samples of a dive, such as the unit system, the log version
+ * and the calibrated sensors, is resolved once by the cache, along with
+ * the sample types that are never present in the dive.
+ */
+typedef struct shearwater_predator_plan_t {
+	double depth;
+	double temperature[2];
+	unsigned int ccr;
+	unsigned int nsensors;
+	unsigned int sensor[NSENSORS];
+	double calibration[NSENSORS];
+	unsigned int setpoint;
+	double setpoints[2];
+	unsigned int cns;
+	unsigned int tanks;
+	unsigned int rbt;
+} shearwater_predator_plan_t;
+
 struct shearwater_predator_parser_t {
 	dc_parser_t base;
 	unsigned int model;
@@ -78,15 +109,21 @@ struct shearwater_predator_parser_t {
 	double calibration[3];
 	unsigned int serial;
 	dc_divemode_t mode;
+	shearwater_predator_plan_t plan;
 
 	/* String fields */
-	dc_field_string_t strings[MAXSTRINGS];
+	unsigned int nstrings;
+	unsigned int strings[MAXSTRINGS];
+	unsigned int t1_battery;
+	unsigned int t2_battery;
+	char values[MAXSTRINGS][SZ_STRING];
 };
 
 static dc_status_t shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t shearwater_predator_parser_samples_range (dc_parser_t *abstract, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata);
 
 static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	sizeof(shearwater_predator_parser_t),
@@ -95,6 +132,9 @@ static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	shearwater_predator_parser_samples_range, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -105,24 +145,13 @@ static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	shearwater_predator_parser_samples_range, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
 
-static unsigned int
-shearwater_predator_find_gasmix (shearwater_predator_parser_t *parser, unsigned int o2, unsigned int he)
-{
-	unsigned int i = 0;
-	while (i < parser->ngasmixes) {
-		if (o2 == parser->oxygen[i] && he == parser->helium[i])
-			break;
-		i++;
-	}
-
-	return i;
-}
-
-
 static dc_status_t
 shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial, unsigned int petrel)
 {
@@ -169,6 +198,10 @@ shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 		parser->calibration[i] = 0.0;
 	}
 	parser->mode = DC_DIVEMODE_OC;
+	parser->nstrings = 0;
+	parser->t1_battery = 0;
+	parser->t2_battery = 0;
+	memset (&parser->plan, 0, sizeof (parser->plan));
 
 	*out = (dc_parser_t *) parser;
 
@@ -210,6 +243,9 @@ shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char
 		parser->calibration[i] = 0.0;
 	}
 	parser->mode = DC_DIVEMODE_OC;
+	parser->nstrings = 0;
+	parser->t1_battery = 0;
+	parser->t2_battery = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -235,30 +271,19 @@ shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *d
 }
 
 /*
- * These string cache interfaces should be some generic
- * library rather than copied for all the dive computers.
- *
- * This is just copied from the EON Steel code.
+ * The string fields are only recorded while caching the dive header,
+ * and formatted on demand. Most applications never ask for them.
  */
 static void
-add_string(shearwater_predator_parser_t *parser, const char *desc, const char *value)
+add_string (shearwater_predator_parser_t *parser, unsigned int id)
 {
-	int i;
-
-	for (i = 0; i < MAXSTRINGS; i++) {
-		dc_field_string_t *str = parser->strings+i;
-		if (str->desc)
-			continue;
-		str->desc = desc;
-		str->value = strdup(value);
-		break;
-	}
+	if (parser->nstrings < MAXSTRINGS)
+		parser->strings[parser->nstrings++] = id;
 }
 
-static void
-add_string_fmt(shearwater_predator_parser_t *parser, const char *desc, const char *fmt, ...)
+static const char *
+format_string (char buffer[SZ_STRING], const char *fmt, ...)
 {
-	char buffer[256];
 	va_list ap;
 
 	/*
@@ -269,11 +294,11 @@ add_string_fmt(shearwater_predator_parser_t *parser, const char *desc, const cha
 	 * implementations.
 	 */
 	va_start(ap, fmt);
-	buffer[sizeof(buffer)-1] = 0;
-	(void) vsnprintf(buffer, sizeof(buffer)-1, fmt, ap);
+	buffer[SZ_STRING - 1] = 0;
+	(void) vsnprintf(buffer, SZ_STRING - 1, fmt, ap);
 	va_end(ap);
 
-	return add_string(parser, desc, buffer);
+	return buffer;
 }
 
 // The Battery state is a big-endian word:
@@ -311,68 +336,91 @@ battery_state(const unsigned char *data)
 // dive - maybe that would be a "starting to warn")
 //
 // We could also report unpaired and comm errors.
-static void
-add_battery_info(shearwater_predator_parser_t *parser, const char *desc, unsigned int state)
-{
-	if (state >= 1 && state <= 7) {
-		static const char *states[8] = {
-			"",		// 000 - No state bits, not used
-			"normal",	// 001 - only normal
-			"critical",	// 010 - only critical
-			"critical",	// 011 - both normal and critical
-			"warning",	// 100 - only warning
-			"warning",	// 101 - normal and warning
-			"critical",	// 110 - warning and critical
-			"critical",	// 111 - normal, warning and critical
-		};
-		add_string(parser, desc, states[state]);
-	}
-}
+static const char *battery_states[8] = {
+	"",		// 000 - No state bits, not used
+	"normal",	// 001 - only normal
+	"critical",	// 010 - only critical
+	"critical",	// 011 - both normal and critical
+	"warning",	// 100 - only warning
+	"warning",	// 101 - normal and warning
+	"critical",	// 110 - warning and critical
+	"critical",	// 111 - normal, warning and critical
+};
 
-static void
-add_deco_model(shearwater_predator_parser_t *parser, const unsigned char *data)
+static const char *
+deco_model(char buffer[SZ_STRING], const unsigned char *data)
 {
 	switch	(data[67]) {
 	case 0:
-		add_string_fmt(parser, "Deco model", "GF %u/%u", data[4], data[5]);
-		break;
+		return format_string(buffer, "GF %u/%u", data[4], data[5]);
 	case 1:
-		add_string_fmt(parser, "Deco model", "VPM-B +%u", data[68]);
-		break;
+		return format_string(buffer, "VPM-B +%u", data[68]);
 	case 2:
-		add_string_fmt(parser, "Deco model", "VPM-B/GFS +%u %u%%", data[68], data[85]);
-		break;
+		return format_string(buffer, "VPM-B/GFS +%u %u%%", data[68], data[85]);
 	default:
-		add_string_fmt(parser, "Deco model", "Unknown model %d", data[67]);
+		return format_string(buffer, "Unknown model %d", data[67]);
 	}
 }
 
-static void
-add_battery_type(shearwater_predator_parser_t *parser, const unsigned char *data)
+static const char *
+battery_type(char buffer[SZ_STRING], const unsigned char *data)
 {
-	if (parser->logversion < 7)
-		return;
-
 	switch (data[120]) {
 	case 1:
-		add_string(parser, "Battery type", "1.5V Alkaline");
-		break;
+		return "1.5V Alkaline";
 	case 2:
-		add_string(parser, "Battery type", "1.5V Lithium");
-		break;
+		return "1.5V Lithium";
 	case 3:
-		add_string(parser, "Battery type", "1.2V NiMH");
-		break;
+		return "1.2V NiMH";
 	case 4:
-		add_string(parser, "Battery type", "3.6V Saft");
-		break;
+		return "3.6V Saft";
 	case 5:
-		add_string(parser, "Battery type", "3.7V Li-Ion");
-		break;
+		return "3.7V Li-Ion";
 	default:
-		add_string_fmt(parser, "Battery type", "unknown type %d", data[120]);
+		return format_string(buffer, "unknown type %d", data[120]);
+	}
+}
+
+static dc_status_t
+shearwater_predator_parser_get_string (shearwater_predator_parser_t *parser, unsigned int idx, dc_field_string_t *string)
+{
+	const unsigned char *data = parser->base.data;
+	char *buffer = parser->values[idx];
+
+	switch (parser->strings[idx]) {
+	case STR_SERIAL:
+		string->desc = "Serial";
+		string->value = format_string(buffer, "%08x", parser->serial);
+		break;
+	case STR_FIRMWARE:
+		string->desc = "FW Version";
+		string->value = format_string(buffer, "%2x", data[19]);
 		break;
+	case STR_DECOMODEL:
+		string->desc = "Deco model";
+		string->value = deco_model(buffer, data);
+		break;
+	case STR_BATTERYTYPE:
+		string->desc = "Battery type";
+		string->value = battery_type(buffer, data);
+		break;
+	case STR_BATTERY:
+		string->desc = "Battery at end";
+		string->value = format_string(buffer, "%.1f V", data[9] / 10.0);
+		break;
+	case STR_T1BATTERY:
+		string->desc = "T1 battery";
+		string->value = battery_states[parser->t1_battery];
+		break;
+	case STR_T2BATTERY:
+		string->desc = "T2 battery";
+		string->value = battery_states[parser->t2_battery];
+		break;
+	default:
+		return DC_STATUS_UNSUPPORTED;
 	}
+
+	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
@@ -400,8 +448,6 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		logversion = data[127];
 	INFO(abstract->context, "Shearwater log version %u\n", logversion);
 
-	memset(parser->strings, 0, sizeof(parser->strings));
-
 	// Adjust the footersize for the final block.
 	if (parser->petrel || array_uint16_be (data + size - footersize) == 0xFFFD) {
 		footersize += SZ_BLOCK;
@@ -423,6 +469,14 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	// Transmitter battery levels
 	unsigned int t1_battery = 0, t2_battery = 0;
 
+	// The tank pressures and gas time present in the samples.
+	unsigned int tanks = 0, rbt = 0;
+
+	// Index the non-empty samples and the gas switches, such that the
+	// samples can be processed without sweeping the profile again.
+	dc_profile_index_t *index = &abstract->index;
+	dc_profile_index_reset (index);
+
 	unsigned int offset = headersize;
 	unsigned int length = size - footersize;
 	while (offset < length) {
@@ -439,6 +493,7 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		}
 
 		// Gaschange.
+		unsigned int gasmix = DC_GASMIX_UNKNOWN;
 		unsigned int o2 = data[offset + 7];
 		unsigned int he = data[offset + 8];
 		if (o2 != o2_previous || he != he_previous) {
@@ -461,6 +516,7 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 				ngasmixes = idx + 1;
 			}
 
+			gasmix = idx;
 			o2_previous = o2;
 			he_previous = he;
 		}
@@ -470,10 +526,24 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 			// T1 at offset 27, T2 at offset 19
 			t1_battery |= battery_state(data + offset + 27);
 			t2_battery |= battery_state(data + offset + 19);
+
+			if (array_uint16_be (data + offset + 27) < 0xFFF0)
+				tanks |= 0x01;
+			if (array_uint16_be (data + offset + 19) < 0xFFF0)
+				tanks |= 0x02;
+			if (data[offset + 21] < 0xF0)
+				rbt = 1;
+		}
+
+		dc_status_t rc = dc_profile_index_append (abstract, offset, gasmix);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return rc;
 		}
 
 		offset += parser->samplesize;
 	}
+	index->valid = 1;
 
 	// Cache sensor calibration for later use
 	unsigned int nsensors = 0, ndefaults = 0;
@@ -506,6 +576,29 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		parser->calibrated = data[86];
 	}
 
+	// Resolve the decode plan of the samples.
+	static const unsigned int sensors[NSENSORS] = {12, 14, 15};
+	shearwater_predator_plan_t *plan = &parser->plan;
+	unsigned int units = data[8];
+	plan->depth = units == IMPERIAL ? FEET : 1.0;
+	plan->temperature[0] = units == IMPERIAL ? 32.0 : 0.0;
+	plan->temperature[1] = units == IMPERIAL ? 5.0 / 9.0 : 1.0;
+	plan->ccr = mode == DC_DIVEMODE_CCR;
+	plan->nsensors = 0;
+	for (unsigned int i = 0; i < NSENSORS; ++i) {
+		if (parser->calibrated & (1 << i)) {
+			plan->sensor[plan->nsensors] = sensors[i];
+			plan->calibration[plan->nsensors] = parser->calibration[i];
+			plan->nsensors++;
+		}
+	}
+	plan->setpoint = parser->petrel;
+	plan->setpoints[0] = data[17] / 100.0;
+	plan->setpoints[1] = data[18] / 100.0;
+	plan->cns = parser->petrel;
+	plan->tanks = tanks;
+	plan->rbt = rbt;
+
 	// Cache the data for later use.
 	parser->logversion = logversion;
 	parser->headersize = headersize;
@@ -516,13 +609,19 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		parser->helium[i] = helium[i];
 	}
 	parser->mode = mode;
-	add_string_fmt(parser, "Serial", "%08x", parser->serial);
-	add_string_fmt(parser, "FW Version", "%2x", data[19]);
-	add_deco_model(parser, data);
-	add_battery_type(parser, data);
-	add_string_fmt(parser, "Battery at end", "%.1f V", data[9] / 10.0);
-	add_battery_info(parser, "T1 battery", t1_battery);
-	add_battery_info(parser, "T2 battery", t2_battery);
+	parser->t1_battery = t1_battery;
+	parser->t2_battery = t2_battery;
+	parser->nstrings = 0;
+	add_string(parser, STR_SERIAL);
+	add_string(parser, STR_FIRMWARE);
+	add_string(parser, STR_DECOMODEL);
+	if (logversion >= 7)
+		add_string(parser, STR_BATTERYTYPE);
+	add_string(parser, STR_BATTERY);
+	if (t1_battery >= 1 && t1_battery <= 7)
+		add_string(parser, STR_T1BATTERY);
+	if (t2_battery >= 1 && t2_battery <= 7)
+		add_string(parser, STR_T2BATTERY);
 	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
@@ -586,14 +685,9 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 			*((dc_divemode_t *) value) = parser->mode;
 			break;
 		case DC_FIELD_STRING:
-			if (flags < MAXSTRINGS) {
-				dc_field_string_t *p = parser->strings + flags;
-				if (p->desc) {
-					*string = *p;
-					break;
-				}
-			}
-			return DC_STATUS_UNSUPPORTED;
+			if (flags >= parser->nstrings)
+				return DC_STATUS_UNSUPPORTED;
+			return shearwater_predator_parser_get_string (parser, flags, string);
 		default:
 			return DC_STATUS_UNSUPPORTED;
 		}
@@ -604,36 +698,22 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 
 
 static dc_status_t
-shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+shearwater_predator_parser_samples (shearwater_predator_parser_t *parser, unsigned int first, unsigned int last, dc_sample_callback_t callback, void *userdata)
 {
-	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
-
+	dc_parser_t *abstract = (dc_parser_t *) parser;
 	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
 
-	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	// The decode plan is resolved by the cache.
+	const shearwater_predator_plan_t *plan = &parser->plan;
 
-	// Get the unit system.
-	unsigned int units = data[8];
+	// The non-empty samples are indexed by the cache.
+	const dc_profile_index_t *index = &abstract->index;
 
-	// Previous gas mix.
-	unsigned int o2_previous = 0, he_previous = 0;
-
-	unsigned int time = 0;
-	unsigned int offset = parser->headersize;
-	unsigned int length = size - parser->footersize;
-
-	while (offset < length) {
+	unsigned int time = first * 10;
+	for (unsigned int i = first; i < last; ++i) {
 		dc_sample_value_t sample = {0};
 
-		// Ignore empty samples.
-		if (array_isequal (data + offset, parser->samplesize, 0x00)) {
-			offset += parser->samplesize;
-			continue;
-		}
+		unsigned int offset = index->records[i].offset;
 
 		// Time (seconds).
 		time += 10;
@@ -642,10 +722,7 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 
 		// Depth (1/10 m or ft).
 		unsigned int depth = array_uint16_be (data + offset);
-		if (units == IMPERIAL)
-			sample.depth = depth * FEET / 10.0;
-		else
-			sample.depth = depth / 10.0;
+		sample.depth = depth * plan->depth / 10.0;
 		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
 		// Temperature (°C or °F).
@@ -657,76 +734,52 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 				temperature = 0;
 			}
 		}
-		if (units == IMPERIAL)
-			sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-		else
-			sample.temperature = temperature;
+		sample.temperature = (temperature - plan->temperature[0]) * plan->temperature[1];
 		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 
 		// Status flags.
 		unsigned int status = data[offset + 11];
 
-		if ((status & OC) == 0) {
+		if (plan->ccr && (status & OC) == 0) {
 			// PPO2
 			if ((status & PPO2_EXTERNAL) == 0) {
 #ifdef SENSOR_AVERAGE
 				sample.ppo2 = data[offset + 6] / 100.0;
 				if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
 #else
-				sample.ppo2 = data[offset + 12] * parser->calibration[0];
-				if (callback && (parser->calibrated & 0x01)) callback (DC_SAMPLE_PPO2, sample, userdata);
-
-				sample.ppo2 = data[offset + 14] * parser->calibration[1];
-				if (callback && (parser->calibrated & 0x02)) callback (DC_SAMPLE_PPO2, sample, userdata);
-
-				sample.ppo2 = data[offset + 15] * parser->calibration[2];
-				if (callback && (parser->calibrated & 0x04)) callback (DC_SAMPLE_PPO2, sample, userdata);
+				for (unsigned int j = 0; j < plan->nsensors; ++j) {
+					sample.ppo2 = data[offset + plan->sensor[j]] * plan->calibration[j];
+					if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+				}
 #endif
 			}
 
 			// Setpoint
-			if (parser->petrel) {
+			if (plan->setpoint) {
 				sample.setpoint = data[offset + 18] / 100.0;
 			} else {
-				if (status & SETPOINT_HIGH) {
-					sample.setpoint = data[18] / 100.0;
-				} else {
-					sample.setpoint = data[17] / 100.0;
-				}
+				sample.setpoint = plan->setpoints[(status & SETPOINT_HIGH) != 0];
 			}
 			if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
 		}
 
 		// CNS
-		if (parser->petrel) {
+		if (plan->cns) {
 			sample.cns = data[offset + 22] / 100.0;
 			if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
 		}
 
 		// Gaschange.
-		unsigned int o2 = data[offset + 7];
-		unsigned int he = data[offset + 8];
-		if (o2 != o2_previous || he != he_previous) {
-			unsigned int idx = shearwater_predator_find_gasmix (parser, o2, he);
-			if (idx >= parser->ngasmixes) {
-				ERROR (abstract->context, "Invalid gas mix.");
-				return DC_STATUS_DATAFORMAT;
-			}
-
-			sample.gasmix = idx;
+		if (index->records[i].gasmix != DC_GASMIX_UNKNOWN) {
+			sample.gasmix = index->records[i].gasmix;
 			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-			o2_previous = o2;
-			he_previous = he;
 		}
 
 		// Deco stop / NDL.
 		unsigned int decostop = array_uint16_be (data + offset + 2);
 		if (decostop) {
 			sample.deco.type = DC_DECO_DECOSTOP;
-			if (units == IMPERIAL)
-				sample.deco.depth = decostop * FEET;
-			else
-				sample.deco.depth = decostop;
+			sample.deco.depth = decostop * plan->depth;
 		} else {
 			sample.deco.type = DC_DECO_NDL;
 			sample.deco.depth = 0.0;
@@ -734,18 +787,16 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 		sample.deco.time = data[offset + 9] * 60;
 		if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
 
-		// for logversion 7 and newer (introduced for Perdix AI)
-		// detect tank pressure
-		if (parser->logversion >= 7) {
-			// Tank pressure
-			// Values above 0xFFF0 are special codes:
-			//    0xFFFF AI is off
-			//    0xFFFE No comms for 90 seconds+
-			//    0xFFFD No comms for 30 seconds
-			//    0xFFFC Transmitter not paired
-			// For regular values, the top 4 bits contain the battery
-			// level (0=normal, 1=critical, 2=warning), and the lower 12
-			// bits the tank pressure in units of 2 psi.
+		// Tank pressure, for log version 7 and newer (introduced for
+		// the Perdix AI). Values above 0xFFF0 are special codes:
+		//    0xFFFF AI is off
+		//    0xFFFE No comms for 90 seconds+
+		//    0xFFFD No comms for 30 seconds
+		//    0xFFFC Transmitter not paired
+		// For regular values, the top 4 bits contain the battery
+		// level (0=normal, 1=critical, 2=warning), and the lower 12
+		// bits the tank pressure in units of 2 psi.
+		if (plan->tanks) {
 			unsigned int pressure = array_uint16_be (data + offset + 27);
 			if (pressure < 0xFFF0) {
 				pressure &= 0x0FFF;
@@ -760,21 +811,69 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 				sample.pressure.value = pressure * 2 * PSI / BAR;
 				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
 			}
-
-			// Gas time remaining in minutes
-			// Values above 0xF0 are special codes:
-			//    0xFF Not paired
-			//    0xFE No communication
-			//    0xFD Not available in current mode
-			//    0xFC Not available because of DECO
-			//    0xFB Tank size or max pressure haven’t been set up
-			if (data[offset + 21] < 0xF0) {
-				sample.rbt = data[offset + 21];
-				if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
-			}
 		}
 
-		offset += parser->samplesize;
+		// Gas time remaining in minutes
+		// Values above 0xF0 are special codes:
+		//    0xFF Not paired
+		//    0xFE No communication
+		//    0xFD Not available in current mode
+		//    0xFC Not available because of DECO
+		//    0xFB Tank size or max pressure haven’t been set up
+		if (plan->rbt && data[offset + 21] < 0xF0) {
+			sample.rbt = data[offset + 21];
+			if (callback) callback (DC_SAMPLE_RBT, sample, userdata);
+		}
 	}
+
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+
+	// Cache the parser data.
+	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return shearwater_predator_parser_samples (parser, 0, abstract->index.count, callback, userdata);
+}
+
+
+static dc_status_t
+shearwater_predator_parser_samples_range (dc_parser_t *abstract, unsigned int begin, unsigned int end, dc_sample_callback_t callback, void *userdata)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+
+	// Cache the parser data.
+	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	const dc_profile_index_t *index = &abstract->index;
+
+	// Every non-empty sample is 10 seconds, and the n'th sample
+	// (zero based) has a time of (n + 1) * 10 seconds.
+	unsigned int first = begin > 0 ? (begin - 1) / 10 : 0;
+	unsigned int last = end / 10;
+	if (first > index->count)
+		first = index->count;
+	if (last > index->count)
+		last = index->count;
+
+	// Report the gas mix in effect at the start of the range.
+	for (unsigned int i = first; i > 0; --i) {
+		if (index->records[i - 1].gasmix != DC_GASMIX_UNKNOWN) {
+			dc_sample_value_t sample = {0};
+			sample.gasmix = index->records[i - 1].gasmix;
+			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			break;
+		}
+	}
+
+	return shearwater_predator_parser_samples (parser, first, last, callback, userdata);
+}
@@ -24,6 +24,9 @@
 #include "common-private.h"
 #include "context-private.h"
 
+// Maximum number of buffers per system call.
+#define MAXIOV 16
+
 dc_status_t
 dc_socket_syserror (s_errcode_t errcode)
 {
@@ -139,6 +142,22 @@ dc_socket_close (dc_iostream_t *abstract)
 	return status;
 }
 
+dc_status_t
+dc_socket_cancel (dc_iostream_t *abstract)
+{
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	// Shutting down both directions wakes up any thread blocked in
+	// select, after which every send and receive fails immediately.
+	if (shutdown (socket->fd, S_SHUT_RDWR) != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (abstract->context, errcode);
+		return dc_socket_syserror(errcode);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 dc_socket_connect (dc_iostream_t *abstract, const struct sockaddr *addr, s_socklen_t addrlen)
 {
@@ -225,6 +244,39 @@ dc_socket_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned in
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_socket_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+
+	while (1) {
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (socket->fd, &fds);
+
+		struct timeval tvt;
+		if (timeout > 0) {
+			tvt.tv_sec  = (timeout / 1000);
+			tvt.tv_usec = (timeout % 1000) * 1000;
+		} else if (timeout == 0) {
+			timerclear (&tvt);
+		}
+
+		int rc = select (socket->fd + 1, &fds, NULL, NULL, timeout >= 0 ? &tvt : NULL);
+		if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			return dc_socket_syserror(errcode);
+		} else if (rc == 0) {
+			return DC_STATUS_TIMEOUT;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
 dc_status_t
 dc_socket_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
 {
@@ -333,6 +385,89 @@ out:
 	return status;
 }
 
+dc_status_t
+dc_socket_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_socket_t *socket = (dc_socket_t *) abstract;
+#ifdef _WIN32
+	WSABUF vec[MAXIOV];
+#else
+	struct iovec vec[MAXIOV];
+#endif
+	size_t nbytes = 0, size = 0;
+
+	for (size_t i = 0; i < count; ++i)
+		size += iov[i].size;
+
+	// Skip any leading empty buffers.
+	size_t index = 0, offset = 0;
+	dc_iovec_advance (iov, count, &index, &offset, 0);
+
+	while (index < count) {
+		// Describe the remaining data, up to the maximum number of
+		// buffers per system call.
+		unsigned int nvec = 0;
+		for (size_t i = index; i < count && nvec < MAXIOV; ++i) {
+			size_t skip = (i == index ? offset : 0);
+#ifdef _WIN32
+			vec[nvec].buf = (CHAR *) iov[i].data + skip;
+			vec[nvec].len = (ULONG) (iov[i].size - skip);
+#else
+			vec[nvec].iov_base = (char *) iov[i].data + skip;
+			vec[nvec].iov_len = iov[i].size - skip;
+#endif
+			nvec++;
+		}
+
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (socket->fd, &fds);
+
+		int rc = select (socket->fd + 1, NULL, &fds, NULL, NULL);
+		if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto out;
+		} else if (rc == 0) {
+			break; // Timeout.
+		}
+
+#ifdef _WIN32
+		DWORD sent = 0;
+		s_ssize_t n = WSASend (socket->fd, vec, nvec, &sent, 0, NULL, NULL) == 0 ? (s_ssize_t) sent : -1;
+#else
+		s_ssize_t n = writev (socket->fd, vec, nvec);
+#endif
+		if (n < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR || errcode == S_EAGAIN)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			status = dc_socket_syserror(errcode);
+			goto out;
+		} else if (n == 0) {
+			break; // EOF.
+		}
+
+		dc_iovec_advance (iov, count, &index, &offset, n);
+		nbytes += n;
+	}
+
+	if (nbytes != size) {
+		status = DC_STATUS_TIMEOUT;
+	}
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
 dc_status_t
 dc_socket_flush (dc_iostream_t *abstract)
 {
@@ -34,6 +34,7 @@
 #include <sys/select.h> // select
 #include <sys/ioctl.h>  // ioctl
 #include <sys/time.h>
+#include <sys/uio.h>    // writev
 #endif
 
 #include <libdivecomputer/common.h>
@@ -56,6 +57,7 @@ typedef int s_socklen_t;
 #define S_INVALID INVALID_SOCKET
 #define S_IOCTL ioctlsocket
 #define S_CLOSE closesocket
+#define S_SHUT_RDWR SD_BOTH
 #else
 typedef int s_socket_t;
 typedef ssize_t s_ssize_t;
@@ -71,6 +73,7 @@ typedef socklen_t s_socklen_t;
 #define S_INVALID -1
 #define S_IOCTL ioctl
 #define S_CLOSE close
+#define S_SHUT_RDWR SHUT_RDWR
 #endif
 
 #ifdef __cplusplus
@@ -125,12 +128,18 @@ dc_socket_get_available (dc_iostream_t *iostream, size_t *value);
 dc_status_t
 dc_socket_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
 
+dc_status_t
+dc_socket_poll (dc_iostream_t *iostream, int timeout);
+
 dc_status_t
 dc_socket_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 
 dc_status_t
 dc_socket_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 
+dc_status_t
+dc_socket_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+
 dc_status_t
 dc_socket_flush (dc_iostream_t *iostream);
 
@@ -143,6 +152,9 @@ dc_socket_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
 dc_status_t
 dc_socket_close (dc_iostream_t *iostream);
 
+dc_status_t
+dc_socket_cancel (dc_iostream_t *iostream);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
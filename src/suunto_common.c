@@ -110,21 +110,24 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		unsigned int idx = RB_PROFILE_PEEK (current, layout);
 		if (data[idx] == 0x80) {
 			unsigned int len = RB_PROFILE_DISTANCE (current, previous, layout);
-			if (current + len > layout->rb_profile_end) {
-				unsigned int a = layout->rb_profile_end - current;
-				unsigned int b = (current + len) - layout->rb_profile_end;
-				memcpy (buffer + 0, data + current, a);
-				memcpy (buffer + a, data + layout->rb_profile_begin,   b);
+			ringbuffer_span_t span;
+			ringbuffer_span (&span, current, len, layout->rb_profile_begin, layout->rb_profile_end);
+
+			// Only a dive crossing the wrap point needs to be copied,
+			// all other dives are passed directly.
+			const unsigned char *dive = buffer;
+			if (span.count == 1) {
+				dive = data + span.segment[0].address;
 			} else {
-				memcpy (buffer, data + current, len);
+				ringbuffer_span_copy (buffer, data, &span);
 			}
 
-			if (device && memcmp (buffer + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+			if (device && memcmp (dive + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
 				free (buffer);
 				return DC_STATUS_SUCCESS;
 			}
 
-			if (callback && !callback (buffer, len, buffer + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
+			if (callback && !callback (dive, len, dive + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
 				free (buffer);
 				return DC_STATUS_SUCCESS;
 			}
@@ -29,6 +29,7 @@
 #include "rbstream.h"
 #include "checksum.h"
 #include "array.h"
+#include "probe.h"
 
 #define MAXRETRIES 2
 
@@ -65,19 +66,27 @@ suunto_common2_transfer (dc_device_t *abstract, const unsigned char command[], u
 	// returning an error. Usually the dive computer will respond
 	// again during one of the retries.
 
+	dc_usecs_t begin = dc_context_trace_begin (abstract->context);
+	DC_PROBE3 (transfer__entry, dc_device_get_type (abstract), command[0], csize);
+
 	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = VTABLE (abstract)->packet (abstract, command, csize, answer, asize, size)) != DC_STATUS_SUCCESS) {
 		// Automatically discard a corrupted packet,
 		// and request a new one.
 		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
-			return rc;
+			break;
 
 		// Abort if the maximum number of retries is reached.
 		if (nretries++ >= MAXRETRIES)
-			return rc;
+			break;
+
+		device_stats_retry (abstract);
 	}
 
+	DC_PROBE3 (transfer__return, dc_device_get_type (abstract), command[0], rc);
+	dc_context_trace_end (abstract->context, "suunto_common2_transfer", begin);
+
 	return rc;
 }
 
@@ -135,6 +144,10 @@ suunto_common2_device_reset_maxdepth (dc_device_t *abstract)
 dc_status_t
 suunto_common2_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size)
 {
+	// The requests can't be pipelined. The interface is a half-duplex
+	// single wire, where the direction is switched with the RTS line, and
+	// every command is echoed. Sending the next command while the answer
+	// is still arriving would collide on the wire.
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		// Calculate the package size.
@@ -197,17 +210,124 @@ suunto_common2_device_write (dc_device_t *abstract, unsigned int address, const
 }
 
 
+static unsigned int
+suunto_common2_get_serial (const unsigned char data[])
+{
+	unsigned int serial = 0;
+	for (unsigned int i = 0; i < 4; ++i) {
+		serial *= 100;
+		serial += data[i];
+	}
+
+	return serial;
+}
+
+
+static int
+suunto_common2_check_pointers (const suunto_common2_layout_t *layout, const unsigned char header[])
+{
+	unsigned int last  = array_uint16_le (header + 0);
+	unsigned int end   = array_uint16_le (header + 4);
+	unsigned int begin = array_uint16_le (header + 6);
+
+	return
+		last >= layout->rb_profile_begin && last < layout->rb_profile_end &&
+		end >= layout->rb_profile_begin && end < layout->rb_profile_end &&
+		begin >= layout->rb_profile_begin && begin < layout->rb_profile_end;
+}
+
+
+static dc_status_t
+suunto_common2_device_update (dc_device_t *abstract, unsigned char data[], unsigned int size, unsigned int *updated)
+{
+	suunto_common2_device_t *device = (suunto_common2_device_t *) abstract;
+	const suunto_common2_layout_t *layout = device->layout;
+
+	// Read the current ringbuffer pointers.
+	unsigned char header[8] = {0};
+	dc_status_t rc = suunto_common2_device_read (abstract, 0x0190, header, sizeof (header));
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory header.");
+		return rc;
+	}
+
+	const unsigned char *previous = data + 0x0190;
+	if (!suunto_common2_check_pointers (layout, header) ||
+		!suunto_common2_check_pointers (layout, previous))
+		return DC_STATUS_SUCCESS;
+
+	unsigned int last  = array_uint16_le (previous + 0);
+	unsigned int count = array_uint16_le (header + 2);
+	unsigned int end   = array_uint16_le (header + 4);
+	unsigned int begin = array_uint16_le (header + 6);
+
+	// Only the dives after the most recent dive of the mirror are new.
+	// That dive itself is downloaded again, in case it was incomplete.
+	// If it is no longer inside the ringbuffer, the new dives overwrote
+	// more than the old ones, and the mirror is useless.
+	if (array_uint16_le (previous + 2) == 0 || count < array_uint16_le (previous + 2))
+		return DC_STATUS_SUCCESS;
+	unsigned int used = RB_PROFILE_DISTANCE (layout, begin, end, count != 0);
+	if (RB_PROFILE_DISTANCE (layout, begin, last, 0) >= used)
+		return DC_STATUS_SUCCESS;
+
+	// Remember the link to the previous dive, to detect a ringbuffer
+	// that wrapped around completely, which the pointers can't tell.
+	unsigned char link[2] = {
+		data[last],
+		data[ringbuffer_increment (last, 1, layout->rb_profile_begin, layout->rb_profile_end)]};
+
+	// The memory outside the profile ringbuffer is always downloaded,
+	// because it also contains the settings.
+	device_range_t ranges[4];
+	unsigned int n = 0;
+	ranges[n].begin = 0;
+	ranges[n].end = layout->rb_profile_begin;
+	n++;
+	if (end >= last) {
+		ranges[n].begin = last;
+		ranges[n].end = end;
+		n++;
+	} else {
+		ranges[n].begin = last;
+		ranges[n].end = layout->rb_profile_end;
+		n++;
+		ranges[n].begin = layout->rb_profile_begin;
+		ranges[n].end = end;
+		n++;
+	}
+	ranges[n].begin = layout->rb_profile_end;
+	ranges[n].end = size;
+	n++;
+
+	rc = device_dump_ranges (abstract, data, size, ranges, n, SZ_PACKET);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (data[last] != link[0] ||
+		data[ringbuffer_increment (last, 1, layout->rb_profile_begin, layout->rb_profile_end)] != link[1])
+		return DC_STATUS_SUCCESS;
+
+	*updated = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 suunto_common2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 {
 	suunto_common2_device_t *device = (suunto_common2_device_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	assert (device != NULL);
 	assert (device->layout != NULL);
 
+	const suunto_common2_layout_t *layout = device->layout;
+
 	// Erase the current contents of the buffer and
 	// allocate the required amount of memory.
-	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, device->layout->memsize)) {
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, layout->memsize)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -218,11 +338,115 @@ suunto_common2_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	return device_dump_read (abstract, dc_buffer_get_data (buffer),
-		dc_buffer_get_size (buffer), SZ_PACKET);
+	unsigned char *data = dc_buffer_get_data (buffer);
+	unsigned int size = dc_buffer_get_size (buffer);
+
+	if (!dc_context_mirror_enabled (abstract->context))
+		return device_dump_read (abstract, data, size, SZ_PACKET);
+
+	// Read the serial number, to locate the mirror.
+	unsigned char serial[SZ_MINIMUM > 4 ? SZ_MINIMUM : 4] = {0};
+	rc = suunto_common2_device_read (abstract, layout->serial, serial, sizeof (serial));
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory header.");
+		return rc;
+	}
+
+	dc_family_t family = abstract->vtable->type;
+	unsigned int number = suunto_common2_get_serial (serial);
+
+	// Update the mirror of a previous dump, or fall back to a full dump.
+	unsigned int updated = 0;
+	if (dc_context_get_mirror (abstract->context, family, number, data, size)) {
+		rc = suunto_common2_device_update (abstract, data, size, &updated);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	if (!updated) {
+		rc = device_dump_read (abstract, data, size, SZ_PACKET);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	} else {
+		DEBUG (abstract->context, "Updated the memory mirror of device %u.", number);
+	}
+
+	dc_context_mirror_add (abstract->context, family, number, data, size);
+
+	return DC_STATUS_SUCCESS;
 }
 
 
+typedef struct suunto_common2_walk_t {
+	suunto_common2_device_t *device;
+	unsigned int current;
+	unsigned int previous;
+	unsigned int remaining;
+	unsigned int cancelled;
+	dc_status_t status;
+	dc_dive_callback_t callback;
+	void *userdata;
+} suunto_common2_walk_t;
+
+static dc_status_t
+suunto_common2_device_record (unsigned char data[], unsigned int size, dc_rbstream_record_t *record, void *userdata)
+{
+	suunto_common2_walk_t *walk = (suunto_common2_walk_t *) userdata;
+	suunto_common2_device_t *device = walk->device;
+	dc_device_t *abstract = (dc_device_t *) device;
+	const suunto_common2_layout_t *layout = device->layout;
+
+	unsigned int prev = array_uint16_le (data + 0);
+	unsigned int next = array_uint16_le (data + 2);
+	if (prev < layout->rb_profile_begin ||
+		prev >= layout->rb_profile_end ||
+		next < layout->rb_profile_begin ||
+		next >= layout->rb_profile_end)
+	{
+		ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", prev, next);
+		return DC_STATUS_DATAFORMAT;
+	}
+	if (next != walk->previous && next != walk->current) {
+		ERROR (abstract->context, "Profiles are not continuous (0x%04x 0x%04x 0x%04x).", walk->current, next, walk->previous);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	if (next != walk->current) {
+		unsigned int fp_offset = layout->fingerprint + 4;
+		if (memcmp (data + fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+			walk->cancelled = 1;
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (walk->callback && !walk->callback (data + 4, size - 4, data + fp_offset, sizeof (device->fingerprint), walk->userdata)) {
+			walk->cancelled = 1;
+			return DC_STATUS_SUCCESS;
+		}
+	} else {
+		ERROR (abstract->context, "Skipping incomplete dive (0x%04x 0x%04x 0x%04x).", walk->current, next, walk->previous);
+		walk->status = DC_STATUS_DATAFORMAT;
+	}
+
+	// Next dive.
+	walk->previous = walk->current;
+	walk->current = prev;
+
+	// The walk stops once the buffer is full, and the pointer to the
+	// dive in front of the oldest one is never used.
+	walk->remaining -= size;
+	if (walk->remaining == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Calculate the size of the next dive.
+	record->size = RB_PROFILE_DISTANCE (layout, walk->current, walk->previous, 1);
+	if (record->size < 4) {
+		ERROR (abstract->context, "Unexpected profile size (%u).", record->size);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
 dc_status_t
 suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -233,9 +457,6 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 
 	const suunto_common2_layout_t *layout = device->layout;
 
-	// Error status for delayed errors.
-	dc_status_t status = DC_STATUS_SUCCESS;
-
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 	progress.maximum = layout->rb_profile_end - layout->rb_profile_begin +
@@ -264,11 +485,7 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	dc_event_devinfo_t devinfo;
 	devinfo.model = device->version[0];
 	devinfo.firmware = array_uint24_be (device->version + 1);
-	devinfo.serial = 0;
-	for (unsigned int i = 0; i < 4; ++i) {
-		devinfo.serial *= 100;
-		devinfo.serial += serial[i];
-	}
+	devinfo.serial = suunto_common2_get_serial (serial);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Read the header bytes.
@@ -303,6 +520,8 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	progress.current += sizeof (header);
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	device_set_phase (abstract, DC_PHASE_PROFILE);
+
 	// Create the ringbuffer stream.
 	dc_rbstream_t *rbstream = NULL;
 	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET, layout->rb_profile_begin, layout->rb_profile_end, end);
@@ -321,77 +540,30 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 
 	// The ring buffer is traversed backwards to retrieve the most recent
 	// dives first. This allows us to download only the new dives.
-	unsigned int current = last;
-	unsigned int previous = end;
-	unsigned int offset = remaining;
-	while (offset) {
-		// Calculate the size of the current dive.
-		unsigned int size = RB_PROFILE_DISTANCE (layout, current, previous, 1);
-
-		if (size < 4 || size > offset) {
-			ERROR (abstract->context, "Unexpected profile size (%u %u).", size, offset);
-			dc_rbstream_free (rbstream);
-			free (data);
-			return DC_STATUS_DATAFORMAT;
-		}
-
-		// Move to the begin of the current dive.
-		offset -= size;
+	suunto_common2_walk_t walk = {device, last, end, remaining, 0, DC_STATUS_SUCCESS, callback, userdata};
+	dc_rbstream_record_t first = {RB_PROFILE_DISTANCE (layout, last, end, 1), 0};
+	if (remaining && first.size < 4) {
+		ERROR (abstract->context, "Unexpected profile size (%u).", first.size);
+		dc_rbstream_free (rbstream);
+		free (data);
+		return DC_STATUS_DATAFORMAT;
+	}
 
-		// Read the dive.
-		rc = dc_rbstream_read (rbstream, &progress, data + offset, size);
-		if (rc != DC_STATUS_SUCCESS) {
+	rc = dc_rbstream_walk (rbstream, &progress, data, remaining, &first, suunto_common2_device_record, &walk, NULL);
+	if (rc != DC_STATUS_SUCCESS) {
+		// A format error is already reported where it was detected.
+		if (rc != DC_STATUS_DATAFORMAT)
 			ERROR (abstract->context, "Failed to read the dive.");
-			dc_rbstream_free (rbstream);
-			free (data);
-			return rc;
-		}
-
-		unsigned char *p = data + offset;
-		unsigned int prev = array_uint16_le (p + 0);
-		unsigned int next = array_uint16_le (p + 2);
-		if (prev < layout->rb_profile_begin ||
-			prev >= layout->rb_profile_end ||
-			next < layout->rb_profile_begin ||
-			next >= layout->rb_profile_end)
-		{
-			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x 0x%04x).", prev, next);
-			dc_rbstream_free (rbstream);
-			free (data);
-			return DC_STATUS_DATAFORMAT;
-		}
-		if (next != previous && next != current) {
-			ERROR (abstract->context, "Profiles are not continuous (0x%04x 0x%04x 0x%04x).", current, next, previous);
-			dc_rbstream_free (rbstream);
-			free (data);
-			return DC_STATUS_DATAFORMAT;
-		}
-
-		if (next != current) {
-			unsigned int fp_offset = layout->fingerprint + 4;
-			if (memcmp (p + fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
-				dc_rbstream_free (rbstream);
-				free (data);
-				return DC_STATUS_SUCCESS;
-			}
-
-			if (callback && !callback (p + 4, size - 4, p + fp_offset, sizeof (device->fingerprint), userdata)) {
-				dc_rbstream_free (rbstream);
-				free (data);
-				return DC_STATUS_SUCCESS;
-			}
-		} else {
-			ERROR (abstract->context, "Skipping incomplete dive (0x%04x 0x%04x 0x%04x).", current, next, previous);
-			status = DC_STATUS_DATAFORMAT;
-		}
-
-		// Next dive.
-		previous = current;
-		current = prev;
+		dc_rbstream_free (rbstream);
+		free (data);
+		return rc;
 	}
 
 	dc_rbstream_free (rbstream);
 	free (data);
 
-	return status;
+	if (walk.cancelled)
+		return DC_STATUS_SUCCESS;
+
+	return walk.status;
 }
@@ -32,8 +32,6 @@
 
 #define ISINSTANCE(device) dc_device_isinstance((device), (const dc_device_vtable_t *) &suunto_d9_device_vtable)
 
-#define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
-
 #define D4i      0x19
 #define D6i      0x1A
 #define D9tx     0x1B
@@ -91,39 +89,28 @@ static const suunto_common2_layout_t suunto_dx_layout = {
 
 
 static dc_status_t
-suunto_d9_device_autodetect (suunto_d9_device_t *device, unsigned int model)
+suunto_d9_device_probe (dc_device_t *abstract, void *userdata)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_device_t *abstract = (dc_device_t *) device;
+	suunto_d9_device_t *device = (suunto_d9_device_t *) abstract;
+
+	// Try reading the version info.
+	return suunto_common2_device_version (abstract, device->base.version, sizeof (device->base.version));
+}
 
-	// The list with possible baudrates.
-	const int baudrates[] = {9600, 115200};
 
+static dc_status_t
+suunto_d9_device_autodetect (suunto_d9_device_t *device, const char *name, unsigned int model)
+{
 	// Use the model number as a hint to speedup the detection.
-	unsigned int hint = 0;
+	unsigned int hint = 9600;
 	if (model == D4i || model == D6i || model == D9tx ||
 		model == DX || model == VYPERNOVO || model == ZOOPNOVO ||
 		model == D4F)
-		hint = 1;
-
-	for (unsigned int i = 0; i < C_ARRAY_SIZE(baudrates); ++i) {
-		// Use the baudrate array as circular array, starting from the hint.
-		unsigned int idx = (hint + i) % C_ARRAY_SIZE(baudrates);
-
-		// Adjust the baudrate.
-		status = dc_iostream_configure (device->iostream, baudrates[idx], 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to set the terminal attributes.");
-			return status;
-		}
-
-		// Try reading the version info.
-		status = suunto_common2_device_version ((dc_device_t *) device, device->base.version, sizeof (device->base.version));
-		if (status == DC_STATUS_SUCCESS)
-			break;
-	}
+		hint = 115200;
 
-	return status;
+	return device_serial_upshift ((dc_device_t *) device, device->iostream, name, hint,
+		8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE,
+		suunto_d9_device_probe, NULL);
 }
 
 
@@ -156,6 +143,8 @@ suunto_d9_device_open (dc_device_t **out, dc_context_t *context, const char *nam
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -184,7 +173,7 @@ suunto_d9_device_open (dc_device_t **out, dc_context_t *context, const char *nam
 	dc_iostream_purge (device->iostream, DC_DIRECTION_ALL);
 
 	// Try to autodetect the protocol variant.
-	status = suunto_d9_device_autodetect (device, model);
+	status = suunto_d9_device_autodetect (device, name, model);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to identify the protocol variant.");
 		goto error_close;
@@ -304,6 +293,7 @@ suunto_d9_device_packet (dc_device_t *abstract, const unsigned char command[], u
 	unsigned char crc = answer[asize - 1];
 	unsigned char ccrc = checksum_xor_uint8 (answer, asize - 1, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -89,6 +89,7 @@ typedef struct sample_info_t {
 	unsigned int size;
 	unsigned int interval;
 	unsigned int divisor;
+	unsigned int countdown;
 } sample_info_t;
 
 static dc_status_t suunto_d9_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -103,6 +104,9 @@ static const dc_parser_vtable_t suunto_d9_parser_vtable = {
 	suunto_d9_parser_get_datetime, /* datetime */
 	suunto_d9_parser_get_field, /* fields */
 	suunto_d9_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -504,9 +508,18 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 		sample.time = time;
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-		// Sample data.
+		// Sample data. Each parameter is present in every interval'th
+		// sample, starting with the first one. A countdown per parameter
+		// keeps track of the next sample containing that parameter.
 		for (unsigned int i = 0; i < nparams; ++i) {
-			if (info[i].interval && (nsamples % info[i].interval) == 0) {
+			if (info[i].interval == 0)
+				continue;
+
+			if (info[i].countdown) {
+				info[i].countdown--;
+			} else {
+				info[i].countdown = info[i].interval - 1;
+
 				if (offset + info[i].size > size) {
 					ERROR (abstract->context, "Buffer overflow detected!");
 					return DC_STATUS_DATAFORMAT;
@@ -93,6 +93,8 @@ suunto_eon_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (1200 8N2).
 	status = dc_iostream_configure (device->iostream, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -203,6 +205,7 @@ suunto_eon_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	unsigned char crc = answer[sizeof (answer) - 1];
 	unsigned char ccrc = checksum_add_uint8 (answer, sizeof (answer) - 1, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -216,9 +219,7 @@ suunto_eon_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	suunto_common_device_t *device = (suunto_common_device_t *) abstract;
-
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -240,7 +241,7 @@ suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	rc = suunto_common_extract_dives (device, &suunto_eon_layout, data, callback, userdata);
+	rc = suunto_eon_extract_dives (abstract, data, dc_buffer_get_size (buffer), callback, userdata);
 
 	dc_buffer_free (buffer);
 
@@ -248,6 +249,21 @@ suunto_eon_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 }
 
 
+dc_status_t
+suunto_eon_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	suunto_common_device_t *device = (suunto_common_device_t *) abstract;
+
+	if (abstract && !ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (size < SZ_MEMORY)
+		return DC_STATUS_DATAFORMAT;
+
+	return suunto_common_extract_dives (device, &suunto_eon_layout, data, callback, userdata);
+}
+
+
 dc_status_t
 suunto_eon_device_write_name (dc_device_t *abstract, unsigned char data[], unsigned int size)
 {
@@ -41,6 +41,10 @@ typedef struct suunto_eonsteel_device_t {
 	unsigned short seq;
 	unsigned char version[0x30];
 	unsigned char fingerprint[4];
+	// BLE receive buffer
+	unsigned char rxbuf[1024];
+	unsigned int rxlen, rxoff;
+	dc_custom_io_t *io;
 } suunto_eonsteel_device_t;
 
 // The EON Steel implements a small filesystem
@@ -48,10 +52,27 @@ typedef struct suunto_eonsteel_device_t {
 #define DIRTYPE_DIR  0x0002
 
 struct directory_entry {
-	struct directory_entry *next;
 	int type;
 	int namelen;
-	char name[1];
+	// Dive time, from the "%x.LOG" file name.
+	int hastime;
+	unsigned int time;
+	// Offset of the name in the string arena, resolved to a
+	// pointer once the whole directory is read.
+	unsigned int offset;
+	const char *name;
+};
+
+/*
+ * The entries are kept in one array, and their names in one string
+ * arena, such that even a directory with thousands of dives takes only
+ * two allocations.
+ */
+struct directory_list {
+	struct directory_entry *entries;
+	unsigned int count, capacity;
+	char *names;
+	unsigned int nsize, ncapacity;
 };
 
 // EON Steel command numbers and other magic field values
@@ -94,28 +115,48 @@ static const dc_device_vtable_t suunto_eonsteel_device_vtable = {
 
 static const char dive_directory[] = "0:/dives";
 
-static void file_list_free (struct directory_entry *de)
+static void file_list_free (struct directory_list *list)
 {
-	while (de) {
-		struct directory_entry *next = de->next;
-		free (de);
-		de = next;
-	}
+	free (list->entries);
+	free (list->names);
+	memset (list, 0, sizeof (*list));
 }
 
-static struct directory_entry *alloc_dirent(int type, int len, const char *name)
+static int add_dirent(struct directory_list *list, int type, int len, const char *name)
 {
 	struct directory_entry *res;
 
-	res = (struct directory_entry *) malloc(offsetof(struct directory_entry, name) + len + 1);
-	if (res) {
-		res->next = NULL;
-		res->type = type;
-		res->namelen = len;
-		memcpy(res->name, name, len);
-		res->name[len] = 0;
+	if (list->count == list->capacity) {
+		unsigned int capacity = list->capacity ? list->capacity * 2 : 64;
+		res = (struct directory_entry *) realloc(list->entries, capacity * sizeof(*res));
+		if (!res)
+			return -1;
+		list->entries = res;
+		list->capacity = capacity;
+	}
+
+	if (list->nsize + len + 1 > list->ncapacity) {
+		unsigned int ncapacity = list->ncapacity ? list->ncapacity : 1024;
+		char *names;
+		while (list->nsize + len + 1 > ncapacity)
+			ncapacity *= 2;
+		names = (char *) realloc(list->names, ncapacity);
+		if (!names)
+			return -1;
+		list->names = names;
+		list->ncapacity = ncapacity;
 	}
-	return res;
+
+	res = list->entries + list->count++;
+	res->type = type;
+	res->namelen = len;
+	res->offset = list->nsize;
+	res->name = NULL;
+	memcpy(list->names + list->nsize, name, len);
+	list->names[list->nsize + len] = 0;
+	list->nsize += len + 1;
+	res->hastime = sscanf(list->names + res->offset, "%x.LOG", &res->time) == 1;
+	return 0;
 }
 
 static void put_le16(unsigned short val, unsigned char *p)
@@ -177,60 +218,106 @@ static int receive_usbhid_packet(dc_custom_io_t *io, suunto_eonsteel_device_t *e
 	return len;
 }
 
+/*
+ * Return the position of the first HDLC escape character, or the
+ * size if there is none. The end of frame character is searched for
+ * separately, since there is at most one per frame.
+ */
+static unsigned int hdlc_span(const unsigned char *data, unsigned int size)
+{
+	const unsigned char *p = (const unsigned char *) memchr(data, 0x7d, size);
+	if (p)
+		return p - data;
+	return size;
+}
+
 static int fill_ble_buffer(dc_custom_io_t *io, suunto_eonsteel_device_t *eon, unsigned char *buffer, int size)
 {
 	int state = 0;
 	int bytes = 0;
 	unsigned int crc;
+	unsigned int eof = 0;
 
 	for (;;) {
-		unsigned char packet[32];
-		dc_status_t rc = DC_STATUS_SUCCESS;
-		size_t transferred = 0;
-		int i;
-
-		rc = io->packet_read(io, packet, sizeof(packet), &transferred);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR(eon->base.context, "BLE GATT read transfer failed");
-			return -1;
-		}
-		for (i = 0; i < transferred; i++) {
-			unsigned char c = packet[i];
-
-			if (c == 0x7e) {
-				if (state == 1)
-					goto done;
-				if (state == 2) {
-					ERROR(eon->base.context, "BLE GATT stream has escaped 7e character");
-					return -1;
-				}
-				/* Initial 7e character - good */
-				state = 1;
-				continue;
+		unsigned char c;
+
+		/*
+		 * Drain all queued notifications at once. Whatever follows
+		 * the end of this frame is kept for the next one.
+		 */
+		if (eon->rxoff >= eon->rxlen) {
+			dc_status_t rc = DC_STATUS_SUCCESS;
+			size_t transferred = 0;
+
+			rc = dc_custom_io_packet_read_many(eon->base.context, io, eon->rxbuf, sizeof(eon->rxbuf), &transferred);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR(eon->base.context, "BLE GATT read transfer failed");
+				goto error;
 			}
+			eon->rxoff = 0;
+			eon->rxlen = transferred;
+			eof = 0;
+			continue;
+		}
 
-			if (!state) {
-				ERROR(eon->base.context, "BLE GATT stream did not start with 7e");
-				return -1;
+		/*
+		 * Inside a frame, copy the whole run of bytes up to the next
+		 * escape or end of frame character at once. The end of frame
+		 * position only needs to be searched for again once passed.
+		 */
+		if (state == 1) {
+			const unsigned char *p = eon->rxbuf + eon->rxoff;
+			unsigned int n;
+
+			if (eof <= eon->rxoff) {
+				const unsigned char *end = (const unsigned char *) memchr(p, 0x7e, eon->rxlen - eon->rxoff);
+				eof = end ? (unsigned int) (end - eon->rxbuf) : eon->rxlen;
 			}
 
-			if (c == 0x7d) {
-				if (state == 2) {
-					ERROR(eon->base.context, "BLE GATT stream has escaped 7d character");
-					return -1;
-				}
-				state = 2;
+			n = hdlc_span(p, eof - eon->rxoff);
+			if (n) {
+				if (bytes < size)
+					memcpy(buffer + bytes, p, n < size - bytes ? n : size - bytes);
+				bytes += n;
+				eon->rxoff += n;
 				continue;
 			}
+		}
+		c = eon->rxbuf[eon->rxoff++];
 
+		if (c == 0x7e) {
+			if (state == 1)
+				goto done;
 			if (state == 2) {
-				c ^= 0x20;
-				state = 1;
+				ERROR(eon->base.context, "BLE GATT stream has escaped 7e character");
+				goto error;
 			}
-			if (bytes < size)
-				buffer[bytes] = c;
-			bytes++;
+			/* Initial 7e character - good */
+			state = 1;
+			continue;
 		}
+
+		if (!state) {
+			ERROR(eon->base.context, "BLE GATT stream did not start with 7e");
+			goto error;
+		}
+
+		if (c == 0x7d) {
+			if (state == 2) {
+				ERROR(eon->base.context, "BLE GATT stream has escaped 7d character");
+				goto error;
+			}
+			state = 2;
+			continue;
+		}
+
+		if (state == 2) {
+			c ^= 0x20;
+			state = 1;
+		}
+		if (bytes < size)
+			buffer[bytes] = c;
+		bytes++;
 	}
 done:
 	if (bytes < 4) {
@@ -251,6 +338,11 @@ done:
 	}
 	HEXDUMP (eon->base.context, DC_LOGLEVEL_DEBUG, "rcv", buffer, bytes);
 	return bytes;
+
+error:
+	/* Discard the rest of the received data */
+	eon->rxoff = eon->rxlen = 0;
+	return -1;
 }
 
 #define HDRSIZE 12
@@ -315,8 +407,21 @@ static int hdlc_reencode(unsigned char *dst, unsigned char *src, int len)
 	int result = 0, i;
 
 	*dst++ = 0x7e; result++;
-	for (i = 0; i < len; i++) {
-		int chars = add_hdlc(dst, src[i]);
+	for (i = 0; i < len; ) {
+		// Copy the run of bytes which need no escaping at once.
+		unsigned int n = hdlc_span(src + i, len - i);
+		const unsigned char *end = (const unsigned char *) memchr(src + i, 0x7e, n);
+		if (end)
+			n = end - (src + i);
+		if (n) {
+			memcpy(dst, src + i, n);
+			dst += n;
+			result += n;
+			i += n;
+			continue;
+		}
+
+		int chars = add_hdlc(dst, src[i++]);
 		dst += chars;
 		result += chars;
 	}
@@ -338,7 +443,7 @@ static int send_cmd(suunto_eonsteel_device_t *eon,
 	unsigned char buf[64];
 	unsigned short seq = eon->seq;
 	unsigned int magic = eon->magic;
-	dc_custom_io_t *io = _dc_context_custom_io(eon->base.context);
+	dc_custom_io_t *io = eon->io;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	size_t transferred = 0;
 
@@ -372,18 +477,19 @@ static int send_cmd(suunto_eonsteel_device_t *eon,
 
 	// BLE GATT protocol?
 	if (io->packet_size < 64) {
-		int hdlc_len;
+		int hdlc_len, mtu;
 		unsigned char hdlc[2+2*(62+4)]; /* start/stop + escaping*(maxbuf+crc32) */
 		unsigned char *ptr;
 
 		hdlc_len = hdlc_reencode(hdlc, buf+2, buf[1]);
 
 		ptr = hdlc;
+		mtu = dc_custom_io_packet_mtu(eon->base.context, io);
 		do {
 			int len = hdlc_len;
 
-			if (len > io->packet_size)
-				len = io->packet_size;
+			if (len > mtu)
+				len = mtu;
 			rc = io->packet_write(io, ptr, len, &transferred);
 			if (rc != DC_STATUS_SUCCESS)
 				break;
@@ -414,7 +520,7 @@ static int receive_header(suunto_eonsteel_device_t *eon, struct eon_hdr *hdr, un
 {
 	int ret;
 	unsigned char header[64];
-	dc_custom_io_t *io = _dc_context_custom_io(eon->base.context);
+	dc_custom_io_t *io = eon->io;
 
 	if (io->packet_size < 64)
 		fill_ble_data(io, eon);
@@ -444,7 +550,7 @@ static int receive_header(suunto_eonsteel_device_t *eon, struct eon_hdr *hdr, un
 static int receive_data(suunto_eonsteel_device_t *eon, unsigned char *buffer, int size)
 {
 	int ret = 0;
-	dc_custom_io_t *io = _dc_context_custom_io(eon->base.context);
+	dc_custom_io_t *io = eon->io;
 
 	while (size > 0) {
 		int len;
@@ -529,8 +635,14 @@ static int send_receive(suunto_eonsteel_device_t *eon,
 	return len;
 }
 
-static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buffer_t *buf)
+/*
+ * Read a file, preceded by the header bytes. Every piece is reported
+ * with a DC_EVENT_DIVEDATA event, and appended to the buffer if there
+ * is one.
+ */
+static int read_file(suunto_eonsteel_device_t *eon, const char *filename, const unsigned char header[], unsigned int hsize, dc_buffer_t *buf)
 {
+	dc_event_divedata_t divedata;
 	unsigned char result[2560];
 	unsigned char cmdbuf[64];
 	unsigned int size, offset;
@@ -564,6 +676,16 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
 	size = array_uint32_le(result+4);
 	offset = 0;
 
+	divedata.data = header;
+	divedata.size = hsize;
+	divedata.offset = 0;
+	divedata.total = hsize + size;
+	device_event_emit(&eon->base, DC_EVENT_DIVEDATA, &divedata);
+	if (buf && !dc_buffer_append (buf, header, hsize)) {
+		ERROR (eon->base.context, "Insufficient buffer space available.");
+		return -1;
+	}
+
 	while (size > 0) {
 		unsigned int ask, got, at;
 
@@ -602,7 +724,12 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
 
 		if (got > size)
 			got = size;
-		if (!dc_buffer_append (buf, result + 8, got)) {
+
+		divedata.data = result + 8;
+		divedata.size = got;
+		divedata.offset = hsize + offset;
+		device_event_emit(&eon->base, DC_EVENT_DIVEDATA, &divedata);
+		if (buf && !dc_buffer_append (buf, result + 8, got)) {
 			ERROR (eon->base.context, "Insufficient buffer space available.");
 			return -1;
 		}
@@ -623,31 +750,55 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
 }
 
 /*
- * NOTE! This will create the list of dirent's in reverse order,
- * with the last dirent first. That's intentional: for dives,
- * we will want to look up the last dive first.
+ * Sort the newest dive first: that's intentional, because we will
+ * want to look up the last dive first, and then the fingerprint
+ * cut-off is found without reading any older file. The dive times are
+ * compared rather than the names, because the hex numbers in the file
+ * names need not have the same length. The entries without a dive
+ * time go last.
  */
-static struct directory_entry *add_dirent(struct directory_entry *new, struct directory_entry *list)
+static int compare_dirent(const void *a, const void *b)
 {
-	struct directory_entry **pp = &list, *p;
+	const struct directory_entry *x = (const struct directory_entry *) a;
+	const struct directory_entry *y = (const struct directory_entry *) b;
+
+	if (x->hastime != y->hastime)
+		return x->hastime ? -1 : 1;
+	if (x->hastime && x->time != y->time)
+		return x->time < y->time ? 1 : -1;
+	return strcmp(y->name, x->name);
+}
 
-	/* Skip any entries that are later than the new one */
-	while ((p = *pp) != NULL && strcmp(p->name, new->name) > 0)
-		pp = &p->next;
+/*
+ * Return the number of entries newer than the dive with the given
+ * time, or all entries if there is no such dive. The dives with a
+ * time are sorted first, newest first, so a binary search will do.
+ */
+static unsigned int find_cutoff(const struct directory_list *list, unsigned int time)
+{
+	unsigned int lo = 0, hi = list->count;
+
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		const struct directory_entry *de = list->entries + mid;
+		if (de->hastime && de->time > time)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	/* Add the new one to that location and return the new list pointer */
-	new->next = p;
-	*pp = new;
-	return list;
+	if (lo < list->count && list->entries[lo].hastime && list->entries[lo].time == time)
+		return lo;
+
+	return list->count;
 }
 
-static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int nr, const unsigned char *p, int len, struct directory_entry *old)
+static void parse_dirent(suunto_eonsteel_device_t *eon, int nr, const unsigned char *p, int len, struct directory_list *list)
 {
 	while (len > 8) {
 		unsigned int type = array_uint32_le(p);
 		unsigned int namelen = array_uint32_le(p+4);
 		const unsigned char *name = p+8;
-		struct directory_entry *entry;
 
 		if (namelen + 8 + 1 > len || name[namelen] != 0) {
 			ERROR(eon->base.context, "corrupt dirent entry: len=%d namelen=%d name='%s'", len, namelen, name);
@@ -657,24 +808,20 @@ static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int n
 
 		p += 8 + namelen + 1;
 		len -= 8 + namelen + 1;
-		entry = alloc_dirent(type, namelen, (const char *) name);
-		if (!entry) {
+		if (add_dirent(list, type, namelen, (const char *) name) < 0) {
 			ERROR(eon->base.context, "out of memory");
 			break;
 		}
-		old = add_dirent(entry, old);
 	}
-	return old;
 }
 
-static int get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
+static int get_file_list(suunto_eonsteel_device_t *eon, struct directory_list *list)
 {
-	struct directory_entry *de = NULL;
 	unsigned char cmd[64];
 	unsigned char result[2048];
 	int rc, cmdlen;
 
-	*res = NULL;
+	memset(list, 0, sizeof(*list));
 	put_le32(0, cmd);
 	memcpy(cmd + 4, dive_directory, sizeof(dive_directory));
 	cmdlen = 4 + sizeof(dive_directory);
@@ -695,17 +842,19 @@ static int get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry *
 			sizeof(result), result);
 		if (rc < 0) {
 			ERROR(eon->base.context, "readdir failed");
+			file_list_free(list);
 			return -1;
 		}
 		if (rc < 8) {
 			ERROR(eon->base.context, "short readdir result");
+			file_list_free(list);
 			return -1;
 		}
 		nr = array_uint32_le(result);
 		last = array_uint32_le(result+4);
 		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "dir packet", result, 8);
 
-		de = parse_dirent(eon, nr, result+8, rc-8, de);
+		parse_dirent(eon, nr, result+8, rc-8, list);
 		if (last)
 			break;
 	}
@@ -717,7 +866,12 @@ static int get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry *
 		ERROR(eon->base.context, "dir close failed");
 	}
 
-	*res = de;
+	// The arena doesn't move anymore.
+	for (unsigned int i = 0; i < list->count; ++i)
+		list->entries[i].name = list->names + list->entries[i].offset;
+
+	qsort(list->entries, list->count, sizeof(struct directory_entry), compare_dirent);
+
 	return 0;
 }
 
@@ -761,15 +915,18 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, const char
 	eon->seq = INIT_SEQ;
 	memset (eon->version, 0, sizeof (eon->version));
 	memset (eon->fingerprint, 0, sizeof (eon->fingerprint));
+	eon->rxlen = eon->rxoff = 0;
 
-	dc_custom_io_t *io = _dc_context_custom_io(eon->base.context);
-	if (io && io->packet_open)
+	// The custom I/O is bound to the device when it is opened, such
+	// that the context can be shared with other downloads.
+	dc_custom_io_t *io = _dc_context_custom_io(context);
+	if (io && io->packet_open) {
 		status = io->packet_open(io, context, name);
-	else {
+	} else {
 		/* We really need some way to specify USB ID's in the descriptor */
 		unsigned int vendor_id = 0x1493;
 		unsigned int device_id = model ? 0x0033 : 0x0030;
-		status = dc_usbhid_custom_io(context, vendor_id, device_id);
+		status = dc_usbhid_custom_io(&io, context, vendor_id, device_id);
 	}
 
 	if (status != DC_STATUS_SUCCESS) {
@@ -777,6 +934,8 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	eon->io = io;
+
 	if (initialize_eonsteel(eon) < 0) {
 		ERROR(context, "unable to initialize device");
 		status = DC_STATUS_IO;
@@ -790,20 +949,10 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, const char
 error_close:
 	suunto_eonsteel_device_close((dc_device_t *) eon);
 error_free:
-	free(eon);
+	dc_device_deallocate((dc_device_t *) eon);
 	return status;
 }
 
-static int count_dir_entries(struct directory_entry *de)
-{
-	int count = 0;
-	while (de) {
-		count++;
-		de = de->next;
-	}
-	return count;
-}
-
 static dc_status_t
 suunto_eonsteel_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -820,15 +969,72 @@ suunto_eonsteel_device_set_fingerprint (dc_device_t *abstract, const unsigned ch
 	return DC_STATUS_SUCCESS;
 }
 
+/*
+ * The dive time from the file name is all the directory tells about a
+ * dive, but that is enough to list the new dives before reading them.
+ */
+static int suunto_eonsteel_device_logbook(suunto_eonsteel_device_t *eon, const struct directory_list *list, unsigned int count)
+{
+	dc_device_t *abstract = (dc_device_t *) eon;
+	dc_logbook_entry_t *entries;
+	unsigned char *fingerprints;
+	unsigned int n = 0;
+
+	if (!count)
+		return 0;
+
+	entries = (dc_logbook_entry_t *) dc_context_alloc(abstract->context, count * sizeof(dc_logbook_entry_t));
+	fingerprints = (unsigned char *) dc_context_alloc(abstract->context, count * sizeof(eon->fingerprint));
+	if (!entries || !fingerprints) {
+		ERROR(abstract->context, "Failed to allocate memory.");
+		dc_context_release(abstract->context, fingerprints);
+		dc_context_release(abstract->context, entries);
+		return -1;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const struct directory_entry *de = list->entries + i;
+		unsigned char *fp = fingerprints + n * sizeof(eon->fingerprint);
+		dc_logbook_entry_t *entry = entries + n;
+
+		if (de->type != DIRTYPE_FILE || !de->hastime)
+			continue;
+
+		put_le32(de->time, fp);
+		if (device_is_known(abstract, fp, sizeof(eon->fingerprint)))
+			continue;
+
+		memset(entry, 0, sizeof(*entry));
+		entry->fingerprint = fp;
+		entry->fsize = sizeof(eon->fingerprint);
+		if (dc_datetime_gmtime(&entry->datetime, de->time)) {
+			entry->datetime.timezone = DC_TIMEZONE_NONE;
+			entry->flags |= DC_LOGBOOK_DATETIME;
+		}
+		n++;
+	}
+
+	if (n) {
+		dc_event_logbook_t event;
+		event.entries = entries;
+		event.count = n;
+		device_event_emit(abstract, DC_EVENT_LOGBOOK, &event);
+	}
+
+	dc_context_release(abstract->context, fingerprints);
+	dc_context_release(abstract->context, entries);
+	return 0;
+}
+
 static dc_status_t
 suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
 	int skip = 0, rc;
-	struct directory_entry *de;
+	struct directory_list list;
+	unsigned int count;
 	suunto_eonsteel_device_t *eon = (suunto_eonsteel_device_t *) abstract;
 	dc_buffer_t *file;
 	char pathname[64];
-	unsigned int time;
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 
 	// Emit a device info event.
@@ -838,26 +1044,43 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 	devinfo.serial = array_convert_str2num(eon->version + 0x10, 16);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	if (get_file_list(eon, &de) < 0)
+	device_set_phase(abstract, DC_PHASE_LOGBOOK);
+	if (get_file_list(eon, &list) < 0)
 		return DC_STATUS_IO;
 
-	if (de == NULL) {
+	if (list.count == 0) {
+		file_list_free (&list);
 		return DC_STATUS_SUCCESS;
 	}
 
-	file = dc_buffer_new (16384);
+	// The fingerprint is the dive time from the file name, so there
+	// is no need to read any file to find the cut-off.
+	count = find_cutoff(&list, array_uint32_le(eon->fingerprint));
+
+	file = dc_buffer_new2 (abstract->context, 16384);
 	if (file == NULL) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
-		file_list_free (de);
+		file_list_free (&list);
 		return DC_STATUS_NOMEMORY;
 	}
-	progress.maximum = count_dir_entries(de);
+	progress.maximum = count;
 	progress.current = 0;
 	device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
 
-	while (de) {
+	// Report the new dives from the directory.
+	if (suunto_eonsteel_device_logbook(eon, &list, count) < 0) {
+		dc_buffer_free(file);
+		file_list_free(&list);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Ask for a fast link during the dive downloads.
+	dc_custom_io_packet_set_params(eon->base.context, eon->io, DC_LINK_BULK);
+
+	device_set_phase(abstract, DC_PHASE_PROFILE);
+	for (unsigned int i = 0; i < count; ++i) {
 		int len;
-		struct directory_entry *next = de->next;
+		const struct directory_entry *de = list.entries + i;
 		unsigned char buf[4];
 		const unsigned char *data = NULL;
 		unsigned int size = 0;
@@ -872,40 +1095,36 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 		case DIRTYPE_FILE:
 			if (skip)
 				break;
-			if (sscanf(de->name, "%x.LOG", &time) != 1)
+			if (!de->hastime)
 				break;
 			len = snprintf(pathname, sizeof(pathname), "%s/%s", dive_directory, de->name);
 			if (len >= sizeof(pathname))
 				break;
 
-			// Reset the membuffer, put the 4-byte length at the head.
-			dc_buffer_clear(file);
-			put_le32(time, buf);
-			dc_buffer_append(file, buf, 4);
+			put_le32(de->time, buf);
+			if (device_is_known (abstract, buf, sizeof (eon->fingerprint)))
+				break;
 
-			// Then read the filename into the rest of the buffer
-			rc = read_file(eon, pathname, file);
+			// Reset the membuffer, then read the file into it, with
+			// the 4-byte time at the head. Without a dive callback,
+			// the dive is only reported with the events.
+			dc_buffer_clear(file);
+			rc = read_file(eon, pathname, buf, 4, callback ? file : NULL);
 			if (rc < 0)
 				break;
 
 			data = dc_buffer_get_data(file);
 			size = dc_buffer_get_size(file);
 
-			if (memcmp (data, eon->fingerprint, sizeof (eon->fingerprint)) == 0) {
-				skip = 1;
-				break;
-			}
-
 			if (callback && !callback(data, size, data, sizeof(eon->fingerprint), userdata))
 				skip = 1;
 		}
 		progress.current++;
 		device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
-
-		free(de);
-		de = next;
 	}
+	dc_custom_io_packet_set_params(eon->base.context, eon->io, 0);
 	dc_buffer_free(file);
+	file_list_free(&list);
 
 	return device_is_cancelled(abstract) ? DC_STATUS_CANCELLED : DC_STATUS_SUCCESS;
 }
@@ -950,7 +1169,8 @@ static dc_status_t suunto_eonsteel_device_timesync(dc_device_t *abstract, const
 static dc_status_t
 suunto_eonsteel_device_close(dc_device_t *abstract)
 {
-	dc_custom_io_t *io = _dc_context_custom_io(abstract->context);
+	suunto_eonsteel_device_t *eon = (suunto_eonsteel_device_t *) abstract;
+	dc_custom_io_t *io = eon->io;
 
 	return io->packet_close(io);
 }
@@ -24,12 +24,10 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <math.h>
-#include <stdarg.h>
 
 /* Wow. MSC is truly crap */
 #ifdef _MSC_VER
 #define snprintf _snprintf
-#define vsnprintf _vsnprintf
 #endif
 
 #include "suunto_eonsteel.h"
@@ -37,6 +35,7 @@
 #include "parser-private.h"
 #include "array.h"
 #include "platform.h"
+#include "thread.h"
 
 #define C_ARRAY_SIZE(a) (sizeof(a) / sizeof(*(a)))
 
@@ -73,17 +72,91 @@ enum eon_sample {
 
 struct type_desc {
 	const char *desc, *format, *mod;
+	// Interned enumeration strings, indexed by value.
+	const char *const *enums;
+	unsigned int nenums;
 	unsigned int size;
 	enum eon_sample type[EON_MAX_GROUP];
+	// Compiled sample decoder: the number of leading fields with a
+	// known sample type, their sizes and the total size.
+	unsigned int nfields, used;
+	unsigned char width[EON_MAX_GROUP];
 };
 
 #define MAXTYPE 512
+
+// The entries of the type table are only valid when their bit is set,
+// such that a new dive only has to clear the bits.
+#define TYPE_VALID(eon,type) ((type) < MAXTYPE && ((eon)->valid[(type) / 32] & (1u << ((type) % 32))) && (eon)->type_desc[(type)].desc)
 #define MAXGASES 16
 #define MAXSTRINGS 32
+#define SZ_STRING  32
+
+#define DESC_HASHSIZE 256
+#define DESC_MAXENTRIES 4096
+
+enum desc_group_end {
+	GROUP_OK = 0,
+	GROUP_NOPARSE,
+	GROUP_BADSEP,
+};
+
+/*
+ * A compiled type descriptor. The entries are keyed by the raw
+ * descriptor text, and never change once they are in a cache, so
+ * the strings can be shared by all parsers.
+ */
+struct desc_entry {
+	struct desc_entry *next;
+	unsigned int hash;
+	unsigned int length;
+	const char *text;
+	const char *desc, *format, *mod;
+	// Base types.
+	unsigned int size;
+	enum eon_sample type;
+	// Group types.
+	unsigned int isgroup;
+	unsigned int ngroup;
+	unsigned short group[EON_MAX_GROUP];
+	enum desc_group_end groupend;
+	// Enumerations.
+	const char **enums;
+	unsigned int nenums;
+};
+
+/*
+ * A string field. The text values point into the dive data, and the
+ * numeric values are only formatted when the field is requested.
+ */
+enum eon_format {
+	FORMAT_TEXT = 0,
+	FORMAT_PERCENT,
+	FORMAT_ADJUSTMENT,
+	FORMAT_TIME,
+};
+
+struct eon_string {
+	const char *desc;
+	const char *value;
+	enum eon_format format;
+	int args[2];
+};
+
+struct suunto_eonsteel_cache_t {
+	dc_mutex_t *mutex;
+	unsigned int count;
+	struct desc_entry *table[DESC_HASHSIZE];
+};
 
 typedef struct suunto_eonsteel_parser_t {
 	dc_parser_t base;
 	struct type_desc type_desc[MAXTYPE];
+	unsigned int valid[MAXTYPE / 32];
+	// Descriptor cache, if the context has none.
+	suunto_eonsteel_cache_t *descriptors;
+	// Incremental parsing state.
+	struct eon_stream *stream;
 	// field cache
 	struct {
 		unsigned int initialized;
@@ -98,11 +171,12 @@ typedef struct suunto_eonsteel_parser_t {
 		double lowsetpoint;
 		double highsetpoint;
 		double customsetpoint;
-		dc_field_string_t strings[MAXSTRINGS];
+		struct eon_string strings[MAXSTRINGS];
 		dc_tankinfo_t tankinfo[MAXGASES];
 		double tanksize[MAXGASES];
 		double tankworkingpressure[MAXGASES];
 	} cache;
+	char values[MAXSTRINGS][SZ_STRING];
 } suunto_eonsteel_parser_t;
 
 typedef int (*eon_data_cb_t)(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user);
@@ -182,6 +256,59 @@ static const char *desc_type_name(enum eon_sample type)
 	return "Unknown";
 }
 
+static unsigned int sample_type_width(enum eon_sample type)
+{
+	switch (type) {
+	case ES_gasnr:
+	case ES_state:
+	case ES_state_active:
+	case ES_notify:
+	case ES_notify_active:
+	case ES_warning:
+	case ES_warning_active:
+	case ES_alarm:
+	case ES_alarm_active:
+	case ES_setpoint_type:
+	case ES_setpoint_automatic:
+		return 1;
+	case ES_dtime:
+	case ES_depth:
+	case ES_temp:
+	case ES_ndl:
+	case ES_ceiling:
+	case ES_tts:
+	case ES_heading:
+	case ES_abspressure:
+	case ES_gastime:
+	case ES_ventilation:
+	case ES_pressure:
+	case ES_bookmark:
+	case ES_gasswitch:
+		return 2;
+	case ES_setpoint_po2:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * Precompute the layout of a sample record, such that decoding a
+ * record needs no more than a single bounds check.
+ */
+static void compile_sample_decoder(struct type_desc *desc)
+{
+	desc->nfields = 0;
+	desc->used = 0;
+	while (desc->nfields < EON_MAX_GROUP) {
+		unsigned int width = sample_type_width(desc->type[desc->nfields]);
+		if (!width)
+			break;
+		desc->width[desc->nfields++] = width;
+		desc->used += width;
+	}
+}
+
 static int lookup_descriptor_size(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
 {
 	const char *format = desc->format;
@@ -206,56 +333,84 @@ static int lookup_descriptor_size(suunto_eonsteel_parser_t *eon, struct type_des
 	return 0;
 }
 
-static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc *desc, const struct desc_entry *entry)
 {
-	int subtype = 0;
-	const char *grp = desc->desc;
+	unsigned int subtype;
 
-	for (;;) {
-		struct type_desc *base;
-		char *end;
-		long index;
+	for (subtype = 0; subtype < entry->ngroup; subtype++) {
+		long index = entry->group[subtype];
 
-		index = strtol(grp, &end, 10);
-		if (index < 0 || index >= MAXTYPE || end == grp) {
-			ERROR(eon->base.context, "Group type descriptor '%s' does not parse", desc->desc);
-			break;
-		}
-		base = eon->type_desc + index;
-		if (!base->desc) {
+		if (!TYPE_VALID(eon, index)) {
 			ERROR(eon->base.context, "Group type descriptor '%s' has undescribed index %ld", desc->desc, index);
-			break;
+			return -1;
 		}
+
+		struct type_desc *base = eon->type_desc + index;
 		if (!base->size) {
 			ERROR(eon->base.context, "Group type descriptor '%s' uses unsized sub-entry '%s'", desc->desc, base->desc);
-			break;
+			return -1;
 		}
 		if (!base->type[0]) {
 			ERROR(eon->base.context, "Group type descriptor '%s' has non-enumerated sub-entry '%s'", desc->desc, base->desc);
-			break;
+			return -1;
 		}
 		if (base->type[1]) {
 			ERROR(eon->base.context, "Group type descriptor '%s' has a recursive group sub-entry '%s'", desc->desc, base->desc);
-			break;
+			return -1;
 		}
 		if (subtype >= EON_MAX_GROUP-1) {
 			ERROR(eon->base.context, "Group type descriptor '%s' has too many sub-entries", desc->desc);
-			break;
+			return -1;
 		}
 		desc->size += base->size;
-		desc->type[subtype++] = base->type[0];
-		switch (*end) {
-		case 0:
-			return 0;
-		case ',':
-			grp = end+1;
-			continue;
-		default:
-			ERROR(eon->base.context, "Group type descriptor '%s' has unparseable index %ld", desc->desc, index);
-			return -1;
+		desc->type[subtype] = base->type[0];
+	}
+
+	switch (entry->groupend) {
+	case GROUP_OK:
+		return 0;
+	case GROUP_NOPARSE:
+		ERROR(eon->base.context, "Group type descriptor '%s' does not parse", desc->desc);
+		return -1;
+	default:
+		ERROR(eon->base.context, "Group type descriptor '%s' has unparseable index %ld", desc->desc, (long) entry->group[entry->ngroup-1]);
+		return -1;
+	}
+}
+
+/*
+ * Split a group descriptor into its list of indices. Resolving the
+ * indices depends on the other descriptors of the dive, so that part
+ * is left to fill_in_group_details.
+ */
+static void compile_group(struct desc_entry *entry)
+{
+	const char *grp = entry->desc;
+
+	entry->groupend = GROUP_NOPARSE;
+	while (entry->ngroup < EON_MAX_GROUP) {
+		char *end;
+		long index;
+
+		index = strtol(grp, &end, 10);
+		if (index < 0 || index >= MAXTYPE || end == grp)
+			break;
+
+		entry->group[entry->ngroup++] = index;
+		if (*end == 0) {
+			entry->groupend = GROUP_OK;
+			break;
+		}
+		if (*end != ',') {
+			entry->groupend = GROUP_BADSEP;
+			break;
 		}
+		grp = end+1;
 	}
-	return -1;
+
+	// Too many sub-entries are reported when the group is resolved.
+	if (entry->ngroup == EON_MAX_GROUP)
+		entry->groupend = GROUP_OK;
 }
 
 /*
@@ -267,39 +422,177 @@ static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc
  * which all start with "sml.DeviceLog.Samples" (for the
  * base types) or are "GRP" types that are a group of said
  * types and are a set of numbers.
+ *
+ * The compiled descriptors are shared between all parsers
+ * of the same context, since they rarely change between
+ * the dives of a firmware version.
  */
-static int fill_in_desc_details(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+static int fill_in_desc_details(suunto_eonsteel_parser_t *eon, struct type_desc *desc, const struct desc_entry *entry)
 {
+	int rc = 0;
+
 	if (!desc->desc)
 		return 0;
 
-	if (isdigit(desc->desc[0]))
-		return fill_in_group_details(eon, desc);
+	if (entry->isgroup) {
+		rc = fill_in_group_details(eon, desc, entry);
+	} else {
+		desc->size = entry->size;
+		desc->type[0] = entry->type;
+	}
 
-	desc->size = lookup_descriptor_size(eon, desc);
-	desc->type[0] = lookup_descriptor_type(eon, desc);
+	compile_sample_decoder(desc);
+	return rc;
+}
+
+/*
+ * Get the next string from an enumeration.
+ *
+ * Enumerations have the enum values in the "format" string,
+ * and all start with "enum:" followed by a comma-separated list
+ * of enumeration values and strings. Example:
+ *
+ * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
+ */
+static int enum_next(const char **pstr, unsigned int *value, const char **pbegin, const char **pend)
+{
+	const char *str = *pstr;
+	unsigned char c;
+
+	while ((c = *str) != 0) {
+		unsigned char n;
+		const char *begin, *end;
+
+		str++;
+		if (!isdigit(c))
+			continue;
+		n = c - '0';
+
+		// We only handle one or two digits
+		if (isdigit(*str)) {
+			n = n*10 + *str - '0';
+			str++;
+		}
+
+		begin = end = str;
+		while ((c = *str) != 0) {
+			str++;
+			if (c == ',')
+				break;
+			end = str;
+		}
+
+		// Verify that it has the 'n=string' format and skip the equals sign
+		if (*begin != '=')
+			continue;
+
+		*pstr = str;
+		*value = n;
+		*pbegin = begin + 1;
+		*pend = end;
+		return 1;
+	}
+
+	*pstr = str;
 	return 0;
 }
 
-static void
-desc_free (struct type_desc desc[], unsigned int count)
+/*
+ * Intern the strings of an enumeration, such that a lookup is just an
+ * index into a table. The first string of a value wins. The table and
+ * the strings share a single allocation, which lives as long as the
+ * entry.
+ */
+static int desc_compile_enum(suunto_eonsteel_parser_t *eon, struct desc_entry *entry)
 {
-	for (unsigned int i = 0; i < count; ++i) {
-		free((void *)desc[i].desc);
-		free((void *)desc[i].format);
-		free((void *)desc[i].mod);
+	const char *format = entry->format;
+	const char *str, *begin, *end;
+	unsigned int value, count = 0;
+	char *p;
+
+	if (!format || strncmp(format, "enum:", 5))
+		return 0;
+	format += 5;
+
+	str = format;
+	while (enum_next(&str, &value, &begin, &end)) {
+		if (value >= count)
+			count = value + 1;
 	}
+	if (!count)
+		return 0;
+
+	// Every string is at least two characters shorter in the format.
+	entry->enums = (const char **) malloc(count * sizeof(char *) + strlen(format) + 1);
+	if (!entry->enums) {
+		ERROR(eon->base.context, "out of memory");
+		return -1;
+	}
+	memset(entry->enums, 0, count * sizeof(char *));
+	entry->nenums = count;
+
+	p = (char *) (entry->enums + count);
+	str = format;
+	while (enum_next(&str, &value, &begin, &end)) {
+		if (entry->enums[value])
+			continue;
+		memcpy(p, begin, end - begin);
+		p[end - begin] = 0;
+		entry->enums[value] = p;
+		p += end - begin + 1;
+	}
+
+	return 0;
 }
 
-static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+static void desc_free(struct desc_entry *entry)
+{
+	if (entry == NULL)
+		return;
+
+	free(entry->enums);
+	free(entry);
+}
+
+static unsigned int desc_hash(const char *text, unsigned int length)
 {
+	// FNV-1a hash.
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < length; ++i) {
+		hash ^= (unsigned char) text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct desc_entry *desc_compile(suunto_eonsteel_parser_t *eon, const char *name, unsigned int length, unsigned int hash)
+{
+	struct desc_entry *entry;
 	struct type_desc desc;
 	const char *next;
+	char *p;
 
+	// The entry, the descriptor text and the (shorter) strings
+	// are stored in a single allocation.
+	entry = (struct desc_entry *) malloc(sizeof(*entry) + 2 * length + 2);
+	if (!entry) {
+		ERROR(eon->base.context, "out of memory");
+		return NULL;
+	}
+
+	memset(entry, 0, sizeof(*entry));
 	memset(&desc, 0, sizeof(desc));
+	p = (char *) (entry + 1);
+	memcpy(p, name, length);
+	p[length] = 0;
+	entry->hash = hash;
+	entry->length = length;
+	entry->text = p;
+	name = p;
+	p += length + 1;
+
 	do {
 		int len;
-		char *p;
 
 		next = strchr(name, '\n');
 		if (next) {
@@ -313,13 +606,8 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 
 		if (len < 5 || name[0] != '<' || name[4] != '>') {
 			ERROR(eon->base.context, "Unexpected type description: %.*s", len, name);
-			return -1;
-		}
-		p = (char *) malloc(len-4);
-		if (!p) {
-			ERROR(eon->base.context, "out of memory");
-			desc_free(&desc, 1);
-			return -1;
+			free(entry);
+			return NULL;
 		}
 		memcpy(p, name+5, len-5);
 		p[len-5] = 0;
@@ -338,26 +626,185 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 			break;
 		default:
 			ERROR(eon->base.context, "Unknown type descriptor: %.*s", len, name);
-			desc_free(&desc, 1);
-			free(p);
-			return -1;
+			free(entry);
+			return NULL;
 		}
+		p += len-4;
 	} while ((name = next) != NULL);
 
+	entry->desc = desc.desc;
+	entry->format = desc.format;
+	entry->mod = desc.mod;
+
+	if (desc_compile_enum(eon, entry) < 0) {
+		free(entry);
+		return NULL;
+	}
+
+	if (desc.desc) {
+		if (isdigit(desc.desc[0])) {
+			entry->isgroup = 1;
+			compile_group(entry);
+		} else {
+			entry->size = lookup_descriptor_size(eon, &desc);
+			entry->type = lookup_descriptor_type(eon, &desc);
+		}
+	}
+
+	return entry;
+}
+
+dc_status_t
+suunto_eonsteel_cache_new(suunto_eonsteel_cache_t **out)
+{
+	suunto_eonsteel_cache_t *cache = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	cache = (suunto_eonsteel_cache_t *) malloc(sizeof(*cache));
+	if (cache == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Without thread support, the mutex remains NULL.
+	cache->mutex = NULL;
+	dc_mutex_new(&cache->mutex);
+
+	cache->count = 0;
+	memset(cache->table, 0, sizeof(cache->table));
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+suunto_eonsteel_cache_free(suunto_eonsteel_cache_t *cache)
+{
+	if (cache == NULL)
+		return;
+
+	for (unsigned int i = 0; i < DESC_HASHSIZE; ++i) {
+		struct desc_entry *entry = cache->table[i];
+		while (entry) {
+			struct desc_entry *next = entry->next;
+			desc_free(entry);
+			entry = next;
+		}
+	}
+
+	dc_mutex_free(cache->mutex);
+	free(cache);
+}
+
+static struct desc_entry *desc_lookup(suunto_eonsteel_cache_t *cache, const char *text, unsigned int length, unsigned int hash)
+{
+	struct desc_entry *entry = cache->table[hash % DESC_HASHSIZE];
+
+	while (entry) {
+		if (entry->hash == hash && entry->length == length && !memcmp(entry->text, text, length))
+			break;
+		entry = entry->next;
+	}
+
+	return entry;
+}
+
+/*
+ * Insert the entry, unless the cache is full or another parser was
+ * faster. Returns the entry which is now in the cache, or NULL.
+ */
+static struct desc_entry *desc_insert(suunto_eonsteel_cache_t *cache, struct desc_entry *entry, unsigned int limit)
+{
+	struct desc_entry *existing = desc_lookup(cache, entry->text, entry->length, entry->hash);
+	if (existing)
+		return existing;
+
+	if (limit && cache->count >= limit)
+		return NULL;
+
+	entry->next = cache->table[entry->hash % DESC_HASHSIZE];
+	cache->table[entry->hash % DESC_HASHSIZE] = entry;
+	cache->count++;
+
+	return entry;
+}
+
+static const struct desc_entry *desc_intern(suunto_eonsteel_parser_t *eon, const char *name, unsigned int length)
+{
+	suunto_eonsteel_cache_t *shared = dc_context_get_eonsteel_cache(eon->base.context);
+	unsigned int hash = desc_hash(name, length);
+	struct desc_entry *entry = NULL, *result = NULL;
+
+	// Try the context cache first, and the private one afterwards.
+	if (shared) {
+		dc_mutex_lock(shared->mutex);
+		result = desc_lookup(shared, name, length, hash);
+		dc_mutex_unlock(shared->mutex);
+		if (result)
+			return result;
+	}
+
+	if (eon->descriptors) {
+		result = desc_lookup(eon->descriptors, name, length, hash);
+		if (result)
+			return result;
+	}
+
+	entry = desc_compile(eon, name, length, hash);
+	if (!entry)
+		return NULL;
+
+	if (shared) {
+		dc_mutex_lock(shared->mutex);
+		result = desc_insert(shared, entry, DESC_MAXENTRIES);
+		dc_mutex_unlock(shared->mutex);
+		if (result) {
+			if (result != entry)
+				desc_free(entry);
+			return result;
+		}
+	}
+
+	// The context cache is not available or full.
+	if (!eon->descriptors && suunto_eonsteel_cache_new(&eon->descriptors) != DC_STATUS_SUCCESS) {
+		ERROR(eon->base.context, "out of memory");
+		desc_free(entry);
+		return NULL;
+	}
+
+	return desc_insert(eon->descriptors, entry, 0);
+}
+
+static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const char *name, int namelen)
+{
+	const struct desc_entry *entry;
+	struct type_desc desc;
+
+	entry = desc_intern(eon, name, strlen(name));
+	if (!entry)
+		return -1;
+
+	memset(&desc, 0, sizeof(desc));
+	desc.desc = entry->desc;
+	desc.format = entry->format;
+	desc.mod = entry->mod;
+	desc.enums = entry->enums;
+	desc.nenums = entry->nenums;
+
 	if (type >= MAXTYPE) {
 		ERROR(eon->base.context, "Type out of range (%04x: '%s' '%s' '%s')",
 			type,
 			desc.desc ? desc.desc : "",
 			desc.format ? desc.format : "",
 			desc.mod ? desc.mod : "");
-		desc_free(&desc, 1);
 		return -1;
 	}
 
-	fill_in_desc_details(eon, &desc);
+	fill_in_desc_details(eon, &desc, entry);
 
-	desc_free(eon->type_desc + type, 1);
 	eon->type_desc[type] = desc;
+	eon->valid[type / 32] |= 1u << (type % 32);
 	return 0;
 }
 
@@ -391,6 +838,9 @@ static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p,
 		return -1;
 	}
 
+	if (dc_parser_work(&eon->base, 0, (unsigned int) textlen, 1) != DC_STATUS_SUCCESS)
+		return -1;
+
 	record_type(eon, type, (const char *) name, textlen-3);
 
 	end = data;
@@ -413,7 +863,10 @@ static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p,
 			end += 4;
 		}
 
-		if (type >= MAXTYPE || !eon->type_desc[type].desc) {
+		if (dc_parser_work(&eon->base, 1, len, 0) != DC_STATUS_SUCCESS)
+			return -1;
+
+		if (!TYPE_VALID(eon, type)) {
 			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "last", last, 16);
 			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "this", begin, 16);
 		} else {
@@ -600,67 +1053,15 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
 }
 
 /*
- * Look up the string from an enumeration.
- *
- * Enumerations have the enum values in the "format" string,
- * and all start with "enum:" followed by a comma-separated list
- * of enumeration values and strings. Example:
- *
- * "enum:0=NoFly Time,1=Depth,2=Surface Time,3=..."
+ * Look up the string from an enumeration. The strings are interned in
+ * the descriptor cache, and remain valid as long as the parser.
  */
 static const char *lookup_enum(const struct type_desc *desc, unsigned char value)
 {
-	const char *str = desc->format;
-	unsigned char c;
-
-	if (!str)
-		return NULL;
-	if (strncmp(str, "enum:", 5))
+	if (value >= desc->nenums)
 		return NULL;
-	str += 5;
-
-	while ((c = *str) != 0) {
-		unsigned char n;
-		const char *begin, *end;
-		char *ret;
-
-		str++;
-		if (!isdigit(c))
-			continue;
-		n = c - '0';
-
-		// We only handle one or two digits
-		if (isdigit(*str)) {
-			n = n*10 + *str - '0';
-			str++;
-		}
-
-		begin = end = str;
-		while ((c = *str) != 0) {
-			str++;
-			if (c == ',')
-				break;
-			end = str;
-		}
 
-		// Verify that it has the 'n=string' format and skip the equals sign
-		if (*begin != '=')
-			continue;
-		begin++;
-
-		// Is it the value we're looking for?
-		if (n != value)
-			continue;
-
-		ret = (char *)malloc(end - begin + 1);
-		if (!ret)
-			break;
-
-		memcpy(ret, begin, end-begin);
-		ret[end-begin] = 0;
-		return ret;
-	}
-	return NULL;
+	return desc->enums[value];
 }
 
 /*
@@ -669,7 +1070,10 @@ static const char *lookup_enum(const struct type_desc *desc, unsigned char value
  */
 static void sample_event_state_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->state_type = lookup_enum(desc, type);
+	// The event name is only needed for wanted events.
+	info->state_type = NULL;
+	if (SAMPLE_WANTED(&info->eon->base, DC_SAMPLE_EVENT))
+		info->state_type = lookup_enum(desc, type);
 }
 
 static void sample_event_state_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -691,7 +1095,9 @@ static void sample_event_state_value(const struct type_desc *desc, struct sample
 
 static void sample_event_notify_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->notify_type = lookup_enum(desc, type);
+	info->notify_type = NULL;
+	if (SAMPLE_WANTED(&info->eon->base, DC_SAMPLE_EVENT))
+		info->notify_type = lookup_enum(desc, type);
 }
 
 static void sample_event_notify_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -714,7 +1120,9 @@ static void sample_event_notify_value(const struct type_desc *desc, struct sampl
 
 static void sample_event_warning_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->warning_type = lookup_enum(desc, type);
+	info->warning_type = NULL;
+	if (SAMPLE_WANTED(&info->eon->base, DC_SAMPLE_EVENT))
+		info->warning_type = lookup_enum(desc, type);
 }
 
 static void sample_event_warning_value(const struct type_desc *desc, struct sample_data *info, unsigned char value)
@@ -736,7 +1144,9 @@ static void sample_event_warning_value(const struct type_desc *desc, struct samp
 
 static void sample_event_alarm_type(const struct type_desc *desc, struct sample_data *info, unsigned char type)
 {
-	info->alarm_type = lookup_enum(desc, type);
+	info->alarm_type = NULL;
+	if (SAMPLE_WANTED(&info->eon->base, DC_SAMPLE_EVENT))
+		info->alarm_type = lookup_enum(desc, type);
 }
 
 
@@ -776,12 +1186,10 @@ static void sample_setpoint_type(const struct type_desc *desc, struct sample_dat
 		sample.ppo2 = info->eon->cache.customsetpoint;
 	else {
 		DEBUG(info->eon->base.context, "sample_setpoint_type(%u) unknown type '%s'", value, type);
-		free((void *)type);
 		return;
 	}
 
 	if (info->callback) info->callback(DC_SAMPLE_SETPOINT, sample, info->userdata);
-	free((void *)type);
 }
 
 // uint32
@@ -797,111 +1205,111 @@ static void sample_setpoint_automatic(struct sample_data *info, unsigned char va
 	DEBUG(info->eon->base.context, "sample_setpoint_automatic(%u)", value);
 }
 
-static int handle_sample_type(const struct type_desc *desc, struct sample_data *info, enum eon_sample type, const unsigned char *data)
+static void handle_sample_type(const struct type_desc *desc, struct sample_data *info, enum eon_sample type, const unsigned char *data)
 {
 	switch (type) {
 	case ES_dtime:
 		sample_time(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_depth:
 		sample_depth(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_temp:
 		sample_temp(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_ndl:
 		sample_ndl(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_ceiling:
 		sample_ceiling(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_tts:
 		sample_tts(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_heading:
 		sample_heading(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_abspressure:
 		sample_abspressure(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_gastime:
 		sample_gastime(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_ventilation:
 		sample_ventilation(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_gasnr:
 		sample_gasnr(info, *data);
-		return 1;
+		break;
 
 	case ES_pressure:
 		sample_pressure(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_state:
 		sample_event_state_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_state_active:
 		sample_event_state_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_notify:
 		sample_event_notify_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_notify_active:
 		sample_event_notify_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_warning:
 		sample_event_warning_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_warning_active:
 		sample_event_warning_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_alarm:
 		sample_event_alarm_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_alarm_active:
 		sample_event_alarm_value(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_bookmark:
 		sample_bookmark_event(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_gasswitch:
 		sample_gas_switch_event(info, array_uint16_le(data));
-		return 2;
+		break;
 
 	case ES_setpoint_type:
 		sample_setpoint_type(desc, info, data[0]);
-		return 1;
+		break;
 
 	case ES_setpoint_po2:
 		sample_setpoint_po2(info, array_uint32_le(data));
-		return 4;
+		break;
 
 	case ES_setpoint_automatic:	// bool
 		sample_setpoint_automatic(info, data[0]);
-		return 1;
+		break;
 
 	default:
-		return 0;
+		break;
 	}
 }
 
@@ -918,19 +1326,27 @@ static int traverse_samples(unsigned short type, const struct type_desc *desc, c
 	info->tts = 0;
 	info->ceiling = 0.0;
 
-	for (i = 0; i < EON_MAX_GROUP; i++) {
-		enum eon_sample type = desc->type[i];
-		int bytes = handle_sample_type(desc, info, type, data);
-
-		if (!bytes)
-			break;
-		if (bytes > len) {
-			ERROR(eon->base.context, "Wanted %d bytes of data, only had %d bytes ('%s' idx %d)", bytes, len, desc->desc, i);
-			break;
+	if (desc->used <= len) {
+		// Fast path: all fields are present.
+		for (i = 0; i < desc->nfields; i++) {
+			handle_sample_type(desc, info, desc->type[i], data);
+			data += desc->width[i];
+		}
+		used = desc->used;
+		len -= used;
+	} else {
+		for (i = 0; i < desc->nfields; i++) {
+			int bytes = desc->width[i];
+
+			if (bytes > len) {
+				ERROR(eon->base.context, "Wanted %d bytes of data, only had %d bytes ('%s' idx %d)", bytes, len, desc->desc, i);
+				break;
+			}
+			handle_sample_type(desc, info, desc->type[i], data);
+			data += bytes;
+			len -= bytes;
+			used += bytes;
 		}
-		data += bytes;
-		len -= bytes;
-		used += bytes;
 	}
 
 	if (info->ndl < 0 && (info->tts || info->ceiling)) {
@@ -954,19 +1370,230 @@ suunto_eonsteel_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
 	struct sample_data data = { eon, callback, userdata, 0 };
 
-	traverse_data(eon, traverse_samples, &data);
+	if (traverse_data(eon, traverse_samples, &data) && abstract->work.exceeded)
+		return DC_STATUS_DATAFORMAT;
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * The bytes of an incomplete record are kept until the rest of the
+ * record arrives, so the memory use is bounded by the largest record
+ * (usually a type descriptor) instead of the whole file.
+ */
+struct eon_stream {
+	dc_buffer_t *pending;
+	unsigned int header;
+	unsigned int entry;
+	unsigned int ignore;
+	struct sample_data info;
+};
+
+static void stream_reset(suunto_eonsteel_parser_t *eon)
+{
+	struct eon_stream *stream = eon->stream;
+
+	if (!stream)
+		return;
+
+	dc_buffer_clear(stream->pending);
+	stream->header = 0;
+	stream->entry = 0;
+	stream->ignore = 0;
+	memset(&stream->info, 0, sizeof(stream->info));
+	stream->info.eon = eon;
+}
+
+/*
+ * Record the type descriptor of the entry header at the start of the
+ * data. Returns the length of the header, zero if the header is not
+ * complete yet, or a negative value for an invalid header.
+ */
+static int stream_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p, unsigned int len)
+{
+	unsigned int offset = 2, textlen;
+
+	if (len < 2)
+		return 0;
+	if (p[0]) {
+		ERROR(eon->base.context, "Bad dive entry (%02x)", p[0]);
+		return -1;
+	}
+	textlen = p[1];
+	if (textlen == 0xff) {
+		if (len < 6)
+			return 0;
+		textlen = array_uint32_le(p + 2);
+		offset = 6;
+	}
+	if (textlen > len - offset)
+		return 0;
+	if (textlen < 3 || p[offset + 2] != '<' || p[offset + textlen - 1])
+		return -1;
+
+	record_type(eon, array_uint16_le(p + offset), (const char *) p + offset + 2, textlen - 3);
+
+	return offset + textlen;
+}
+
+/*
+ * Report the data record at the start of the data. Returns the length
+ * of the record, or zero if the record is not complete yet.
+ */
+static unsigned int stream_record(suunto_eonsteel_parser_t *eon, const unsigned char *p, unsigned int len, eon_data_cb_t callback, void *user)
+{
+	unsigned int offset = 1, type, datalen;
+
+	type = p[0];
+	if (type == 0xff) {
+		if (len < 3)
+			return 0;
+		type = array_uint16_le(p + 1);
+		offset = 3;
+	}
+	if (offset >= len)
+		return 0;
+	datalen = p[offset++];
+	if (datalen == 0xff) {
+		if (len - offset < 4)
+			return 0;
+		datalen = array_uint32_le(p + offset);
+		offset += 4;
+	}
+	if (datalen > len - offset)
+		return 0;
+
+	if (TYPE_VALID(eon, type))
+		callback(type, eon->type_desc+type, p + offset, datalen, user);
+
+	return offset + datalen;
+}
+
+static dc_status_t
+suunto_eonsteel_parser_samples_feed(dc_parser_t *abstract, const unsigned char data[], unsigned int size, dc_sample_callback_t callback, void *userdata)
+{
+	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
+	struct eon_stream *stream = eon->stream;
+	const unsigned char *p;
+	unsigned int len, used = 0;
+
+	if (!stream) {
+		stream = (struct eon_stream *) dc_context_alloc(abstract->context, sizeof(*stream));
+		if (!stream) {
+			ERROR(abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		stream->pending = dc_buffer_new2(abstract->context, 1024);
+		if (!stream->pending) {
+			ERROR(abstract->context, "Failed to allocate memory.");
+			dc_context_release(abstract->context, stream);
+			return DC_STATUS_NOMEMORY;
+		}
+		eon->stream = stream;
+		stream_reset(eon);
+	}
+
+	if (size && !stream->ignore && !dc_buffer_append(stream->pending, data, size)) {
+		ERROR(abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	stream->info.callback = callback;
+	stream->info.userdata = userdata;
+
+	p = dc_buffer_get_data(stream->pending);
+	len = dc_buffer_get_size(stream->pending);
+
+	// Dive files start with "SBEM" and four NUL characters, after
+	// the 4-byte time pre-header.
+	if (!stream->ignore && !stream->header && len >= 12) {
+		if (memcmp(p+4, "SBEM", 4)) {
+			stream->ignore = 1;
+		} else {
+			stream->header = 1;
+			used = 12;
+		}
+	}
+
+	// Report every record as soon as it is complete. The incomplete
+	// records at the end of the data are silently dropped, like with
+	// traverse_data.
+	while (!stream->ignore && stream->header && used < len) {
+		if (!stream->entry || !p[used]) {
+			int n = stream_entry(eon, p + used, len - used);
+			if (n < 0) {
+				// Ignore the remainder of the dive, like traverse_data.
+				stream->ignore = 1;
+				break;
+			}
+			if (n == 0)
+				break;
+			if (dc_parser_work(abstract, 0, n, 1) != DC_STATUS_SUCCESS) {
+				stream->ignore = 1;
+				break;
+			}
+			stream->entry = 1;
+			used += n;
+		} else {
+			unsigned int n = stream_record(eon, p + used, len - used, traverse_samples, &stream->info);
+			if (n == 0)
+				break;
+			if (dc_parser_work(abstract, 1, n, 0) != DC_STATUS_SUCCESS) {
+				stream->ignore = 1;
+				break;
+			}
+			used += n;
+		}
+	}
+
+	if (!size)
+		stream_reset(eon);
+	else if (stream->ignore)
+		dc_buffer_clear(stream->pending);
+	else
+		dc_buffer_slice(stream->pending, used, len - used);
+
+	if (abstract->work.exceeded)
+		return DC_STATUS_DATAFORMAT;
+
 	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t get_string_field(suunto_eonsteel_parser_t *eon, unsigned idx, dc_field_string_t *value)
 {
 	if (idx < MAXSTRINGS) {
-		dc_field_string_t *res = eon->cache.strings+idx;
+		const struct eon_string *res = eon->cache.strings+idx;
+		if (res->desc && res->format != FORMAT_TEXT) {
+			char *buffer = eon->values[idx];
+
+			/*
+			 * We ignore the return value from snprintf, and we
+			 * always NUL-terminate the destination buffer ourselves.
+			 *
+			 * That way we don't have to worry about random bad legacy
+			 * implementations.
+			 */
+			buffer[SZ_STRING-1] = 0;
+			switch (res->format) {
+			case FORMAT_PERCENT:
+				(void) snprintf(buffer, SZ_STRING-1, "%d %%", res->args[0]);
+				break;
+			case FORMAT_ADJUSTMENT:
+				(void) snprintf(buffer, SZ_STRING-1, "P%d", res->args[0]);
+				break;
+			default:
+				(void) snprintf(buffer, SZ_STRING-1, "%d:%02d", res->args[0], res->args[1]);
+				break;
+			}
+
+			value->desc = res->desc;
+			value->value = buffer;
+			return DC_STATUS_SUCCESS;
+		}
 		if (res->desc && res->value) {
-			*value = *res;
+			value->desc = res->desc;
+			value->value = res->value;
 			return DC_STATUS_SUCCESS;
 		}
-
 	}
 	return DC_STATUS_UNSUPPORTED;
 }
@@ -1127,7 +1754,6 @@ static int add_gas_type(suunto_eonsteel_parser_t *eon, const struct type_desc *d
 
 	eon->cache.initialized |= 1 << DC_FIELD_GASMIX_COUNT;
 	eon->cache.initialized |= 1 << DC_FIELD_TANK_COUNT;
-	free((void *)name);
 	return 0;
 }
 
@@ -1170,40 +1796,48 @@ static int add_gas_workpressure(suunto_eonsteel_parser_t *eon, float wp)
 	return 0;
 }
 
-static int add_string(suunto_eonsteel_parser_t *eon, const char *desc, const char *value)
+static struct eon_string *new_string(suunto_eonsteel_parser_t *eon, const char *desc)
 {
 	int i;
 
 	eon->cache.initialized |= 1 << DC_FIELD_STRING;
 	for (i = 0; i < MAXSTRINGS; i++) {
-		dc_field_string_t *str = eon->cache.strings+i;
+		struct eon_string *str = eon->cache.strings+i;
 		if (str->desc)
 			continue;
 		str->desc = desc;
-		str->value = strdup(value);
-		break;
+		return str;
 	}
-	return 0;
+	return NULL;
 }
 
-static int add_string_fmt(suunto_eonsteel_parser_t *eon, const char *desc, const char *fmt, ...)
+/*
+ * The utf8 values are NUL-terminated in the dive data, and are handed
+ * out as they are, without a copy.
+ */
+static int add_string(suunto_eonsteel_parser_t *eon, const char *desc, const unsigned char *value)
 {
-	char buffer[256];
-	va_list ap;
+	struct eon_string *str = new_string(eon, desc);
 
-	/*
-	 * We ignore the return value from vsnprintf, and we
-	 * always NUL-terminate the destination buffer ourselves.
-	 *
-	 * That way we don't have to worry about random bad legacy
-	 * implementations.
-	 */
-	va_start(ap, fmt);
-	buffer[sizeof(buffer)-1] = 0;
-	(void) vsnprintf(buffer, sizeof(buffer)-1, fmt, ap);
-	va_end(ap);
+	if (str)
+		str->value = (const char *) value;
+	return 0;
+}
+
+/*
+ * The numeric values take up to two integer arguments, and are only
+ * formatted by get_string_field.
+ */
+static int add_string_fmt(suunto_eonsteel_parser_t *eon, const char *desc, enum eon_format format, int arg0, int arg1)
+{
+	struct eon_string *str = new_string(eon, desc);
 
-	return add_string(eon, desc, buffer);
+	if (str) {
+		str->format = format;
+		str->args[0] = arg0;
+		str->args[1] = arg1;
+	}
+	return 0;
 }
 
 static float get_le32_float(const unsigned char *src)
@@ -1288,10 +1922,10 @@ static int traverse_gas_fields(suunto_eonsteel_parser_t *eon, const struct type_
 		return 0;
 
 	if (!strcmp(name, ".Gas.TransmitterStartBatteryCharge"))
-		return add_string_fmt(eon, "Transmitter Battery at start", "%d %%", data[0]);
+		return add_string_fmt(eon, "Transmitter Battery at start", FORMAT_PERCENT, data[0], 0);
 
 	if (!strcmp(name, ".Gas.TransmitterEndBatteryCharge"))
-		return add_string_fmt(eon, "Transmitter Battery at end", "%d %%", data[0]);
+		return add_string_fmt(eon, "Transmitter Battery at end", FORMAT_PERCENT, data[0], 0);
 
 	return 0;
 }
@@ -1364,7 +1998,7 @@ static int traverse_diving_fields(suunto_eonsteel_parser_t *eon, const struct ty
 	if (!strcmp(name, "Conservatism")) {
 		int val = *(signed char *)data;
 
-		return add_string_fmt(eon, "Personal Adjustment", "P%d", val);
+		return add_string_fmt(eon, "Personal Adjustment", FORMAT_ADJUSTMENT, val, 0);
 	}
 
 	if (!strcmp(name, "LowSetPoint")) {
@@ -1383,12 +2017,12 @@ static int traverse_diving_fields(suunto_eonsteel_parser_t *eon, const struct ty
 	// Let's just agree to ignore seconds
 	if (!strcmp(name, "DesaturationTime")) {
 		unsigned int time = array_uint32_le(data) / 60;
-		return add_string_fmt(eon, "Desaturation Time", "%d:%02d", time / 60, time % 60);
+		return add_string_fmt(eon, "Desaturation Time", FORMAT_TIME, time / 60, time % 60);
 	}
 
 	if (!strcmp(name, "SurfaceTime")) {
 		unsigned int time = array_uint32_le(data) / 60;
-		return add_string_fmt(eon, "Surface Time", "%d:%02d", time / 60, time % 60);
+		return add_string_fmt(eon, "Surface Time", FORMAT_TIME, time / 60, time % 60);
 	}
 
 	return 0;
@@ -1500,7 +2134,7 @@ static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, struct type_d
 {
 	int i;
 
-	if (!desc->desc)
+	if (!TYPE_VALID(eon, (unsigned int) nr))
 		return;
 	DEBUG(eon->base.context, "Descriptor %d: '%s', size %d bytes", nr, desc->desc, desc->size);
 	if (desc->format)
@@ -1526,10 +2160,12 @@ suunto_eonsteel_parser_set_data(dc_parser_t *parser, const unsigned char *data,
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
-	memset(eon->type_desc, 0, sizeof(eon->type_desc));
+	memset(eon->valid, 0, sizeof(eon->valid));
+	stream_reset(eon);
 	initialize_field_caches(eon);
 	show_all_descriptors(eon);
+	if (parser->work.exceeded)
+		return DC_STATUS_DATAFORMAT;
 	return DC_STATUS_SUCCESS;
 }
 
@@ -1538,7 +2174,11 @@ suunto_eonsteel_parser_destroy(dc_parser_t *parser)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
+	suunto_eonsteel_cache_free(eon->descriptors);
+	if (eon->stream) {
+		dc_buffer_free(eon->stream->pending);
+		dc_context_release(parser->context, eon->stream);
+	}
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1550,6 +2190,9 @@ static const dc_parser_vtable_t suunto_eonsteel_parser_vtable = {
 	suunto_eonsteel_parser_get_datetime, /* datetime */
 	suunto_eonsteel_parser_get_field, /* fields */
 	suunto_eonsteel_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	suunto_eonsteel_parser_samples_feed, /* samples_feed */
 	suunto_eonsteel_parser_destroy /* destroy */
 };
 
@@ -1567,7 +2210,9 @@ suunto_eonsteel_parser_create(dc_parser_t **out, dc_context_t *context, unsigned
 		return DC_STATUS_NOMEMORY;
 	}
 
-	memset(&parser->type_desc, 0, sizeof(parser->type_desc));
+	memset(parser->valid, 0, sizeof(parser->valid));
+	parser->descriptors = NULL;
+	parser->stream = NULL;
 	memset(&parser->cache, 0, sizeof(parser->cache));
 
 	*out = (dc_parser_t *) parser;
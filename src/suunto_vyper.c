@@ -27,6 +27,7 @@
 #include "suunto_common.h"
 #include "context-private.h"
 #include "device-private.h"
+#include "iostream-private.h"
 #include "serial.h"
 #include "checksum.h"
 #include "array.h"
@@ -39,6 +40,10 @@
 #define SZ_MEMORY 0x2000
 #define SZ_PACKET 32
 
+#define MAXRETRIES 2
+
+#define GUARDTIME 500
+
 #define HDR_DEVINFO_VYPER   0x24
 #define HDR_DEVINFO_SPYDER  0x16
 #define HDR_DEVINFO_BEGIN   (HDR_DEVINFO_SPYDER)
@@ -113,6 +118,8 @@ suunto_vyper_device_open (dc_device_t **out, dc_context_t *context, const char *
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (2400 8O1).
 	status = dc_iostream_configure (device->iostream, 2400, 8, DC_PARITY_ODD, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -175,7 +182,17 @@ suunto_vyper_send (suunto_vyper_device_t *device, const unsigned char command[],
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
-	dc_iostream_sleep (device->iostream, 500);
+	// The dive computer needs some quiet time after its previous reply,
+	// before it accepts the next command. Only the part of that guard
+	// time that hasn't already elapsed is waited for. After a dive has
+	// been received, the read timeout that marks the end of the dive
+	// already exceeds the guard time, and the command is sent at once.
+	int idle = dc_iostream_get_idle (device->iostream);
+	if (idle < 0) {
+		dc_iostream_sleep (device->iostream, GUARDTIME);
+	} else if (idle < GUARDTIME) {
+		dc_iostream_sleep (device->iostream, GUARDTIME - idle);
+	}
 
 	// Set RTS to send the command.
 	status = dc_iostream_set_rts (device->iostream, 1);
@@ -251,6 +268,7 @@ suunto_vyper_transfer (suunto_vyper_device_t *device, const unsigned char comman
 	unsigned char crc = answer[asize - 1];
 	unsigned char ccrc = checksum_xor_uint8 (answer, asize - 1, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -277,9 +295,25 @@ suunto_vyper_device_read (dc_device_t *abstract, unsigned int address, unsigned
 				len, // count
 				0};  // CRC
 		command[4] = checksum_xor_uint8 (command, 4, 0x00);
-		dc_status_t rc = suunto_vyper_transfer (device, command, sizeof (command), answer, len + 5, len);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+
+		// A corrupted or missing package is requested again, instead
+		// of failing the entire download.
+		unsigned int nretries = 0;
+		dc_status_t rc = DC_STATUS_SUCCESS;
+		while ((rc = suunto_vyper_transfer (device, command, sizeof (command), answer, len + 5, len)) != DC_STATUS_SUCCESS) {
+			if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
+				return rc;
+
+			// Abort if the maximum number of retries is reached.
+			if (nretries++ >= MAXRETRIES)
+				return rc;
+
+			device_stats_retry (abstract);
+
+			// Discard the remainder of the failed answer, so it isn't
+			// mistaken for the start of the next one.
+			dc_iostream_purge (device->iostream, DC_DIRECTION_INPUT);
+		}
 
 		memcpy (data, answer + 4, len);
 
@@ -395,6 +429,7 @@ suunto_vyper_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init, dc
 		unsigned char crc = answer[len + 2];
 		unsigned char ccrc = checksum_xor_uint8 (answer, len + 2, 0x00);
 		if (crc != ccrc) {
+			device_stats_checksum (abstract);
 			ERROR (abstract->context, "Unexpected answer checksum.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -512,7 +547,7 @@ suunto_vyper_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
 	// Allocate a memory buffer.
-	dc_buffer_t *buffer = dc_buffer_new (layout->rb_profile_end - layout->rb_profile_begin);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, layout->rb_profile_end - layout->rb_profile_begin);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -0,0 +1,212 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "context-private.h"
+
+#define MINSLOTS 64
+
+typedef struct dc_syncindex_entry_t {
+	dc_family_t family;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int size;
+	unsigned char fingerprint[SYNCINDEX_MAXSIZE];
+} dc_syncindex_entry_t;
+
+/*
+ * The entries are stored in an open addressing hash table with linear
+ * probing. The number of slots is always a power of two, and the table
+ * is kept at most half full. Entries are never removed individually,
+ * so there is no need for tombstones.
+ */
+struct dc_syncindex_t {
+	dc_syncindex_entry_t *entries;
+	unsigned int nslots;
+	unsigned int count;
+};
+
+static unsigned int
+dc_syncindex_hash (dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size)
+{
+	// FNV-1a hash.
+	unsigned int hash = 2166136261u;
+	unsigned int values[] = {family, model, serial};
+
+	for (unsigned int i = 0; i < sizeof (values) / sizeof (values[0]); ++i) {
+		for (unsigned int j = 0; j < 4; ++j) {
+			hash ^= (values[i] >> (8 * j)) & 0xFF;
+			hash *= 16777619u;
+		}
+	}
+
+	for (unsigned int i = 0; i < size; ++i) {
+		hash ^= fingerprint[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static dc_syncindex_entry_t *
+dc_syncindex_lookup (dc_syncindex_entry_t *entries, unsigned int nslots, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size)
+{
+	unsigned int mask = nslots - 1;
+	unsigned int i = dc_syncindex_hash (family, model, serial, fingerprint, size) & mask;
+
+	// Return either the matching entry, or the empty slot where the
+	// entry should be inserted.
+	while (entries[i].size) {
+		const dc_syncindex_entry_t *entry = &entries[i];
+		if (entry->family == family &&
+			entry->model == model &&
+			entry->serial == serial &&
+			entry->size == size &&
+			memcmp (entry->fingerprint, fingerprint, size) == 0)
+			break;
+		i = (i + 1) & mask;
+	}
+
+	return &entries[i];
+}
+
+dc_status_t
+dc_syncindex_new (dc_syncindex_t **out)
+{
+	dc_syncindex_t *index = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	index = (dc_syncindex_t *) malloc (sizeof (dc_syncindex_t));
+	if (index == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	index->entries = NULL;
+	index->nslots = 0;
+	index->count = 0;
+
+	*out = index;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_syncindex_free (dc_syncindex_t *index)
+{
+	if (index == NULL)
+		return;
+
+	free (index->entries);
+	free (index);
+}
+
+static dc_status_t
+dc_syncindex_resize (dc_syncindex_t *index, unsigned int nslots)
+{
+	dc_syncindex_entry_t *entries = (dc_syncindex_entry_t *) calloc (nslots, sizeof (dc_syncindex_entry_t));
+	if (entries == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	// Re-insert the existing entries.
+	for (unsigned int i = 0; i < index->nslots; ++i) {
+		const dc_syncindex_entry_t *entry = &index->entries[i];
+		if (entry->size == 0)
+			continue;
+
+		*dc_syncindex_lookup (entries, nslots, entry->family, entry->model, entry->serial, entry->fingerprint, entry->size) = *entry;
+	}
+
+	free (index->entries);
+	index->entries = entries;
+	index->nslots = nslots;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_syncindex_add (dc_syncindex_t *index, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (index == NULL || fingerprint == NULL || size == 0 || size > SYNCINDEX_MAXSIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	// Keep the table at most half full.
+	if (2 * (index->count + 1) > index->nslots) {
+		status = dc_syncindex_resize (index, index->nslots ? 2 * index->nslots : MINSLOTS);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	dc_syncindex_entry_t *entry = dc_syncindex_lookup (index->entries, index->nslots, family, model, serial, fingerprint, size);
+	if (entry->size)
+		return DC_STATUS_SUCCESS;
+
+	entry->family = family;
+	entry->model = model;
+	entry->serial = serial;
+	entry->size = size;
+	memcpy (entry->fingerprint, fingerprint, size);
+	index->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_syncindex_contains (dc_syncindex_t *index, dc_family_t family, unsigned int model, unsigned int serial, const unsigned char fingerprint[], unsigned int size)
+{
+	if (index == NULL || index->count == 0 || fingerprint == NULL || size == 0 || size > SYNCINDEX_MAXSIZE)
+		return 0;
+
+	const dc_syncindex_entry_t *entry = dc_syncindex_lookup (index->entries, index->nslots, family, model, serial, fingerprint, size);
+
+	return entry->size != 0;
+}
+
+void
+dc_syncindex_foreach (dc_syncindex_t *index, dc_syncindex_callback_t callback, void *userdata)
+{
+	if (index == NULL || callback == NULL)
+		return;
+
+	for (unsigned int i = 0; i < index->nslots; ++i) {
+		const dc_syncindex_entry_t *entry = &index->entries[i];
+		if (entry->size == 0)
+			continue;
+
+		callback (entry->family, entry->model, entry->serial, entry->fingerprint, entry->size, userdata);
+	}
+}
+
+void
+dc_syncindex_clear (dc_syncindex_t *index)
+{
+	if (index == NULL)
+		return;
+
+	free (index->entries);
+	index->entries = NULL;
+	index->nslots = 0;
+	index->count = 0;
+}
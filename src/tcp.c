@@ -0,0 +1,869 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2017 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, strncmp
+
+#include "socket.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <time.h>        // nanosleep
+#include <netdb.h>       // getaddrinfo
+#include <netinet/in.h>  // IPPROTO_TCP
+#include <netinet/tcp.h> // TCP_NODELAY
+#endif
+
+#include "tcp.h"
+
+#include "common-private.h"
+#include "context-private.h"
+#include "iostream-private.h"
+
+#define SZ_RXBUF 4096
+#define SZ_TXBUF 1024
+#define SZ_HOST  256
+#define SZ_SUBNEGOTIATION 16
+
+// Telnet commands (RFC 854).
+#define SE   240
+#define SB   250
+#define WILL 251
+#define WONT 252
+#define DO   253
+#define DONT 254
+#define IAC  255
+
+// Telnet options.
+#define OPT_BINARY  0
+#define OPT_SGA     3
+#define OPT_COMPORT 44
+
+// Com port control commands (RFC 2217).
+#define COMPORT_SET_BAUDRATE       1
+#define COMPORT_SET_DATASIZE       2
+#define COMPORT_SET_PARITY         3
+#define COMPORT_SET_STOPSIZE       4
+#define COMPORT_SET_CONTROL        5
+#define COMPORT_NOTIFY_MODEMSTATE  7
+#define COMPORT_PURGE_DATA        12
+#define COMPORT_SERVER           100
+
+#define CONTROL_FLOW_NONE     1
+#define CONTROL_FLOW_SOFTWARE 2
+#define CONTROL_FLOW_HARDWARE 3
+#define CONTROL_BREAK_ON      5
+#define CONTROL_BREAK_OFF     6
+#define CONTROL_DTR_ON        8
+#define CONTROL_DTR_OFF       9
+#define CONTROL_RTS_ON       11
+#define CONTROL_RTS_OFF      12
+
+#define MODEMSTATE_CTS 0x10
+#define MODEMSTATE_DSR 0x20
+#define MODEMSTATE_RI  0x40
+#define MODEMSTATE_CD  0x80
+
+typedef enum dc_tcp_state_t {
+	STATE_DATA,
+	STATE_IAC,
+	STATE_OPTION,
+	STATE_SB,
+	STATE_SB_IAC,
+} dc_tcp_state_t;
+
+typedef struct dc_tcp_t {
+	dc_socket_t base;
+	// Telnet with the RFC 2217 com port control option.
+	unsigned int telnet;
+	dc_tcp_state_t state;
+	unsigned char command;
+	unsigned char subnegotiation[SZ_SUBNEGOTIATION];
+	size_t length;
+	unsigned int modemstate;
+	// Receive buffer, with the telnet commands already removed.
+	unsigned char rxbuf[SZ_RXBUF];
+	size_t rxoffset;
+	size_t rxcount;
+} dc_tcp_t;
+
+static dc_status_t dc_tcp_set_break (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_tcp_set_dtr (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_tcp_set_rts (dc_iostream_t *iostream, unsigned int value);
+static dc_status_t dc_tcp_get_lines (dc_iostream_t *iostream, unsigned int *value);
+static dc_status_t dc_tcp_get_available (dc_iostream_t *iostream, size_t *value);
+static dc_status_t dc_tcp_poll (dc_iostream_t *iostream, int timeout);
+static dc_status_t dc_tcp_configure (dc_iostream_t *iostream, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_tcp_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
+static dc_status_t dc_tcp_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_tcp_writev (dc_iostream_t *iostream, const dc_iovec_t iov[], size_t count, size_t *actual);
+static dc_status_t dc_tcp_purge (dc_iostream_t *iostream, dc_direction_t direction);
+static dc_status_t dc_tcp_sleep (dc_iostream_t *iostream, unsigned int milliseconds);
+
+static const dc_iostream_vtable_t dc_tcp_vtable = {
+	sizeof(dc_tcp_t),
+	dc_socket_set_timeout, /* set_timeout */
+	dc_socket_set_latency, /* set_latency */
+	dc_tcp_set_break, /* set_break */
+	dc_tcp_set_dtr, /* set_dtr */
+	dc_tcp_set_rts, /* set_rts */
+	dc_tcp_get_lines, /* get_lines */
+	dc_tcp_get_available, /* get_received */
+	dc_tcp_poll, /* poll */
+	dc_tcp_configure, /* configure */
+	dc_tcp_read, /* read */
+	dc_tcp_write, /* write */
+	NULL, /* readv */
+	dc_tcp_writev, /* writev */
+	dc_socket_flush, /* flush */
+	dc_tcp_purge, /* purge */
+	dc_tcp_sleep, /* sleep */
+	dc_socket_close, /* close */
+	dc_socket_cancel, /* cancel */
+};
+
+int
+dc_tcp_match (const char *name)
+{
+	if (name == NULL)
+		return 0;
+
+	return strncmp (name, "tcp://", 6) == 0 ||
+		strncmp (name, "rfc2217://", 10) == 0;
+}
+
+static dc_status_t
+dc_tcp_parse (const char *name, unsigned int *telnet, char host[], size_t hostsize, char service[], size_t servicesize)
+{
+	const char *p = NULL;
+	if (strncmp (name, "tcp://", 6) == 0) {
+		*telnet = 0;
+		p = name + 6;
+	} else if (strncmp (name, "rfc2217://", 10) == 0) {
+		*telnet = 1;
+		p = name + 10;
+	} else {
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	// Locate the host and the port number.
+	const char *begin = p, *end = NULL, *colon = NULL;
+	if (*p == '[') {
+		begin = p + 1;
+		end = strchr (begin, ']');
+		if (end == NULL || end[1] != ':')
+			return DC_STATUS_INVALIDARGS;
+		colon = end + 1;
+	} else {
+		colon = strrchr (p, ':');
+		if (colon == NULL)
+			return DC_STATUS_INVALIDARGS;
+		end = colon;
+	}
+
+	size_t hostlen = end - begin;
+	if (hostlen == 0 || hostlen >= hostsize)
+		return DC_STATUS_INVALIDARGS;
+
+	const char *port = colon + 1;
+	size_t portlen = strlen (port);
+	if (portlen == 0 || portlen >= servicesize || portlen > 5)
+		return DC_STATUS_INVALIDARGS;
+	for (size_t i = 0; i < portlen; ++i) {
+		if (port[i] < '0' || port[i] > '9')
+			return DC_STATUS_INVALIDARGS;
+	}
+
+	memcpy (host, begin, hostlen);
+	host[hostlen] = '\0';
+	memcpy (service, port, portlen + 1);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_tcp_send (dc_tcp_t *device, const unsigned char data[], size_t size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	status = dc_socket_write (&device->base.base, data, size, &nbytes);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->base.base.context, "Failed to send the data.");
+		return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static size_t
+dc_tcp_comport_encode (unsigned char buffer[], unsigned int command, const unsigned char value[], size_t size)
+{
+	size_t n = 0;
+
+	buffer[n++] = IAC;
+	buffer[n++] = SB;
+	buffer[n++] = OPT_COMPORT;
+	buffer[n++] = command;
+	for (size_t i = 0; i < size; ++i) {
+		if (value[i] == IAC)
+			buffer[n++] = IAC;
+		buffer[n++] = value[i];
+	}
+	buffer[n++] = IAC;
+	buffer[n++] = SE;
+
+	return n;
+}
+
+static dc_status_t
+dc_tcp_comport (dc_tcp_t *device, unsigned int command, unsigned int value)
+{
+	unsigned char buffer[8];
+	unsigned char data[] = {value};
+	size_t n = dc_tcp_comport_encode (buffer, command, data, sizeof (data));
+
+	return dc_tcp_send (device, buffer, n);
+}
+
+static void
+dc_tcp_negotiate (dc_tcp_t *device, unsigned char command, unsigned char option)
+{
+	dc_context_t *context = device->base.base.context;
+	unsigned char reply = 0;
+
+	// The options we support are offered when the connection is opened,
+	// so a request for one of them is the answer to our own offer, and
+	// requires no reply. All other options are refused.
+	switch (command) {
+	case DO:
+		if (option != OPT_BINARY && option != OPT_SGA && option != OPT_COMPORT)
+			reply = WONT;
+		break;
+	case WILL:
+		if (option != OPT_BINARY && option != OPT_SGA)
+			reply = DONT;
+		break;
+	case DONT:
+		if (option == OPT_COMPORT)
+			WARNING (context, "The bridge does not support com port control.");
+		break;
+	default:
+		break;
+	}
+
+	if (reply) {
+		const unsigned char buffer[] = {IAC, reply, option};
+		dc_tcp_send (device, buffer, sizeof (buffer));
+	}
+}
+
+static void
+dc_tcp_subnegotiate (dc_tcp_t *device, const unsigned char data[], size_t size)
+{
+	if (size < 3 || data[0] != OPT_COMPORT)
+		return;
+
+	// Keep track of the modem state notifications, for the line status.
+	if (data[1] == COMPORT_SERVER + COMPORT_NOTIFY_MODEMSTATE) {
+		device->modemstate = data[2];
+	}
+}
+
+/*
+ * Remove the telnet commands from the received data. The data is
+ * decoded in place, which is possible because the result is never
+ * longer than the input. Returns the number of data bytes left.
+ */
+static size_t
+dc_tcp_decode (dc_tcp_t *device, unsigned char data[], size_t size)
+{
+	if (!device->telnet)
+		return size;
+
+	size_t n = 0;
+	for (size_t i = 0; i < size; ++i) {
+		unsigned char c = data[i];
+		switch (device->state) {
+		case STATE_DATA:
+			if (c == IAC)
+				device->state = STATE_IAC;
+			else
+				data[n++] = c;
+			break;
+		case STATE_IAC:
+			if (c == IAC) {
+				data[n++] = c;
+				device->state = STATE_DATA;
+			} else if (c == WILL || c == WONT || c == DO || c == DONT) {
+				device->command = c;
+				device->state = STATE_OPTION;
+			} else if (c == SB) {
+				device->length = 0;
+				device->state = STATE_SB;
+			} else {
+				// Ignore all other commands.
+				device->state = STATE_DATA;
+			}
+			break;
+		case STATE_OPTION:
+			dc_tcp_negotiate (device, device->command, c);
+			device->state = STATE_DATA;
+			break;
+		case STATE_SB:
+			if (c == IAC)
+				device->state = STATE_SB_IAC;
+			else if (device->length < sizeof (device->subnegotiation))
+				device->subnegotiation[device->length++] = c;
+			break;
+		case STATE_SB_IAC:
+			if (c == SE) {
+				dc_tcp_subnegotiate (device, device->subnegotiation, device->length);
+				device->state = STATE_DATA;
+			} else {
+				if (c == IAC && device->length < sizeof (device->subnegotiation))
+					device->subnegotiation[device->length++] = c;
+				device->state = STATE_SB;
+			}
+			break;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Wait for data, and receive whatever is available, up to the size of
+ * the buffer.
+ */
+static dc_status_t
+dc_tcp_receive (dc_tcp_t *device, unsigned char data[], size_t size, size_t *actual)
+{
+	dc_iostream_t *abstract = (dc_iostream_t *) device;
+	int timeout = device->base.timeout;
+
+	while (1) {
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (device->base.fd, &fds);
+
+		struct timeval tvt;
+		if (timeout > 0) {
+			tvt.tv_sec  = (timeout / 1000);
+			tvt.tv_usec = (timeout % 1000) * 1000;
+		} else if (timeout == 0) {
+			timerclear (&tvt);
+		}
+
+		int rc = select (device->base.fd + 1, &fds, NULL, NULL, timeout >= 0 ? &tvt : NULL);
+		if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			return dc_socket_syserror(errcode);
+		} else if (rc == 0) {
+			return DC_STATUS_TIMEOUT;
+		}
+
+		s_ssize_t n = recv (device->base.fd, (char *) data, size, 0);
+		if (n < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR || errcode == S_EAGAIN)
+				continue; // Retry.
+			SYSERROR (abstract->context, errcode);
+			return dc_socket_syserror(errcode);
+		} else if (n == 0) {
+			ERROR (abstract->context, "The connection was closed by the bridge.");
+			return DC_STATUS_IO;
+		}
+
+		*actual = n;
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
+dc_status_t
+dc_tcp_open (dc_iostream_t **out, dc_context_t *context, const char *name)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_tcp_t *device = NULL;
+	char host[SZ_HOST], service[8];
+	unsigned int telnet = 0;
+
+	if (out == NULL || name == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: name=%s", name);
+
+	status = dc_tcp_parse (name, &telnet, host, sizeof (host), service, sizeof (service));
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Invalid address '%s'.", name);
+		return status;
+	}
+
+	// Allocate memory.
+	device = (dc_tcp_t *) dc_iostream_allocate (context, &dc_tcp_vtable);
+	if (device == NULL) {
+		SYSERROR (context, S_ENOMEM);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->telnet = telnet;
+	device->state = STATE_DATA;
+	device->command = 0;
+	device->length = 0;
+	device->modemstate = 0;
+	device->rxoffset = 0;
+	device->rxcount = 0;
+
+	// Initialize the socket library, for the name resolution.
+	status = dc_socket_init (context);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	struct addrinfo hints, *result = NULL;
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	int rc = getaddrinfo (host, service, &hints, &result);
+	if (rc != 0) {
+		ERROR (context, "Failed to resolve the host '%s' (%s).", host, gai_strerror (rc));
+		dc_socket_exit (context);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	// Try all addresses until a connection succeeds.
+	status = DC_STATUS_IO;
+	for (struct addrinfo *ai = result; ai != NULL; ai = ai->ai_next) {
+		status = dc_socket_open (&device->base.base, ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (status != DC_STATUS_SUCCESS)
+			continue;
+
+		status = dc_socket_connect (&device->base.base, ai->ai_addr, (s_socklen_t) ai->ai_addrlen);
+		if (status == DC_STATUS_SUCCESS)
+			break;
+
+		dc_socket_close (&device->base.base);
+	}
+
+	freeaddrinfo (result);
+	dc_socket_exit (context);
+
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to connect to '%s'.", name);
+		goto error_free;
+	}
+
+	// Disable the Nagle algorithm. The protocols are made of small
+	// packets and immediate responses, which otherwise get delayed
+	// until the previous packet is acknowledged.
+	int nodelay = 1;
+	if (setsockopt (device->base.fd, IPPROTO_TCP, TCP_NODELAY, (const char *) &nodelay, sizeof (nodelay)) != 0) {
+		WARNING (context, "Failed to disable the Nagle algorithm.");
+	}
+
+	// Offer a binary connection with com port control.
+	if (device->telnet) {
+		const unsigned char negotiation[] = {
+			IAC, WILL, OPT_BINARY,
+			IAC, DO, OPT_BINARY,
+			IAC, WILL, OPT_SGA,
+			IAC, DO, OPT_SGA,
+			IAC, WILL, OPT_COMPORT};
+		status = dc_tcp_send (device, negotiation, sizeof (negotiation));
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_close;
+		}
+	}
+
+	*out = (dc_iostream_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_socket_close (&device->base.base);
+error_free:
+	dc_iostream_deallocate ((dc_iostream_t *) device);
+	return status;
+}
+
+static dc_status_t
+dc_tcp_set_break (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	if (!device->telnet)
+		return DC_STATUS_SUCCESS;
+
+	return dc_tcp_comport (device, COMPORT_SET_CONTROL, value ? CONTROL_BREAK_ON : CONTROL_BREAK_OFF);
+}
+
+static dc_status_t
+dc_tcp_set_dtr (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	if (!device->telnet)
+		return DC_STATUS_SUCCESS;
+
+	return dc_tcp_comport (device, COMPORT_SET_CONTROL, value ? CONTROL_DTR_ON : CONTROL_DTR_OFF);
+}
+
+static dc_status_t
+dc_tcp_set_rts (dc_iostream_t *abstract, unsigned int value)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	if (!device->telnet)
+		return DC_STATUS_SUCCESS;
+
+	return dc_tcp_comport (device, COMPORT_SET_CONTROL, value ? CONTROL_RTS_ON : CONTROL_RTS_OFF);
+}
+
+static dc_status_t
+dc_tcp_get_lines (dc_iostream_t *abstract, unsigned int *value)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+	unsigned int lines = 0;
+
+	// The line status is only known from the notifications of the
+	// bridge, as they are received along with the data.
+	if (device->modemstate & MODEMSTATE_CD)
+		lines |= DC_LINE_DCD;
+	if (device->modemstate & MODEMSTATE_CTS)
+		lines |= DC_LINE_CTS;
+	if (device->modemstate & MODEMSTATE_DSR)
+		lines |= DC_LINE_DSR;
+	if (device->modemstate & MODEMSTATE_RI)
+		lines |= DC_LINE_RNG;
+
+	if (value)
+		*value = lines;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_tcp_get_available (dc_iostream_t *abstract, size_t *value)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+	size_t available = 0;
+
+	dc_status_t status = dc_socket_get_available (abstract, &available);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (value)
+		*value = device->rxcount + available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_tcp_poll (dc_iostream_t *abstract, int timeout)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	if (device->rxcount)
+		return DC_STATUS_SUCCESS;
+
+	return dc_socket_poll (abstract, timeout);
+}
+
+static dc_status_t
+dc_tcp_configure (dc_iostream_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	// Without com port control, the serial port is configured on the
+	// bridge itself.
+	if (!device->telnet)
+		return DC_STATUS_SUCCESS;
+
+	unsigned char value = 0;
+	switch (parity) {
+	case DC_PARITY_NONE:
+		value = 1;
+		break;
+	case DC_PARITY_ODD:
+		value = 2;
+		break;
+	case DC_PARITY_EVEN:
+		value = 3;
+		break;
+	case DC_PARITY_MARK:
+		value = 4;
+		break;
+	case DC_PARITY_SPACE:
+		value = 5;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+	const unsigned char p[] = {value};
+
+	switch (stopbits) {
+	case DC_STOPBITS_ONE:
+		value = 1;
+		break;
+	case DC_STOPBITS_TWO:
+		value = 2;
+		break;
+	case DC_STOPBITS_ONEPOINTFIVE:
+		value = 3;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+	const unsigned char s[] = {value};
+
+	switch (flowcontrol) {
+	case DC_FLOWCONTROL_NONE:
+		value = CONTROL_FLOW_NONE;
+		break;
+	case DC_FLOWCONTROL_HARDWARE:
+		value = CONTROL_FLOW_HARDWARE;
+		break;
+	case DC_FLOWCONTROL_SOFTWARE:
+		value = CONTROL_FLOW_SOFTWARE;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+	const unsigned char f[] = {value};
+
+	const unsigned char b[] = {
+		(baudrate >> 24) & 0xFF,
+		(baudrate >> 16) & 0xFF,
+		(baudrate >>  8) & 0xFF,
+		(baudrate      ) & 0xFF};
+	const unsigned char d[] = {databits};
+
+	// Send all settings at once.
+	unsigned char buffer[64];
+	size_t n = 0;
+	n += dc_tcp_comport_encode (buffer + n, COMPORT_SET_BAUDRATE, b, sizeof (b));
+	n += dc_tcp_comport_encode (buffer + n, COMPORT_SET_DATASIZE, d, sizeof (d));
+	n += dc_tcp_comport_encode (buffer + n, COMPORT_SET_PARITY, p, sizeof (p));
+	n += dc_tcp_comport_encode (buffer + n, COMPORT_SET_STOPSIZE, s, sizeof (s));
+	n += dc_tcp_comport_encode (buffer + n, COMPORT_SET_CONTROL, f, sizeof (f));
+
+	return dc_tcp_send (device, buffer, n);
+}
+
+static dc_status_t
+dc_tcp_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+	unsigned char *p = (unsigned char *) data;
+	size_t nbytes = 0;
+
+	while (1) {
+		// Return the buffered data first.
+		size_t n = device->rxcount;
+		if (n > size - nbytes)
+			n = size - nbytes;
+		memcpy (p + nbytes, device->rxbuf + device->rxoffset, n);
+		device->rxoffset += n;
+		device->rxcount -= n;
+		nbytes += n;
+
+		if (nbytes == size)
+			break;
+
+		// The buffer is empty now. Large requests are received directly
+		// into the destination, to avoid the extra copy.
+		size_t remaining = size - nbytes;
+		unsigned char *buffer = device->rxbuf;
+		size_t capacity = sizeof (device->rxbuf);
+		if (remaining >= capacity) {
+			buffer = p + nbytes;
+			capacity = remaining;
+		}
+
+		size_t received = 0;
+		status = dc_tcp_receive (device, buffer, capacity, &received);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+
+		n = dc_tcp_decode (device, buffer, received);
+		if (buffer == device->rxbuf) {
+			device->rxoffset = 0;
+			device->rxcount = n;
+		} else {
+			nbytes += n;
+		}
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_tcp_writev (dc_iostream_t *abstract, const dc_iovec_t iov[], size_t count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+	unsigned char buffer[SZ_TXBUF];
+	size_t nbytes = 0, pending = 0, n = 0;
+
+	if (!device->telnet)
+		return dc_socket_writev (abstract, iov, count, actual);
+
+	// Escape the data bytes that equal the telnet command prefix, and
+	// gather everything in as few system calls as possible.
+	for (size_t i = 0; i < count; ++i) {
+		const unsigned char *data = (const unsigned char *) iov[i].data;
+		for (size_t j = 0; j < iov[i].size; ++j) {
+			if (n + 2 > sizeof (buffer)) {
+				status = dc_socket_write (abstract, buffer, n, NULL);
+				if (status != DC_STATUS_SUCCESS)
+					goto out;
+				nbytes += pending;
+				pending = 0;
+				n = 0;
+			}
+
+			if (data[j] == IAC)
+				buffer[n++] = IAC;
+			buffer[n++] = data[j];
+			pending++;
+		}
+	}
+
+	if (n) {
+		status = dc_socket_write (abstract, buffer, n, NULL);
+		if (status != DC_STATUS_SUCCESS)
+			goto out;
+		nbytes += pending;
+	}
+
+out:
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_tcp_write (dc_iostream_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	if (!device->telnet)
+		return dc_socket_write (abstract, data, size, actual);
+
+	dc_iovec_t iov = {(void *) data, size};
+
+	return dc_tcp_writev (abstract, &iov, 1, actual);
+}
+
+static dc_status_t
+dc_tcp_purge (dc_iostream_t *abstract, dc_direction_t direction)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_tcp_t *device = (dc_tcp_t *) abstract;
+
+	// Purge the buffers of the serial port on the bridge.
+	if (device->telnet) {
+		unsigned int value = 0;
+		switch (direction) {
+		case DC_DIRECTION_INPUT:
+			value = 1;
+			break;
+		case DC_DIRECTION_OUTPUT:
+			value = 2;
+			break;
+		case DC_DIRECTION_ALL:
+			value = 3;
+			break;
+		default:
+			return DC_STATUS_INVALIDARGS;
+		}
+
+		status = dc_tcp_comport (device, COMPORT_PURGE_DATA, value);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	if (direction & DC_DIRECTION_INPUT) {
+		// Discard the buffered data, and the data that is already
+		// waiting in the socket. The telnet commands are still
+		// processed.
+		device->rxoffset = 0;
+		device->rxcount = 0;
+
+		while (1) {
+			size_t available = 0;
+			status = dc_socket_get_available (abstract, &available);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+
+			if (available == 0)
+				break;
+
+			size_t received = 0;
+			status = dc_tcp_receive (device, device->rxbuf, sizeof (device->rxbuf), &received);
+			if (status != DC_STATUS_SUCCESS)
+				return status;
+
+			dc_tcp_decode (device, device->rxbuf, received);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_tcp_sleep (dc_iostream_t *abstract, unsigned int timeout)
+{
+#ifdef _WIN32
+	Sleep (timeout);
+#else
+	struct timespec ts;
+	ts.tv_sec  = (timeout / 1000);
+	ts.tv_nsec = (timeout % 1000) * 1000000;
+
+	while (nanosleep (&ts, &ts) != 0) {
+		int errcode = errno;
+		if (errcode != EINTR ) {
+			SYSERROR (abstract->context, errcode);
+			return dc_socket_syserror (errcode);
+		}
+	}
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,62 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2017 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_TCP_H
+#define DC_TCP_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/iostream.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Check whether the name refers to a serial port behind a TCP bridge.
+ *
+ * Two forms are recognized: "tcp://host:port" for a raw connection,
+ * where the serial settings are configured on the bridge itself, and
+ * "rfc2217://host:port" for a telnet connection with the RFC 2217 com
+ * port control option. An IPv6 address is written between brackets.
+ *
+ * @param[in]  name  The name of the serial port.
+ * @returns Non-zero if the name is a TCP address, zero otherwise.
+ */
+int
+dc_tcp_match (const char *name);
+
+/**
+ * Open a TCP connection to a serial port bridge.
+ *
+ * @param[out]  iostream A location to store the TCP connection.
+ * @param[in]   context  A valid context object.
+ * @param[in]   name     The address of the bridge (see #dc_tcp_match).
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_tcp_open (dc_iostream_t **iostream, dc_context_t *context, const char *name);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_TCP_H */
@@ -0,0 +1,359 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (_WIN32)
+#define NOGDI
+#include <windows.h>
+#define USE_WIN32
+#elif defined (HAVE_PTHREAD_H)
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#define USE_PTHREAD
+#endif
+
+#include "thread.h"
+
+struct dc_thread_t {
+#if defined (USE_WIN32)
+	HANDLE handle;
+#elif defined (USE_PTHREAD)
+	pthread_t handle;
+#endif
+	dc_thread_func_t func;
+	void *userdata;
+};
+
+struct dc_mutex_t {
+#if defined (USE_WIN32)
+	CRITICAL_SECTION handle;
+#elif defined (USE_PTHREAD)
+	pthread_mutex_t handle;
+#endif
+};
+
+struct dc_cond_t {
+#if defined (USE_WIN32)
+	CONDITION_VARIABLE handle;
+#elif defined (USE_PTHREAD)
+	pthread_cond_t handle;
+#endif
+};
+
+#if defined (USE_WIN32)
+static DWORD WINAPI
+dc_thread_start (LPVOID param)
+{
+	dc_thread_t *thread = (dc_thread_t *) param;
+
+	thread->func (thread->userdata);
+
+	return 0;
+}
+#elif defined (USE_PTHREAD)
+static void *
+dc_thread_start (void *param)
+{
+	dc_thread_t *thread = (dc_thread_t *) param;
+
+	thread->func (thread->userdata);
+
+	return NULL;
+}
+#endif
+
+dc_status_t
+dc_thread_new (dc_thread_t **out, dc_thread_func_t func, void *userdata)
+{
+#if defined (USE_WIN32) || defined (USE_PTHREAD)
+	dc_thread_t *thread = NULL;
+
+	if (out == NULL || func == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	thread = (dc_thread_t *) malloc (sizeof (dc_thread_t));
+	if (thread == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	thread->func = func;
+	thread->userdata = userdata;
+
+#if defined (USE_WIN32)
+	thread->handle = CreateThread (NULL, 0, dc_thread_start, thread, 0, NULL);
+	if (thread->handle == NULL) {
+		free (thread);
+		return DC_STATUS_IO;
+	}
+#else
+	if (pthread_create (&thread->handle, NULL, dc_thread_start, thread) != 0) {
+		free (thread);
+		return DC_STATUS_IO;
+	}
+#endif
+
+	*out = thread;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_thread_join (dc_thread_t *thread)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (thread == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#if defined (USE_WIN32)
+	if (WaitForSingleObject (thread->handle, INFINITE) != WAIT_OBJECT_0)
+		status = DC_STATUS_IO;
+	CloseHandle (thread->handle);
+#elif defined (USE_PTHREAD)
+	if (pthread_join (thread->handle, NULL) != 0)
+		status = DC_STATUS_IO;
+#endif
+
+	free (thread);
+
+	return status;
+}
+
+unsigned long long
+dc_thread_self (void)
+{
+	unsigned long long id = 0;
+
+#if defined (USE_WIN32)
+	id = GetCurrentThreadId ();
+#elif defined (USE_PTHREAD)
+	// The pthread_t type is opaque, but in practice an integer or a
+	// pointer, which is good enough to tell the threads apart.
+	pthread_t self = pthread_self ();
+	memcpy (&id, &self, sizeof (self) < sizeof (id) ? sizeof (self) : sizeof (id));
+#endif
+
+	return id;
+}
+
+dc_status_t
+dc_mutex_new (dc_mutex_t **out)
+{
+#if defined (USE_WIN32) || defined (USE_PTHREAD)
+	dc_mutex_t *mutex = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	mutex = (dc_mutex_t *) malloc (sizeof (dc_mutex_t));
+	if (mutex == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+#if defined (USE_WIN32)
+	InitializeCriticalSection (&mutex->handle);
+#else
+	if (pthread_mutex_init (&mutex->handle, NULL) != 0) {
+		free (mutex);
+		return DC_STATUS_IO;
+	}
+#endif
+
+	*out = mutex;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_mutex_lock (dc_mutex_t *mutex)
+{
+	if (mutex == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_WIN32)
+	EnterCriticalSection (&mutex->handle);
+#elif defined (USE_PTHREAD)
+	if (pthread_mutex_lock (&mutex->handle) != 0)
+		return DC_STATUS_IO;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_mutex_unlock (dc_mutex_t *mutex)
+{
+	if (mutex == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_WIN32)
+	LeaveCriticalSection (&mutex->handle);
+#elif defined (USE_PTHREAD)
+	if (pthread_mutex_unlock (&mutex->handle) != 0)
+		return DC_STATUS_IO;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_mutex_free (dc_mutex_t *mutex)
+{
+	if (mutex == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_WIN32)
+	DeleteCriticalSection (&mutex->handle);
+#elif defined (USE_PTHREAD)
+	pthread_mutex_destroy (&mutex->handle);
+#endif
+
+	free (mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_cond_new (dc_cond_t **out)
+{
+#if defined (USE_WIN32) || defined (USE_PTHREAD)
+	dc_cond_t *cond = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	cond = (dc_cond_t *) malloc (sizeof (dc_cond_t));
+	if (cond == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+#if defined (USE_WIN32)
+	InitializeConditionVariable (&cond->handle);
+#else
+	if (pthread_cond_init (&cond->handle, NULL) != 0) {
+		free (cond);
+		return DC_STATUS_IO;
+	}
+#endif
+
+	*out = cond;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_cond_wait (dc_cond_t *cond, dc_mutex_t *mutex, int timeout)
+{
+	if (cond == NULL || mutex == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_WIN32)
+	if (!SleepConditionVariableCS (&cond->handle, &mutex->handle, timeout < 0 ? INFINITE : (DWORD) timeout)) {
+		if (GetLastError () == ERROR_TIMEOUT)
+			return DC_STATUS_TIMEOUT;
+		return DC_STATUS_IO;
+	}
+#elif defined (USE_PTHREAD)
+	int rc = 0;
+	if (timeout < 0) {
+		rc = pthread_cond_wait (&cond->handle, &mutex->handle);
+	} else {
+		struct timeval now;
+		gettimeofday (&now, NULL);
+
+		struct timespec ts;
+		unsigned long long nsec = (unsigned long long) now.tv_usec * 1000 + (unsigned long long) (timeout % 1000) * 1000000;
+		ts.tv_sec = now.tv_sec + timeout / 1000 + nsec / 1000000000;
+		ts.tv_nsec = nsec % 1000000000;
+
+		rc = pthread_cond_timedwait (&cond->handle, &mutex->handle, &ts);
+	}
+
+	if (rc == ETIMEDOUT)
+		return DC_STATUS_TIMEOUT;
+	else if (rc != 0)
+		return DC_STATUS_IO;
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_cond_signal (dc_cond_t *cond)
+{
+	if (cond == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_WIN32)
+	WakeConditionVariable (&cond->handle);
+#elif defined (USE_PTHREAD)
+	pthread_cond_signal (&cond->handle);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_cond_broadcast (dc_cond_t *cond)
+{
+	if (cond == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_WIN32)
+	WakeAllConditionVariable (&cond->handle);
+#elif defined (USE_PTHREAD)
+	pthread_cond_broadcast (&cond->handle);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_cond_free (dc_cond_t *cond)
+{
+	if (cond == NULL)
+		return DC_STATUS_SUCCESS;
+
+#if defined (USE_PTHREAD)
+	pthread_cond_destroy (&cond->handle);
+#endif
+
+	free (cond);
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,116 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2018 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_THREAD_H
+#define DC_THREAD_H
+
+#include <libdivecomputer/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque objects representing a thread, a mutex and a condition
+ * variable. On platforms without thread support, all functions fail
+ * with #DC_STATUS_UNSUPPORTED, except for the mutex and condition
+ * functions, which accept a NULL object and do nothing. That allows
+ * the same code to run unchanged in single-threaded builds.
+ */
+typedef struct dc_thread_t dc_thread_t;
+typedef struct dc_mutex_t dc_mutex_t;
+typedef struct dc_cond_t dc_cond_t;
+
+typedef void (*dc_thread_func_t) (void *userdata);
+
+/**
+ * Start a new thread.
+ *
+ * @param[out]  thread    A location to store the thread.
+ * @param[in]   func      The function to run in the new thread.
+ * @param[in]   userdata  User data to pass to the function.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_thread_new (dc_thread_t **thread, dc_thread_func_t func, void *userdata);
+
+/**
+ * Wait for the thread to finish, and destroy it.
+ *
+ * @param[in]  thread  A valid thread.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_thread_join (dc_thread_t *thread);
+
+/**
+ * Get an identifier of the calling thread. The identifier is unique
+ * among the running threads, but may be re-used after a thread has
+ * finished. Without thread support, the identifier is always zero.
+ *
+ * @returns The identifier of the calling thread.
+ */
+unsigned long long
+dc_thread_self (void);
+
+dc_status_t
+dc_mutex_new (dc_mutex_t **mutex);
+
+dc_status_t
+dc_mutex_lock (dc_mutex_t *mutex);
+
+dc_status_t
+dc_mutex_unlock (dc_mutex_t *mutex);
+
+dc_status_t
+dc_mutex_free (dc_mutex_t *mutex);
+
+dc_status_t
+dc_cond_new (dc_cond_t **cond);
+
+/**
+ * Wait for the condition variable to be signalled.
+ *
+ * @param[in]  cond     A valid condition variable.
+ * @param[in]  mutex    A valid mutex, locked by the calling thread.
+ * @param[in]  timeout  The timeout in milliseconds, or a negative
+ *                      value to wait forever.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_TIMEOUT if the
+ * timeout expired, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_cond_wait (dc_cond_t *cond, dc_mutex_t *mutex, int timeout);
+
+dc_status_t
+dc_cond_signal (dc_cond_t *cond);
+
+dc_status_t
+dc_cond_broadcast (dc_cond_t *cond);
+
+dc_status_t
+dc_cond_free (dc_cond_t *cond);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_THREAD_H */
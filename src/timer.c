@@ -159,3 +159,132 @@ dc_timer_free (dc_timer_t *timer)
 
 	return DC_STATUS_SUCCESS;
 }
+
+#if defined (HAVE_CLOCK_GETTIME) && !defined (_WIN32)
+static clockid_t
+dc_timer_clockid (unsigned int coarse)
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+	if (coarse)
+		return CLOCK_MONOTONIC_COARSE;
+#endif
+	return CLOCK_MONOTONIC;
+}
+#endif
+
+dc_status_t
+dc_timer_clock (unsigned int coarse, dc_usecs_t *usecs)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usecs_t value = 0;
+
+#if defined (_WIN32)
+	LARGE_INTEGER now, frequency;
+	if (!QueryPerformanceFrequency(&frequency) ||
+		!QueryPerformanceCounter(&now)) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = (now.QuadPart / frequency.QuadPart) * 1000000 +
+		(now.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#elif defined (HAVE_CLOCK_GETTIME)
+	struct timespec now;
+	if (clock_gettime(dc_timer_clockid (coarse), &now) != 0) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = (dc_usecs_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#elif defined (HAVE_MACH_ABSOLUTE_TIME)
+	mach_timebase_info_data_t info;
+	if (mach_timebase_info(&info) != KERN_SUCCESS) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = mach_absolute_time() * info.numer / info.denom / 1000;
+#else
+	struct timeval now;
+	if (gettimeofday (&now, NULL) != 0) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = (dc_usecs_t) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+
+out:
+	if (usecs)
+		*usecs = value;
+
+	return status;
+}
+
+dc_status_t
+dc_timer_clock_nsecs (dc_nsecs_t *nsecs)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_nsecs_t value = 0;
+
+#if defined (_WIN32)
+	LARGE_INTEGER now, frequency;
+	if (!QueryPerformanceFrequency(&frequency) ||
+		!QueryPerformanceCounter(&now)) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = (now.QuadPart / frequency.QuadPart) * 1000000000 +
+		(now.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#elif defined (HAVE_CLOCK_GETTIME)
+	struct timespec now;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = (dc_nsecs_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#elif defined (HAVE_MACH_ABSOLUTE_TIME)
+	mach_timebase_info_data_t info;
+	if (mach_timebase_info(&info) != KERN_SUCCESS) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = mach_absolute_time() * info.numer / info.denom;
+#else
+	struct timeval now;
+	if (gettimeofday (&now, NULL) != 0) {
+		status = DC_STATUS_IO;
+		goto out;
+	}
+
+	value = ((dc_nsecs_t) now.tv_sec * 1000000 + now.tv_usec) * 1000;
+#endif
+
+out:
+	if (nsecs)
+		*nsecs = value;
+
+	return status;
+}
+
+dc_usecs_t
+dc_timer_resolution (unsigned int coarse)
+{
+#if defined (_WIN32)
+	return 1;
+#elif defined (HAVE_CLOCK_GETTIME)
+	struct timespec res;
+	if (clock_getres (dc_timer_clockid (coarse), &res) != 0)
+		return 0;
+
+	dc_usecs_t value = (dc_usecs_t) res.tv_sec * 1000000 + (res.tv_nsec + 999) / 1000;
+	return value ? value : 1;
+#elif defined (HAVE_MACH_ABSOLUTE_TIME)
+	return 1;
+#else
+	return 0;
+#endif
+}
@@ -30,8 +30,10 @@ extern "C" {
 
 #if defined (_WIN32) && !defined (__GNUC__)
 typedef unsigned __int64 dc_usecs_t;
+typedef unsigned __int64 dc_nsecs_t;
 #else
 typedef unsigned long long dc_usecs_t;
+typedef unsigned long long dc_nsecs_t;
 #endif
 
 typedef struct dc_timer_t dc_timer_t;
@@ -45,6 +47,27 @@ dc_timer_now (dc_timer_t *timer, dc_usecs_t *usecs);
 dc_status_t
 dc_timer_free (dc_timer_t *timer);
 
+/*
+ * Read the monotonic clock without a timer object. The origin of the
+ * clock is arbitrary, so only differences are meaningful. With the
+ * coarse flag, a faster but less precise clock is used if available.
+ */
+dc_status_t
+dc_timer_clock (unsigned int coarse, dc_usecs_t *usecs);
+
+/*
+ * Read the monotonic clock in nanoseconds, with the same origin as
+ * the precise clock of dc_timer_clock.
+ */
+dc_status_t
+dc_timer_clock_nsecs (dc_nsecs_t *nsecs);
+
+/*
+ * The resolution of the clock in microseconds, or zero if unknown.
+ */
+dc_usecs_t
+dc_timer_resolution (unsigned int coarse);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,175 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2026 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "context-private.h"
+#include "thread.h"
+#include "timer.h"
+
+#define NTHREADS 8
+
+typedef struct dc_trace_span_t {
+	const char *name;
+	dc_usecs_t begin;
+	dc_usecs_t end;
+} dc_trace_span_t;
+
+typedef struct dc_trace_ring_t {
+	unsigned long long thread;
+	dc_trace_span_t *spans;
+	unsigned int head;
+	unsigned int count;
+} dc_trace_ring_t;
+
+/*
+ * Every thread records its spans in a ring buffer of its own, such that
+ * a busy transfer thread doesn't push the spans of the other threads
+ * out of the trace. The rings are allocated on the first span of the
+ * thread. The spans of the threads beyond the maximum are dropped.
+ */
+struct dc_trace_t {
+	dc_timer_t *timer;
+	dc_mutex_t *mutex;
+	unsigned int size;
+	dc_trace_ring_t rings[NTHREADS];
+	unsigned int nrings;
+};
+
+dc_status_t
+dc_trace_new (dc_trace_t **out, unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_trace_t *trace = NULL;
+
+	if (out == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	trace = (dc_trace_t *) malloc (sizeof (dc_trace_t));
+	if (trace == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	memset (trace, 0, sizeof (dc_trace_t));
+	trace->size = size;
+
+	status = dc_timer_new (&trace->timer);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	// Without thread support, the mutex functions are no-ops for a
+	// NULL mutex.
+	dc_mutex_new (&trace->mutex);
+
+	*out = trace;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	free (trace);
+	return status;
+}
+
+void
+dc_trace_free (dc_trace_t *trace)
+{
+	if (trace == NULL)
+		return;
+
+	for (unsigned int i = 0; i < trace->nrings; ++i)
+		free (trace->rings[i].spans);
+	dc_mutex_free (trace->mutex);
+	dc_timer_free (trace->timer);
+	free (trace);
+}
+
+dc_usecs_t
+dc_trace_now (dc_trace_t *trace)
+{
+	dc_usecs_t now = 0;
+
+	dc_timer_now (trace->timer, &now);
+
+	return now;
+}
+
+void
+dc_trace_add (dc_trace_t *trace, const char *name, dc_usecs_t begin, dc_usecs_t end)
+{
+	unsigned long long thread = dc_thread_self ();
+	dc_trace_ring_t *ring = NULL;
+
+	dc_mutex_lock (trace->mutex);
+
+	for (unsigned int i = 0; i < trace->nrings; ++i) {
+		if (trace->rings[i].thread == thread) {
+			ring = &trace->rings[i];
+			break;
+		}
+	}
+
+	if (ring == NULL && trace->nrings < NTHREADS) {
+		dc_trace_span_t *spans = (dc_trace_span_t *) malloc (trace->size * sizeof (dc_trace_span_t));
+		if (spans) {
+			ring = &trace->rings[trace->nrings++];
+			ring->thread = thread;
+			ring->spans = spans;
+			ring->head = 0;
+			ring->count = 0;
+		}
+	}
+
+	if (ring) {
+		dc_trace_span_t *span = &ring->spans[ring->head];
+		span->name = name;
+		span->begin = begin;
+		span->end = end;
+
+		ring->head = (ring->head + 1) % trace->size;
+		if (ring->count < trace->size)
+			ring->count++;
+	}
+
+	dc_mutex_unlock (trace->mutex);
+}
+
+void
+dc_trace_foreach (dc_trace_t *trace, dc_trace_callback_t callback, void *userdata)
+{
+	if (trace == NULL)
+		return;
+
+	dc_mutex_lock (trace->mutex);
+
+	for (unsigned int i = 0; i < trace->nrings; ++i) {
+		const dc_trace_ring_t *ring = &trace->rings[i];
+
+		// Oldest span first.
+		unsigned int idx = (ring->head + trace->size - ring->count) % trace->size;
+		for (unsigned int j = 0; j < ring->count; ++j) {
+			const dc_trace_span_t *span = &ring->spans[idx];
+			callback (span->name, ring->thread, span->begin, span->end, userdata);
+			idx = (idx + 1) % trace->size;
+		}
+	}
+
+	dc_mutex_unlock (trace->mutex);
+}
@@ -24,6 +24,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #ifdef HAVE_PTHREAD_H
 #include <pthread.h>
 #endif
@@ -40,6 +41,13 @@
 #define USBHID
 #endif
 
+#ifdef _WIN32
+#define USE_WIN32
+#ifndef USBHID
+#define USBHID
+#endif
+#endif
+
 #if defined(USE_LIBUSB)
 #ifdef _WIN32
 #define NOGDI
@@ -49,6 +57,11 @@
 #include <hidapi/hidapi.h>
 #endif
 
+#if defined(USE_WIN32)
+#include <setupapi.h>
+#include <hidsdi.h>
+#endif
+
 #include "usbhid.h"
 
 #include "common-private.h"
@@ -57,6 +70,7 @@
 #include "descriptor-private.h"
 #include "iterator-private.h"
 #include "platform.h"
+#include "timer.h"
 
 #ifdef _WIN32
 typedef LONG dc_mutex_t;
@@ -68,6 +82,10 @@ typedef pthread_mutex_t dc_mutex_t;
 
 #define ISINSTANCE(device) dc_iostream_isinstance((device), &dc_usbhid_vtable)
 
+#define MAXTRANSFERS 8
+#define NTRANSFERS   4
+#define NBUFFERS     64
+
 struct dc_usbhid_device_t {
 	unsigned short vid, pid;
 };
@@ -80,6 +98,7 @@ static dc_status_t dc_usbhid_set_timeout (dc_iostream_t *iostream, int timeout);
 static dc_status_t dc_usbhid_read (dc_iostream_t *iostream, void *data, size_t size, size_t *actual);
 static dc_status_t dc_usbhid_write (dc_iostream_t *iostream, const void *data, size_t size, size_t *actual);
 static dc_status_t dc_usbhid_close (dc_iostream_t *iostream);
+static dc_status_t dc_usbhid_cancel (dc_iostream_t *iostream);
 
 typedef struct dc_usbhid_iterator_t {
 	dc_iterator_t base;
@@ -91,6 +110,11 @@ typedef struct dc_usbhid_iterator_t {
 #elif defined(USE_HIDAPI)
 	struct hid_device_info *devices, *current;
 #endif
+#if defined(USE_WIN32)
+	unsigned int native;
+	HDEVINFO devinfo;
+	DWORD index;
+#endif
 } dc_usbhid_iterator_t;
 
 typedef struct dc_usbhid_t {
@@ -102,13 +126,65 @@ typedef struct dc_usbhid_t {
 	int interface;
 	unsigned char endpoint_in;
 	unsigned char endpoint_out;
+	unsigned int packetsize;
 	unsigned int timeout;
+	/* Asynchronous input transfers, queued in submission order. */
+	struct libusb_transfer *transfers[MAXTRANSFERS];
+	int state[MAXTRANSFERS];
+	unsigned int ntransfers;
+	unsigned int queue[MAXTRANSFERS];
+	unsigned int head, npending;
+	dc_timer_t *timer;
 #elif defined(USE_HIDAPI)
 	hid_device *handle;
 	int timeout;
 #endif
+#if defined(USE_WIN32)
+	/*
+	 * Native backend, on top of the HID class driver. The overlapped
+	 * input reads are queued in submission order, and the cancellation
+	 * event is never reset once signalled.
+	 */
+	unsigned int native;
+	struct {
+		HANDLE handle;
+		HANDLE cancel;
+		HANDLE writer;
+		DWORD timeout;
+		unsigned int input, output;
+		unsigned char *buffer;
+		OVERLAPPED overlapped[MAXTRANSFERS];
+		unsigned char *reports[MAXTRANSFERS];
+		int pending[MAXTRANSFERS];
+		unsigned int nreports;
+		unsigned int queue[MAXTRANSFERS];
+		unsigned int head, npending;
+	} hid;
+#endif
 } dc_usbhid_t;
 
+#if defined(USE_LIBUSB)
+typedef struct dc_usbhid_hotplug_item_t {
+	dc_usbhid_hotplug_event_t event;
+	dc_descriptor_t *descriptor;
+	unsigned short vid, pid;
+} dc_usbhid_hotplug_item_t;
+
+struct dc_usbhid_hotplug_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	dc_filter_t filter;
+	dc_usbhid_hotplug_callback_t callback;
+	void *userdata;
+	libusb_hotplug_callback_handle handle;
+	dc_timer_t *timer;
+	/* Events queued by the libusb callback, in order of arrival. */
+	dc_usbhid_hotplug_item_t *items;
+	size_t count, capacity;
+	int signalled;
+};
+#endif
+
 static const dc_iterator_vtable_t dc_usbhid_iterator_vtable = {
 	sizeof(dc_usbhid_iterator_t),
 	dc_usbhid_iterator_next,
@@ -124,19 +200,25 @@ static const dc_iostream_vtable_t dc_usbhid_vtable = {
 	NULL, /* set_rts */
 	NULL, /* get_lines */
 	NULL, /* get_received */
+	NULL, /* poll */
 	NULL, /* configure */
 	dc_usbhid_read, /* read */
 	dc_usbhid_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
 	NULL, /* flush */
 	NULL, /* purge */
 	NULL, /* sleep */
 	dc_usbhid_close, /* close */
+	dc_usbhid_cancel, /* cancel */
 };
 
 static dc_mutex_t g_usbhid_mutex = DC_MUTEX_INIT;
 static size_t g_usbhid_refcount = 0;
+static dc_usbhid_backend_t g_usbhid_backend = DC_USBHID_BACKEND_DEFAULT;
 #ifdef USE_LIBUSB
 static libusb_context *g_usbhid_ctx = NULL;
+static dc_mutex_t g_hotplug_mutex = DC_MUTEX_INIT;
 #endif
 
 #if defined(USE_LIBUSB)
@@ -160,13 +242,157 @@ syserror(int errcode)
 		return DC_STATUS_IO;
 	}
 }
+
+enum {
+	TRANSFER_PENDING = 0,
+	TRANSFER_COMPLETE = 1,
+	TRANSFER_IDLE = 2,
+};
+
+static void LIBUSB_CALL
+dc_usbhid_transfer_cb (struct libusb_transfer *transfer)
+{
+	int *state = (int *) transfer->user_data;
+
+	*state = TRANSFER_COMPLETE;
+}
+
+static dc_status_t
+dc_usbhid_submit (dc_usbhid_t *usbhid, unsigned int index)
+{
+	usbhid->state[index] = TRANSFER_PENDING;
+
+	int rc = libusb_submit_transfer (usbhid->transfers[index]);
+	if (rc != LIBUSB_SUCCESS) {
+		ERROR (usbhid->base.context, "Failed to submit the usb transfer (%s).",
+			libusb_error_name (rc));
+		usbhid->state[index] = TRANSFER_IDLE;
+		return syserror (rc);
+	}
+
+	// Append to the queue of pending transfers.
+	usbhid->queue[(usbhid->head + usbhid->npending) % usbhid->ntransfers] = index;
+	usbhid->npending++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_usbhid_async_stop (dc_usbhid_t *usbhid)
+{
+	// Cancel all pending transfers, and wait for their completion.
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		if (usbhid->state[i] == TRANSFER_PENDING)
+			libusb_cancel_transfer (usbhid->transfers[i]);
+	}
+
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		while (usbhid->state[i] == TRANSFER_PENDING) {
+			if (libusb_handle_events_completed (g_usbhid_ctx, &usbhid->state[i]) != LIBUSB_SUCCESS)
+				break;
+		}
+
+		// A transfer that is still owned by libusb can't be freed.
+		if (usbhid->state[i] != TRANSFER_PENDING)
+			libusb_free_transfer (usbhid->transfers[i]);
+		usbhid->transfers[i] = NULL;
+	}
+
+	usbhid->ntransfers = 0;
+	usbhid->head = 0;
+	usbhid->npending = 0;
+
+	dc_timer_free (usbhid->timer);
+	usbhid->timer = NULL;
+}
+
+static dc_status_t
+dc_usbhid_read_async (dc_usbhid_t *usbhid, void *data, size_t size, int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usecs_t now = 0, deadline = 0;
+
+	// Resubmit the transfers that failed to submit earlier.
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		if (usbhid->state[i] == TRANSFER_IDLE) {
+			status = dc_usbhid_submit (usbhid, i);
+			if (status != DC_STATUS_SUCCESS && usbhid->npending == 0)
+				return status;
+		}
+	}
+
+	if (usbhid->timeout) {
+		dc_timer_now (usbhid->timer, &now);
+		deadline = now + (dc_usecs_t) usbhid->timeout * 1000;
+	}
+
+	// Wait for the oldest transfer to complete.
+	unsigned int index = usbhid->queue[usbhid->head];
+	struct libusb_transfer *transfer = usbhid->transfers[index];
+	while (usbhid->state[index] == TRANSFER_PENDING) {
+		int rc = 0;
+		if (usbhid->timeout) {
+			dc_timer_now (usbhid->timer, &now);
+			if (now >= deadline) {
+				ERROR (usbhid->base.context, "Usb read interrupt transfer failed (%s).",
+					libusb_error_name (LIBUSB_ERROR_TIMEOUT));
+				return DC_STATUS_TIMEOUT;
+			}
+
+			struct timeval tv;
+			tv.tv_sec = (deadline - now) / 1000000;
+			tv.tv_usec = (deadline - now) % 1000000;
+			rc = libusb_handle_events_timeout_completed (g_usbhid_ctx, &tv, &usbhid->state[index]);
+		} else {
+			rc = libusb_handle_events_completed (g_usbhid_ctx, &usbhid->state[index]);
+		}
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (usbhid->base.context, "Failed to handle the usb events (%s).",
+				libusb_error_name (rc));
+			return syserror (rc);
+		}
+	}
+
+	usbhid->head = (usbhid->head + 1) % usbhid->ntransfers;
+	usbhid->npending--;
+	usbhid->state[index] = TRANSFER_IDLE;
+
+	// A transfer cancelled by dc_usbhid_cancel is not queued again.
+	if (usbhid->base.cancelled)
+		return DC_STATUS_CANCELLED;
+
+	status = DC_STATUS_SUCCESS;
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		size_t length = transfer->actual_length;
+		if (length > size) {
+			WARNING (usbhid->base.context, "Input report truncated (" DC_PRINTF_SIZE " > " DC_PRINTF_SIZE ").", length, size);
+			length = size;
+		}
+		memcpy (data, transfer->buffer, length);
+		*actual = length;
+	} else {
+		ERROR (usbhid->base.context, "Usb read interrupt transfer failed (status %d).",
+			transfer->status);
+		if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE)
+			return DC_STATUS_NODEVICE;
+		status = DC_STATUS_IO;
+	}
+
+	// Queue the transfer again, behind the ones still in flight. A
+	// failure is retried on the next read.
+	dc_usbhid_submit (usbhid, index);
+
+	return status;
+}
 #endif
 
 static dc_status_t
 usbhid_packet_close(dc_custom_io_t *io)
 {
 	dc_iostream_t *usbhid = (dc_iostream_t *)io->userdata;
-	return dc_usbhid_close(usbhid);
+	dc_status_t status = dc_usbhid_close(usbhid);
+	free(io);
+	return status;
 }
 
 static dc_status_t
@@ -198,24 +424,32 @@ usbhid_packet_write(dc_custom_io_t *io, const void* data, size_t size, size_t *a
 }
 
 dc_status_t
-dc_usbhid_custom_io (dc_context_t *context, unsigned int vid, unsigned int pid)
+dc_usbhid_custom_io (dc_custom_io_t **out, dc_context_t *context, unsigned int vid, unsigned int pid)
 {
 	dc_iostream_t *usbhid;
 	dc_status_t status;
 
-	static dc_custom_io_t custom = {
-		.packet_size = 64,
-		.packet_close = usbhid_packet_close,
-		.packet_read  = usbhid_packet_read,
-		.packet_write = usbhid_packet_write,
-	};
+	// Every connection gets its own instance, which is owned by the
+	// device (and freed by packet_close), and not registered with the
+	// context. Concurrent downloads can therefore share the context.
+	dc_custom_io_t *custom = (dc_custom_io_t *) calloc (1, sizeof (dc_custom_io_t));
+	if (custom == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	custom->packet_size = 64;
+	custom->packet_close = usbhid_packet_close;
+	custom->packet_read  = usbhid_packet_read;
+	custom->packet_write = usbhid_packet_write;
 
 	status = dc_usbhid_open(&usbhid, context, vid, pid);
-	if (status != DC_STATUS_SUCCESS)
+	if (status != DC_STATUS_SUCCESS) {
+		free (custom);
 		return status;
+	}
 
-	custom.userdata = (void *)usbhid;
-	dc_context_set_custom_io(context, &custom, NULL);
+	custom->userdata = (void *)usbhid;
 
 	dc_usbhid_set_timeout(usbhid, 10);
 
@@ -234,6 +468,13 @@ dc_usbhid_custom_io (dc_context_t *context, unsigned int vid, unsigned int pid)
 
 	dc_usbhid_set_timeout(usbhid, 5000);
 
+	/* Keep several input reports in flight during the download */
+	status = dc_usbhid_set_async(usbhid, NTRANSFERS);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED)
+		WARNING (context, "Failed to enable the asynchronous transfers.");
+
+	*out = custom;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -287,7 +528,9 @@ dc_usbhid_init (dc_context_t *context)
 
 	g_usbhid_refcount++;
 
+#if defined(USE_LIBUSB) || defined(USE_HIDAPI)
 error:
+#endif
 	dc_mutex_unlock (&g_usbhid_mutex);
 	return status;
 }
@@ -310,6 +553,508 @@ dc_usbhid_exit (void)
 
 	return DC_STATUS_SUCCESS;
 }
+
+#if defined(USE_WIN32)
+static dc_status_t
+syserror_native (DWORD errcode)
+{
+	switch (errcode) {
+	case ERROR_INVALID_PARAMETER:
+		return DC_STATUS_INVALIDARGS;
+	case ERROR_OUTOFMEMORY:
+	case ERROR_NOT_ENOUGH_MEMORY:
+		return DC_STATUS_NOMEMORY;
+	case ERROR_FILE_NOT_FOUND:
+	case ERROR_DEVICE_NOT_CONNECTED:
+		return DC_STATUS_NODEVICE;
+	case ERROR_ACCESS_DENIED:
+	case ERROR_SHARING_VIOLATION:
+		return DC_STATUS_NOACCESS;
+	case ERROR_OPERATION_ABORTED:
+		return DC_STATUS_CANCELLED;
+	default:
+		return DC_STATUS_IO;
+	}
+}
+
+/*
+ * The backend for the objects created now. Without libusb or hidapi,
+ * the native backend is the only one available.
+ */
+static unsigned int
+dc_usbhid_native (void)
+{
+#if defined(USE_LIBUSB) || defined(USE_HIDAPI)
+	dc_mutex_lock (&g_usbhid_mutex);
+	unsigned int native =
+		g_usbhid_backend == DC_USBHID_BACKEND_DEFAULT ||
+		g_usbhid_backend == DC_USBHID_BACKEND_NATIVE;
+	dc_mutex_unlock (&g_usbhid_mutex);
+
+	return native;
+#else
+	return 1;
+#endif
+}
+
+static HDEVINFO
+dc_usbhid_native_enumerate (dc_context_t *context)
+{
+	GUID guid;
+	HidD_GetHidGuid (&guid);
+
+	HDEVINFO devinfo = SetupDiGetClassDevsA (&guid, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+	if (devinfo == INVALID_HANDLE_VALUE) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+	}
+
+	return devinfo;
+}
+
+/*
+ * Get the next HID interface with both input and output reports. The
+ * interface is opened without any access rights, which is sufficient
+ * to query the attributes, and also works for the keyboards and mice
+ * that are opened exclusively by the system. The caller frees the
+ * interface details.
+ */
+static dc_status_t
+dc_usbhid_native_next (dc_context_t *context, HDEVINFO devinfo, DWORD *index, dc_usbhid_device_t *device, SP_DEVICE_INTERFACE_DETAIL_DATA_A **out)
+{
+	GUID guid;
+	HidD_GetHidGuid (&guid);
+
+	for (;;) {
+		SP_DEVICE_INTERFACE_DATA data;
+		data.cbSize = sizeof (data);
+		if (!SetupDiEnumDeviceInterfaces (devinfo, NULL, &guid, (*index)++, &data)) {
+			DWORD errcode = GetLastError ();
+			if (errcode == ERROR_NO_MORE_ITEMS)
+				return DC_STATUS_DONE;
+			SYSERROR (context, errcode);
+			return syserror_native (errcode);
+		}
+
+		// Get the device path.
+		DWORD size = 0;
+		SetupDiGetDeviceInterfaceDetailA (devinfo, &data, NULL, 0, &size, NULL);
+		if (size < sizeof (SP_DEVICE_INTERFACE_DETAIL_DATA_A))
+			continue;
+
+		SP_DEVICE_INTERFACE_DETAIL_DATA_A *detail = (SP_DEVICE_INTERFACE_DETAIL_DATA_A *) malloc (size);
+		if (detail == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		detail->cbSize = sizeof (SP_DEVICE_INTERFACE_DETAIL_DATA_A);
+		if (!SetupDiGetDeviceInterfaceDetailA (devinfo, &data, detail, size, NULL, NULL)) {
+			free (detail);
+			continue;
+		}
+
+		HANDLE handle = CreateFileA (detail->DevicePath, 0,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+		if (handle == INVALID_HANDLE_VALUE) {
+			free (detail);
+			continue;
+		}
+
+		HIDD_ATTRIBUTES attributes;
+		PHIDP_PREPARSED_DATA preparsed = NULL;
+		HIDP_CAPS caps;
+		attributes.Size = sizeof (attributes);
+		if (!HidD_GetAttributes (handle, &attributes) ||
+			!HidD_GetPreparsedData (handle, &preparsed)) {
+			CloseHandle (handle);
+			free (detail);
+			continue;
+		}
+
+		NTSTATUS rc = HidP_GetCaps (preparsed, &caps);
+		HidD_FreePreparsedData (preparsed);
+		CloseHandle (handle);
+
+		if (rc != HIDP_STATUS_SUCCESS ||
+			caps.InputReportByteLength == 0 ||
+			caps.OutputReportByteLength == 0) {
+			free (detail);
+			continue;
+		}
+
+		device->vid = attributes.VendorID;
+		device->pid = attributes.ProductID;
+
+		if (out)
+			*out = detail;
+		else
+			free (detail);
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
+static dc_status_t
+dc_usbhid_native_iterator_next (dc_usbhid_iterator_t *iterator, void *out)
+{
+	dc_context_t *context = iterator->base.context;
+	dc_usbhid_device_t current;
+
+	for (;;) {
+		dc_status_t status = dc_usbhid_native_next (context, iterator->devinfo, &iterator->index, &current, NULL);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		dc_usb_desc_t usb = {current.vid, current.pid};
+		if (iterator->filter && !iterator->filter (DC_TRANSPORT_USBHID, &usb)) {
+			continue;
+		}
+
+		dc_usbhid_device_t *device = (dc_usbhid_device_t *) malloc (sizeof(dc_usbhid_device_t));
+		if (device == NULL) {
+			ERROR (context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		*device = current;
+
+		*(dc_usbhid_device_t **) out = device;
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
+static dc_status_t
+dc_usbhid_native_submit (dc_usbhid_t *usbhid, unsigned int index)
+{
+	OVERLAPPED *overlapped = &usbhid->hid.overlapped[index];
+	HANDLE event = overlapped->hEvent;
+
+	memset (overlapped, 0, sizeof (OVERLAPPED));
+	overlapped->hEvent = event;
+
+	// A read that completes immediately signals the event as well.
+	if (!ReadFile (usbhid->hid.handle, usbhid->hid.reports[index], usbhid->hid.input, NULL, overlapped)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (usbhid->base.context, errcode);
+			return syserror_native (errcode);
+		}
+	}
+
+	// Append to the queue of pending reads.
+	usbhid->hid.pending[index] = 1;
+	usbhid->hid.queue[(usbhid->hid.head + usbhid->hid.npending) % usbhid->hid.nreports] = index;
+	usbhid->hid.npending++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Cancel all pending reads, and wait for their completion. Just like
+ * the serial port, the reads must be issued from the calling thread.
+ */
+static void
+dc_usbhid_native_stop (dc_usbhid_t *usbhid)
+{
+	if (usbhid->hid.npending)
+		CancelIo (usbhid->hid.handle);
+
+	for (unsigned int i = 0; i < usbhid->hid.nreports; ++i) {
+		if (usbhid->hid.pending[i]) {
+			DWORD transferred = 0;
+			GetOverlappedResult (usbhid->hid.handle, &usbhid->hid.overlapped[i], &transferred, TRUE);
+			usbhid->hid.pending[i] = 0;
+		}
+
+		CloseHandle (usbhid->hid.overlapped[i].hEvent);
+		free (usbhid->hid.reports[i]);
+		usbhid->hid.reports[i] = NULL;
+	}
+
+	usbhid->hid.nreports = 0;
+	usbhid->hid.head = 0;
+	usbhid->hid.npending = 0;
+}
+
+static dc_status_t
+dc_usbhid_native_start (dc_usbhid_t *usbhid, unsigned int count)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		HANDLE event = CreateEvent (NULL, TRUE, FALSE, NULL);
+		unsigned char *buffer = (unsigned char *) malloc (usbhid->hid.input);
+		if (event == NULL || buffer == NULL) {
+			ERROR (usbhid->base.context, "Failed to allocate memory.");
+			if (event)
+				CloseHandle (event);
+			free (buffer);
+			status = DC_STATUS_NOMEMORY;
+			goto error;
+		}
+
+		memset (&usbhid->hid.overlapped[i], 0, sizeof (OVERLAPPED));
+		usbhid->hid.overlapped[i].hEvent = event;
+		usbhid->hid.reports[i] = buffer;
+		usbhid->hid.pending[i] = 0;
+		usbhid->hid.nreports++;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		status = dc_usbhid_native_submit (usbhid, i);
+		if (status != DC_STATUS_SUCCESS)
+			goto error;
+	}
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	dc_usbhid_native_stop (usbhid);
+	return status;
+}
+
+static dc_status_t
+dc_usbhid_native_open (dc_usbhid_t *usbhid, unsigned int vid, unsigned int pid)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_context_t *context = usbhid->base.context;
+	SP_DEVICE_INTERFACE_DETAIL_DATA_A *detail = NULL;
+	dc_usbhid_device_t device;
+	DWORD index = 0;
+
+	HDEVINFO devinfo = dc_usbhid_native_enumerate (context);
+	if (devinfo == INVALID_HANDLE_VALUE)
+		return DC_STATUS_IO;
+
+	// Find the first interface matching the VID/PID.
+	for (;;) {
+		status = dc_usbhid_native_next (context, devinfo, &index, &device, &detail);
+		if (status == DC_STATUS_DONE) {
+			ERROR (context, "No matching USB device (%04x:%04x) found.", vid, pid);
+			status = DC_STATUS_NODEVICE;
+		}
+		if (status != DC_STATUS_SUCCESS)
+			goto error_devinfo;
+
+		if (device.vid == vid && device.pid == pid)
+			break;
+
+		free (detail);
+		detail = NULL;
+	}
+
+	usbhid->hid.handle = CreateFileA (detail->DevicePath,
+		GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+	if (usbhid->hid.handle == INVALID_HANDLE_VALUE) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror_native (errcode);
+		goto error_detail;
+	}
+
+	// Get the size of the reports, including the report id.
+	PHIDP_PREPARSED_DATA preparsed = NULL;
+	HIDP_CAPS caps;
+	if (!HidD_GetPreparsedData (usbhid->hid.handle, &preparsed)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror_native (errcode);
+		goto error_close;
+	}
+
+	NTSTATUS rc = HidP_GetCaps (preparsed, &caps);
+	HidD_FreePreparsedData (preparsed);
+	if (rc != HIDP_STATUS_SUCCESS) {
+		ERROR (context, "Failed to get the HID capabilities.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	usbhid->hid.input = caps.InputReportByteLength;
+	usbhid->hid.output = caps.OutputReportByteLength;
+	usbhid->hid.timeout = INFINITE;
+	usbhid->hid.nreports = 0;
+	usbhid->hid.head = 0;
+	usbhid->hid.npending = 0;
+
+	INFO (context, "Open: reports=%u,%u", usbhid->hid.input, usbhid->hid.output);
+
+	// Let the class driver buffer more input reports between reads.
+	if (!HidD_SetNumInputBuffers (usbhid->hid.handle, NBUFFERS))
+		WARNING (context, "Failed to set the number of input buffers.");
+
+	usbhid->hid.buffer = (unsigned char *) malloc (usbhid->hid.output);
+	if (usbhid->hid.buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_close;
+	}
+
+	usbhid->hid.cancel = CreateEvent (NULL, TRUE, FALSE, NULL);
+	if (usbhid->hid.cancel == NULL) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror_native (errcode);
+		goto error_free_buffer;
+	}
+
+	usbhid->hid.writer = CreateEvent (NULL, TRUE, FALSE, NULL);
+	if (usbhid->hid.writer == NULL) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror_native (errcode);
+		goto error_free_cancel;
+	}
+
+	// Keep a single input report in flight, such that a read with a
+	// timeout never discards a report.
+	status = dc_usbhid_native_start (usbhid, 1);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free_writer;
+
+	free (detail);
+	SetupDiDestroyDeviceInfoList (devinfo);
+
+	return DC_STATUS_SUCCESS;
+
+error_free_writer:
+	CloseHandle (usbhid->hid.writer);
+error_free_cancel:
+	CloseHandle (usbhid->hid.cancel);
+error_free_buffer:
+	free (usbhid->hid.buffer);
+error_close:
+	CloseHandle (usbhid->hid.handle);
+error_detail:
+	free (detail);
+error_devinfo:
+	SetupDiDestroyDeviceInfoList (devinfo);
+	return status;
+}
+
+static void
+dc_usbhid_native_close (dc_usbhid_t *usbhid)
+{
+	dc_usbhid_native_stop (usbhid);
+	CloseHandle (usbhid->hid.writer);
+	CloseHandle (usbhid->hid.cancel);
+	CloseHandle (usbhid->hid.handle);
+	free (usbhid->hid.buffer);
+}
+
+static dc_status_t
+dc_usbhid_native_read (dc_usbhid_t *usbhid, void *data, size_t size, int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Resubmit the reads that failed to submit earlier.
+	for (unsigned int i = 0; i < usbhid->hid.nreports; ++i) {
+		if (!usbhid->hid.pending[i]) {
+			status = dc_usbhid_native_submit (usbhid, i);
+			if (status != DC_STATUS_SUCCESS && usbhid->hid.npending == 0)
+				return status;
+		}
+	}
+
+	// Wait for the oldest read to complete. On a timeout, or a
+	// cancellation, the read remains queued for the next call.
+	unsigned int index = usbhid->hid.queue[usbhid->hid.head];
+	OVERLAPPED *overlapped = &usbhid->hid.overlapped[index];
+	HANDLE handles[2] = {overlapped->hEvent, usbhid->hid.cancel};
+	DWORD rc = WaitForMultipleObjects (2, handles, FALSE, usbhid->hid.timeout);
+	if (rc == WAIT_TIMEOUT) {
+		ERROR (usbhid->base.context, "Usb read interrupt transfer failed (timeout).");
+		return DC_STATUS_TIMEOUT;
+	} else if (rc == WAIT_OBJECT_0 + 1) {
+		return DC_STATUS_CANCELLED;
+	} else if (rc != WAIT_OBJECT_0) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (usbhid->base.context, errcode);
+		return syserror_native (errcode);
+	}
+
+	DWORD nbytes = 0;
+	BOOL success = GetOverlappedResult (usbhid->hid.handle, overlapped, &nbytes, FALSE);
+	DWORD errcode = success ? ERROR_SUCCESS : GetLastError ();
+
+	usbhid->hid.head = (usbhid->hid.head + 1) % usbhid->hid.nreports;
+	usbhid->hid.npending--;
+	usbhid->hid.pending[index] = 0;
+
+	if (success) {
+		// The report starts with the report id. Just like hidapi, and
+		// the libusb backend, a report id of zero is removed.
+		const unsigned char *report = usbhid->hid.reports[index];
+		if (nbytes && report[0] == 0) {
+			report++;
+			nbytes--;
+		}
+		if (nbytes > size) {
+			WARNING (usbhid->base.context, "Input report truncated (%lu > " DC_PRINTF_SIZE ").", (unsigned long) nbytes, size);
+			nbytes = size;
+		}
+		memcpy (data, report, nbytes);
+		*actual = nbytes;
+	} else {
+		SYSERROR (usbhid->base.context, errcode);
+		status = syserror_native (errcode);
+	}
+
+	// Queue the read again, behind the ones still in flight. A failure
+	// is retried on the next read.
+	dc_usbhid_native_submit (usbhid, index);
+
+	return status;
+}
+
+static dc_status_t
+dc_usbhid_native_write (dc_usbhid_t *usbhid, const void *data, size_t size, int *actual)
+{
+	// The output reports have a fixed size, including the report id.
+	size_t length = size < usbhid->hid.output ? size : usbhid->hid.output;
+	memcpy (usbhid->hid.buffer, data, length);
+	memset (usbhid->hid.buffer + length, 0, usbhid->hid.output - length);
+
+	OVERLAPPED overlapped;
+	memset (&overlapped, 0, sizeof (overlapped));
+	overlapped.hEvent = usbhid->hid.writer;
+
+	if (!WriteFile (usbhid->hid.handle, usbhid->hid.buffer, usbhid->hid.output, NULL, &overlapped)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (usbhid->base.context, errcode);
+			return syserror_native (errcode);
+		}
+	}
+
+	HANDLE handles[2] = {overlapped.hEvent, usbhid->hid.cancel};
+	DWORD rc = WaitForMultipleObjects (2, handles, FALSE, INFINITE);
+	if (rc != WAIT_OBJECT_0) {
+		DWORD errcode = GetLastError ();
+		DWORD transferred = 0;
+		CancelIo (usbhid->hid.handle);
+		GetOverlappedResult (usbhid->hid.handle, &overlapped, &transferred, TRUE);
+		if (rc == WAIT_OBJECT_0 + 1)
+			return DC_STATUS_CANCELLED;
+		SYSERROR (usbhid->base.context, errcode);
+		return syserror_native (errcode);
+	}
+
+	DWORD transferred = 0;
+	if (!GetOverlappedResult (usbhid->hid.handle, &overlapped, &transferred, FALSE)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (usbhid->base.context, errcode);
+		return syserror_native (errcode);
+	}
+
+	*actual = length;
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
 #endif
 
 unsigned int
@@ -358,6 +1103,24 @@ dc_usbhid_iterator_new (dc_iterator_t **out, dc_context_t *context, dc_descripto
 		goto error_free;
 	}
 
+#if defined(USE_WIN32)
+	iterator->native = dc_usbhid_native ();
+	if (iterator->native) {
+		iterator->devinfo = dc_usbhid_native_enumerate (context);
+		if (iterator->devinfo == INVALID_HANDLE_VALUE) {
+			status = DC_STATUS_IO;
+			goto error_usb_exit;
+		}
+
+		iterator->index = 0;
+		iterator->filter = dc_descriptor_get_filter (descriptor);
+
+		*out = (dc_iterator_t *) iterator;
+
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
 	// Enumerate the USB devices.
 	struct libusb_device **devices = NULL;
@@ -403,7 +1166,14 @@ static dc_status_t
 dc_usbhid_iterator_next (dc_iterator_t *abstract, void *out)
 {
 	dc_usbhid_iterator_t *iterator = (dc_usbhid_iterator_t *) abstract;
+#if defined(USE_LIBUSB) || defined(USE_HIDAPI)
 	dc_usbhid_device_t *device = NULL;
+#endif
+
+#if defined(USE_WIN32)
+	if (iterator->native)
+		return dc_usbhid_native_iterator_next (iterator, out);
+#endif
 
 #if defined(USE_LIBUSB)
 	while (iterator->current < iterator->count) {
@@ -524,6 +1294,14 @@ dc_usbhid_iterator_free (dc_iterator_t *abstract)
 {
 	dc_usbhid_iterator_t *iterator = (dc_usbhid_iterator_t *) abstract;
 
+#if defined(USE_WIN32)
+	if (iterator->native) {
+		SetupDiDestroyDeviceInfoList (iterator->devinfo);
+		dc_usbhid_exit ();
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
 	libusb_free_device_list (iterator->devices, 1);
 #elif defined(USE_HIDAPI)
@@ -535,6 +1313,229 @@ dc_usbhid_iterator_free (dc_iterator_t *abstract)
 }
 #endif
 
+#if defined(USE_LIBUSB)
+/*
+ * The hotplug callback is invoked by whichever thread is handling the
+ * libusb events, which may also be a thread reading from another device.
+ * The events are therefore only queued here, and reported to the
+ * application from dc_usbhid_hotplug_wait.
+ */
+static int LIBUSB_CALL
+dc_usbhid_hotplug_cb (libusb_context *ctx, libusb_device *current, libusb_hotplug_event event, void *userdata)
+{
+	dc_usbhid_hotplug_t *hotplug = (dc_usbhid_hotplug_t *) userdata;
+
+	// The device descriptor is cached, and remains available after the
+	// device has been disconnected.
+	struct libusb_device_descriptor dev;
+	int rc = libusb_get_device_descriptor (current, &dev);
+	if (rc < 0) {
+		ERROR (hotplug->context, "Failed to get the device descriptor (%s).",
+			libusb_error_name (rc));
+		return 0;
+	}
+
+	dc_descriptor_t *descriptor = hotplug->descriptor;
+	if (descriptor) {
+		dc_usb_desc_t usb = {dev.idVendor, dev.idProduct};
+		if (hotplug->filter && !hotplug->filter (DC_TRANSPORT_USBHID, &usb))
+			return 0;
+	} else {
+		if (dc_descriptor_find_by_usb (&descriptor, dev.idVendor, dev.idProduct) != DC_STATUS_SUCCESS)
+			return 0;
+	}
+
+	dc_mutex_lock (&g_hotplug_mutex);
+
+	if (hotplug->count == hotplug->capacity) {
+		size_t capacity = hotplug->capacity ? hotplug->capacity * 2 : 8;
+		dc_usbhid_hotplug_item_t *items = (dc_usbhid_hotplug_item_t *) realloc (hotplug->items, capacity * sizeof (dc_usbhid_hotplug_item_t));
+		if (items == NULL) {
+			dc_mutex_unlock (&g_hotplug_mutex);
+			ERROR (hotplug->context, "Failed to allocate memory.");
+			return 0;
+		}
+		hotplug->items = items;
+		hotplug->capacity = capacity;
+	}
+
+	dc_usbhid_hotplug_item_t *item = &hotplug->items[hotplug->count++];
+	item->event = (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED ?
+		DC_USBHID_HOTPLUG_ARRIVED : DC_USBHID_HOTPLUG_LEFT);
+	item->descriptor = descriptor;
+	item->vid = dev.idVendor;
+	item->pid = dev.idProduct;
+	hotplug->signalled = 1;
+
+	dc_mutex_unlock (&g_hotplug_mutex);
+
+	return 0;
+}
+#endif
+
+dc_status_t
+dc_usbhid_hotplug_new (dc_usbhid_hotplug_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_usbhid_hotplug_callback_t callback, void *userdata)
+{
+#if defined(USE_LIBUSB)
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usbhid_hotplug_t *hotplug = NULL;
+
+	if (out == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	hotplug = (dc_usbhid_hotplug_t *) malloc (sizeof (dc_usbhid_hotplug_t));
+	if (hotplug == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	hotplug->context = context;
+	hotplug->descriptor = descriptor;
+	hotplug->filter = dc_descriptor_get_filter (descriptor);
+	hotplug->callback = callback;
+	hotplug->userdata = userdata;
+	hotplug->timer = NULL;
+	hotplug->items = NULL;
+	hotplug->count = 0;
+	hotplug->capacity = 0;
+	hotplug->signalled = 0;
+
+	// Initialize the usb library.
+	status = dc_usbhid_init (context);
+	if (status != DC_STATUS_SUCCESS) {
+		goto error_free;
+	}
+
+	if (!libusb_has_capability (LIBUSB_CAP_HAS_HOTPLUG)) {
+		ERROR (context, "Usb hotplug notifications are not supported.");
+		status = DC_STATUS_UNSUPPORTED;
+		goto error_usb_exit;
+	}
+
+	status = dc_timer_new (&hotplug->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create a high resolution timer.");
+		goto error_usb_exit;
+	}
+
+	// Register the callback. The devices that are already connected are
+	// queued immediately, as arrival events.
+	int rc = libusb_hotplug_register_callback (g_usbhid_ctx,
+		LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+		LIBUSB_HOTPLUG_ENUMERATE,
+		LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY,
+		dc_usbhid_hotplug_cb, hotplug, &hotplug->handle);
+	if (rc != LIBUSB_SUCCESS) {
+		ERROR (context, "Failed to register the hotplug callback (%s).",
+			libusb_error_name (rc));
+		status = syserror (rc);
+		goto error_timer_free;
+	}
+
+	*out = hotplug;
+
+	return DC_STATUS_SUCCESS;
+
+error_timer_free:
+	dc_timer_free (hotplug->timer);
+error_usb_exit:
+	dc_usbhid_exit ();
+error_free:
+	free (hotplug->items);
+	free (hotplug);
+	return status;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_usbhid_hotplug_wait (dc_usbhid_hotplug_t *hotplug, int timeout)
+{
+#if defined(USE_LIBUSB)
+	dc_usecs_t now = 0, deadline = 0;
+
+	if (hotplug == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (timeout > 0) {
+		dc_timer_now (hotplug->timer, &now);
+		deadline = now + (dc_usecs_t) timeout * 1000;
+	}
+
+	while (1) {
+		// Take all queued events.
+		dc_mutex_lock (&g_hotplug_mutex);
+		dc_usbhid_hotplug_item_t *items = hotplug->items;
+		size_t count = hotplug->count;
+		if (count) {
+			hotplug->items = NULL;
+			hotplug->count = 0;
+			hotplug->capacity = 0;
+		}
+		hotplug->signalled = 0;
+		dc_mutex_unlock (&g_hotplug_mutex);
+
+		// Report the events without holding the lock, such that the
+		// callback can open the device.
+		if (count) {
+			for (size_t i = 0; i < count; ++i) {
+				dc_usbhid_device_t device = {items[i].vid, items[i].pid};
+				hotplug->callback (items[i].event, &device, items[i].descriptor, hotplug->userdata);
+			}
+			free (items);
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (timeout == 0)
+			return DC_STATUS_TIMEOUT;
+
+		// Handle the usb events until the callback signals a new event.
+		int rc = 0;
+		if (timeout > 0) {
+			dc_timer_now (hotplug->timer, &now);
+			if (now >= deadline)
+				return DC_STATUS_TIMEOUT;
+
+			struct timeval tv;
+			tv.tv_sec = (deadline - now) / 1000000;
+			tv.tv_usec = (deadline - now) % 1000000;
+			rc = libusb_handle_events_timeout_completed (g_usbhid_ctx, &tv, &hotplug->signalled);
+		} else {
+			rc = libusb_handle_events_completed (g_usbhid_ctx, &hotplug->signalled);
+		}
+		if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_INTERRUPTED) {
+			ERROR (hotplug->context, "Failed to handle the usb events (%s).",
+				libusb_error_name (rc));
+			return syserror (rc);
+		}
+	}
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_usbhid_hotplug_free (dc_usbhid_hotplug_t *hotplug)
+{
+#if defined(USE_LIBUSB)
+	if (hotplug == NULL)
+		return DC_STATUS_SUCCESS;
+
+	libusb_hotplug_deregister_callback (g_usbhid_ctx, hotplug->handle);
+
+	dc_timer_free (hotplug->timer);
+	dc_usbhid_exit ();
+
+	free (hotplug->items);
+	free (hotplug);
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
 dc_status_t
 dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, unsigned int vid, unsigned int pid)
 {
@@ -560,6 +1561,19 @@ dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, unsigned int vid, un
 		goto error_free;
 	}
 
+#if defined(USE_WIN32)
+	usbhid->native = dc_usbhid_native ();
+	if (usbhid->native) {
+		status = dc_usbhid_native_open (usbhid, vid, pid);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_usb_exit;
+
+		*out = (dc_iostream_t *) usbhid;
+
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
 	struct libusb_device **devices = NULL;
 	struct libusb_config_descriptor *config = NULL;
@@ -654,7 +1668,12 @@ dc_usbhid_open (dc_iostream_t **out, dc_context_t *context, unsigned int vid, un
 	usbhid->interface = interface->bInterfaceNumber;
 	usbhid->endpoint_in = ep_in->bEndpointAddress;
 	usbhid->endpoint_out = ep_out->bEndpointAddress;
+	usbhid->packetsize = ep_in->wMaxPacketSize;
 	usbhid->timeout = 0;
+	usbhid->ntransfers = 0;
+	usbhid->head = 0;
+	usbhid->npending = 0;
+	usbhid->timer = NULL;
 
 	INFO (context, "Open: interface=%u, endpoints=%02x,%02x",
 		usbhid->interface, usbhid->endpoint_in, usbhid->endpoint_out);
@@ -725,7 +1744,16 @@ dc_usbhid_close (dc_iostream_t *abstract)
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
 
+#if defined(USE_WIN32)
+	if (usbhid->native) {
+		dc_usbhid_native_close (usbhid);
+		dc_usbhid_exit ();
+		return status;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
+	dc_usbhid_async_stop (usbhid);
 	libusb_release_interface (usbhid->handle, usbhid->interface);
 	libusb_close (usbhid->handle);
 #elif defined(USE_HIDAPI)
@@ -736,11 +1764,56 @@ dc_usbhid_close (dc_iostream_t *abstract)
 	return status;
 }
 
+static dc_status_t
+dc_usbhid_cancel (dc_iostream_t *abstract)
+{
+#if defined(USE_WIN32)
+	dc_usbhid_t *native = (dc_usbhid_t *) abstract;
+
+	// Wake up any thread waiting for an input or output report. The
+	// reads remain queued, and are cancelled when the stream closes.
+	if (native->native) {
+		if (!SetEvent (native->hid.cancel)) {
+			DWORD errcode = GetLastError ();
+			SYSERROR (abstract->context, errcode);
+			return syserror_native (errcode);
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
+#if defined(USE_LIBUSB)
+	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
+
+	// Only the asynchronous transfers can be interrupted. The reading
+	// thread wakes up as soon as libusb reports the cancellation.
+	if (usbhid->ntransfers == 0)
+		return DC_STATUS_UNSUPPORTED;
+
+	for (unsigned int i = 0; i < usbhid->ntransfers; ++i) {
+		if (usbhid->state[i] == TRANSFER_PENDING)
+			libusb_cancel_transfer (usbhid->transfers[i]);
+	}
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
 static dc_status_t
 dc_usbhid_set_timeout (dc_iostream_t *abstract, int timeout)
 {
 	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
 
+#if defined(USE_WIN32)
+	if (usbhid->native) {
+		usbhid->hid.timeout = timeout < 0 ? INFINITE : (DWORD) timeout;
+		return DC_STATUS_SUCCESS;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
 	if (timeout < 0) {
 		usbhid->timeout = 0;
@@ -767,7 +1840,19 @@ dc_usbhid_read (dc_iostream_t *abstract, void *data, size_t size, size_t *actual
 	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
 	int nbytes = 0;
 
+#if defined(USE_WIN32)
+	if (usbhid->native) {
+		status = dc_usbhid_native_read (usbhid, data, size, &nbytes);
+		goto out;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
+	if (usbhid->ntransfers) {
+		status = dc_usbhid_read_async (usbhid, data, size, &nbytes);
+		goto out;
+	}
+
 	int rc = libusb_interrupt_transfer (usbhid->handle, usbhid->endpoint_in, data, size, &nbytes, usbhid->timeout);
 	if (rc != LIBUSB_SUCCESS) {
 		ERROR (abstract->context, "Usb read interrupt transfer failed (%s).",
@@ -803,6 +1888,13 @@ dc_usbhid_write (dc_iostream_t *abstract, const void *data, size_t size, size_t
 		goto out;
 	}
 
+#if defined(USE_WIN32)
+	if (usbhid->native) {
+		status = dc_usbhid_native_write (usbhid, data, size, &nbytes);
+		goto out;
+	}
+#endif
+
 #if defined(USE_LIBUSB)
 	const unsigned char *buffer = (const unsigned char *) data;
 	size_t length = size;
@@ -848,10 +1940,117 @@ out:
 
 	return status;
 }
-#else /* !USBHID */
+#endif
+
+dc_status_t
+dc_usbhid_set_async (dc_iostream_t *abstract, unsigned int count)
+{
+#if defined(USE_WIN32)
+	dc_usbhid_t *native = (dc_usbhid_t *) abstract;
+
+	// Without asynchronous reads, a single read remains in flight.
+	if (ISINSTANCE (abstract) && native->native) {
+		dc_usbhid_native_stop (native);
+
+		if (count == 0)
+			count = 1;
+		if (count > MAXTRANSFERS)
+			count = MAXTRANSFERS;
+
+		return dc_usbhid_native_start (native, count);
+	}
+#endif
+
+#if defined(USE_LIBUSB)
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_usbhid_t *usbhid = (dc_usbhid_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_usbhid_async_stop (usbhid);
+
+	if (count == 0)
+		return DC_STATUS_SUCCESS;
+
+	if (count > MAXTRANSFERS)
+		count = MAXTRANSFERS;
+
+	status = dc_timer_new (&usbhid->timer);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create a high resolution timer.");
+		return status;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		struct libusb_transfer *transfer = libusb_alloc_transfer (0);
+		unsigned char *buffer = (unsigned char *) malloc (usbhid->packetsize);
+		if (transfer == NULL || buffer == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			libusb_free_transfer (transfer);
+			free (buffer);
+			status = DC_STATUS_NOMEMORY;
+			goto error;
+		}
+
+		libusb_fill_interrupt_transfer (transfer, usbhid->handle, usbhid->endpoint_in,
+			buffer, usbhid->packetsize, dc_usbhid_transfer_cb, &usbhid->state[i], 0);
+		transfer->flags = LIBUSB_TRANSFER_FREE_BUFFER;
+
+		usbhid->transfers[i] = transfer;
+		usbhid->state[i] = TRANSFER_IDLE;
+		usbhid->ntransfers++;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		status = dc_usbhid_submit (usbhid, i);
+		if (status != DC_STATUS_SUCCESS)
+			goto error;
+	}
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	dc_usbhid_async_stop (usbhid);
+	return status;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_usbhid_set_backend (dc_usbhid_backend_t backend)
+{
+#ifdef USBHID
+	switch (backend) {
+	case DC_USBHID_BACKEND_DEFAULT:
+#if defined(USE_LIBUSB)
+	case DC_USBHID_BACKEND_LIBUSB:
+#elif defined(USE_HIDAPI)
+	case DC_USBHID_BACKEND_HIDAPI:
+#endif
+#if defined(USE_WIN32)
+	case DC_USBHID_BACKEND_NATIVE:
+#endif
+		break;
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	dc_mutex_lock (&g_usbhid_mutex);
+	g_usbhid_backend = backend;
+	dc_mutex_unlock (&g_usbhid_mutex);
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+#ifndef USBHID
 
 dc_status_t
-dc_usbhid_custom_io (dc_context_t *context, unsigned int vid, unsigned int pid)
+dc_usbhid_custom_io (dc_custom_io_t **out, dc_context_t *context, unsigned int vid, unsigned int pid)
 {
 	return DC_STATUS_UNSUPPORTED;
 }
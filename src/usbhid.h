@@ -27,11 +27,41 @@
 #include <libdivecomputer/iostream.h>
 #include <libdivecomputer/iterator.h>
 #include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/custom_io.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/**
+ * USB HID backends.
+ */
+typedef enum dc_usbhid_backend_t {
+	DC_USBHID_BACKEND_DEFAULT,
+	DC_USBHID_BACKEND_LIBUSB,
+	DC_USBHID_BACKEND_HIDAPI,
+	DC_USBHID_BACKEND_NATIVE,
+} dc_usbhid_backend_t;
+
+/**
+ * Select the backend for the USB HID devices.
+ *
+ * The backend applies to the iterators and connections created
+ * afterwards. The native backend talks to the HID class driver of
+ * Windows directly, with overlapped input and output reports, and
+ * doesn't require a replacement driver for the device. It is the
+ * default on Windows. Elsewhere, the default is libusb or hidapi,
+ * whichever the library was built with. The hotplug monitor always
+ * uses libusb.
+ *
+ * @param[in]  backend  The backend.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the backend is not available, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_usbhid_set_backend (dc_usbhid_backend_t backend);
+
 /**
  * Opaque object representing a USB HID device.
  */
@@ -73,6 +103,72 @@ dc_usbhid_device_free(dc_usbhid_device_t *device);
 dc_status_t
 dc_usbhid_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_descriptor_t *descriptor);
 
+/**
+ * Opaque object representing a USB HID hotplug monitor.
+ */
+typedef struct dc_usbhid_hotplug_t dc_usbhid_hotplug_t;
+
+/**
+ * USB HID hotplug events.
+ */
+typedef enum dc_usbhid_hotplug_event_t {
+	DC_USBHID_HOTPLUG_ARRIVED,
+	DC_USBHID_HOTPLUG_LEFT,
+} dc_usbhid_hotplug_event_t;
+
+/**
+ * Hotplug callback.
+ *
+ * The device is only valid for the duration of the callback. The
+ * descriptor is the one passed to #dc_usbhid_hotplug_new, or else the
+ * descriptor matching the USB vendor and product id of the device.
+ */
+typedef void (*dc_usbhid_hotplug_callback_t) (dc_usbhid_hotplug_event_t event, dc_usbhid_device_t *device, dc_descriptor_t *descriptor, void *userdata);
+
+/**
+ * Create a hotplug monitor for the USB HID devices.
+ *
+ * An arrival event is reported for every matching device that is
+ * already connected, followed by the arrival and removal of devices
+ * afterwards. Without a descriptor, all known dive computers, and only
+ * those, are reported. The events are reported from within
+ * #dc_usbhid_hotplug_wait, never from another thread.
+ *
+ * @param[out] hotplug     A location to store the hotplug monitor.
+ * @param[in]  context     A valid context object.
+ * @param[in]  descriptor  A valid device descriptor or NULL.
+ * @param[in]  callback    The hotplug callback.
+ * @param[in]  userdata    User data to pass to the callback.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the backend has no hotplug support, or another #dc_status_t code on
+ * failure.
+ */
+dc_status_t
+dc_usbhid_hotplug_new (dc_usbhid_hotplug_t **hotplug, dc_context_t *context, dc_descriptor_t *descriptor, dc_usbhid_hotplug_callback_t callback, void *userdata);
+
+/**
+ * Wait for hotplug events, and report them to the callback.
+ *
+ * @param[in]  hotplug  A valid hotplug monitor.
+ * @param[in]  timeout  The timeout in milliseconds, or a negative value
+ *                      to wait forever.
+ * @returns #DC_STATUS_SUCCESS if one or more events were reported,
+ * #DC_STATUS_TIMEOUT if the timeout expired, or another #dc_status_t
+ * code on failure.
+ */
+dc_status_t
+dc_usbhid_hotplug_wait (dc_usbhid_hotplug_t *hotplug, int timeout);
+
+/**
+ * Destroy the hotplug monitor and free all resources.
+ *
+ * @param[in]  hotplug  A valid hotplug monitor.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_usbhid_hotplug_free (dc_usbhid_hotplug_t *hotplug);
+
 /**
  * Open a USB HID connection.
  *
@@ -86,9 +182,28 @@ dc_usbhid_iterator_new (dc_iterator_t **iterator, dc_context_t *context, dc_desc
 dc_status_t
 dc_usbhid_open (dc_iostream_t **iostream, dc_context_t *context, unsigned int vid, unsigned int pid);
 
-/* Create a dc_custom_io_t that uses usbhid for packet transfer */
+/**
+ * Enable or disable the asynchronous input transfers.
+ *
+ * Up to count interrupt IN transfers are kept in flight, and the
+ * completed input reports are returned by the subsequent read calls,
+ * in the order they were received. This avoids idle gaps on the bus
+ * between consecutive reads. With the native backend, a single read
+ * remains in flight when disabled.
+ *
+ * @param[in]   iostream A valid USB HID connection.
+ * @param[in]   count    The number of transfers, or zero to disable.
+ * @returns #DC_STATUS_SUCCESS on success, #DC_STATUS_UNSUPPORTED if
+ * the backend has no asynchronous api, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_usbhid_set_async (dc_iostream_t *iostream, unsigned int count);
+
+/* Create a dc_custom_io_t that uses usbhid for packet transfer. The
+ * caller owns it, and its packet_close function releases it. */
 dc_status_t
-dc_usbhid_custom_io(dc_context_t *context, unsigned int vid, unsigned int pid);
+dc_usbhid_custom_io(dc_custom_io_t **out, dc_context_t *context, unsigned int vid, unsigned int pid);
 
 #ifdef __cplusplus
 }
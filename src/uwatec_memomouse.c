@@ -62,9 +62,6 @@ static const dc_device_vtable_t uwatec_memomouse_device_vtable = {
 	uwatec_memomouse_device_close /* close */
 };
 
-static dc_status_t
-uwatec_memomouse_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 dc_status_t
 uwatec_memomouse_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -94,6 +91,8 @@ uwatec_memomouse_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_iostream_configure (device->iostream, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -210,6 +209,7 @@ uwatec_memomouse_read_packet (uwatec_memomouse_device_t *device, unsigned char d
 	unsigned char crc = data[len + 1];
 	unsigned char ccrc = checksum_xor_uint8 (data, len + 1, 0x00);
 	if (crc != ccrc) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -263,6 +263,7 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 
 	unsigned int nbytes = 0;
 	unsigned int total = PACKETSIZE;
+	unsigned char ccrc = 0x00;
 	while (nbytes < total) {
 		// Calculate the packet size.
 		unsigned int length = total - nbytes;
@@ -295,6 +296,10 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 			total = array_uint16_le (packet + 1) + 3;
 
 			// Pre-allocate the required amount of memory.
+			rc = dc_context_check_memory (abstract->context, total);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
 			if (!dc_buffer_reserve (buffer, total)) {
 				ERROR (abstract->context, "Insufficient buffer space available.");
 				return DC_STATUS_NOMEMORY;
@@ -311,16 +316,19 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 		// Append the packet to the buffer.
 		dc_buffer_append (buffer, packet + 1, length);
 
+		// Update the checksum of the inner packet. Including the
+		// checksum byte itself, the result should be zero.
+		unsigned int n = length;
+		if (nbytes + n > total)
+			n = total - nbytes;
+		ccrc = checksum_xor_uint8 (packet + 1, n, ccrc);
+
 		nbytes += length;
 	}
 
-	// Obtain the pointer to the buffer contents.
-	unsigned char *data = dc_buffer_get_data (buffer);
-
 	// Verify the checksum.
-	unsigned char crc = data[total - 1];
-	unsigned char ccrc = checksum_xor_uint8 (data, total - 1, 0x00);
-	if (crc != ccrc) {
+	if (ccrc != 0x00) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -478,7 +486,7 @@ uwatec_memomouse_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_memomouse_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -497,7 +505,7 @@ uwatec_memomouse_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 }
 
 
-static dc_status_t
+dc_status_t
 uwatec_memomouse_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
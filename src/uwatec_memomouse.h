@@ -33,6 +33,9 @@ extern "C" {
 dc_status_t
 uwatec_memomouse_device_open (dc_device_t **device, dc_context_t *context, const char *name);
 
+dc_status_t
+uwatec_memomouse_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
 dc_status_t
 uwatec_memomouse_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int devtime, dc_ticks_t systime);
 
@@ -60,9 +60,6 @@ static const dc_device_vtable_t uwatec_meridian_device_vtable = {
 	uwatec_meridian_device_close /* close */
 };
 
-static dc_status_t
-uwatec_meridian_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static dc_status_t
 uwatec_meridian_transfer (uwatec_meridian_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
@@ -137,6 +134,7 @@ uwatec_meridian_transfer (uwatec_meridian_device_t *device, const unsigned char
 	ccsum = checksum_xor_uint8 (header + 1, sizeof (header) - 1, ccsum);
 	ccsum = checksum_xor_uint8 (answer, asize, ccsum);
 	if (csum != ccsum) {
+		device_stats_checksum (abstract);
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
@@ -211,6 +209,8 @@ uwatec_meridian_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	device_set_iostream ((dc_device_t *) device, device->iostream);
+
 	// Set the serial communication protocol (57600 8N1).
 	status = dc_iostream_configure (device->iostream, 57600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -363,6 +363,10 @@ uwatec_meridian_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_SUCCESS;
 
 	// Allocate the required amount of memory.
+	rc = dc_context_check_memory (abstract->context, length);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	if (!dc_buffer_resize (buffer, length)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
@@ -425,6 +429,7 @@ uwatec_meridian_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		ccsum = checksum_xor_uint8 (header, sizeof (header), ccsum);
 		ccsum = checksum_xor_uint8 (data + nbytes, packetsize - 1, ccsum);
 		if (csum != ccsum) {
+			device_stats_checksum (abstract);
 			ERROR (abstract->context, "Unexpected answer checksum.");
 			return DC_STATUS_PROTOCOL;
 		}
@@ -444,7 +449,7 @@ uwatec_meridian_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_meridian_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -463,7 +468,7 @@ uwatec_meridian_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 }
 
 
-static dc_status_t
+dc_status_t
 uwatec_meridian_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
@@ -58,9 +58,6 @@ static const dc_device_vtable_t uwatec_smart_device_vtable = {
 	uwatec_smart_device_close /* close */
 };
 
-static dc_status_t
-uwatec_smart_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
-
 static int
 uwatec_smart_filter (const char *name)
 {
@@ -146,13 +143,55 @@ uwatec_smart_handshake (uwatec_smart_device_t *device)
 }
 
 
+static dc_status_t
+uwatec_smart_discover (dc_context_t *context, unsigned int *address)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_iterator_t *iterator = NULL;
+
+	// Create the irda device iterator.
+	status = dc_irda_iterator_new (&iterator, context, NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the irda iterator.");
+		return status;
+	}
+
+	// Enumerate the irda devices.
+	while (1) {
+		dc_irda_device_t *current = NULL;
+		status = dc_iterator_next (iterator, &current);
+		if (status != DC_STATUS_SUCCESS) {
+			if (status == DC_STATUS_DONE) {
+				ERROR (context, "No dive computer found.");
+				status = DC_STATUS_NODEVICE;
+			} else {
+				ERROR (context, "Failed to enumerate the irda devices.");
+			}
+			break;
+		}
+
+		int match = uwatec_smart_filter (dc_irda_device_get_name (current));
+		if (match) {
+			*address = dc_irda_device_get_address (current);
+		}
+
+		dc_irda_device_free (current);
+
+		if (match)
+			break;
+	}
+
+	dc_iterator_free (iterator);
+
+	return status;
+}
+
+
 dc_status_t
 uwatec_smart_device_open (dc_device_t **out, dc_context_t *context)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	uwatec_smart_device_t *device = NULL;
-	dc_iterator_t *iterator = NULL;
-	dc_irda_device_t *dev = NULL;
 
 	if (out == NULL)
 		return DC_STATUS_INVALIDARGS;
@@ -170,41 +209,34 @@ uwatec_smart_device_open (dc_device_t **out, dc_context_t *context)
 	device->systime = (dc_ticks_t) -1;
 	device->devtime = 0;
 
-	// Create the irda device iterator.
-	status = dc_irda_iterator_new (&iterator, context, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to create the irda iterator.");
-		goto error_free;
+	// Connect directly to a recently seen dive computer, to skip the
+	// discovery. If it's no longer there, discover it again.
+	unsigned int address = dc_irda_cache_lookup (context, uwatec_smart_filter);
+	if (address) {
+		status = dc_irda_open (&device->iostream, context, address, 1);
+		if (status != DC_STATUS_SUCCESS) {
+			WARNING (context, "Failed to connect to the cached address.");
+			dc_irda_cache_invalidate (context, address);
+			device->iostream = NULL;
+			address = 0;
+		}
 	}
 
-	// Enumerate the irda devices.
-	while (1) {
-		dc_irda_device_t *current = NULL;
-		status = dc_iterator_next (iterator, &current);
+	if (address == 0) {
+		status = uwatec_smart_discover (context, &address);
 		if (status != DC_STATUS_SUCCESS) {
-			if (status == DC_STATUS_DONE) {
-				ERROR (context, "No dive computer found.");
-				status = DC_STATUS_NODEVICE;
-			} else {
-				ERROR (context, "Failed to enumerate the irda devices.");
-			}
-			goto error_iterator_free;
+			goto error_free;
 		}
 
-		if (uwatec_smart_filter (dc_irda_device_get_name (current))) {
-			dev = current;
-			break;
+		// Open the irda socket.
+		status = dc_irda_open (&device->iostream, context, address, 1);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to open the irda socket.");
+			goto error_free;
 		}
-
-		dc_irda_device_free (current);
 	}
 
-	// Open the irda socket.
-	status = dc_irda_open (&device->iostream, context, dc_irda_device_get_address (dev), 1);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to open the irda socket.");
-		goto error_device_free;
-	}
+	device_set_iostream ((dc_device_t *) device, device->iostream);
 
 	// Perform the handshaking.
 	status = uwatec_smart_handshake (device);
@@ -219,16 +251,11 @@ uwatec_smart_device_open (dc_device_t **out, dc_context_t *context)
 
 error_close:
 	dc_iostream_close (device->iostream);
-error_device_free:
-	dc_irda_device_free (dev);
-error_iterator_free:
-	dc_iterator_free (iterator);
 error_free:
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
 }
 
-
 static dc_status_t
 uwatec_smart_device_close (dc_device_t *abstract)
 {
@@ -337,6 +364,10 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_SUCCESS;
 
 	// Allocate the required amount of memory.
+	rc = dc_context_check_memory (abstract->context, length);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
 	if (!dc_buffer_resize (buffer, length)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
@@ -396,7 +427,11 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	// The dives are extracted only after the download is complete. The
+	// device sends them oldest first, while they have to be returned
+	// newest first, so the last dive is needed before the first one can
+	// be passed to the callback.
+	dc_buffer_t *buffer = dc_buffer_new2 (abstract->context, 0);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
@@ -415,7 +450,7 @@ uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 }
 
 
-static dc_status_t
+dc_status_t
 uwatec_smart_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
 {
 	if (abstract && !ISINSTANCE (abstract))
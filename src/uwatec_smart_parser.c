@@ -55,6 +55,10 @@
 
 #define NEVENTS   3
 #define NGASMIXES 10
+#define NSAMPLES  20
+
+#define MULTIBYTE 0xFF
+#define NOSLOT    0xFF
 
 #define HEADER  1
 #define PROFILE 2
@@ -114,6 +118,14 @@ typedef struct uwatec_smart_sample_info_t {
 	unsigned int extrabytes;
 } uwatec_smart_sample_info_t;
 
+// Precomputed decoding info for each sample type.
+typedef struct uwatec_smart_decoder_t {
+	unsigned int ntypebytes;
+	unsigned int partial;
+	unsigned int mask;
+	unsigned int nbits;
+} uwatec_smart_decoder_t;
+
 typedef struct uwatec_smart_event_info_t {
 	uwatec_smart_event_t type;
 	unsigned int mask;
@@ -144,6 +156,9 @@ struct uwatec_smart_parser_t {
 	const uwatec_smart_header_info_t *header;
 	unsigned int headersize;
 	unsigned int nsamples;
+	// Sample type of each first byte, and the decoding info.
+	unsigned char dispatch[256];
+	uwatec_smart_decoder_t decoder[NSAMPLES];
 	const uwatec_smart_event_info_t *events[NEVENTS];
 	unsigned int nevents[NEVENTS];
 	unsigned int trimix;
@@ -153,6 +168,9 @@ struct uwatec_smart_parser_t {
 	uwatec_smart_gasmix_t gasmix[NGASMIXES];
 	unsigned int ntanks;
 	uwatec_smart_tank_t tank[NGASMIXES];
+	// Slot of each gas mix and tank id.
+	unsigned char gasmix_slot[NGASMIXES];
+	unsigned char tank_slot[NGASMIXES];
 	dc_water_t watertype;
 	dc_divemode_t divemode;
 };
@@ -162,7 +180,9 @@ static dc_status_t uwatec_smart_parser_get_datetime (dc_parser_t *abstract, dc_d
 static dc_status_t uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
 
+static dc_status_t uwatec_smart_scan (uwatec_smart_parser_t *parser);
 static dc_status_t uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata);
+static void uwatec_smart_build_dispatch (uwatec_smart_parser_t *parser);
 
 static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	sizeof(uwatec_smart_parser_t),
@@ -171,6 +191,9 @@ static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	uwatec_smart_parser_get_datetime, /* datetime */
 	uwatec_smart_parser_get_field, /* fields */
 	uwatec_smart_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_batch */
+	NULL, /* samples_range */
+	NULL, /* samples_feed */
 	NULL /* destroy */
 };
 
@@ -409,27 +432,19 @@ uwatec_smart_event_info_t uwatec_smart_trimix_events_2[] = {
 static unsigned int
 uwatec_smart_find_gasmix (uwatec_smart_parser_t *parser, unsigned int id)
 {
-       unsigned int i = 0;
-       while (i < parser->ngasmixes) {
-               if (id == parser->gasmix[i].id)
-                       break;
-               i++;
-       }
-
-       return i;
+	if (id >= NGASMIXES || parser->gasmix_slot[id] >= parser->ngasmixes)
+		return parser->ngasmixes;
+
+	return parser->gasmix_slot[id];
 }
 
 static unsigned int
 uwatec_smart_find_tank (uwatec_smart_parser_t *parser, unsigned int id)
 {
-       unsigned int i = 0;
-       while (i < parser->ntanks) {
-               if (id == parser->tank[i].id)
-                       break;
-               i++;
-       }
-
-       return i;
+	if (id >= NGASMIXES || parser->tank_slot[id] >= parser->ntanks)
+		return parser->ntanks;
+
+	return parser->tank_slot[id];
 }
 
 static dc_status_t
@@ -549,10 +564,12 @@ uwatec_smart_parser_cache (uwatec_smart_parser_t *parser)
 	parser->ngasmixes = ngasmixes;
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->gasmix[i] = gasmix[i];
+		parser->gasmix_slot[gasmix[i].id] = i;
 	}
 	parser->ntanks = ntanks;
 	for (unsigned int i = 0; i < ntanks; ++i) {
 		parser->tank[i] = tank[i];
+		parser->tank_slot[tank[i].id] = i;
 	}
 	parser->watertype = watertype;
 	parser->divemode = divemode;
@@ -668,6 +685,8 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		goto error_free;
 	}
 
+	uwatec_smart_build_dispatch (parser);
+
 	parser->cached = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
@@ -679,6 +698,8 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		parser->tank[i].beginpressure = 0;
 		parser->tank[i].endpressure = 0;
 		parser->tank[i].gasmix = 0;
+		parser->gasmix_slot[i] = NOSLOT;
+		parser->tank_slot[i] = NOSLOT;
 	}
 	parser->watertype = DC_WATER_FRESH;
 	parser->divemode = DC_DIVEMODE_OC;
@@ -710,6 +731,8 @@ uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 		parser->tank[i].beginpressure = 0;
 		parser->tank[i].endpressure = 0;
 		parser->tank[i].gasmix = 0;
+		parser->gasmix_slot[i] = NOSLOT;
+		parser->tank_slot[i] = NOSLOT;
 	}
 	parser->watertype = DC_WATER_FRESH;
 	parser->divemode = DC_DIVEMODE_OC;
@@ -767,7 +790,7 @@ uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 
 	// Cache the profile data.
 	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
+		rc = uwatec_smart_scan (parser);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -898,6 +921,220 @@ uwatec_smart_fixsignbit (unsigned int x, unsigned int n)
 }
 
 
+/*
+ * Precompute the sample type for every possible first byte, and how
+ * the data bits of each type are laid out, such that identifying and
+ * extracting a sample is a table lookup. Only the Smart type bits can
+ * continue into the next byte, which is left to uwatec_smart_identify.
+ */
+static void
+uwatec_smart_build_dispatch (uwatec_smart_parser_t *parser)
+{
+	const uwatec_smart_sample_info_t *table = parser->samples;
+	unsigned int galileo = (table == uwatec_smart_galileo_samples);
+
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned char value = i;
+		if (galileo) {
+			parser->dispatch[i] = uwatec_galileo_identify (value);
+		} else if (value == 0xFF) {
+			parser->dispatch[i] = MULTIBYTE;
+		} else {
+			parser->dispatch[i] = uwatec_smart_identify (&value, 1);
+		}
+	}
+
+	for (unsigned int i = 0; i < parser->nsamples && i < NSAMPLES; ++i) {
+		uwatec_smart_decoder_t *decoder = parser->decoder + i;
+		unsigned int n = table[i].ntypebits % NBITS;
+
+		decoder->ntypebytes = table[i].ntypebits / NBITS;
+		decoder->partial = (n > 0);
+		decoder->mask = 0;
+		decoder->nbits = NBITS * table[i].extrabytes;
+		if (n > 0 && !table[i].ignoretype) {
+			// The last type byte also contains data bits,
+			// except for certain samples.
+			decoder->mask = 0xFF >> n;
+			decoder->nbits += NBITS - n;
+		}
+	}
+}
+
+
+/*
+ * Walk the profile to collect the gas mixes and tanks which are only
+ * defined in the sample data. Only the record boundaries, the gas mix
+ * definitions and the gas switches are decoded, and the same errors as
+ * in the full decoding are reported. Afterwards, the tables are
+ * complete, and the samples can be emitted in a single decoding pass.
+ */
+static dc_status_t
+uwatec_smart_scan (uwatec_smart_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	const uwatec_smart_sample_info_t *table = parser->samples;
+	unsigned int entries = parser->nsamples;
+
+	unsigned int gasmix = 0;
+	unsigned int gasmix_previous = 0xFFFFFFFF;
+
+	unsigned int offset = parser->headersize;
+	while (offset < size) {
+		if (dc_parser_work (abstract, 1, 0, 0) != DC_STATUS_SUCCESS)
+			return DC_STATUS_DATAFORMAT;
+
+		// Process the type bits in the bitstream.
+		unsigned int id = parser->dispatch[data[offset]];
+		if (id == MULTIBYTE) {
+			// Uwatec Smart
+			id = uwatec_smart_identify (data + offset, size - offset);
+		}
+		if (id >= entries || id >= NSAMPLES) {
+			ERROR (abstract->context, "Invalid type bits.");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		const uwatec_smart_decoder_t *decoder = parser->decoder + id;
+
+		offset += decoder->ntypebytes;
+
+		unsigned int value = 0;
+		if (decoder->partial) {
+			value = data[offset] & decoder->mask;
+			offset++;
+		}
+
+		if (offset + table[id].extrabytes > size) {
+			ERROR (abstract->context, "Incomplete sample data.");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		value = (value << (NBITS * table[id].extrabytes)) | array_uint_be (data + offset, table[id].extrabytes);
+		offset += table[id].extrabytes;
+
+		unsigned int idx = 0;
+		unsigned int subtype = 0;
+		int complete = 0;
+		switch (table[id].type) {
+		case PRESSURE_DEPTH:
+			complete = 1;
+			break;
+		case PRESSURE:
+			if (table[id].absolute) {
+				if (parser->trimix) {
+					gasmix = (value & 0xF000) >> 12;
+				} else {
+					gasmix = table[id].index;
+				}
+			}
+			break;
+		case DEPTH:
+			complete = 1;
+			break;
+		case ALARMS:
+			idx = table[id].index;
+			if (idx >= NEVENTS || parser->events[idx] == NULL) {
+				ERROR (abstract->context, "Unexpected event index.");
+				return DC_STATUS_DATAFORMAT;
+			}
+
+			for (unsigned int i = 0; i < parser->nevents[idx]; ++i) {
+				const uwatec_smart_event_info_t *event = parser->events[idx] + i;
+				if (event->type == EV_GASMIX) {
+					gasmix = (value & event->mask) >> event->shift;
+				}
+			}
+			break;
+		case TIME:
+			complete = value;
+			break;
+		case APNEA:
+			if (offset + 8 > size) {
+				ERROR (abstract->context, "Incomplete sample data.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			offset += 8;
+			break;
+		case MISC:
+			if (value < 1 || offset + value - 1 > size) {
+				ERROR (abstract->context, "Incomplete sample data.");
+				return DC_STATUS_DATAFORMAT;
+			}
+
+			subtype = data[offset];
+			if (subtype >= 32 && subtype <= 41) {
+				if (value < 16) {
+					ERROR (abstract->context, "Incomplete sample data.");
+					return DC_STATUS_DATAFORMAT;
+				}
+				unsigned int mixid = subtype - 32;
+				unsigned int mixidx = DC_GASMIX_UNKNOWN;
+				unsigned int o2 = array_uint16_le (data + offset + 1);
+				unsigned int he = array_uint16_le (data + offset + 3);
+				unsigned int beginpressure = array_uint16_le (data + offset + 5);
+				unsigned int endpressure   = array_uint16_le (data + offset + 7);
+
+				if (o2 != 0 || he != 0) {
+					idx = uwatec_smart_find_gasmix (parser, mixid);
+					if (idx >= parser->ngasmixes) {
+						if (idx >= NGASMIXES) {
+							ERROR (abstract->context, "Maximum number of gas mixes reached.");
+							return DC_STATUS_NOMEMORY;
+						}
+						parser->gasmix[idx].id = mixid;
+						parser->gasmix[idx].oxygen = o2;
+						parser->gasmix[idx].helium = he;
+						parser->gasmix_slot[mixid] = idx;
+						parser->ngasmixes++;
+					}
+					mixidx = idx;
+				}
+
+				if ((beginpressure != 0 || endpressure != 0) &&
+					(beginpressure != 0xFFFF) && (endpressure != 0xFFFF)) {
+					idx = uwatec_smart_find_tank (parser, mixid);
+					if (idx >= parser->ntanks) {
+						if (idx >= NGASMIXES) {
+							ERROR (abstract->context, "Maximum number of tanks reached.");
+							return DC_STATUS_NOMEMORY;
+						}
+						parser->tank[idx].id = mixid;
+						parser->tank[idx].beginpressure = beginpressure;
+						parser->tank[idx].endpressure = endpressure;
+						parser->tank[idx].gasmix = mixidx;
+						parser->tank_slot[mixid] = idx;
+						parser->ntanks++;
+					}
+				}
+			}
+
+			offset += value - 1;
+			break;
+		default:
+			break;
+		}
+
+		// A gas switch to a mix which is not defined yet is an error.
+		if (complete && parser->ngasmixes && gasmix != gasmix_previous) {
+			if (uwatec_smart_find_gasmix (parser, gasmix) >= parser->ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			gasmix_previous = gasmix;
+		}
+	}
+
+	parser->cached = PROFILE;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback, void *userdata)
 {
@@ -950,40 +1187,30 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 	while (offset < size) {
 		dc_sample_value_t sample = {0};
 
+		if (dc_parser_work (abstract, 1, 0, 0) != DC_STATUS_SUCCESS)
+			return DC_STATUS_DATAFORMAT;
+
 		// Process the type bits in the bitstream.
-		unsigned int id = 0;
-		if (parser->model == GALILEO || parser->model == GALILEOTRIMIX ||
-			parser->model == ALADIN2G || parser->model == MERIDIAN ||
-			parser->model == CHROMIS || parser->model == MANTIS2 ||
-			parser->model == G2 || parser->model == ALADINSPORTMATRIX ||
-			parser->model == ALADINSQUARE) {
-			// Uwatec Galileo
-			id = uwatec_galileo_identify (data[offset]);
-		} else {
+		unsigned int id = parser->dispatch[data[offset]];
+		if (id == MULTIBYTE) {
 			// Uwatec Smart
 			id = uwatec_smart_identify (data + offset, size - offset);
 		}
-		if (id >= entries) {
+		if (id >= entries || id >= NSAMPLES) {
 			ERROR (abstract->context, "Invalid type bits.");
 			return DC_STATUS_DATAFORMAT;
 		}
 
+		const uwatec_smart_decoder_t *decoder = parser->decoder + id;
+
 		// Skip the processed type bytes.
-		offset += table[id].ntypebits / NBITS;
+		offset += decoder->ntypebytes;
 
 		// Process the remaining data bits.
-		unsigned int nbits = 0;
+		unsigned int nbits = decoder->nbits;
 		unsigned int value = 0;
-		unsigned int n = table[id].ntypebits % NBITS;
-		if (n > 0) {
-			nbits = NBITS - n;
-			value = data[offset] & (0xFF >> n);
-			if (table[id].ignoretype) {
-				// Ignore any data bits that are stored in
-				// the last type byte for certain samples.
-				nbits = 0;
-				value = 0;
-			}
+		if (decoder->partial) {
+			value = data[offset] & decoder->mask;
 			offset++;
 		}
 
@@ -994,19 +1221,14 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 		}
 
 		// Process the extra data bytes.
-		for (unsigned int i = 0; i < table[id].extrabytes; ++i) {
-			nbits += NBITS;
-			value <<= NBITS;
-			value += data[offset];
-			offset++;
-		}
+		value = (value << (NBITS * table[id].extrabytes)) | array_uint_be (data + offset, table[id].extrabytes);
+		offset += table[id].extrabytes;
 
 		// Fix the sign bit.
 		signed int svalue = uwatec_smart_fixsignbit (value, nbits);
 
 		// Parse the value.
 		unsigned int idx = 0;
-		unsigned int subtype = 0;
 		unsigned int nevents = 0;
 		const uwatec_smart_event_info_t *events = NULL;
 		switch (table[id].type) {
@@ -1112,51 +1334,6 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 				return DC_STATUS_DATAFORMAT;
 			}
 
-			subtype = data[offset];
-			if (subtype >= 32 && subtype <= 41) {
-				if (value < 16) {
-					ERROR (abstract->context, "Incomplete sample data.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				unsigned int mixid = subtype - 32;
-				unsigned int mixidx = DC_GASMIX_UNKNOWN;
-				unsigned int o2 = array_uint16_le (data + offset + 1);
-				unsigned int he = array_uint16_le (data + offset + 3);
-				unsigned int beginpressure = array_uint16_le (data + offset + 5);
-				unsigned int endpressure   = array_uint16_le (data + offset + 7);
-
-				if (o2 != 0 || he != 0) {
-					idx = uwatec_smart_find_gasmix (parser, mixid);
-					if (idx >= parser->ngasmixes) {
-						if (idx >= NGASMIXES) {
-							ERROR (abstract->context, "Maximum number of gas mixes reached.");
-							return DC_STATUS_NOMEMORY;
-						}
-						parser->gasmix[idx].id = mixid;
-						parser->gasmix[idx].oxygen = o2;
-						parser->gasmix[idx].helium = he;
-						parser->ngasmixes++;
-					}
-					mixidx = idx;
-				}
-
-				if ((beginpressure != 0 || endpressure != 0) &&
-					(beginpressure != 0xFFFF) && (endpressure != 0xFFFF)) {
-					idx = uwatec_smart_find_tank (parser, mixid);
-					if (idx >= parser->ntanks) {
-						if (idx >= NGASMIXES) {
-							ERROR (abstract->context, "Maximum number of tanks reached.");
-							return DC_STATUS_NOMEMORY;
-						}
-						parser->tank[idx].id = mixid;
-						parser->tank[idx].beginpressure = beginpressure;
-						parser->tank[idx].endpressure = endpressure;
-						parser->tank[idx].gasmix = mixidx;
-						parser->ntanks++;
-					}
-				}
-			}
-
 			offset += value - 1;
 			break;
 		default:
@@ -1227,8 +1404,6 @@ uwatec_smart_parse (uwatec_smart_parser_t *parser, dc_sample_callback_t callback
 		}
 	}
 
-	parser->cached = PROFILE;
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -1245,7 +1420,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 	// Cache the profile data.
 	if (parser->cached < PROFILE) {
-		rc = uwatec_smart_parse (parser, NULL, NULL);
+		rc = uwatec_smart_scan (parser);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}